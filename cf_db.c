@@ -39,6 +39,14 @@ cf_db_open_sql(const char *db_path, bool ro, cf_db_t *out)
 	return sql_db_open(db_path, ro, &out->sql);
 }
 
+int
+cf_db_open_log(const char *dir, cf_db_t *out)
+{
+	memset(out, 0, sizeof(*out));
+	out->db_kind = db_kind_log;
+	return log_db_open(dir, &out->log);
+}
+
 /*
  * Free a database created from a previous successful _open() call.
  *
@@ -46,6 +54,7 @@ cf_db_open_sql(const char *db_path, bool ro, cf_db_t *out)
  * - cf_db_open_nop()
  * - cf_db_open_mem()
  * - cf_db_open_sql()
+ * - cf_db_open_log()
  * need to be followed with a call to this function.
  */
 int
@@ -58,6 +67,8 @@ cf_db_close(cf_db_t *db)
 			return mem_db_close(&db->mem);
 		case db_kind_sql:
 			return sql_db_close(&db->sql);
+		case db_kind_log:
+			return log_db_close(&db->log);
 	}
 	cf_panic("unknown database impl %d\n", db->db_kind);
 }
@@ -68,19 +79,218 @@ cf_db_close(cf_db_t *db)
  * On success, a reference to the file is returned via `out`. This function
  * succeeds if either the file is new, or the file preexists.
  *
+ * `*alias_out` is set to true if `path` has the same contents as another file
+ * already in `db`. `out` then refers to that other file, and whatever `path`
+ * declares is already in `db`. Only the sql database deduplicates files.
+ *
  * Note: although `path` is a filesystem path, it need not be NUL terminated.
  * It is `len` bytes *excluding* any terminator.
  */
 int
-cf_db_add_file(cf_db_t *db, const char *path, size_t len, file_ref_t *out)
+cf_db_add_file(cf_db_t *db, const char *path, size_t len, file_ref_t *out,
+		bool *alias_out)
 {
 	switch (db->db_kind) {
 		case db_kind_nop:
+			*alias_out = false;
 			return nop_db_add_file(&db->nop, path, len, &out->rowid);
 		case db_kind_mem:
+			*alias_out = false;
 			return mem_db_add_file(&db->mem, path, len, &out->index);
 		case db_kind_sql:
-			return sql_db_add_file(&db->sql, path, len, &out->rowid);
+			return sql_db_add_file(&db->sql, path, len, &out->rowid,
+					alias_out);
+		case db_kind_log:
+			*alias_out = false;
+			return log_db_add_file(&db->log, path, len, &out->rowid);
+	}
+	cf_panic("unknown database impl %d\n", db->db_kind);
+}
+
+/*
+ * Queue `path` to be resolved by the next cf_db_resolve_files().
+ *
+ * A later cf_db_add_file() of the same path then skips resolving it. This is
+ * only a hint: the sql database resolves every queued path at once instead of
+ * one at a time as they're added. The others ignore it.
+ */
+int
+cf_db_prefetch_file(cf_db_t *db, const char *path, size_t len)
+{
+	switch (db->db_kind) {
+		case db_kind_nop:
+			CF_FALLTHROUGH;
+		case db_kind_mem:
+			CF_FALLTHROUGH;
+		case db_kind_log:
+			return 0;
+		case db_kind_sql:
+			return sql_db_prefetch_file(&db->sql, path, len);
+	}
+	cf_panic("unknown database impl %d\n", db->db_kind);
+}
+
+/*
+ * Resolve every path queued with cf_db_prefetch_file().
+ */
+void
+cf_db_resolve_files(cf_db_t *db)
+{
+	switch (db->db_kind) {
+		case db_kind_nop:
+			CF_FALLTHROUGH;
+		case db_kind_mem:
+			CF_FALLTHROUGH;
+		case db_kind_log:
+			return;
+		case db_kind_sql:
+			sql_db_resolve_files(&db->sql);
+			return;
+	}
+	cf_panic("unknown database impl %d\n", db->db_kind);
+}
+
+/*
+ * Set whether files added to `db` from now on are indexed approximately.
+ *
+ * Entries from approximate files are tagged so that adding the same file
+ * later, with `approx` false, replaces them. Only the sql database persists
+ * between runs, so the others ignore this.
+ */
+int
+cf_db_set_approx(cf_db_t *db, bool approx)
+{
+	switch (db->db_kind) {
+		case db_kind_nop:
+			CF_FALLTHROUGH;
+		case db_kind_mem:
+			CF_FALLTHROUGH;
+		case db_kind_log:
+			return 0;
+		case db_kind_sql:
+			return sql_db_set_approx(&db->sql, approx);
+	}
+	cf_panic("unknown database impl %d\n", db->db_kind);
+}
+
+/*
+ * Set when the write-ahead log of `db` is checkpointed.
+ *
+ * Only the sql database has a write-ahead log. The others ignore this.
+ */
+int
+cf_db_set_wal_policy(cf_db_t *db, const wal_policy_t *policy)
+{
+	switch (db->db_kind) {
+		case db_kind_nop:
+			CF_FALLTHROUGH;
+		case db_kind_mem:
+			CF_FALLTHROUGH;
+		case db_kind_log:
+			return 0;
+		case db_kind_sql:
+			return sql_db_set_wal_policy(&db->sql, policy);
+	}
+	cf_panic("unknown database impl %d\n", db->db_kind);
+}
+
+/*
+ * Mark a point where it's cheap to checkpoint the write-ahead log of `db`.
+ *
+ * Whether anything happens depends on the policy set with
+ * cf_db_set_wal_policy().
+ */
+int
+cf_db_checkpoint(cf_db_t *db)
+{
+	switch (db->db_kind) {
+		case db_kind_nop:
+			CF_FALLTHROUGH;
+		case db_kind_mem:
+			CF_FALLTHROUGH;
+		case db_kind_log:
+			return 0;
+		case db_kind_sql:
+			return sql_db_checkpoint(&db->sql);
+	}
+	cf_panic("unknown database impl %d\n", db->db_kind);
+}
+
+/*
+ * Record that the TU whose main file is `tu` depends on file `dep`.
+ *
+ * Only the sql database persists between runs, so it's the only one that
+ * needs dependencies to do incremental reindexing. The log database records
+ * them for compaction into one. The others ignore them.
+ */
+int
+cf_db_tu_dep_insert(cf_db_t *db, file_ref_t tu, file_ref_t dep)
+{
+	switch (db->db_kind) {
+		case db_kind_nop:
+			CF_FALLTHROUGH;
+		case db_kind_mem:
+			return 0;
+		case db_kind_sql:
+			return sql_db_tu_dep_insert(&db->sql, tu.rowid, dep.rowid);
+		case db_kind_log:
+			return log_db_tu_dep_insert(&db->log, tu.rowid, dep.rowid);
+	}
+	cf_panic("unknown database impl %d\n", db->db_kind);
+}
+
+/*
+ * Store source lines `lines` of file `file` for cf_db_snippet_lookup().
+ *
+ * `lines` must be sorted by line number without duplicates. Lines already
+ * stored for `file` are kept.
+ *
+ * Snippets exist so a search can print context without the sources, which
+ * only matters for a database that outlives the indexer: sql, or log until
+ * it's compacted. The others ignore them.
+ */
+int
+cf_db_snippet_insert(cf_db_t *db, file_ref_t file, const db_snippet_t *lines,
+		size_t num_lines)
+{
+	switch (db->db_kind) {
+		case db_kind_nop:
+			CF_FALLTHROUGH;
+		case db_kind_mem:
+			return 0;
+		case db_kind_sql:
+			return sql_db_snippet_insert(&db->sql, file.rowid, lines,
+					num_lines);
+		case db_kind_log:
+			return log_db_snippet_insert(&db->log, file.rowid, lines,
+					num_lines);
+	}
+	cf_panic("unknown database impl %d\n", db->db_kind);
+}
+
+/*
+ * Purge everything in `db` that's out of date with respect to version control
+ * snapshot `tree`.
+ *
+ * On success, the main file of each TU that need not be reindexed is inserted
+ * into `clean_tus_out` as a key. `tree` must outlive `db`; files added later
+ * are stamped with their id from `tree`.
+ *
+ * A database that starts empty every run (nop, mem, log) never has anything
+ * out of date. Nothing is inserted into `clean_tus_out` for them.
+ */
+int
+cf_db_vcs_sync(cf_db_t *db, const vcs_tree_t *tree, cf_map8_t *clean_tus_out)
+{
+	switch (db->db_kind) {
+		case db_kind_nop:
+			CF_FALLTHROUGH;
+		case db_kind_mem:
+			CF_FALLTHROUGH;
+		case db_kind_log:
+			return 0;
+		case db_kind_sql:
+			return sql_db_vcs_sync(&db->sql, tree, clean_tus_out);
 	}
 	cf_panic("unknown database impl %d\n", db->db_kind);
 }
@@ -94,8 +304,7 @@ cf_db_add_file(cf_db_t *db, const char *path, size_t len, file_ref_t *out)
  *
  * The bits checked for a match are:
  * - loc->file
- * - loc->scope
- *   (XXX unimplemented)
+ * - loc->scope and loc->func
  * - name->name
  * - name->kind
  */
@@ -110,6 +319,35 @@ cf_db_typename_lookup(cf_db_t *db, const loc_ctx_t *loc,
 			return mem_db_typename_lookup(&db->mem, loc, name, &out->index);
 		case db_kind_sql:
 			return sql_db_typename_lookup(&db->sql, loc, name, &out->rowid);
+		case db_kind_log:
+			return log_db_typename_lookup(&db->log, loc, name, &out->rowid);
+	}
+	cf_panic("unknown database impl %d\n", db->db_kind);
+}
+
+/*
+ * Look up `num_keys` typenames at once.
+ *
+ * The result for `keys[i]` is written to `out[i]`: a reference to the type,
+ * like cf_db_typename_lookup(), or zero if there's no match. Unlike
+ * cf_db_typename_lookup(), a missing name is not an error.
+ *
+ * sqlite resolves the keys with one join per batch of keys, rather than one
+ * query per key. mem and log look each key up in their typename hash index.
+ */
+int
+cf_db_typename_lookup_many(cf_db_t *db, const db_typename_key_t *keys,
+		size_t num_keys, type_ref_t *out)
+{
+	switch (db->db_kind) {
+		case db_kind_nop:
+			return nop_db_typename_lookup_many(&db->nop, keys, num_keys, out);
+		case db_kind_mem:
+			return mem_db_typename_lookup_many(&db->mem, keys, num_keys, out);
+		case db_kind_sql:
+			return sql_db_typename_lookup_many(&db->sql, keys, num_keys, out);
+		case db_kind_log:
+			return log_db_typename_lookup_many(&db->log, keys, num_keys, out);
 	}
 	cf_panic("unknown database impl %d\n", db->db_kind);
 }
@@ -133,6 +371,8 @@ cf_db_type_insert(cf_db_t *db, const loc_ctx_t *loc,
 			return mem_db_type_insert(&db->mem, loc, entry, &out->index);
 		case db_kind_sql:
 			return sql_db_type_insert(&db->sql, loc, entry, &out->rowid);
+		case db_kind_log:
+			return log_db_type_insert(&db->log, loc, entry, &out->rowid);
 	}
 	cf_panic("unknown database impl %d\n", db->db_kind);
 }
@@ -148,6 +388,8 @@ cf_db_typename_insert(cf_db_t *db, const loc_ctx_t *loc,
 			return mem_db_typename_insert(&db->mem, loc, entry);
 		case db_kind_sql:
 			return sql_db_typename_insert(&db->sql, loc, entry);
+		case db_kind_log:
+			return log_db_typename_insert(&db->log, loc, entry);
 	}
 	cf_panic("unknown database impl %d\n", db->db_kind);
 }
@@ -163,6 +405,8 @@ cf_db_member_insert(cf_db_t *db, const loc_ctx_t *loc,
 			return mem_db_member_insert(&db->mem, loc, entry);
 		case db_kind_sql:
 			return sql_db_member_insert(&db->sql, loc, entry);
+		case db_kind_log:
+			return log_db_member_insert(&db->log, loc, entry);
 	}
 	cf_panic("unknown database impl %d\n", db->db_kind);
 }
@@ -178,6 +422,36 @@ cf_db_type_use_insert(cf_db_t *db, const loc_ctx_t *loc,
 			return mem_db_type_use_insert(&db->mem, loc, entry);
 		case db_kind_sql:
 			return sql_db_type_use_insert(&db->sql, loc, entry);
+		case db_kind_log:
+			return log_db_type_use_insert(&db->log, loc, entry);
+	}
+	cf_panic("unknown database impl %d\n", db->db_kind);
+}
+
+/*
+ * Add `entry->count` uses to the stored count for the type, file, and kind in
+ * `entry`. The indexer uses this instead of a cf_db_type_use_insert() per use
+ * when it aggregates type uses.
+ *
+ * If `max` is set, the stored count is replaced by `entry->count` only if
+ * that's larger. Merging uses this so the same file indexed in several
+ * fragments isn't counted more than once.
+ *
+ * A log doesn't keep counts; it returns ENOTSUP.
+ */
+int
+cf_db_type_use_count_insert(cf_db_t *db, const db_type_use_count_t *entry,
+		bool max)
+{
+	switch (db->db_kind) {
+		case db_kind_nop:
+			return nop_db_type_use_count_insert(&db->nop, entry, max);
+		case db_kind_mem:
+			return mem_db_type_use_count_insert(&db->mem, entry, max);
+		case db_kind_sql:
+			return sql_db_type_use_count_insert(&db->sql, entry, max);
+		case db_kind_log:
+			return ENOTSUP;
 	}
 	cf_panic("unknown database impl %d\n", db->db_kind);
 }
@@ -197,11 +471,37 @@ cf_db_file_lookup(cf_db_t *db, file_ref_t id, cf_str_t *out)
 			return mem_db_file_lookup(&db->mem, id.index, out);
 		case db_kind_sql:
 			return sql_db_file_lookup(&db->sql, id.rowid, out);
+		case db_kind_log:
+			return log_db_file_lookup(&db->log, id.rowid, out);
 	}
 	cf_panic("unknown database impl %d\n", db->db_kind);
 
 }
 
+/*
+ * Look up the stored text of line `line` of file `file`.
+ *
+ * On success, a copy of the line is returned via `out`. Free it with
+ * cf_str_free(). Return ENOENT if the line wasn't stored, e.g., the database
+ * was indexed without snippets.
+ */
+int
+cf_db_snippet_lookup(cf_db_t *db, file_ref_t file, uint32_t line,
+		cf_str_t *out)
+{
+	switch (db->db_kind) {
+		case db_kind_nop:
+			CF_FALLTHROUGH;
+		case db_kind_mem:
+			CF_FALLTHROUGH;
+		case db_kind_log:
+			return ENOENT;
+		case db_kind_sql:
+			return sql_db_snippet_lookup(&db->sql, file.rowid, line, out);
+	}
+	cf_panic("unknown database impl %d\n", db->db_kind);
+}
+
 int
 cf_db_type_lookup(cf_db_t *db, type_ref_t id, db_type_entry_t *entry_out,
 		loc_ctx_t *loc_out)
@@ -216,6 +516,34 @@ cf_db_type_lookup(cf_db_t *db, type_ref_t id, db_type_entry_t *entry_out,
 		case db_kind_sql:
 			return sql_db_type_lookup(&db->sql, id.rowid,
 					entry_out, loc_out);
+		case db_kind_log:
+			// compact the log to search it
+			return ENOTSUP;
+	}
+	cf_panic("unknown database impl %d\n", db->db_kind);
+}
+
+/*
+ * Append every aggregated use count of type `type` to `out`, one per file and
+ * kind of use.
+ *
+ * `out` must have been made by the caller. If the type has no aggregated
+ * counts, e.g., the database wasn't indexed with them, its stored type uses
+ * are counted instead.
+ */
+int
+cf_db_type_use_count_lookup(cf_db_t *db, type_ref_t type,
+		use_count_vec_t *out)
+{
+	switch (db->db_kind) {
+		case db_kind_nop:
+			return 0;
+		case db_kind_mem:
+			return mem_db_type_use_count_lookup(&db->mem, type.index, out);
+		case db_kind_sql:
+			return sql_db_type_use_count_lookup(&db->sql, type.rowid, out);
+		case db_kind_log:
+			return ENOTSUP;
 	}
 	cf_panic("unknown database impl %d\n", db->db_kind);
 }
@@ -223,24 +551,28 @@ cf_db_type_lookup(cf_db_t *db, type_ref_t id, db_type_entry_t *entry_out,
 /*
  * Look up a member of struct/union `parent` with name matching `member`.
  *
+ * `filter` is optional. Only its `file_glob` applies to members.
+ *
  * On success, return the entry via `*entry_out` and `*loc_out`. The returned
  * entry contains an owned string of the full member name. Call cf_str_free()
  * on `&entry_out->name`.
  */
 int
 cf_db_member_lookup(cf_db_t *db, type_ref_t parent, const cf_str_t *member,
-		db_member_t *entry_out, loc_ctx_t *loc_out)
+		const db_filter_t *filter, db_member_t *entry_out, loc_ctx_t *loc_out)
 {
 	switch (db->db_kind) {
 		case db_kind_nop:
 			return nop_db_member_lookup(&db->nop, parent.rowid, member,
-					entry_out, loc_out);
+					filter, entry_out, loc_out);
 		case db_kind_mem:
 			return mem_db_member_lookup(&db->mem, parent.index, member,
-					entry_out, loc_out);
+					filter, entry_out, loc_out);
 		case db_kind_sql:
 			return sql_db_member_lookup(&db->sql, parent.rowid, member,
-					entry_out, loc_out);
+					filter, entry_out, loc_out);
+		case db_kind_log:
+			return ENOTSUP;
 	}
 	cf_panic("unknown database impl %d\n", db->db_kind);
 }
@@ -254,22 +586,31 @@ cf_db_member_lookup(cf_db_t *db, type_ref_t parent, const cf_str_t *member,
  * created. The next db_typename_iter_next() call will return false. See the
  * docs above `db_typename_iter_t` for more details on use.
  *
- * `name` is borrowed. It needs to live until `*out` is freed.
+ * `filter` is optional. Pass NULL to return every typename matching `name`.
+ * Otherwise only entries passing `filter` are returned, in the requested
+ * order. Backends apply the filter themselves so that, e.g., the sql backend
+ * never fetches rows that would be thrown away.
+ *
+ * `name` and `filter` are borrowed. They need to live until `*out` is freed.
+ *
+ * A log database can't be searched until it's compacted. It returns ENOTSUP.
  */
 int
 cf_db_typename_find(cf_db_t *db, const cf_str_t *name,
-		db_typename_iter_t *out)
+		const db_filter_t *filter, db_typename_iter_t *out)
 {
 	memset(out, 0, sizeof(*out));
 	out->parent = db;
 
 	switch (db->db_kind) {
 		case db_kind_nop:
-			return nop_db_typename_find(&db->nop, name, &out->nop);
+			return nop_db_typename_find(&db->nop, name, filter, &out->nop);
 		case db_kind_mem:
-			return mem_db_typename_find(&db->mem, name, &out->mem);
+			return mem_db_typename_find(&db->mem, name, filter, &out->mem);
 		case db_kind_sql:
-			return sql_db_typename_find(&db->sql, name, &out->sql);
+			return sql_db_typename_find(&db->sql, name, filter, &out->sql);
+		case db_kind_log:
+			return ENOTSUP;
 	}
 	cf_panic("unknown database impl %d\n", db->db_kind);
 }
@@ -286,7 +627,8 @@ db_typename_iter_free(db_typename_iter_t *it)
 		case db_kind_mem:
 			return mem_db_typename_iter_free(&it->mem);
 		case db_kind_sql:
-			return sql_db_typename_iter_free(&it->sql);
+			return sql_db_typename_iter_free(&it->sql);		case db_kind_log:
+			cf_panic("log database has no typename iterator\n");
 	}
 	cf_panic("unknown database impl %d\n", it->parent->db_kind);
 }
@@ -314,7 +656,8 @@ db_typename_iter_peek(const db_typename_iter_t *it, db_typename_t *entry_out,
 					entry_out, loc_out);
 		case db_kind_sql:
 			return sql_db_typename_iter_peek(&it->parent->sql, &it->sql,
-					entry_out, loc_out);
+					entry_out, loc_out);		case db_kind_log:
+			cf_panic("log database has no typename iterator\n");
 	}
 	cf_panic("unknown database impl %d\n", it->parent->db_kind);
 }
@@ -334,7 +677,32 @@ db_typename_iter_next(db_typename_iter_t *it)
 		case db_kind_mem:
 			return mem_db_typename_iter_next(&it->parent->mem, &it->mem);
 		case db_kind_sql:
-			return sql_db_typename_iter_next(&it->parent->sql, &it->sql);
+			return sql_db_typename_iter_next(&it->parent->sql, &it->sql);		case db_kind_log:
+			cf_panic("log database has no typename iterator\n");
+	}
+	cf_panic("unknown database impl %d\n", it->parent->db_kind);
+}
+
+/*
+ * Return the keyset cursor of the current typename in `it`.
+ *
+ * Passing it as `db_filter_t::after` to a later cf_db_typename_find() call,
+ * with the same name and filter otherwise, continues after this entry. The
+ * value is opaque and only meaningful to the database it came from.
+ *
+ * Like db_typename_iter_peek(), the iterator must currently be on an entry.
+ */
+int64_t
+db_typename_iter_cursor(const db_typename_iter_t *it)
+{
+	switch (it->parent->db_kind) {
+		case db_kind_nop:
+			return nop_db_typename_iter_cursor(&it->nop);
+		case db_kind_mem:
+			return mem_db_typename_iter_cursor(&it->mem);
+		case db_kind_sql:
+			return sql_db_typename_iter_cursor(&it->sql);		case db_kind_log:
+			cf_panic("log database has no typename iterator\n");
 	}
 	cf_panic("unknown database impl %d\n", it->parent->db_kind);
 }
@@ -7,10 +7,13 @@
 #pragma once
 
 #include "cc_support.h"
+#include "cf_map.h"
 #include "db_types.h"
+#include "log_db.h"
 #include "nop_db.h"
 #include "mem_db.h"
 #include "sql_db.h"
+#include "vcs.h"
 
 #include <stdint.h>
 #include <string.h>
@@ -22,7 +25,8 @@ __BEGIN_DECLS
  * Database frontend interface.
  *
  * This static dispatches between different database backends implementations.
- * It currently supports a nop, sqlite, and an in-memory database.
+ * It currently supports a nop, sqlite, an in-memory, and an append-only log
+ * database.
  *
  * Members:
  * - db_kind
@@ -33,17 +37,20 @@ __BEGIN_DECLS
  *   - `kind_nop` uses `nop`
  *   - `kind_mem` uses `mem`
  *   - `kind_sql` uses `sql`
+ *   - `kind_log` uses `log`
  */
 typedef struct {
 	enum __attribute__((enum_extensibility(closed))) {
 		db_kind_nop = 1,
 		db_kind_mem = 2,
 		db_kind_sql = 3,
+		db_kind_log = 4,
 	} db_kind;
 	union {
 		nop_db_t nop;
 		mem_db_t mem;
 		sqlite_db_t sql;
+		log_db_t log;
 	};
 } cf_db_t;
 
@@ -60,7 +67,7 @@ typedef struct {
  *   cf_str_t name = ...;
  *   db_typename_iter_t it;
  *
- *   (void)cf_db_typename_find(&db, name, &it);
+ *   (void)cf_db_typename_find(&db, name, NULL, &it);
  *
  *   while (db_typename_iter_next(&it)) {
  *     ... db_typename_iter_peek(&it);
@@ -68,6 +75,13 @@ typedef struct {
  *   }
  *   db_typename_iter_free(&it);
  *
+ * To page through a large result set, set a limit in the filter, and save
+ * db_typename_iter_cursor() of the last entry of a page. Searching again with
+ * that as `db_filter_t::after` returns the next page. Each page costs about
+ * the same no matter how deep into the results it is.
+ *
+ * A log database can't be searched, so it has no iterator.
+ *
  * Members:
  * - parent
  *   Database
@@ -92,16 +106,29 @@ typedef struct {
 int cf_db_open_nop(cf_db_t *out);
 int cf_db_open_mem(cf_db_t *out);
 int cf_db_open_sql(const char *db_path, bool ro, cf_db_t *out);
+int cf_db_open_log(const char *dir, cf_db_t *out);
 int cf_db_close(cf_db_t *db);
 
 // virtual interface functions
 int cf_db_add_file(cf_db_t *db, const char *path, size_t len,
-		file_ref_t *out);
+		file_ref_t *out, bool *alias_out);
+int cf_db_prefetch_file(cf_db_t *db, const char *path, size_t len);
+void cf_db_resolve_files(cf_db_t *db);
+int cf_db_set_approx(cf_db_t *db, bool approx);
+int cf_db_set_wal_policy(cf_db_t *db, const wal_policy_t *policy);
+int cf_db_checkpoint(cf_db_t *db);
+int cf_db_tu_dep_insert(cf_db_t *db, file_ref_t tu, file_ref_t dep);
+int cf_db_snippet_insert(cf_db_t *db, file_ref_t file,
+		const db_snippet_t *lines, size_t num_lines);
+int cf_db_vcs_sync(cf_db_t *db, const vcs_tree_t *tree,
+		cf_map8_t *clean_tus_out);
 int cf_db_add_typedef(cf_db_t *db, const loc_ctx_t *loc,
 		const db_typename_t *entry);
 
 int cf_db_typename_lookup(cf_db_t *db, const loc_ctx_t *loc,
 		const db_typename_t *name, type_ref_t *out);
+int cf_db_typename_lookup_many(cf_db_t *db, const db_typename_key_t *keys,
+		size_t num_keys, type_ref_t *out);
 int cf_db_type_insert(cf_db_t *db, const loc_ctx_t *loc,
 		const db_type_entry_t *entry, type_ref_t *out);
 int cf_db_typename_insert(cf_db_t *db, const loc_ctx_t *loc,
@@ -110,18 +137,26 @@ int cf_db_member_insert(cf_db_t *db, const loc_ctx_t *loc,
 		const db_member_t *entry);
 int cf_db_type_use_insert(cf_db_t *db, const loc_ctx_t *loc,
 		const db_type_use_t *entry);
+int cf_db_type_use_count_insert(cf_db_t *db, const db_type_use_count_t *entry,
+		bool max);
 
 int cf_db_file_lookup(cf_db_t *db, file_ref_t id, cf_str_t *out);
+int cf_db_snippet_lookup(cf_db_t *db, file_ref_t file, uint32_t line,
+		cf_str_t *out);
 int cf_db_type_lookup(cf_db_t *db, type_ref_t id, db_type_entry_t *entry_out,
 		loc_ctx_t *loc_out);
+int cf_db_type_use_count_lookup(cf_db_t *db, type_ref_t type,
+		use_count_vec_t *out);
 int cf_db_member_lookup(cf_db_t *db, type_ref_t parent,
-		const cf_str_t *member, db_member_t *entry_out, loc_ctx_t *loc_out);
+		const cf_str_t *member, const db_filter_t *filter,
+		db_member_t *entry_out, loc_ctx_t *loc_out);
 int cf_db_typename_find(cf_db_t *db, const cf_str_t *name,
-		db_typename_iter_t *out);
+		const db_filter_t *filter, db_typename_iter_t *out);
 
 void db_typename_iter_free(db_typename_iter_t *it);
 void db_typename_iter_peek(const db_typename_iter_t *it,
 		db_typename_t *entry_out, loc_ctx_t *loc_out);
 bool db_typename_iter_next(db_typename_iter_t *it);
+int64_t db_typename_iter_cursor(const db_typename_iter_t *it);
 
 __END_DECLS
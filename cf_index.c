@@ -16,8 +16,11 @@
 #include "db_types.h"
 #include "cf_db.h"
 #include "index_types.h"
+#include "merge.h"
 
 #include <errno.h>
+#include <pthread.h>
+#include <stdatomic.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdbool.h>
@@ -35,17 +38,42 @@ CF_VEC_FUNC_DECL(cursor_stack_t, CXCursor, cursor_stack);
 CF_VEC_FUNC_DECL(struct_vec_t, struct_pkg_t, struct_vec);
 CF_VEC_FUNC_DECL(memberpkg_vec_t, member_pkg_t, memberpkg_vec);
 CF_VEC_FUNC_DECL(typeusepkg_vec_t, type_use_pkg_t, typeusepkg_vec);
+CF_VEC_FUNC_DECL(typedefpkg_vec_t, typedef_pkg_t, typedefpkg_vec);
+CF_VEC_FUNC_DECL(snippet_key_vec_t, snippet_key_t, snippet_key_vec);
+CF_VEC_FUNC_DECL(use_count_vec_t, db_type_use_count_t, use_count_vec);
 
 CF_VEC_ITER_GENERATE(struct_vec_t, struct_pkg_t, struct_iter);
 CF_VEC_ITER_GENERATE(memberpkg_vec_t, member_pkg_t, memberpkg_iter);
 CF_VEC_ITER_GENERATE(typeusepkg_vec_t, type_use_pkg_t, typeusepkg_iter);
 
+// fewest indexable top-level structs worth splitting a TU for
+#define TU_SPLIT_MIN_STRUCTS 256
+// top-level structs built ahead of the walk of a split TU at a time
+#define TU_SPLIT_WINDOW 1024
+// fewest structs of a window worth starting another thread for
+#define TU_SPLIT_STRUCTS_PER_THREAD 32
+// most threads to split a TU across, regardless of `index_config_t`
+#define TU_SPLIT_MAX_THREADS 16
+// most struct scoreboards staged before they're committed
+#define STRUCT_STAGE_MAX 4096
+
+/*
+ * Held around libclang calls that fill clang's internal caches, which aren't
+ * safe to update from several threads at once. See start_tu_split().
+ *
+ * It's uncontended unless a TU is split.
+ */
+static pthread_mutex_t clang_lock = PTHREAD_MUTEX_INITIALIZER;
+
 /*
  * Lightweight argument struct used in index_includes().
  */
 typedef struct {
 	cf_db_t *db;
 	cf_map8_t *file_map;
+	cf_map8_t *alias_files;
+	cf_cache8_t *file_cache;
+	file_ref_t tu;
 	int error;
 } include_ctx_t;
 
@@ -73,6 +101,10 @@ typedef struct {
  * - argv
  *   Command line arguments used to compile `path`. This is an (owned) array of
  *   pointers to strings borrowed from `arg_data`.
+ * - argv_names_path
+ *   `argv` is a full compiler command line that already names `path` as its
+ *   input. `path` must not be passed to libclang again, or the driver sees
+ *   two inputs and fails.
  */
 typedef struct {
 	unsigned n;
@@ -80,6 +112,7 @@ typedef struct {
 	CXString *arg_data;
 	const char *path;
 	const char *const *argv;
+	bool argv_names_path;
 } argv_builder_t;
 
 /*
@@ -142,6 +175,68 @@ typedef enum {
 	struct_name_anon = 3,
 } struct_name_kind_t;
 
+/*
+ * The new types of one or more scoreboards, looked up in the database as one
+ * batch.
+ *
+ * Members
+ * - pkgs
+ *   Named types not already in `index_ctx_t::type_cache`, in scoreboard
+ *   order.
+ * - keys
+ *   Typename lookup key for each of `pkgs`.
+ * - refs
+ *   Result for each of `pkgs`: the preexisting type, or zero if it's new.
+ *   NULL if the batch lookup failed.
+ * - ends
+ *   For each scoreboard, the index in `pkgs` after its last type.
+ * - len
+ * - evictions
+ *   `index_ctx_t::type_cache` evictions when the batch was looked up.
+ */
+typedef struct {
+	struct_pkg_t **pkgs;
+	db_typename_key_t *keys;
+	type_ref_t *refs;
+	size_t *ends;
+	size_t len;
+	uint64_t evictions;
+} struct_batch_t;
+
+/*
+ * Value of `index_ctx_t::type_cache`: a typename's base type and the full key
+ * the typename is cached under.
+ *
+ * The cache is keyed by a hash of the key (see type_cache_key()). A cached
+ * entry only matches a lookup if every field of the key is equal too.
+ *
+ * Members
+ * - rowid
+ *   Rowid of the type the typename names.
+ * - file, func, scope
+ *   Location fields of the typename, as in `loc_ctx_t`.
+ * - kind
+ *   Typename kind; the tag and typedef namespaces are separate.
+ * - name_len, name
+ *   The typename, without a NUL terminator.
+ */
+typedef struct {
+	int64_t rowid;
+	int64_t file;
+	int64_t func;
+	uint32_t scope;
+	uint32_t kind;
+	uint32_t name_len;
+	char name[];
+} type_cache_entry_t;
+
+/*
+ * Bytes of one `type_cache_entry_t` counted against the cache budget.
+ *
+ * Names vary in length, so this is an estimate with room for a 16-byte name.
+ */
+#define TYPE_CACHE_ENTRY_SIZE (sizeof(type_cache_entry_t) + 16)
+
 /*
  * Sub argument structure used in index_struct_children()
  */
@@ -150,22 +245,61 @@ typedef struct {
 	struct_scoreboard_t *sb;
 } index_struct_args_t;
 
+/*
+ * State shared by the threads building one window of a split TU.
+ *
+ * Members
+ * - ctx
+ *   Only read while the threads run.
+ * - units, len
+ *   Structs to build.
+ * - next
+ *   Index of the next unit to take.
+ */
+typedef struct {
+	index_ctx_t *ctx;
+	split_unit_t *units;
+	size_t len;
+	atomic_size_t next;
+} split_build_ctx_t;
+
 // top-level indexing
-static int index_project(const index_config_t *config, index_ctx_t *ctx);
+static int index_project(const index_config_t *config, const char *path,
+		index_ctx_t *ctx);
 static int index_target(const index_config_t *config, index_ctx_t *ctx,
 		argv_builder_t *args);
 
 static int index_compile_cmd(CXCompileCommand cmd,
 		const index_config_t *config, index_ctx_t *ctx);
-static int index_source(const index_config_t *config, index_ctx_t *ctx);
+static int index_source(const index_config_t *config, const char *path,
+		index_ctx_t *ctx);
+static int index_command(const index_config_t *config, const char *path,
+		index_ctx_t *ctx);
 static int index_includes(CXTranslationUnit tu, index_ctx_t *ctx);
+static int index_tu_deps(file_ref_t tu, index_ctx_t *ctx);
+static bool tu_is_clean(const index_ctx_t *ctx, file_ref_t tu);
+static bool add_clean_tu_file(const char *path, index_ctx_t *ctx,
+		file_ref_t *out);
 static int index_tu(CXTranslationUnit tu, index_ctx_t *ctx);
+static int start_tu_split(CXCursor root, index_ctx_t *ctx);
+static void stop_tu_split(index_ctx_t *ctx);
+static enum CXChildVisitResult collect_split_cb(CXCursor cursor,
+		CXCursor parent, CXClientData ctx_);
+static struct_scoreboard_t *take_split_unit(CXCursor cursor, CXCursor parent,
+		index_ctx_t *ctx);
+static void build_split_window(index_ctx_t *ctx);
+static void *split_worker(void *build_);
+static void build_split_units(split_build_ctx_t *build);
+static int index_snippets(CXTranslationUnit tu, index_ctx_t *ctx);
 
 // generic iterators
 static int iterate_children(CXCursor root, iterate_children_args_t *args);
 static enum CXChildVisitResult iterate_children_cb(
 		CXCursor cursor, CXCursor parent, CXClientData ctx);
 
+static void prefetch_include_cb(CXFile included_file,
+		CXSourceLocation *inclusion_stack, unsigned include_len,
+		CXClientData ctx);
 static void index_include_cb(CXFile included_file,
 		CXSourceLocation *inclusion_stack, unsigned include_len,
 		CXClientData ctx);
@@ -179,7 +313,12 @@ static enum CXChildVisitResult index_type_children_cb2(
 static enum CXChildVisitResult index_ast_node(
 		CXCursor cursor, CXCursor parent, index_ctx_t *ctx);
 static void index_typedef(CXCursor cursor, index_ctx_t *ctx);
-static bool index_struct(CXCursor cursor, index_ctx_t *ctx);
+static bool index_struct(CXCursor cursor, struct_scoreboard_t *built,
+		index_ctx_t *ctx);
+static bool index_alias_struct(CXCursor cursor, index_ctx_t *ctx);
+static bool struct_has_nested_type(CXCursor cursor);
+static enum CXChildVisitResult find_nested_type_cb(CXCursor cursor,
+		CXCursor parent, CXClientData found);
 static void index_struct_record(CXCursor struct_decl, struct_scoreboard_t *sb);
 static void index_struct_children(CXCursor cursor, index_ctx_t *ctx,
 		struct_scoreboard_t *sb);
@@ -194,21 +333,39 @@ static bool special_index_struct_name(CXCursor cursor, struct_scoreboard_t *sb,
 static void make_struct_scoreboard(struct_scoreboard_t *out);
 static void free_struct_scoreboard(struct_scoreboard_t *sb);
 static void reset_struct_scoreboard(struct_scoreboard_t *sb);
-static int commit_struct_scoreboard(struct_scoreboard_t *sb, index_ctx_t *ctx);
+static int stage_struct_scoreboard(index_ctx_t *ctx);
+static int commit_staged_structs(index_ctx_t *ctx);
+static int stage_typedef(const typedef_pkg_t *pkg, index_ctx_t *ctx);
+static int commit_staged_typedefs(index_ctx_t *ctx);
+static int commit_one_typedef(typedef_pkg_t *pkg, const type_ref_t *found,
+		index_ctx_t *ctx);
+static void reset_staged(index_ctx_t *ctx);
+static int commit_struct_scoreboards(struct_scoreboard_t *sbs, size_t n,
+		index_ctx_t *ctx);
+static int commit_struct_scoreboard(struct_scoreboard_t *sb,
+		const struct_batch_t *batch, size_t begin, size_t end,
+		index_ctx_t *ctx);
 static void free_struct_scoreboard_rsrc(struct_scoreboard_t *sb);
 
-static int commit_one_struct(struct_pkg_t *pkg, cf_map8_t *new_type_map,
-		index_ctx_t *ctx);
+static int make_struct_batch(struct_scoreboard_t *sbs, size_t n,
+		index_ctx_t *ctx, struct_batch_t *out);
+static void free_struct_batch(struct_batch_t *batch);
+static bool struct_is_cached(struct_pkg_t *pkg, index_ctx_t *ctx);
+static int commit_one_struct(struct_pkg_t *pkg, const type_ref_t *found,
+		cf_hmap8_t *new_type_map, index_ctx_t *ctx);
 static int commit_one_member(member_pkg_t *pkg, index_ctx_t *ctx);
 static int commit_one_type_use(type_use_pkg_t *pkg, index_ctx_t *ctx);
+static int count_one_type_use(type_use_pkg_t *pkg, index_ctx_t *ctx);
+static int flush_use_counts(index_ctx_t *ctx);
+static void reset_use_counts(index_ctx_t *ctx);
 static int struct_scoreboard_add_name(CXCursor cursor, struct_scoreboard_t *sb,
 		index_ctx_t *ctx);
 static void extract_typedef_name(CXCursor cursor, CXString *out);
 static void extract_var_name(CXCursor cursor, CXString *out);
 
-static bool translate_member_type(cf_map8_t *map1, cf_map8_t *map2,
+static bool translate_member_type(cf_hmap8_t *map1, cf_hmap8_t *map2,
 		clang_type_t old, type_ref_t *out);
-static bool translate_struct_type(cf_map8_t *map, clang_type_t old,
+static bool translate_struct_type(cf_hmap8_t *map, clang_type_t old,
 		type_ref_t *out);
 
 static void index_member(CXCursor cursor, CXCursor parent,
@@ -221,14 +378,18 @@ static void build_member_type_use(CXCursor cursor, CXCursor parent,
 static void extract_member_typename(CXCursor member_decl, db_typename_t *out);
 
 static void print_scoreboard_stats(const struct_scoreboard_t *sb);
+static void print_cache_stats(const char *name, const cf_cache8_t *cache);
 
 // indexing misc.
 static bool cursor_is_indexable(CXCursor cursor, index_ctx_t *ctx);
 static bool user_type_is_indexable(CXCursor cursor);
-static bool typedef_is_indexable(CXCursor cursor);
+static bool typedef_is_indexable(CXCursor cursor, index_ctx_t *ctx);
 static bool var_is_indexable(CXCursor cursor);
 static bool type_is_indexable(CXType ct);
 static void update_location(index_ctx_t *ctx, CXCursor cursor);
+static void locate_cursor(const index_ctx_t *ctx, CXCursor cursor,
+		loc_ctx_t *loc, bool *in_alias_file);
+static void note_snippet(index_ctx_t *ctx, const loc_ctx_t *loc);
 static void assert_is_tag(enum CXCursorKind kind);
 
 // extractor functions
@@ -243,17 +404,34 @@ static struct_name_kind_t get_struct_name_kind(CXCursor cursor);
 // `index_ctx_t` functions
 static int make_index_ctx(const index_config_t *config, index_ctx_t *out);
 static int make_index_ctx_db(const index_config_t *config, index_ctx_t *out);
+static int make_index_ctx_vcs(const index_config_t *config, index_ctx_t *out);
 static void free_index_ctx(index_ctx_t *ctx);
 static void reset_tu_ctx(index_ctx_t *ctx);
 
 // maps
-static void type_map_insert(cf_map8_t *map, clang_type_t ct,
+static void type_map_insert(cf_hmap8_t *map, clang_type_t ct,
 		type_ref_t type_ref);
-static bool type_map_lookup(cf_map8_t *map, CXType ct, type_ref_t *ref_out);
-static bool type_map_lookup2(cf_map8_t *map, clang_type_t ct,
+static bool type_map_lookup2(cf_hmap8_t *map, clang_type_t ct,
 		type_ref_t *ref_out);
 static void file_map_add(cf_map8_t *map, CXFile file, file_ref_t ref);
-static bool file_map_lookup(cf_map8_t *map, CXFile file, file_ref_t *ref_out);
+static bool file_map_lookup(const cf_map8_t *map, CXFile file,
+		file_ref_t *ref_out);
+static uint64_t file_cache_key(CXFile file);
+static uint64_t type_cache_key(const loc_ctx_t *loc,
+		const db_typename_t *name);
+static bool type_cache_find(index_ctx_t *ctx, const loc_ctx_t *loc,
+		const db_typename_t *name, type_ref_t *ref_out);
+static int type_cache_insert(index_ctx_t *ctx, const loc_ctx_t *loc,
+		const db_typename_t *name, type_ref_t ref);
+static void type_cache_release(uint64_t value);
+static CXFile file_map_find(const cf_map8_t *map, int64_t rowid);
+
+// snippets
+static int compare_snippet_keys(const void *lhs, const void *rhs);
+static size_t unique_snippet_keys(snippet_key_t *keys, size_t len);
+static int store_file_snippets(CXTranslationUnit tu, CXFile file,
+		const snippet_key_t *keys, size_t len, index_ctx_t *ctx);
+static void extract_snippet(const char *line, size_t len, cf_str_t *out);
 
 // ast path
 static void make_ast_path(ast_path_t *out);
@@ -272,13 +450,19 @@ static void free_argv_builder(argv_builder_t *args);
 static clang_type_t get_clang_type(CXType ct);
 
 /*
- * Index the project/source file specified by `config`.
+ * Index the projects/source files specified by `config`.
  *
  * Steps:
  * - make an `index_ctx_t`
- * - dispatch into either
- *   - index_project() if `config` contains a "compile_commands.json"
- *   - index_source() if `config` contains just a single ".c" file
+ * - for each input, dispatch into one of
+ *   - index_project() if `config` contains "compile_commands.json"s
+ *   - index_source() if `config` contains ".c" files
+ *   - index_command() if `config` contains a ".c" file and its command line
+ *   - cf_merge_fragment() if `config` contains index fragments
+ *   - cf_merge_log() if `config` contains logs
+ *
+ * Every input shares the same `index_ctx_t`, and with it the same database and
+ * file/type caches.
  */
 int
 cf_index_project(const index_config_t *config)
@@ -286,23 +470,54 @@ cf_index_project(const index_config_t *config)
 	int error;
 	index_ctx_t ctx;
 
+	cf_assert(config->num_inputs);
+
 	// make an indexing context to keep state between TUs
 	if ((error = make_index_ctx(config, &ctx))) {
 		goto fail;
 	}
 
-	if (config->input_kind == input_comp_db) {
-		// index the compilation database specified in `config->input_path`
-		error = index_project(config, &ctx);
-	} else {
-		// index single source file
-		error = index_source(config, &ctx);
-	}
+	for (size_t i = 0; i < config->num_inputs; ++i) {
+		const char *path = config->input_paths[i];
+
+		switch (config->input_kind) {
+			case input_comp_db:
+				// index the compilation database in directory `path`
+				error = index_project(config, path, &ctx);
+				break;
+			case input_source_file:
+				// index single source file
+				error = index_source(config, path, &ctx);
+				reset_tu_ctx(&ctx);
+				break;
+			case input_command:
+				error = index_command(config, path, &ctx);
+				reset_tu_ctx(&ctx);
+				break;
+			case input_fragment:
+				// no parsing; copy entries from another database
+				error = cf_merge_fragment(ctx.db, path);
+				break;
+			case input_log:
+				error = cf_merge_log(ctx.db, path);
+				break;
+			default:
+				error = EINVAL;
+				break;
+		}
 
-	if (error) {
-		goto fail_index;
+		if (error) {
+			cf_print_err("cannot index input '%s', error %d\n", path, error);
+			goto fail_index;
+		}
 	}
 
+	cf_print_info("indexed %zu inputs; cached %zu files, %zu types\n",
+			config->num_inputs, cf_cache8_len(&ctx.file_cache),
+			cf_cache8_len(&ctx.type_cache));
+	print_cache_stats("file", &ctx.file_cache);
+	print_cache_stats("type", &ctx.type_cache);
+
 fail_index:
 	free_index_ctx(&ctx);
 fail:
@@ -313,7 +528,7 @@ fail:
  * Index all targets in a project.
  *
  * This is different from cf_index_project() in that it doesn't make `ctx`, and
- * a compilation database specifies the files to index.
+ * a compilation database in directory `path` specifies the files to index.
  *
  * XXX passing in the parent directory of a compilation database is
  * counterintuitive. probably just change this to:
@@ -324,21 +539,22 @@ fail:
  * Note: do not confuse a compilation database with cfind's search database:
  * - compilation database
  *   A ".json" file that specifies how to compile every source file in a
- *   project. It's passed in via `ctx->input_path`. (Despite the name, there's
+ *   project. It's passed in via `path`. (Despite the name, there's
  *   nothing database-like about it at all.)
  * - cfind search database
  *   A newly created sqlite3 db. It was instantiated by the caller and passed
  *   in via `ctx->db`.
  */
 static int
-index_project(const index_config_t *config, index_ctx_t *ctx)
+index_project(const index_config_t *config, const char *path,
+		index_ctx_t *ctx)
 {
 	int error = 0;
 
-	// load compilation db from `config->input_path`
+	// load compilation db from `path`
 	CXCompilationDatabase_Error db_error = CXCompilationDatabase_NoError;
 	CXCompilationDatabase db = clang_CompilationDatabase_fromDirectory(
-			config->input_path, &db_error);
+			path, &db_error);
 	if (db_error) {
 		// `CXCompilationDatabase_Error` uses 1 error code for everything
 		error = ESRCH;
@@ -351,7 +567,7 @@ index_project(const index_config_t *config, index_ctx_t *ctx)
 	const unsigned n = clang_CompileCommands_getSize(cmds);
 
 	cf_print_info("loaded comp-db '%s'/compile_commands.json; %u commands\n",
-			config->input_path, n);
+			path, n);
 
 	// for each target
 	for (unsigned i = 0; i < n; ++i) {
@@ -361,6 +577,12 @@ index_project(const index_config_t *config, index_ctx_t *ctx)
 		}
 		// get rid of TU-specific state in `ctx`
 		reset_tu_ctx(ctx);
+
+		// a TU boundary is a good time to checkpoint
+		if ((error = cf_db_checkpoint(ctx->db))) {
+			cf_print_debug("cannot checkpoint db, error %d\n", error);
+			error = 0;
+		}
 	}
 
 fail_index:
@@ -477,12 +699,13 @@ free_argv_builder(argv_builder_t *args)
 }
 
 /*
- * Compile and index a single source file specified in `config`.
+ * Compile and index the single source file at `path`.
  *
  * This a wrapper to index_target() that uses default compile args.
  */
 static int
-index_source(const index_config_t *config, index_ctx_t *ctx)
+index_source(const index_config_t *config, const char *path,
+		index_ctx_t *ctx)
 {
 	// default compile args
 	static const char *const argv[] = {
@@ -495,7 +718,7 @@ index_source(const index_config_t *config, index_ctx_t *ctx)
 	// fake an `argv_builder_t` to call into index_target()
 	argv_builder_t cmd_args = {
 		.n = ARRAY_LEN(argv),
-		.path = config->input_path,
+		.path = path,
 		.argv = argv,
 	};
 
@@ -504,23 +727,60 @@ index_source(const index_config_t *config, index_ctx_t *ctx)
 	// note: don't free `cmd_args` because it owns nothing
 }
 
+/*
+ * Compile and index the source file at `path` with the compiler command line
+ * in `config`.
+ *
+ * Like index_source(), except the arguments come from the caller. The command
+ * line is passed to clang as-is, just like a compilation database entry.
+ */
+static int
+index_command(const index_config_t *config, const char *path,
+		index_ctx_t *ctx)
+{
+	cf_assert(config->command_argc);
+
+	argv_builder_t cmd_args = {
+		.n = config->command_argc,
+		.path = path,
+		.argv = (const char **)config->command_argv,
+		.argv_names_path = true,
+	};
+
+	return index_target(config, ctx, &cmd_args);
+}
+
 /*
  * Compile `args` and index it.
+ *
+ * In approximate mode, only the main file is parsed and parse errors are
+ * skipped over. This is much faster because nothing is read from headers.
  */
 static int
 index_target(const index_config_t *config, index_ctx_t *ctx,
 		argv_builder_t *args)
 {
-	(void)config;
 	int error;
 	CXTranslationUnit tu;
 
+	const unsigned parse_options = config->approx ?
+			(CXTranslationUnit_SingleFileParse | CXTranslationUnit_KeepGoing) :
+			CXTranslationUnit_None;
+
+	// don't bother parsing a TU that's already up to date
+	file_ref_t tu_file;
+	if (add_clean_tu_file(args->path, ctx, &tu_file) &&
+			tu_is_clean(ctx, tu_file)) {
+		cf_print_debug("skip unchanged TU '%s'\n", args->path);
+		return 0;
+	}
+
 	// compile `args` into an AST
 	const enum CXErrorCode cerror = clang_parseTranslationUnit2FullArgv(
 			ctx->clang_index,
-			args->path,
+			args->argv_names_path ? NULL : args->path,
 			args->argv, args->n,
-			NULL, 0, CXTranslationUnit_None, &tu);
+			NULL, 0, parse_options, &tu);
 
 	if (cerror) {
 		cf_print_err("cannot make TU from '%s', error %d\n",
@@ -542,6 +802,16 @@ index_target(const index_config_t *config, index_ctx_t *ctx,
 		goto fail_index;
 	}
 
+	if (ctx->count_uses && (error = flush_use_counts(ctx))) {
+		goto fail_index;
+	}
+
+	// source lines are read while the TU still holds the file contents
+	if (ctx->snippets && (error = index_snippets(tu, ctx))) {
+		cf_print_err("cannot store snippets, error %d\n", error);
+		goto fail_index;
+	}
+
 fail_index:
 	clang_disposeTranslationUnit(tu);
 fail:
@@ -618,17 +888,213 @@ free_struct_scoreboard_rsrc(struct_scoreboard_t *sb)
 	// note: `type_uses` holds no external resources
 }
 
+/*
+ * Stage the fully traversed scoreboard in `ctx->struct_sb` to be committed
+ * with the structs after it, and leave an empty one in its place.
+ *
+ * A 2,000-struct header then costs one batch of typename lookups rather than
+ * one per struct. If `STRUCT_STAGE_MAX` scoreboards are already staged,
+ * they're committed first.
+ */
+static int
+stage_struct_scoreboard(index_ctx_t *ctx)
+{
+	if (ctx->num_staged == STRUCT_STAGE_MAX) {
+		(void)commit_staged_structs(ctx);
+	}
+
+	if (ctx->num_staged == ctx->staged_capacity) {
+		const size_t capacity = ctx->staged_capacity ?
+				MIN(2 * ctx->staged_capacity, STRUCT_STAGE_MAX) : 16;
+		struct_scoreboard_t *staged = cf_realloc(ctx->staged,
+				capacity * sizeof(*staged));
+		if (!staged) {
+			// commit it on its own instead
+			(void)commit_staged_structs(ctx);
+			return commit_struct_scoreboards(&ctx->struct_sb, 1, ctx);
+		}
+		for (size_t i = ctx->staged_capacity; i < capacity; ++i) {
+			make_struct_scoreboard(&staged[i]);
+		}
+		ctx->staged = staged;
+		ctx->staged_capacity = capacity;
+	}
+
+	struct_scoreboard_t *slot = &ctx->staged[ctx->num_staged++];
+	const struct_scoreboard_t empty = *slot;
+	*slot = ctx->struct_sb;
+	ctx->struct_sb = empty;
+	return 0;
+}
+
+/*
+ * Commit every scoreboard staged by stage_struct_scoreboard(), then the
+ * typedefs staged behind them.
+ *
+ * This must happen before anything else reads `ctx->type_map` or looks up a
+ * typename, since staged types aren't in either yet.
+ */
+static int
+commit_staged_structs(index_ctx_t *ctx)
+{
+	const int error = commit_struct_scoreboards(ctx->staged,
+			ctx->num_staged, ctx);
+	ctx->num_staged = 0;
+
+	const int typedef_error = commit_staged_typedefs(ctx);
+	return error ? error : typedef_error;
+}
+
+/*
+ * Stage typedef `pkg` behind the staged structs. Its name is copied.
+ *
+ * Fail if `STRUCT_STAGE_MAX` typedefs are already staged.
+ */
+static int
+stage_typedef(const typedef_pkg_t *pkg, index_ctx_t *ctx)
+{
+	int error;
+
+	if (typedefpkg_vec_len(&ctx->staged_typedefs) == STRUCT_STAGE_MAX) {
+		return E2BIG;
+	}
+
+	typedef_pkg_t *staged = typedefpkg_vec_reserve(&ctx->staged_typedefs);
+	if (!staged) {
+		return ENOMEM;
+	}
+	*staged = *pkg;
+	if ((error = cf_str_dup_str(&pkg->name.name, &staged->name.name))) {
+		typedefpkg_vec_abort(&ctx->staged_typedefs, staged);
+		return error;
+	}
+	typedefpkg_vec_commit(&ctx->staged_typedefs, staged);
+	return 0;
+}
+
+/*
+ * Commit every typedef staged by stage_typedef(), in order.
+ *
+ * All of them are looked up in one batch first. A typedef the batch found to
+ * be new is looked up again on its own if an earlier one of the batch with
+ * the same key was committed, e.g., when a header repeats a typedef.
+ */
+static int
+commit_staged_typedefs(index_ctx_t *ctx)
+{
+	int error = 0;
+	const size_t n = typedefpkg_vec_len(&ctx->staged_typedefs);
+	cf_hmap8_t committed;
+
+	if (!n) {
+		return 0;
+	}
+
+	db_typename_key_t *keys = cf_malloc(n * sizeof(*keys));
+	type_ref_t *refs = cf_malloc(n * sizeof(*refs));
+	if (keys && refs) {
+		for (size_t i = 0; i < n; ++i) {
+			typedef_pkg_t *pkg = typedefpkg_vec_at(&ctx->staged_typedefs, i);
+			keys[i] = (db_typename_key_t) {
+				.loc = &pkg->loc,
+				.name = &pkg->name,
+			};
+		}
+		error = cf_db_typename_lookup_many(ctx->db, keys, n, refs);
+	} else {
+		error = ENOMEM;
+	}
+	if (error) {
+		// fall back to looking up typedefs one by one
+		cf_print_err("cannot look up %zu typedefs, error %d\n", n, error);
+		cf_free(refs);
+		refs = NULL;
+	}
+
+	cf_hmap8_make(&committed);
+	for (size_t i = 0; i < n; ++i) {
+		typedef_pkg_t *pkg = typedefpkg_vec_at(&ctx->staged_typedefs, i);
+		const uint64_t key = type_cache_key(&pkg->loc, &pkg->name);
+
+		uint64_t dummy;
+		const bool repeated = cf_hmap8_lookup(&committed, key, &dummy);
+		const type_ref_t *found = (refs && !repeated) ? &refs[i] : NULL;
+		if (!commit_one_typedef(pkg, found, ctx)) {
+			(void)cf_hmap8_insert(&committed, key, 1);
+		}
+		cf_str_free(&pkg->name.name);
+	}
+	cf_hmap8_free(&committed);
+	typedefpkg_vec_reset(&ctx->staged_typedefs);
+
+	cf_free(refs);
+	cf_free(keys);
+	return error;
+}
+
+/*
+ * Drop everything staged without committing it, e.g., after a failed TU.
+ */
+static void
+reset_staged(index_ctx_t *ctx)
+{
+	for (size_t i = 0; i < ctx->num_staged; ++i) {
+		reset_struct_scoreboard(&ctx->staged[i]);
+	}
+	ctx->num_staged = 0;
+
+	const size_t n = typedefpkg_vec_len(&ctx->staged_typedefs);
+	for (size_t i = 0; i < n; ++i) {
+		typedef_pkg_t *pkg = typedefpkg_vec_at(&ctx->staged_typedefs, i);
+		cf_str_free(&pkg->name.name);
+	}
+	typedefpkg_vec_reset(&ctx->staged_typedefs);
+}
+
+/*
+ * Commit `n` scoreboards `sbs` to `ctx` in order, then reset them.
+ *
+ * The named new types of all of them are looked up in one batch first. A
+ * type inserted by an earlier scoreboard and named again by a later one is
+ * found in `ctx->type_cache` by commit_one_struct(), the same as a typename
+ * repeated within one scoreboard.
+ */
+static int
+commit_struct_scoreboards(struct_scoreboard_t *sbs, size_t n,
+		index_ctx_t *ctx)
+{
+	int error;
+	struct_batch_t batch;
+
+	if (!n) {
+		return 0;
+	}
+
+	error = make_struct_batch(sbs, n, ctx, &batch);
+	for (size_t i = 0; i < n; ++i) {
+		if (!error) {
+			(void)commit_struct_scoreboard(&sbs[i], &batch,
+					i ? batch.ends[i - 1] : 0, batch.ends[i], ctx);
+		}
+		reset_struct_scoreboard(&sbs[i]);
+	}
+	free_struct_batch(&batch);
+	return error;
+}
+
 /*
  * Serialize in-memory state in `sb` to `ctx`.
  *
+ * `sb`s named, uncached types are entries `begin` to `end` of `batch`, which
+ * are already looked up.
+ *
  * Note:
  * - types may or may not preexist in the database
  *   be careful about reinserting x
  *
  * Steps:
  * - build a new type map (clang::Type* -> rowid)
- * - iterate over `sb->new_types`
- *   discard entries in `sb->unnamed_types`
+ * - iterate over the batch
  *   serialize (type-entry, name) into `ctx->db`
  *     if it's new, store the new rowid in the *new* type map
  *     if it's old, store the preexisting rowid in `ctx->type_map`
@@ -638,35 +1104,31 @@ free_struct_scoreboard_rsrc(struct_scoreboard_t *sb)
  * - merge new type map into old type map
  */
 static int
-commit_struct_scoreboard(struct_scoreboard_t *sb, index_ctx_t *ctx)
+commit_struct_scoreboard(struct_scoreboard_t *sb,
+		const struct_batch_t *batch, size_t begin, size_t end,
+		index_ctx_t *ctx)
 {
 	print_scoreboard_stats(sb);
 
-	cf_map8_t new_type_map;
-	cf_map8_make(&new_type_map);
-
-	cf_vec_iter_t new_types_it;
-	struct_iter_make(&sb->new_types, &new_types_it);
+	cf_hmap8_t new_type_map;
+	cf_hmap8_make(&new_type_map);
 
 	// serialize all new types
-	while (struct_iter_next(&new_types_it)) {
-		struct_pkg_t *pkg = struct_iter_peek(&new_types_it);
-		const clang_type_t type_id = pkg->type_id;
-		cf_assert(type_id);
-
-		cf_print_info("serialize struct %p\n", type_id);
-
-		uint64_t dummy;
-		if (cf_map8_lookup(&sb->unnamed_types, (uintptr_t)type_id, &dummy)) {
-			// skip unnamed types
-			cf_print_warn("type id %p has no name\n", type_id);
-			continue;
+	for (size_t i = begin; i < end; ++i) {
+		struct_pkg_t *pkg = batch->pkgs[i];
+		cf_print_info("serialize struct %p\n", pkg->type_id);
+
+		// a "new" result is stale if the cache has since evicted an
+		// earlier pkg of the batch with the same name
+		const type_ref_t *found = batch->refs ? &batch->refs[i] : NULL;
+		if (found && !found->rowid &&
+				(ctx->type_cache.stats.evictions != batch->evictions)) {
+			found = NULL;
 		}
 
 		// commit pkg, updating `new_type_map` if it's new
-		(void)commit_one_struct(pkg, &new_type_map, ctx);
+		(void)commit_one_struct(pkg, found, &new_type_map, ctx);
 	}
-	struct_iter_free(&new_types_it);
 
 	// serialize all non-type decls in `sb`
 
@@ -720,47 +1182,171 @@ commit_struct_scoreboard(struct_scoreboard_t *sb, index_ctx_t *ctx)
 			continue;
 		}
 
-		(void)commit_one_type_use(pkg, ctx);
+		if (ctx->count_uses) {
+			(void)count_one_type_use(pkg, ctx);
+		} else {
+			(void)commit_one_type_use(pkg, ctx);
+		}
 	}
 	typeusepkg_iter_free(&type_uses_it);
 
-	// now merge `new_type_map` into `ctx->type_map`
-	cf_vec_iter_t new_type_it;
-	cf_vec_iter_make(&new_type_map.v, &new_type_it);
-	while (cf_vec_iter_next(&new_type_it)) {
-		cf_map_entry_t *entry = cf_vec_iter_peek(&new_type_it);
-
-		// insert current entry in type map
-		type_map_insert(&ctx->type_map,
-				(clang_type_t)entry->key,
-				(type_ref_t){.rowid = entry->value});
+	// now merge `new_type_map` into `ctx->type_map`, in batch order
+	for (size_t i = begin; i < end; ++i) {
+		const struct_pkg_t *pkg = batch->pkgs[i];
+		type_ref_t ref;
+		if (translate_struct_type(&new_type_map, pkg->type_id, &ref)) {
+			type_map_insert(&ctx->type_map, pkg->type_id, ref);
+		}
 	}
-	cf_vec_iter_free(&new_type_it);
 
-	cf_map8_free(&new_type_map);
+	cf_hmap8_free(&new_type_map);
 
 	return 0; // XXX ???
 }
 
+/*
+ * Collect the named new types of `n` scoreboards `sbs` and look them all up
+ * at once.
+ *
+ * Types already in `ctx->type_cache` are resolved here and left out of the
+ * batch. If the lookup itself fails, `out->refs` is NULL and
+ * commit_one_struct() falls back to looking up types one by one.
+ */
+static int
+make_struct_batch(struct_scoreboard_t *sbs, size_t n, index_ctx_t *ctx,
+		struct_batch_t *out)
+{
+	int error;
+	size_t capacity = 0;
+
+	memset(out, 0, sizeof(*out));
+	for (size_t i = 0; i < n; ++i) {
+		capacity += struct_vec_len(&sbs[i].new_types);
+	}
+
+	if (!(out->ends = cf_malloc(n * sizeof(*out->ends)))) {
+		error = ENOMEM;
+		goto fail;
+	}
+	if (capacity && !(out->pkgs = cf_malloc(capacity * sizeof(*out->pkgs)))) {
+		error = ENOMEM;
+		goto fail;
+	}
+	if (capacity && !(out->keys = cf_malloc(capacity * sizeof(*out->keys)))) {
+		error = ENOMEM;
+		goto fail;
+	}
+
+	for (size_t i = 0; i < n; ++i) {
+		struct_scoreboard_t *sb = &sbs[i];
+		cf_vec_iter_t it;
+		struct_iter_make(&sb->new_types, &it);
+		while (struct_iter_next(&it)) {
+			struct_pkg_t *pkg = struct_iter_peek(&it);
+			cf_assert(pkg->type_id);
+
+			uint64_t dummy;
+			if (cf_map8_lookup(&sb->unnamed_types, (uintptr_t)pkg->type_id,
+					&dummy)) {
+				// skip unnamed types
+				cf_print_warn("type id %p has no name\n", pkg->type_id);
+				continue;
+			}
+			if (struct_is_cached(pkg, ctx)) {
+				continue;
+			}
+
+			out->pkgs[out->len] = pkg;
+			out->keys[out->len] = (db_typename_key_t) {
+				.loc = &pkg->loc[1],
+				.name = &pkg->name,
+			};
+			++out->len;
+		}
+		struct_iter_free(&it);
+		out->ends[i] = out->len;
+	}
+
+	if (!out->len) {
+		return 0;
+	}
+
+	if (!(out->refs = cf_malloc(out->len * sizeof(*out->refs)))) {
+		error = ENOMEM;
+		goto fail;
+	}
+	out->evictions = ctx->type_cache.stats.evictions;
+	if ((error = cf_db_typename_lookup_many(ctx->db, out->keys, out->len,
+			out->refs))) {
+		cf_print_err("cannot look up %zu typenames, error %d\n", out->len,
+				error);
+		cf_free(out->refs);
+		out->refs = NULL;
+	}
+	return 0;
+fail:
+	free_struct_batch(out);
+	return error;
+}
+
+static void
+free_struct_batch(struct_batch_t *batch)
+{
+	cf_free(batch->ends);
+	cf_free(batch->refs);
+	cf_free(batch->keys);
+	cf_free(batch->pkgs);
+	memset(batch, 0, sizeof(*batch));
+}
+
+/*
+ * Check for a struct from a header shared with a previous TU, or an earlier
+ * struct in the same batch. If it's cached, add it to `ctx`s "old" type map.
+ */
+static bool
+struct_is_cached(struct_pkg_t *pkg, index_ctx_t *ctx)
+{
+	type_ref_t struct_ref;
+	if (!type_cache_find(ctx, &pkg->loc[1], &pkg->name, &struct_ref)) {
+		return false;
+	}
+
+	type_map_insert(&ctx->type_map, pkg->type_id, struct_ref);
+	return true;
+}
+
 /*
  * Steps:
  * - check for a preexisting entry according to `pkg->name`
+ *   `found` is the result of a batch lookup; without one, do a single lookup
  *   if it preexists, add to `ctx`s "old" type map
  *   no new database entries will be created
  * - insert typename_entry_t then type_entry_t into database
  * - save new rowid in `new_type_map`
  */
 static int
-commit_one_struct(struct_pkg_t *pkg, cf_map8_t *new_type_map, index_ctx_t *ctx)
+commit_one_struct(struct_pkg_t *pkg, const type_ref_t *found,
+		cf_hmap8_t *new_type_map, index_ctx_t *ctx)
 {
 	int error;
 	type_ref_t struct_ref;
 
-	error = cf_db_typename_lookup(ctx->db, &pkg->loc[1], &pkg->name,
-			&struct_ref);
+	// the same typename may appear twice in one batch
+	if (struct_is_cached(pkg, ctx)) {
+		return 0;
+	}
+
+	if (found) {
+		struct_ref = *found;
+		error = struct_ref.rowid ? 0 : ENOENT;
+	} else {
+		error = cf_db_typename_lookup(ctx->db, &pkg->loc[1], &pkg->name,
+				&struct_ref);
+	}
 	if (!error) {
 		// preexists, mutate old type map
 		type_map_insert(&ctx->type_map, pkg->type_id, struct_ref);
+		error = type_cache_insert(ctx, &pkg->loc[1], &pkg->name, struct_ref);
 		goto fail;
 	} else if (error != ENOENT) {
 		// some other error; can't determine if the struct preexists
@@ -789,8 +1375,11 @@ commit_one_struct(struct_pkg_t *pkg, cf_map8_t *new_type_map, index_ctx_t *ctx)
 		goto fail_name;
 	}
 
+	note_snippet(ctx, &pkg->loc[0]);
+	note_snippet(ctx, &pkg->loc[1]);
+
 	type_map_insert(new_type_map, pkg->type_id, struct_ref);
-	return 0;
+	return type_cache_insert(ctx, &pkg->loc[1], &pkg->name, struct_ref);
 fail_name:
 	// XXX type entry inserted above is leaked here
 fail:
@@ -804,7 +1393,7 @@ fail:
  * write the db ref to `*out`.
  */
 static bool
-translate_member_type(cf_map8_t *map1, cf_map8_t *map2, clang_type_t old,
+translate_member_type(cf_hmap8_t *map1, cf_hmap8_t *map2, clang_type_t old,
 		type_ref_t *out)
 {
 	if (!old) {
@@ -820,10 +1409,10 @@ translate_member_type(cf_map8_t *map1, cf_map8_t *map2, clang_type_t old,
 }
 
 static bool
-translate_struct_type(cf_map8_t *map, clang_type_t old, type_ref_t *out)
+translate_struct_type(cf_hmap8_t *map, clang_type_t old, type_ref_t *out)
 {
 	uint64_t new;
-	if (!cf_map8_lookup(map, (uintptr_t)old, &new)) {
+	if (!cf_hmap8_lookup(map, (uintptr_t)old, &new)) {
 		return false;
 	}
 	out->rowid = (int64_t)new;
@@ -840,6 +1429,7 @@ commit_one_member(member_pkg_t *pkg, index_ctx_t *ctx)
 	cf_assert(pkg->entry.parent.p);
 	// zero for primitives
 	// cf_assert(pkg->entry.base_type.p);
+	note_snippet(ctx, &pkg->loc);
 	return cf_db_member_insert(ctx->db, &pkg->loc, &pkg->entry);
 }
 
@@ -852,24 +1442,118 @@ commit_one_type_use(type_use_pkg_t *pkg, index_ctx_t *ctx)
 {
 	cf_assert(pkg->entry.base_type.p);
 	cf_assert(pkg->entry.kind);
+	note_snippet(ctx, &pkg->loc);
 	return cf_db_type_use_insert(ctx->db, &pkg->loc, &pkg->entry);
 }
 
 /*
- * `cursor` is a typedef or variable decl for the primary struct in `sb`.
+ * Count `pkg` in `ctx->use_counts` instead of inserting it. The first
+ * `ctx->use_samples` uses of each key are also inserted, as samples of where
+ * the type is used.
+ *
+ * Steps:
+ * - hash (type, file, kind)
+ * - find its entry in `use_counts`, probing past hash collisions
+ * - add a new entry if there's none
+ * - count the use, and insert it if it's a sample
  */
 static int
-struct_scoreboard_add_name(CXCursor cursor, struct_scoreboard_t *sb,
-		index_ctx_t *ctx)
+count_one_type_use(type_use_pkg_t *pkg, index_ctx_t *ctx)
 {
-	cf_assert(struct_vec_len(&sb->new_types));
+	int error;
 
-	// (hack) primary struct is always at index 0
-	struct_pkg_t *entry = struct_vec_at(&sb->new_types, 0);
-	cf_assert(entry);
-	const enum CXCursorKind cursor_kind = clang_getCursorKind(cursor);
+	const db_type_use_count_t key = {
+		.base_type = pkg->entry.base_type,
+		.file = pkg->loc.file,
+		.kind = pkg->entry.kind,
+	};
+	uint64_t hash = cf_hash_bytes(0, &key.base_type.rowid,
+			sizeof(key.base_type.rowid));
+	hash = cf_hash_bytes(hash, &key.file.rowid, sizeof(key.file.rowid));
+	hash = cf_hash_bytes(hash, &key.kind, sizeof(key.kind));
+
+	db_type_use_count_t *entry = NULL;
+	uint64_t value;
+	// note: 0 isn't a valid key
+	for (hash = hash ? hash : 1; cf_hmap8_lookup(&ctx->use_count_index, hash,
+			&value); hash = (hash + 1) ? (hash + 1) : 1) {
+		entry = use_count_vec_at(&ctx->use_counts, (size_t)value - 1);
+		if ((entry->base_type.rowid == key.base_type.rowid) &&
+				(entry->file.rowid == key.file.rowid) &&
+				(entry->kind == key.kind)) {
+			break;
+		}
+		entry = NULL;
+	}
 
-	// double check it's in the unnamed types map
+	if (!entry) {
+		if (!use_count_vec_push(&ctx->use_counts, &key)) {
+			return ENOMEM;
+		}
+		const size_t len = use_count_vec_len(&ctx->use_counts);
+		if ((error = cf_hmap8_insert(&ctx->use_count_index, hash, len))) {
+			return error;
+		}
+		entry = use_count_vec_at(&ctx->use_counts, len - 1);
+	}
+
+	if (++entry->count > ctx->use_samples) {
+		return 0;
+	}
+	return commit_one_type_use(pkg, ctx);
+}
+
+/*
+ * Add the type use counts of the TU to the database, then empty them.
+ *
+ * One row per (type, file, kind) is written rather than a row per use.
+ */
+static int
+flush_use_counts(index_ctx_t *ctx)
+{
+	int error = 0;
+
+	const size_t len = use_count_vec_len(&ctx->use_counts);
+	for (size_t i = 0; i < len; ++i) {
+		const db_type_use_count_t *entry = use_count_vec_at(&ctx->use_counts,
+				i);
+		if ((error = cf_db_type_use_count_insert(ctx->db, entry,
+				/*max*/false))) {
+			cf_print_err("cannot insert use count of type %lld, error %d\n",
+					p_(entry->base_type.rowid), error);
+			break;
+		}
+	}
+
+	cf_print_info("%zu type use counts\n", len);
+	reset_use_counts(ctx);
+	return error;
+}
+
+static void
+reset_use_counts(index_ctx_t *ctx)
+{
+	use_count_vec_reset(&ctx->use_counts);
+	// no reset for hash maps
+	cf_hmap8_free(&ctx->use_count_index);
+	cf_hmap8_make(&ctx->use_count_index);
+}
+
+/*
+ * `cursor` is a typedef or variable decl for the primary struct in `sb`.
+ */
+static int
+struct_scoreboard_add_name(CXCursor cursor, struct_scoreboard_t *sb,
+		index_ctx_t *ctx)
+{
+	cf_assert(struct_vec_len(&sb->new_types));
+
+	// (hack) primary struct is always at index 0
+	struct_pkg_t *entry = struct_vec_at(&sb->new_types, 0);
+	cf_assert(entry);
+	const enum CXCursorKind cursor_kind = clang_getCursorKind(cursor);
+
+	// double check it's in the unnamed types map
 	uint64_t index;
 	if (cf_map8_lookup(&sb->unnamed_types, (uintptr_t)entry->type_id, &index)) {
 		cf_assert(index == 0);
@@ -928,6 +1612,36 @@ print_scoreboard_stats(const struct_scoreboard_t *sb)
 }
 
 /*
+ * Report how well `cache` did for the size it was allowed.
+ *
+ * Compare runs with different `index_config_t::cache_budget`s to pick one.
+ * Each miss costs a database lookup.
+ */
+static void
+print_cache_stats(const char *name, const cf_cache8_t *cache)
+{
+	const cf_cache_stats_t *stats = &cache->stats;
+	const uint64_t lookups = stats->hits + stats->misses;
+	const size_t budget = cf_cache8_budget(cache);
+	char budget_str[32] = "unbounded";
+
+	if (budget) {
+		snprintf(budget_str, sizeof(budget_str), "%zu KiB", budget / 1024);
+	}
+	cf_print_info("%s cache: %zu KiB of %s, %llu/%llu hits (%.1f%%),"
+			" %llu inserts, %llu evictions\n",
+			name, cf_cache8_bytes(cache) / 1024, budget_str,
+			p_(stats->hits), p_(lookups),
+			lookups ? (100.0 * (double)stats->hits / (double)lookups) : 0.0,
+			p_(stats->inserts), p_(stats->evictions));
+}
+
+/*
+ * Add every file in `tu` to the database, then record them as dependencies of
+ * `tu`.
+ *
+ * Files not already known are first resolved together with
+ * cf_db_resolve_files(), rather than one at a time as they're added.
  */
 static int
 index_includes(CXTranslationUnit tu, index_ctx_t *ctx)
@@ -935,13 +1649,257 @@ index_includes(CXTranslationUnit tu, index_ctx_t *ctx)
 	include_ctx_t sub_ctx = {
 		.db = ctx->db,
 		.file_map = &ctx->file_map,
+		.alias_files = &ctx->alias_files,
+		.file_cache = &ctx->file_cache,
 		.error = 0,
 	};
+	// queue each new include in `tu` with prefetch_include_cb()
+	clang_getInclusions(tu, prefetch_include_cb, &sub_ctx);
+	if (sub_ctx.error) {
+		return sub_ctx.error;
+	}
+	cf_db_resolve_files(ctx->db);
+
 	// call out to index_include_cb() on each include in `tu`
 	clang_getInclusions(tu, index_include_cb, &sub_ctx);
 
 	// propagate any error during iteration
-	return sub_ctx.error;
+	if (sub_ctx.error) {
+		return sub_ctx.error;
+	}
+
+	if (!sub_ctx.tu.rowid) {
+		// no main file; nothing to depend on it
+		return 0;
+	}
+	return index_tu_deps(sub_ctx.tu, ctx);
+}
+
+/*
+ * Store the source lines noted by note_snippet() while indexing `tu`.
+ *
+ * Lines are stored per file. A header included by many TUs gets the lines of
+ * whatever each TU added from it; cf_db_snippet_insert() merges them.
+ *
+ * Steps:
+ * - sort and deduplicate `ctx->snippet_keys`
+ * - for each file, read its contents from `tu` and store its lines
+ * - reset `ctx->snippet_keys`
+ */
+static int
+index_snippets(CXTranslationUnit tu, index_ctx_t *ctx)
+{
+	int error = 0;
+	size_t len = snippet_key_vec_len(&ctx->snippet_keys);
+
+	if (!len) {
+		return 0;
+	}
+
+	// note: the vector's storage is contiguous
+	snippet_key_t *keys = snippet_key_vec_at(&ctx->snippet_keys, 0);
+	qsort(keys, len, sizeof(*keys), compare_snippet_keys);
+	len = unique_snippet_keys(keys, len);
+
+	size_t start = 0;
+	while (start < len) {
+		size_t end = start + 1;
+		while ((end < len) && (keys[end].file == keys[start].file)) {
+			++end;
+		}
+
+		CXFile file = file_map_find(&ctx->file_map, keys[start].file);
+		if (!file) {
+			cf_print_err("no file for snippets of %lld\n",
+					p_(keys[start].file));
+		} else if ((error = store_file_snippets(tu, file, &keys[start],
+				end - start, ctx))) {
+			break;
+		}
+		start = end;
+	}
+
+	snippet_key_vec_reset(&ctx->snippet_keys);
+	return error;
+}
+
+/*
+ * Store lines `keys` of `file`. Every key is in the same file, sorted by
+ * line.
+ */
+static int
+store_file_snippets(CXTranslationUnit tu, CXFile file,
+		const snippet_key_t *keys, size_t len, index_ctx_t *ctx)
+{
+	int error;
+
+	size_t size;
+	const char *contents = clang_getFileContents(tu, file, &size);
+	if (!contents) {
+		// e.g., a file the preprocessor never loaded; nothing to store
+		cf_print_debug("no contents for snippets of %lld\n", p_(keys[0].file));
+		return 0;
+	}
+
+	db_snippet_t *lines = cf_malloc(sizeof(*lines) * len);
+	if (!lines) {
+		return ENOMEM;
+	}
+
+	// walk `contents` once; `keys` are in line order
+	size_t num_lines = 0;
+	const char *pos = contents;
+	const char *const end = contents + size;
+	uint32_t line = 1;
+	for (size_t i = 0; (i < len) && (pos < end); ++i) {
+		while ((line < keys[i].line) && (pos < end)) {
+			const char *nl = memchr(pos, '\n', (size_t)(end - pos));
+			pos = nl ? (nl + 1) : end;
+			++line;
+		}
+		if (pos == end) {
+			break;
+		}
+
+		const char *nl = memchr(pos, '\n', (size_t)(end - pos));
+		db_snippet_t *snippet = &lines[num_lines];
+		snippet->line = line;
+		extract_snippet(pos, (size_t)((nl ? nl : end) - pos), &snippet->text);
+		if (!cf_str_is_null(&snippet->text)) {
+			++num_lines;
+		}
+	}
+
+	const file_ref_t ref = {.rowid = keys[0].file};
+	error = cf_db_snippet_insert(ctx->db, ref, lines, num_lines);
+
+	cf_free(lines);
+	return error;
+}
+
+/*
+ * Borrow the part of source line `line` worth printing into `out`.
+ *
+ * Surrounding whitespace is dropped. A line longer than `DB_SNIPPET_MAX_LEN`
+ * is cut short, but not in the middle of a UTF-8 sequence. Blank lines become
+ * a null string.
+ */
+static void
+extract_snippet(const char *line, size_t len, cf_str_t *out)
+{
+	while (len && ((line[0] == ' ') || (line[0] == '\t'))) {
+		++line;
+		--len;
+	}
+	while (len && ((line[len - 1] == ' ') || (line[len - 1] == '\t') ||
+			(line[len - 1] == '\r'))) {
+		--len;
+	}
+
+	if (len > DB_SNIPPET_MAX_LEN) {
+		len = DB_SNIPPET_MAX_LEN;
+		// back up to the start of a UTF-8 sequence
+		while (len && (((unsigned char)line[len] & 0xc0) == 0x80)) {
+			--len;
+		}
+	}
+
+	if (!len) {
+		cf_str_null(out);
+		return;
+	}
+	cf_str_borrow(line, len, out);
+}
+
+static int
+compare_snippet_keys(const void *lhs_, const void *rhs_)
+{
+	const snippet_key_t *const lhs = lhs_;
+	const snippet_key_t *const rhs = rhs_;
+
+	int ret = (lhs->file > rhs->file) - (lhs->file < rhs->file);
+	if (ret) {
+		return ret;
+	}
+	return (lhs->line > rhs->line) - (lhs->line < rhs->line);
+}
+
+/*
+ * Remove adjacent duplicates from sorted `keys`. Return the new length.
+ */
+static size_t
+unique_snippet_keys(snippet_key_t *keys, size_t len)
+{
+	size_t out = 0;
+
+	for (size_t i = 0; i < len; ++i) {
+		if (!out || (compare_snippet_keys(&keys[out - 1], &keys[i]) != 0)) {
+			keys[out++] = keys[i];
+		}
+	}
+	return out;
+}
+
+/*
+ * Record every file in `ctx->file_map` as a dependency of `tu`.
+ *
+ * `ctx->file_map` is reset between TUs, so it holds exactly the files
+ * included by `tu`, and `tu` itself.
+ */
+static int
+index_tu_deps(file_ref_t tu, index_ctx_t *ctx)
+{
+	int error = 0;
+
+	cf_vec_citer_t it;
+	cf_vec_citer_make(&ctx->file_map.v, &it);
+	while (cf_vec_citer_next(&it)) {
+		const cf_map_entry_t *entry = cf_vec_citer_peek(&it);
+		const file_ref_t dep = {.rowid = (int64_t)entry->value};
+
+		if ((error = cf_db_tu_dep_insert(ctx->db, tu, dep))) {
+			cf_print_err("cannot add TU dependency %lld->%lld, error %d\n",
+					p_(tu.rowid), p_(dep.rowid), error);
+			break;
+		}
+	}
+	cf_vec_citer_free(&it);
+
+	return error;
+}
+
+/*
+ * Add main file `path` of a TU to the database, if there are any clean TUs it
+ * could be one of.
+ *
+ * The file is usually already there, in which case adding it is a lookup.
+ * Otherwise it's inserted now instead of when the TU is indexed. Return false
+ * if there are no clean TUs or the file can't be added.
+ */
+static bool
+add_clean_tu_file(const char *path, index_ctx_t *ctx, file_ref_t *out)
+{
+	if (!cf_map8_len(&ctx->clean_tus)) {
+		return false;
+	}
+
+	bool alias;
+	if (cf_db_add_file(ctx->db, path, strlen(path), out, &alias)) {
+		// e.g., `path` is relative to some other directory
+		return false;
+	}
+	return true;
+}
+
+/*
+ * Check whether the TU with main file `tu` is already up to date in the
+ * database.
+ */
+static bool
+tu_is_clean(const index_ctx_t *ctx, file_ref_t tu)
+{
+	uint64_t dummy;
+	return cf_map8_lookup(&ctx->clean_tus, (uint64_t)tu.rowid, &dummy);
 }
 
 static void
@@ -949,6 +1907,38 @@ nop(CF_UNUSED CXCursor parent, CF_UNUSED void *ctx)
 {
 }
 
+/*
+ * Used as a callback in index_includes().
+ *
+ * Queue `included_file` to be resolved if index_include_cb() is going to add
+ * it to the database. Files already added by this TU or a previous one are
+ * skipped.
+ */
+static void
+prefetch_include_cb(CXFile included_file,
+		CF_UNUSED CXSourceLocation *inclusion_stack,
+		CF_UNUSED unsigned include_len, CXClientData ctx_)
+{
+	int error;
+	include_ctx_t *ctx = ctx_;
+	file_ref_t ref;
+
+	if (ctx->error || file_map_lookup(ctx->file_map, included_file, &ref) ||
+			cf_cache8_contains(ctx->file_cache,
+			file_cache_key(included_file))) {
+		return;
+	}
+
+	CXString name = clang_getFileName(included_file);
+	const char *c_string = clang_getCString(name);
+	if ((error = cf_db_prefetch_file(ctx->db, c_string, strlen(c_string)))) {
+		cf_print_debug("cannot prefetch #include file '%s', error %d\n",
+				c_string, error);
+		ctx->error = error;
+	}
+	clang_disposeString(name);
+}
+
 /*
  * Used as a callback in index_includes().
  *
@@ -968,7 +1958,6 @@ index_include_cb(CXFile included_file, CXSourceLocation *inclusion_stack,
 		unsigned include_len, CXClientData ctx_)
 {
 	(void)inclusion_stack;
-	(void)include_len;
 	int error;
 	include_ctx_t *ctx = ctx_;
 
@@ -989,53 +1978,343 @@ index_include_cb(CXFile included_file, CXSourceLocation *inclusion_stack,
 		goto fail;
 	}
 
-	// file is new
+	// file is new to this TU
+
+	// maybe a previous TU already added it to the db
+	const uint64_t key = file_cache_key(included_file);
+	uint64_t cached;
+	bool alias;
+	if (cf_cache8_lookup(ctx->file_cache, key, &cached)) {
+		ref.rowid = (int64_t)(cached & INT64_MAX);
+		alias = (cached >> 63);
+		cf_print_debug("cached include '%s', rowid %lld\n",
+				clang_getCString(name), p_(ref.rowid));
+	} else {
+		// add to db
+		const char *c_string = clang_getCString(name);
+		if ((error = cf_db_add_file(ctx->db, c_string, strlen(c_string),
+				&ref, &alias))) {
+			cf_print_debug("cannot add #include file '%s', error %d\n",
+					c_string, error);
+			ctx->error = error;
+			goto fail;
+		}
+		cf_assert(ref.rowid >= 0);
+		if (key && (error = cf_cache8_insert(ctx->file_cache, key,
+				(uint64_t)ref.rowid | ((uint64_t)alias << 63)))) {
+			ctx->error = error;
+			goto fail;
+		}
+	}
+
+	// track the mapping from file ID -> rowid
+	cf_print_info("map file %p->%ld\n", included_file, ref.rowid);
+	file_map_add(ctx->file_map, included_file, ref);
 
-	// add to db
-	const char *c_string = clang_getCString(name);
-	if ((error = cf_db_add_file(ctx->db, c_string, strlen(c_string), &ref))) {
-		cf_print_debug("cannot add #include file '%s', error %d\n",
-				c_string, error);
-		ctx->error = error;
+	// a duplicate shares its rowid with the original
+	if (alias) {
+		cf_print_info("file %p duplicates rowid %ld\n", included_file,
+				ref.rowid);
+		file_map_add(ctx->alias_files, included_file, ref);
+	}
+
+	// an empty include stack means this is the main file
+	if (!include_len) {
+		ctx->tu = ref;
+	}
+
+fail:
+	clang_disposeString(name);
+}
+
+/*
+ * Index all children of translation unit `tu` and mutate `ctx`.
+ */
+static int
+index_tu(CXTranslationUnit tu, index_ctx_t *ctx)
+{
+	int error = 0;
+
+	// make a cursor starting at the root of the TU
+	CXCursor root = clang_getTranslationUnitCursor(tu);
+	if (clang_Cursor_isNull(root)) {
+		cf_print_err("can't get TU root node\n");
+		error = -2;
 		goto fail;
 	}
-	// track the mapping from file ID -> rowid
-	cf_print_info("map file %p->%ld\n", included_file, ref.rowid);
-	file_map_add(ctx->file_map, included_file, ref);
 
-fail:
-	clang_disposeString(name);
+	cf_print_info("starting iteration\n");
+
+	// a failed split only means traversing on this thread
+	if (ctx->split.max_threads > 1) {
+		(void)start_tu_split(root, ctx);
+	}
+
+	iterate_children_args_t args = {
+		.path = &ctx->path,
+		.cb = index_ast_node_,
+		.final = nop,
+		.real_ctx = ctx,
+	};
+	(void)iterate_children(root, &args);
+	(void)commit_staged_structs(ctx);
+
+	stop_tu_split(ctx);
+
+	cf_print_info("iteration complete, found %d nodes\n", ctx->path.count);
+fail:
+	return error;
+}
+
+/*
+ * Split the top-level structs of the TU at `root` across threads.
+ *
+ * Generated TUs, like register maps, can have tens of thousands of top-level
+ * structs. Traversing them dominates the time to index such a TU. Most of
+ * that is the traversal of each struct's children into a scoreboard, which
+ * doesn't depend on anything indexed before it. So threads build the
+ * scoreboards of a window of structs ahead of time, each into its own. The
+ * walk of the TU then runs like normal, on this thread, in AST order. As it
+ * reaches each struct, it swaps in the struct's scoreboard instead of
+ * traversing it, and commits it. Everything that reads or writes the
+ * database still happens in the same order, so the database is the same as
+ * without splitting.
+ *
+ * libclang doesn't promise that a TU can be read from several threads. The
+ * AST is done changing once it's parsed, but clang still fills some caches
+ * lazily: source locations go through the source manager's lookup caches,
+ * and a type's layout is computed on first use. Those calls are made under
+ * `clang_lock`, as is pretty-printing a decl in get_struct_name_kind(),
+ * since the printer's internals aren't documented as read-only. The rest of
+ * a struct's traversal only reads the AST: TUs aren't parsed with a preamble
+ * or modules, so clang_visitChildren() walks decls that are all in memory
+ * rather than deserializing them on demand, and cursor kinds, spellings, and
+ * canonical types are read off the decls and types as they are.
+ *
+ * Steps:
+ * - collect the indexable top-level structs
+ *   don't split a TU with few of them
+ * - allocate a window of scoreboards
+ *   the first window is built once the walk reaches the first struct
+ */
+static int
+start_tu_split(CXCursor root, index_ctx_t *ctx)
+{
+	tu_split_t *split = &ctx->split;
+
+	cursor_stack_reset(&split->cursors);
+	(void)clang_visitChildren(root, collect_split_cb, ctx);
+
+	const size_t num_structs = cursor_stack_len(&split->cursors);
+	if (num_structs < TU_SPLIT_MIN_STRUCTS) {
+		return 0;
+	}
+
+	split->units = cf_malloc(TU_SPLIT_WINDOW * sizeof(*split->units));
+	if (!split->units) {
+		return ENOMEM;
+	}
+	for (size_t i = 0; i < TU_SPLIT_WINDOW; ++i) {
+		make_struct_scoreboard(&split->units[i].sb);
+		split->units[i].built = false;
+	}
+
+	cf_print_info("split TU: %zu top-level structs, %zu threads\n",
+			num_structs, split->max_threads);
+	split->active = true;
+	split->next = 0;
+	split->base = 0;
+	split->len = 0;
+	return 0;
+}
+
+/*
+ * Free the state of a split TU, if it was split.
+ */
+static void
+stop_tu_split(index_ctx_t *ctx)
+{
+	tu_split_t *split = &ctx->split;
+
+	if (split->units) {
+		for (size_t i = 0; i < TU_SPLIT_WINDOW; ++i) {
+			free_struct_scoreboard(&split->units[i].sb);
+		}
+		cf_free(split->units);
+		split->units = NULL;
+	}
+	cursor_stack_reset(&split->cursors);
+	split->active = false;
+}
+
+/*
+ * Collect top-level struct decls the walk of the TU passes to index_struct().
+ *
+ * These are the same nodes index_ast_node() dispatches to index_struct() (or
+ * index_alias_struct()), in the same order.
+ */
+static enum CXChildVisitResult
+collect_split_cb(CXCursor cursor, CF_UNUSED CXCursor parent,
+		CXClientData ctx_)
+{
+	index_ctx_t *ctx = ctx_;
+
+	switch (clang_getCursorKind(cursor)) {
+		case CXCursor_StructDecl:
+		case CXCursor_UnionDecl:
+		case CXCursor_EnumDecl:
+			break;
+		default:
+			return CXChildVisit_Continue;
+	}
+	if (cursor_is_indexable(cursor, ctx) &&
+			!cursor_stack_push(&ctx->split.cursors, &cursor)) {
+		// a split TU needs every struct
+		cf_print_err("cannot collect struct to split TU\n");
+		return CXChildVisit_Break;
+	}
+	return CXChildVisit_Continue;
+}
+
+/*
+ * Take the scoreboard built ahead of time for top-level struct `cursor`.
+ *
+ * Every top-level struct takes its unit, even if it's then skipped as a
+ * duplicate, to keep the walk in step with `ctx->split.cursors`. Return NULL
+ * if the TU isn't split, if `cursor` isn't top-level, or if its scoreboard
+ * wasn't built; index_struct() traverses `cursor` itself then.
+ */
+static struct_scoreboard_t *
+take_split_unit(CXCursor cursor, CXCursor parent, index_ctx_t *ctx)
+{
+	tu_split_t *split = &ctx->split;
+
+	if (!split->active ||
+			(clang_getCursorKind(parent) != CXCursor_TranslationUnit)) {
+		return NULL;
+	}
+
+	if (split->next == cursor_stack_len(&split->cursors)) {
+		goto fail;
+	}
+	if (split->next == split->base + split->len) {
+		build_split_window(ctx);
+	}
+
+	split_unit_t *unit = &split->units[split->next - split->base];
+	if (!clang_equalCursors(unit->cursor, cursor)) {
+		goto fail;
+	}
+	++split->next;
+	return unit->built ? &unit->sb : NULL;
+fail:
+	// shouldn't happen; finish the TU on this thread
+	cf_print_err("split TU out of step at struct %zu\n", split->next);
+	split->active = false;
+	return NULL;
+}
+
+/*
+ * Build the scoreboards of the next window of structs, starting at
+ * `ctx->split.next`.
+ *
+ * Every thread, including the caller's, takes the next struct of the window
+ * off a shared atomic counter until none are left. Each only writes to its
+ * struct's unit. If threads can't be started, the caller builds the rest by
+ * itself.
+ *
+ * Steps:
+ * - reset the units of the last window
+ * - pick a thread count from the size of the window
+ * - start the threads; the caller works alongside them
+ * - wait for all of them
+ */
+static void
+build_split_window(index_ctx_t *ctx)
+{
+	tu_split_t *split = &ctx->split;
+	pthread_t threads[TU_SPLIT_MAX_THREADS - 1];
+
+	for (size_t i = 0; i < split->len; ++i) {
+		reset_struct_scoreboard(&split->units[i].sb);
+		split->units[i].built = false;
+	}
+
+	split->base = split->next;
+	split->len = MIN(TU_SPLIT_WINDOW,
+			cursor_stack_len(&split->cursors) - split->base);
+	for (size_t i = 0; i < split->len; ++i) {
+		split->units[i].cursor =
+				*cursor_stack_at(&split->cursors, split->base + i);
+	}
+
+	split_build_ctx_t build = {
+		.ctx = ctx,
+		.units = split->units,
+		.len = split->len,
+	};
+	atomic_init(&build.next, 0);
+
+	// the caller's thread counts as one
+	size_t want = (split->len - 1) / TU_SPLIT_STRUCTS_PER_THREAD;
+	want = MIN(want, split->max_threads - 1);
+	size_t num_threads = 0;
+	for (; num_threads < want; ++num_threads) {
+		int error;
+		if ((error = pthread_create(&threads[num_threads], NULL,
+				split_worker, &build))) {
+			cf_print_debug("cannot start split thread, error %d\n", error);
+			break;
+		}
+	}
+
+	build_split_units(&build);
+
+	for (size_t i = 0; i < num_threads; ++i) {
+		(void)pthread_join(threads[i], NULL);
+	}
+	cf_print_info("built structs %zu..%zu on %zu threads\n", split->base,
+			split->base + split->len, num_threads + 1);
+}
+
+static void *
+split_worker(void *build_)
+{
+	build_split_units(build_);
+	return NULL;
 }
 
 /*
- * Index all children of translation unit `tu` and mutate `ctx`.
+ * Traverse structs of a window into their units' scoreboards, like
+ * index_struct() does.
+ *
+ * A struct's location starts out as `ctx->loc`, which doesn't change while
+ * the window is built.
  */
-static int
-index_tu(CXTranslationUnit tu, index_ctx_t *ctx)
+static void
+build_split_units(split_build_ctx_t *build)
 {
-	int error = 0;
+	for (;;) {
+		const size_t i = atomic_fetch_add_explicit(&build->next, 1,
+				memory_order_relaxed);
+		if (i >= build->len) {
+			break;
+		}
+		split_unit_t *unit = &build->units[i];
+		struct_scoreboard_t *sb = &unit->sb;
+
+		bool in_alias_file = false;
+		memcpy(&sb->loc, &build->ctx->loc, sizeof(loc_ctx_t));
+		locate_cursor(build->ctx, unit->cursor, &sb->loc, &in_alias_file);
+		if (in_alias_file) {
+			// likely skipped as a duplicate; traversed later if not
+			continue;
+		}
 
-	// make a cursor starting at the root of the TU
-	CXCursor root = clang_getTranslationUnitCursor(tu);
-	if (clang_Cursor_isNull(root)) {
-		cf_print_err("can't get TU root node\n");
-		error = -2;
-		goto fail;
+		index_struct_record(unit->cursor, sb);
+		index_struct_children(unit->cursor, build->ctx, sb);
+		unit->built = true;
 	}
-
-	cf_print_info("starting iteration\n");
-
-	iterate_children_args_t args = {
-		.path = &ctx->path,
-		.cb = index_ast_node_,
-		.final = nop,
-		.real_ctx = ctx,
-	};
-	(void)iterate_children(root, &args);
-
-	cf_print_info("iteration complete, found %d nodes\n", ctx->path.count);
-fail:
-	return error;
 }
 
 /*
@@ -1169,7 +2448,7 @@ index_ast_node_(CXCursor cursor, CXCursor parent, CXClientData ctx)
  *     node is just indexed like normal.
  */
 static enum CXChildVisitResult
-index_ast_node(CXCursor cursor, CF_UNUSED CXCursor parent, index_ctx_t *ctx)
+index_ast_node(CXCursor cursor, CXCursor parent, index_ctx_t *ctx)
 {
 	enum CXChildVisitResult ret = CXChildVisit_Recurse;
 
@@ -1190,10 +2469,8 @@ index_ast_node(CXCursor cursor, CF_UNUSED CXCursor parent, index_ctx_t *ctx)
 		const bool skip = special_index_struct_name(
 				cursor, &ctx->struct_sb, ctx);
 
-		// commit and reset regardless of whether struct has a name
-		// reset `ctx` and commit scoreboard to the database
-		(void)commit_struct_scoreboard(&ctx->struct_sb, ctx);
-		reset_struct_scoreboard(&ctx->struct_sb);
+		// stage regardless of whether struct has a name
+		(void)stage_struct_scoreboard(ctx);
 		ctx->last_struct = (clang_type_t)0;
 
 		if (skip) {
@@ -1208,8 +2485,20 @@ index_ast_node(CXCursor cursor, CF_UNUSED CXCursor parent, index_ctx_t *ctx)
 	switch (kind) {
 		case CXCursor_StructDecl:
 		case CXCursor_UnionDecl:
-		case CXCursor_EnumDecl:
-			if (index_struct(cursor, ctx)) {
+		case CXCursor_EnumDecl: {
+			// taken even if it's a duplicate
+			struct_scoreboard_t *built =
+					take_split_unit(cursor, parent, ctx);
+			// its copy may be staged; look it up in the database
+			if (ctx->in_alias_file) {
+				(void)commit_staged_structs(ctx);
+			}
+			if (ctx->in_alias_file && index_alias_struct(cursor, ctx)) {
+				// already indexed from the original file
+				ret = CXChildVisit_Continue;
+				break;
+			}
+			if (index_struct(cursor, built, ctx)) {
 				// need name
 				ctx->last_struct = get_clang_type(clang_getCursorType(cursor));
 				cf_print_info("look for struct %p name next iter\n",
@@ -1217,6 +2506,7 @@ index_ast_node(CXCursor cursor, CF_UNUSED CXCursor parent, index_ctx_t *ctx)
 			}
 			ret = CXChildVisit_Continue;
 			break;
+		}
 		case CXCursor_TypedefDecl:
 			index_typedef(cursor, ctx);
 			break;
@@ -1254,8 +2544,8 @@ special_index_struct_name(CXCursor cursor, struct_scoreboard_t *sb,
 		cursor_type = get_clang_type(
 				clang_getCanonicalType(clang_getCursorType(cursor)));
 	} else if (kind == CXCursor_TypedefDecl) {
-		cursor_type = get_clang_type(clang_getCanonicalType(
-				clang_getTypedefDeclUnderlyingType(cursor)));
+		// saved by cursor_is_indexable()
+		cursor_type = ctx->typedef_type;
 	} else {
 		// an unnamed struct must be followed by either a typedef or a var
 		// warn about no substitute name
@@ -1286,14 +2576,13 @@ special_index_struct_name(CXCursor cursor, struct_scoreboard_t *sb,
 static bool
 cursor_is_indexable(CXCursor cursor, index_ctx_t *ctx)
 {
-	(void)ctx;
 	switch (clang_getCursorKind(cursor)) {
 		case CXCursor_StructDecl:
 		case CXCursor_UnionDecl:
 		case CXCursor_EnumDecl:
 			return user_type_is_indexable(cursor);
 		case CXCursor_TypedefDecl:
-			return typedef_is_indexable(cursor);
+			return typedef_is_indexable(cursor, ctx);
 		case CXCursor_VarDecl:
 			return var_is_indexable(cursor);
 		case CXCursor_FunctionDecl:
@@ -1333,15 +2622,19 @@ user_type_is_indexable(CXCursor cursor)
 /*
  * Return true if cursor, which is a typedef decl, is indexable.
  *
+ * The canonical type it names is saved in `ctx->typedef_type` for
+ * index_typedef().
+ *
  * Prohibit the following:
  * - typedefs of primitive types
  */
 static bool
-typedef_is_indexable(CXCursor cursor)
+typedef_is_indexable(CXCursor cursor, index_ctx_t *ctx)
 {
 	CXType old_type =
 			clang_getCanonicalType(clang_getTypedefDeclUnderlyingType(cursor));
 
+	ctx->typedef_type = get_clang_type(old_type);
 	return type_is_indexable(old_type);
 }
 
@@ -1378,6 +2671,19 @@ type_is_indexable(CXType ct)
 
 /*
  * Update `ctx->loc` to the source location of `cursor`.
+ */
+static void
+update_location(index_ctx_t *ctx, CXCursor cursor)
+{
+	locate_cursor(ctx, cursor, &ctx->loc, &ctx->in_alias_file);
+}
+
+/*
+ * Update `loc` to the source location of `cursor`, and optionally set
+ * `in_alias_file` to whether it's in one of `ctx->alias_files`.
+ *
+ * `ctx` is only read, so split threads can call this at once. `loc` is left
+ * as-is if `cursor`'s file isn't known.
  *
  * Steps:
  * - extract file from `cursor`
@@ -1386,22 +2692,25 @@ type_is_indexable(CXType ct)
  * - ignore function and scope level for now
  */
 static void
-update_location(index_ctx_t *ctx, CXCursor cursor)
+locate_cursor(const index_ctx_t *ctx, CXCursor cursor, loc_ctx_t *loc,
+		bool *in_alias_file)
 {
+	CXFile file;
+	unsigned line;
+	unsigned column;
+
+	// both go through the source manager's lookup caches
+	pthread_mutex_lock(&clang_lock);
 	CXSourceRange range = clang_getCursorExtent(cursor);
-	CXSourceLocation loc = clang_getRangeStart(range);
+	clang_getExpansionLocation(clang_getRangeStart(range), &file, &line,
+			&column, /*offset=*/NULL);
+	pthread_mutex_unlock(&clang_lock);
 
 	if (clang_Range_isNull(range)) {
 		// shouldn't happen, but worth checking
 		cf_print_err("null range\n");
 	}
 
-	CXFile file;
-	unsigned line;
-	unsigned column;
-
-	clang_getExpansionLocation(loc, &file, &line, &column, /*offset=*/NULL);
-
 	// check if the current file changed
 	file_ref_t file_ref;
 	if (!file_map_lookup(&ctx->file_map, file, &file_ref)) {
@@ -1411,23 +2720,50 @@ update_location(index_ctx_t *ctx, CXCursor cursor)
 		goto fail;
 	}
 
-	if (ctx->loc.file.rowid != file_ref.rowid) {
-		// file changed; update it in `ctx`
+	file_ref_t dummy;
+	if (in_alias_file) {
+		*in_alias_file = file_map_lookup(&ctx->alias_files, file, &dummy);
+	}
+
+	if (loc->file.rowid != file_ref.rowid) {
+		// file changed; update it in `loc`
 		cf_print_info("file changed from %lld to %lld\n",
-				p_(ctx->loc.file.rowid), p_(file_ref.rowid));
-		ctx->loc.file = file_ref;
+				p_(loc->file.rowid), p_(file_ref.rowid));
+		loc->file = file_ref;
 	}
 
 	// skip function/scope; it can't be updated here
 
 	// update line/column
-	ctx->loc.line = line;
-	ctx->loc.column = column;
+	loc->line = line;
+	loc->column = column;
 
 fail:
 	return;
 }
 
+/*
+ * Remember to store the source line at `loc` once the TU is indexed. See
+ * index_snippets().
+ *
+ * Snippets are best effort. Failing to store one doesn't fail the entry.
+ */
+static void
+note_snippet(index_ctx_t *ctx, const loc_ctx_t *loc)
+{
+	if (!ctx->snippets || !loc->file.rowid || !loc->line) {
+		return;
+	}
+
+	const snippet_key_t key = {
+		.file = loc->file.rowid,
+		.line = loc->line,
+	};
+	if (!snippet_key_vec_push(&ctx->snippet_keys, &key)) {
+		cf_print_err("cannot note snippet %lld:%u\n", p_(key.file), key.line);
+	}
+}
+
 /*
  * cf_assert() that `kind` is a user-defined type.
  */
@@ -1472,8 +2808,11 @@ extract_struct(CXCursor cursor, CXType ct, db_type_entry_t *entry_out)
 	const type_kind_t entry_kind =
 			extract_type_kind(clang_getCursorKind(cursor));
 	// kind of a hack to test incompleteness
+	// note: the layout is computed and cached on first use
+	pthread_mutex_lock(&clang_lock);
 	const bool incomplete = clang_Type_getAlignOf(ct) ==
 			CXTypeLayoutError_Incomplete;
+	pthread_mutex_unlock(&clang_lock);
 
 	*entry_out = (db_type_entry_t) {
 		.kind = entry_kind,
@@ -1508,6 +2847,8 @@ get_struct_name_kind(CXCursor cursor)
 	}
 
 	// do the hack described above to detect unnamed types
+	// (see start_tu_split() for the lock)
+	pthread_mutex_lock(&clang_lock);
 	CXPrintingPolicy policy = clang_getCursorPrintingPolicy(cursor);
 
 	clang_PrintingPolicy_setProperty(policy,
@@ -1537,6 +2878,7 @@ get_struct_name_kind(CXCursor cursor)
 
 	clang_PrintingPolicy_dispose(policy);
 	clang_disposeString(name_data);
+	pthread_mutex_unlock(&clang_lock);
 
 	return unnamed ? struct_name_unnamed : struct_name_direct;
 }
@@ -1638,79 +2980,107 @@ extract_var_name(CXCursor cursor, CXString *out)
 /*
  * Given `cursor` that refers to a typedef AST node, index it.
  *
+ * The type it names may be a struct that's still staged. If any are, the
+ * typedef is staged behind them; otherwise it's committed now.
+ */
+static void
+index_typedef(CXCursor cursor, index_ctx_t *ctx)
+{
+	// the decl's spelling is its name; unlike clang_getTypedefName(), it
+	// doesn't make a CXType, which walks the typedef's whole sugar chain
+	CXString name_data = clang_getCursorSpelling(cursor);
+	const char *c_string = clang_getCString(name_data);
+
+	typedef_pkg_t pkg = {
+		// saved by cursor_is_indexable()
+		.type = ctx->typedef_type,
+		.name.kind = name_kind_typedef,
+		.loc = ctx->loc,
+	};
+	cf_str_borrow(c_string, strlen(c_string), &pkg.name.name);
+
+	if (ctx->num_staged) {
+		if (!stage_typedef(&pkg, ctx)) {
+			goto done;
+		}
+		// can't stage it; commit what it may name first
+		(void)commit_staged_structs(ctx);
+	}
+	(void)commit_one_typedef(&pkg, NULL, ctx);
+
+done:
+	clang_disposeString(name_data);
+}
+
+/*
  * Steps:
  * - check `clang::Type*` already exists in the type map
  *   index_struct() must have already been called on the same type
- * - build a `db_typename_t` entry
  * - check for preexistence in the db
+ *   `found` is the result of a batch lookup; without one, do a single lookup
  *   if so, do nothing
  * - insert entry into database
+ *
+ * Return 0 if `pkg` is in the database afterwards.
  */
-static void
-index_typedef(CXCursor cursor, index_ctx_t *ctx)
+static int
+commit_one_typedef(typedef_pkg_t *pkg, const type_ref_t *found,
+		index_ctx_t *ctx)
 {
 	int error;
+	const char *c_string = pkg->name.name.str;
+	const int len = (int)cf_str_len(&pkg->name.name);
 
 	// resolve old CXType to a database type reference
 	type_ref_t old_ref;
-	CXType old_type = clang_getCanonicalType(
-			clang_getTypedefDeclUnderlyingType(cursor));
-
-	if (!type_map_lookup(&ctx->type_map, old_type, &old_ref)) {
+	if (!type_map_lookup2(&ctx->type_map, pkg->type, &old_ref)) {
 		// 3 reasons:
 		// an incomplete type (XXX unimplemented)
 		// this is a typedef of something not indexable (e.g. int)
 		// a clang bug, a typedef appears before a decl
-		cf_print_debug("cannot find type ref %p\n", get_clang_type(old_type));
-		goto fail;
+		cf_print_debug("cannot find type ref %p\n", pkg->type);
+		return ENOENT;
 	}
-
-	CXString name_data = clang_getTypedefName(clang_getCursorType(cursor));
-	const char *c_string = clang_getCString(name_data);
-
-	db_typename_t record;
-	memset(&record, 0, sizeof(record));
-	record.kind = name_kind_typedef;
-	record.base_type = old_ref;
-	cf_str_borrow(c_string, strlen(c_string), &record.name);
+	pkg->name.base_type = old_ref;
 
 	// look up any preexisting entry
 	type_ref_t db_entry_ref;
-	error = cf_db_typename_lookup(ctx->db, &ctx->loc, &record, &db_entry_ref);
+	if (found) {
+		db_entry_ref = *found;
+		error = db_entry_ref.rowid ? 0 : ENOENT;
+	} else {
+		error = cf_db_typename_lookup(ctx->db, &pkg->loc, &pkg->name,
+				&db_entry_ref);
+	}
 
 	if (!error) {
 		// already exists
 		if (db_entry_ref.rowid != old_ref.rowid) {
 			// somehow found: `typedef A foo_t` vs `typedef B foo_t`
-			cf_print_err("mismatched typedef '%s', old %lld, new %lld\n",
-					c_string, p_(old_ref.rowid), p_(db_entry_ref.rowid));
+			cf_print_err("mismatched typedef '%.*s', old %lld, new %lld\n",
+					len, c_string, p_(old_ref.rowid),
+					p_(db_entry_ref.rowid));
 			// keep the old type
 		}
-		goto fail_db;
+		return 0;
 	} else if (error != ENOENT) {
 		// some other error
-		cf_print_err("cannot look up typename '%s'\n", c_string);
-		goto fail_db;
+		cf_print_err("cannot look up typename '%.*s'\n", len, c_string);
+		return error;
 	}
 
 	// error == ENOENT
 	// entry is new, insert it
-	error = cf_db_typename_insert(ctx->db, &ctx->loc, &record);
-
-	if (error) {
-		cf_print_err("can't persist typedef '%s', error %d\n",
-				c_string, error);
-		goto fail_db;
+	if ((error = cf_db_typename_insert(ctx->db, &pkg->loc, &pkg->name))) {
+		cf_print_err("can't persist typedef '%.*s', error %d\n",
+				len, c_string, error);
+		return error;
 	}
 
-	cf_print_info("added typedef '%s'->(%p, %lld)\n",
-			c_string, get_clang_type(old_type), p_(old_ref.rowid));
-
-fail_db:
-	cf_str_free(&record.name);
-	clang_disposeString(name_data);
-fail:
-	return;
+	cf_print_info("added typedef '%.*s'->(%p, %lld)\n",
+			len, c_string, pkg->type, p_(old_ref.rowid));
+	note_snippet(ctx, &pkg->loc);
+	return 0;
 }
 
 /*
@@ -1749,9 +3119,14 @@ fail:
  * At the expense of extra memory use, entries created for a struct are staged
  * to a `struct_scoreboard_t` and then committed in pieces.
  *
+ * If `built` isn't NULL, it already holds the entries for `cursor`, built by a
+ * split TU's thread. It's swapped with the empty `ctx->struct_sb` rather than
+ * traversing `cursor` again.
+ *
  * Steps:
  * - build entry for top-level record decl from `cursor`
  * - recursively index children
+ *   or swap in `built`
  * - if `cursor` already has a name
  *   commit the scoreboard now; return false
  *   else:
@@ -1760,7 +3135,7 @@ fail:
  *   then commit
  */
 static bool
-index_struct(CXCursor cursor, index_ctx_t *ctx)
+index_struct(CXCursor cursor, struct_scoreboard_t *built, index_ctx_t *ctx)
 {
 	struct_scoreboard_t *sb = &ctx->struct_sb;
 
@@ -1773,9 +3148,15 @@ index_struct(CXCursor cursor, index_ctx_t *ctx)
 	cf_assert(type_is_indexable(cursor_type));
 
 	// index struct and children
-	memcpy(&sb->loc, &ctx->loc, sizeof(loc_ctx_t)); // XXX hack
-	index_struct_record(cursor, sb);
-	index_struct_children(cursor, ctx, sb);
+	if (built) {
+		const struct_scoreboard_t empty = *sb;
+		*sb = *built;
+		*built = empty;
+	} else {
+		memcpy(&sb->loc, &ctx->loc, sizeof(loc_ctx_t)); // XXX hack
+		index_struct_record(cursor, sb);
+		index_struct_children(cursor, ctx, sb);
+	}
 
 	// if `cursor` is a direct-name struct, commit scoreboard now
 	// otherwise signal to caller to look for a name
@@ -1789,11 +3170,84 @@ index_struct(CXCursor cursor, index_ctx_t *ctx)
 		return true;
 	}
 	// `cursor` already has a name
-	commit_struct_scoreboard(sb, ctx);
-	reset_struct_scoreboard(sb);
+	(void)stage_struct_scoreboard(ctx);
 	return false;
 }
 
+/*
+ * Try to skip indexing struct decl `cursor` because it's in a file that
+ * duplicates another one.
+ *
+ * The database already has a copy of every type in the original file. Look up
+ * `cursor`'s copy by name and map `cursor`'s type to it. This avoids
+ * traversing the duplicate's children.
+ *
+ * Only direct-name structs can be looked up. Return false if `cursor` isn't
+ * one, or if its copy isn't found; it should be indexed like normal then.
+ *
+ * Types nested in `cursor` would be skipped along with it and never reach
+ * `ctx->type_map`, so later references to them in the TU couldn't be
+ * resolved. Structs with nested types are indexed like normal too; their
+ * copies are found by the struct scoreboard like any preexisting type.
+ */
+static bool
+index_alias_struct(CXCursor cursor, index_ctx_t *ctx)
+{
+	int error;
+
+	CXType ct = clang_getCanonicalType(clang_getCursorType(cursor));
+	cf_assert(type_is_indexable(ct));
+
+	if (struct_has_nested_type(cursor)) {
+		return false;
+	}
+
+	db_typename_t name;
+	if (extract_struct_name(cursor, ct, &name) != struct_name_direct) {
+		return false;
+	}
+
+	type_ref_t ref;
+	error = cf_db_typename_lookup(ctx->db, &ctx->loc, &name, &ref);
+	cf_str_free(&name.name);
+	if (error) {
+		return false;
+	}
+
+	cf_print_info("skip duplicate struct %p, rowid %lld\n",
+			get_clang_type(ct), p_(ref.rowid));
+	type_map_insert(&ctx->type_map, get_clang_type(ct), ref);
+	return true;
+}
+
+/*
+ * Return whether struct decl `cursor` declares another struct, union, or enum
+ * inside it, at any depth.
+ */
+static bool
+struct_has_nested_type(CXCursor cursor)
+{
+	bool found = false;
+	(void)clang_visitChildren(cursor, find_nested_type_cb, &found);
+	return found;
+}
+
+static enum CXChildVisitResult
+find_nested_type_cb(CXCursor cursor, CF_UNUSED CXCursor parent,
+		CXClientData found)
+{
+	switch (clang_getCursorKind(cursor)) {
+		case CXCursor_StructDecl:
+		case CXCursor_UnionDecl:
+		case CXCursor_EnumDecl:
+			*(bool *)found = true;
+			return CXChildVisit_Break;
+		default:
+			// nested types are direct children of a field or the record
+			return CXChildVisit_Continue;
+	}
+}
+
 /*
  * Index only the top-level record of a struct.
  *
@@ -1963,9 +3417,7 @@ index_type_children_cb(CXCursor cursor, CXCursor parent, CXClientData args_)
 	index_struct_args_t *args = args_;
 
 	// get its new source location
-	update_location(args->ctx, cursor);
-	// XXX mega big hack, just copy ctx's location context into sb
-	memcpy(&args->sb->loc, &args->ctx->loc, sizeof(loc_ctx_t));
+	locate_cursor(args->ctx, cursor, &args->sb->loc, NULL);
 
 	// do real indexing work
 	const enum CXChildVisitResult ret =
@@ -2276,29 +3728,28 @@ extract_member_typename(CXCursor member_decl, db_typename_t *out)
 	clang_disposeString(name);
 }
 
+/*
+ * Map `ct` to `type_ref` in `map`, unless `ct` is already mapped. The first
+ * mapping of a type wins.
+ */
 static void
-type_map_insert(cf_map8_t *map, clang_type_t ct, type_ref_t type_ref)
+type_map_insert(cf_hmap8_t *map, clang_type_t ct, type_ref_t type_ref)
 {
 	cf_assert(ct);
 	cf_assert(type_ref.rowid);
 
-	cf_map_entry_t *entry = cf_map8_reserve(map);
-	entry->key = (uint64_t)ct;
-	entry->value = (uint64_t)type_ref.rowid;
-	cf_map8_commit(map, entry);
-}
-
-static bool
-type_map_lookup(cf_map8_t *map, CXType ct, type_ref_t *ref_out)
-{
-	return type_map_lookup2(map, get_clang_type(ct), ref_out);
+	uint64_t old;
+	if (cf_hmap8_lookup(map, (uintptr_t)ct, &old)) {
+		return;
+	}
+	(void)cf_hmap8_insert(map, (uintptr_t)ct, (uint64_t)type_ref.rowid);
 }
 
 static bool
-type_map_lookup2(cf_map8_t *map, clang_type_t ct, type_ref_t *ref_out)
+type_map_lookup2(cf_hmap8_t *map, clang_type_t ct, type_ref_t *ref_out)
 {
 	uint64_t val;
-	if (!cf_map8_lookup(map, (uintptr_t)ct, &val)) {
+	if (!cf_hmap8_lookup(map, (uintptr_t)ct, &val)) {
 		return false;
 	}
 	ref_out->rowid = val;
@@ -2327,7 +3778,7 @@ file_map_add(cf_map8_t *map, CXFile file, file_ref_t ref)
 }
 
 static bool
-file_map_lookup(cf_map8_t *map, CXFile file, file_ref_t *ref_out)
+file_map_lookup(const cf_map8_t *map, CXFile file, file_ref_t *ref_out)
 {
 	uint64_t val;
 	if (!cf_map8_lookup(map, (uint64_t)file, &val)) {
@@ -2337,6 +3788,141 @@ file_map_lookup(cf_map8_t *map, CXFile file, file_ref_t *ref_out)
 	return true;
 }
 
+/*
+ * Reverse lookup in `map`: find a `CXFile` with database rowid `rowid`.
+ *
+ * Several `CXFile`s may share a rowid (see `index_ctx_t::alias_files`). Their
+ * contents are identical, so any of them will do. Return NULL if there's none.
+ */
+static CXFile
+file_map_find(const cf_map8_t *map, int64_t rowid)
+{
+	CXFile file = NULL;
+
+	cf_vec_citer_t it;
+	cf_vec_citer_make(&map->v, &it);
+	while (cf_vec_citer_next(&it)) {
+		const cf_map_entry_t *entry = cf_vec_citer_peek(&it);
+		if ((int64_t)entry->value == rowid) {
+			file = (CXFile)entry->key;
+			break;
+		}
+	}
+	cf_vec_citer_free(&it);
+
+	return file;
+}
+
+/*
+ * Make a `ctx->file_cache` key for `file`.
+ *
+ * `CXFile` pointers are only meaningful within a TU; the unique ID (device,
+ * inode, mtime) is the same for every TU that includes the file.
+ */
+static uint64_t
+file_cache_key(CXFile file)
+{
+	CXFileUniqueID id;
+	if (clang_getFileUniqueID(file, &id)) {
+		// no ID; never cached
+		return 0;
+	}
+	const uint64_t key = cf_hash_bytes(0, id.data, sizeof(id.data));
+	return key ? key : 1;
+}
+
+/*
+ * Make a `ctx->type_cache` key for typename `name` at `loc`.
+ *
+ * This hashes the same fields cf_db_typename_lookup() matches on: file,
+ * function, scope, kind, and name.
+ */
+static uint64_t
+type_cache_key(const loc_ctx_t *loc, const db_typename_t *name)
+{
+	const uint32_t kind = name->kind;
+
+	uint64_t key = cf_hash_bytes(0, &loc->file.rowid,
+			sizeof(loc->file.rowid));
+	key = cf_hash_bytes(key, &loc->func.rowid, sizeof(loc->func.rowid));
+	key = cf_hash_bytes(key, &loc->scope, sizeof(loc->scope));
+	key = cf_hash_bytes(key, &kind, sizeof(kind));
+	key = cf_hash_bytes(key, name->name.str, cf_str_len(&name->name));
+	return key ? key : 1;
+}
+
+/*
+ * Look up typename `name` at `loc` in `ctx->type_cache`.
+ *
+ * On a hit, the full key is compared too; a hash collision is a miss.
+ */
+static bool
+type_cache_find(index_ctx_t *ctx, const loc_ctx_t *loc,
+		const db_typename_t *name, type_ref_t *ref_out)
+{
+	uint64_t cached;
+	if (!cf_cache8_lookup(&ctx->type_cache, type_cache_key(loc, name),
+			&cached)) {
+		return false;
+	}
+
+	const type_cache_entry_t *entry =
+			(const type_cache_entry_t *)(uintptr_t)cached;
+	const size_t len = cf_str_len(&name->name);
+	if ((entry->file != loc->file.rowid) ||
+			(entry->func != loc->func.rowid) ||
+			(entry->scope != loc->scope) ||
+			(entry->kind != (uint32_t)name->kind) ||
+			(entry->name_len != len) ||
+			memcmp(entry->name, name->name.str, len)) {
+		cf_print_debug("type cache collision on '%.*s'\n", (int)len,
+				name->name.str);
+		return false;
+	}
+
+	ref_out->rowid = entry->rowid;
+	return true;
+}
+
+/*
+ * Cache that typename `name` at `loc` names type `ref`.
+ *
+ * This replaces an entry with a colliding key.
+ */
+static int
+type_cache_insert(index_ctx_t *ctx, const loc_ctx_t *loc,
+		const db_typename_t *name, type_ref_t ref)
+{
+	int error;
+	const size_t len = cf_str_len(&name->name);
+
+	type_cache_entry_t *entry = cf_malloc(sizeof(*entry) + len);
+	if (!entry) {
+		return ENOMEM;
+	}
+	*entry = (type_cache_entry_t) {
+		.rowid = ref.rowid,
+		.file = loc->file.rowid,
+		.func = loc->func.rowid,
+		.scope = loc->scope,
+		.kind = name->kind,
+		.name_len = (uint32_t)len,
+	};
+	memcpy(entry->name, name->name.str, len);
+
+	if ((error = cf_cache8_insert(&ctx->type_cache,
+			type_cache_key(loc, name), (uintptr_t)entry))) {
+		cf_free(entry);
+	}
+	return error;
+}
+
+static void
+type_cache_release(uint64_t value)
+{
+	cf_free((type_cache_entry_t *)(uintptr_t)value);
+}
+
 static CXCursor *
 cursor_stack_top(cursor_stack_t *stack)
 {
@@ -2384,23 +3970,69 @@ make_index_ctx(const index_config_t *config, index_ctx_t *out)
 	out->clang_index = clang_createIndex(0, 1);
 
 	// init datastructures
-	cf_map8_make(&out->type_map);
+	cf_hmap8_make(&out->type_map);
 	cf_map8_make(&out->file_map);
+	cf_map8_make(&out->alias_files);
+	cf_map8_make(&out->clean_tus);
+	// split the budget evenly between the caches; round up so that any
+	// nonzero budget stays bounded rather than halving to "unbounded"
+	const size_t half_budget = (config->cache_budget / 2) +
+			(config->cache_budget % 2);
+	cf_cache8_make(half_budget, &out->file_cache);
+	cf_cache8_make_owner(half_budget, TYPE_CACHE_ENTRY_SIZE,
+			type_cache_release, &out->type_cache);
 
 	make_ast_path(&out->path);
 	make_struct_scoreboard(&out->struct_sb);
+	typedefpkg_vec_make(&out->staged_typedefs);
+
+	out->snippets = config->snippets;
+	snippet_key_vec_make(&out->snippet_keys);
+
+	out->count_uses = config->count_uses;
+	out->use_samples = config->use_samples;
+	use_count_vec_make(&out->use_counts);
+	cf_hmap8_make(&out->use_count_index);
+
+	out->split.max_threads = MIN(config->tu_threads, TU_SPLIT_MAX_THREADS);
+	cursor_stack_make(&out->split.cursors);
 
 	// initialize database separately
 	if ((error = make_index_ctx_db(config, out))) {
 		goto fail;
 	}
 
+	// tag what's indexed as approximate
+	if (config->approx && (error = cf_db_set_approx(out->db, true))) {
+		goto fail_vcs;
+	}
+
+	if ((error = cf_db_set_wal_policy(out->db, &config->wal))) {
+		goto fail_vcs;
+	}
+
+	// optionally, figure out what's already indexed
+	if (config->vcs_path && (error = make_index_ctx_vcs(config, out))) {
+		goto fail_vcs;
+	}
+
 	return 0;
+fail_vcs:
+	if (out->db_owned) {
+		cf_db_close(&out->db_);
+	}
 fail:
+	cursor_stack_free(&out->split.cursors);
+	snippet_key_vec_free(&out->snippet_keys);
 	free_ast_path(&out->path);
+	typedefpkg_vec_free(&out->staged_typedefs);
 	free_struct_scoreboard(&out->struct_sb);
+	cf_cache8_free(&out->type_cache);
+	cf_cache8_free(&out->file_cache);
+	cf_map8_free(&out->clean_tus);
+	cf_map8_free(&out->alias_files);
 	cf_map8_free(&out->file_map);
-	cf_map8_free(&out->type_map);
+	cf_hmap8_free(&out->type_map);
 	clang_disposeIndex(out->clang_index);
 	return error;
 }
@@ -2433,6 +4065,9 @@ make_index_ctx_db(const index_config_t *config, index_ctx_t *out)
 			error = cf_db_open_sql(config->db_args.sql_path, /*ro*/false,
 					&out->db_);
 			break;
+		case index_db_log:
+			error = cf_db_open_log(config->db_args.log_path, &out->db_);
+			break;
 		default:
 			cf_assert(config->db_kind != index_db_borrowed);
 			error = EINVAL;
@@ -2450,6 +4085,45 @@ fail:
 	return error;
 }
 
+/*
+ * Initialize version control-related members of an `index_ctx_t`.
+ *
+ * The database must already be open. It's owned, so it can't outlive the
+ * `vcs_tree_t` it borrows.
+ *
+ * Steps:
+ * - snapshot the git repository at `config->vcs_path`
+ * - purge changed files from the database and collect the TUs that are
+ *   unaffected
+ */
+static int
+make_index_ctx_vcs(const index_config_t *config, index_ctx_t *out)
+{
+	int error;
+
+	if (!out->db_owned) {
+		cf_print_err("version control needs an owned database\n");
+		return EINVAL;
+	}
+
+	if ((error = vcs_tree_load(config->vcs_path, &out->vcs))) {
+		goto fail;
+	}
+
+	if ((error = cf_db_vcs_sync(out->db, &out->vcs, &out->clean_tus))) {
+		cf_print_err("cannot sync db with '%s', error %d\n",
+				out->vcs.root, error);
+		goto fail_sync;
+	}
+
+	out->use_vcs = true;
+	return 0;
+fail_sync:
+	vcs_tree_free(&out->vcs);
+fail:
+	return error;
+}
+
 /*
  * Free the internal resources of a `index_ctx_t` initialized from a previous
  * successful call to make_index_ctx().
@@ -2458,14 +4132,32 @@ static void
 free_index_ctx(index_ctx_t *ctx)
 {
 	cf_print_debug("free index_ctx %p: %zu files, %zu types\n",
-			ctx, cf_map8_len(&ctx->file_map), cf_map8_len(&ctx->type_map));
+			ctx, cf_map8_len(&ctx->file_map), cf_hmap8_len(&ctx->type_map));
 	if (ctx->db_owned) {
 		cf_db_close(&ctx->db_);
 	}
+	// note: after the db is closed; it borrows `vcs`
+	if (ctx->use_vcs) {
+		vcs_tree_free(&ctx->vcs);
+	}
+	cf_cache8_free(&ctx->type_cache);
+	cf_cache8_free(&ctx->file_cache);
+	cf_map8_free(&ctx->clean_tus);
+	cursor_stack_free(&ctx->split.cursors);
+	snippet_key_vec_free(&ctx->snippet_keys);
+	cf_hmap8_free(&ctx->use_count_index);
+	use_count_vec_free(&ctx->use_counts);
+	reset_staged(ctx);
+	for (size_t i = 0; i < ctx->staged_capacity; ++i) {
+		free_struct_scoreboard(&ctx->staged[i]);
+	}
+	cf_free(ctx->staged);
+	typedefpkg_vec_free(&ctx->staged_typedefs);
 	free_struct_scoreboard(&ctx->struct_sb);
 	free_ast_path(&ctx->path);
+	cf_map8_free(&ctx->alias_files);
 	cf_map8_free(&ctx->file_map);
-	cf_map8_free(&ctx->type_map);
+	cf_hmap8_free(&ctx->type_map);
 	clang_disposeIndex(ctx->clang_index);
 }
 
@@ -2478,12 +4170,21 @@ free_index_ctx(index_ctx_t *ctx)
  * Reset the following members:
  * - type_map
  * - file_map
+ * - alias_files
+ * - snippet_keys, use_counts, staged, staged_typedefs
+ *   Normally already empty. Not if indexing the TU failed.
  */
 static void
 reset_tu_ctx(index_ctx_t *ctx)
 {
+	reset_staged(ctx);
 	cf_map8_reset(&ctx->file_map);
-	cf_map8_reset(&ctx->type_map);
+	cf_map8_reset(&ctx->alias_files);
+	ctx->in_alias_file = false;
+	cf_hmap8_free(&ctx->type_map);
+	cf_hmap8_make(&ctx->type_map);
+	snippet_key_vec_reset(&ctx->snippet_keys);
+	reset_use_counts(ctx);
 }
 
 static void
@@ -4,6 +4,7 @@
  *
  * Main API for creating an index.
  */
+#pragma once
 #include "cc_support.h"
 #include "cf_db.h"
 
@@ -29,20 +30,72 @@ __BEGIN_DECLS
  *   - index_db_borrowed
  *     The database is injected by the caller via `db_args.db`. This is useful
  *     for tests that index then inspect the results.
+ *   - index_db_log
+ *     The index is appended to a new log (see "log_db.h") in directory
+ *     `db_args.log_path`. It must be compacted with `input_log` before it can
+ *     be searched.
  * - input_kind
- *   This specifies what `input_path` is. Note: nothing other than filesystem
- *   inputs is supported (because libclang). Tests need to conjure up a path to
- *   something if they want to use in-memory source inputs.
+ *   This specifies what each of `input_paths` is. Note: nothing other than
+ *   filesystem inputs is supported (because libclang). Tests need to conjure
+ *   up a path to something if they want to use in-memory source inputs.
  *   - input_comp_db
  *     If set, the input is the path to the parent directory of a compilation
  *     database. E.g., if the compilation db is at "foo/compile_commands.json",
- *     set `input_path` to "foo".
+ *     set an input path to "foo".
  *   - input_source_file
  *     If set, the input is a single source file. Default compiler arguments
  *     are used for building the AST.
- *  - input_path
- *    Filesystem path to source. A ".c" file, or the parent directory of a
- *    compilation database, 
+ *   - input_command
+ *     If set, the input is a single source file compiled with
+ *     `command_argv`. Used by `cfind-cc` to index a TU with the same flags
+ *     the build compiles it with.
+ *   - input_fragment
+ *     If set, the input is an index fragment (a database written by
+ *     `cfind-cc`). It's merged into the output database rather than parsed.
+ *   - input_log
+ *     If set, the input is the directory of a log written with
+ *     `index_db_log`. It's compacted into the output database.
+ *  - input_paths
+ *    Filesystem paths to source. Each is a ".c" file, or the parent directory
+ *    of a compilation database, according to `input_kind`. All inputs are
+ *    indexed into the same database by one process, so files and types
+ *    shared between inputs (e.g., common SDK headers) are only resolved once.
+ *  - num_inputs
+ *    Number of entries in `input_paths`. At least 1.
+ *  - command_argv, command_argc
+ *    Full compiler command line, starting with the compiler itself. It names
+ *    the input source file itself. Only used by `input_command`, which takes
+ *    exactly 1 input.
+ *  - vcs_path
+ *    Optional path to a directory in a git working tree. If non-NULL, the
+ *    database is treated as the output of a previous run: files that changed
+ *    according to git are purged from it, then only TUs that depend on them
+ *    are reindexed. The database must be owned (not `index_db_borrowed`).
+ *  - approx
+ *    If true, index quickly but approximately. Each source file is parsed on
+ *    its own: `#include`s aren't followed and errors are ignored, so types
+ *    and macros from headers are missing. Files are tagged as approximate in
+ *    the database; a later precise run replaces what was indexed from them.
+ *  - snippets
+ *    If true, also store the source line of every indexed entry, so searches
+ *    can print it without reading the source. Lines are stored compressed,
+ *    once per file. Only `index_db_sql` and `index_db_log` keep them.
+ *  - wal
+ *    When to checkpoint the write-ahead log of the database. The indexer
+ *    calls cf_db_checkpoint() between TUs. Only used by `index_db_sql`.
+ *  - cache_budget
+ *    Approximate number of bytes the indexer may spend on caches of files
+ *    and types shared between TUs. 0 means unbounded. A smaller budget trades
+ *    memory for database lookups; hit rates are printed at the end of a run.
+ *  - count_uses, use_samples
+ *    If `count_uses` is true, type uses are aggregated: the database stores
+ *    how many times each type is used per file and kind of use, rather than
+ *    a row per use. Only the first `use_samples` uses of each (type, file,
+ *    kind) in a TU keep a location. Not supported by `index_db_log`.
+ *  - tu_threads
+ *    Most threads to traverse one TU with, counting the indexer's own. Only
+ *    TUs with many top-level structs are split. The database ends up the
+ *    same either way. 0 or 1 keeps every TU on one thread.
  */
 typedef struct {
 	enum {
@@ -50,19 +103,35 @@ typedef struct {
 		index_db_mem = 2,
 		index_db_sql = 3,
 		index_db_borrowed = 4,
+		index_db_log = 5,
 	} db_kind;
 
 	enum {
 		input_comp_db = 1,
 		input_source_file = 2,
+		input_command = 3,
+		input_fragment = 4,
+		input_log = 5,
 	} input_kind;
 
 	union {
 		const char *sql_path;
+		const char *log_path;
 		cf_db_t *db;
 	} db_args;
 
-	const char *input_path;
+	const char *const *input_paths;
+	size_t num_inputs;
+	const char *const *command_argv;
+	unsigned command_argc;
+	const char *vcs_path;
+	bool approx;
+	bool snippets;
+	wal_policy_t wal;
+	size_t cache_budget;
+	bool count_uses;
+	size_t use_samples;
+	size_t tu_threads;
 } index_config_t;
 
 int cf_index_project(const index_config_t *config);
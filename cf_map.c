@@ -4,15 +4,33 @@
  */
 #include "cf_map.h"
 
+#include "cf_alloc.h"
+#include "cf_assert.h"
 #include "cf_vector.h"
 
+#include <errno.h>
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
+#include <string.h>
 
-CF_VEC_ITER_GENERATE(cf_map8_t, cf_map_entry_t, map8_iter);
+CF_VEC_CITER_GENERATE(cf_map8_t, cf_map_entry_t, map8_citer);
 
-static bool lookup_internal(cf_map8_t *map, uint64_t key,
-		cf_map_entry_t **out);
+static bool lookup_internal(const cf_map8_t *map, uint64_t key,
+		const cf_map_entry_t **out);
+static int hmap8_grow(cf_hmap8_t *map);
+static cf_map_entry_t *hmap8_probe(cf_map_entry_t *slots, size_t capacity,
+		uint64_t key);
+static uint64_t mix64(uint64_t key);
+
+static int cache8_resize(cf_cache8_t *cache, size_t capacity);
+static void cache8_evict(cf_cache8_t *cache);
+static void cache8_remove_slot(cf_cache8_t *cache, size_t i);
+
+// smallest table allocated on first insertion
+#define HMAP8_MIN_CAPACITY 64
+// bytes of a `cf_cache8_t` slot: the entry plus its referenced bit
+#define CACHE8_SLOT_SIZE (sizeof(cf_map_entry_t) + 1)
 
 /*
  * Search through `map` for an entry equal to `key` then return its value.
@@ -20,9 +38,9 @@ static bool lookup_internal(cf_map8_t *map, uint64_t key,
  * On success, return `true` and set `*out` to the value.
  */
 bool
-cf_map8_lookup(cf_map8_t *map, uint64_t key, uint64_t *out)
+cf_map8_lookup(const cf_map8_t *map, uint64_t key, uint64_t *out)
 {
-	cf_map_entry_t *entry;
+	const cf_map_entry_t *entry;
 	if (!lookup_internal(map, key, &entry)) {
 		return false;
 	}
@@ -38,12 +56,12 @@ cf_map8_lookup(cf_map8_t *map, uint64_t key, uint64_t *out)
 bool
 cf_map8_remove(cf_map8_t *map, uint64_t key)
 {
-	cf_map_entry_t *entry;
+	const cf_map_entry_t *entry;
 	if (!lookup_internal(map, key, &entry)) {
 		return false;
 	}
 
-	cf_vec_remove(&map->v, entry);
+	cf_vec_remove(&map->v, (cf_map_entry_t *)entry);
 
 	return true;
 }
@@ -51,25 +69,29 @@ cf_map8_remove(cf_map8_t *map, uint64_t key)
 /*
  * Do a lookup in `map` for `key`; return the entry via `*out`.
  *
- * NOTE: slightly unsafe because CF_VEC_ITERATED is cleared when this function
+ * A const iterator is used so that lookups don't write to `map`; several
+ * threads can look up in a map nobody inserts into.
+ *
+ * NOTE: slightly unsafe because the iterator is freed when this function
  * returns and yet a pointer to an entry is returned. However, this is fine for
- * a `static` function in a single threaded program. (It's easy to see in the
- * source there's no map insertion interleaved between lookup and use.)
+ * a `static` function. (It's easy to see in the source there's no map
+ * insertion interleaved between lookup and use.)
  */
 static bool
-lookup_internal(cf_map8_t *map, uint64_t key, cf_map_entry_t **out)
+lookup_internal(const cf_map8_t *map, uint64_t key,
+		const cf_map_entry_t **out)
 {
 	if (!cf_map8_len(map)) {
 		return false;
 	}
 
-	cf_vec_iter_t iter;
-	map8_iter_make(map, &iter);
+	cf_vec_citer_t iter;
+	map8_citer_make(map, &iter);
 
 	// iterate over every entry
 	bool found = false;
-	while (map8_iter_next(&iter)) {
-		cf_map_entry_t *entry = map8_iter_peek(&iter);
+	while (map8_citer_next(&iter)) {
+		const cf_map_entry_t *entry = map8_citer_peek(&iter);
 		if (entry->key == key) {
 			// a match
 			*out = entry;
@@ -78,6 +100,424 @@ lookup_internal(cf_map8_t *map, uint64_t key, cf_map_entry_t **out)
 		}
 	}
 
-	map8_iter_free(&iter);
+	map8_citer_free(&iter);
 	return found;
 }
+
+void
+cf_hmap8_make(cf_hmap8_t *map)
+{
+	memset(map, 0, sizeof(*map));
+}
+
+void
+cf_hmap8_free(cf_hmap8_t *map)
+{
+	cf_free(map->slots);
+	memset(map, 0, sizeof(*map));
+}
+
+/*
+ * Map `key` to `value` in `map`, replacing any previous value.
+ *
+ * The table doubles once it's 3/4 full.
+ */
+int
+cf_hmap8_insert(cf_hmap8_t *map, uint64_t key, uint64_t value)
+{
+	int error;
+	cf_assert(key);
+
+	if ((map->len + 1) * 4 > map->capacity * 3) {
+		if ((error = hmap8_grow(map))) {
+			return error;
+		}
+	}
+
+	cf_map_entry_t *slot = hmap8_probe(map->slots, map->capacity, key);
+	if (!slot->key) {
+		slot->key = key;
+		++map->len;
+	}
+	slot->value = value;
+	return 0;
+}
+
+/*
+ * Look up `key` in `map`.
+ *
+ * On success, return `true` and set `*out` to the value.
+ */
+bool
+cf_hmap8_lookup(const cf_hmap8_t *map, uint64_t key, uint64_t *out)
+{
+	if (!map->len || !key) {
+		return false;
+	}
+
+	const cf_map_entry_t *slot = hmap8_probe(map->slots, map->capacity, key);
+	if (!slot->key) {
+		return false;
+	}
+	*out = slot->value;
+	return true;
+}
+
+size_t
+cf_hmap8_len(const cf_hmap8_t *map)
+{
+	return map->len;
+}
+
+/*
+ * Initialize `out` to an empty cache using at most about `budget` bytes.
+ *
+ * A `budget` of 0 makes an unbounded cache. Otherwise the table is capped at
+ * the largest power of 2 number of slots that fits in `budget`, but at least
+ * HMAP8_MIN_CAPACITY. Free `out` with cf_cache8_free().
+ */
+void
+cf_cache8_make(size_t budget, cf_cache8_t *out)
+{
+	cf_cache8_make_owner(budget, 0, NULL, out);
+}
+
+/*
+ * Initialize `out` to an empty cache that owns its values.
+ *
+ * Like cf_cache8_make(), but each value also uses `value_size` bytes of
+ * `budget`, and is passed to `release` when it leaves the cache.
+ */
+void
+cf_cache8_make_owner(size_t budget, size_t value_size,
+		cf_cache8_release_t release, cf_cache8_t *out)
+{
+	memset(out, 0, sizeof(*out));
+	out->value_size = value_size;
+	out->release = release;
+	if (!budget) {
+		return;
+	}
+
+	const size_t slot_size = CACHE8_SLOT_SIZE + value_size;
+	size_t max_capacity = HMAP8_MIN_CAPACITY;
+	while ((max_capacity <= (SIZE_MAX / 2 / slot_size)) &&
+			((max_capacity * 2 * slot_size) <= budget)) {
+		max_capacity *= 2;
+	}
+	out->max_capacity = max_capacity;
+}
+
+void
+cf_cache8_free(cf_cache8_t *cache)
+{
+	if (cache->release) {
+		for (size_t i = 0; i < cache->capacity; ++i) {
+			if (cache->slots[i].key) {
+				cache->release(cache->slots[i].value);
+			}
+		}
+	}
+	cf_free(cache->referenced);
+	cf_free(cache->slots);
+	memset(cache, 0, sizeof(*cache));
+}
+
+/*
+ * Map `key` to `value` in `cache`, replacing any previous value.
+ *
+ * Steps:
+ * - replace the value of an existing key
+ * - if the table is 3/4 full, double it, or if it's at its budget, evict an
+ *   entry
+ * - insert the new entry with its referenced bit set
+ *
+ * Only allocation can fail; an insertion never fails for lack of budget. On
+ * failure, an owning cache doesn't take `value`.
+ */
+int
+cf_cache8_insert(cf_cache8_t *cache, uint64_t key, uint64_t value)
+{
+	int error;
+	cf_assert(key);
+
+	if (cache->len) {
+		cf_map_entry_t *slot =
+				hmap8_probe(cache->slots, cache->capacity, key);
+		if (slot->key) {
+			if (cache->release && (slot->value != value)) {
+				cache->release(slot->value);
+			}
+			slot->value = value;
+			cache->referenced[slot - cache->slots] = 1;
+			return 0;
+		}
+	}
+
+	if ((cache->len + 1) * 4 > cache->capacity * 3) {
+		if (!cache->max_capacity || (cache->capacity < cache->max_capacity)) {
+			const size_t capacity = cache->capacity ?
+					(cache->capacity * 2) : HMAP8_MIN_CAPACITY;
+			if ((error = cache8_resize(cache, capacity))) {
+				return error;
+			}
+		} else {
+			cache8_evict(cache);
+		}
+	}
+
+	cf_map_entry_t *slot = hmap8_probe(cache->slots, cache->capacity, key);
+	cf_assert(!slot->key);
+	*slot = (cf_map_entry_t){
+		.key = key,
+		.value = value,
+	};
+	cache->referenced[slot - cache->slots] = 1;
+	++cache->len;
+	++cache->stats.inserts;
+	return 0;
+}
+
+/*
+ * Look up `key` in `cache`.
+ *
+ * On success, return `true` and set `*out` to the value. Either way, count the
+ * lookup in `cache->stats`.
+ */
+bool
+cf_cache8_lookup(cf_cache8_t *cache, uint64_t key, uint64_t *out)
+{
+	if (!cache->len || !key) {
+		++cache->stats.misses;
+		return false;
+	}
+
+	const cf_map_entry_t *slot =
+			hmap8_probe(cache->slots, cache->capacity, key);
+	if (!slot->key) {
+		++cache->stats.misses;
+		return false;
+	}
+	cache->referenced[slot - cache->slots] = 1;
+	++cache->stats.hits;
+	*out = slot->value;
+	return true;
+}
+
+/*
+ * Check whether `key` is in `cache` without counting it as a lookup or
+ * marking it as recently used.
+ */
+bool
+cf_cache8_contains(const cf_cache8_t *cache, uint64_t key)
+{
+	if (!cache->len || !key) {
+		return false;
+	}
+	return hmap8_probe(cache->slots, cache->capacity, key)->key != 0;
+}
+
+size_t
+cf_cache8_len(const cf_cache8_t *cache)
+{
+	return cache->len;
+}
+
+/*
+ * Return the number of bytes allocated by `cache`, counting owned values.
+ */
+size_t
+cf_cache8_bytes(const cf_cache8_t *cache)
+{
+	return (cache->capacity * CACHE8_SLOT_SIZE) +
+			(cache->len * cache->value_size);
+}
+
+/*
+ * Return the most bytes `cache` will allocate, or 0 if it's unbounded.
+ */
+size_t
+cf_cache8_budget(const cf_cache8_t *cache)
+{
+	return cache->max_capacity * (CACHE8_SLOT_SIZE + cache->value_size);
+}
+
+/*
+ * Fold `len` bytes of `buf` into `hash` with 64bit FNV-1a.
+ *
+ * Start a new hash with `hash` set to 0. Useful for turning a composite key
+ * into a `cf_hmap8_t` key.
+ */
+uint64_t
+cf_hash_bytes(uint64_t hash, const void *buf, size_t len)
+{
+	const unsigned char *p = buf;
+
+	if (!hash) {
+		hash = 0xcbf29ce484222325ull;
+	}
+	for (size_t i = 0; i < len; ++i) {
+		hash ^= p[i];
+		hash *= 0x100000001b3ull;
+	}
+	return hash;
+}
+
+/*
+ * Double the capacity of `map` and rehash every entry.
+ */
+static int
+hmap8_grow(cf_hmap8_t *map)
+{
+	const size_t capacity = map->capacity ?
+			(map->capacity * 2) : HMAP8_MIN_CAPACITY;
+	if (capacity > (SIZE_MAX / sizeof(cf_map_entry_t))) {
+		return ENOMEM;
+	}
+
+	cf_map_entry_t *slots = cf_malloc(capacity * sizeof(cf_map_entry_t));
+	if (!slots) {
+		return ENOMEM;
+	}
+	memset(slots, 0, capacity * sizeof(cf_map_entry_t));
+
+	for (size_t i = 0; i < map->capacity; ++i) {
+		const cf_map_entry_t *old = &map->slots[i];
+		if (old->key) {
+			*hmap8_probe(slots, capacity, old->key) = *old;
+		}
+	}
+
+	cf_free(map->slots);
+	map->slots = slots;
+	map->capacity = capacity;
+	return 0;
+}
+
+/*
+ * Return the slot holding `key`, or the empty slot where it would go.
+ *
+ * There's always an empty slot because the table is never full.
+ */
+static cf_map_entry_t *
+hmap8_probe(cf_map_entry_t *slots, size_t capacity, uint64_t key)
+{
+	const size_t mask = capacity - 1;
+	for (size_t i = mix64(key) & mask;; i = (i + 1) & mask) {
+		if (!slots[i].key || (slots[i].key == key)) {
+			return &slots[i];
+		}
+	}
+}
+
+/*
+ * Scramble `key` so that keys that differ only in their high bits (e.g.,
+ * pointers) don't land in the same slot.
+ */
+static uint64_t
+mix64(uint64_t key)
+{
+	key ^= key >> 33;
+	key *= 0xff51afd7ed558ccdull;
+	key ^= key >> 33;
+	return key;
+}
+
+/*
+ * Rehash every entry of `cache` into a new table of `capacity` slots.
+ *
+ * Referenced bits move with their entries.
+ */
+static int
+cache8_resize(cf_cache8_t *cache, size_t capacity)
+{
+	if (capacity > (SIZE_MAX / sizeof(cf_map_entry_t))) {
+		return ENOMEM;
+	}
+
+	cf_map_entry_t *slots = cf_malloc(capacity * sizeof(cf_map_entry_t));
+	uint8_t *referenced = cf_malloc(capacity);
+	if (!slots || !referenced) {
+		cf_free(referenced);
+		cf_free(slots);
+		return ENOMEM;
+	}
+	memset(slots, 0, capacity * sizeof(cf_map_entry_t));
+	memset(referenced, 0, capacity);
+
+	for (size_t i = 0; i < cache->capacity; ++i) {
+		const cf_map_entry_t *old = &cache->slots[i];
+		if (old->key) {
+			cf_map_entry_t *slot = hmap8_probe(slots, capacity, old->key);
+			*slot = *old;
+			referenced[slot - slots] = cache->referenced[i];
+		}
+	}
+
+	cf_free(cache->referenced);
+	cf_free(cache->slots);
+	cache->slots = slots;
+	cache->referenced = referenced;
+	cache->capacity = capacity;
+	cache->hand = 0;
+	return 0;
+}
+
+/*
+ * Evict one entry from a non-empty `cache` with the CLOCK algorithm.
+ *
+ * This always terminates: after one full sweep every referenced bit is clear.
+ */
+static void
+cache8_evict(cf_cache8_t *cache)
+{
+	cf_assert(cache->len);
+	const size_t mask = cache->capacity - 1;
+
+	for (;; cache->hand = (cache->hand + 1) & mask) {
+		const size_t i = cache->hand;
+		if (!cache->slots[i].key) {
+			continue;
+		}
+		if (cache->referenced[i]) {
+			// second chance
+			cache->referenced[i] = 0;
+			continue;
+		}
+		if (cache->release) {
+			cache->release(cache->slots[i].value);
+		}
+		cache8_remove_slot(cache, i);
+		++cache->stats.evictions;
+		// the hand stays put: an entry may have shifted into slot `i`
+		return;
+	}
+}
+
+/*
+ * Remove the entry in slot `i` of `cache`.
+ *
+ * There are no tombstones. Instead, entries after `i` in its probe run are
+ * shifted back into the hole unless that would move them before their home
+ * slot.
+ */
+static void
+cache8_remove_slot(cf_cache8_t *cache, size_t i)
+{
+	const size_t mask = cache->capacity - 1;
+
+	for (size_t j = (i + 1) & mask; cache->slots[j].key; j = (j + 1) & mask) {
+		const size_t home = mix64(cache->slots[j].key) & mask;
+		// `j` stays if its home is within (i, j]
+		if (((j - home) & mask) < ((j - i) & mask)) {
+			continue;
+		}
+		cache->slots[i] = cache->slots[j];
+		cache->referenced[i] = cache->referenced[j];
+		i = j;
+	}
+
+	cache->slots[i] = (cf_map_entry_t){0};
+	cache->referenced[i] = 0;
+	--cache->len;
+}
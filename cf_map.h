@@ -11,6 +11,7 @@
 #include "cc_support.h"
 
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 
 __BEGIN_DECLS
@@ -49,7 +50,124 @@ typedef struct {
  */
 CF_VEC_GENERATE(cf_map8_t, cf_map_entry_t, cf_map8);
 
-bool cf_map8_lookup(cf_map8_t *map, uint64_t key, uint64_t *out);
+bool cf_map8_lookup(const cf_map8_t *map, uint64_t key, uint64_t *out);
 bool cf_map8_remove(cf_map8_t *map, uint64_t key);
 
+/*
+ * A hash map of 64bit int keys and values.
+ *
+ * Use this instead of `cf_map8_t` for maps that get big, e.g., caches that
+ * live for a whole indexer run. It's an open addressing table with linear
+ * probing. Unlike `cf_map8_t`, inserting an existing key replaces its value.
+ *
+ * Key 0 marks an empty slot so it can't be inserted. Callers that hash
+ * something into a key should remap 0 to another value.
+ *
+ * Members
+ * - slots
+ *   Table of `capacity` entries. NULL until the first insertion.
+ * - len
+ *   Number of used slots.
+ * - capacity
+ *   Number of slots. Always 0 or a power of 2.
+ */
+typedef struct {
+	cf_map_entry_t *slots;
+	size_t len;
+	size_t capacity;
+} cf_hmap8_t;
+
+void cf_hmap8_make(cf_hmap8_t *map);
+void cf_hmap8_free(cf_hmap8_t *map);
+int cf_hmap8_insert(cf_hmap8_t *map, uint64_t key, uint64_t value);
+bool cf_hmap8_lookup(const cf_hmap8_t *map, uint64_t key, uint64_t *out);
+size_t cf_hmap8_len(const cf_hmap8_t *map);
+
+/*
+ * Counters kept by a `cf_cache8_t`.
+ *
+ * Members
+ * - hits, misses
+ *   Lookups that did and didn't find their key.
+ * - inserts
+ *   Insertions of a key not already in the cache.
+ * - evictions
+ *   Entries dropped to make room for an insertion.
+ */
+typedef struct {
+	uint64_t hits;
+	uint64_t misses;
+	uint64_t inserts;
+	uint64_t evictions;
+} cf_cache_stats_t;
+
+/*
+ * A hash map of 64bit int keys and values with an optional memory budget.
+ *
+ * Use this instead of `cf_hmap8_t` for caches in front of the database that
+ * would otherwise grow with the size of the project. The table grows like
+ * `cf_hmap8_t` until it reaches the budget. After that, each insertion of a
+ * new key evicts an entry picked by the CLOCK algorithm: a hand sweeps the
+ * table, clearing the referenced bit of each entry it passes, and evicts the
+ * first entry found without one. Lookups and insertions set the bit.
+ *
+ * An evicted entry is simply gone. Callers must be able to get it back from
+ * wherever the cache is in front of; the counters in `stats` tell how often
+ * that happens.
+ *
+ * Like `cf_hmap8_t`, key 0 can't be inserted. Unlike it, lookups write to the
+ * cache (referenced bits and counters), so a cache can't be shared between
+ * threads.
+ *
+ * A cache made with cf_cache8_make_owner() owns its values, e.g., pointers to
+ * records holding the full key a hashed key was made from. Each value is
+ * passed to `release` once it's evicted, replaced, or the cache is freed.
+ *
+ * Members
+ * - slots
+ *   Table of `capacity` entries. NULL until the first insertion.
+ * - referenced
+ *   CLOCK referenced bit of each of `slots`, one byte each.
+ * - len
+ *   Number of used slots.
+ * - capacity
+ *   Number of slots. Always 0 or a power of 2.
+ * - max_capacity
+ *   Most slots the budget allows, or 0 if the cache is unbounded.
+ * - hand
+ *   Slot the CLOCK hand points at.
+ * - stats
+ * - value_size
+ *   Bytes owned by each value outside of the table, counted against the
+ *   budget. 0 unless the cache owns its values.
+ * - release
+ *   Function that frees an owned value, or NULL.
+ */
+typedef void (*cf_cache8_release_t)(uint64_t value);
+
+typedef struct {
+	cf_map_entry_t *slots;
+	uint8_t *referenced;
+	size_t len;
+	size_t capacity;
+	size_t max_capacity;
+	size_t hand;
+	cf_cache_stats_t stats;
+	size_t value_size;
+	cf_cache8_release_t release;
+} cf_cache8_t;
+
+void cf_cache8_make(size_t budget, cf_cache8_t *out);
+void cf_cache8_make_owner(size_t budget, size_t value_size,
+		cf_cache8_release_t release, cf_cache8_t *out);
+void cf_cache8_free(cf_cache8_t *cache);
+int cf_cache8_insert(cf_cache8_t *cache, uint64_t key, uint64_t value);
+bool cf_cache8_lookup(cf_cache8_t *cache, uint64_t key, uint64_t *out);
+bool cf_cache8_contains(const cf_cache8_t *cache, uint64_t key);
+size_t cf_cache8_len(const cf_cache8_t *cache);
+size_t cf_cache8_bytes(const cf_cache8_t *cache);
+size_t cf_cache8_budget(const cf_cache8_t *cache);
+
+uint64_t cf_hash_bytes(uint64_t hash, const void *buf, size_t len);
+
 __END_DECLS
@@ -35,6 +35,25 @@
  */
 #define ITER_OFFSET_UNSTARTED (SIZE_MAX)
 
+/*
+ * Const iterators outstanding in the current thread.
+ *
+ * This replaces the CF_VEC_ITERATED bit for const iterators. Only the thread
+ * that made an iterator ever reads or writes its entry here, so concurrent
+ * const iteration never writes to shared memory.
+ *
+ * Members
+ * - parents
+ *   Vector of each outstanding iterator, in no particular order. A vector
+ *   appears once per iterator over it.
+ * - count
+ *   Number of valid entries in `parents`.
+ */
+static _Thread_local struct {
+	const cf_vec_t *parents[CF_VEC_CITER_MAX];
+	unsigned count;
+} citers;
+
 static int resize_vec(cf_vec_t *vec, size_t new_capacity);
 static bool grow_strategy(size_t old_capacity, size_t stride,
 		size_t *capacity_out);
@@ -46,8 +65,13 @@ static uintptr_t vec_bits(uintptr_t packed_data);
 static void vec_set_bit(uintptr_t *packed_data, uintptr_t bit);
 static void vec_clear_bit(uintptr_t *packed_data, uintptr_t bit);
 
+static void citer_register(const cf_vec_t *vec);
+static void citer_unregister(const cf_vec_t *vec);
+
 static void assert_vec(const cf_vec_t *vec);
 static void assert_vec_iter(const cf_vec_iter_t *it);
+static void assert_vec_citer(const cf_vec_citer_t *it);
+static void assert_no_citer(const cf_vec_t *vec);
 
 /*
  * API
@@ -89,6 +113,7 @@ cf_vec_free(cf_vec_t *vec)
 	assert_vec(vec);
 	// check no reservations/iterators outstanding
 	cf_assert(!vec_bits(vec->packed_data));
+	assert_no_citer(vec);
 	cf_free(vec_data(vec->packed_data));
 }
 
@@ -124,6 +149,7 @@ cf_vec_reset(cf_vec_t *vec)
 	cf_assert(vec);
 	// check no reservations/iterators outstanding
 	cf_assert(!vec_bits(vec->packed_data));
+	assert_no_citer(vec);
 	vec->len = 0;
 }
 
@@ -153,6 +179,7 @@ cf_vec_detach(cf_vec_t *vec)
 	assert_vec(vec);
 	// check no reservations/iterators outstanding
 	cf_assert(!vec_bits(vec->packed_data));
+	assert_no_citer(vec);
 
 	return vec_data(vec->packed_data);
 }
@@ -214,6 +241,7 @@ cf_vec_reserve(cf_vec_t *vec)
 {
 	assert_vec(vec);
 	cf_assert(!vec_bits(vec->packed_data));
+	assert_no_citer(vec);
 
 	// check if full; may need a resize
 	if (vec->len == vec->capacity) {
@@ -298,6 +326,7 @@ void
 cf_vec_remove(cf_vec_t *vec, void *entry_)
 {
 	assert_vec(vec);
+	assert_no_citer(vec);
 	// use `char *` so clang doesn't complain about `void *` arithmetic
 	char *const entry = entry_;
 	char *const data = vec_data(vec->packed_data);
@@ -336,6 +365,7 @@ cf_vec_pop_start(cf_vec_t *vec)
 {
 	assert_vec(vec);
 	cf_assert(!vec_bits(vec->packed_data));
+	assert_no_citer(vec);
 
 	if (!vec->len) {
 		// empty; nothing to pop
@@ -417,12 +447,17 @@ cf_vec_at(const cf_vec_t *vec, size_t i)
  * - a vector cannot have two iterators at once
  * - an iterator cannot be started while a vector is in the middle of insertion
  *   I.e.: reserve, iter_make, commit is prohibited
+ * - an iterator cannot be started while the same thread has a const iterator
+ *   over the vector
+ *
+ * Use cf_vec_citer_make() instead when elements are only read.
  */
 void
 cf_vec_iter_make(cf_vec_t *vec, cf_vec_iter_t *out)
 {
 	assert_vec(vec);
 	cf_assert(!vec_bits(vec->packed_data));
+	assert_no_citer(vec);
 	vec_set_bit(&vec->packed_data, CF_VEC_ITERATED);
 
 	*out = (cf_vec_iter_t) {
@@ -474,6 +509,78 @@ cf_vec_iter_next(cf_vec_iter_t *it)
 	return it->offset < it->parent->len;
 }
 
+/*
+ * Initialize `out` to a read-only iterator over all elements in `vec`.
+ *
+ * `vec` isn't written to. Free `out` with a call to cf_vec_citer_free().
+ *
+ * Limitations:
+ * - a vector cannot be modified while being iterated, by any thread
+ * - a vector cannot be const iterated while in the middle of insertion
+ * - a thread can have at most CF_VEC_CITER_MAX const iterators at once
+ *
+ * Steps:
+ * - check `vec` isn't in the middle of an insert/pop/mutable iteration
+ * - record `vec` as const iterated by the current thread
+ * - snapshot the fields read during iteration
+ */
+void
+cf_vec_citer_make(const cf_vec_t *vec, cf_vec_citer_t *out)
+{
+	assert_vec(vec);
+	cf_assert(!vec_bits(vec->packed_data));
+	citer_register(vec);
+
+	*out = (cf_vec_citer_t) {
+		.parent = vec,
+		.offset = ITER_OFFSET_UNSTARTED,
+		.packed_data = vec->packed_data,
+		.len = vec->len,
+	};
+	assert_vec_citer(out);
+}
+
+/*
+ * Free an iterator initialized from a previous cf_vec_citer_make().
+ */
+void
+cf_vec_citer_free(cf_vec_citer_t *it)
+{
+	assert_vec_citer(it);
+	citer_unregister(it->parent);
+}
+
+/*
+ * Return a pointer to the element the iterator is currently on.
+ */
+const void *
+cf_vec_citer_peek(const cf_vec_citer_t *it)
+{
+	assert_vec_citer(it);
+	// can't peek an iterator that hasn't been _next()ed once
+	cf_assert(it->offset != ITER_OFFSET_UNSTARTED);
+	cf_assert(it->offset < it->len);
+
+	return vec_offset(it->packed_data, it->offset);
+}
+
+/*
+ * Advance iterator `it`.
+ *
+ * Only the snapshot in `it` is read, not the parent vector.
+ */
+bool
+cf_vec_citer_next(cf_vec_citer_t *it)
+{
+	if (it->offset == ITER_OFFSET_UNSTARTED) {
+		it->offset = 0;
+	} else {
+		it->offset += it->parent->stride;
+	}
+
+	return it->offset < it->len;
+}
+
 /*
  * Resize `vec` to a new physical size of `new_capacity` bytes.
  *
@@ -568,6 +675,33 @@ vec_clear_bit(uintptr_t *packed_data, uintptr_t bit)
 	*packed_data &= ~bit;
 }
 
+/*
+ * Record a new const iterator over `vec` in the current thread.
+ */
+static void
+citer_register(const cf_vec_t *vec)
+{
+	if (citers.count == CF_VEC_CITER_MAX) {
+		cf_assert_fail("more than %u const iterators\n", CF_VEC_CITER_MAX);
+	}
+	citers.parents[citers.count++] = vec;
+}
+
+/*
+ * Forget one const iterator over `vec` in the current thread.
+ */
+static void
+citer_unregister(const cf_vec_t *vec)
+{
+	for (unsigned i = 0; i < citers.count; ++i) {
+		if (citers.parents[i] == vec) {
+			citers.parents[i] = citers.parents[--citers.count];
+			return;
+		}
+	}
+	cf_assert_fail("no const iterator over vec %p\n", (void *)vec);
+}
+
 /*
  * Assert that `vec` is self consistent.
  *
@@ -646,3 +780,37 @@ assert_vec_iter(const cf_vec_iter_t *it)
 	cf_assert(it->offset <= it->parent->len);
 	cf_assert((it->offset % it->parent->stride) == 0);
 }
+
+/*
+ * Assert that `it` is self consistent.
+ *
+ * In addition to the checks of assert_vec_iter(), check the parent vector
+ * still matches the snapshot in `it`. A mismatch means the vector was modified
+ * during iteration.
+ */
+static void
+assert_vec_citer(const cf_vec_citer_t *it)
+{
+	cf_assert(it->parent);
+	cf_assert(it->parent->packed_data == it->packed_data);
+	cf_assert(it->parent->len == it->len);
+	if (it->offset == ITER_OFFSET_UNSTARTED) {
+		return;
+	}
+	cf_assert(it->offset <= it->len);
+	cf_assert((it->offset % it->parent->stride) == 0);
+}
+
+/*
+ * Assert that the current thread has no const iterator over `vec`.
+ *
+ * Called by each function that modifies a vector. Const iterators of other
+ * threads aren't visible here.
+ */
+static void
+assert_no_citer(const cf_vec_t *vec)
+{
+	for (unsigned i = 0; i < citers.count; ++i) {
+		cf_assert(citers.parents[i] != vec);
+	}
+}
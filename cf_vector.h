@@ -105,6 +105,43 @@ typedef struct {
 	size_t offset;
 } cf_vec_iter_t;
 
+/*
+ * Read-only vector iterator.
+ *
+ * Same use as `cf_vec_iter_t`, but through the cf_vec_citer_* functions.
+ * Unlike cf_vec_iter_make(), cf_vec_citer_make() doesn't write to the vector:
+ * no CF_VEC_ITERATED bit is set. Any number of threads can iterate over a
+ * vector nobody modifies, and a single thread can nest iterators over the
+ * same vector.
+ *
+ * The assertions CF_VEC_ITERATED gives are kept by recording outstanding
+ * const iterators per thread instead of in the vector. Modifying a vector
+ * that the same thread is const iterating over fails an assertion. A change
+ * made by another thread is caught, on a best effort basis, by comparing
+ * against a snapshot taken in cf_vec_citer_make().
+ *
+ * Members
+ * - parent
+ *   Borrowed pointer to vector being iterated over.
+ * - offset
+ *   Same as `cf_vec_iter_t::offset`.
+ * - packed_data
+ *   Snapshot of `parent->packed_data`.
+ * - len
+ *   Snapshot of `parent->len`. Iteration stops here.
+ */
+typedef struct {
+	const cf_vec_t *parent;
+	size_t offset;
+	uintptr_t packed_data;
+	size_t len;
+} cf_vec_citer_t;
+
+/*
+ * Maximum number of const iterators a single thread can have at once.
+ */
+#define CF_VEC_CITER_MAX 8
+
 void cf_vec_make(size_t type_size, size_t type_align, cf_vec_t *out);
 void cf_vec_free(cf_vec_t *vec);
 void cf_vec_reset(cf_vec_t *vec);
@@ -127,6 +164,11 @@ void cf_vec_iter_free(cf_vec_iter_t *it);
 void *cf_vec_iter_peek(const cf_vec_iter_t *it);
 bool cf_vec_iter_next(cf_vec_iter_t *it);
 
+void cf_vec_citer_make(const cf_vec_t *vec, cf_vec_citer_t *out);
+void cf_vec_citer_free(cf_vec_citer_t *it);
+const void *cf_vec_citer_peek(const cf_vec_citer_t *it);
+bool cf_vec_citer_next(cf_vec_citer_t *it);
+
 /*
  * Codegen wrappers for a type-safe vector of `type`.
  *
@@ -252,4 +294,34 @@ bool cf_vec_iter_next(cf_vec_iter_t *it);
 		return cf_vec_iter_next(it); \
 	} \
 
+/*
+ * Codegen wrappers to cf_vec_citer_* functions for a vector of `type`.
+ *
+ * Similar to CF_VEC_ITER_GENERATE(). E.g.,
+ * `CF_VEC_CITER_GENERATE(foo_vec_t, foo_t, foo_citer)` will generate:
+ * - void foo_citer_make(const foo_vec_t *, ...);
+ * - void foo_citer_free(...);
+ * - const foo_t *foo_citer_peek(...);
+ * - bool foo_citer_next(...);
+ */
+#define CF_VEC_CITER_GENERATE(vec_name, type, prefix) \
+	CF_VEC_CITER_GENERATE_(vec_name, type, prefix)
+#define CF_VEC_CITER_GENERATE_(vec_name, type, prefix) \
+	static inline void \
+	prefix ## _make(const vec_name *vec, cf_vec_citer_t *out) { \
+		return cf_vec_citer_make(&vec->v, out); \
+	} \
+	static inline void \
+	prefix ## _free(cf_vec_citer_t *it) { \
+		return cf_vec_citer_free(it); \
+	} \
+	static inline const type * \
+	prefix ## _peek(const cf_vec_citer_t *it) { \
+		return cf_vec_citer_peek(it); \
+	} \
+	static inline bool \
+	prefix ## _next(cf_vec_citer_t *it) { \
+		return cf_vec_citer_next(it); \
+	} \
+
 __END_DECLS
@@ -0,0 +1,1679 @@
+/*
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ * Copyright (C) 2024 cfind developer
+ *
+ * main()-containing file for the benchmark tool.
+ *
+ * Three subcommands:
+ * - run
+ *   Run an indexer command several times. After each trial, time a set of
+ *   queries against the database it made. Write every sample, along with
+ *   metadata about the machine, to a JSON file.
+ * - replay
+ *   Run every command of a query log (see "query_log.h") against a database
+ *   several times. Write the latency distribution of each pass to a JSON
+ *   file in the same schema as `run`.
+ * - compare
+ *   Read two files written by `run` and decide, per metric, whether the
+ *   difference between them is more than noise. Exit with status 1 if any
+ *   metric regressed by more than a threshold.
+ *
+ * Result file schema ("cfind-bench/1"). Fields are only ever added.
+ *   {
+ *     "schema": "cfind-bench/1",
+ *     "env": {
+ *       "cfind_version": "0.1", "sqlite_version": "3.40.1",
+ *       "compiler": "...", "os": "Linux", "release": "...",
+ *       "machine": "x86_64", "host": "...", "cpus": 8,
+ *       "time": "2024-01-01T00:00:00Z", "trials": 5, "command": "..."
+ *     },
+ *     (for `replay`, "trials" is the number of passes and "command" the
+ *     `cfind-bench replay` arguments)
+ *     "metrics": {
+ *       "<name>": {"unit": "...", "better": "higher"|"lower",
+ *                  "samples": [1.0, ...]},
+ *       ...
+ *     }
+ *   }
+ */
+#define _POSIX_C_SOURCE 200809L // for clock_gettime(2)
+#define _DEFAULT_SOURCE // for wait4(2)
+#include "cf_alloc.h"
+#include "cf_db.h"
+#include "cf_print.h"
+#include "cf_string.h"
+#include "main_support.h"
+#include "query_log.h"
+#include "scan.h"
+#include "search.h"
+#include "sql_db.h"
+#include "sql_query.h"
+#include "version.h"
+
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <limits.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sysexits.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/utsname.h>
+#include <sys/wait.h>
+
+#include <sqlite3.h>
+
+#define BENCH_SCHEMA "cfind-bench/1"
+
+// default number of indexer runs
+#define BENCH_DEFAULT_TRIALS 5
+// times each query is repeated per trial
+#define BENCH_QUERY_REPS 20
+// default `compare` regression threshold, in percent
+#define BENCH_DEFAULT_THRESHOLD 5.0
+// max number of `-q` queries
+#define BENCH_MAX_QUERIES 16
+// default number of `replay` passes over a log
+#define BENCH_DEFAULT_PASSES 3
+
+/*
+ * Identifiers for each metric recorded by `run`.
+ */
+typedef enum {
+	metric_tus_per_sec,
+	metric_query_p50,
+	metric_query_p99,
+	metric_max_rss,
+	metric_db_size,
+	num_metrics,
+} metric_id_t;
+
+/*
+ * Static description of a metric.
+ *
+ * Members
+ * - name
+ *   Key in the "metrics" object.
+ * - unit
+ * - higher_better
+ *   Direction of an improvement.
+ */
+typedef struct {
+	const char *name;
+	const char *unit;
+	bool higher_better;
+} metric_desc_t;
+
+static const metric_desc_t metric_descs[num_metrics] = {
+	[metric_tus_per_sec] = {"tus_per_sec", "TU/s", true},
+	[metric_query_p50] = {"query_p50_us", "us", false},
+	[metric_query_p99] = {"query_p99_us", "us", false},
+	[metric_max_rss] = {"max_rss_kb", "KiB", false},
+	[metric_db_size] = {"db_bytes", "B", false},
+};
+
+/*
+ * Identifiers for each metric recorded by `replay`, one sample per pass.
+ */
+typedef enum {
+	replay_metric_total,
+	replay_metric_p50,
+	replay_metric_p99,
+	replay_metric_max,
+	num_replay_metrics,
+} replay_metric_id_t;
+
+static const metric_desc_t replay_metric_descs[num_replay_metrics] = {
+	[replay_metric_total] = {"replay_total_ms", "ms", false},
+	[replay_metric_p50] = {"replay_p50_us", "us", false},
+	[replay_metric_p99] = {"replay_p99_us", "us", false},
+	[replay_metric_max] = {"replay_max_us", "us", false},
+};
+
+/*
+ * Everything written to a result file.
+ *
+ * Members
+ * - out_path
+ * - descs, samples, num_metrics
+ *   Parallel arrays: each metric's description and its `trials` samples.
+ * - trials
+ * - command, command_len
+ *   Command line recorded in "env".
+ */
+typedef struct {
+	const char *out_path;
+	const metric_desc_t *descs;
+	double *const *samples;
+	size_t num_metrics;
+	unsigned trials;
+	char **command;
+	int command_len;
+} bench_results_t;
+
+/*
+ * `cfind-bench run` arguments and results.
+ *
+ * Members
+ * - db_path
+ *   Database the indexer command writes. Deleted before each trial.
+ * - out_path
+ *   JSON file to write.
+ * - command, command_len
+ *   Indexer command line.
+ * - queries, num_queries
+ *   typename patterns timed after each trial.
+ * - trials
+ * - samples
+ *   `trials` samples for each metric.
+ */
+typedef struct {
+	const char *db_path;
+	const char *out_path;
+	char **command;
+	int command_len;
+	const char *queries[BENCH_MAX_QUERIES];
+	size_t num_queries;
+	unsigned trials;
+	double *samples[num_metrics];
+} bench_run_t;
+
+/*
+ * `cfind-bench replay` arguments and state.
+ *
+ * Members
+ * - log_path
+ * - db_path
+ * - out_path
+ * - passes
+ *   Number of times every record is run.
+ * - argv, argc
+ *   The `replay` command line, for the result file.
+ * - records, num_records
+ *   Records loaded from the log. Commands borrow from `log`.
+ * - log
+ * - recorded
+ *   Recorded latency of each record in microseconds, sorted.
+ * - latencies
+ *   Latency of each record in the current pass.
+ * - samples
+ *   `passes` samples for each metric.
+ */
+typedef struct {
+	const char *log_path;
+	const char *db_path;
+	const char *out_path;
+	unsigned passes;
+	char **argv;
+	int argc;
+	query_record_t *records;
+	size_t num_records;
+	query_log_t log;
+	double *recorded;
+	double *latencies;
+	double *samples[num_replay_metrics];
+} bench_replay_t;
+
+/*
+ * A parsed JSON value.
+ *
+ * Only as much JSON as the result schema needs. `len` is the length of
+ * `string`, or the number of `items` in an array or object. Objects keep
+ * their keys in `keys`, parallel to `items`.
+ */
+typedef struct json_value {
+	enum {
+		json_null,
+		json_bool,
+		json_number,
+		json_string,
+		json_array,
+		json_object,
+	} kind;
+	double number;
+	char *string;
+	size_t len;
+	char **keys;
+	struct json_value *items;
+} json_value_t;
+
+/*
+ * Summary of one metric's samples in one result file.
+ */
+typedef struct {
+	size_t n;
+	double mean;
+	double var;
+} sample_stats_t;
+
+static int bench_run(int argc, char **argv);
+static int parse_run_args(int argc, char **argv, bench_run_t *out);
+static int run_one_trial(bench_run_t *run, unsigned trial);
+static int run_indexer(char **command, double *secs_out, long *rss_kb_out);
+static int time_queries(bench_run_t *run, double *p50_out, double *p99_out);
+static int time_one_query(cf_db_t *db, const char *pattern, double *us_out);
+static int count_db_tus(const char *db_path, size_t *out);
+static uint64_t db_file_size(const char *db_path);
+static void remove_db(const char *db_path);
+static int write_results(const bench_results_t *res);
+static void write_env(FILE *f, const bench_results_t *res);
+static void write_json_string(FILE *f, const char *str);
+
+static int bench_replay(int argc, char **argv);
+static int parse_replay_args(int argc, char **argv, bench_replay_t *out);
+static int load_records(bench_replay_t *replay);
+static int replay_pass(bench_replay_t *replay, cf_db_t *db,
+		const scan_table_t *table, unsigned pass, size_t *mismatches_out);
+static int silence_stdout(void);
+static void restore_stdout(int saved);
+
+static int bench_compare(int argc, char **argv);
+static int load_results(const char *path, json_value_t *out);
+static const json_value_t *json_get(const json_value_t *obj, const char *key);
+static bool get_samples(const json_value_t *metric, sample_stats_t *out);
+static bool compare_metric(const char *name, const json_value_t *base,
+		const json_value_t *new, double threshold);
+static double t_critical(double df);
+static void warn_env_mismatch(const json_value_t *base,
+		const json_value_t *new);
+
+static int json_parse(const char **p, const char *end, json_value_t *out);
+static int json_parse_string(const char **p, const char *end, char **out,
+		size_t *len_out);
+static int json_parse_container(const char **p, const char *end, bool object,
+		json_value_t *out);
+static void json_skip_space(const char **p, const char *end);
+static void json_free(json_value_t *value);
+
+static double now_secs(void);
+static int compare_doubles(const void *lhs, const void *rhs);
+
+static void
+print_usage(void)
+{
+	printf("Usage: cfind-bench run [OPTION]... database -- command...\n" \
+			"   or: cfind-bench replay [OPTION]... log database\n" \
+			"   or: cfind-bench compare [OPTION]... base.json new.json\n");
+}
+
+static void
+print_help(void)
+{
+	print_usage();
+	printf("cfind benchmark tool.\n" \
+			"run: index with `command' (which must write `database') " \
+			"several times\n" \
+			"and record index and query performance.\n" \
+			"   -n, --trials N      number of runs (default %d)\n" \
+			"   -q, --query PAT     typename pattern to time; repeatable\n" \
+			"                       (default `%%', `%%lock%%', `a%%')\n" \
+			"   -o, --out FILE      result file (default bench.json)\n" \
+			"replay: run the commands of a query log written by " \
+			"`cfind -L' and\n" \
+			"record their latency.\n" \
+			"   -n, --passes N      number of passes over the log " \
+			"(default %d)\n" \
+			"   -o, --out FILE      result file (default replay.json)\n" \
+			"compare: compare two result files; exit 1 on a regression.\n" \
+			"   -t, --threshold PCT smallest significant change that\n" \
+			"                       counts as a regression (default %.0f)\n",
+			BENCH_DEFAULT_TRIALS, BENCH_DEFAULT_PASSES,
+			BENCH_DEFAULT_THRESHOLD);
+}
+
+int
+main(int argc, char **argv)
+{
+	int error;
+
+	if ((error = cf_setup_stdio())) {
+		return error;
+	}
+
+	if (argc < 2) {
+		print_usage();
+		return EX_USAGE;
+	}
+
+	if (!strcmp(argv[1], "run")) {
+		return bench_run(argc - 1, &argv[1]);
+	}
+	if (!strcmp(argv[1], "replay")) {
+		return bench_replay(argc - 1, &argv[1]);
+	}
+	if (!strcmp(argv[1], "compare")) {
+		return bench_compare(argc - 1, &argv[1]);
+	}
+	if (!strcmp(argv[1], "-h") || !strcmp(argv[1], "--help")) {
+		print_help();
+		return 0;
+	}
+	if (!strcmp(argv[1], "--version")) {
+		printf("cfind-bench %s\n", CF_VERSION_STR);
+		return 0;
+	}
+
+	print_usage();
+	return EX_USAGE;
+}
+
+/*
+ * `cfind-bench run`.
+ *
+ * Steps:
+ * - for each trial
+ *   - delete the database
+ *   - run the indexer command; measure time and peak RSS
+ *   - measure database size and count TUs
+ *   - time queries
+ * - write every sample to a JSON file
+ */
+static int
+bench_run(int argc, char **argv)
+{
+	int error;
+	bench_run_t run;
+
+	if ((error = parse_run_args(argc, argv, &run))) {
+		print_usage();
+		return error;
+	}
+
+	for (size_t i = 0; i < num_metrics; ++i) {
+		if (!(run.samples[i] = cf_malloc(run.trials * sizeof(double)))) {
+			error = EX_OSERR;
+			goto fail;
+		}
+	}
+
+	for (unsigned i = 0; i < run.trials; ++i) {
+		if ((error = run_one_trial(&run, i))) {
+			error = EX_SOFTWARE;
+			goto fail;
+		}
+	}
+
+	const bench_results_t results = {
+		.out_path = run.out_path,
+		.descs = metric_descs,
+		.samples = run.samples,
+		.num_metrics = num_metrics,
+		.trials = run.trials,
+		.command = run.command,
+		.command_len = run.command_len,
+	};
+	if ((error = write_results(&results))) {
+		fprintf(stderr, "cannot write '%s', error %d\n", run.out_path, error);
+		error = EX_CANTCREAT;
+		goto fail;
+	}
+
+fail:
+	for (size_t i = 0; i < num_metrics; ++i) {
+		cf_free(run.samples[i]);
+	}
+	return error;
+}
+
+static int
+parse_run_args(int argc, char **argv, bench_run_t *out)
+{
+	static const struct option options[] = {
+		{"trials", required_argument, NULL, 'n'},
+		{"query", required_argument, NULL, 'q'},
+		{"out", required_argument, NULL, 'o'},
+		{NULL, 0, NULL, 0},
+	};
+
+	*out = (bench_run_t) {
+		.out_path = "bench.json",
+		.trials = BENCH_DEFAULT_TRIALS,
+	};
+
+	int c;
+	while ((c = getopt_long(argc, argv, "+n:q:o:", options, NULL)) != -1) {
+		switch (c) {
+			case 'n': {
+				char *end;
+				const unsigned long n = strtoul(optarg, &end, 10);
+				if (*end || !n || (n > 10000)) {
+					printf("bad trial count '%s'\n", optarg);
+					return EX_USAGE;
+				}
+				out->trials = (unsigned)n;
+				break;
+			}
+			case 'q':
+				if (out->num_queries == BENCH_MAX_QUERIES) {
+					printf("too many queries\n");
+					return EX_USAGE;
+				}
+				out->queries[out->num_queries++] = optarg;
+				break;
+			case 'o':
+				out->out_path = optarg;
+				break;
+			default:
+				return EX_USAGE;
+		}
+	}
+
+	// database, "--", then at least the indexer itself
+	if ((argc - optind < 3) || strcmp(argv[optind + 1], "--")) {
+		printf("missing database or command\n");
+		return EX_USAGE;
+	}
+	out->db_path = argv[optind];
+	out->command = &argv[optind + 2];
+	out->command_len = argc - (optind + 2);
+
+	if (!out->num_queries) {
+		out->queries[out->num_queries++] = "%";
+		out->queries[out->num_queries++] = "%lock%";
+		out->queries[out->num_queries++] = "a%";
+	}
+	return 0;
+}
+
+static int
+run_one_trial(bench_run_t *run, unsigned trial)
+{
+	int error;
+	double secs;
+	long rss_kb;
+	size_t tus;
+	double p50;
+	double p99;
+
+	remove_db(run->db_path);
+
+	if ((error = run_indexer(run->command, &secs, &rss_kb))) {
+		fprintf(stderr, "trial %u: indexer failed, error %d\n", trial, error);
+		return error;
+	}
+	if ((error = count_db_tus(run->db_path, &tus))) {
+		fprintf(stderr, "trial %u: cannot read '%s', error %d\n", trial,
+				run->db_path, error);
+		return error;
+	}
+	if ((error = time_queries(run, &p50, &p99))) {
+		fprintf(stderr, "trial %u: query failed, error %d\n", trial, error);
+		return error;
+	}
+
+	run->samples[metric_tus_per_sec][trial] = (secs > 0) ? (tus / secs) : 0;
+	run->samples[metric_query_p50][trial] = p50;
+	run->samples[metric_query_p99][trial] = p99;
+	run->samples[metric_max_rss][trial] = (double)rss_kb;
+	run->samples[metric_db_size][trial] = (double)db_file_size(run->db_path);
+
+	fprintf(stderr, "trial %u: %zu TUs in %.3fs, p99 %.1fus, rss %ldKiB\n",
+			trial, tus, secs, p99, rss_kb);
+	return 0;
+}
+
+/*
+ * Run `command` to completion.
+ *
+ * Its wall time and peak RSS are written to the out parameters.
+ */
+static int
+run_indexer(char **command, double *secs_out, long *rss_kb_out)
+{
+	fflush(stdout);
+
+	const double start = now_secs();
+	const pid_t pid = fork();
+	if (pid == -1) {
+		return errno;
+	}
+	if (!pid) {
+		execvp(command[0], command);
+		_exit(EX_UNAVAILABLE);
+	}
+
+	int wstatus;
+	struct rusage usage;
+	while (wait4(pid, &wstatus, 0, &usage) == -1) {
+		if (errno != EINTR) {
+			return errno;
+		}
+	}
+	*secs_out = now_secs() - start;
+
+	if (!WIFEXITED(wstatus) || WEXITSTATUS(wstatus)) {
+		return ECHILD;
+	}
+	// Linux and the BSDs report this in KiB
+	*rss_kb_out = usage.ru_maxrss;
+	return 0;
+}
+
+/*
+ * Time `BENCH_QUERY_REPS` runs of every query. Report the median and 99th
+ * percentile latency across all of them.
+ *
+ * Like replay_pass(), logging printed during the queries goes to /dev/null,
+ * so both measure the same work.
+ */
+static int
+time_queries(bench_run_t *run, double *p50_out, double *p99_out)
+{
+	int error;
+	cf_db_t db;
+
+	const size_t num = run->num_queries * BENCH_QUERY_REPS;
+	double *latencies = cf_malloc(num * sizeof(double));
+	if (!latencies) {
+		return ENOMEM;
+	}
+
+	if ((error = cf_db_open_sql(run->db_path, /*ro*/true, &db))) {
+		goto fail;
+	}
+
+	const int saved = silence_stdout();
+	if (saved == -1) {
+		error = errno;
+		goto fail_db;
+	}
+
+	size_t n = 0;
+	for (size_t rep = 0; (rep < BENCH_QUERY_REPS) && !error; ++rep) {
+		for (size_t i = 0; i < run->num_queries; ++i) {
+			if ((error = time_one_query(&db, run->queries[i],
+					&latencies[n++]))) {
+				break;
+			}
+		}
+	}
+	restore_stdout(saved);
+	if (error) {
+		goto fail_db;
+	}
+
+	qsort(latencies, n, sizeof(double), compare_doubles);
+	*p50_out = latencies[(n - 1) / 2];
+	*p99_out = latencies[((n - 1) * 99) / 100];
+
+fail_db:
+	cf_db_close(&db);
+fail:
+	cf_free(latencies);
+	return error;
+}
+
+/*
+ * Find every typename matching `pattern`, and read every result.
+ */
+static int
+time_one_query(cf_db_t *db, const char *pattern, double *us_out)
+{
+	int error;
+	cf_str_t name;
+	db_typename_iter_t it;
+	db_typename_t entry;
+	loc_ctx_t loc;
+
+	cf_str_borrow(pattern, strlen(pattern), &name);
+
+	const double start = now_secs();
+	if ((error = cf_db_typename_find(db, &name, NULL, &it))) {
+		return error;
+	}
+	while (db_typename_iter_next(&it)) {
+		db_typename_iter_peek(&it, &entry, &loc);
+	}
+	db_typename_iter_free(&it);
+	*us_out = (now_secs() - start) * 1e6;
+
+	return 0;
+}
+
+static int
+count_db_tus(const char *db_path, size_t *out)
+{
+	int error;
+	sqlite_db_t db;
+
+	if ((error = sql_db_open(db_path, /*ro*/true, &db))) {
+		return error;
+	}
+	error = count_tus(db.sql, out);
+	sql_db_close(&db);
+	return error;
+}
+
+/*
+ * Size of the database at `db_path`, including its WAL.
+ */
+static uint64_t
+db_file_size(const char *db_path)
+{
+	struct stat sb;
+	char wal[PATH_MAX];
+	uint64_t size = 0;
+
+	if (!stat(db_path, &sb)) {
+		size += (uint64_t)sb.st_size;
+	}
+	if ((snprintf(wal, sizeof(wal), "%s-wal", db_path) < (int)sizeof(wal)) &&
+			!stat(wal, &sb)) {
+		size += (uint64_t)sb.st_size;
+	}
+	return size;
+}
+
+static void
+remove_db(const char *db_path)
+{
+	char buf[PATH_MAX];
+
+	(void)unlink(db_path);
+	if (snprintf(buf, sizeof(buf), "%s-wal", db_path) < (int)sizeof(buf)) {
+		(void)unlink(buf);
+	}
+	if (snprintf(buf, sizeof(buf), "%s-shm", db_path) < (int)sizeof(buf)) {
+		(void)unlink(buf);
+	}
+}
+
+static int
+write_results(const bench_results_t *res)
+{
+	FILE *f = fopen(res->out_path, "w");
+	if (!f) {
+		return errno;
+	}
+
+	fprintf(f, "{\n  \"schema\": \"%s\",\n", BENCH_SCHEMA);
+	write_env(f, res);
+
+	fprintf(f, "  \"metrics\": {\n");
+	for (size_t i = 0; i < res->num_metrics; ++i) {
+		const metric_desc_t *desc = &res->descs[i];
+		fprintf(f, "    \"%s\": {\"unit\": \"%s\", \"better\": \"%s\", "
+				"\"samples\": [", desc->name, desc->unit,
+				desc->higher_better ? "higher" : "lower");
+		for (unsigned j = 0; j < res->trials; ++j) {
+			fprintf(f, "%s%.17g", j ? ", " : "", res->samples[i][j]);
+		}
+		fprintf(f, "]}%s\n", (i + 1 < res->num_metrics) ? "," : "");
+	}
+	fprintf(f, "  }\n}\n");
+
+	const int error = ferror(f) ? EIO : 0;
+	if (fclose(f) && !error) {
+		return errno;
+	}
+	return error;
+}
+
+/*
+ * Write the "env" object: enough to tell whether two result files are
+ * comparable at all.
+ */
+static void
+write_env(FILE *f, const bench_results_t *res)
+{
+	struct utsname uts;
+	char time_buf[32] = "";
+	const time_t now = time(NULL);
+	struct tm tm;
+
+	if (uname(&uts)) {
+		memset(&uts, 0, sizeof(uts));
+	}
+	if (gmtime_r(&now, &tm)) {
+		strftime(time_buf, sizeof(time_buf), "%Y-%m-%dT%H:%M:%SZ", &tm);
+	}
+
+	fprintf(f, "  \"env\": {\n");
+	fprintf(f, "    \"cfind_version\": \"%s\",\n", CF_VERSION_STR);
+	fprintf(f, "    \"sqlite_version\": \"%s\",\n", sqlite3_libversion());
+	fprintf(f, "    \"compiler\": ");
+	write_json_string(f, __VERSION__);
+	fprintf(f, ",\n    \"os\": ");
+	write_json_string(f, uts.sysname);
+	fprintf(f, ",\n    \"release\": ");
+	write_json_string(f, uts.release);
+	fprintf(f, ",\n    \"machine\": ");
+	write_json_string(f, uts.machine);
+	fprintf(f, ",\n    \"host\": ");
+	write_json_string(f, uts.nodename);
+	fprintf(f, ",\n    \"cpus\": %ld,\n", sysconf(_SC_NPROCESSORS_ONLN));
+	fprintf(f, "    \"time\": \"%s\",\n", time_buf);
+	fprintf(f, "    \"trials\": %u,\n", res->trials);
+
+	// the command as one string; only for people to read
+	fprintf(f, "    \"command\": \"");
+	for (int i = 0; i < res->command_len; ++i) {
+		if (i) {
+			fputc(' ', f);
+		}
+		for (const char *c = res->command[i]; *c; ++c) {
+			if ((*c == '"') || (*c == '\\')) {
+				fprintf(f, "\\%c", *c);
+			} else if ((unsigned char)*c < 0x20) {
+				fprintf(f, "\\u%04x", (unsigned char)*c);
+			} else {
+				fputc(*c, f);
+			}
+		}
+	}
+	fprintf(f, "\"\n  },\n");
+}
+
+static void
+write_json_string(FILE *f, const char *str)
+{
+	fputc('"', f);
+	for (const char *c = str; *c; ++c) {
+		if ((*c == '"') || (*c == '\\')) {
+			fprintf(f, "\\%c", *c);
+		} else if ((unsigned char)*c < 0x20) {
+			fprintf(f, "\\u%04x", (unsigned char)*c);
+		} else {
+			fputc(*c, f);
+		}
+	}
+	fputc('"', f);
+}
+
+/*
+ * `cfind-bench replay`.
+ *
+ * Steps:
+ * - load every record of the query log
+ * - open the database read-only; load a scan table if any record used one
+ * - for each pass
+ *   - run every command the way `cfind` ran it, output discarded
+ *   - record total, median, 99th percentile, and max latency
+ * - warn if result counts differ from the log; the database probably isn't
+ *   the one the log was recorded against
+ * - write every sample to a JSON file
+ */
+static int
+bench_replay(int argc, char **argv)
+{
+	int error;
+	bench_replay_t replay;
+	cf_db_t db;
+	scan_table_t table;
+	bool scan = false;
+	size_t mismatches = 0;
+
+	if ((error = parse_replay_args(argc, argv, &replay))) {
+		print_usage();
+		return error;
+	}
+
+	if ((error = load_records(&replay))) {
+		error = EX_DATAERR;
+		goto fail;
+	}
+
+	for (size_t i = 0; i < num_replay_metrics; ++i) {
+		if (!(replay.samples[i] = cf_malloc(replay.passes * sizeof(double)))) {
+			error = EX_OSERR;
+			goto fail;
+		}
+	}
+	replay.recorded = cf_malloc(replay.num_records * sizeof(double));
+	replay.latencies = cf_malloc(replay.num_records * sizeof(double));
+	if (!replay.recorded || !replay.latencies) {
+		error = EX_OSERR;
+		goto fail;
+	}
+
+	for (size_t i = 0; i < replay.num_records; ++i) {
+		replay.recorded[i] = (double)replay.records[i].latency_us;
+		scan |= replay.records[i].scan;
+	}
+	qsort(replay.recorded, replay.num_records, sizeof(double),
+			compare_doubles);
+
+	if ((error = cf_db_open_sql(replay.db_path, /*ro*/true, &db))) {
+		fprintf(stderr, "cannot open '%s', error %d\n", replay.db_path, error);
+		error = EX_NOINPUT;
+		goto fail;
+	}
+	// loaded once, like `cfind -s` would if it stayed open
+	if (scan && (error = scan_table_load(&db.sql, &table))) {
+		fprintf(stderr, "cannot load scan table, error %d\n", error);
+		error = EX_SOFTWARE;
+		goto fail_db;
+	}
+
+	const size_t n = replay.num_records;
+	fprintf(stderr, "recorded: %zu commands, p50 %.1fus, p99 %.1fus\n", n,
+			replay.recorded[(n - 1) / 2],
+			replay.recorded[((n - 1) * 99) / 100]);
+
+	for (unsigned i = 0; i < replay.passes; ++i) {
+		if ((error = replay_pass(&replay, &db, scan ? &table : NULL, i,
+				i ? NULL : &mismatches))) {
+			error = EX_OSERR;
+			goto fail_table;
+		}
+	}
+
+	if (mismatches) {
+		fprintf(stderr, "warning: %zu of %zu commands gave different results "
+				"than recorded; is this the same database?\n", mismatches, n);
+	}
+
+	const bench_results_t results = {
+		.out_path = replay.out_path,
+		.descs = replay_metric_descs,
+		.samples = replay.samples,
+		.num_metrics = num_replay_metrics,
+		.trials = replay.passes,
+		.command = replay.argv,
+		.command_len = replay.argc,
+	};
+	if ((error = write_results(&results))) {
+		fprintf(stderr, "cannot write '%s', error %d\n", replay.out_path,
+				error);
+		error = EX_CANTCREAT;
+		goto fail_table;
+	}
+
+fail_table:
+	if (scan) {
+		scan_table_free(&table);
+	}
+fail_db:
+	cf_db_close(&db);
+fail:
+	for (size_t i = 0; i < num_replay_metrics; ++i) {
+		cf_free(replay.samples[i]);
+	}
+	cf_free(replay.latencies);
+	cf_free(replay.recorded);
+	cf_free(replay.records);
+	query_log_free(&replay.log);
+	return error;
+}
+
+static int
+parse_replay_args(int argc, char **argv, bench_replay_t *out)
+{
+	static const struct option options[] = {
+		{"passes", required_argument, NULL, 'n'},
+		{"out", required_argument, NULL, 'o'},
+		{NULL, 0, NULL, 0},
+	};
+
+	*out = (bench_replay_t) {
+		.out_path = "replay.json",
+		.passes = BENCH_DEFAULT_PASSES,
+		.argv = argv,
+		.argc = argc,
+	};
+
+	int c;
+	while ((c = getopt_long(argc, argv, "n:o:", options, NULL)) != -1) {
+		switch (c) {
+			case 'n': {
+				char *end;
+				const unsigned long n = strtoul(optarg, &end, 10);
+				if (*end || !n || (n > 10000)) {
+					printf("bad pass count '%s'\n", optarg);
+					return EX_USAGE;
+				}
+				out->passes = (unsigned)n;
+				break;
+			}
+			case 'o':
+				out->out_path = optarg;
+				break;
+			default:
+				return EX_USAGE;
+		}
+	}
+
+	if (argc - optind != 2) {
+		printf("missing log or database\n");
+		return EX_USAGE;
+	}
+	out->log_path = argv[optind];
+	out->db_path = argv[optind + 1];
+	return 0;
+}
+
+/*
+ * Read every well-formed record of the query log into `replay->records`.
+ *
+ * Malformed records, e.g., the tail of a write cut short, are skipped with a
+ * warning. A log with no records at all is an error.
+ */
+static int
+load_records(bench_replay_t *replay)
+{
+	int error;
+	size_t capacity = 0;
+	size_t bad = 0;
+	query_record_t rec;
+
+	if ((error = query_log_load(replay->log_path, &replay->log))) {
+		fprintf(stderr, "cannot read '%s', error %d\n", replay->log_path,
+				error);
+		return error;
+	}
+
+	while ((error = query_log_next(&replay->log, &rec)) != ENOENT) {
+		if (error) {
+			++bad;
+			continue;
+		}
+		if (replay->num_records == capacity) {
+			capacity = capacity ? (capacity * 2) : 256;
+			query_record_t *records = cf_realloc(replay->records,
+					capacity * sizeof(*records));
+			if (!records) {
+				return ENOMEM;
+			}
+			replay->records = records;
+		}
+		replay->records[replay->num_records++] = rec;
+	}
+
+	if (bad) {
+		fprintf(stderr, "warning: skipped %zu malformed records\n", bad);
+	}
+	if (!replay->num_records) {
+		fprintf(stderr, "'%s' has no records\n", replay->log_path);
+		return ENOENT;
+	}
+	return 0;
+}
+
+/*
+ * Run every record once and store this pass's samples.
+ *
+ * Commands print their results as they go. That's part of the cost being
+ * measured, so they still print, only to /dev/null. Commands that fail are
+ * timed like the rest; they failed when recorded, too.
+ *
+ * If `mismatches_out` is non-NULL, count the records whose result count or
+ * success differs from the log.
+ */
+static int
+replay_pass(bench_replay_t *replay, cf_db_t *db, const scan_table_t *table,
+		unsigned pass, size_t *mismatches_out)
+{
+	const int saved = silence_stdout();
+	if (saved == -1) {
+		return errno;
+	}
+
+	const uint64_t pass_start = query_log_clock_us();
+	for (size_t i = 0; i < replay->num_records; ++i) {
+		const query_record_t *rec = &replay->records[i];
+		const search_opts_t opts = {
+			.scan = rec->scan,
+		};
+		search_result_t result;
+
+		const uint64_t start = query_log_clock_us();
+		const int error = search_exec(db, rec->scan ? table : NULL,
+				&rec->cmd, &opts, &result);
+		replay->latencies[i] = (double)(query_log_clock_us() - start);
+
+		if (mismatches_out && ((result.num_results != rec->num_results) ||
+				(!error != !rec->error))) {
+			++*mismatches_out;
+		}
+	}
+	const double total_ms = (query_log_clock_us() - pass_start) / 1e3;
+
+	restore_stdout(saved);
+
+	const size_t n = replay->num_records;
+	double *const lat = replay->latencies;
+	qsort(lat, n, sizeof(double), compare_doubles);
+	replay->samples[replay_metric_total][pass] = total_ms;
+	replay->samples[replay_metric_p50][pass] = lat[(n - 1) / 2];
+	replay->samples[replay_metric_p99][pass] = lat[((n - 1) * 99) / 100];
+	replay->samples[replay_metric_max][pass] = lat[n - 1];
+
+	fprintf(stderr, "pass %u: %zu commands in %.3fms, p50 %.1fus, "
+			"p99 %.1fus\n", pass, n, total_ms, lat[(n - 1) / 2],
+			lat[((n - 1) * 99) / 100]);
+	return 0;
+}
+
+/*
+ * Point stdout at /dev/null. Return a descriptor for restore_stdout(), or
+ * -1 with errno set.
+ */
+static int
+silence_stdout(void)
+{
+	int error;
+
+	fflush(stdout);
+
+	const int saved = dup(STDOUT_FILENO);
+	if (saved == -1) {
+		return -1;
+	}
+	const int null = open("/dev/null", O_WRONLY | O_CLOEXEC);
+	if (null == -1) {
+		error = errno;
+		goto fail;
+	}
+	if (dup2(null, STDOUT_FILENO) == -1) {
+		error = errno;
+		close(null);
+		goto fail;
+	}
+	close(null);
+	return saved;
+
+fail:
+	close(saved);
+	errno = error;
+	return -1;
+}
+
+static void
+restore_stdout(int saved)
+{
+	fflush(stdout);
+	(void)dup2(saved, STDOUT_FILENO);
+	close(saved);
+}
+
+/*
+ * `cfind-bench compare`.
+ *
+ * For every metric in both files, test whether the means differ with
+ * Welch's t-test at 95% confidence. A difference that's significant, in the
+ * bad direction, and bigger than the threshold is a regression.
+ */
+static int
+bench_compare(int argc, char **argv)
+{
+	static const struct option options[] = {
+		{"threshold", required_argument, NULL, 't'},
+		{NULL, 0, NULL, 0},
+	};
+
+	int error;
+	double threshold = BENCH_DEFAULT_THRESHOLD;
+	json_value_t base;
+	json_value_t new;
+
+	int c;
+	while ((c = getopt_long(argc, argv, "t:", options, NULL)) != -1) {
+		switch (c) {
+			case 't': {
+				char *end;
+				threshold = strtod(optarg, &end);
+				if (*end || (threshold < 0)) {
+					printf("bad threshold '%s'\n", optarg);
+					return EX_USAGE;
+				}
+				break;
+			}
+			default:
+				print_usage();
+				return EX_USAGE;
+		}
+	}
+	if (argc - optind != 2) {
+		print_usage();
+		return EX_USAGE;
+	}
+
+	if ((error = load_results(argv[optind], &base))) {
+		return EX_DATAERR;
+	}
+	if ((error = load_results(argv[optind + 1], &new))) {
+		json_free(&base);
+		return EX_DATAERR;
+	}
+
+	warn_env_mismatch(json_get(&base, "env"), json_get(&new, "env"));
+
+	printf("%-14s %14s %14s %9s  %-21s %s\n", "metric", "base", "new",
+			"change", "95% CI", "verdict");
+
+	const json_value_t *base_metrics = json_get(&base, "metrics");
+	const json_value_t *new_metrics = json_get(&new, "metrics");
+	bool regressed = false;
+	for (size_t i = 0; i < base_metrics->len; ++i) {
+		const char *name = base_metrics->keys[i];
+		const json_value_t *other = json_get(new_metrics, name);
+		if (!other) {
+			printf("%-14s missing from new results\n", name);
+			continue;
+		}
+		if (compare_metric(name, &base_metrics->items[i], other,
+				threshold)) {
+			regressed = true;
+		}
+	}
+
+	json_free(&new);
+	json_free(&base);
+
+	// not a sysexits error; callers (CI) only check for nonzero
+	return regressed ? 1 : 0;
+}
+
+/*
+ * Read and parse the result file at `path`. Check it has the expected schema.
+ */
+static int
+load_results(const char *path, json_value_t *out)
+{
+	int error;
+	char *buf = NULL;
+	size_t len = 0;
+
+	FILE *f = fopen(path, "r");
+	if (!f) {
+		error = errno;
+		printf("cannot open '%s', error %d\n", path, error);
+		return error;
+	}
+
+	// slurp
+	size_t capacity = 0;
+	for (;;) {
+		if (len == capacity) {
+			capacity = capacity ? (capacity * 2) : 4096;
+			char *new_buf = cf_realloc(buf, capacity);
+			if (!new_buf) {
+				error = ENOMEM;
+				goto fail;
+			}
+			buf = new_buf;
+		}
+		const size_t n = fread(buf + len, 1, capacity - len, f);
+		if (!n) {
+			break;
+		}
+		len += n;
+	}
+	if (ferror(f)) {
+		error = EIO;
+		goto fail;
+	}
+
+	const char *p = buf;
+	if ((error = json_parse(&p, buf + len, out))) {
+		printf("'%s' is not valid JSON\n", path);
+		goto fail;
+	}
+
+	const json_value_t *schema = json_get(out, "schema");
+	const json_value_t *metrics = json_get(out, "metrics");
+	if (!schema || (schema->kind != json_string) ||
+			strcmp(schema->string, BENCH_SCHEMA) ||
+			!metrics || (metrics->kind != json_object)) {
+		printf("'%s' is not a %s result file\n", path, BENCH_SCHEMA);
+		json_free(out);
+		error = EINVAL;
+		goto fail;
+	}
+
+fail:
+	cf_free(buf);
+	fclose(f);
+	return error;
+}
+
+/*
+ * Look up `key` in JSON object `obj`. NULL if missing or `obj` isn't an
+ * object.
+ */
+static const json_value_t *
+json_get(const json_value_t *obj, const char *key)
+{
+	if (!obj || (obj->kind != json_object)) {
+		return NULL;
+	}
+	for (size_t i = 0; i < obj->len; ++i) {
+		if (!strcmp(obj->keys[i], key)) {
+			return &obj->items[i];
+		}
+	}
+	return NULL;
+}
+
+/*
+ * Compute the mean and sample variance of `metric`'s "samples" array.
+ */
+static bool
+get_samples(const json_value_t *metric, sample_stats_t *out)
+{
+	const json_value_t *samples = json_get(metric, "samples");
+	if (!samples || (samples->kind != json_array) || !samples->len) {
+		return false;
+	}
+
+	double sum = 0;
+	for (size_t i = 0; i < samples->len; ++i) {
+		if (samples->items[i].kind != json_number) {
+			return false;
+		}
+		sum += samples->items[i].number;
+	}
+
+	*out = (sample_stats_t) {
+		.n = samples->len,
+		.mean = sum / samples->len,
+	};
+	if (out->n > 1) {
+		double sq = 0;
+		for (size_t i = 0; i < samples->len; ++i) {
+			const double d = samples->items[i].number - out->mean;
+			sq += d * d;
+		}
+		out->var = sq / (out->n - 1);
+	}
+	return true;
+}
+
+/*
+ * Compare metric `name` between result files and print a row.
+ *
+ * With fewer than two samples on either side the variance is unknown, so no
+ * confidence interval is printed and the metric never counts as regressed.
+ *
+ * Return true if it regressed.
+ */
+static bool
+compare_metric(const char *name, const json_value_t *base,
+		const json_value_t *new, double threshold)
+{
+	sample_stats_t b;
+	sample_stats_t n;
+	if (!get_samples(base, &b) || !get_samples(new, &n)) {
+		printf("%-14s malformed samples\n", name);
+		return false;
+	}
+
+	const json_value_t *better = json_get(base, "better");
+	const bool higher_better = better && (better->kind == json_string) &&
+			!strcmp(better->string, "higher");
+
+	const double diff = n.mean - b.mean;
+	const double pct = b.mean ? ((100 * diff) / fabs(b.mean)) : 0;
+	if ((b.n < 2) || (n.n < 2)) {
+		printf("%-14s %14.6g %14.6g %+8.1f%%  %-21s %s\n", name, b.mean,
+				n.mean, pct, "", "too few samples");
+		return false;
+	}
+
+	const double vb = b.var / b.n;
+	const double vn = n.var / n.n;
+	const double se = sqrt(vb + vn);
+
+	// Welch-Satterthwaite degrees of freedom
+	double tcrit = INFINITY;
+	if (se > 0) {
+		const double df = ((vb + vn) * (vb + vn)) /
+				(((vb * vb) / (b.n - 1)) + ((vn * vn) / (n.n - 1)));
+		tcrit = t_critical(df);
+	}
+
+	// samples that don't vary at all on either side make any difference real
+	const bool significant = (se > 0) ? (fabs(diff) > (tcrit * se)) :
+			(diff != 0);
+	const double ci_pct = (b.mean && (se > 0)) ?
+			((100 * tcrit * se) / fabs(b.mean)) : 0;
+	const bool worse = higher_better ? (diff < 0) : (diff > 0);
+	const bool regressed = significant && worse && (fabs(pct) > threshold);
+
+	const char *verdict;
+	if (regressed) {
+		verdict = "REGRESSED";
+	} else if (!significant) {
+		verdict = "noise";
+	} else {
+		verdict = worse ? "worse (under threshold)" : "improved";
+	}
+
+	char ci[32];
+	snprintf(ci, sizeof(ci), "[%+.1f%%, %+.1f%%]", pct - ci_pct,
+			pct + ci_pct);
+	printf("%-14s %14.6g %14.6g %+8.1f%%  %-21s %s\n", name, b.mean, n.mean,
+			pct, ci, verdict);
+	return regressed;
+}
+
+/*
+ * Two-sided 95% critical value of Student's t distribution with `df`
+ * degrees of freedom.
+ *
+ * Exact for integer `df` up to 30. Beyond that, interpolated in 1/df toward
+ * the normal distribution's 1.96.
+ */
+static double
+t_critical(double df)
+{
+	static const double table[] = {
+		12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262,
+		2.228, 2.201, 2.179, 2.160, 2.145, 2.131, 2.120, 2.110, 2.101,
+		2.093, 2.086, 2.080, 2.074, 2.069, 2.064, 2.060, 2.056, 2.052,
+		2.048, 2.045, 2.042,
+	};
+
+	if (!(df >= 1)) {
+		return table[0];
+	}
+	if (df <= ARRAY_LEN(table)) {
+		// round down; fewer degrees of freedom is more conservative
+		return table[(size_t)df - 1];
+	}
+	return 1.960 + ((table[ARRAY_LEN(table) - 1] - 1.960) *
+			(ARRAY_LEN(table) / df));
+}
+
+/*
+ * Results from different machines or builds usually aren't comparable. Say
+ * so, but compare anyway.
+ */
+static void
+warn_env_mismatch(const json_value_t *base, const json_value_t *new)
+{
+	static const char *const keys[] = {
+		"machine", "cpus", "host", "compiler", "sqlite_version",
+	};
+
+	for (size_t i = 0; i < ARRAY_LEN(keys); ++i) {
+		const json_value_t *b = json_get(base, keys[i]);
+		const json_value_t *n = json_get(new, keys[i]);
+		if (!b || !n || (b->kind != n->kind)) {
+			continue;
+		}
+		if (((b->kind == json_string) && strcmp(b->string, n->string)) ||
+				((b->kind == json_number) && (b->number != n->number))) {
+			printf("warning: results differ in env.%s\n", keys[i]);
+		}
+	}
+}
+
+/*
+ * Parse one JSON value starting at `*p` and advance `*p` past it.
+ */
+static int
+json_parse(const char **p, const char *end, json_value_t *out)
+{
+	memset(out, 0, sizeof(*out));
+	json_skip_space(p, end);
+	if (*p == end) {
+		return EINVAL;
+	}
+
+	switch (**p) {
+		case '{':
+			return json_parse_container(p, end, true, out);
+		case '[':
+			return json_parse_container(p, end, false, out);
+		case '"':
+			out->kind = json_string;
+			return json_parse_string(p, end, &out->string, &out->len);
+		default:
+			break;
+	}
+
+	static const struct {
+		const char *word;
+		int kind;
+		double number;
+	} words[] = {
+		{"null", json_null, 0},
+		{"true", json_bool, 1},
+		{"false", json_bool, 0},
+	};
+	for (size_t i = 0; i < ARRAY_LEN(words); ++i) {
+		const size_t len = strlen(words[i].word);
+		if (((size_t)(end - *p) >= len) && !memcmp(*p, words[i].word, len)) {
+			out->kind = words[i].kind;
+			out->number = words[i].number;
+			*p += len;
+			return 0;
+		}
+	}
+
+	// strtod(3) needs a NUL-terminated copy
+	char num[64];
+	size_t len = 0;
+	while ((*p + len < end) && (len < sizeof(num) - 1) &&
+			strchr("+-.0123456789eE", (*p)[len])) {
+		num[len] = (*p)[len];
+		++len;
+	}
+	num[len] = '\0';
+
+	char *num_end;
+	out->kind = json_number;
+	out->number = strtod(num, &num_end);
+	if (!len || (num_end != num + len)) {
+		return EINVAL;
+	}
+	*p += len;
+	return 0;
+}
+
+/*
+ * Parse a JSON string into a new NUL-terminated buffer.
+ *
+ * `\u` escapes outside of ASCII are replaced with '?'; nothing in the schema
+ * needs them.
+ */
+static int
+json_parse_string(const char **p, const char *end, char **out,
+		size_t *len_out)
+{
+	const char *s = *p + 1;
+
+	// the unescaped string is never longer than the escaped one
+	char *buf = cf_malloc((size_t)(end - s) + 1);
+	if (!buf) {
+		return ENOMEM;
+	}
+
+	size_t len = 0;
+	while ((s < end) && (*s != '"')) {
+		if (*s != '\\') {
+			buf[len++] = *s++;
+			continue;
+		}
+		if (++s == end) {
+			break;
+		}
+		switch (*s) {
+			case 'n':
+				buf[len++] = '\n';
+				break;
+			case 't':
+				buf[len++] = '\t';
+				break;
+			case 'r':
+				buf[len++] = '\r';
+				break;
+			case 'b':
+				buf[len++] = '\b';
+				break;
+			case 'f':
+				buf[len++] = '\f';
+				break;
+			case 'u': {
+				unsigned code = 0;
+				for (int i = 0; i < 4; ++i) {
+					if ((++s == end) || !isxdigit((unsigned char)*s)) {
+						cf_free(buf);
+						return EINVAL;
+					}
+					code = (code * 16) + (unsigned)(isdigit(*s) ?
+							(*s - '0') : ((tolower(*s) - 'a') + 10));
+				}
+				buf[len++] = (code < 0x80) ? (char)code : '?';
+				break;
+			}
+			default:
+				// '"', '\\', '/'
+				buf[len++] = *s;
+				break;
+		}
+		++s;
+	}
+
+	if (s == end) {
+		cf_free(buf);
+		return EINVAL;
+	}
+
+	buf[len] = '\0';
+	*out = buf;
+	*len_out = len;
+	*p = s + 1;
+	return 0;
+}
+
+/*
+ * Parse a JSON object (`object` is true) or array into `out`.
+ */
+static int
+json_parse_container(const char **p, const char *end, bool object,
+		json_value_t *out)
+{
+	int error = 0;
+	const char close = object ? '}' : ']';
+	size_t capacity = 0;
+
+	out->kind = object ? json_object : json_array;
+	++*p;
+
+	json_skip_space(p, end);
+	if ((*p < end) && (**p == close)) {
+		++*p;
+		return 0;
+	}
+
+	for (;;) {
+		if (out->len == capacity) {
+			capacity = capacity ? (capacity * 2) : 8;
+			json_value_t *items = cf_realloc(out->items,
+					capacity * sizeof(*items));
+			if (!items) {
+				error = ENOMEM;
+				goto fail;
+			}
+			out->items = items;
+			if (object) {
+				char **keys = cf_realloc(out->keys, capacity * sizeof(*keys));
+				if (!keys) {
+					error = ENOMEM;
+					goto fail;
+				}
+				out->keys = keys;
+			}
+		}
+
+		if (object) {
+			size_t key_len;
+			json_skip_space(p, end);
+			if ((*p == end) || (**p != '"')) {
+				error = EINVAL;
+				goto fail;
+			}
+			if ((error = json_parse_string(p, end, &out->keys[out->len],
+					&key_len))) {
+				goto fail;
+			}
+			json_skip_space(p, end);
+			if ((*p == end) || (**p != ':')) {
+				cf_free(out->keys[out->len]);
+				error = EINVAL;
+				goto fail;
+			}
+			++*p;
+		}
+
+		if ((error = json_parse(p, end, &out->items[out->len]))) {
+			if (object) {
+				cf_free(out->keys[out->len]);
+			}
+			json_free(&out->items[out->len]);
+			goto fail;
+		}
+		++out->len;
+
+		json_skip_space(p, end);
+		if (*p == end) {
+			error = EINVAL;
+			goto fail;
+		}
+		if (**p == ',') {
+			++*p;
+			continue;
+		}
+		if (**p == close) {
+			++*p;
+			return 0;
+		}
+		error = EINVAL;
+		goto fail;
+	}
+
+fail:
+	json_free(out);
+	return error;
+}
+
+static void
+json_skip_space(const char **p, const char *end)
+{
+	while ((*p < end) && isspace((unsigned char)**p)) {
+		++*p;
+	}
+}
+
+static void
+json_free(json_value_t *value)
+{
+	if ((value->kind == json_array) || (value->kind == json_object)) {
+		for (size_t i = 0; i < value->len; ++i) {
+			if (value->keys) {
+				cf_free(value->keys[i]);
+			}
+			json_free(&value->items[i]);
+		}
+	}
+	cf_free(value->keys);
+	cf_free(value->items);
+	cf_free(value->string);
+	memset(value, 0, sizeof(*value));
+}
+
+static double
+now_secs(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + (ts.tv_nsec / 1e9);
+}
+
+static int
+compare_doubles(const void *lhs, const void *rhs)
+{
+	const double l = *(const double *)lhs;
+	const double r = *(const double *)rhs;
+	return (l > r) - (l < r);
+}
@@ -0,0 +1,346 @@
+/*
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ * Copyright (C) 2024 cfind developer
+ *
+ * main()-containing file for the compiler wrapper.
+ *
+ * `cfind-cc` is used in place of the compiler in a build, e.g.,
+ *   $ make CC="cfind-cc clang"
+ * It runs the real compiler with the same arguments. When the compiler
+ * succeeds at compiling one ".c" file to an object file, the same TU is then
+ * indexed with the same arguments. The result is an index fragment, a small
+ * cfind database at "<object>.cfind". `cfind-index -m` merges fragments into a
+ * single database after the build.
+ *
+ * Indexing never fails the build. The exit status is always the compiler's.
+ *
+ * Environment variables:
+ * - CFIND_CC_LOG
+ *   See redirect_log().
+ * - CFIND_CC_SNIPPETS
+ *   If set, fragments also store source line snippets (`cfind-index -S`).
+ * - CFIND_CC_USE_COUNTS
+ *   If set, fragments store aggregated type use counts, keeping this many
+ *   sample locations of each (`cfind-index -U`).
+ * - CFIND_CC_TU_THREADS
+ *   If set, a TU with many top-level structs is traversed on up to this many
+ *   threads (`cfind-index -T`).
+ */
+#define _POSIX_C_SOURCE 200809L
+#include "cf_index.h"
+#include "cf_print.h"
+#include "main_support.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <paths.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sysexits.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+/*
+ * What the wrapped compiler command does.
+ *
+ * Members
+ * - compile_only
+ *   `-c` was passed.
+ * - other_output
+ *   Something other than an object file is made (e.g., `-E`, `-S`).
+ * - num_sources
+ *   Number of ".c" inputs.
+ * - source
+ *   The last ".c" input.
+ * - output
+ *   Argument to `-o`, if any.
+ */
+typedef struct {
+	bool compile_only;
+	bool other_output;
+	unsigned num_sources;
+	const char *source;
+	const char *output;
+} compile_cmd_t;
+
+static int run_compiler(char **argv);
+static void parse_compile_cmd(int argc, char **argv, compile_cmd_t *out);
+static bool takes_separate_arg(const char *arg);
+static bool is_c_source(const char *arg);
+static int make_fragment_path(const compile_cmd_t *cmd, char *buf,
+		size_t len);
+static void remove_fragment(const char *path);
+static void redirect_log(void);
+static int index_fragment(int argc, char **argv, const compile_cmd_t *cmd,
+		const char *path);
+
+// suffix appended to an object file path to name its index fragment
+#define FRAGMENT_SUFFIX ".cfind"
+
+static void
+print_usage(void)
+{
+	printf("Usage: cfind-cc compiler [compiler-argument]...\n");
+}
+
+int
+main(int argc, char **argv)
+{
+	int error;
+
+	if ((error = cf_setup_stdio())) {
+		return error;
+	}
+
+	if (argc < 2) {
+		print_usage();
+		return EX_USAGE;
+	}
+
+	compile_cmd_t cmd;
+	char path[PATH_MAX];
+	parse_compile_cmd(argc - 1, &argv[1], &cmd);
+	const bool indexable = cmd.compile_only && !cmd.other_output &&
+			(cmd.num_sources == 1) &&
+			!make_fragment_path(&cmd, path, sizeof(path));
+
+	// the build only cares about this
+	const int status = run_compiler(&argv[1]);
+
+	if (!indexable) {
+		// linking, preprocessing, etc.; nothing to index
+		return status;
+	}
+
+	// a fragment from a previous build is stale either way
+	remove_fragment(path);
+	if (status) {
+		return status;
+	}
+
+	redirect_log();
+	(void)index_fragment(argc - 1, &argv[1], &cmd, path);
+	return 0;
+}
+
+/*
+ * Run compiler command `argv` and wait for it.
+ *
+ * Return its exit status, or a sysexits value if it couldn't run.
+ */
+static int
+run_compiler(char **argv)
+{
+	// don't duplicate buffered output in the child
+	fflush(stdout);
+
+	const pid_t pid = fork();
+	if (pid == -1) {
+		fprintf(stderr, "cfind-cc: cannot fork, error %d\n", errno);
+		return EX_OSERR;
+	}
+	if (!pid) {
+		execvp(argv[0], argv);
+		fprintf(stderr, "cfind-cc: cannot run '%s', error %d\n",
+				argv[0], errno);
+		_exit(EX_UNAVAILABLE);
+	}
+
+	int wstatus;
+	while (waitpid(pid, &wstatus, 0) == -1) {
+		if (errno != EINTR) {
+			return EX_OSERR;
+		}
+	}
+
+	if (WIFEXITED(wstatus)) {
+		return WEXITSTATUS(wstatus);
+	}
+	// killed by a signal; report it like a shell
+	return 128 + WTERMSIG(wstatus);
+}
+
+/*
+ * Pick out what matters for indexing from compiler command `argv`.
+ *
+ * `argv[0]` is the compiler. This only understands the common gcc/clang
+ * driver options; anything unusual just means no fragment is made.
+ */
+static void
+parse_compile_cmd(int argc, char **argv, compile_cmd_t *out)
+{
+	memset(out, 0, sizeof(*out));
+
+	for (int i = 1; i < argc; ++i) {
+		const char *arg = argv[i];
+
+		if (!strcmp(arg, "-c")) {
+			out->compile_only = true;
+		} else if (!strcmp(arg, "-E") || !strcmp(arg, "-S") ||
+				!strcmp(arg, "-M") || !strcmp(arg, "-MM") ||
+				!strcmp(arg, "-fsyntax-only")) {
+			out->other_output = true;
+		} else if (!strcmp(arg, "-o")) {
+			if (i + 1 < argc) {
+				out->output = argv[++i];
+			}
+		} else if (!strncmp(arg, "-o", 2)) {
+			out->output = arg + 2;
+		} else if (takes_separate_arg(arg)) {
+			// skip the option's argument; it's not an input
+			++i;
+		} else if (is_c_source(arg)) {
+			out->source = arg;
+			++out->num_sources;
+		}
+	}
+}
+
+/*
+ * Whether driver option `arg` is followed by a separate argument, e.g.,
+ * "-MF" in `-MF foo.d`.
+ */
+static bool
+takes_separate_arg(const char *arg)
+{
+	static const char *const options[] = {
+		"-MF", "-MT", "-MQ",
+		"-I", "-D", "-U", "-x",
+		"-include", "-imacros", "-isystem", "-iquote", "-idirafter",
+		"-iprefix", "-isysroot", "-target", "-arch", "--param",
+		"-Xclang", "-Xpreprocessor", "-Xassembler", "-Xlinker",
+	};
+
+	for (size_t i = 0; i < ARRAY_LEN(options); ++i) {
+		if (!strcmp(arg, options[i])) {
+			return true;
+		}
+	}
+	return false;
+}
+
+static bool
+is_c_source(const char *arg)
+{
+	const size_t len = strlen(arg);
+	return (arg[0] != '-') && (len > 2) && !strcmp(&arg[len - 2], ".c");
+}
+
+/*
+ * Write the fragment path for `cmd` to `buf`.
+ *
+ * Without `-o`, compilers write "foo.o" to the current directory for source
+ * ".../foo.c".
+ */
+static int
+make_fragment_path(const compile_cmd_t *cmd, char *buf, size_t len)
+{
+	int n;
+
+	if (cmd->output) {
+		n = snprintf(buf, len, "%s" FRAGMENT_SUFFIX, cmd->output);
+	} else {
+		const char *base = strrchr(cmd->source, '/');
+		base = base ? (base + 1) : cmd->source;
+		n = snprintf(buf, len, "%.*so" FRAGMENT_SUFFIX,
+				(int)(strlen(base) - 1), base);
+	}
+
+	if ((n < 0) || ((size_t)n >= len)) {
+		return ENAMETOOLONG;
+	}
+	return 0;
+}
+
+/*
+ * Delete a fragment from a previous build, along with the sqlite WAL files
+ * next to it.
+ */
+static void
+remove_fragment(const char *path)
+{
+	char buf[PATH_MAX];
+
+	(void)unlink(path);
+	if (snprintf(buf, sizeof(buf), "%s-wal", path) < (int)sizeof(buf)) {
+		(void)unlink(buf);
+	}
+	if (snprintf(buf, sizeof(buf), "%s-shm", path) < (int)sizeof(buf)) {
+		(void)unlink(buf);
+	}
+}
+
+/*
+ * Keep indexer logging out of the build's output.
+ *
+ * Logs are appended to the file named by environment variable `CFIND_CC_LOG`,
+ * or discarded.
+ */
+static void
+redirect_log(void)
+{
+	const char *log = getenv("CFIND_CC_LOG");
+
+	fflush(stdout);
+	int fd = open(log ? log : _PATH_DEVNULL,
+			O_WRONLY | O_APPEND | O_CREAT, 0644);
+	if (fd == -1) {
+		fd = open(_PATH_DEVNULL, O_WRONLY);
+	}
+	if (fd == -1) {
+		// leave stdout as-is
+		return;
+	}
+	(void)dup2(fd, STDOUT_FILENO);
+	close(fd);
+}
+
+/*
+ * Index the TU of compiler command `argv` into a new fragment at `path`.
+ *
+ * A failed index leaves nothing behind to be merged.
+ */
+static int
+index_fragment(int argc, char **argv, const compile_cmd_t *cmd,
+		const char *path)
+{
+	int error;
+
+	const char *const inputs[] = {
+		cmd->source,
+	};
+	// a malformed count keeps no samples
+	const char *const use_counts = getenv("CFIND_CC_USE_COUNTS");
+	// or doesn't split TUs
+	const char *const tu_threads = getenv("CFIND_CC_TU_THREADS");
+	const index_config_t config = {
+		.db_kind = index_db_sql,
+		.db_args = {
+			.sql_path = path,
+		},
+		.input_kind = input_command,
+		.input_paths = inputs,
+		.num_inputs = ARRAY_LEN(inputs),
+		.command_argv = (const char *const *)argv,
+		.command_argc = (unsigned)argc,
+		.snippets = (getenv("CFIND_CC_SNIPPETS") != NULL),
+		.count_uses = (use_counts != NULL),
+		.use_samples = use_counts ?
+				(size_t)strtoull(use_counts, NULL, 10) : 0,
+		.tu_threads = tu_threads ?
+				(size_t)strtoull(tu_threads, NULL, 10) : 0,
+		.wal = {
+			.close_truncate = true,
+		},
+	};
+
+	if ((error = cf_index_project(&config))) {
+		fprintf(stderr, "cfind-cc: cannot index '%s', error %d\n",
+				cmd->source, error);
+		remove_fragment(path);
+	}
+	return error;
+}
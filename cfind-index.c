@@ -7,6 +7,7 @@
  * The goal is to produce an index (a search database) from a bunch of C source
  * files.
  */
+#define _POSIX_C_SOURCE 200809L // for strtok_r(3)
 #include "cf_index.h"
 #include "cf_print.h"
 #include "main_support.h"
@@ -29,6 +30,9 @@ typedef struct {
 
 static void print_usage(void);
 static void print_help(void);
+static int parse_wal_policy(const char *arg, wal_policy_t *out);
+static int parse_cache_budget(const char *arg, size_t *out);
+static int parse_count(const char *arg, size_t *out);
 
 static const struct option cfind_index_options[] = {
 	{"help", no_argument, NULL, 'h'},
@@ -37,14 +41,26 @@ static const struct option cfind_index_options[] = {
 	{"dir", no_argument, NULL, 'd'},
 	{"out", required_argument, NULL, 'o'},
 	{"dry-run", no_argument, NULL, 'n'},
+	{"git", required_argument, NULL, 'g'},
+	{"approx", no_argument, NULL, 'a'},
+	{"wal", required_argument, NULL, 'w'},
+	{"merge", no_argument, NULL, 'm'},
+	{"snippets", no_argument, NULL, 'S'},
+	{"cache-budget", required_argument, NULL, 'M'},
+	{"log", required_argument, NULL, 'l'},
+	{"compact", no_argument, NULL, 'C'},
+	{"use-counts", required_argument, NULL, 'U'},
+	{"tu-threads", required_argument, NULL, 'T'},
 	{NULL, 0, NULL, 0},
 };
 
 static void
 print_usage(void)
 {
-	printf("Usage: cfind-index [OPTION]... [-s] source-file\n" \
-			"   or: cfind-index [OPTION]... -d build-directory\n");
+	printf("Usage: cfind-index [OPTION]... [-s] source-file...\n" \
+			"   or: cfind-index [OPTION]... -d build-directory...\n" \
+			"   or: cfind-index [OPTION]... -m fragment...\n" \
+			"   or: cfind-index [OPTION]... -C log-directory...\n");
 }
 
 static void
@@ -59,8 +75,41 @@ print_help(void)
 			"   -s, --src       input path is a single `.c' file (default)\n" \
 			"   -d, --dir       input path is the parent directory of a \n" \
 			"                   compilation database\n" \
+			"                   (several inputs are indexed into one\n" \
+			"                   database, sharing work on common files)\n" \
 			"   -o, --out       path to sqlite database to create\n" \
-			"   -n, --dry-run   input file is a single `.c' file\n"
+			"   -n, --dry-run   input file is a single `.c' file\n" \
+			"   -g, --git       path to a git working tree; update the\n" \
+			"                   database from `-o' in place, reindexing\n" \
+			"                   only TUs affected by changed files\n" \
+			"   -a, --approx    index quickly by parsing each file without\n" \
+			"                   its #includes; a later run without `-a'\n" \
+			"                   replaces the approximate entries\n" \
+			"   -w, --wal       comma-separated WAL checkpoint policy:\n" \
+			"                   `tu' checkpoint between TUs\n" \
+			"                   `close' truncate the WAL on exit\n" \
+			"                   `cap=MB' truncate the WAL once it's\n" \
+			"                   bigger than MB megabytes\n" \
+			"   -m, --merge     input paths are index fragments written\n" \
+			"                   by cfind-cc; merge them into `-o'\n" \
+			"   -S, --snippets  also store the source line of each entry\n" \
+			"                   so `cfind --context' can print it\n" \
+			"   -M, --cache-budget=MB\n" \
+			"                   spend at most about MB megabytes on\n" \
+			"                   caching files and types between TUs\n" \
+			"                   (default unbounded)\n" \
+			"   -l, --log       path to a log directory to create instead\n" \
+			"                   of a sqlite database; faster to write,\n" \
+			"                   but it must be compacted with `-C'\n" \
+			"   -C, --compact   input paths are logs written with `-l';\n" \
+			"                   compact them into `-o'\n" \
+			"   -U, --use-counts=N\n" \
+			"                   store the number of uses of each type\n" \
+			"                   per file instead of every use, keeping\n" \
+			"                   N sample locations of each\n" \
+			"   -T, --tu-threads=N\n" \
+			"                   traverse a TU with many top-level\n" \
+			"                   structs on up to N threads\n"
 			);
 }
 
@@ -83,8 +132,8 @@ static int
 parse_one_arg(int argc, char **argv, cfind_index_args_t *out)
 {
 	int option_index;
-	int c = getopt_long(argc, argv, "hVsdo:n", cfind_index_options,
-			&option_index);
+	int c = getopt_long(argc, argv, "hVsdo:ng:aw:mSM:l:CU:T:",
+			cfind_index_options, &option_index);
 	if (c == -1) {
 		return 1;
 	}
@@ -110,6 +159,50 @@ parse_one_arg(int argc, char **argv, cfind_index_args_t *out)
 			out->config.db_args.sql_path = NULL;
 			out->config.db_kind = index_db_nop;
 			break;
+		case 'g':
+			out->config.vcs_path = optarg;
+			break;
+		case 'a':
+			out->config.approx = true;
+			break;
+		case 'm':
+			out->config.input_kind = input_fragment;
+			break;
+		case 'l':
+			out->config.db_args.log_path = optarg;
+			out->config.db_kind = index_db_log;
+			break;
+		case 'C':
+			out->config.input_kind = input_log;
+			break;
+		case 'U':
+			if (parse_count(optarg, &out->config.use_samples)) {
+				printf("bad number of use samples '%s'\n", optarg);
+				return EX_USAGE;
+			}
+			out->config.count_uses = true;
+			break;
+		case 'T':
+			if (parse_count(optarg, &out->config.tu_threads)) {
+				printf("bad number of TU threads '%s'\n", optarg);
+				return EX_USAGE;
+			}
+			break;
+		case 'S':
+			out->config.snippets = true;
+			break;
+		case 'w':
+			if (parse_wal_policy(optarg, &out->config.wal)) {
+				printf("bad WAL policy '%s'\n", optarg);
+				return EX_USAGE;
+			}
+			break;
+		case 'M':
+			if (parse_cache_budget(optarg, &out->config.cache_budget)) {
+				printf("bad cache budget '%s'\n", optarg);
+				return EX_USAGE;
+			}
+			break;
 		default:
 		case '?':
 			return EX_USAGE;
@@ -117,6 +210,79 @@ parse_one_arg(int argc, char **argv, cfind_index_args_t *out)
 	return 0;
 }
 
+/*
+ * Parse a `--wal` argument like "tu,close,cap=256" into `out`.
+ */
+static int
+parse_wal_policy(const char *arg, wal_policy_t *out)
+{
+	int error = 0;
+	char *saveptr;
+
+	char *const buf = strdup(arg);
+	if (!buf) {
+		return ENOMEM;
+	}
+
+	for (char *tok = strtok_r(buf, ",", &saveptr); tok;
+			tok = strtok_r(NULL, ",", &saveptr)) {
+		if (!strcmp(tok, "tu")) {
+			out->tu_checkpoint = true;
+		} else if (!strcmp(tok, "close")) {
+			out->close_truncate = true;
+		} else if (!strncmp(tok, "cap=", 4)) {
+			char *end;
+			errno = 0;
+			const unsigned long long mb = strtoull(tok + 4, &end, 10);
+			if (errno || (end == tok + 4) || *end || !mb ||
+					(mb > (UINT64_MAX >> 20))) {
+				error = EINVAL;
+				break;
+			}
+			out->size_cap = (uint64_t)mb << 20;
+		} else {
+			error = EINVAL;
+			break;
+		}
+	}
+
+	free(buf);
+	return error;
+}
+
+/*
+ * Parse a `--cache-budget` argument, a positive number of megabytes, into
+ * bytes.
+ */
+static int
+parse_cache_budget(const char *arg, size_t *out)
+{
+	char *end;
+	errno = 0;
+	const unsigned long long mb = strtoull(arg, &end, 10);
+	if (errno || (end == arg) || *end || !mb || (mb > (SIZE_MAX >> 20))) {
+		return EINVAL;
+	}
+	*out = (size_t)mb << 20;
+	return 0;
+}
+
+/*
+ * Parse a `--use-counts` or `--tu-threads` argument, a number that may be 0.
+ */
+static int
+parse_count(const char *arg, size_t *out)
+{
+	char *end;
+	errno = 0;
+	const unsigned long long samples = strtoull(arg, &end, 10);
+	if (errno || (end == arg) || *end || (samples > SIZE_MAX)) {
+		return EINVAL;
+	}
+	*out = (size_t)samples;
+	return 0;
+}
+
 /*
  * Default CLI arguments.
  *
@@ -154,13 +320,24 @@ parse_args(int argc, char **argv, cfind_index_args_t *out)
 		return 0;
 	}
 
-	// last argument is always input path
+	// a log keeps neither approximate tags, use counts, nor anything to
+	// update in place
+	if ((out->config.db_kind == index_db_log) &&
+			(out->config.approx || out->config.vcs_path ||
+			out->config.count_uses ||
+			(out->config.input_kind == input_log))) {
+		printf("`-l' cannot be used with `-a', `-g', `-U', or `-C'\n");
+		return EX_USAGE;
+	}
+
+	// remaining arguments are always input paths
 	if (optind >= argc) {
 		printf("missing input file\n");
 		return EX_USAGE;
 	}
 
-	out->config.input_path = argv[optind++];
+	out->config.input_paths = (const char *const *)&argv[optind];
+	out->config.num_inputs = (size_t)(argc - optind);
 	return 0;
 }
 
@@ -192,10 +369,12 @@ main(int argc, char **argv)
 		return 0;
 	}
 
-	cf_print_info("index %s('%s')\n",
-			((args.config.input_kind == input_comp_db) ?
-					"index_project" : "index_source"),
-			args.config.input_path);
+	cf_print_info("index %s('%s'), %zu inputs\n",
+			((args.config.input_kind == input_comp_db) ? "index_project" :
+			(args.config.input_kind == input_fragment) ? "merge" :
+			(args.config.input_kind == input_log) ? "compact" :
+					"index_source"),
+			args.config.input_paths[0], args.config.num_inputs);
 	// call into indexer
 	if ((error = cf_index_project(&args.config))) {
 		return EX_DATAERR;
@@ -25,6 +25,7 @@
 typedef struct {
 	char *db_path;
 	cf_str_t cmd_str;
+	search_opts_t opts;
 	bool help;
 	bool version;
 	bool cmd;
@@ -35,6 +36,9 @@ static const struct option cfind_options[] = {
 	{"version", no_argument, NULL, 'V'},
 	{"interactive", no_argument, NULL, 'i'},
 	{"command", required_argument, NULL, 'c'},
+	{"scan", no_argument, NULL, 's'},
+	{"context", no_argument, NULL, 'C'},
+	{"log", required_argument, NULL, 'L'},
 	{NULL, 0, NULL, 0},
 };
 
@@ -55,7 +59,17 @@ print_help(void)
 			"   -h, --help            print this\n" \
 			"   --version             display version\n" \
 			"   -i, --interactive     interactive mode (default)\n" \
-			"   -c, -cmd <command>    execute a single command\n"
+			"   -c, -cmd <command>    execute a single command\n" \
+			"   -s, --scan            load the database into memory and\n" \
+			"                         scan it for typename and member\n" \
+			"                         searches; faster for wildcards\n" \
+			"   -C, --context         print the source line of each\n" \
+			"                         result, if the database has it\n" \
+			"   -L, --log <file>      append the command, its latency and\n" \
+			"                         result count to a query log for\n" \
+			"                         `cfind-bench replay'\n" \
+			"ENVIRONMENT:\n" \
+			"   CFIND_QUERY_LOG       query log used when `-L' isn't given\n"
 			);
 }
 
@@ -78,7 +92,7 @@ static int
 parse_one_arg(int argc, char **argv, cfind_args_t *out)
 {
 	int option_index;
-	int c = getopt_long(argc, argv, "hVic:", cfind_options, &option_index);
+	int c = getopt_long(argc, argv, "hVic:sCL:", cfind_options, &option_index);
 	if (c == -1) {
 		return 1;
 	}
@@ -97,6 +111,15 @@ parse_one_arg(int argc, char **argv, cfind_args_t *out)
 		case 'i':
 			out->cmd = false;
 			break;
+		case 's':
+			out->opts.scan = true;
+			break;
+		case 'C':
+			out->opts.context = true;
+			break;
+		case 'L':
+			out->opts.log_path = optarg;
+			break;
 		default:
 		case '?':
 			return EX_USAGE;
@@ -110,6 +133,9 @@ parse_args(int argc, char **argv, cfind_args_t *out)
 	int error;
 	memset(out, 0, sizeof(*out));
 
+	// `-L` overrides this
+	out->opts.log_path = getenv("CFIND_QUERY_LOG");
+
 	while (!(error = parse_one_arg(argc, argv, out))) {
 	}
 	if (error != 1) {
@@ -161,5 +187,5 @@ main(int argc, char **argv)
 		return EX_UNAVAILABLE;
 	}
 
-	return run_one_command(args.db_path, &args.cmd_str);
+	return run_one_command(args.db_path, &args.cmd_str, &args.opts);
 }
@@ -180,6 +180,17 @@ typedef struct {
 	cf_str_t name;
 } db_typename_t;
 
+/*
+ * Key of one typename in a batch lookup.
+ *
+ * Matches the same bits as a single typename lookup: `loc->scope`,
+ * `loc->func`, `loc->file`, `name->name`, and `name->kind`.
+ */
+typedef struct {
+	const loc_ctx_t *loc;
+	const db_typename_t *name;
+} db_typename_key_t;
+
 /*
  * Variable decl.
  *
@@ -311,6 +322,118 @@ typedef struct {
 	type_use_kind_t kind;
 } db_type_use_t;
 
+/*
+ * Number of uses of a type within a file, in place of a `db_type_use_t` per
+ * use.
+ *
+ * Members
+ * - base_type, kind
+ *   Same as `db_type_use_t`.
+ * - file
+ *   File containing the uses.
+ * - count
+ *   Number of uses.
+ */
+typedef struct {
+	type_ref_t base_type;
+	file_ref_t file;
+	type_use_kind_t kind;
+	uint64_t count;
+} db_type_use_count_t;
+
+CF_VEC_TYPE_DECL(use_count_vec_t, db_type_use_count_t);
+
+/*
+ * Source line of an indexed entry.
+ *
+ * Members
+ * - line
+ *   Line number in the file, starting at 1.
+ * - text
+ *   Content of the line. Leading and trailing whitespace is removed, and long
+ *   lines are cut at `DB_SNIPPET_MAX_LEN` bytes.
+ */
+typedef struct {
+	uint32_t line;
+	cf_str_t text;
+} db_snippet_t;
+
+// longest line stored by the indexer
+#define DB_SNIPPET_MAX_LEN 240
+
+/*
+ * Order in which a find query returns its results.
+ *
+ * Enumerators
+ * - db_order_none
+ *   Whatever order the database finds cheapest. In practice, insertion
+ *   order.
+ * - db_order_name
+ *   Sorted by name.
+ * - db_order_file
+ *   Sorted by file path, then line.
+ */
+typedef enum {
+	db_order_none = 0,
+	db_order_name = 1,
+	db_order_file = 2,
+} db_order_t;
+
+/*
+ * Constants for `db_filter_t::scope`.
+ *
+ * - db_scope_any
+ *   Names at any scope.
+ * - db_scope_global
+ *   Only names at file scope (`scope_global`).
+ * - db_scope_local
+ *   Only names declared inside a function, at any depth.
+ */
+typedef enum {
+	db_scope_any = 0,
+	db_scope_global = 1,
+	db_scope_local = 2,
+} db_scope_filter_t;
+
+/*
+ * Constraints on the results of a find/lookup query.
+ *
+ * Every member is optional. The zero value of each member matches anything,
+ * so a zero-initialized filter is the same as no filter at all.
+ *
+ * Members
+ * - type_kind
+ *   Only match names of this kind of type (struct, union, enum). 0 for any.
+ * - name_kind
+ *   Only match this kind of typename (direct, typedef, var). 0 for any.
+ * - file_glob
+ *   Only match entries declared in a file whose path matches this glob(7)
+ *   pattern. Paths in the database are absolute, so the pattern is also
+ *   tried against every suffix of the path that follows a '/'. E.g.,
+ *   "drivers/net/tun*" matches "/src/linux/drivers/net/tun.c". A null string
+ *   matches any file.
+ * - limit
+ *   Stop after this many results. 0 for no limit.
+ * - order
+ *   Result order.
+ * - after
+ *   Keyset cursor. Only return results that come after this one in `order`.
+ *   It's the cursor of the last result of the previous page, as returned by
+ *   db_typename_iter_cursor(). 0 to start from the first result.
+ * - scope
+ *   Only match typenames declared at this kind of scope. Ignored by member
+ *   searches.
+ */
+typedef struct {
+	type_kind_t type_kind;
+	typename_kind_t name_kind;
+	cf_str_t file_glob;
+	uint32_t limit;
+	db_order_t order;
+	int64_t after;
+	db_scope_filter_t scope;
+} db_filter_t;
+
 const char *db_type_kind_str(type_kind_t kind);
 const char *db_member_access_str(member_access_kind_t kind);
 const char *db_type_use_str(type_use_kind_t kind);
@@ -8,6 +8,7 @@
 #include "cf_map.h"
 #include "cf_vector.h"
 #include "db_types.h"
+#include "vcs.h"
 
 #include <stdbool.h>
 #include <stdint.h>
@@ -86,9 +87,37 @@ typedef struct {
 	loc_ctx_t loc;
 } type_use_pkg_t;
 
+/*
+ * Glued together database entries for a typedef, staged behind the structs
+ * before it. See `index_ctx_t::staged_typedefs`.
+ *
+ * Members
+ * - type
+ *   Canonical `clang::Type*` the typedef names.
+ * - name
+ *   The typedef. Its base type is filled in when it's committed.
+ * - loc
+ *   Source location of the typedef.
+ */
+typedef struct {
+	clang_type_t type;
+	db_typename_t name;
+	loc_ctx_t loc;
+} typedef_pkg_t;
+
+/*
+ * A source line to store as a snippet. See `index_ctx_t::snippet_keys`.
+ */
+typedef struct {
+	int64_t file;
+	uint32_t line;
+} snippet_key_t;
+
 CF_VEC_TYPE_DECL(struct_vec_t, struct_pkg_t);
 CF_VEC_TYPE_DECL(memberpkg_vec_t, member_pkg_t);
 CF_VEC_TYPE_DECL(typeusepkg_vec_t, type_use_pkg_t);
+CF_VEC_TYPE_DECL(typedefpkg_vec_t, typedef_pkg_t);
+CF_VEC_TYPE_DECL(snippet_key_vec_t, snippet_key_t);
 
 /*
  * State built up while traversing a struct/union/enum.
@@ -123,6 +152,51 @@ typedef struct {
 	cf_map8_t unnamed_types;
 } struct_scoreboard_t;
 
+/*
+ * A top-level struct/union/enum of a split TU. See index_tu().
+ *
+ * Members
+ * - cursor
+ *   The struct's decl.
+ * - sb
+ *   Entries staged for `cursor` by a split thread. Swapped into
+ *   `index_ctx_t::struct_sb` when the walk of the TU reaches `cursor`.
+ * - built
+ *   True if `sb` holds `cursor`'s entries. Structs in alias files aren't
+ *   built ahead of time; index_alias_struct() usually skips them.
+ */
+typedef struct {
+	CXCursor cursor;
+	struct_scoreboard_t sb;
+	bool built;
+} split_unit_t;
+
+/*
+ * Top-level structs of the current TU, traversed on several threads ahead of
+ * the walk of the TU.
+ *
+ * Members
+ * - active
+ *   True if the current TU is split.
+ * - max_threads
+ *   Most threads to traverse with, counting the indexer's own.
+ * - cursors
+ *   Every indexable top-level struct/union/enum of the TU, in AST order.
+ * - next
+ *   Index in `cursors` of the next struct the walk reaches.
+ * - units, base, len
+ *   The window of `len` structs starting at `cursors[base]` built last.
+ */
+typedef struct {
+	bool active;
+	size_t max_threads;
+	cursor_stack_t cursors;
+	size_t next;
+	split_unit_t *units;
+	size_t base;
+	size_t len;
+} tu_split_t;
+
 /*
  * Indexing context.
  *
@@ -156,9 +230,62 @@ typedef struct {
  *   The source location of the current AST node.
  * - struct_sb
  *   State maintained while traversing a struct/union/enum type declaration.
+ * - staged, num_staged, staged_capacity
+ *   Scoreboards of structs that are fully traversed but not yet committed,
+ *   in AST order. They're committed together so that their typenames are
+ *   looked up in one batch. The first `num_staged` of `staged_capacity` are
+ *   in use; the rest are empty.
+ * - staged_typedefs
+ *   Typedefs indexed while structs are staged. The type each names may be one
+ *   of them, so they're committed right after them, also in one batch.
+ * - alias_files
+ *   Set of `CXFile`s in `file_map` whose contents duplicate another file in
+ *   the database. Their rowid in `file_map` is that of the other file.
+ * - in_alias_file
+ *   True if `loc` is in one of `alias_files`.
  * - last_struct
  *   The `clang::Type*` of the last struct indexed. This is only used to assign
  *   names to top-level unnamed structs (i.e., for `typedef struct {} foo_t;`).
+ * - typedef_type
+ *   The canonical `clang::Type*` named by the typedef decl last checked by
+ *   cursor_is_indexable(). Getting it from clang walks the typedef's whole
+ *   sugar chain, so it's done once per typedef.
+ * - use_vcs
+ *   True if `vcs` is initialized.
+ * - vcs
+ *   Version control snapshot of the project being indexed. Only used when
+ *   reindexing an existing database.
+ * - clean_tus
+ *   Set of main file rowids of TUs that are already up to date in `db`. These
+ *   are skipped. It's empty unless `use_vcs` is true.
+ * - file_cache
+ *   Map from a file's `CXFileUniqueID` (hashed) to its database rowid. Unlike
+ *   `file_map`, this outlives a TU, so headers shared by many TUs -- or by
+ *   many compilation databases -- are only added to `db` once. The top bit
+ *   of each value is set if the file is an alias (see `alias_files`).
+ * - type_cache
+ *   Map from a named type's typename key -- (file, func, scope, kind, name),
+ *   hashed -- to a `type_cache_entry_t` with its database rowid and the full
+ *   key, which is compared on each hit. It outlives a TU for the same reason
+ *   as `file_cache` and saves a database lookup for every struct in a shared
+ *   header.
+ *   Both caches share `index_config_t::cache_budget`. An evicted entry is
+ *   looked up in the database again on its next use.
+ * - snippets
+ *   True if the source line of each new entry is stored in the database.
+ * - snippet_keys
+ *   Lines of the current TU to store as snippets. The file contents are read
+ *   from clang once the whole TU is indexed.
+ * - count_uses, use_samples
+ *   Copied from `index_config_t`.
+ * - use_counts
+ *   Type uses of the current TU, aggregated by (type, file, kind). Added to
+ *   the database once the whole TU is indexed.
+ * - use_count_index
+ *   Map from a hash of each key of `use_counts` to 1 + its index.
+ * - split
+ *   Top-level structs traversed ahead of time when a TU is split across
+ *   threads.
  */
 typedef struct {
 	CXIndex clang_index;
@@ -167,10 +294,35 @@ typedef struct {
 	bool db_owned;
 
 	cf_map8_t file_map;
-	cf_map8_t type_map;
+	cf_hmap8_t type_map;
 	ast_path_t path;
 	loc_ctx_t loc;
 	struct_scoreboard_t struct_sb;
+	struct_scoreboard_t *staged;
+	size_t num_staged;
+	size_t staged_capacity;
+	typedefpkg_vec_t staged_typedefs;
+
+	cf_map8_t alias_files;
+	bool in_alias_file;
 
 	clang_type_t last_struct;
+	clang_type_t typedef_type;
+
+	bool use_vcs;
+	vcs_tree_t vcs;
+	cf_map8_t clean_tus;
+
+	cf_cache8_t file_cache;
+	cf_cache8_t type_cache;
+
+	bool snippets;
+	snippet_key_vec_t snippet_keys;
+
+	bool count_uses;
+	size_t use_samples;
+	use_count_vec_t use_counts;
+	cf_hmap8_t use_count_index;
+
+	tu_split_t split;
 } index_ctx_t;
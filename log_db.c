@@ -0,0 +1,918 @@
+/*
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ * Copyright (C) 2024 cfind developer
+ *
+ * Log database implementation. See "log_db.h" for the format.
+ */
+#define _POSIX_C_SOURCE 200809L // for clock_gettime(2)
+#include "log_db.h"
+
+#include "cf_alloc.h"
+#include "cf_assert.h"
+#include "cf_print.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+CF_VEC_FUNC_DECL(log_path_vec_t, log_str_t, log_path_vec);
+CF_VEC_FUNC_DECL(log_key_vec_t, log_key_t, log_key_vec);
+
+// bytes buffered per segment before they're written out
+#define LOG_SEG_BUF_SIZE (1u << 20)
+// longest record payload; has to fit in a segment buffer with its length
+#define LOG_MAX_RECORD (LOG_SEG_BUF_SIZE - sizeof(uint32_t))
+// initial size of `log_db_t::strs`
+#define LOG_MIN_STRS (64u << 10)
+
+/*
+ * Record payloads, one per segment kind. Each is optionally followed by a
+ * string: the path, name, or snippet text. Padding is explicit so records
+ * are written without uninitialized bytes.
+ */
+typedef struct {
+	int64_t file;
+	int64_t func;
+	uint32_t scope;
+	uint32_t line;
+	uint32_t column;
+	uint32_t pad;
+} log_loc_rec_t;
+
+typedef struct {
+	int64_t id;
+} log_file_rec_t;
+
+typedef struct {
+	int64_t id;
+	log_loc_rec_t loc;
+	uint32_t kind;
+	uint32_t complete;
+} log_type_rec_t;
+
+typedef struct {
+	log_loc_rec_t loc;
+	int64_t base_type;
+	uint32_t kind;
+	uint32_t pad;
+} log_typename_rec_t;
+
+typedef struct {
+	log_loc_rec_t loc;
+	int64_t parent;
+	int64_t base_type;
+} log_member_rec_t;
+
+typedef struct {
+	log_loc_rec_t loc;
+	int64_t base_type;
+	uint32_t kind;
+	uint32_t pad;
+} log_type_use_rec_t;
+
+typedef struct {
+	int64_t tu;
+	int64_t dep;
+} log_tu_dep_rec_t;
+
+typedef struct {
+	int64_t file;
+	uint32_t line;
+	uint32_t pad;
+} log_snippet_rec_t;
+
+static const char *const seg_names[LOG_NUM_SEGS] = {
+	[log_seg_files] = "files",
+	[log_seg_types] = "types",
+	[log_seg_typenames] = "typenames",
+	[log_seg_members] = "members",
+	[log_seg_type_uses] = "type_uses",
+	[log_seg_tu_deps] = "tu_deps",
+	[log_seg_snippets] = "snippets",
+};
+
+static int seg_path(const char *dir, log_seg_kind_t kind, char *out,
+		size_t size);
+static int seg_append(log_db_t *db, log_seg_kind_t kind, const void *rec,
+		size_t rec_len, const cf_str_t *str);
+static int seg_flush(log_db_t *db, log_seg_t *seg);
+static int push_str(log_db_t *db, const char *str, size_t len, size_t *off);
+static bool str_eq(const log_db_t *db, const log_str_t *s, const char *str,
+		size_t len);
+static const log_key_t *find_key(const log_db_t *db, const loc_ctx_t *loc,
+		const db_typename_t *name, uint64_t *hash_out);
+static uint64_t hash_key(const loc_ctx_t *loc, const db_typename_t *name);
+static uint64_t hash_path(const char *path, size_t len);
+static log_loc_rec_t loc_rec(const loc_ctx_t *loc);
+static loc_ctx_t rec_loc(const log_loc_rec_t *rec);
+static int reader_fill(log_reader_t *reader, size_t need);
+static int reader_next(log_reader_t *reader, void *rec, size_t rec_len,
+		cf_str_t *str_out);
+static uint64_t get_time_ns(void);
+
+/*
+ * Create a new log in directory `dir`.
+ *
+ * `dir` is created if needed, but it can't already hold a log: ids restart at
+ * 1 in every log, so appending to an old one would mix up its references.
+ *
+ * Steps:
+ * - make the directory
+ * - create each segment, and buffer its header
+ * - make the in-memory indexes
+ */
+int
+log_db_open(const char *dir, log_db_t *out)
+{
+	int error = 0;
+	char path[PATH_MAX];
+	size_t num_created = 0;
+
+	memset(out, 0, sizeof(*out));
+	for (size_t i = 0; i < LOG_NUM_SEGS; ++i) {
+		out->segs[i].fd = -1;
+	}
+
+	if (mkdir(dir, 0777) && (errno != EEXIST)) {
+		error = errno;
+		cf_print_err("cannot make log directory '%s', error %d\n", dir, error);
+		return error;
+	}
+
+	for (; num_created < LOG_NUM_SEGS; ++num_created) {
+		log_seg_t *seg = &out->segs[num_created];
+		if ((error = seg_path(dir, num_created, path, sizeof(path)))) {
+			goto fail;
+		}
+		seg->fd = open(path, O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+		if (seg->fd == -1) {
+			error = errno;
+			cf_print_err("cannot create log segment '%s', error %d\n",
+					path, error);
+			goto fail;
+		}
+		if (!(seg->buf = cf_malloc(LOG_SEG_BUF_SIZE))) {
+			// count this one as created so it's removed
+			++num_created;
+			error = ENOMEM;
+			goto fail;
+		}
+		seg->len = strlen(LOG_SEG_MAGIC);
+		seg->num_bytes = seg->len;
+		memcpy(seg->buf, LOG_SEG_MAGIC, seg->len);
+	}
+
+	log_path_vec_make(&out->paths);
+	log_key_vec_make(&out->keys);
+	cf_hmap8_make(&out->path_index);
+	cf_hmap8_make(&out->key_index);
+	return 0;
+
+fail:
+	// don't leave a partial log behind to block the next attempt
+	for (size_t i = 0; i < num_created; ++i) {
+		if (!seg_path(dir, i, path, sizeof(path))) {
+			(void)unlink(path);
+		}
+	}
+	for (size_t i = 0; i < LOG_NUM_SEGS; ++i) {
+		if (out->segs[i].fd != -1) {
+			close(out->segs[i].fd);
+		}
+		cf_free(out->segs[i].buf);
+	}
+	return error;
+}
+
+/*
+ * Write out everything buffered in `db`, then free it.
+ *
+ * Return the first error hit writing a segment. `db` is freed regardless.
+ */
+int
+log_db_close(log_db_t *db)
+{
+	int error = 0;
+
+	for (size_t i = 0; i < LOG_NUM_SEGS; ++i) {
+		log_seg_t *seg = &db->segs[i];
+		const int seg_error = seg_flush(db, seg);
+		if (seg_error && !error) {
+			error = seg_error;
+		}
+		if (close(seg->fd) && !error) {
+			error = errno;
+		}
+		cf_free(seg->buf);
+
+		cf_print_info("log %s: %llu records, %llu bytes\n", seg_names[i],
+				p_(seg->num_records), p_(seg->num_bytes));
+	}
+	cf_print_info("log: %zu files, %lld types, %llu us writing\n",
+			log_path_vec_len(&db->paths), p_(db->num_types),
+			p_(db->write_ns / 1000));
+
+	cf_hmap8_free(&db->key_index);
+	cf_hmap8_free(&db->path_index);
+	log_key_vec_free(&db->keys);
+	log_path_vec_free(&db->paths);
+	cf_free(db->strs);
+	memset(db, 0, sizeof(*db));
+	return error;
+}
+
+/*
+ * Add a file to `db`, or find it if it was added before.
+ *
+ * Paths are compared byte for byte; unlike the sql database, nothing is
+ * resolved or read here. Compaction does that once per file instead of once
+ * per time a TU includes it.
+ */
+int
+log_db_add_file(log_db_t *db, const char *path, size_t len, int64_t *out)
+{
+	int error;
+
+	const uint64_t hash = hash_path(path, len);
+	uint64_t head = 0;
+	(void)cf_hmap8_lookup(&db->path_index, hash, &head);
+
+	for (size_t next = head; next; ) {
+		const log_str_t *s = log_path_vec_at(&db->paths, next - 1);
+		if (str_eq(db, s, path, len)) {
+			*out = (int64_t)next;
+			return 0;
+		}
+		next = s->next;
+	}
+
+	log_str_t entry = {
+		.len = len,
+		.next = head,
+	};
+	if ((error = push_str(db, path, len, &entry.off))) {
+		return error;
+	}
+	if (!log_path_vec_push(&db->paths, &entry)) {
+		return ENOMEM;
+	}
+	const int64_t id = (int64_t)log_path_vec_len(&db->paths);
+	if ((error = cf_hmap8_insert(&db->path_index, hash, (uint64_t)id))) {
+		return error;
+	}
+
+	const log_file_rec_t rec = {
+		.id = id,
+	};
+	cf_str_t str;
+	cf_str_borrow(path, len, &str);
+	if ((error = seg_append(db, log_seg_files, &rec, sizeof(rec), &str))) {
+		return error;
+	}
+
+	*out = id;
+	return 0;
+}
+
+int
+log_db_tu_dep_insert(log_db_t *db, int64_t tu, int64_t dep)
+{
+	const log_tu_dep_rec_t rec = {
+		.tu = tu,
+		.dep = dep,
+	};
+	return seg_append(db, log_seg_tu_deps, &rec, sizeof(rec), NULL);
+}
+
+/*
+ * Append `num_lines` source lines of `file`, one record each.
+ */
+int
+log_db_snippet_insert(log_db_t *db, int64_t file, const db_snippet_t *lines,
+		size_t num_lines)
+{
+	int error;
+
+	for (size_t i = 0; i < num_lines; ++i) {
+		const log_snippet_rec_t rec = {
+			.file = file,
+			.line = lines[i].line,
+		};
+		if ((error = seg_append(db, log_seg_snippets, &rec, sizeof(rec),
+				&lines[i].text))) {
+			return error;
+		}
+	}
+	return 0;
+}
+
+/*
+ * Look up a typename matching `name` and `loc` in memory.
+ *
+ * Match the same bits as cf_db_typename_lookup(). Return ENOENT if there's
+ * none.
+ */
+int
+log_db_typename_lookup(log_db_t *db, const loc_ctx_t *loc,
+		const db_typename_t *name, int64_t *out)
+{
+	uint64_t hash;
+	const log_key_t *key = find_key(db, loc, name, &hash);
+	if (!key) {
+		return ENOENT;
+	}
+	*out = key->type;
+	return 0;
+}
+
+int
+log_db_typename_lookup_many(log_db_t *db, const db_typename_key_t *keys,
+		size_t num_keys, type_ref_t *out)
+{
+	for (size_t i = 0; i < num_keys; ++i) {
+		uint64_t hash;
+		const log_key_t *key = find_key(db, keys[i].loc, keys[i].name, &hash);
+		out[i].rowid = key ? key->type : 0;
+	}
+	return 0;
+}
+
+int
+log_db_type_insert(log_db_t *db, const loc_ctx_t *loc,
+		const db_type_entry_t *entry, int64_t *out)
+{
+	int error;
+
+	const log_type_rec_t rec = {
+		.id = db->num_types + 1,
+		.loc = loc_rec(loc),
+		.kind = entry->kind,
+		.complete = entry->complete,
+	};
+	if ((error = seg_append(db, log_seg_types, &rec, sizeof(rec), NULL))) {
+		return error;
+	}
+
+	*out = ++db->num_types;
+	return 0;
+}
+
+/*
+ * Append typename `entry` and index it for log_db_typename_lookup().
+ *
+ * If the same key was inserted before, lookups keep finding the first one,
+ * like the sql database.
+ */
+int
+log_db_typename_insert(log_db_t *db, const loc_ctx_t *loc,
+		const db_typename_t *entry)
+{
+	int error;
+
+	const log_typename_rec_t rec = {
+		.loc = loc_rec(loc),
+		.base_type = entry->base_type.rowid,
+		.kind = entry->kind,
+	};
+	if ((error = seg_append(db, log_seg_typenames, &rec, sizeof(rec),
+			&entry->name))) {
+		return error;
+	}
+
+	uint64_t hash;
+	if (find_key(db, loc, entry, &hash)) {
+		return 0;
+	}
+	uint64_t head = 0;
+	(void)cf_hmap8_lookup(&db->key_index, hash, &head);
+
+	const size_t len = cf_str_len(&entry->name);
+	log_key_t key = {
+		.name = {
+			.len = len,
+			.next = head,
+		},
+		.file = loc->file.rowid,
+		.func = loc->func.rowid,
+		.scope = loc->scope,
+		.kind = entry->kind,
+		.type = entry->base_type.rowid,
+	};
+	if ((error = push_str(db, entry->name.str, len, &key.name.off))) {
+		return error;
+	}
+	if (!log_key_vec_push(&db->keys, &key)) {
+		return ENOMEM;
+	}
+	return cf_hmap8_insert(&db->key_index, hash, log_key_vec_len(&db->keys));
+}
+
+int
+log_db_member_insert(log_db_t *db, const loc_ctx_t *loc,
+		const db_member_t *entry)
+{
+	const log_member_rec_t rec = {
+		.loc = loc_rec(loc),
+		.parent = entry->parent.rowid,
+		.base_type = entry->base_type.rowid,
+	};
+	return seg_append(db, log_seg_members, &rec, sizeof(rec), &entry->name);
+}
+
+int
+log_db_type_use_insert(log_db_t *db, const loc_ctx_t *loc,
+		const db_type_use_t *entry)
+{
+	const log_type_use_rec_t rec = {
+		.loc = loc_rec(loc),
+		.base_type = entry->base_type.rowid,
+		.kind = entry->kind,
+	};
+	return seg_append(db, log_seg_type_uses, &rec, sizeof(rec), NULL);
+}
+
+/*
+ * Return a copy of the path of file `id` via `out`. Free it with
+ * cf_str_free().
+ */
+int
+log_db_file_lookup(log_db_t *db, int64_t id, cf_str_t *out)
+{
+	if ((id < 1) || ((uint64_t)id > log_path_vec_len(&db->paths))) {
+		return ENOENT;
+	}
+	const log_str_t *s = log_path_vec_at(&db->paths, (size_t)id - 1);
+	return cf_str_dup(&db->strs[s->off], s->len, out);
+}
+
+/*
+ * Open segment `kind` of the log in directory `dir` for reading.
+ *
+ * On success, read records with the log_read_*() function for `kind`, then
+ * call log_reader_close(). Return EILSEQ if the file isn't a log segment.
+ */
+int
+log_reader_open(const char *dir, log_seg_kind_t kind, log_reader_t *out)
+{
+	int error;
+	char path[PATH_MAX];
+
+	memset(out, 0, sizeof(*out));
+	out->kind = kind;
+
+	if ((error = seg_path(dir, kind, path, sizeof(path)))) {
+		return error;
+	}
+	if ((out->fd = open(path, O_RDONLY | O_CLOEXEC)) == -1) {
+		error = errno;
+		cf_print_err("cannot open log segment '%s', error %d\n", path, error);
+		return error;
+	}
+
+	// a record plus its length always fits
+	out->capacity = LOG_SEG_BUF_SIZE;
+	if (!(out->buf = cf_malloc(out->capacity))) {
+		error = ENOMEM;
+		goto fail;
+	}
+
+	const size_t magic_len = strlen(LOG_SEG_MAGIC);
+	if ((error = reader_fill(out, magic_len))) {
+		goto fail;
+	}
+	if ((out->len < magic_len) ||
+			memcmp(out->buf, LOG_SEG_MAGIC, magic_len)) {
+		cf_print_err("'%s' is not a log segment\n", path);
+		error = EILSEQ;
+		goto fail;
+	}
+	out->pos = magic_len;
+	return 0;
+
+fail:
+	log_reader_close(out);
+	return error;
+}
+
+void
+log_reader_close(log_reader_t *reader)
+{
+	if (reader->fd != -1) {
+		close(reader->fd);
+	}
+	cf_free(reader->buf);
+	memset(reader, 0, sizeof(*reader));
+	reader->fd = -1;
+}
+
+/*
+ * Read the next record of a `log_seg_files` segment.
+ *
+ * Like the other log_read_*() functions, return ENOENT at the end of the
+ * segment, and EILSEQ for a malformed or cut short record.
+ */
+int
+log_read_file(log_reader_t *reader, int64_t *id_out, cf_str_t *path_out)
+{
+	int error;
+	log_file_rec_t rec;
+
+	cf_assert(reader->kind == log_seg_files);
+	if ((error = reader_next(reader, &rec, sizeof(rec), path_out))) {
+		return error;
+	}
+	*id_out = rec.id;
+	return 0;
+}
+
+int
+log_read_type(log_reader_t *reader, int64_t *id_out,
+		db_type_entry_t *entry_out, loc_ctx_t *loc_out)
+{
+	int error;
+	log_type_rec_t rec;
+
+	cf_assert(reader->kind == log_seg_types);
+	if ((error = reader_next(reader, &rec, sizeof(rec), NULL))) {
+		return error;
+	}
+	*id_out = rec.id;
+	*entry_out = (db_type_entry_t) {
+		.kind = (type_kind_t)rec.kind,
+		.complete = rec.complete,
+	};
+	*loc_out = rec_loc(&rec.loc);
+	return 0;
+}
+
+int
+log_read_typename(log_reader_t *reader, db_typename_t *entry_out,
+		loc_ctx_t *loc_out)
+{
+	int error;
+	log_typename_rec_t rec;
+
+	cf_assert(reader->kind == log_seg_typenames);
+	memset(entry_out, 0, sizeof(*entry_out));
+	if ((error = reader_next(reader, &rec, sizeof(rec), &entry_out->name))) {
+		return error;
+	}
+	entry_out->kind = (typename_kind_t)rec.kind;
+	entry_out->base_type.rowid = rec.base_type;
+	*loc_out = rec_loc(&rec.loc);
+	return 0;
+}
+
+int
+log_read_member(log_reader_t *reader, db_member_t *entry_out,
+		loc_ctx_t *loc_out)
+{
+	int error;
+	log_member_rec_t rec;
+
+	cf_assert(reader->kind == log_seg_members);
+	memset(entry_out, 0, sizeof(*entry_out));
+	if ((error = reader_next(reader, &rec, sizeof(rec), &entry_out->name))) {
+		return error;
+	}
+	entry_out->parent.rowid = rec.parent;
+	entry_out->base_type.rowid = rec.base_type;
+	*loc_out = rec_loc(&rec.loc);
+	return 0;
+}
+
+int
+log_read_type_use(log_reader_t *reader, db_type_use_t *entry_out,
+		loc_ctx_t *loc_out)
+{
+	int error;
+	log_type_use_rec_t rec;
+
+	cf_assert(reader->kind == log_seg_type_uses);
+	if ((error = reader_next(reader, &rec, sizeof(rec), NULL))) {
+		return error;
+	}
+	*entry_out = (db_type_use_t) {
+		.base_type = {
+			.rowid = rec.base_type,
+		},
+		.kind = (type_use_kind_t)rec.kind,
+	};
+	*loc_out = rec_loc(&rec.loc);
+	return 0;
+}
+
+int
+log_read_tu_dep(log_reader_t *reader, int64_t *tu_out, int64_t *dep_out)
+{
+	int error;
+	log_tu_dep_rec_t rec;
+
+	cf_assert(reader->kind == log_seg_tu_deps);
+	if ((error = reader_next(reader, &rec, sizeof(rec), NULL))) {
+		return error;
+	}
+	*tu_out = rec.tu;
+	*dep_out = rec.dep;
+	return 0;
+}
+
+int
+log_read_snippet(log_reader_t *reader, int64_t *file_out,
+		db_snippet_t *line_out)
+{
+	int error;
+	log_snippet_rec_t rec;
+
+	cf_assert(reader->kind == log_seg_snippets);
+	if ((error = reader_next(reader, &rec, sizeof(rec), &line_out->text))) {
+		return error;
+	}
+	*file_out = rec.file;
+	line_out->line = rec.line;
+	return 0;
+}
+
+/*
+ * Write the path of segment `kind` of the log in `dir` to `out`.
+ */
+static int
+seg_path(const char *dir, log_seg_kind_t kind, char *out, size_t size)
+{
+	const int len = snprintf(out, size, "%s/%s.seg", dir, seg_names[kind]);
+	if ((len < 0) || ((size_t)len >= size)) {
+		return ENAMETOOLONG;
+	}
+	return 0;
+}
+
+/*
+ * Append a record to segment `kind`: `rec_len` bytes of `rec` followed by
+ * the optional string `str`.
+ */
+static int
+seg_append(log_db_t *db, log_seg_kind_t kind, const void *rec,
+		size_t rec_len, const cf_str_t *str)
+{
+	int error;
+	log_seg_t *seg = &db->segs[kind];
+
+	const size_t str_len = str ? cf_str_len(str) : 0;
+	const size_t payload_len = rec_len + str_len;
+	if (payload_len > LOG_MAX_RECORD) {
+		return E2BIG;
+	}
+	const uint32_t header = (uint32_t)payload_len;
+	const size_t total = sizeof(header) + payload_len;
+
+	if ((seg->len + total) > LOG_SEG_BUF_SIZE) {
+		if ((error = seg_flush(db, seg))) {
+			return error;
+		}
+	}
+
+	char *p = &seg->buf[seg->len];
+	memcpy(p, &header, sizeof(header));
+	memcpy(p + sizeof(header), rec, rec_len);
+	if (str_len) {
+		memcpy(p + sizeof(header) + rec_len, str->str, str_len);
+	}
+	seg->len += total;
+	seg->num_records++;
+	seg->num_bytes += total;
+	return 0;
+}
+
+/*
+ * Write everything buffered in `seg` to its file.
+ */
+static int
+seg_flush(log_db_t *db, log_seg_t *seg)
+{
+	const uint64_t start = get_time_ns();
+	size_t done = 0;
+
+	while (done < seg->len) {
+		const ssize_t n = write(seg->fd, &seg->buf[done], seg->len - done);
+		if (n == -1) {
+			if (errno == EINTR) {
+				continue;
+			}
+			return errno;
+		}
+		done += (size_t)n;
+	}
+	seg->len = 0;
+
+	db->write_ns += get_time_ns() - start;
+	return 0;
+}
+
+/*
+ * Copy `len` bytes of `str` to the end of `db->strs`. Return its offset via
+ * `off`.
+ */
+static int
+push_str(log_db_t *db, const char *str, size_t len, size_t *off)
+{
+	if ((db->strs_capacity - db->strs_len) < len) {
+		size_t capacity = db->strs_capacity ? db->strs_capacity : LOG_MIN_STRS;
+		while ((capacity - db->strs_len) < len) {
+			capacity *= 2;
+		}
+		char *strs = cf_realloc(db->strs, capacity);
+		if (!strs) {
+			return ENOMEM;
+		}
+		db->strs = strs;
+		db->strs_capacity = capacity;
+	}
+
+	*off = db->strs_len;
+	memcpy(&db->strs[db->strs_len], str, len);
+	db->strs_len += len;
+	return 0;
+}
+
+static bool
+str_eq(const log_db_t *db, const log_str_t *s, const char *str, size_t len)
+{
+	return (s->len == len) && !memcmp(&db->strs[s->off], str, len);
+}
+
+/*
+ * Find the key of typename `name` at `loc` in `db->keys`, or NULL. Return the
+ * hash of the key via `hash_out` either way.
+ */
+static const log_key_t *
+find_key(const log_db_t *db, const loc_ctx_t *loc, const db_typename_t *name,
+		uint64_t *hash_out)
+{
+	const size_t len = cf_str_len(&name->name);
+
+	*hash_out = hash_key(loc, name);
+	uint64_t next = 0;
+	(void)cf_hmap8_lookup(&db->key_index, *hash_out, &next);
+
+	while (next) {
+		const log_key_t *key = log_key_vec_at(&db->keys, next - 1);
+		if ((key->file == loc->file.rowid) &&
+				(key->func == loc->func.rowid) &&
+				(key->scope == loc->scope) && (key->kind == name->kind) &&
+				str_eq(db, &key->name, name->name.str, len)) {
+			return key;
+		}
+		next = key->name.next;
+	}
+	return NULL;
+}
+
+/*
+ * Hash the bits of a typename lookup into a `cf_hmap8_t` key.
+ */
+static uint64_t
+hash_key(const loc_ctx_t *loc, const db_typename_t *name)
+{
+	const uint32_t kind = name->kind;
+	uint64_t hash = cf_hash_bytes(0, &loc->file.rowid,
+			sizeof(loc->file.rowid));
+	hash = cf_hash_bytes(hash, &loc->func.rowid, sizeof(loc->func.rowid));
+	hash = cf_hash_bytes(hash, &loc->scope, sizeof(loc->scope));
+	hash = cf_hash_bytes(hash, &kind, sizeof(kind));
+	hash = cf_hash_bytes(hash, name->name.str, cf_str_len(&name->name));
+	return hash ? hash : 1;
+}
+
+static uint64_t
+hash_path(const char *path, size_t len)
+{
+	const uint64_t hash = cf_hash_bytes(0, path, len);
+	return hash ? hash : 1;
+}
+
+static log_loc_rec_t
+loc_rec(const loc_ctx_t *loc)
+{
+	return (log_loc_rec_t) {
+		.file = loc->file.rowid,
+		.func = loc->func.rowid,
+		.scope = loc->scope,
+		.line = loc->line,
+		.column = loc->column,
+	};
+}
+
+static loc_ctx_t
+rec_loc(const log_loc_rec_t *rec)
+{
+	return (loc_ctx_t) {
+		.file = {
+			.rowid = rec->file,
+		},
+		.func = {
+			.rowid = rec->func,
+		},
+		.scope = rec->scope,
+		.line = rec->line,
+		.column = rec->column,
+	};
+}
+
+/*
+ * Read from `reader->fd` until at least `need` unconsumed bytes are
+ * buffered, or the end of the file.
+ *
+ * Consumed bytes are dropped from the front of the buffer first, which moves
+ * whatever strings were borrowed from it.
+ */
+static int
+reader_fill(log_reader_t *reader, size_t need)
+{
+	cf_assert(need <= reader->capacity);
+
+	if ((reader->len - reader->pos) >= need) {
+		return 0;
+	}
+	if (reader->pos) {
+		reader->len -= reader->pos;
+		memmove(reader->buf, &reader->buf[reader->pos], reader->len);
+		reader->pos = 0;
+	}
+
+	while (!reader->eof && (reader->len < need)) {
+		const ssize_t n = read(reader->fd, &reader->buf[reader->len],
+				reader->capacity - reader->len);
+		if (n == -1) {
+			if (errno == EINTR) {
+				continue;
+			}
+			return errno;
+		}
+		if (!n) {
+			reader->eof = true;
+		}
+		reader->len += (size_t)n;
+	}
+	return 0;
+}
+
+/*
+ * Read the next record into `rec`, a `rec_len`-byte struct, and borrow the
+ * string after it, if any, via `str_out`. Records without strings pass NULL.
+ */
+static int
+reader_next(log_reader_t *reader, void *rec, size_t rec_len,
+		cf_str_t *str_out)
+{
+	int error;
+	uint32_t payload_len;
+
+	if ((error = reader_fill(reader, sizeof(payload_len)))) {
+		return error;
+	}
+	const size_t left = reader->len - reader->pos;
+	if (!left) {
+		return ENOENT;
+	}
+	if (left < sizeof(payload_len)) {
+		goto bad;
+	}
+	memcpy(&payload_len, &reader->buf[reader->pos], sizeof(payload_len));
+	if ((payload_len > LOG_MAX_RECORD) || (payload_len < rec_len) ||
+			(!str_out && (payload_len != rec_len))) {
+		goto bad;
+	}
+
+	const size_t total = sizeof(payload_len) + payload_len;
+	if ((error = reader_fill(reader, total))) {
+		return error;
+	}
+	if ((reader->len - reader->pos) < total) {
+		goto bad;
+	}
+
+	const char *payload = &reader->buf[reader->pos + sizeof(payload_len)];
+	memcpy(rec, payload, rec_len);
+	if (str_out) {
+		cf_str_borrow(payload + rec_len, payload_len - rec_len, str_out);
+	}
+	reader->pos += total;
+	return 0;
+
+bad:
+	cf_print_err("bad %s log record\n", seg_names[reader->kind]);
+	return EILSEQ;
+}
+
+static uint64_t
+get_time_ns(void)
+{
+	struct timespec ts;
+	(void)clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ((uint64_t)ts.tv_sec * 1000000000ull) + (uint64_t)ts.tv_nsec;
+}
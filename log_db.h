@@ -0,0 +1,218 @@
+/*
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ * Copyright (C) 2024 cfind developer
+ *
+ * Append-only log database backend.
+ *
+ * Indexing into sqlite spends most of its time maintaining B-trees: every
+ * insert lands somewhere in the middle of a table or index. A log database
+ * instead appends each entry to the end of a segment file, one segment per
+ * kind of entry, so indexing is nothing but sequential writes. The only
+ * lookups the indexer needs while it runs, files by path and typenames by
+ * key, are answered by hash tables in memory.
+ *
+ * A log can't be searched. It's compacted into a sqlite database afterwards
+ * by cf_merge_log() in "merge.h", which loads each segment in bulk.
+ *
+ * A log is a directory holding a file per segment. Each segment starts with
+ * `LOG_SEG_MAGIC` followed by records: a 32bit length then that many bytes of
+ * payload. Payloads are fixed-size structs in native byte order, optionally
+ * followed by a string. A log is only meant to be read on the machine that
+ * wrote it.
+ */
+#pragma once
+
+#include "cc_support.h"
+#include "cf_map.h"
+#include "cf_string.h"
+#include "cf_vector.h"
+#include "db_types.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+__BEGIN_DECLS
+
+// first bytes of every segment; bumped if the record format changes
+#define LOG_SEG_MAGIC "cflog01\n"
+
+/*
+ * Kinds of segments in a log, one per kind of entry.
+ */
+typedef enum {
+	log_seg_files = 0,
+	log_seg_types = 1,
+	log_seg_typenames = 2,
+	log_seg_members = 3,
+	log_seg_type_uses = 4,
+	log_seg_tu_deps = 5,
+	log_seg_snippets = 6,
+} log_seg_kind_t;
+
+#define LOG_NUM_SEGS 7
+
+/*
+ * A segment open for appending.
+ *
+ * Members
+ * - fd
+ *   Segment file.
+ * - buf, len
+ *   Records not yet written to `fd`.
+ * - num_records, num_bytes
+ *   Totals appended to this segment, including what's still in `buf`.
+ */
+typedef struct {
+	int fd;
+	char *buf;
+	size_t len;
+	uint64_t num_records;
+	uint64_t num_bytes;
+} log_seg_t;
+
+/*
+ * A path or name copied into `log_db_t::strs`, chained to the next entry with
+ * the same hash.
+ *
+ * Members
+ * - off, len
+ *   Location of the string in `log_db_t::strs`.
+ * - next
+ *   1 + index of the next entry in the chain, or 0 at the end.
+ */
+typedef struct {
+	size_t off;
+	size_t len;
+	size_t next;
+} log_str_t;
+
+/*
+ * Typename lookup key, and the type it names.
+ *
+ * Members
+ * - name
+ *   The typename string and its hash chain.
+ * - file, func, scope, kind
+ *   Same as the bits compared by cf_db_typename_lookup().
+ * - type
+ *   Id of the type named.
+ */
+typedef struct {
+	log_str_t name;
+	int64_t file;
+	int64_t func;
+	uint32_t scope;
+	uint32_t kind;
+	int64_t type;
+} log_key_t;
+
+CF_VEC_TYPE_DECL(log_path_vec_t, log_str_t);
+CF_VEC_TYPE_DECL(log_key_vec_t, log_key_t);
+
+/*
+ * Log database.
+ *
+ * Ids are handed out like sqlite rowids: files and types count up from 1 in
+ * insertion order.
+ *
+ * Members
+ * - segs
+ *   One appender per `log_seg_kind_t`.
+ * - strs, strs_len, strs_capacity
+ *   Heap buffer of every file path and typename, back to back.
+ * - paths
+ *   Every file added. File id `i` is at index `i - 1`.
+ * - path_index
+ *   Map from a hash of a path to 1 + index of the first of `paths` with that
+ *   hash.
+ * - keys
+ *   Every typename inserted.
+ * - key_index
+ *   Map from a hash of a `log_key_t` to 1 + index of the first of `keys` with
+ *   that hash.
+ * - num_types
+ *   Number of types inserted; also the last type id.
+ * - write_ns
+ *   Time spent in write(2), printed when the log is closed.
+ */
+typedef struct {
+	log_seg_t segs[LOG_NUM_SEGS];
+	char *strs;
+	size_t strs_len;
+	size_t strs_capacity;
+	log_path_vec_t paths;
+	cf_hmap8_t path_index;
+	log_key_vec_t keys;
+	cf_hmap8_t key_index;
+	int64_t num_types;
+	uint64_t write_ns;
+} log_db_t;
+
+/*
+ * Sequential reader of one segment of a log.
+ *
+ * Strings returned by the log_read_*() functions are borrowed from `buf`.
+ * They're valid until the next read.
+ *
+ * Members
+ * - fd
+ *   Segment file.
+ * - kind
+ *   Kind of segment being read.
+ * - buf, len, capacity
+ *   Bytes read from `fd` but not yet consumed, starting at `pos`.
+ * - pos
+ *   Offset in `buf` of the next record.
+ * - eof
+ *   Whether `fd` has been read to the end.
+ */
+typedef struct {
+	int fd;
+	log_seg_kind_t kind;
+	char *buf;
+	size_t len;
+	size_t capacity;
+	size_t pos;
+	bool eof;
+} log_reader_t;
+
+int log_db_open(const char *dir, log_db_t *out);
+int log_db_close(log_db_t *db);
+
+int log_db_add_file(log_db_t *db, const char *path, size_t len, int64_t *out);
+int log_db_tu_dep_insert(log_db_t *db, int64_t tu, int64_t dep);
+int log_db_snippet_insert(log_db_t *db, int64_t file,
+		const db_snippet_t *lines, size_t num_lines);
+
+int log_db_typename_lookup(log_db_t *db, const loc_ctx_t *loc,
+		const db_typename_t *name, int64_t *out);
+int log_db_typename_lookup_many(log_db_t *db, const db_typename_key_t *keys,
+		size_t num_keys, type_ref_t *out);
+int log_db_type_insert(log_db_t *db, const loc_ctx_t *loc,
+		const db_type_entry_t *entry, int64_t *out);
+int log_db_typename_insert(log_db_t *db, const loc_ctx_t *loc,
+		const db_typename_t *entry);
+int log_db_member_insert(log_db_t *db, const loc_ctx_t *loc,
+		const db_member_t *entry);
+int log_db_type_use_insert(log_db_t *db, const loc_ctx_t *loc,
+		const db_type_use_t *entry);
+
+int log_db_file_lookup(log_db_t *db, int64_t id, cf_str_t *out);
+
+int log_reader_open(const char *dir, log_seg_kind_t kind, log_reader_t *out);
+void log_reader_close(log_reader_t *reader);
+int log_read_file(log_reader_t *reader, int64_t *id_out, cf_str_t *path_out);
+int log_read_type(log_reader_t *reader, int64_t *id_out,
+		db_type_entry_t *entry_out, loc_ctx_t *loc_out);
+int log_read_typename(log_reader_t *reader, db_typename_t *entry_out,
+		loc_ctx_t *loc_out);
+int log_read_member(log_reader_t *reader, db_member_t *entry_out,
+		loc_ctx_t *loc_out);
+int log_read_type_use(log_reader_t *reader, db_type_use_t *entry_out,
+		loc_ctx_t *loc_out);
+int log_read_tu_dep(log_reader_t *reader, int64_t *tu_out, int64_t *dep_out);
+int log_read_snippet(log_reader_t *reader, int64_t *file_out,
+		db_snippet_t *line_out);
+
+__END_DECLS
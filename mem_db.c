@@ -4,7 +4,9 @@
  */
 #include "mem_db.h"
 
+#include "cf_alloc.h"
 #include "cf_assert.h"
+#include "cf_map.h"
 #include "cf_print.h"
 #include "cf_string.h"
 #include "cf_vector.h"
@@ -28,7 +30,9 @@ CF_VEC_FUNC_DECL(type_vec_t, db_type_entry_t, type_vec);
 CF_VEC_FUNC_DECL(typename_vec_t, db_typename_t, typename_vec);
 CF_VEC_FUNC_DECL(member_vec_t, db_member_t, member_vec);
 CF_VEC_FUNC_DECL(type_use_vec_t, db_type_use_t, type_use_vec);
+CF_VEC_FUNC_DECL(use_count_vec_t, db_type_use_count_t, use_count_vec);
 CF_VEC_FUNC_DECL(loc_vec_t, loc_ctx_t, loc_vec);
+CF_VEC_FUNC_DECL(link_vec_t, size_t, link_vec);
 
 CF_VEC_ITER_GENERATE(file_vec_t, cf_str_t, file_iter);
 // CF_VEC_ITER_GENERATE(type_vec_t, db_type_entry_t, type_iter);
@@ -36,12 +40,22 @@ CF_VEC_ITER_GENERATE(typename_vec_t, db_typename_t, typename_iter);
 CF_VEC_ITER_GENERATE(member_vec_t, db_member_t, member_iter);
 // CF_VEC_ITER_GENERATE(type_use_vec_t, db_type_use_t, type_use_iter);
 
+// CF_VEC_CITER_GENERATE(typename_vec_t, db_typename_t, typename_citer);
+CF_VEC_CITER_GENERATE(member_vec_t, db_member_t, member_citer);
+
 static void mem_db_free_files(file_vec_t *vec);
 static void mem_db_free_types(type_vec_t *vec);
 static void mem_db_free_typenames(typename_vec_t *vec);
 static void mem_db_free_members(member_vec_t *vec);
 static void mem_db_free_type_uses(type_use_vec_t *vec);
 static void mem_db_free_locs(loc_vec_t *vec);
+static uint64_t typename_key_hash(size_t file, const cf_str_t *name);
+static bool typename_key_match(const db_typename_key_t *key,
+		const db_typename_t *entry, const loc_ctx_t *loc);
+static const db_typename_t *find_typename(const mem_db_t *db,
+		const db_typename_key_t *key);
+static int count_type_use(const db_type_use_t *use, const loc_ctx_t *loc,
+		size_t begin, use_count_vec_t *out);
 
 int
 mem_db_open(mem_db_t *db)
@@ -50,8 +64,11 @@ mem_db_open(mem_db_t *db)
 	file_vec_make(&db->files);
 	type_vec_make(&db->user_types);
 	typename_vec_make(&db->typenames);
+	cf_hmap8_make(&db->typename_index);
+	link_vec_make(&db->typename_links);
 	member_vec_make(&db->members);
 	type_use_vec_make(&db->type_uses);
+	use_count_vec_make(&db->use_counts);
 
 	for (unsigned i = 0; i < MEM_DB_NUM_VEC; ++i) {
 		loc_vec_make(&db->locs[i]);
@@ -67,8 +84,11 @@ mem_db_close(mem_db_t *db)
 	mem_db_free_files(&db->files);
 	mem_db_free_types(&db->user_types);
 	mem_db_free_typenames(&db->typenames);
+	cf_hmap8_free(&db->typename_index);
+	link_vec_free(&db->typename_links);
 	mem_db_free_members(&db->members);
 	mem_db_free_type_uses(&db->type_uses);
+	use_count_vec_free(&db->use_counts);
 	mem_db_free_locs(db->locs);
 
 	return 0;
@@ -111,65 +131,43 @@ fail:
  * Check for existence of a type matching `name` in the file specified by
  * `loc`.
  *
- * If it exists, return the entry's rowid via `*out`, if not this
- * function returns ENOENT.
+ * If it exists, return the index of the type it names via `*out`, if not
+ * this function returns ENOENT.
  *
- * Steps:
- * - iterate over `db->typenames`
- *   - strcmp each entry's name with `name`
- *   - if there's a match, check whether `loc` matches `db->locs`
- *   - if not, continue on
+ * Only typenames with the same hash of file and name are compared, by
+ * following their chain in `db->typename_index`.
  */
 int
 mem_db_typename_lookup(mem_db_t *db, const loc_ctx_t *loc,
 		const db_typename_t *name, size_t *out)
 {
-	int error = ENOENT;
-	cf_vec_iter_t iter;
-
-	typename_iter_make(&db->typenames, &iter);
+	const db_typename_key_t key = {
+		.loc = loc,
+		.name = name,
+	};
 
-	if (!typename_vec_len(&db->typenames)) {
-		error = ENOENT;
-		goto fail;
+	const db_typename_t *entry = find_typename(db, &key);
+	if (!entry) {
+		return ENOENT;
 	}
+	*out = entry->base_type.index;
+	return 0;
+}
 
-	// base pointer
-	const db_typename_t *base = typename_vec_at(&db->typenames, 0);
-
-	// check each typename entry
-	while (typename_iter_next(&iter)) {
-		db_typename_t *entry = typename_iter_peek(&iter);
-		const size_t len = cf_str_len(&entry->name);
-
-		// check names
-		if (cf_str_len(&name->name) != len) {
-			continue;
-		}
-		if (strncmp(name->name.str, entry->name.str, len)) {
-			continue;
-		}
-		// name match, check location
-
-		// compute location index
-		cf_assert(entry >= base);
-		const size_t i = entry - base;
-		const loc_ctx_t *loc2 = loc_vec_at(&db->locs[typename_idx], i);
-
-		// check locations match
-		if (loc->file.index != loc2->file.index) {
-			continue;
-		}
-
-		// a match
-		error = 0;
-		*out = i;
-		break;
+/*
+ * Look up each of `keys` in `db->typename_index`.
+ *
+ * A key that isn't found is left as 0 in `out`.
+ */
+int
+mem_db_typename_lookup_many(mem_db_t *db, const db_typename_key_t *keys,
+		size_t num_keys, type_ref_t *out)
+{
+	for (size_t i = 0; i < num_keys; ++i) {
+		const db_typename_t *entry = find_typename(db, &keys[i]);
+		out[i].index = entry ? entry->base_type.index : 0;
 	}
-
-fail:
-	typename_iter_free(&iter);
-	return error;
+	return 0;
 }
 
 int
@@ -232,6 +230,13 @@ mem_db_typename_insert(mem_db_t *db, const loc_ctx_t *loc,
 		goto fail_loc;
 	}
 
+	// reserve for its hash chain link
+	size_t *new_link = link_vec_reserve(&db->typename_links);
+	if (!new_link) {
+		error = ENOMEM;
+		goto fail_link;
+	}
+
 	// copy
 	// heap allocate `entry`s name
 	*new_entry = (db_typename_t) {
@@ -243,12 +248,27 @@ mem_db_typename_insert(mem_db_t *db, const loc_ctx_t *loc,
 	}
 	memcpy(new_loc, loc, sizeof(*loc));
 
+	// push to the front of its chain
+	const uint64_t hash = typename_key_hash(loc->file.index, &entry->name);
+	uint64_t head = 0;
+	(void)cf_hmap8_lookup(&db->typename_index, hash, &head);
+	*new_link = (size_t)head;
+	if ((error = cf_hmap8_insert(&db->typename_index, hash,
+			typename_vec_len(&db->typenames) + 1))) {
+		goto fail_index;
+	}
+
 	// commit
 	typename_vec_commit(&db->typenames, new_entry);
 	loc_vec_commit(&db->locs[typename_idx], new_loc);
+	link_vec_commit(&db->typename_links, new_link);
 
 	return 0;
+fail_index:
+	cf_str_free(&new_entry->name);
 fail_copy:
+	link_vec_abort(&db->typename_links, new_link);
+fail_link:
 	loc_vec_abort(&db->locs[typename_idx], new_loc);
 fail_loc:
 	typename_vec_abort(&db->typenames, new_entry);
@@ -335,6 +355,37 @@ fail:
 	return error;
 }
 
+/*
+ * Add `entry->count` to the count of `entry`'s key, or keep the larger of the
+ * two if `max` is set. See insert_type_use_count().
+ *
+ * Keys are found with a linear search.
+ */
+int
+mem_db_type_use_count_insert(mem_db_t *db, const db_type_use_count_t *entry,
+		bool max)
+{
+	for (size_t i = 0; i < use_count_vec_len(&db->use_counts); ++i) {
+		db_type_use_count_t *old = use_count_vec_at(&db->use_counts, i);
+		if ((old->base_type.index != entry->base_type.index) ||
+				(old->file.index != entry->file.index) ||
+				(old->kind != entry->kind)) {
+			continue;
+		}
+		if (!max) {
+			old->count += entry->count;
+		} else if (entry->count > old->count) {
+			old->count = entry->count;
+		}
+		return 0;
+	}
+
+	if (!use_count_vec_push(&db->use_counts, entry)) {
+		return ENOMEM;
+	}
+	return 0;
+}
+
 int
 mem_db_file_lookup(mem_db_t *db, size_t id, cf_str_t *out)
 {
@@ -371,6 +422,44 @@ mem_db_type_lookup(mem_db_t *db, size_t id, db_type_entry_t *entry_out,
 	return 0;
 }
 
+/*
+ * Append the use counts of type `type` to `out`, in insertion order.
+ *
+ * If there are none, count its `db->type_uses` per file and kind instead.
+ */
+int
+mem_db_type_use_count_lookup(mem_db_t *db, size_t type, use_count_vec_t *out)
+{
+	int error;
+	const size_t begin = use_count_vec_len(out);
+
+	for (size_t i = 0; i < use_count_vec_len(&db->use_counts); ++i) {
+		const db_type_use_count_t *entry = use_count_vec_at(&db->use_counts,
+				i);
+		if (entry->base_type.index != type) {
+			continue;
+		}
+		if (!use_count_vec_push(out, entry)) {
+			return ENOMEM;
+		}
+	}
+	if (use_count_vec_len(out) != begin) {
+		return 0;
+	}
+
+	for (size_t i = 0; i < type_use_vec_len(&db->type_uses); ++i) {
+		const db_type_use_t *use = type_use_vec_at(&db->type_uses, i);
+		const loc_ctx_t *loc = loc_vec_at(&db->locs[type_use_idx], i);
+		if (use->base_type.index != type) {
+			continue;
+		}
+		if ((error = count_type_use(use, loc, begin, out))) {
+			return error;
+		}
+	}
+	return 0;
+}
+
 /*
  * Search member entries for `parent`,`name`.
  *
@@ -378,12 +467,16 @@ mem_db_type_lookup(mem_db_t *db, size_t id, db_type_entry_t *entry_out,
  */
 int
 mem_db_member_lookup(mem_db_t *db, size_t parent, const cf_str_t *name,
-		db_member_t *entry_out, loc_ctx_t *loc_out)
+		const db_filter_t *filter, db_member_t *entry_out, loc_ctx_t *loc_out)
 {
 	int error = ENOENT;
 
-	cf_vec_iter_t iter;
-	member_iter_make(&db->members, &iter);
+	if (filter && !cf_str_is_null(&filter->file_glob)) {
+		return ENOTSUP;
+	}
+
+	cf_vec_citer_t iter;
+	member_citer_make(&db->members, &iter);
 
 	if (!member_vec_len(&db->members)) {
 		error = ENOENT;
@@ -394,8 +487,8 @@ mem_db_member_lookup(mem_db_t *db, size_t parent, const cf_str_t *name,
 	const db_member_t *base = member_vec_at(&db->members, 0);
 
 	// check each member entry
-	while (member_iter_next(&iter)) {
-		db_member_t *entry = member_iter_peek(&iter);
+	while (member_citer_next(&iter)) {
+		const db_member_t *entry = member_citer_peek(&iter);
 
 		// check parents
 		if (parent != entry->parent.index) {
@@ -432,23 +525,41 @@ mem_db_member_lookup(mem_db_t *db, size_t parent, const cf_str_t *name,
 	}
 
 fail:
-	typename_iter_free(&iter);
+	member_citer_free(&iter);
 	return error;
 }
 
 /*
  * Create an iterator over typename entries in search of `name`.
+ *
+ * Only the kind filters, the limit, and the cursor in `filter` are supported.
+ * Results are always in insertion order. An entry's cursor is its index plus
+ * one, so 0 stays "no cursor".
  */
 int
 mem_db_typename_find(mem_db_t *db, const cf_str_t *name,
-		mem_db_typename_iter_t *out)
+		const db_filter_t *filter, mem_db_typename_iter_t *out)
 {
-	(void)db;
 	// initialize to 0xffff...
 	// the first _next() call will increment, then check against length
 	memset(out, 0, sizeof(*out));
 	out->i = SIZE_MAX;
 	cf_str_borrow_str(name, &out->key);
+
+	if (filter) {
+		if (!cf_str_is_null(&filter->file_glob) ||
+				(filter->order != db_order_none)) {
+			return ENOTSUP;
+		}
+		if ((filter->after < 0) || ((uint64_t)filter->after >
+				typename_vec_len(&db->typenames))) {
+			return ENOENT;
+		}
+		memcpy(&out->filter, filter, sizeof(*filter));
+
+		// resume just past the cursor's entry
+		out->i = (size_t)filter->after - 1;
+	}
 	return 0;
 }
 
@@ -485,6 +596,11 @@ mem_db_typename_iter_next(mem_db_t *db, mem_db_typename_iter_t *it)
 {
 	const size_t vec_len = typename_vec_len(&db->typenames);
 	const size_t name_len = cf_str_len(&it->key);
+	const db_filter_t *filter = &it->filter;
+
+	if (filter->limit && (it->count >= filter->limit)) {
+		return false;
+	}
 
 	for (size_t i = it->i + 1; i < vec_len; ++i) {
 		const db_typename_t *entry = typename_vec_at(&db->typenames, i);
@@ -496,8 +612,29 @@ mem_db_typename_iter_next(mem_db_t *db, mem_db_typename_iter_t *it)
 			continue;
 		}
 
+		// check filters
+		if (filter->name_kind && (entry->kind != filter->name_kind)) {
+			continue;
+		}
+		if (filter->type_kind) {
+			// note the shift by 1: type at index 0 uses ID 1
+			const db_type_entry_t *type = type_vec_at(&db->user_types,
+					entry->base_type.index - 1);
+			if (type->kind != filter->type_kind) {
+				continue;
+			}
+		}
+		if (filter->scope) {
+			const loc_ctx_t *loc = loc_vec_at(&db->locs[typename_idx], i);
+			const bool global = (loc->scope == scope_global);
+			if (global != (filter->scope == db_scope_global)) {
+				continue;
+			}
+		}
+
 		// a match
 		it->i = i;
+		it->count++;
 		return true;
 	}
 
@@ -505,6 +642,12 @@ mem_db_typename_iter_next(mem_db_t *db, mem_db_typename_iter_t *it)
 	return false;
 }
 
+int64_t
+mem_db_typename_iter_cursor(const mem_db_typename_iter_t *it)
+{
+	return (int64_t)it->i + 1;
+}
+
 static void
 mem_db_free_files(file_vec_t *vec)
 {
@@ -576,3 +719,78 @@ mem_db_free_locs(loc_vec_t *vec)
 		loc_vec_free(&vec[i]);
 	}
 }
+
+static uint64_t
+typename_key_hash(size_t file, const cf_str_t *name)
+{
+	uint64_t hash = cf_hash_bytes(0, &file, sizeof(file));
+	hash = cf_hash_bytes(hash, name->str, cf_str_len(name));
+	// zero is not a valid hmap key
+	return hash ? hash : 1;
+}
+
+static bool
+typename_key_match(const db_typename_key_t *key, const db_typename_t *entry,
+		const loc_ctx_t *loc)
+{
+	const size_t len = cf_str_len(&entry->name);
+	return (key->loc->file.index == loc->file.index) &&
+			(key->loc->scope == loc->scope) &&
+			(key->loc->func.index == loc->func.index) &&
+			(key->name->kind == entry->kind) &&
+			(cf_str_len(&key->name->name) == len) &&
+			!memcmp(key->name->name.str, entry->name.str, len);
+}
+
+/*
+ * Find the typename matching `key` by following its hash chain.
+ *
+ * Chains run from the newest typename to the oldest. The oldest match is
+ * returned, the one a scan of `db->typenames` would find first.
+ */
+static const db_typename_t *
+find_typename(const mem_db_t *db, const db_typename_key_t *key)
+{
+	const db_typename_t *found = NULL;
+
+	uint64_t next = 0;
+	(void)cf_hmap8_lookup(&db->typename_index,
+			typename_key_hash(key->loc->file.index, &key->name->name), &next);
+	while (next) {
+		const size_t i = (size_t)next - 1;
+		const db_typename_t *entry = typename_vec_at(&db->typenames, i);
+		const loc_ctx_t *loc = loc_vec_at(&db->locs[typename_idx], i);
+
+		if (typename_key_match(key, entry, loc)) {
+			found = entry;
+		}
+		next = *link_vec_at(&db->typename_links, i);
+	}
+	return found;
+}
+
+/*
+ * Add `use` at `loc` to the count of its file and kind among entries `begin`
+ * and after of `out`, appending a count of one if there's none yet.
+ */
+static int
+count_type_use(const db_type_use_t *use, const loc_ctx_t *loc, size_t begin,
+		use_count_vec_t *out)
+{
+	for (size_t i = begin; i < use_count_vec_len(out); ++i) {
+		db_type_use_count_t *count = use_count_vec_at(out, i);
+		if ((count->file.index == loc->file.index) &&
+				(count->kind == use->kind)) {
+			++count->count;
+			return 0;
+		}
+	}
+
+	const db_type_use_count_t count = {
+		.base_type = use->base_type,
+		.file = loc->file,
+		.kind = use->kind,
+		.count = 1,
+	};
+	return use_count_vec_push(out, &count) ? 0 : ENOMEM;
+}
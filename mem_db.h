@@ -7,6 +7,7 @@
 #pragma once
 
 #include "cc_support.h"
+#include "cf_map.h"
 #include "cf_string.h"
 #include "cf_vector.h"
 #include "db_types.h"
@@ -22,6 +23,7 @@ CF_VEC_TYPE_DECL(typename_vec_t, db_typename_t);
 CF_VEC_TYPE_DECL(member_vec_t, db_member_t);
 CF_VEC_TYPE_DECL(type_use_vec_t, db_type_use_t);
 CF_VEC_TYPE_DECL(loc_vec_t, loc_ctx_t);
+CF_VEC_TYPE_DECL(link_vec_t, size_t);
 
 #define MEM_DB_NUM_VEC 4
 
@@ -38,18 +40,30 @@ CF_VEC_TYPE_DECL(loc_vec_t, loc_ctx_t);
  * - typenames
  *   Typedefs and names of `user_types`. structs, etc. only. No entries for
  *   builtin types.
+ * - typename_index
+ *   Map from a hash of a typename's file and name to 1 + index of the last of
+ *   `typenames` with that hash.
+ * - typename_links
+ *   Hash chains of `typename_index`, parallel to `typenames`. Each is 1 +
+ *   index of the previous typename with the same hash, or 0 at the end.
  * - members
  *   Struct/union members of `user_types`.
  * - type_uses
  *   Miscellaneous uses of types in `user_types`. The whole type is involved,
  *   rather than just an individual member.
+ * - use_counts
+ *   Aggregated uses of types in `user_types`; one entry per type, file, and
+ *   kind of use.
  */
 typedef struct {
 	file_vec_t files;
 	type_vec_t user_types;
 	typename_vec_t typenames;
+	cf_hmap8_t typename_index;
+	link_vec_t typename_links;
 	member_vec_t members;
 	type_use_vec_t type_uses;
+	use_count_vec_t use_counts;
 	loc_vec_t locs[MEM_DB_NUM_VEC];
 } mem_db_t;
 
@@ -61,10 +75,16 @@ typedef struct {
  *   Current index into `mem_db_t::typenames`.
  * - key
  *   The name string being searched for.
+ * - filter
+ *   Copy of the caller's filter. Zero if there's none.
+ * - count
+ *   Number of entries returned so far. Used for `filter.limit`.
  */
 typedef struct {
 	size_t i;
 	cf_str_t key;
+	db_filter_t filter;
+	size_t count;
 } mem_db_typename_iter_t;
 
 int mem_db_open(mem_db_t *db);
@@ -73,6 +93,8 @@ int mem_db_add_file(mem_db_t *db, const char *path, size_t len, size_t *out);
 
 int mem_db_typename_lookup(mem_db_t *db, const loc_ctx_t *loc,
 		const db_typename_t *name, size_t *out);
+int mem_db_typename_lookup_many(mem_db_t *db,
+		const db_typename_key_t *keys, size_t num_keys, type_ref_t *out);
 int mem_db_type_insert(mem_db_t *db, const loc_ctx_t *loc,
 		const db_type_entry_t *entry, size_t *out);
 int mem_db_typename_insert(mem_db_t *db, const loc_ctx_t *loc,
@@ -81,19 +103,24 @@ int mem_db_member_insert(mem_db_t *db, const loc_ctx_t *loc,
 		const db_member_t *entry);
 int mem_db_type_use_insert(mem_db_t *db, const loc_ctx_t *loc,
 		const db_type_use_t *entry);
+int mem_db_type_use_count_insert(mem_db_t *db,
+		const db_type_use_count_t *entry, bool max);
 
 int mem_db_file_lookup(mem_db_t *db, size_t id, cf_str_t *out);
 int mem_db_type_lookup(mem_db_t *db, size_t id,
 		db_type_entry_t *entry_out, loc_ctx_t *loc_out);
+int mem_db_type_use_count_lookup(mem_db_t *db, size_t type,
+		use_count_vec_t *out);
 int mem_db_member_lookup(mem_db_t *db, size_t parent, const cf_str_t *name,
-		db_member_t *entry_out, loc_ctx_t *loc_out);
+		const db_filter_t *filter, db_member_t *entry_out, loc_ctx_t *loc_out);
 int mem_db_typename_find(mem_db_t *db, const cf_str_t *name,
-		mem_db_typename_iter_t *out);
+		const db_filter_t *filter, mem_db_typename_iter_t *out);
 
 void mem_db_typename_iter_free(mem_db_typename_iter_t *it);
 void mem_db_typename_iter_peek(const mem_db_t *db,
 		const mem_db_typename_iter_t *it, db_typename_t *entry_out,
 		loc_ctx_t *loc_out);
 bool mem_db_typename_iter_next(mem_db_t *db, mem_db_typename_iter_t *it);
+int64_t mem_db_typename_iter_cursor(const mem_db_typename_iter_t *it);
 
 __END_DECLS
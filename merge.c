@@ -0,0 +1,1190 @@
+/*
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ * Copyright (C) 2024 cfind developer
+ *
+ * Index fragment merging. See "merge.h".
+ *
+ * Every rowid in a fragment is local to it. Merging reads the fragment one
+ * table at a time and translates rowids to the destination database with a
+ * map per kind of reference:
+ * - files
+ *   Fragment file rowid -> destination file rowid. A file that no longer
+ *   exists can't be added, so nothing located in it is merged. A duplicate of
+ *   a destination file maps to that file.
+ * - types
+ *   Fragment typeid -> destination typeid, for every type with a name.
+ * - new_types
+ *   Set of fragment typeids inserted into the destination by this merge.
+ *   Like commit_struct_scoreboard(), members of a type that already existed
+ *   aren't merged again.
+ * - member_locs
+ *   Set of source locations of merged members. A type use is recorded at
+ *   the location of the member that declares it, so this decides which type
+ *   uses belong to new types.
+ *
+ * Aggregated type use counts have no location to check against
+ * `member_locs`. A fragment has the counts of every file it includes, so a
+ * header shared by two fragments has the same counts in both. They're merged
+ * by keeping the larger count rather than adding them.
+ *
+ * A log written by the log database (see "log_db.h") is merged the same way,
+ * reading its segments instead of tables. Its typenames are sorted before
+ * they're inserted; see log_merge_typenames().
+ */
+#include "merge.h"
+
+#include "cf_alloc.h"
+#include "cf_assert.h"
+#include "cf_map.h"
+#include "cf_print.h"
+#include "cf_string.h"
+#include "db_types.h"
+#include "log_db.h"
+#include "sql_db.h"
+#include "sql_query.h"
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * A type entry read from a fragment, waiting for its first typename.
+ */
+typedef struct {
+	int64_t typeid;
+	db_type_entry_t entry;
+	loc_ctx_t loc;
+} frag_type_t;
+
+CF_VEC_GENERATE(frag_type_vec_t, frag_type_t, frag_type_vec);
+
+/*
+ * A typename read from a log, waiting to be sorted.
+ *
+ * Members
+ * - entry
+ *   The typename. Its name is owned.
+ * - loc
+ *   Its location, already translated.
+ * - seq
+ *   Position in the log. Keeps the sort stable.
+ */
+typedef struct {
+	db_typename_t entry;
+	loc_ctx_t loc;
+	size_t seq;
+} log_typename_t;
+
+CF_VEC_GENERATE(log_typename_vec_t, log_typename_t, log_typename_vec);
+CF_VEC_GENERATE(snippet_vec_t, db_snippet_t, snippet_vec);
+
+/*
+ * State for a single cf_merge_fragment() call.
+ *
+ * Members
+ * - db
+ *   Destination database.
+ * - frag
+ *   Fragment being read. Unused when merging a log.
+ * - frag_types
+ *   Every row of the fragment's type table in typeid order.
+ * - files, types, new_types, member_locs
+ *   See the top of this file.
+ * - num_typenames, num_members
+ *   Counts of rows inserted; only for logging.
+ */
+typedef struct {
+	cf_db_t *db;
+	sqlite_db_t frag;
+	frag_type_vec_t frag_types;
+
+	cf_hmap8_t files;
+	cf_hmap8_t types;
+	cf_hmap8_t new_types;
+	cf_hmap8_t member_locs;
+
+	size_t num_typenames;
+	size_t num_members;
+} merge_ctx_t;
+
+static void make_merge_ctx(cf_db_t *db, merge_ctx_t *out);
+static void free_merge_ctx(merge_ctx_t *ctx);
+
+static int merge_files(merge_ctx_t *ctx);
+static int merge_file_aliases(merge_ctx_t *ctx);
+static int load_types(merge_ctx_t *ctx);
+static int merge_typenames(merge_ctx_t *ctx);
+static int merge_one_typename(merge_ctx_t *ctx, db_typename_t *entry,
+		const loc_ctx_t *loc);
+static int merge_members(merge_ctx_t *ctx);
+static int merge_one_member(merge_ctx_t *ctx, db_member_t *entry,
+		loc_ctx_t *loc);
+static int merge_type_uses(merge_ctx_t *ctx);
+static int merge_one_type_use(merge_ctx_t *ctx, db_type_use_t *entry,
+		loc_ctx_t *loc);
+static int merge_type_use_counts(merge_ctx_t *ctx);
+static int merge_tu_deps(merge_ctx_t *ctx);
+static int merge_one_tu_dep(merge_ctx_t *ctx, int64_t tu, int64_t dep);
+static int merge_snippets(merge_ctx_t *ctx);
+
+static int log_merge_files(merge_ctx_t *ctx, const char *dir);
+static int log_load_types(merge_ctx_t *ctx, const char *dir);
+static int log_merge_typenames(merge_ctx_t *ctx, const char *dir);
+static int log_merge_members(merge_ctx_t *ctx, const char *dir);
+static int log_merge_type_uses(merge_ctx_t *ctx, const char *dir);
+static int log_merge_tu_deps(merge_ctx_t *ctx, const char *dir);
+static int log_merge_snippets(merge_ctx_t *ctx, const char *dir);
+static int flush_snippets(merge_ctx_t *ctx, int64_t file,
+		snippet_vec_t *lines);
+static int compare_log_typenames(const void *a_, const void *b_);
+
+static const frag_type_t *find_frag_type(merge_ctx_t *ctx, int64_t typeid);
+static bool translate_file(merge_ctx_t *ctx, loc_ctx_t *loc);
+static bool translate_type(merge_ctx_t *ctx, type_ref_t *ref);
+static uint64_t id_key(int64_t rowid);
+static uint64_t loc_key(const loc_ctx_t *loc);
+
+/*
+ * Merge the fragment database at `path` into `db`.
+ *
+ * Steps:
+ * - open the fragment read-only
+ * - add its files and file aliases
+ * - add types along with their first typename, or find them in `db`
+ * - add remaining typenames (typedefs, etc.)
+ * - add members and type uses of new types
+ * - add TU dependencies
+ * - add snippets, if the fragment has any
+ */
+int
+cf_merge_fragment(cf_db_t *db, const char *path)
+{
+	int error;
+	merge_ctx_t ctx;
+
+	make_merge_ctx(db, &ctx);
+
+	if ((error = sql_db_open(path, /*ro*/true, &ctx.frag))) {
+		cf_print_err("cannot open fragment '%s', error %d\n", path, error);
+		free_merge_ctx(&ctx);
+		return error;
+	}
+
+	if ((error = merge_files(&ctx))) {
+		goto fail;
+	}
+	if ((error = merge_file_aliases(&ctx))) {
+		goto fail;
+	}
+	if ((error = load_types(&ctx))) {
+		goto fail;
+	}
+	if ((error = merge_typenames(&ctx))) {
+		goto fail;
+	}
+	if ((error = merge_members(&ctx))) {
+		goto fail;
+	}
+	if ((error = merge_type_uses(&ctx))) {
+		goto fail;
+	}
+	if ((error = merge_type_use_counts(&ctx))) {
+		goto fail;
+	}
+	if ((error = merge_tu_deps(&ctx))) {
+		goto fail;
+	}
+	if ((error = merge_snippets(&ctx))) {
+		goto fail;
+	}
+
+	cf_print_info("merged '%s': %zu files, %zu new types, %zu typenames, "
+			"%zu members\n", path, cf_hmap8_len(&ctx.files),
+			cf_hmap8_len(&ctx.new_types), ctx.num_typenames,
+			ctx.num_members);
+
+fail:
+	if (error) {
+		cf_print_err("cannot merge fragment '%s', error %d\n", path, error);
+	}
+	sql_db_close(&ctx.frag);
+	free_merge_ctx(&ctx);
+	return error;
+}
+
+/*
+ * Compact the log in directory `dir` into `db`.
+ *
+ * This is cf_merge_fragment() for a log: entries are deduplicated against
+ * `db` the same way, so several logs, or a log and fragments, can be merged
+ * into one database.
+ *
+ * Each segment is read start to end once. Rows are appended to every table
+ * in id order except for the typename table, the only one with secondary
+ * indexes. Its rows are sorted by the key of its scope index first, so the
+ * index is built with mostly sequential inserts, and the lookup done per
+ * typename walks the index in order.
+ *
+ * Steps:
+ * - add every file
+ * - read every type
+ * - sort the typenames, then add them with their types
+ * - add members and type uses of new types
+ * - add TU dependencies and snippets
+ */
+int
+cf_merge_log(cf_db_t *db, const char *dir)
+{
+	int error;
+	merge_ctx_t ctx;
+
+	make_merge_ctx(db, &ctx);
+
+	if ((error = log_merge_files(&ctx, dir))) {
+		goto fail;
+	}
+	if ((error = log_load_types(&ctx, dir))) {
+		goto fail;
+	}
+	if ((error = log_merge_typenames(&ctx, dir))) {
+		goto fail;
+	}
+	if ((error = log_merge_members(&ctx, dir))) {
+		goto fail;
+	}
+	if ((error = log_merge_type_uses(&ctx, dir))) {
+		goto fail;
+	}
+	if ((error = log_merge_tu_deps(&ctx, dir))) {
+		goto fail;
+	}
+	if ((error = log_merge_snippets(&ctx, dir))) {
+		goto fail;
+	}
+
+	cf_print_info("merged log '%s': %zu files, %zu new types, "
+			"%zu typenames, %zu members\n", dir, cf_hmap8_len(&ctx.files),
+			cf_hmap8_len(&ctx.new_types), ctx.num_typenames,
+			ctx.num_members);
+
+fail:
+	if (error) {
+		cf_print_err("cannot merge log '%s', error %d\n", dir, error);
+	}
+	free_merge_ctx(&ctx);
+	return error;
+}
+
+static void
+make_merge_ctx(cf_db_t *db, merge_ctx_t *out)
+{
+	memset(out, 0, sizeof(*out));
+	out->db = db;
+	frag_type_vec_make(&out->frag_types);
+	cf_hmap8_make(&out->files);
+	cf_hmap8_make(&out->types);
+	cf_hmap8_make(&out->new_types);
+	cf_hmap8_make(&out->member_locs);
+}
+
+/*
+ * Free everything in `ctx` but the fragment.
+ */
+static void
+free_merge_ctx(merge_ctx_t *ctx)
+{
+	cf_hmap8_free(&ctx->member_locs);
+	cf_hmap8_free(&ctx->new_types);
+	cf_hmap8_free(&ctx->types);
+	cf_hmap8_free(&ctx->files);
+	frag_type_vec_free(&ctx->frag_types);
+}
+
+/*
+ * Add every file in the fragment to `ctx->db`.
+ *
+ * cf_db_add_file() finds files the database already has, by path or by
+ * content, so shared headers keep a single rowid. A fragment file that
+ * duplicates another file's content translates to that file.
+ */
+static int
+merge_files(merge_ctx_t *ctx)
+{
+	int error;
+	sqlite3_stmt *stmt;
+
+	if ((error = scan_files(ctx->frag.sql, &stmt))) {
+		return error;
+	}
+
+	while (!(error = iter_next_scan_row(stmt))) {
+		int64_t rowid;
+		cf_str_t path;
+		if ((error = iter_get_scan_file(stmt, &rowid, &path))) {
+			goto fail;
+		}
+
+		file_ref_t ref;
+		bool alias;
+		if ((error = cf_db_add_file(ctx->db, path.str, cf_str_len(&path),
+				&ref, &alias))) {
+			// e.g., a generated header deleted after the build
+			cf_print_warn("cannot add fragment file '%.*s', error %d\n",
+					(int)cf_str_len(&path), path.str, error);
+			continue;
+		}
+		// a duplicate of a file in `db` is translated to it; its entries
+		// are found there, not added again
+		if ((error = cf_hmap8_insert(&ctx->files, id_key(rowid),
+				(uint64_t)ref.rowid))) {
+			goto fail;
+		}
+	}
+
+	if (error == ENOENT) {
+		error = 0;
+	}
+fail:
+	free_scan_rows(stmt);
+	return error;
+}
+
+/*
+ * Add the paths of duplicate files in the fragment to `ctx->db`.
+ *
+ * These have no entries of their own; adding them only records the path.
+ */
+static int
+merge_file_aliases(merge_ctx_t *ctx)
+{
+	int error;
+	sqlite3_stmt *stmt;
+
+	if ((error = scan_file_aliases(ctx->frag.sql, &stmt))) {
+		return error;
+	}
+
+	while (!(error = iter_next_scan_row(stmt))) {
+		int64_t file;
+		cf_str_t path;
+		if ((error = iter_get_scan_file_alias(stmt, &file, &path))) {
+			goto fail;
+		}
+
+		file_ref_t ref;
+		bool alias;
+		if (cf_db_add_file(ctx->db, path.str, cf_str_len(&path), &ref,
+				&alias)) {
+			cf_print_warn("cannot add fragment alias '%.*s'\n",
+					(int)cf_str_len(&path), path.str);
+		}
+	}
+
+	if (error == ENOENT) {
+		error = 0;
+	}
+fail:
+	free_scan_rows(stmt);
+	return error;
+}
+
+/*
+ * Read the fragment's type table into `ctx->frag_types`.
+ *
+ * Types are only inserted into the destination once their first typename is
+ * seen, because the name decides whether the type already exists there.
+ */
+static int
+load_types(merge_ctx_t *ctx)
+{
+	int error;
+	sqlite3_stmt *stmt;
+
+	if ((error = scan_types(ctx->frag.sql, &stmt))) {
+		return error;
+	}
+
+	while (!(error = iter_next_scan_row(stmt))) {
+		frag_type_t type;
+		if ((error = iter_get_scan_type(stmt, &type.typeid, &type.entry,
+				&type.loc))) {
+			goto fail;
+		}
+		if (!frag_type_vec_push(&ctx->frag_types, &type)) {
+			error = ENOMEM;
+			goto fail;
+		}
+	}
+
+	if (error == ENOENT) {
+		error = 0;
+	}
+fail:
+	free_scan_rows(stmt);
+	return error;
+}
+
+/*
+ * Merge every typename of the fragment, in insertion order.
+ *
+ * The indexer inserts a type and its primary name back to back, so the first
+ * typename seen for a type is the one cf_db_typename_lookup() dedupes it
+ * with.
+ */
+static int
+merge_typenames(merge_ctx_t *ctx)
+{
+	int error;
+	sqlite3_stmt *stmt;
+
+	if ((error = scan_typenames(ctx->frag.sql, &stmt))) {
+		return error;
+	}
+
+	while (!(error = iter_next_scan_row(stmt))) {
+		int64_t rowid;
+		db_typename_t entry;
+		type_kind_t type_kind;
+		loc_ctx_t loc;
+		if ((error = iter_get_scan_typename(stmt, &rowid, &entry, &type_kind,
+				&loc))) {
+			goto fail;
+		}
+		if (!translate_file(ctx, &loc)) {
+			continue;
+		}
+		if ((error = merge_one_typename(ctx, &entry, &loc))) {
+			goto fail;
+		}
+	}
+
+	if (error == ENOENT) {
+		error = 0;
+	}
+fail:
+	free_scan_rows(stmt);
+	return error;
+}
+
+/*
+ * Merge a single typename `entry` located at `loc` (already translated).
+ *
+ * Steps:
+ * - if the type `entry` names was seen before, this is another name for it
+ *   add `entry` unless `db` has it
+ * - otherwise, look up `entry` in `db`
+ *   if found, the type already exists; map it
+ *   if not, insert the type then `entry`; map it as new
+ */
+static int
+merge_one_typename(merge_ctx_t *ctx, db_typename_t *entry,
+		const loc_ctx_t *loc)
+{
+	int error;
+	const int64_t frag_typeid = entry->base_type.rowid;
+
+	type_ref_t found;
+	error = cf_db_typename_lookup(ctx->db, loc, entry, &found);
+	if (error && (error != ENOENT)) {
+		return error;
+	}
+	const bool exists = !error;
+
+	// another name for a type already merged
+	if (translate_type(ctx, &entry->base_type)) {
+		if (exists) {
+			return 0;
+		}
+		++ctx->num_typenames;
+		return cf_db_typename_insert(ctx->db, loc, entry);
+	}
+
+	// first name of a type
+	if (exists) {
+		return cf_hmap8_insert(&ctx->types, id_key(frag_typeid),
+				(uint64_t)found.rowid);
+	}
+
+	const frag_type_t *type = find_frag_type(ctx, frag_typeid);
+	if (!type) {
+		cf_print_warn("fragment typename '%.*s' has no type %lld\n",
+				(int)cf_str_len(&entry->name), entry->name.str,
+				p_(frag_typeid));
+		return 0;
+	}
+	loc_ctx_t type_loc = type->loc;
+	if (!translate_file(ctx, &type_loc)) {
+		return 0;
+	}
+
+	type_ref_t ref;
+	if ((error = cf_db_type_insert(ctx->db, &type_loc, &type->entry, &ref))) {
+		return error;
+	}
+	entry->base_type = ref;
+	if ((error = cf_db_typename_insert(ctx->db, loc, entry))) {
+		return error;
+	}
+	++ctx->num_typenames;
+
+	if ((error = cf_hmap8_insert(&ctx->types, id_key(frag_typeid),
+			(uint64_t)ref.rowid))) {
+		return error;
+	}
+	return cf_hmap8_insert(&ctx->new_types, id_key(frag_typeid), 1);
+}
+
+/*
+ * Merge members of types new to `ctx->db`.
+ */
+static int
+merge_members(merge_ctx_t *ctx)
+{
+	int error;
+	sqlite3_stmt *stmt;
+
+	if ((error = scan_members(ctx->frag.sql, &stmt))) {
+		return error;
+	}
+
+	while (!(error = iter_next_scan_row(stmt))) {
+		db_member_t entry;
+		loc_ctx_t loc;
+		if ((error = iter_get_scan_member(stmt, &entry, &loc))) {
+			goto fail;
+		}
+		if ((error = merge_one_member(ctx, &entry, &loc))) {
+			goto fail;
+		}
+	}
+
+	if (error == ENOENT) {
+		error = 0;
+	}
+fail:
+	free_scan_rows(stmt);
+	return error;
+}
+
+/*
+ * Merge member `entry` at `loc`, both untranslated, if its parent is new.
+ */
+static int
+merge_one_member(merge_ctx_t *ctx, db_member_t *entry, loc_ctx_t *loc)
+{
+	int error;
+
+	uint64_t dummy;
+	if (!cf_hmap8_lookup(&ctx->new_types, id_key(entry->parent.rowid),
+			&dummy)) {
+		return 0;
+	}
+	// base type 0 is a primitive
+	if (!translate_type(ctx, &entry->parent) ||
+			(entry->base_type.rowid &&
+					!translate_type(ctx, &entry->base_type)) ||
+			!translate_file(ctx, loc)) {
+		return 0;
+	}
+
+	if ((error = cf_db_member_insert(ctx->db, loc, entry))) {
+		return error;
+	}
+	++ctx->num_members;
+	return cf_hmap8_insert(&ctx->member_locs, loc_key(loc), 1);
+}
+
+/*
+ * Merge type uses declared by members merged in merge_members().
+ */
+static int
+merge_type_uses(merge_ctx_t *ctx)
+{
+	int error;
+	sqlite3_stmt *stmt;
+
+	if ((error = scan_type_uses(ctx->frag.sql, &stmt))) {
+		return error;
+	}
+
+	while (!(error = iter_next_scan_row(stmt))) {
+		db_type_use_t entry;
+		loc_ctx_t loc;
+		if ((error = iter_get_scan_type_use(stmt, &entry, &loc))) {
+			goto fail;
+		}
+		if ((error = merge_one_type_use(ctx, &entry, &loc))) {
+			goto fail;
+		}
+	}
+
+	if (error == ENOENT) {
+		error = 0;
+	}
+fail:
+	free_scan_rows(stmt);
+	return error;
+}
+
+/*
+ * Merge type use `entry` at `loc`, both untranslated, if it belongs to a
+ * merged member.
+ */
+static int
+merge_one_type_use(merge_ctx_t *ctx, db_type_use_t *entry, loc_ctx_t *loc)
+{
+	if (!translate_file(ctx, loc) || !translate_type(ctx, &entry->base_type)) {
+		return 0;
+	}
+
+	uint64_t dummy;
+	if (!cf_hmap8_lookup(&ctx->member_locs, loc_key(loc), &dummy)) {
+		return 0;
+	}
+	return cf_db_type_use_insert(ctx->db, loc, entry);
+}
+
+/*
+ * Merge the fragment's aggregated type use counts. Empty unless it was
+ * indexed with `index_config_t::count_uses`.
+ */
+static int
+merge_type_use_counts(merge_ctx_t *ctx)
+{
+	int error;
+	sqlite3_stmt *stmt;
+
+	if ((error = scan_type_use_counts(ctx->frag.sql, &stmt))) {
+		return error;
+	}
+
+	while (!(error = iter_next_scan_row(stmt))) {
+		db_type_use_count_t entry;
+		if ((error = iter_get_scan_type_use_count(stmt, &entry))) {
+			goto fail;
+		}
+
+		loc_ctx_t loc = {
+			.file = entry.file,
+		};
+		if (!translate_file(ctx, &loc) ||
+				!translate_type(ctx, &entry.base_type)) {
+			continue;
+		}
+		entry.file = loc.file;
+
+		if ((error = cf_db_type_use_count_insert(ctx->db, &entry,
+				/*max*/true))) {
+			goto fail;
+		}
+	}
+
+	if (error == ENOENT) {
+		error = 0;
+	}
+fail:
+	free_scan_rows(stmt);
+	return error;
+}
+
+static int
+merge_tu_deps(merge_ctx_t *ctx)
+{
+	int error;
+	sqlite3_stmt *stmt;
+
+	if ((error = scan_tu_deps(ctx->frag.sql, &stmt))) {
+		return error;
+	}
+
+	while (!(error = iter_next_scan_row(stmt))) {
+		int64_t tu;
+		int64_t dep;
+		if ((error = iter_get_scan_tu_dep(stmt, &tu, &dep))) {
+			goto fail;
+		}
+		if ((error = merge_one_tu_dep(ctx, tu, dep))) {
+			goto fail;
+		}
+	}
+
+	if (error == ENOENT) {
+		error = 0;
+	}
+fail:
+	free_scan_rows(stmt);
+	return error;
+}
+
+/*
+ * Merge the dependency of TU `tu` on file `dep`, both untranslated.
+ */
+static int
+merge_one_tu_dep(merge_ctx_t *ctx, int64_t tu, int64_t dep)
+{
+	loc_ctx_t tu_loc = {
+		.file = {
+			.rowid = tu,
+		},
+	};
+	loc_ctx_t dep_loc = {
+		.file = {
+			.rowid = dep,
+		},
+	};
+	if (!translate_file(ctx, &tu_loc) || !translate_file(ctx, &dep_loc)) {
+		return 0;
+	}
+	return cf_db_tu_dep_insert(ctx->db, tu_loc.file, dep_loc.file);
+}
+
+/*
+ * Add the source line snippets of each merged file. They're merged with lines
+ * `ctx->db` already has for the file, e.g., from another fragment that
+ * includes the same header.
+ */
+static int
+merge_snippets(merge_ctx_t *ctx)
+{
+	int error;
+	sqlite3_stmt *stmt;
+
+	if ((error = scan_snippets(ctx->frag.sql, &stmt))) {
+		return error;
+	}
+
+	while (!(error = iter_next_scan_row(stmt))) {
+		loc_ctx_t loc = {0};
+		snippet_block_t block;
+		if ((error = iter_get_scan_snippets(stmt, &loc.file.rowid, &block))) {
+			goto fail;
+		}
+		if (translate_file(ctx, &loc)) {
+			error = cf_db_snippet_insert(ctx->db, loc.file, block.lines,
+					block.num_lines);
+		}
+		snippet_block_free(&block);
+		if (error) {
+			goto fail;
+		}
+	}
+
+	if (error == ENOENT) {
+		error = 0;
+	}
+fail:
+	free_scan_rows(stmt);
+	return error;
+}
+
+/*
+ * Add every file in the log in `dir` to `ctx->db`, like merge_files().
+ *
+ * The log has no file aliases: it only compares paths. Duplicate contents are
+ * found here, as each path is added to `ctx->db`, and a duplicate translates
+ * to the file it duplicates.
+ */
+static int
+log_merge_files(merge_ctx_t *ctx, const char *dir)
+{
+	int error;
+	log_reader_t reader;
+
+	if ((error = log_reader_open(dir, log_seg_files, &reader))) {
+		return error;
+	}
+
+	int64_t id;
+	cf_str_t path;
+	while (!(error = log_read_file(&reader, &id, &path))) {
+		file_ref_t ref;
+		bool alias;
+		if ((error = cf_db_add_file(ctx->db, path.str, cf_str_len(&path),
+				&ref, &alias))) {
+			cf_print_warn("cannot add log file '%.*s', error %d\n",
+					(int)cf_str_len(&path), path.str, error);
+			continue;
+		}
+		// a duplicate of a file in `db` (the log only compared paths) is
+		// translated to it; its entries are found there, not added again
+		if ((error = cf_hmap8_insert(&ctx->files, id_key(id),
+				(uint64_t)ref.rowid))) {
+			goto fail;
+		}
+	}
+
+	if (error == ENOENT) {
+		error = 0;
+	}
+fail:
+	log_reader_close(&reader);
+	return error;
+}
+
+/*
+ * Read the log's types into `ctx->frag_types`, like load_types(). They're
+ * logged in id order.
+ */
+static int
+log_load_types(merge_ctx_t *ctx, const char *dir)
+{
+	int error;
+	log_reader_t reader;
+
+	if ((error = log_reader_open(dir, log_seg_types, &reader))) {
+		return error;
+	}
+
+	frag_type_t type;
+	while (!(error = log_read_type(&reader, &type.typeid, &type.entry,
+			&type.loc))) {
+		if (!frag_type_vec_push(&ctx->frag_types, &type)) {
+			error = ENOMEM;
+			goto fail;
+		}
+	}
+
+	if (error == ENOENT) {
+		error = 0;
+	}
+fail:
+	log_reader_close(&reader);
+	return error;
+}
+
+/*
+ * Merge every typename of the log, sorted by the key of
+ * `TYPENAME_SCOPE_INDEX_NAME`.
+ *
+ * Unlike a fragment, the order names were logged in doesn't matter for
+ * dedupe: the log already deduped them against each other. Ties keep the log
+ * order.
+ */
+static int
+log_merge_typenames(merge_ctx_t *ctx, const char *dir)
+{
+	int error;
+	log_reader_t reader;
+	log_typename_vec_t names;
+
+	if ((error = log_reader_open(dir, log_seg_typenames, &reader))) {
+		return error;
+	}
+	log_typename_vec_make(&names);
+
+	log_typename_t name;
+	for (name.seq = 0; !(error = log_read_typename(&reader, &name.entry,
+			&name.loc)); ++name.seq) {
+		if (!translate_file(ctx, &name.loc)) {
+			continue;
+		}
+		cf_str_t borrowed = name.entry.name;
+		if ((error = cf_str_dup_str(&borrowed, &name.entry.name))) {
+			goto fail;
+		}
+		if (!log_typename_vec_push(&names, &name)) {
+			cf_str_free(&name.entry.name);
+			error = ENOMEM;
+			goto fail;
+		}
+	}
+	if (error != ENOENT) {
+		goto fail;
+	}
+
+	const size_t len = log_typename_vec_len(&names);
+	if (len) {
+		qsort(log_typename_vec_at(&names, 0), len, sizeof(name),
+				compare_log_typenames);
+	}
+
+	error = 0;
+	for (size_t i = 0; i < len; ++i) {
+		log_typename_t *entry = log_typename_vec_at(&names, i);
+		if ((error = merge_one_typename(ctx, &entry->entry, &entry->loc))) {
+			break;
+		}
+	}
+
+fail:
+	for (size_t i = 0; i < log_typename_vec_len(&names); ++i) {
+		cf_str_free(&log_typename_vec_at(&names, i)->entry.name);
+	}
+	log_typename_vec_free(&names);
+	log_reader_close(&reader);
+	return error;
+}
+
+static int
+log_merge_members(merge_ctx_t *ctx, const char *dir)
+{
+	int error;
+	log_reader_t reader;
+
+	if ((error = log_reader_open(dir, log_seg_members, &reader))) {
+		return error;
+	}
+
+	db_member_t entry;
+	loc_ctx_t loc;
+	while (!(error = log_read_member(&reader, &entry, &loc))) {
+		if ((error = merge_one_member(ctx, &entry, &loc))) {
+			goto fail;
+		}
+	}
+
+	if (error == ENOENT) {
+		error = 0;
+	}
+fail:
+	log_reader_close(&reader);
+	return error;
+}
+
+static int
+log_merge_type_uses(merge_ctx_t *ctx, const char *dir)
+{
+	int error;
+	log_reader_t reader;
+
+	if ((error = log_reader_open(dir, log_seg_type_uses, &reader))) {
+		return error;
+	}
+
+	db_type_use_t entry;
+	loc_ctx_t loc;
+	while (!(error = log_read_type_use(&reader, &entry, &loc))) {
+		if ((error = merge_one_type_use(ctx, &entry, &loc))) {
+			goto fail;
+		}
+	}
+
+	if (error == ENOENT) {
+		error = 0;
+	}
+fail:
+	log_reader_close(&reader);
+	return error;
+}
+
+static int
+log_merge_tu_deps(merge_ctx_t *ctx, const char *dir)
+{
+	int error;
+	log_reader_t reader;
+
+	if ((error = log_reader_open(dir, log_seg_tu_deps, &reader))) {
+		return error;
+	}
+
+	int64_t tu;
+	int64_t dep;
+	while (!(error = log_read_tu_dep(&reader, &tu, &dep))) {
+		if ((error = merge_one_tu_dep(ctx, tu, dep))) {
+			goto fail;
+		}
+	}
+
+	if (error == ENOENT) {
+		error = 0;
+	}
+fail:
+	log_reader_close(&reader);
+	return error;
+}
+
+/*
+ * Add the log's snippets, like merge_snippets().
+ *
+ * The log has a record per line. Each run of lines of one file with
+ * increasing line numbers came from a single cf_db_snippet_insert(), so it's
+ * inserted back with one call.
+ */
+static int
+log_merge_snippets(merge_ctx_t *ctx, const char *dir)
+{
+	int error;
+	log_reader_t reader;
+	snippet_vec_t lines;
+	int64_t run_file = 0;
+
+	if ((error = log_reader_open(dir, log_seg_snippets, &reader))) {
+		return error;
+	}
+	snippet_vec_make(&lines);
+
+	int64_t file;
+	db_snippet_t line;
+	while (!(error = log_read_snippet(&reader, &file, &line))) {
+		const size_t len = snippet_vec_len(&lines);
+		if (len && ((file != run_file) ||
+				(line.line <= snippet_vec_at(&lines, len - 1)->line))) {
+			if ((error = flush_snippets(ctx, run_file, &lines))) {
+				goto fail;
+			}
+		}
+		run_file = file;
+		// the text is borrowed from `reader`; keep it until the run ends
+		cf_str_t borrowed = line.text;
+		if ((error = cf_str_dup_str(&borrowed, &line.text))) {
+			goto fail;
+		}
+		if (!snippet_vec_push(&lines, &line)) {
+			cf_str_free(&line.text);
+			error = ENOMEM;
+			goto fail;
+		}
+	}
+	if (error != ENOENT) {
+		goto fail;
+	}
+	error = flush_snippets(ctx, run_file, &lines);
+
+fail:
+	// free whatever wasn't flushed
+	(void)flush_snippets(NULL, 0, &lines);
+	snippet_vec_free(&lines);
+	log_reader_close(&reader);
+	return error;
+}
+
+/*
+ * Insert `lines` of log file `file` into `ctx->db`, then empty `lines`.
+ * With a NULL `ctx`, only empty it.
+ */
+static int
+flush_snippets(merge_ctx_t *ctx, int64_t file, snippet_vec_t *lines)
+{
+	int error = 0;
+	const size_t len = snippet_vec_len(lines);
+
+	loc_ctx_t loc = {
+		.file = {
+			.rowid = file,
+		},
+	};
+	if (ctx && len && translate_file(ctx, &loc)) {
+		error = cf_db_snippet_insert(ctx->db, loc.file,
+				snippet_vec_at(lines, 0), len);
+	}
+
+	for (size_t i = 0; i < len; ++i) {
+		cf_str_free(&snippet_vec_at(lines, i)->text);
+	}
+	snippet_vec_reset(lines);
+	return error;
+}
+
+/*
+ * qsort(3) comparator of `log_typename_t`s: scope, func, file, name, then log
+ * order.
+ *
+ * Names compare like sqlite's BINARY collation: bytes, then length.
+ */
+static int
+compare_log_typenames(const void *a_, const void *b_)
+{
+	const log_typename_t *a = a_;
+	const log_typename_t *b = b_;
+
+	if (a->loc.scope != b->loc.scope) {
+		return (a->loc.scope < b->loc.scope) ? -1 : 1;
+	}
+	if (a->loc.func.rowid != b->loc.func.rowid) {
+		return (a->loc.func.rowid < b->loc.func.rowid) ? -1 : 1;
+	}
+	if (a->loc.file.rowid != b->loc.file.rowid) {
+		return (a->loc.file.rowid < b->loc.file.rowid) ? -1 : 1;
+	}
+
+	const size_t a_len = cf_str_len(&a->entry.name);
+	const size_t b_len = cf_str_len(&b->entry.name);
+	const size_t len = (a_len < b_len) ? a_len : b_len;
+	const int diff = len ? memcmp(a->entry.name.str, b->entry.name.str, len) :
+			0;
+	if (diff) {
+		return diff;
+	}
+	if (a_len != b_len) {
+		return (a_len < b_len) ? -1 : 1;
+	}
+	return (a->seq < b->seq) ? -1 : (a->seq > b->seq);
+}
+
+/*
+ * Binary search `ctx->frag_types` for `typeid`.
+ */
+static const frag_type_t *
+find_frag_type(merge_ctx_t *ctx, int64_t typeid)
+{
+	size_t lo = 0;
+	size_t hi = frag_type_vec_len(&ctx->frag_types);
+
+	while (lo < hi) {
+		const size_t mid = lo + ((hi - lo) / 2);
+		const frag_type_t *type = frag_type_vec_at(&ctx->frag_types, mid);
+		if (type->typeid == typeid) {
+			return type;
+		}
+		if (type->typeid < typeid) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
+		}
+	}
+	return NULL;
+}
+
+/*
+ * Translate the file of `loc` from a fragment rowid to a `ctx->db` rowid.
+ *
+ * Return false if the file wasn't merged.
+ */
+static bool
+translate_file(merge_ctx_t *ctx, loc_ctx_t *loc)
+{
+	uint64_t rowid;
+	if (!cf_hmap8_lookup(&ctx->files, id_key(loc->file.rowid), &rowid)) {
+		return false;
+	}
+	loc->file.rowid = (int64_t)rowid;
+	return true;
+}
+
+/*
+ * Translate `ref` from a fragment typeid to a `ctx->db` typeid.
+ */
+static bool
+translate_type(merge_ctx_t *ctx, type_ref_t *ref)
+{
+	uint64_t rowid;
+	if (!cf_hmap8_lookup(&ctx->types, id_key(ref->rowid), &rowid)) {
+		return false;
+	}
+	ref->rowid = (int64_t)rowid;
+	return true;
+}
+
+/*
+ * Turn a rowid into a `cf_hmap8_t` key. Rowids start at 1, but be careful
+ * anyway because 0 is reserved.
+ */
+static uint64_t
+id_key(int64_t rowid)
+{
+	return (uint64_t)rowid + 1;
+}
+
+/*
+ * Turn a source location into a `cf_hmap8_t` key.
+ */
+static uint64_t
+loc_key(const loc_ctx_t *loc)
+{
+	uint64_t key = cf_hash_bytes(0, &loc->file.rowid, sizeof(loc->file.rowid));
+	key = cf_hash_bytes(key, &loc->line, sizeof(loc->line));
+	key = cf_hash_bytes(key, &loc->column, sizeof(loc->column));
+	return key ? key : 1;
+}
@@ -0,0 +1,27 @@
+/*
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ * Copyright (C) 2024 cfind developer
+ *
+ * Fold index fragments into a database.
+ *
+ * A fragment is an ordinary sqlite cfind database holding the index of a
+ * single TU. `cfind-cc` writes one next to each object file as a build runs.
+ * Merging replays a fragment into a larger database through the cf_db
+ * frontend, with the same deduplication rules the indexer uses: files by path
+ * and content, types by (file, name), and members/type uses only for types
+ * that are new.
+ *
+ * A log written by the log database backend is compacted into a database the
+ * same way.
+ */
+#pragma once
+
+#include "cc_support.h"
+#include "cf_db.h"
+
+__BEGIN_DECLS
+
+int cf_merge_fragment(cf_db_t *db, const char *path);
+int cf_merge_log(cf_db_t *db, const char *dir);
+
+__END_DECLS
@@ -47,6 +47,14 @@ nop_db_typename_lookup(nop_db_t *db, const loc_ctx_t *loc,
 	return ENOENT;
 }
 
+int
+nop_db_typename_lookup_many(nop_db_t *db, const db_typename_key_t *keys,
+		size_t num_keys, type_ref_t *out)
+{
+	memset(out, 0, num_keys * sizeof(*out));
+	return 0;
+}
+
 int
 nop_db_type_insert(nop_db_t *db, const loc_ctx_t *loc,
 		const db_type_entry_t *entry, int64_t *out)
@@ -77,6 +85,13 @@ nop_db_type_use_insert(nop_db_t *db, const loc_ctx_t *loc,
 	return 0;
 }
 
+int
+nop_db_type_use_count_insert(nop_db_t *db, const db_type_use_count_t *entry,
+		bool max)
+{
+	return 0;
+}
+
 int
 nop_db_type_lookup(nop_db_t *db, int64_t id, db_type_entry_t *entry_out,
 		loc_ctx_t *loc_out)
@@ -92,14 +107,14 @@ nop_db_file_lookup(nop_db_t *db, int64_t id, cf_str_t *out)
 
 int
 nop_db_typename_find(nop_db_t *db, const cf_str_t *name,
-		nop_db_typename_iter_t *out)
+		const db_filter_t *filter, nop_db_typename_iter_t *out)
 {
 	return ENOTSUP;
 }
 
 int
 nop_db_member_lookup(nop_db_t *db, int64_t parent, const cf_str_t *member,
-		db_member_t *entry_out, loc_ctx_t *loc_out)
+		const db_filter_t *filter, db_member_t *entry_out, loc_ctx_t *loc_out)
 {
 	return ENOENT;
 }
@@ -123,4 +138,10 @@ nop_db_typename_iter_next(nop_db_t *db, nop_db_typename_iter_t *it)
 	cf_panic("nop typename iterator not supported");
 }
 
+int64_t
+nop_db_typename_iter_cursor(const nop_db_typename_iter_t *it)
+{
+	cf_panic("nop typename iterator not supported");
+}
+
 #pragma clang diagnostic pop // -Wunused-parameter
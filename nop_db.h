@@ -39,6 +39,8 @@ int nop_db_add_type(nop_db_t *db, const loc_ctx_t *loc,
 
 int nop_db_typename_lookup(nop_db_t *db, const loc_ctx_t *loc,
 		const db_typename_t *name, int64_t *out);
+int nop_db_typename_lookup_many(nop_db_t *db,
+		const db_typename_key_t *keys, size_t num_keys, type_ref_t *out);
 int nop_db_type_insert(nop_db_t *db, const loc_ctx_t *loc,
 		const db_type_entry_t *entry, int64_t *out);
 int nop_db_typename_insert(nop_db_t *db, const loc_ctx_t *loc,
@@ -47,19 +49,22 @@ int nop_db_member_insert(nop_db_t *db, const loc_ctx_t *loc,
 		const db_member_t *entry);
 int nop_db_type_use_insert(nop_db_t *db, const loc_ctx_t *loc,
 		const db_type_use_t *entry);
+int nop_db_type_use_count_insert(nop_db_t *db,
+		const db_type_use_count_t *entry, bool max);
 
 int nop_db_type_lookup(nop_db_t *db, int64_t id,
 		db_type_entry_t *entry_out, loc_ctx_t *loc_out);
 int nop_db_file_lookup(nop_db_t *db, int64_t id, cf_str_t *out);
 int nop_db_member_lookup(nop_db_t *db, int64_t parent, const cf_str_t *member,
-		db_member_t *entry_out, loc_ctx_t *loc_out);
+		const db_filter_t *filter, db_member_t *entry_out, loc_ctx_t *loc_out);
 int nop_db_typename_find(nop_db_t *db, const cf_str_t *name,
-		nop_db_typename_iter_t *out);
+		const db_filter_t *filter, nop_db_typename_iter_t *out);
 
 void nop_db_typename_iter_free(nop_db_typename_iter_t *it);
 void nop_db_typename_iter_peek(const nop_db_t *db,
 		const nop_db_typename_iter_t *it, db_typename_t *entry_out,
 		loc_ctx_t *loc_out);
 bool nop_db_typename_iter_next(nop_db_t *db, nop_db_typename_iter_t *it);
+int64_t nop_db_typename_iter_cursor(const nop_db_typename_iter_t *it);
 
 __END_DECLS
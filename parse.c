@@ -34,6 +34,9 @@
 #include <string.h>
 
 static int parse_command_verb(cf_tok_iter_t *iter, search_kind_t *out);
+static int parse_options(cf_tok_iter_t *iter, db_filter_t *out);
+static int parse_one_option(const cf_str_t *opt, cf_tok_iter_t *iter,
+		db_filter_t *out);
 static int parse_type_search(cf_tok_iter_t *iter, type_search_t *out);
 static int parse_typename_search(cf_tok_iter_t *iter, typename_search_t *out);
 static int parse_member_search(cf_tok_iter_t *iter, member_search_t *out);
@@ -48,6 +51,9 @@ static bool is_digit(char c);
 
 static bool command_string2kind(const cf_str_t *str, search_kind_t *out);
 static name_elab_t str2elab(const cf_str_t *str);
+static bool str2name_kind(const cf_str_t *str, typename_kind_t *out);
+static bool str2order(const cf_str_t *str, db_order_t *out);
+static bool str2scope(const cf_str_t *str, db_scope_filter_t *out);
 
 static bool litcmp_(const char *lit, size_t len, const cf_str_t *s2);
 
@@ -75,10 +81,25 @@ static bool litcmp_(const char *lit, size_t len, const cf_str_t *s2);
  *   td, typedecl    search for type declaration
  *   tn, typename    name of a type
  *   md, memberdecl  member declaration
- *   XXX add type use and member use
+ *   tu, typeuse     count uses of a type
+ *   XXX add member use
  *
  * OPTIONS:
- *   XXX unimplemented
+ *   -k, --kind KIND        only types of KIND: struct, union, enum
+ *   -n, --name-kind NKIND  only typenames of NKIND: direct, typedef, var
+ *   -f, --file GLOB        only declarations in files whose path matches GLOB
+ *   -l, --limit N          at most N results
+ *   -o, --order ORDER      sort results by ORDER: name, file
+ *   -a, --after CURSOR     continue a listing after CURSOR
+ *   -s, --scope SCOPE      only typenames declared at SCOPE: global, local
+ *
+ * Options are filters. They're passed down to the database query rather than
+ * applied to its results. For `memberdecl`, they apply to both the owning
+ * type lookup and the member lookup.
+ *
+ * A listing cut short by `--limit` ends with a line giving its CURSOR. The
+ * same command plus `--after CURSOR` prints the next page. Only listings
+ * (`typename`, ambiguous names) use it; finding a single type ignores it.
  *
  * Commands explained:
  * - typedecl
@@ -112,6 +133,12 @@ static bool litcmp_(const char *lit, size_t len, const cf_str_t *s2);
  *     same as typedecl argument
  *   - <member-name>
  *     name of the member
+ * - typeuse
+ *   Count the uses of a user defined type, per file and kind of use. Only
+ *   databases indexed with aggregated type uses (`cfind-index -U`) have
+ *   counts.
+ *   ARGS: <ID> | <name>
+ *     same as typedecl
  *
  * ----------------
  * Steps:
@@ -141,7 +168,13 @@ parse_command(const cf_str_t *cmd_str, search_cmd_t *out)
 
 	out->kind = cmd;
 
-	// parse tokens 1... as args specific to `cmd`
+	// parse options up to the first arg
+	if ((error = parse_options(&iter, &out->filter))) {
+		cf_print_err("can't parse options, error %d\n", error);
+		goto fail;
+	}
+
+	// parse remaining tokens as args specific to `cmd`
 	switch (cmd) {
 		case search_type_decl:
 			error = parse_type_search(&iter, &out->arg.type);
@@ -152,6 +185,9 @@ parse_command(const cf_str_t *cmd_str, search_cmd_t *out)
 		case search_member_decl:
 			error = parse_member_search(&iter, &out->arg.member);
 			break;
+		case search_type_use:
+			error = parse_type_search(&iter, &out->arg.type_use);
+			break;
 		default:
 			__builtin_unreachable();
 	}
@@ -211,6 +247,109 @@ parse_command_verb(cf_tok_iter_t *iter, search_kind_t *out)
 	return 0;
 }
 
+/*
+ * Parse tokens starting with '-' as options into `out`.
+ *
+ * On return, `iter` is left just before the first token that isn't an option
+ * so that arg parsing can extract it as usual.
+ */
+static int
+parse_options(cf_tok_iter_t *iter, db_filter_t *out)
+{
+	int error;
+
+	for (;;) {
+		// save position to un-extract a non-option token
+		const cf_tok_iter_t prev = *iter;
+		cf_str_t tok;
+
+		if (!tok_iter_next(iter)) {
+			// no args; let the arg parser report it
+			*iter = prev;
+			return 0;
+		}
+		tok_iter_peek(iter, &tok);
+
+		if (tok.str[0] != '-') {
+			*iter = prev;
+			cf_str_free(&tok);
+			return 0;
+		}
+
+		error = parse_one_option(&tok, iter, out);
+		cf_str_free(&tok);
+		if (error) {
+			return error;
+		}
+	}
+}
+
+/*
+ * Parse option `opt` and its value, the next token in `iter`, into `out`.
+ */
+static int
+parse_one_option(const cf_str_t *opt, cf_tok_iter_t *iter, db_filter_t *out)
+{
+	int error = 0;
+	cf_str_t val;
+
+	if (!tok_iter_next(iter)) {
+		cf_print_err("option '%.*s' needs a value\n",
+				(int)cf_str_len(opt), opt->str);
+		return EINVAL;
+	}
+	tok_iter_peek(iter, &val);
+
+	if (litcmp("-k", opt) || litcmp("--kind", opt)) {
+		const name_elab_t elab = str2elab(&val);
+		if (elab == name_none) {
+			goto bad_val;
+		}
+		out->type_kind = elab2type_kind(elab);
+	} else if (litcmp("-n", opt) || litcmp("--name-kind", opt)) {
+		if (!str2name_kind(&val, &out->name_kind)) {
+			goto bad_val;
+		}
+	} else if (litcmp("-f", opt) || litcmp("--file", opt)) {
+		cf_str_free(&out->file_glob);
+		cf_str_borrow_str(&val, &out->file_glob);
+	} else if (litcmp("-l", opt) || litcmp("--limit", opt)) {
+		uint64_t limit;
+		if (!str2uint64(&val, &limit) || (limit > UINT32_MAX)) {
+			goto bad_val;
+		}
+		out->limit = (uint32_t)limit;
+	} else if (litcmp("-o", opt) || litcmp("--order", opt)) {
+		if (!str2order(&val, &out->order)) {
+			goto bad_val;
+		}
+	} else if (litcmp("-a", opt) || litcmp("--after", opt)) {
+		uint64_t after;
+		if (!str2uint64(&val, &after) || !after || (after > INT64_MAX)) {
+			goto bad_val;
+		}
+		out->after = (int64_t)after;
+	} else if (litcmp("-s", opt) || litcmp("--scope", opt)) {
+		if (!str2scope(&val, &out->scope)) {
+			goto bad_val;
+		}
+	} else {
+		cf_print_err("unknown option '%.*s'\n",
+				(int)cf_str_len(opt), opt->str);
+		error = EINVAL;
+	}
+
+	cf_str_free(&val);
+	return error;
+
+bad_val:
+	cf_print_err("bad value '%.*s' for option '%.*s'\n",
+			(int)cf_str_len(&val), val.str,
+			(int)cf_str_len(opt), opt->str);
+	cf_str_free(&val);
+	return EINVAL;
+}
+
 /*
  * first token is one of three things
  * 1. numeric type ID
@@ -431,6 +570,11 @@ command_string2kind(const cf_str_t *str, search_kind_t *out)
 		return true;
 	}
 
+	if (litcmp("tu", str) || litcmp("typeuse", str)) {
+		*out = search_type_use;
+		return true;
+	}
+
 	return false;
 }
 
@@ -449,6 +593,52 @@ str2elab(const cf_str_t *str)
 	return name_none;
 }
 
+static bool
+str2name_kind(const cf_str_t *str, typename_kind_t *out)
+{
+	if (litcmp("direct", str)) {
+		*out = name_kind_direct;
+		return true;
+	}
+	if (litcmp("typedef", str)) {
+		*out = name_kind_typedef;
+		return true;
+	}
+	if (litcmp("var", str)) {
+		*out = name_kind_var;
+		return true;
+	}
+	return false;
+}
+
+static bool
+str2order(const cf_str_t *str, db_order_t *out)
+{
+	if (litcmp("name", str)) {
+		*out = db_order_name;
+		return true;
+	}
+	if (litcmp("file", str)) {
+		*out = db_order_file;
+		return true;
+	}
+	return false;
+}
+
+static bool
+str2scope(const cf_str_t *str, db_scope_filter_t *out)
+{
+	if (litcmp("global", str)) {
+		*out = db_scope_global;
+		return true;
+	}
+	if (litcmp("local", str)) {
+		*out = db_scope_local;
+		return true;
+	}
+	return false;
+}
+
 /*
  * Compare two strings for exact equality.
  *
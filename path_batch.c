@@ -0,0 +1,295 @@
+/*
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ * Copyright (C) 2024 cfind developer
+ *
+ * Thread pool implementation of "path_batch.h".
+ *
+ * Every thread, including the caller's, takes the next unresolved job off a
+ * shared atomic counter until none are left. realpath(3) is thread safe and
+ * each job only writes to itself, so no other synchronization is needed.
+ */
+#define _POSIX_C_SOURCE 200809L // for realpath(3)
+#define _XOPEN_SOURCE 700
+#include "path_batch.h"
+
+#include "cf_alloc.h"
+#include "cf_assert.h"
+#include "cf_print.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+// most threads started by one path_batch_resolve(), regardless of CPUs
+#define PATH_BATCH_MAX_THREADS 8
+// fewest jobs worth starting another thread for
+#define PATH_BATCH_JOBS_PER_THREAD 16
+
+/*
+ * State shared by the threads of one path_batch_resolve().
+ *
+ * Members
+ * - jobs, len
+ *   Jobs to resolve.
+ * - next
+ *   Index of the next job to take.
+ */
+typedef struct {
+	path_job_t *jobs;
+	size_t len;
+	atomic_size_t next;
+} resolve_ctx_t;
+
+static void *resolve_worker(void *ctx_);
+static void resolve_jobs(resolve_ctx_t *ctx);
+static uint64_t hash_path(const char *path, size_t len);
+static uint64_t get_time_ns(void);
+
+/*
+ * Initialize an empty `path_batch_t`.
+ *
+ * Threads only pay off when there's a CPU to run them while others wait on the
+ * filesystem. With a warm dentry cache, realpath(3) hardly waits at all, and
+ * extra threads on a single CPU only add switches. So the thread count is
+ * capped by the number of CPUs, less the caller's.
+ */
+void
+path_batch_make(path_batch_t *out)
+{
+	memset(out, 0, sizeof(*out));
+	cf_hmap8_make(&out->index);
+
+	const long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+	out->max_threads = (cpus > 1) ? (size_t)(cpus - 1) : 0;
+	if (out->max_threads > PATH_BATCH_MAX_THREADS) {
+		out->max_threads = PATH_BATCH_MAX_THREADS;
+	}
+}
+
+void
+path_batch_free(path_batch_t *batch)
+{
+	path_batch_reset(batch);
+	cf_free(batch->jobs);
+	batch->jobs = NULL;
+	batch->capacity = 0;
+}
+
+/*
+ * Remove every path from `batch`. Keep the job array for reuse.
+ */
+void
+path_batch_reset(path_batch_t *batch)
+{
+	for (size_t i = 0; i < batch->len; ++i) {
+		cf_free(batch->jobs[i].path);
+		free(batch->jobs[i].resolved); // from realpath(3)
+	}
+	batch->len = 0;
+	batch->resolved = 0;
+	cf_hmap8_free(&batch->index);
+}
+
+/*
+ * Add a copy of `path`, `len` bytes and not necessarily NUL terminated, to
+ * the paths resolved by the next path_batch_resolve().
+ *
+ * Adding a path already in `batch` does nothing. So does adding one whose
+ * hash collides with another; it's resolved when it's needed instead.
+ */
+int
+path_batch_add(path_batch_t *batch, const char *path, size_t len)
+{
+	int error;
+
+	const uint64_t key = hash_path(path, len);
+	uint64_t pos;
+	if (cf_hmap8_lookup(&batch->index, key, &pos)) {
+		return 0;
+	}
+
+	if (batch->len == batch->capacity) {
+		const size_t capacity = batch->capacity ? (batch->capacity * 2) : 64;
+		path_job_t *jobs = cf_realloc(batch->jobs, capacity * sizeof(*jobs));
+		if (!jobs) {
+			return ENOMEM;
+		}
+		batch->jobs = jobs;
+		batch->capacity = capacity;
+	}
+
+	char *copy = cf_malloc(len + 1);
+	if (!copy) {
+		return ENOMEM;
+	}
+	memcpy(copy, path, len);
+	copy[len] = '\0';
+
+	if ((error = cf_hmap8_insert(&batch->index, key, batch->len))) {
+		cf_free(copy);
+		return error;
+	}
+
+	batch->jobs[batch->len++] = (path_job_t) {
+		.path = copy,
+	};
+	return 0;
+}
+
+/*
+ * Resolve every path added since the last call.
+ *
+ * A failure to resolve a path is stored in its job, not returned. If threads
+ * can't be started, the caller's thread resolves the rest by itself.
+ *
+ * Steps:
+ * - pick a thread count from the number of new jobs
+ * - start the threads; the caller works alongside them
+ * - wait for all of them
+ * - update `stats`
+ */
+void
+path_batch_resolve(path_batch_t *batch, path_stats_t *stats)
+{
+	pthread_t threads[PATH_BATCH_MAX_THREADS];
+	resolve_ctx_t ctx = {
+		.jobs = &batch->jobs[batch->resolved],
+		.len = batch->len - batch->resolved,
+	};
+
+	if (!ctx.len) {
+		return;
+	}
+	atomic_init(&ctx.next, 0);
+
+	const uint64_t start = get_time_ns();
+
+	// the caller's thread counts as one
+	size_t want = (ctx.len - 1) / PATH_BATCH_JOBS_PER_THREAD;
+	if (want > batch->max_threads) {
+		want = batch->max_threads;
+	}
+	size_t num_threads = 0;
+	for (; num_threads < want; ++num_threads) {
+		int error;
+		if ((error = pthread_create(&threads[num_threads], NULL,
+				resolve_worker, &ctx))) {
+			cf_print_debug("cannot start path thread, error %d\n", error);
+			break;
+		}
+	}
+
+	resolve_jobs(&ctx);
+
+	for (size_t i = 0; i < num_threads; ++i) {
+		(void)pthread_join(threads[i], NULL);
+	}
+
+	batch->resolved = batch->len;
+
+	for (size_t i = 0; i < ctx.len; ++i) {
+		stats->batch_components += ctx.jobs[i].components;
+	}
+	++stats->num_batches;
+	stats->num_threads += num_threads;
+	stats->batch_paths += ctx.len;
+	stats->batch_ns += get_time_ns() - start;
+}
+
+/*
+ * Find the resolved job for `path`, `len` bytes and not necessarily NUL
+ * terminated.
+ *
+ * Return NULL if `path` wasn't added or hasn't been resolved yet.
+ */
+const path_job_t *
+path_batch_find(const path_batch_t *batch, const char *path, size_t len)
+{
+	uint64_t pos;
+
+	if (!cf_hmap8_lookup(&batch->index, hash_path(path, len), &pos) ||
+			(pos >= batch->resolved)) {
+		return NULL;
+	}
+	const path_job_t *job = &batch->jobs[pos];
+	if (strncmp(job->path, path, len) || job->path[len]) {
+		// another path with the same hash
+		return NULL;
+	}
+	return job;
+}
+
+static void *
+resolve_worker(void *ctx_)
+{
+	resolve_jobs(ctx_);
+	return NULL;
+}
+
+static void
+resolve_jobs(resolve_ctx_t *ctx)
+{
+	for (;;) {
+		const size_t i = atomic_fetch_add_explicit(&ctx->next, 1,
+				memory_order_relaxed);
+		if (i >= ctx->len) {
+			break;
+		}
+		path_job_t *job = &ctx->jobs[i];
+		if (!(job->resolved = realpath(job->path, NULL))) {
+			job->error = errno;
+		}
+		job->components = path_components(job->resolved ? job->resolved :
+				job->path);
+	}
+}
+
+/*
+ * Count the components of NUL-terminated `path`, as an estimate of the
+ * lookups realpath(3) does to resolve it.
+ *
+ * realpath(3) checks each component for a symlink with one lstat(2) or
+ * readlink(2), more if it follows one. Empty and "." components are skipped.
+ * A relative path is resolved from the working directory, which isn't
+ * counted.
+ */
+uint32_t
+path_components(const char *path)
+{
+	uint32_t count = 0;
+
+	while (*path) {
+		while (*path == '/') {
+			++path;
+		}
+		const char *end = path + strcspn(path, "/");
+		if ((end > path) && ((end - path != 1) || (*path != '.'))) {
+			++count;
+		}
+		path = end;
+	}
+	return count;
+}
+
+/*
+ * Hash `path` into a `cf_hmap8_t` key. 0 isn't a valid key.
+ */
+static uint64_t
+hash_path(const char *path, size_t len)
+{
+	const uint64_t key = cf_hash_bytes(0, path, len);
+	return key ? key : 1;
+}
+
+static uint64_t
+get_time_ns(void)
+{
+	struct timespec ts;
+	(void)clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ((uint64_t)ts.tv_sec * 1000000000ull) + (uint64_t)ts.tv_nsec;
+}
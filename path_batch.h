@@ -0,0 +1,114 @@
+/*
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ * Copyright (C) 2024 cfind developer
+ *
+ * Batched path resolution.
+ *
+ * Adding a file to the sql database resolves its path with realpath(3), which
+ * is a handful of lstat(2)s and readlink(2)s per path. A TU can include
+ * hundreds of new files. Resolving them one at a time, in between database
+ * queries, spends most of that time waiting on the filesystem.
+ *
+ * A `path_batch_t` collects the paths of a TU up front and resolves them all
+ * at once on a few threads. The results are then looked up as each file is
+ * added.
+ *
+ * io_uring would be the other way to issue these in parallel, but it has no
+ * path resolution operation: realpath(3) still takes a round trip per
+ * component and symlink. Plain threads keep it portable.
+ */
+#pragma once
+
+#include "cc_support.h"
+#include "cf_map.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+__BEGIN_DECLS
+
+/*
+ * One path to resolve.
+ *
+ * Members
+ * - path
+ *   Heap-allocated, NUL-terminated copy of the input path.
+ * - resolved
+ *   Canonical absolute path from realpath(3), or NULL on error.
+ * - error
+ *   errno from realpath(3), 0 on success.
+ * - components
+ *   Path components realpath(3) walked; see path_components().
+ */
+typedef struct {
+	char *path;
+	char *resolved;
+	int error;
+	uint32_t components;
+} path_job_t;
+
+/*
+ * Path resolution counters.
+ *
+ * Members
+ * - num_batches
+ *   Calls to path_batch_resolve() with at least one path.
+ * - num_threads
+ *   Threads started by those calls, not counting the caller's.
+ * - batch_paths, batch_ns
+ *   Paths resolved in batches, and the wall time spent doing it.
+ * - batch_hits
+ *   Paths whose batched result was used. Lower than `batch_paths` if a
+ *   batched path was never looked up.
+ * - sync_paths, sync_ns
+ *   Paths resolved one at a time as they were needed, and the time spent.
+ * - batch_components, sync_components
+ *   Path components walked by the realpath(3) calls of each kind. Each is
+ *   about one lstat(2) or readlink(2), so these approximate the system calls
+ *   spent resolving paths. There's one realpath(3) call per path resolved.
+ */
+typedef struct {
+	uint64_t num_batches;
+	uint64_t num_threads;
+	uint64_t batch_paths;
+	uint64_t batch_ns;
+	uint64_t batch_hits;
+	uint64_t sync_paths;
+	uint64_t sync_ns;
+	uint64_t batch_components;
+	uint64_t sync_components;
+} path_stats_t;
+
+/*
+ * A set of paths, resolved together.
+ *
+ * Members
+ * - jobs, len, capacity
+ *   Array of `len` unique paths.
+ * - index
+ *   Map from a hash of each path to its position in `jobs`.
+ * - resolved
+ *   Number of jobs at the start of `jobs` already resolved.
+ * - max_threads
+ *   Most threads to start per path_batch_resolve(). 0 means the caller
+ *   resolves every path itself.
+ */
+typedef struct {
+	path_job_t *jobs;
+	size_t len;
+	size_t capacity;
+	cf_hmap8_t index;
+	size_t resolved;
+	size_t max_threads;
+} path_batch_t;
+
+void path_batch_make(path_batch_t *out);
+void path_batch_free(path_batch_t *batch);
+void path_batch_reset(path_batch_t *batch);
+int path_batch_add(path_batch_t *batch, const char *path, size_t len);
+void path_batch_resolve(path_batch_t *batch, path_stats_t *stats);
+const path_job_t *path_batch_find(const path_batch_t *batch,
+		const char *path, size_t len);
+uint32_t path_components(const char *path);
+
+__END_DECLS
@@ -34,6 +34,19 @@
 extern const char query_section_start[] QUERY_SECTION_START;
 extern const char query_section_end[] QUERY_SECTION_STOP;
 
+/*
+ * sql predicate for `db_filter_t::file_glob` bound as parameter `param`.
+ *
+ * True if the row's `file` column refers to a file whose path, or any suffix
+ * of it following a '/', matches the glob. An empty glob matches every file.
+ */
+#define FILE_GLOB_FILTER(param) \
+	"((" param " == '') OR (file IN (" \
+		"SELECT id FROM " FILE_TABLE_NAME " WHERE (" \
+		"(path GLOB " param ") OR " \
+		"(path GLOB ('*/' || " param "))" \
+	"))))"
+
 static const QUERY_ATTR lookup_desc_t file_lookup_query = {
 	.base = {
 		.query = "SELECT " \
@@ -74,11 +87,286 @@ static const QUERY_ATTR query_desc_t file_insert_query = {
 	.query = "INSERT INTO " \
 			FILE_TABLE_NAME " " \
 			"(" FILE_COLUMN_NAMES ") " \
-			"VALUES (?1, ?2);",
-	.num_columns = 2,
+			"VALUES (?1, ?2, ?3, ?4);",
+	.num_columns = 4,
+	// note: `vcs_id` is bound as `column_null` for untracked files
 	.column_kinds = (const column_kind_t[]) {
 		[0] = column_null,
 		[1] = column_str,
+		[2] = column_str,
+		[3] = column_uint64,
+	},
+};
+
+static const QUERY_ATTR query_desc_t file_update_query = {
+	.query = "UPDATE " FILE_TABLE_NAME " " \
+			"SET vcs_id = ?2, hash = ?3 " \
+			"WHERE (id == ?1);",
+	.num_columns = 3,
+	// note: `vcs_id` is bound as `column_null` for untracked files
+	.column_kinds = (const column_kind_t[]) {
+		[0] = column_uint64,
+		[1] = column_str,
+		[2] = column_uint64,
+	},
+};
+
+static const QUERY_ATTR lookup_desc_t file_hash_find_query = {
+	.base = {
+		.query = "SELECT " \
+				"id, path " \
+				"FROM " FILE_TABLE_NAME " WHERE (" \
+				"(hash == ?1)" \
+				");",
+		.num_columns = 1,
+		.column_kinds = (const column_kind_t[]) {
+			[0] = column_uint64,
+		},
+	},
+	.num_outputs = 2,
+	.output_kinds = (const column_kind_t[]) {
+		[0] = column_uint64,
+		[1] = column_str,
+	},
+};
+
+static const QUERY_ATTR lookup_desc_t file_alias_lookup_query = {
+	.base = {
+		.query = "SELECT " \
+				"file " \
+				"FROM " FILE_ALIAS_TABLE_NAME " WHERE (" \
+				"(path == ?1)" \
+				");",
+		.num_columns = 1,
+		.column_kinds = (const column_kind_t[]) {
+			[0] = column_str,
+		},
+	},
+	.num_outputs = 1,
+	.output_kinds = (const column_kind_t[]) {
+		[0] = column_uint64,
+	},
+};
+
+static const QUERY_ATTR query_desc_t file_alias_insert_query = {
+	.query = "INSERT INTO " \
+			FILE_ALIAS_TABLE_NAME " " \
+			"(" FILE_ALIAS_COLUMN_NAMES ") " \
+			"VALUES (?1, ?2, ?3);",
+	.num_columns = 3,
+	// note: `vcs_id` is bound as `column_null` for untracked files
+	.column_kinds = (const column_kind_t[]) {
+		[0] = column_str,
+		[1] = column_uint64,
+		[2] = column_str,
+	},
+};
+
+static const QUERY_ATTR lookup_desc_t file_tracked_find_query = {
+	.base = {
+		.query = "SELECT " \
+				"id, path, vcs_id " \
+				"FROM " FILE_TABLE_NAME " WHERE (" \
+				"vcs_id NOT NULL" \
+				");",
+		.num_columns = 0,
+		.column_kinds = NULL,
+	},
+	.num_outputs = 3,
+	.output_kinds = (const column_kind_t[]) {
+		[0] = column_uint64,
+		[1] = column_str,
+		[2] = column_str,
+	},
+};
+
+static const QUERY_ATTR lookup_desc_t file_untracked_find_query = {
+	.base = {
+		.query = "SELECT " \
+				"id, path " \
+				"FROM " FILE_TABLE_NAME " WHERE (" \
+				"vcs_id IS NULL" \
+				");",
+		.num_columns = 0,
+		.column_kinds = NULL,
+	},
+	.num_outputs = 2,
+	.output_kinds = (const column_kind_t[]) {
+		[0] = column_uint64,
+		[1] = column_str,
+	},
+};
+
+/*
+ * The same as `file_tracked_find_query` but for aliases. The id is that of the
+ * file table row the alias refers to.
+ */
+static const QUERY_ATTR lookup_desc_t file_alias_tracked_find_query = {
+	.base = {
+		.query = "SELECT " \
+				"file, path, vcs_id " \
+				"FROM " FILE_ALIAS_TABLE_NAME " WHERE (" \
+				"vcs_id NOT NULL" \
+				");",
+		.num_columns = 0,
+		.column_kinds = NULL,
+	},
+	.num_outputs = 3,
+	.output_kinds = (const column_kind_t[]) {
+		[0] = column_uint64,
+		[1] = column_str,
+		[2] = column_str,
+	},
+};
+
+static const QUERY_ATTR lookup_desc_t file_alias_untracked_find_query = {
+	.base = {
+		.query = "SELECT " \
+				"file, path " \
+				"FROM " FILE_ALIAS_TABLE_NAME " WHERE (" \
+				"vcs_id IS NULL" \
+				");",
+		.num_columns = 0,
+		.column_kinds = NULL,
+	},
+	.num_outputs = 2,
+	.output_kinds = (const column_kind_t[]) {
+		[0] = column_uint64,
+		[1] = column_str,
+	},
+};
+
+static const QUERY_ATTR query_desc_t tu_dep_insert_query = {
+	// note: reindexing a TU without version control adds the same rows again
+	.query = "INSERT OR IGNORE INTO " \
+			TU_DEP_TABLE_NAME " " \
+			"(" TU_DEP_COLUMN_NAMES ") " \
+			"VALUES (?1, ?2);",
+	.num_columns = 2,
+	.column_kinds = (const column_kind_t[]) {
+		[0] = column_uint64,
+		[1] = column_uint64,
+	},
+};
+
+static const QUERY_ATTR query_desc_t approx_file_insert_query = {
+	.query = "INSERT OR IGNORE INTO " \
+			APPROX_FILE_TABLE_NAME " " \
+			"(" APPROX_FILE_COLUMN_NAMES ") " \
+			"VALUES (?1);",
+	.num_columns = 1,
+	.column_kinds = (const column_kind_t[]) {
+		[0] = column_uint64,
+	},
+};
+
+static const QUERY_ATTR lookup_desc_t approx_file_lookup_query = {
+	.base = {
+		.query = "SELECT " \
+				"file " \
+				"FROM " APPROX_FILE_TABLE_NAME " WHERE (" \
+				"(file == ?1)" \
+				");",
+		.num_columns = 1,
+		.column_kinds = (const column_kind_t[]) {
+			[0] = column_uint64,
+		},
+	},
+	.num_outputs = 1,
+	.output_kinds = (const column_kind_t[]) {
+		[0] = column_uint64,
+	},
+};
+
+static const QUERY_ATTR lookup_desc_t approx_file_count_query = {
+	.base = {
+		.query = "SELECT " \
+				"count(*) " \
+				"FROM " APPROX_FILE_TABLE_NAME ";",
+		.num_columns = 0,
+		.column_kinds = NULL,
+	},
+	.num_outputs = 1,
+	.output_kinds = (const column_kind_t[]) {
+		[0] = column_uint64,
+	},
+};
+
+// note: replaces the file's previous block, if any
+static const QUERY_ATTR query_desc_t snippet_insert_query = {
+	.query = "INSERT OR REPLACE INTO " \
+			SNIPPET_TABLE_NAME " " \
+			"(" SNIPPET_COLUMN_NAMES ") " \
+			"VALUES (?1, ?2);",
+	.num_columns = 2,
+	.column_kinds = (const column_kind_t[]) {
+		[0] = column_uint64,
+		[1] = column_blob,
+	},
+};
+
+static const QUERY_ATTR lookup_desc_t snippet_lookup_query = {
+	.base = {
+		.query = "SELECT " \
+				"data " \
+				"FROM " SNIPPET_TABLE_NAME " WHERE (" \
+				"(file == ?1)" \
+				");",
+		.num_columns = 1,
+		.column_kinds = (const column_kind_t[]) {
+			[0] = column_uint64,
+		},
+	},
+	.num_outputs = 1,
+	.output_kinds = (const column_kind_t[]) {
+		[0] = column_blob,
+	},
+};
+
+/*
+ * Number of TUs indexed. Every TU depends on at least its main file.
+ */
+static const QUERY_ATTR lookup_desc_t tu_count_query = {
+	.base = {
+		.query = "SELECT " \
+				"count(DISTINCT tu) " \
+				"FROM " TU_DEP_TABLE_NAME ";",
+		.num_columns = 0,
+		.column_kinds = NULL,
+	},
+	.num_outputs = 1,
+	.output_kinds = (const column_kind_t[]) {
+		[0] = column_uint64,
+	},
+};
+
+static const QUERY_ATTR query_desc_t vcs_changed_insert_query = {
+	.query = "INSERT OR IGNORE INTO temp.vcs_changed (id) VALUES (?1);",
+	.num_columns = 1,
+	.column_kinds = (const column_kind_t[]) {
+		[0] = column_uint64,
+	},
+};
+
+/*
+ * Select every TU that doesn't depend on a file in temporary table
+ * `vcs_changed`.
+ */
+static const QUERY_ATTR lookup_desc_t tu_dep_clean_find_query = {
+	.base = {
+		.query = "SELECT DISTINCT " \
+				"tu " \
+				"FROM " TU_DEP_TABLE_NAME " WHERE (" \
+				"tu NOT IN (" \
+					"SELECT tu FROM " TU_DEP_TABLE_NAME " WHERE " \
+					"file IN (SELECT id FROM temp.vcs_changed)" \
+				"));",
+		.num_columns = 0,
+		.column_kinds = NULL,
+	},
+	.num_outputs = 1,
+	.output_kinds = (const column_kind_t[]) {
+		[0] = column_uint64,
 	},
 };
 
@@ -128,20 +416,31 @@ static const QUERY_ATTR query_desc_t type_insert_query = {
 	},
 };
 
+/*
+ * Typename lookup by the indexer.
+ *
+ * Every column of `TYPENAME_SCOPE_INDEX_NAME` is matched, scope first. `kind`
+ * is matched too; a tag and a typedef of the same name are different
+ * typenames.
+ */
 static const QUERY_ATTR lookup_desc_t typename_lookup_query = {
 	.base = {
-		// XXX hard coded for global scope lookups
 		.query = "SELECT " \
 				"base_type,kind " \
 				"FROM " TYPENAME_TABLE_NAME " WHERE (" \
+				"(scope == ?3) AND " \
+				"(func == ?4) AND " \
 				"(file == ?1) AND " \
 				"(name == ?2) AND " \
-				"(scope == 0) " \
+				"(kind == ?5) " \
 				");",
-		.num_columns = 2,
+		.num_columns = 5,
 		.column_kinds = (const column_kind_t[]) {
 			[0] = column_uint64,
 			[1] = column_str,
+			[2] = column_uint32,
+			[3] = column_uint64,
+			[4] = column_uint32,
 		},
 	},
 	.num_outputs = 2,
@@ -151,29 +450,238 @@ static const QUERY_ATTR lookup_desc_t typename_lookup_query = {
 	},
 };
 
+/*
+ * Number of keys resolved by one `typename_lookup_many_query`.
+ */
+#define TYPENAME_LOOKUP_BATCH 32
+
+/*
+ * Input column kinds of one key: file, name, kind, scope, func.
+ */
+#define TYPENAME_KEY_KINDS \
+	column_uint64, column_str, column_uint32, column_uint32, column_uint64
+#define TYPENAME_KEY_COLUMNS 5
+#define TYPENAME_KEY_KINDS4 \
+	TYPENAME_KEY_KINDS, TYPENAME_KEY_KINDS, \
+	TYPENAME_KEY_KINDS, TYPENAME_KEY_KINDS
+
+/*
+ * Batched form of `typename_lookup_query`.
+ *
+ * Keys are bound as `TYPENAME_LOOKUP_BATCH` (file, name, kind, scope, func)
+ * tuples. Unused keys are bound to NULL and match nothing. Output rows are
+ * (key index, base_type), in no particular order; a key may have more than
+ * one.
+ */
+static const QUERY_ATTR lookup_desc_t typename_lookup_many_query = {
+	.base = {
+		.query = "WITH lookup_key(i, file, name, kind, scope, func) AS (" \
+				"VALUES " \
+				"(0,?1,?2,?3,?4,?5),(1,?6,?7,?8,?9,?10)," \
+				"(2,?11,?12,?13,?14,?15),(3,?16,?17,?18,?19,?20)," \
+				"(4,?21,?22,?23,?24,?25),(5,?26,?27,?28,?29,?30)," \
+				"(6,?31,?32,?33,?34,?35),(7,?36,?37,?38,?39,?40)," \
+				"(8,?41,?42,?43,?44,?45),(9,?46,?47,?48,?49,?50)," \
+				"(10,?51,?52,?53,?54,?55),(11,?56,?57,?58,?59,?60)," \
+				"(12,?61,?62,?63,?64,?65),(13,?66,?67,?68,?69,?70)," \
+				"(14,?71,?72,?73,?74,?75),(15,?76,?77,?78,?79,?80)," \
+				"(16,?81,?82,?83,?84,?85),(17,?86,?87,?88,?89,?90)," \
+				"(18,?91,?92,?93,?94,?95),(19,?96,?97,?98,?99,?100)," \
+				"(20,?101,?102,?103,?104,?105)," \
+				"(21,?106,?107,?108,?109,?110)," \
+				"(22,?111,?112,?113,?114,?115)," \
+				"(23,?116,?117,?118,?119,?120)," \
+				"(24,?121,?122,?123,?124,?125)," \
+				"(25,?126,?127,?128,?129,?130)," \
+				"(26,?131,?132,?133,?134,?135)," \
+				"(27,?136,?137,?138,?139,?140)," \
+				"(28,?141,?142,?143,?144,?145)," \
+				"(29,?146,?147,?148,?149,?150)," \
+				"(30,?151,?152,?153,?154,?155)," \
+				"(31,?156,?157,?158,?159,?160)" \
+				") SELECT " \
+				"lookup_key.i,t.base_type " \
+				"FROM lookup_key JOIN " TYPENAME_TABLE_NAME " AS t ON (" \
+				"(t.scope == lookup_key.scope) AND " \
+				"(t.func == lookup_key.func) AND " \
+				"(t.file == lookup_key.file) AND " \
+				"(t.name == lookup_key.name) AND " \
+				"(t.kind == lookup_key.kind) " \
+				");",
+		.num_columns = TYPENAME_KEY_COLUMNS * TYPENAME_LOOKUP_BATCH,
+		.column_kinds = (const column_kind_t[]) {
+			TYPENAME_KEY_KINDS4,
+			TYPENAME_KEY_KINDS4,
+			TYPENAME_KEY_KINDS4,
+			TYPENAME_KEY_KINDS4,
+			TYPENAME_KEY_KINDS4,
+			TYPENAME_KEY_KINDS4,
+			TYPENAME_KEY_KINDS4,
+			TYPENAME_KEY_KINDS4,
+		},
+	},
+	.num_outputs = 2,
+	.output_kinds = (const column_kind_t[]) {
+		[0] = column_uint32,
+		[1] = column_uint64,
+	},
+};
+
+/*
+ * Filtered typename search. See `db_filter_t` for the meaning of ?2..?5 and
+ * ?7.
+ *
+ * Each filter is written as "(<unset> OR <predicate>)" so a single compiled
+ * statement serves every combination of filters and sqlite still evaluates
+ * them rather than the caller.
+ */
+#define TYPENAME_FIND_FILTER \
+	"(name LIKE ?1) AND " \
+	"((?2 == 0) OR (base_type IN (" \
+		"SELECT typeid FROM " TYPE_TABLE_NAME " WHERE " \
+		"(kind == ?2)" \
+	"))) AND " \
+	"((?3 == 0) OR (kind == ?3)) AND " \
+	"((?7 == 0) OR ((scope == 0) == (?7 == 1))) AND " \
+	FILE_GLOB_FILTER("?4")
+
+/*
+ * Path of the file of typename row `row`, '' if it has none.
+ */
+#define TYPENAME_PATH(row) \
+	"IFNULL((SELECT path FROM " FILE_TABLE_NAME " WHERE " \
+		"(id == " row ".file)), '')"
+
+// parameters and outputs shared by every `typename_find*_query`
+#define TYPENAME_FIND_COLUMN_KINDS \
+	[0] = column_str, \
+	[1] = column_uint32, \
+	[2] = column_uint32, \
+	[3] = column_str, \
+	[4] = column_uint64, \
+	[5] = column_uint64, \
+	[6] = column_uint32
+#define TYPENAME_FIND_OUTPUT_KINDS \
+	[0] = column_str, \
+	[1] = column_uint32, \
+	[2] = column_uint64, \
+	[3] = column_uint64, \
+	[4] = column_uint64, \
+	[5] = column_uint32, \
+	[6] = column_uint32, \
+	[7] = column_uint32, \
+	[8] = column_uint64
+
+/*
+ * Typename search in `db_order_none` order.
+ *
+ * Results are ordered by rowid, which doubles as the keyset cursor: the page
+ * after cursor ?5 starts with a rowid range seek. The extra last output is
+ * the rowid of each row.
+ */
 static const QUERY_ATTR lookup_desc_t typename_find_query = {
 	.base = {
-		// XXX hard coded for global scope lookups
 		.query = "SELECT " \
-				TYPENAME_COLUMN_NAMES \
+				TYPENAME_COLUMN_NAMES ", rowid" \
+				" FROM " TYPENAME_TABLE_NAME " WHERE (" \
+				TYPENAME_FIND_FILTER " AND " \
+				"(rowid > ?5)" \
+				") ORDER BY rowid " \
+				"LIMIT ?6;",
+		.num_columns = 7,
+		.column_kinds = (const column_kind_t[]) {
+			TYPENAME_FIND_COLUMN_KINDS,
+		},
+	},
+	.num_outputs = 9,
+	.output_kinds = (const column_kind_t[]) {
+		TYPENAME_FIND_OUTPUT_KINDS,
+	},
+};
+
+/*
+ * Typename search in `db_order_name` order.
+ *
+ * Walks `TYPENAME_NAME_INDEX_NAME` in (name, rowid) order starting just past
+ * the key of cursor row ?5. No cursor is the key ('', 0), which precedes every
+ * row.
+ */
+static const QUERY_ATTR lookup_desc_t typename_find_by_name_query = {
+	.base = {
+		.query = "SELECT " \
+				TYPENAME_COLUMN_NAMES ", rowid" \
+				" FROM " TYPENAME_TABLE_NAME " WHERE (" \
+				TYPENAME_FIND_FILTER " AND " \
+				"((name, rowid) > (" \
+					"IFNULL((SELECT name FROM " TYPENAME_TABLE_NAME \
+						" WHERE (rowid == ?5)), ''), " \
+					"?5" \
+				"))" \
+				") ORDER BY name, rowid " \
+				"LIMIT ?6;",
+		.num_columns = 7,
+		.column_kinds = (const column_kind_t[]) {
+			TYPENAME_FIND_COLUMN_KINDS,
+		},
+	},
+	.num_outputs = 9,
+	.output_kinds = (const column_kind_t[]) {
+		TYPENAME_FIND_OUTPUT_KINDS,
+	},
+};
+
+/*
+ * Typename search in `db_order_file` order.
+ *
+ * The key is (path, line, rowid). Paths live in another table so this can't
+ * walk an index. It still skips every row up to cursor ?5 before sorting, and
+ * the LIMIT keeps the sort to a page's worth of rows.
+ */
+static const QUERY_ATTR lookup_desc_t typename_find_by_file_query = {
+	.base = {
+		.query = "SELECT " \
+				TYPENAME_COLUMN_NAMES ", rowid" \
 				" FROM " TYPENAME_TABLE_NAME " WHERE (" \
-				"(name LIKE ?1)" \
+				TYPENAME_FIND_FILTER " AND " \
+				"((?5 == 0) OR ((" \
+					TYPENAME_PATH(TYPENAME_TABLE_NAME) ", line, rowid" \
+				") > (" \
+					"SELECT " TYPENAME_PATH("c") ", c.line, c.rowid " \
+					"FROM " TYPENAME_TABLE_NAME " AS c " \
+					"WHERE (c.rowid == ?5)" \
+				")))" \
+				") ORDER BY " \
+				TYPENAME_PATH(TYPENAME_TABLE_NAME) ", line, rowid " \
+				"LIMIT ?6;",
+		.num_columns = 7,
+		.column_kinds = (const column_kind_t[]) {
+			TYPENAME_FIND_COLUMN_KINDS,
+		},
+	},
+	.num_outputs = 9,
+	.output_kinds = (const column_kind_t[]) {
+		TYPENAME_FIND_OUTPUT_KINDS,
+	},
+};
+
+/*
+ * Whether typename rowid ?1 exists. Checks a keyset cursor before use.
+ */
+static const QUERY_ATTR lookup_desc_t typename_cursor_query = {
+	.base = {
+		.query = "SELECT " \
+				"rowid " \
+				"FROM " TYPENAME_TABLE_NAME " WHERE (" \
+				"(rowid == ?1)" \
 				");",
 		.num_columns = 1,
 		.column_kinds = (const column_kind_t[]) {
-			[0] = column_str,
+			[0] = column_uint64,
 		},
 	},
-	.num_outputs = 8,
+	.num_outputs = 1,
 	.output_kinds = (const column_kind_t[]) {
-		[0] = column_str,
-		[1] = column_uint32,
-		[2] = column_uint64,
-		[3] = column_uint64,
-		[4] = column_uint64,
-		[5] = column_uint32,
-		[6] = column_uint32,
-		[7] = column_uint32,
+		[0] = column_uint64,
 	},
 };
 
@@ -210,6 +718,60 @@ static const QUERY_ATTR query_desc_t type_use_insert_query = {
 	},
 };
 
+/*
+ * Add ?4 to the count of (?1, ?2, ?3), or keep the larger of the two if ?5 is
+ * nonzero.
+ */
+static const QUERY_ATTR query_desc_t type_use_count_insert_query = {
+	.query = "INSERT INTO " \
+			TYPE_USE_COUNT_TABLE_NAME " " \
+			"(" TYPE_USE_COUNT_COLUMN_NAMES ") " \
+			"VALUES (?1, ?2, ?3, ?4) " \
+			"ON CONFLICT (base_type, file, kind) DO UPDATE SET " \
+			"count = CASE WHEN (?5 == 0) THEN (count + excluded.count) " \
+			"ELSE max(count, excluded.count) END;",
+	.num_columns = 5,
+	.column_kinds = (const column_kind_t[]) {
+		[0] = column_uint64,
+		[1] = column_uint64,
+		[2] = column_uint32,
+		[3] = column_uint64,
+		[4] = column_uint32,
+	},
+};
+
+/*
+ * Use counts of type ?1. If it has none, e.g., the database wasn't indexed
+ * with aggregated type uses, count its `type_use` rows instead.
+ */
+static const QUERY_ATTR lookup_desc_t type_use_count_lookup_query = {
+	.base = {
+		.query = "SELECT " \
+				TYPE_USE_COUNT_COLUMN_NAMES " " \
+				"FROM " TYPE_USE_COUNT_TABLE_NAME " WHERE " \
+				"(base_type == ?1) " \
+				"UNION ALL " \
+				"SELECT base_type, file, kind, count(*) " \
+				"FROM " TYPE_USE_TABLE_NAME " WHERE " \
+				"(base_type == ?1) AND NOT EXISTS (" \
+				"SELECT 1 FROM " TYPE_USE_COUNT_TABLE_NAME " WHERE " \
+				"(base_type == ?1)) " \
+				"GROUP BY file, kind " \
+				"ORDER BY file, kind;",
+		.num_columns = 1,
+		.column_kinds = (const column_kind_t[]) {
+			[0] = column_uint64,
+		},
+	},
+	.num_outputs = 4,
+	.output_kinds = (const column_kind_t[]) {
+		[0] = column_uint64,
+		[1] = column_uint64,
+		[2] = column_uint32,
+		[3] = column_uint64,
+	},
+};
+
 static const QUERY_ATTR query_desc_t member_insert_query = {
 	.query = "INSERT INTO " \
 			MEMBER_TABLE_NAME " " \
@@ -232,12 +794,14 @@ static const QUERY_ATTR lookup_desc_t member_lookup_query = {
 				MEMBER_COLUMN_NAMES \
 				" FROM " MEMBER_TABLE_NAME " WHERE (" \
 				"(parent == ?1) AND" \
-				"(name LIKE ?2)" \
+				"(name LIKE ?2) AND " \
+				FILE_GLOB_FILTER("?3") \
 				");",
-		.num_columns = 2,
+		.num_columns = 3,
 		.column_kinds = (const column_kind_t[]) {
 			[0] = column_uint64,
 			[1] = column_str,
+			[2] = column_str,
 		},
 	},
 	.num_outputs = 6,
@@ -250,3 +814,176 @@ static const QUERY_ATTR lookup_desc_t member_lookup_query = {
 		[5] = column_uint32,
 	},
 };
+
+/*
+ * Whole-table reads for the columnar scan engine in "scan.c".
+ *
+ * Rows come back in rowid order, which is the same order a filtered find
+ * without an ORDER BY returns them in.
+ */
+static const QUERY_ATTR lookup_desc_t scan_file_query = {
+	.base = {
+		.query = "SELECT " \
+				"id, path " \
+				"FROM " FILE_TABLE_NAME " ORDER BY id;",
+		.num_columns = 0,
+		.column_kinds = NULL,
+	},
+	.num_outputs = 2,
+	.output_kinds = (const column_kind_t[]) {
+		[0] = column_uint64,
+		[1] = column_str,
+	},
+};
+
+/*
+ * Note: the kind of the type each name refers to is joined in so the scan
+ * engine can filter on it without a second table.
+ */
+static const QUERY_ATTR lookup_desc_t scan_typename_query = {
+	.base = {
+		.query = "SELECT " \
+				"t.name, t.kind, IFNULL(y.kind, 0), t.base_type, " \
+				"t.file, t.line, t.column, t.rowid, t.scope " \
+				"FROM " TYPENAME_TABLE_NAME " AS t " \
+				"LEFT JOIN " TYPE_TABLE_NAME " AS y " \
+				"ON (y.typeid == t.base_type) " \
+				"ORDER BY t.rowid;",
+		.num_columns = 0,
+		.column_kinds = NULL,
+	},
+	.num_outputs = 9,
+	.output_kinds = (const column_kind_t[]) {
+		[0] = column_str,
+		[1] = column_uint32,
+		[2] = column_uint32,
+		[3] = column_uint64,
+		[4] = column_uint64,
+		[5] = column_uint32,
+		[6] = column_uint32,
+		[7] = column_uint64,
+		[8] = column_uint32,
+	},
+};
+
+static const QUERY_ATTR lookup_desc_t scan_member_query = {
+	.base = {
+		.query = "SELECT " \
+				MEMBER_COLUMN_NAMES \
+				" FROM " MEMBER_TABLE_NAME " ORDER BY rowid;",
+		.num_columns = 0,
+		.column_kinds = NULL,
+	},
+	.num_outputs = 6,
+	.output_kinds = (const column_kind_t[]) {
+		[0] = column_uint64,
+		[1] = column_uint64,
+		[2] = column_str,
+		[3] = column_uint64,
+		[4] = column_uint32,
+		[5] = column_uint32,
+	},
+};
+
+/*
+ * Whole-table reads for merging an index fragment into another database.
+ * See "merge.c".
+ */
+static const QUERY_ATTR lookup_desc_t scan_type_query = {
+	.base = {
+		.query = "SELECT " \
+				"typeid, kind, complete, file, line, column " \
+				"FROM " TYPE_TABLE_NAME " ORDER BY typeid;",
+		.num_columns = 0,
+		.column_kinds = NULL,
+	},
+	.num_outputs = 6,
+	.output_kinds = (const column_kind_t[]) {
+		[0] = column_uint64,
+		[1] = column_uint32,
+		[2] = column_uint32,
+		[3] = column_uint64,
+		[4] = column_uint32,
+		[5] = column_uint32,
+	},
+};
+
+static const QUERY_ATTR lookup_desc_t scan_type_use_query = {
+	.base = {
+		.query = "SELECT " \
+				TYPE_USE_COLUMN_NAMES \
+				" FROM " TYPE_USE_TABLE_NAME " ORDER BY rowid;",
+		.num_columns = 0,
+		.column_kinds = NULL,
+	},
+	.num_outputs = 5,
+	.output_kinds = (const column_kind_t[]) {
+		[0] = column_uint64,
+		[1] = column_uint32,
+		[2] = column_uint64,
+		[3] = column_uint32,
+		[4] = column_uint32,
+	},
+};
+
+static const QUERY_ATTR lookup_desc_t scan_type_use_count_query = {
+	.base = {
+		.query = "SELECT " \
+				TYPE_USE_COUNT_COLUMN_NAMES \
+				" FROM " TYPE_USE_COUNT_TABLE_NAME ";",
+		.num_columns = 0,
+		.column_kinds = NULL,
+	},
+	.num_outputs = 4,
+	.output_kinds = (const column_kind_t[]) {
+		[0] = column_uint64,
+		[1] = column_uint64,
+		[2] = column_uint32,
+		[3] = column_uint64,
+	},
+};
+
+static const QUERY_ATTR lookup_desc_t scan_tu_dep_query = {
+	.base = {
+		.query = "SELECT " \
+				TU_DEP_COLUMN_NAMES \
+				" FROM " TU_DEP_TABLE_NAME ";",
+		.num_columns = 0,
+		.column_kinds = NULL,
+	},
+	.num_outputs = 2,
+	.output_kinds = (const column_kind_t[]) {
+		[0] = column_uint64,
+		[1] = column_uint64,
+	},
+};
+
+static const QUERY_ATTR lookup_desc_t scan_snippet_query = {
+	.base = {
+		.query = "SELECT " \
+				SNIPPET_COLUMN_NAMES \
+				" FROM " SNIPPET_TABLE_NAME ";",
+		.num_columns = 0,
+		.column_kinds = NULL,
+	},
+	.num_outputs = 2,
+	.output_kinds = (const column_kind_t[]) {
+		[0] = column_uint64,
+		[1] = column_blob,
+	},
+};
+
+static const QUERY_ATTR lookup_desc_t scan_file_alias_query = {
+	.base = {
+		.query = "SELECT " \
+				"file, path " \
+				"FROM " FILE_ALIAS_TABLE_NAME " ORDER BY rowid;",
+		.num_columns = 0,
+		.column_kinds = NULL,
+	},
+	.num_outputs = 2,
+	.output_kinds = (const column_kind_t[]) {
+		[0] = column_uint64,
+		[1] = column_str,
+	},
+};
@@ -0,0 +1,291 @@
+/*
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ * Copyright (C) 2024 cfind developer
+ *
+ * Query log reader and writer. See "query_log.h" for the format.
+ */
+#define _POSIX_C_SOURCE 200809L // for clock_gettime(2)
+#include "query_log.h"
+
+#include "cf_alloc.h"
+#include "cf_assert.h"
+#include "cf_print.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+static bool parse_uint(const char **pos, const char *end, uint64_t *out);
+static bool parse_int(const char **pos, const char *end, int64_t *out);
+static bool expect_char(const char **pos, const char *end, char c);
+
+// tag at the start of each record; bumped if the format ever changes
+#define QUERY_LOG_TAG "q1 "
+// longest command recorded; longer ones aren't typed by hand
+#define QUERY_LOG_MAX_CMD 4096
+// refuse to load bigger logs
+#define QUERY_LOG_MAX_SIZE (256u << 20)
+
+/*
+ * Append `rec` to the log at `path`, creating it if needed.
+ *
+ * The log is created private to the user: commands can reveal what someone
+ * is working on. Return E2BIG if the command is too long to log.
+ */
+int
+query_log_append(const char *path, const query_record_t *rec)
+{
+	int error = 0;
+	char header[160];
+
+	const size_t cmd_len = cf_str_len(&rec->cmd);
+	if (cmd_len > QUERY_LOG_MAX_CMD) {
+		return E2BIG;
+	}
+
+	const int header_len = snprintf(header, sizeof(header),
+			QUERY_LOG_TAG "%" PRId64 " %" PRIu64 " %" PRIu64
+			" %d %d %d %zu:", rec->time_ms, rec->latency_us,
+			rec->num_results, rec->error, rec->scan ? 1 : 0, (int)rec->kind,
+			cmd_len);
+	cf_assert((header_len > 0) && ((size_t)header_len < sizeof(header)));
+
+	// build the whole line so it's written at once
+	const size_t len = (size_t)header_len + cmd_len + 1;
+	char *const line = cf_malloc(len);
+	if (!line) {
+		return ENOMEM;
+	}
+	memcpy(line, header, header_len);
+	if (cmd_len) {
+		memcpy(&line[header_len], rec->cmd.str, cmd_len);
+	}
+	line[len - 1] = '\n';
+
+	const int fd = open(path, O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC,
+			0600);
+	if (fd == -1) {
+		error = errno;
+		goto fail;
+	}
+	const ssize_t written = write(fd, line, len);
+	if (written == -1) {
+		error = errno;
+	} else if ((size_t)written != len) {
+		error = EIO;
+	}
+	close(fd);
+
+fail:
+	cf_free(line);
+	return error;
+}
+
+/*
+ * Read the whole log at `path` into `out`.
+ *
+ * On success, read records with query_log_next() then free `out` with
+ * query_log_free().
+ */
+int
+query_log_load(const char *path, query_log_t *out)
+{
+	int error = 0;
+
+	memset(out, 0, sizeof(*out));
+
+	FILE *f = fopen(path, "r");
+	if (!f) {
+		return errno;
+	}
+
+	size_t capacity = 0;
+	for (;;) {
+		if (out->len == capacity) {
+			if (capacity >= QUERY_LOG_MAX_SIZE) {
+				error = EFBIG;
+				goto fail;
+			}
+			capacity = capacity ? (capacity * 2) : 4096;
+			char *buf = cf_realloc(out->buf, capacity);
+			if (!buf) {
+				error = ENOMEM;
+				goto fail;
+			}
+			out->buf = buf;
+		}
+		const size_t got = fread(&out->buf[out->len], 1,
+				capacity - out->len, f);
+		out->len += got;
+		if (!got) {
+			break;
+		}
+	}
+	if (ferror(f)) {
+		error = EIO;
+		goto fail;
+	}
+
+	fclose(f);
+	return 0;
+
+fail:
+	fclose(f);
+	query_log_free(out);
+	return error;
+}
+
+/*
+ * Read the next record of `log` into `out`.
+ *
+ * Return ENOENT at the end of the log. Return EILSEQ for a malformed record,
+ * e.g., from a write cut short; the next call continues with the record on
+ * the following line.
+ */
+int
+query_log_next(query_log_t *log, query_record_t *out)
+{
+	const char *const start = &log->buf[log->pos];
+	const char *const end = &log->buf[log->len];
+	const char *pos = start;
+
+	if (pos == end) {
+		return ENOENT;
+	}
+
+	uint64_t latency;
+	uint64_t results;
+	int64_t time_ms;
+	int64_t error;
+	uint64_t scan;
+	uint64_t kind;
+	uint64_t cmd_len;
+	const size_t tag_len = strlen(QUERY_LOG_TAG);
+	if (((size_t)(end - pos) < tag_len) ||
+			memcmp(pos, QUERY_LOG_TAG, tag_len)) {
+		goto bad;
+	}
+	pos += tag_len;
+	if (!parse_int(&pos, end, &time_ms) || !expect_char(&pos, end, ' ') ||
+			!parse_uint(&pos, end, &latency) ||
+			!expect_char(&pos, end, ' ') ||
+			!parse_uint(&pos, end, &results) ||
+			!expect_char(&pos, end, ' ') ||
+			!parse_int(&pos, end, &error) || !expect_char(&pos, end, ' ') ||
+			!parse_uint(&pos, end, &scan) || !expect_char(&pos, end, ' ') ||
+			!parse_uint(&pos, end, &kind) || !expect_char(&pos, end, ' ') ||
+			!parse_uint(&pos, end, &cmd_len) ||
+			!expect_char(&pos, end, ':')) {
+		goto bad;
+	}
+	if ((error < INT_MIN) || (error > INT_MAX) || (scan > 1) ||
+			(kind < search_type_decl) || (kind > search_type_use) ||
+			(cmd_len > QUERY_LOG_MAX_CMD) ||
+			(cmd_len >= (uint64_t)(end - pos)) || (pos[cmd_len] != '\n')) {
+		goto bad;
+	}
+
+	*out = (query_record_t) {
+		.time_ms = time_ms,
+		.latency_us = latency,
+		.num_results = results,
+		.error = (int)error,
+		.scan = scan,
+		.kind = (search_kind_t)kind,
+	};
+	cf_str_borrow(pos, cmd_len, &out->cmd);
+	log->pos = (size_t)(&pos[cmd_len + 1] - log->buf);
+	return 0;
+
+bad:
+	cf_print_debug("bad query log record at offset %zu\n", log->pos);
+	// skip to the next line
+	pos = memchr(start, '\n', (size_t)(end - start));
+	log->pos = pos ? (size_t)(pos + 1 - log->buf) : log->len;
+	return EILSEQ;
+}
+
+void
+query_log_free(query_log_t *log)
+{
+	cf_free(log->buf);
+	memset(log, 0, sizeof(*log));
+}
+
+/*
+ * Return a monotonic time in microseconds, for measuring latency.
+ */
+uint64_t
+query_log_clock_us(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ((uint64_t)ts.tv_sec * 1000000) + ((uint64_t)ts.tv_nsec / 1000);
+}
+
+/*
+ * Return the wall clock time in milliseconds since the epoch.
+ */
+int64_t
+query_log_wall_ms(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_REALTIME, &ts);
+	return ((int64_t)ts.tv_sec * 1000) + (ts.tv_nsec / 1000000);
+}
+
+/*
+ * Parse a decimal number at `*pos` and advance `*pos` past it.
+ */
+static bool
+parse_uint(const char **pos, const char *end, uint64_t *out)
+{
+	uint64_t val = 0;
+	const char *p = *pos;
+
+	for (; (p < end) && (*p >= '0') && (*p <= '9'); ++p) {
+		if (__builtin_mul_overflow(val, 10, &val) ||
+				__builtin_add_overflow(val, (uint64_t)(*p - '0'), &val)) {
+			return false;
+		}
+	}
+	if (p == *pos) {
+		return false;
+	}
+	*pos = p;
+	*out = val;
+	return true;
+}
+
+/*
+ * Same as parse_uint(), but with an optional leading '-'.
+ */
+static bool
+parse_int(const char **pos, const char *end, int64_t *out)
+{
+	const bool negative = (*pos < end) && (**pos == '-');
+	const char *p = *pos + negative;
+	uint64_t val;
+
+	if (!parse_uint(&p, end, &val) || (val > INT64_MAX)) {
+		return false;
+	}
+	*pos = p;
+	*out = negative ? -(int64_t)val : (int64_t)val;
+	return true;
+}
+
+static bool
+expect_char(const char **pos, const char *end, char c)
+{
+	if ((*pos == end) || (**pos != c)) {
+		return false;
+	}
+	++*pos;
+	return true;
+}
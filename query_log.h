@@ -0,0 +1,80 @@
+/*
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ * Copyright (C) 2024 cfind developer
+ *
+ * Query log: a record of the commands `cfind` ran, for replay by
+ * `cfind-bench replay`.
+ *
+ * A log is a text file with one record per line:
+ *   q1 TIME LATENCY RESULTS ERROR SCAN KIND LEN:COMMAND
+ * - TIME
+ *   Wall clock time the command ran, in milliseconds since the epoch.
+ * - LATENCY
+ *   Microseconds to parse and execute the command, database already open.
+ * - RESULTS
+ *   Number of entries printed.
+ * - ERROR
+ *   Error the command returned, 0 for success.
+ * - SCAN
+ *   1 if the command ran with `--scan`, else 0.
+ * - KIND
+ *   `search_kind_t` of the parsed command.
+ * - LEN:COMMAND
+ *   The command string as typed, prefixed by its length in bytes. It's
+ *   stored verbatim, so it may contain spaces.
+ *
+ * Each record is appended with one write(2) to a file opened with O_APPEND,
+ * so several `cfind`s can share one log.
+ */
+#pragma once
+
+#include "cc_support.h"
+#include "cf_string.h"
+#include "search_types.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+__BEGIN_DECLS
+
+/*
+ * One command in a query log. See the file comment for each member.
+ *
+ * `cmd` borrows from the `query_log_t` a record was read from.
+ */
+typedef struct {
+	int64_t time_ms;
+	uint64_t latency_us;
+	uint64_t num_results;
+	int error;
+	bool scan;
+	search_kind_t kind;
+	cf_str_t cmd;
+} query_record_t;
+
+/*
+ * A query log read into memory.
+ *
+ * Members
+ * - buf, len
+ *   Whole contents of the file.
+ * - pos
+ *   Offset of the next record to read.
+ */
+typedef struct {
+	char *buf;
+	size_t len;
+	size_t pos;
+} query_log_t;
+
+int query_log_append(const char *path, const query_record_t *rec);
+
+int query_log_load(const char *path, query_log_t *out);
+int query_log_next(query_log_t *log, query_record_t *out);
+void query_log_free(query_log_t *log);
+
+uint64_t query_log_clock_us(void);
+int64_t query_log_wall_ms(void);
+
+__END_DECLS
@@ -0,0 +1,1198 @@
+/*
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ * Copyright (C) 2024 cfind developer
+ *
+ * Columnar scan engine. See "scan.h".
+ *
+ * A find query runs in passes over a `uint8_t` "keep" flag per row:
+ * - name prefilter
+ *   memmem(3) for the longest literal part of the name pattern over the
+ *   lower-cased name blob. Rows without a hit are never looked at again.
+ * - column filters
+ *   Kind, parent, and file comparisons. Each is a single loop over a whole
+ *   column that ANDs into the flags.
+ * - materialize
+ *   Skip over runs of cleared flags. Check the full name pattern only for
+ *   rows that are left.
+ */
+#define _GNU_SOURCE // for memmem(3)
+#include "scan.h"
+
+#include "cf_alloc.h"
+#include "cf_assert.h"
+#include "cf_print.h"
+#include "sql_query.h"
+
+#include <errno.h>
+#include <fnmatch.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * 16 byte vector type for filter kernels.
+ *
+ * The compiler lowers operations on it to SSE2/NEON instructions regardless
+ * of optimization level. Lanes of a comparison result are 0 or 0xff.
+ */
+typedef uint8_t scan_vec_t __attribute__((vector_size(16)));
+
+// initial number of rows allocated for each table
+#define SCAN_MIN_ROWS 256
+// initial number of bytes allocated for each string column
+#define SCAN_MIN_BYTES 4096
+
+/*
+ * Resize column array `col` to hold `capacity` elements.
+ *
+ * Evaluates to false if out of memory. `col` is left as-is in that case.
+ */
+#define grow_column(col, capacity) ({ \
+	__typeof__(col) new_col_ = cf_realloc((col), \
+			sizeof(*(col)) * (capacity)); \
+	if (new_col_) { \
+		(col) = new_col_; \
+	} \
+	(new_col_ != NULL); \
+})
+
+// loading
+static int load_files(sqlite3 *db, scan_files_t *out);
+static int load_typenames(sqlite3 *db, const scan_files_t *files,
+		scan_typenames_t *out);
+static int load_members(sqlite3 *db, const scan_files_t *files,
+		scan_members_t *out);
+static int reserve_files(scan_files_t *files);
+static int reserve_typenames(scan_typenames_t *typenames);
+static int reserve_members(scan_members_t *members);
+static uint32_t file_row(const scan_files_t *files, int64_t id);
+static bool typename_row(const scan_typenames_t *typenames, int64_t id,
+		uint32_t *out);
+
+// string columns
+static int strs_push(scan_strs_t *strs, size_t row, const cf_str_t *str);
+static int strs_reserve(scan_strs_t *strs, size_t len);
+static void strs_get(const scan_strs_t *strs, uint32_t row, cf_str_t *out);
+static void strs_free(scan_strs_t *strs);
+static char ascii_lower(char c);
+
+// filter kernels
+static int filter_name(const scan_strs_t *names, size_t num_rows,
+		const cf_str_t *pattern, uint8_t *keep);
+static void filter_eq_u8(const uint8_t *col, uint8_t val, size_t num_rows,
+		uint8_t *keep);
+static void filter_eq_i64(const int64_t *col, int64_t val, size_t num_rows,
+		uint8_t *keep);
+static void filter_file(const uint32_t *col, const uint8_t *file_mask,
+		size_t num_rows, uint8_t *keep);
+static int make_file_mask(const scan_files_t *files, const cf_str_t *glob,
+		uint8_t **out);
+static bool glob_match_path(const char *glob, const char *path);
+static size_t longest_literal(const cf_str_t *pattern, size_t *start_out);
+static uint32_t row_of_offset(const uint32_t *offs, size_t num_rows,
+		size_t off);
+static bool like_match(const char *pat, size_t pat_len, const char *str,
+		size_t len);
+
+// materialization
+static int collect_rows(const scan_strs_t *names, const cf_str_t *pattern,
+		const uint8_t *keep, size_t num_rows, uint32_t limit,
+		scan_result_t *out);
+static void sort_rows(const scan_table_t *table, const scan_strs_t *names,
+		const uint32_t *file, const uint32_t *line, db_order_t order,
+		scan_result_t *result);
+static void skip_to_cursor(const scan_table_t *table,
+		const scan_strs_t *names, const uint32_t *file, const uint32_t *line,
+		db_order_t order, uint32_t cursor, scan_result_t *result);
+static int compare_by_name(const void *lhs, const void *rhs);
+static int compare_by_file(const void *lhs, const void *rhs);
+
+/*
+ * Key used to sort scan results. Self-contained because qsort(3) doesn't pass
+ * a context pointer to its comparison function.
+ */
+typedef struct {
+	const char *name;
+	size_t name_len;
+	const char *path;
+	uint32_t line;
+	uint32_t row;
+} sort_key_t;
+
+static void make_sort_key(const scan_table_t *table,
+		const scan_strs_t *names, const uint32_t *file, const uint32_t *line,
+		uint32_t row, sort_key_t *out);
+
+/*
+ * Read the file, typename, and member tables of `db` into `out`.
+ *
+ * On success, follow with a call to scan_table_free().
+ */
+int
+scan_table_load(sqlite_db_t *db, scan_table_t *out)
+{
+	int error;
+
+	memset(out, 0, sizeof(*out));
+	out->typenames.names.searchable = true;
+	out->members.names.searchable = true;
+
+	if ((error = load_files(db->sql, &out->files))) {
+		cf_print_err("cannot load file table, error %d\n", error);
+		goto fail;
+	}
+	if ((error = load_typenames(db->sql, &out->files, &out->typenames))) {
+		cf_print_err("cannot load typename table, error %d\n", error);
+		goto fail;
+	}
+	if ((error = load_members(db->sql, &out->files, &out->members))) {
+		cf_print_err("cannot load member table, error %d\n", error);
+		goto fail;
+	}
+
+	cf_print_debug("scan loaded %zu files, %zu typenames, %zu members\n",
+			out->files.num_rows - 1, out->typenames.num_rows,
+			out->members.num_rows);
+	return 0;
+
+fail:
+	scan_table_free(out);
+	return error;
+}
+
+void
+scan_table_free(scan_table_t *table)
+{
+	scan_files_t *files = &table->files;
+	cf_free(files->ids);
+	strs_free(&files->paths);
+
+	scan_typenames_t *typenames = &table->typenames;
+	cf_free(typenames->ids);
+	strs_free(&typenames->names);
+	cf_free(typenames->name_kind);
+	cf_free(typenames->type_kind);
+	cf_free(typenames->local);
+	cf_free(typenames->base_type);
+	cf_free(typenames->file);
+	cf_free(typenames->line);
+	cf_free(typenames->column);
+
+	scan_members_t *members = &table->members;
+	strs_free(&members->names);
+	cf_free(members->parent);
+	cf_free(members->base_type);
+	cf_free(members->file);
+	cf_free(members->line);
+	cf_free(members->column);
+
+	memset(table, 0, sizeof(*table));
+}
+
+/*
+ * Find typenames matching `name` and `filter`.
+ *
+ * `name` is a sql LIKE pattern. The results are the same, and in the same
+ * order, as a cf_db_typename_find() call with the same arguments. That
+ * includes `filter->after`: cursors from scan_typename_cursor() and
+ * db_typename_iter_cursor() are interchangeable. Return ENOENT for a cursor
+ * not in `table`.
+ *
+ * On success, follow with a call to scan_result_free().
+ */
+int
+scan_find_typenames(const scan_table_t *table, const cf_str_t *name,
+		const db_filter_t *filter, scan_result_t *out)
+{
+	int error;
+	const scan_typenames_t *typenames = &table->typenames;
+	const size_t num_rows = typenames->num_rows;
+	uint8_t *file_mask = NULL;
+
+	memset(out, 0, sizeof(*out));
+
+	uint32_t cursor = 0;
+	if (filter->after && !typename_row(typenames, filter->after, &cursor)) {
+		return ENOENT;
+	}
+	if (!num_rows) {
+		return 0;
+	}
+
+	uint8_t *keep = cf_malloc(num_rows);
+	if (!keep) {
+		return ENOMEM;
+	}
+
+	if ((error = filter_name(&typenames->names, num_rows, name, keep))) {
+		goto fail;
+	}
+	if (filter->after && !filter->order) {
+		// rows are in rowid order; everything up to the cursor is done
+		memset(keep, 0, (size_t)cursor + 1);
+	}
+	if (filter->name_kind) {
+		filter_eq_u8(typenames->name_kind, (uint8_t)filter->name_kind,
+				num_rows, keep);
+	}
+	if (filter->type_kind) {
+		filter_eq_u8(typenames->type_kind, (uint8_t)filter->type_kind,
+				num_rows, keep);
+	}
+	if (filter->scope) {
+		filter_eq_u8(typenames->local, filter->scope == db_scope_local,
+				num_rows, keep);
+	}
+	if (!cf_str_is_null(&filter->file_glob)) {
+		if ((error = make_file_mask(&table->files, &filter->file_glob,
+				&file_mask))) {
+			goto fail;
+		}
+		filter_file(typenames->file, file_mask, num_rows, keep);
+	}
+
+	// a limit can only be applied while collecting if there's no sorting
+	const uint32_t early_limit = filter->order ? 0 : filter->limit;
+	if ((error = collect_rows(&typenames->names, name, keep, num_rows,
+			early_limit, out))) {
+		goto fail;
+	}
+
+	if (filter->order) {
+		if (filter->after) {
+			skip_to_cursor(table, &typenames->names, typenames->file,
+					typenames->line, filter->order, cursor, out);
+		}
+		sort_rows(table, &typenames->names, typenames->file, typenames->line,
+				filter->order, out);
+		if (filter->limit && (out->len > filter->limit)) {
+			out->len = filter->limit;
+		}
+	}
+
+fail:
+	cf_free(file_mask);
+	cf_free(keep);
+	return error;
+}
+
+/*
+ * Find members of type `parent` matching `name` and `filter`.
+ *
+ * Similar to scan_find_typenames(). Only `filter->file_glob` applies.
+ */
+int
+scan_find_members(const scan_table_t *table, int64_t parent,
+		const cf_str_t *name, const db_filter_t *filter, scan_result_t *out)
+{
+	int error;
+	const scan_members_t *members = &table->members;
+	const size_t num_rows = members->num_rows;
+	uint8_t *file_mask = NULL;
+
+	memset(out, 0, sizeof(*out));
+	if (!num_rows) {
+		return 0;
+	}
+
+	uint8_t *keep = cf_malloc(num_rows);
+	if (!keep) {
+		return ENOMEM;
+	}
+
+	if ((error = filter_name(&members->names, num_rows, name, keep))) {
+		goto fail;
+	}
+	filter_eq_i64(members->parent, parent, num_rows, keep);
+	if (filter && !cf_str_is_null(&filter->file_glob)) {
+		if ((error = make_file_mask(&table->files, &filter->file_glob,
+				&file_mask))) {
+			goto fail;
+		}
+		filter_file(members->file, file_mask, num_rows, keep);
+	}
+
+	if ((error = collect_rows(&members->names, name, keep, num_rows, 0,
+			out))) {
+		goto fail;
+	}
+
+fail:
+	cf_free(file_mask);
+	cf_free(keep);
+	return error;
+}
+
+void
+scan_result_free(scan_result_t *result)
+{
+	cf_free(result->rows);
+	result->rows = NULL;
+	result->len = 0;
+}
+
+/*
+ * Materialize typename `row` of `table`.
+ *
+ * `entry_out->name` and `*file_out` borrow from `table`.
+ */
+void
+scan_get_typename(const scan_table_t *table, uint32_t row,
+		db_typename_t *entry_out, loc_ctx_t *loc_out, cf_str_t *file_out)
+{
+	const scan_typenames_t *typenames = &table->typenames;
+	cf_assert(row < typenames->num_rows);
+
+	const uint32_t file = typenames->file[row];
+
+	memset(entry_out, 0, sizeof(*entry_out));
+	strs_get(&typenames->names, row, &entry_out->name);
+	entry_out->kind = typenames->name_kind[row];
+	entry_out->base_type.rowid = typenames->base_type[row];
+
+	*loc_out = (loc_ctx_t) {
+		.file = {
+			.rowid = table->files.ids[file],
+		},
+		.line = typenames->line[row],
+		.column = typenames->column[row],
+	};
+	strs_get(&table->files.paths, file, file_out);
+}
+
+/*
+ * Return the keyset cursor of typename `row` of `table`.
+ *
+ * See db_typename_iter_cursor().
+ */
+int64_t
+scan_typename_cursor(const scan_table_t *table, uint32_t row)
+{
+	cf_assert(row < table->typenames.num_rows);
+	return table->typenames.ids[row];
+}
+
+/*
+ * Materialize member `row` of `table`. Similar to scan_get_typename().
+ */
+void
+scan_get_member(const scan_table_t *table, uint32_t row,
+		db_member_t *entry_out, loc_ctx_t *loc_out, cf_str_t *file_out)
+{
+	const scan_members_t *members = &table->members;
+	cf_assert(row < members->num_rows);
+
+	const uint32_t file = members->file[row];
+
+	*entry_out = (db_member_t) {
+		.parent = {
+			.rowid = members->parent[row],
+		},
+		.base_type = {
+			.rowid = members->base_type[row],
+		},
+	};
+	strs_get(&members->names, row, &entry_out->name);
+
+	*loc_out = (loc_ctx_t) {
+		.file = {
+			.rowid = table->files.ids[file],
+		},
+		.line = members->line[row],
+		.column = members->column[row],
+	};
+	strs_get(&table->files.paths, file, file_out);
+}
+
+static int
+load_files(sqlite3 *db, scan_files_t *out)
+{
+	int error;
+	sqlite3_stmt *stmt;
+
+	// row 0: placeholder for a missing file
+	if ((error = reserve_files(out))) {
+		return error;
+	}
+	cf_str_t path;
+	cf_str_borrow("", 0, &path);
+	out->ids[0] = 0;
+	if ((error = strs_push(&out->paths, 0, &path))) {
+		return error;
+	}
+	out->num_rows = 1;
+
+	if ((error = scan_files(db, &stmt))) {
+		return error;
+	}
+
+	while (!(error = iter_next_scan_row(stmt))) {
+		int64_t id;
+		if ((error = iter_get_scan_file(stmt, &id, &path))) {
+			goto fail;
+		}
+		if ((error = reserve_files(out))) {
+			goto fail;
+		}
+
+		const size_t row = out->num_rows;
+		out->ids[row] = id;
+		if ((error = strs_push(&out->paths, row, &path))) {
+			goto fail;
+		}
+		out->num_rows++;
+	}
+	if (error == ENOENT) {
+		// no more rows
+		error = 0;
+	}
+
+fail:
+	free_scan_rows(stmt);
+	return error;
+}
+
+static int
+load_typenames(sqlite3 *db, const scan_files_t *files, scan_typenames_t *out)
+{
+	int error;
+	sqlite3_stmt *stmt;
+
+	if ((error = scan_typenames(db, &stmt))) {
+		return error;
+	}
+
+	while (!(error = iter_next_scan_row(stmt))) {
+		int64_t rowid;
+		db_typename_t entry;
+		type_kind_t type_kind;
+		loc_ctx_t loc;
+
+		if ((error = iter_get_scan_typename(stmt, &rowid, &entry, &type_kind,
+				&loc))) {
+			goto fail;
+		}
+		if ((error = reserve_typenames(out))) {
+			goto fail;
+		}
+
+		const size_t row = out->num_rows;
+		if ((error = strs_push(&out->names, row, &entry.name))) {
+			goto fail;
+		}
+		out->ids[row] = rowid;
+		out->name_kind[row] = (uint8_t)entry.kind;
+		out->type_kind[row] = (uint8_t)type_kind;
+		out->local[row] = (loc.scope != scope_global);
+		out->base_type[row] = entry.base_type.rowid;
+		out->file[row] = file_row(files, loc.file.rowid);
+		out->line[row] = loc.line;
+		out->column[row] = loc.column;
+		out->num_rows++;
+	}
+	if (error == ENOENT) {
+		error = 0;
+	}
+
+fail:
+	free_scan_rows(stmt);
+	return error;
+}
+
+static int
+load_members(sqlite3 *db, const scan_files_t *files, scan_members_t *out)
+{
+	int error;
+	sqlite3_stmt *stmt;
+
+	if ((error = scan_members(db, &stmt))) {
+		return error;
+	}
+
+	while (!(error = iter_next_scan_row(stmt))) {
+		db_member_t entry;
+		loc_ctx_t loc;
+
+		if ((error = iter_get_scan_member(stmt, &entry, &loc))) {
+			goto fail;
+		}
+		if ((error = reserve_members(out))) {
+			goto fail;
+		}
+
+		const size_t row = out->num_rows;
+		if ((error = strs_push(&out->names, row, &entry.name))) {
+			goto fail;
+		}
+		out->parent[row] = entry.parent.rowid;
+		out->base_type[row] = entry.base_type.rowid;
+		out->file[row] = file_row(files, loc.file.rowid);
+		out->line[row] = loc.line;
+		out->column[row] = loc.column;
+		out->num_rows++;
+	}
+	if (error == ENOENT) {
+		error = 0;
+	}
+
+fail:
+	free_scan_rows(stmt);
+	return error;
+}
+
+/*
+ * Make room for one more row in every column of `files`.
+ */
+static int
+reserve_files(scan_files_t *files)
+{
+	if (files->num_rows < files->capacity) {
+		return 0;
+	}
+	const size_t capacity = files->capacity ?
+			(files->capacity * 2) : SCAN_MIN_ROWS;
+	if (capacity > UINT32_MAX) {
+		return ERANGE;
+	}
+
+	if (!grow_column(files->ids, capacity) ||
+			!grow_column(files->paths.offs, capacity + 1)) {
+		return ENOMEM;
+	}
+	if (!files->num_rows) {
+		files->paths.offs[0] = 0;
+	}
+	files->capacity = capacity;
+	return 0;
+}
+
+static int
+reserve_typenames(scan_typenames_t *typenames)
+{
+	if (typenames->num_rows < typenames->capacity) {
+		return 0;
+	}
+	const size_t capacity = typenames->capacity ?
+			(typenames->capacity * 2) : SCAN_MIN_ROWS;
+	if (capacity > UINT32_MAX) {
+		return ERANGE;
+	}
+
+	if (!grow_column(typenames->ids, capacity) ||
+			!grow_column(typenames->names.offs, capacity + 1) ||
+			!grow_column(typenames->name_kind, capacity) ||
+			!grow_column(typenames->type_kind, capacity) ||
+			!grow_column(typenames->local, capacity) ||
+			!grow_column(typenames->base_type, capacity) ||
+			!grow_column(typenames->file, capacity) ||
+			!grow_column(typenames->line, capacity) ||
+			!grow_column(typenames->column, capacity)) {
+		return ENOMEM;
+	}
+	if (!typenames->num_rows) {
+		typenames->names.offs[0] = 0;
+	}
+	typenames->capacity = capacity;
+	return 0;
+}
+
+static int
+reserve_members(scan_members_t *members)
+{
+	if (members->num_rows < members->capacity) {
+		return 0;
+	}
+	const size_t capacity = members->capacity ?
+			(members->capacity * 2) : SCAN_MIN_ROWS;
+	if (capacity > UINT32_MAX) {
+		return ERANGE;
+	}
+
+	if (!grow_column(members->names.offs, capacity + 1) ||
+			!grow_column(members->parent, capacity) ||
+			!grow_column(members->base_type, capacity) ||
+			!grow_column(members->file, capacity) ||
+			!grow_column(members->line, capacity) ||
+			!grow_column(members->column, capacity)) {
+		return ENOMEM;
+	}
+	if (!members->num_rows) {
+		members->names.offs[0] = 0;
+	}
+	members->capacity = capacity;
+	return 0;
+}
+
+/*
+ * Convert file rowid `id` into a row index of `files`.
+ *
+ * Binary search because `files->ids` is sorted. Unknown files map to the
+ * placeholder row 0.
+ */
+static uint32_t
+file_row(const scan_files_t *files, int64_t id)
+{
+	size_t lo = 1;
+	size_t hi = files->num_rows;
+	while (lo < hi) {
+		const size_t mid = lo + (hi - lo) / 2;
+		const int64_t mid_id = files->ids[mid];
+		if (mid_id == id) {
+			return (uint32_t)mid;
+		}
+		if (mid_id < id) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
+		}
+	}
+	return 0;
+}
+
+/*
+ * Convert typename rowid `id` into a row index of `typenames`.
+ *
+ * Like file_row(), but there's no placeholder row. Return false if there's
+ * no such row.
+ */
+static bool
+typename_row(const scan_typenames_t *typenames, int64_t id, uint32_t *out)
+{
+	size_t lo = 0;
+	size_t hi = typenames->num_rows;
+	while (lo < hi) {
+		const size_t mid = lo + (hi - lo) / 2;
+		const int64_t mid_id = typenames->ids[mid];
+		if (mid_id == id) {
+			*out = (uint32_t)mid;
+			return true;
+		}
+		if (mid_id < id) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
+		}
+	}
+	return false;
+}
+
+/*
+ * Append `str` as string number `row` of `strs`.
+ *
+ * Rows must be pushed in order. The caller must have already grown
+ * `strs->offs` to hold `row + 2` entries.
+ */
+static int
+strs_push(scan_strs_t *strs, size_t row, const cf_str_t *str)
+{
+	int error;
+	const size_t len = cf_str_len(str);
+
+	if ((strs->len + len + 1) > UINT32_MAX) {
+		return ERANGE;
+	}
+	if ((error = strs_reserve(strs, len + 1))) {
+		return error;
+	}
+
+	cf_assert(strs->offs[row] == strs->len);
+	memcpy(strs->blob + strs->len, str->str, len);
+	strs->blob[strs->len + len] = '\0';
+
+	if (strs->searchable) {
+		char *lower = strs->lower + strs->len;
+		for (size_t i = 0; i < len; ++i) {
+			lower[i] = ascii_lower(str->str[i]);
+		}
+		lower[len] = '\0';
+	}
+
+	strs->len += len + 1;
+	strs->offs[row + 1] = (uint32_t)strs->len;
+	return 0;
+}
+
+/*
+ * Make room for `len` more bytes in `strs`.
+ */
+static int
+strs_reserve(scan_strs_t *strs, size_t len)
+{
+	if ((strs->len + len) <= strs->capacity) {
+		return 0;
+	}
+
+	size_t capacity = strs->capacity ? strs->capacity : SCAN_MIN_BYTES;
+	while (capacity < (strs->len + len)) {
+		capacity *= 2;
+	}
+
+	if (!grow_column(strs->blob, capacity)) {
+		return ENOMEM;
+	}
+	if (strs->searchable && !grow_column(strs->lower, capacity)) {
+		return ENOMEM;
+	}
+	strs->capacity = capacity;
+	return 0;
+}
+
+/*
+ * Set `out` to borrow string `row` of `strs`.
+ */
+static void
+strs_get(const scan_strs_t *strs, uint32_t row, cf_str_t *out)
+{
+	const uint32_t off = strs->offs[row];
+	const size_t len = strs->offs[row + 1] - off - 1;
+	cf_str_borrow(strs->blob + off, len, out);
+}
+
+static void
+strs_free(scan_strs_t *strs)
+{
+	cf_free(strs->blob);
+	cf_free(strs->lower);
+	cf_free(strs->offs);
+}
+
+/*
+ * tolower(3) for the "C" locale only. sqlite's LIKE only folds ASCII.
+ */
+static char
+ascii_lower(char c)
+{
+	if (('A' <= c) && (c <= 'Z')) {
+		return (char)(c - 'A' + 'a');
+	}
+	return c;
+}
+
+/*
+ * Set each entry in `keep` to 1 if the corresponding string in `names`
+ * might match LIKE pattern `pattern`, 0 otherwise.
+ *
+ * This only checks that the longest literal part of `pattern` appears in the
+ * string. collect_rows() does the full match.
+ *
+ * memmem(3) runs over the entire blob at once rather than each string. Hits
+ * are mapped back to a row by binary searching `names->offs`. The NUL between
+ * strings keeps a hit from spanning two of them.
+ */
+static int
+filter_name(const scan_strs_t *names, size_t num_rows, const cf_str_t *pattern,
+		uint8_t *keep)
+{
+	size_t start;
+	const size_t lit_len = longest_literal(pattern, &start);
+
+	if (!lit_len) {
+		// e.g., "%": every row might match
+		memset(keep, 1, num_rows);
+		return 0;
+	}
+
+	char *lit = cf_malloc(lit_len);
+	if (!lit) {
+		return ENOMEM;
+	}
+	for (size_t i = 0; i < lit_len; ++i) {
+		lit[i] = ascii_lower(pattern->str[start + i]);
+	}
+
+	memset(keep, 0, num_rows);
+
+	const char *const base = names->lower;
+	const char *const end = base + names->len;
+	const char *p = base;
+	while (p < end) {
+		const char *hit = memmem(p, (size_t)(end - p), lit, lit_len);
+		if (!hit) {
+			break;
+		}
+		const uint32_t row = row_of_offset(names->offs, num_rows,
+				(size_t)(hit - base));
+		keep[row] = 1;
+
+		// resume at the next string
+		p = base + names->offs[row + 1];
+	}
+
+	cf_free(lit);
+	return 0;
+}
+
+/*
+ * keep[i] &= (col[i] == val)
+ *
+ * 16 rows at a time.
+ */
+static void
+filter_eq_u8(const uint8_t *col, uint8_t val, size_t num_rows, uint8_t *keep)
+{
+	const size_t width = sizeof(scan_vec_t);
+	size_t i = 0;
+
+	for (; (i + width) <= num_rows; i += width) {
+		scan_vec_t c;
+		scan_vec_t k;
+		memcpy(&c, col + i, width);
+		memcpy(&k, keep + i, width);
+		k &= (scan_vec_t)(c == val);
+		memcpy(keep + i, &k, width);
+	}
+	for (; i < num_rows; ++i) {
+		keep[i] &= (col[i] == val);
+	}
+}
+
+/*
+ * keep[i] &= (col[i] == val)
+ */
+static void
+filter_eq_i64(const int64_t *col, int64_t val, size_t num_rows, uint8_t *keep)
+{
+	for (size_t i = 0; i < num_rows; ++i) {
+		keep[i] &= (col[i] == val);
+	}
+}
+
+/*
+ * keep[i] &= file_mask[col[i]]
+ */
+static void
+filter_file(const uint32_t *col, const uint8_t *file_mask, size_t num_rows,
+		uint8_t *keep)
+{
+	for (size_t i = 0; i < num_rows; ++i) {
+		keep[i] &= file_mask[col[i]];
+	}
+}
+
+/*
+ * Match every file path against `glob` once.
+ *
+ * On success, `*out` is a heap array with an entry per row of `files`: 1 if
+ * the path matches, 0 if not. cf_free() it.
+ */
+static int
+make_file_mask(const scan_files_t *files, const cf_str_t *glob,
+		uint8_t **out)
+{
+	int error;
+
+	// fnmatch(3) needs a NUL-terminated pattern
+	const size_t glob_len = cf_str_len(glob);
+	char *pattern = cf_malloc(glob_len + 1);
+	if (!pattern) {
+		return ENOMEM;
+	}
+	memcpy(pattern, glob->str, glob_len);
+	pattern[glob_len] = '\0';
+
+	uint8_t *mask = cf_malloc(files->num_rows);
+	if (!mask) {
+		error = ENOMEM;
+		goto fail;
+	}
+
+	// the placeholder row never matches
+	mask[0] = 0;
+	for (size_t i = 1; i < files->num_rows; ++i) {
+		const char *path = files->paths.blob + files->paths.offs[i];
+		mask[i] = glob_match_path(pattern, path);
+	}
+
+	*out = mask;
+	error = 0;
+fail:
+	cf_free(pattern);
+	return error;
+}
+
+/*
+ * The same match as `FILE_GLOB_FILTER` in "query_desc.h": `path` or any
+ * suffix of it that follows a '/' matches `glob`.
+ *
+ * Note: fnmatch(3) and sqlite's GLOB differ on negated bracket expressions;
+ * fnmatch(3) wants "[!...]" where sqlite also takes "[^...]".
+ */
+static bool
+glob_match_path(const char *glob, const char *path)
+{
+	if (!fnmatch(glob, path, 0)) {
+		return true;
+	}
+	for (const char *p = strchr(path, '/'); p; p = strchr(p + 1, '/')) {
+		if (!fnmatch(glob, p + 1, 0)) {
+			return true;
+		}
+	}
+	return false;
+}
+
+/*
+ * Find the longest run of `pattern` without LIKE wildcards.
+ *
+ * Return its length and set `*start_out` to its offset in `pattern`.
+ */
+static size_t
+longest_literal(const cf_str_t *pattern, size_t *start_out)
+{
+	const size_t len = cf_str_len(pattern);
+	size_t best_start = 0;
+	size_t best_len = 0;
+	size_t run_start = 0;
+
+	for (size_t i = 0; i <= len; ++i) {
+		const bool wild = (i == len) ||
+				(pattern->str[i] == '%') || (pattern->str[i] == '_');
+		if (!wild) {
+			continue;
+		}
+		if ((i - run_start) > best_len) {
+			best_start = run_start;
+			best_len = i - run_start;
+		}
+		run_start = i + 1;
+	}
+
+	*start_out = best_start;
+	return best_len;
+}
+
+/*
+ * Return the row whose string contains byte offset `off`.
+ */
+static uint32_t
+row_of_offset(const uint32_t *offs, size_t num_rows, size_t off)
+{
+	// find the last row starting at or before `off`
+	size_t lo = 0;
+	size_t hi = num_rows;
+	while ((hi - lo) > 1) {
+		const size_t mid = lo + (hi - lo) / 2;
+		if (offs[mid] <= off) {
+			lo = mid;
+		} else {
+			hi = mid;
+		}
+	}
+	return (uint32_t)lo;
+}
+
+/*
+ * sql LIKE without an ESCAPE clause.
+ *
+ * '%' matches any run of characters and '_' matches any single character.
+ * `str` must already be lower case. `pat` is folded here.
+ */
+static bool
+like_match(const char *pat, size_t pat_len, const char *str, size_t len)
+{
+	size_t p = 0;
+	size_t s = 0;
+	// position of the last '%' in `pat` and where in `str` it started
+	size_t star = SIZE_MAX;
+	size_t mark = 0;
+
+	while (s < len) {
+		if ((p < pat_len) && (pat[p] == '%')) {
+			star = p++;
+			mark = s;
+			continue;
+		}
+		if ((p < pat_len) &&
+				((pat[p] == '_') || (ascii_lower(pat[p]) == str[s]))) {
+			++p;
+			++s;
+			continue;
+		}
+		if (star != SIZE_MAX) {
+			// let the last '%' absorb one more character
+			p = star + 1;
+			s = ++mark;
+			continue;
+		}
+		return false;
+	}
+
+	while ((p < pat_len) && (pat[p] == '%')) {
+		++p;
+	}
+	return p == pat_len;
+}
+
+/*
+ * Fill `out` with the rows that have their `keep` flag set and fully match
+ * `pattern`. Stop after `limit` rows if it's nonzero.
+ */
+static int
+collect_rows(const scan_strs_t *names, const cf_str_t *pattern,
+		const uint8_t *keep, size_t num_rows, uint32_t limit,
+		scan_result_t *out)
+{
+	size_t capacity = 0;
+	uint32_t *rows = NULL;
+	size_t len = 0;
+
+	const size_t pat_len = cf_str_len(pattern);
+
+	size_t i = 0;
+	while (i < num_rows) {
+		// skip 8 cleared flags at a time
+		if ((i + sizeof(uint64_t)) <= num_rows) {
+			uint64_t word;
+			memcpy(&word, keep + i, sizeof(word));
+			if (!word) {
+				i += sizeof(word);
+				continue;
+			}
+		}
+
+		const size_t row = i++;
+		if (!keep[row]) {
+			continue;
+		}
+
+		const uint32_t off = names->offs[row];
+		const size_t str_len = names->offs[row + 1] - off - 1;
+		if (!like_match(pattern->str, pat_len, names->lower + off, str_len)) {
+			continue;
+		}
+
+		if (len == capacity) {
+			capacity = capacity ? (capacity * 2) : SCAN_MIN_ROWS;
+			if (!grow_column(rows, capacity)) {
+				cf_free(rows);
+				return ENOMEM;
+			}
+		}
+		rows[len++] = (uint32_t)row;
+
+		if (limit && (len == limit)) {
+			break;
+		}
+	}
+
+	out->rows = rows;
+	out->len = len;
+	return 0;
+}
+
+/*
+ * Sort `result` in `order`. Ties are broken by row, i.e., database rowid.
+ */
+static void
+sort_rows(const scan_table_t *table, const scan_strs_t *names,
+		const uint32_t *file, const uint32_t *line, db_order_t order,
+		scan_result_t *result)
+{
+	if (result->len < 2) {
+		return;
+	}
+
+	sort_key_t *keys = cf_malloc(result->len * sizeof(*keys));
+	if (!keys) {
+		// leave unsorted
+		cf_print_warn("no memory to sort %zu results\n", result->len);
+		return;
+	}
+
+	for (size_t i = 0; i < result->len; ++i) {
+		make_sort_key(table, names, file, line, result->rows[i], &keys[i]);
+	}
+
+	qsort(keys, result->len, sizeof(*keys),
+			(order == db_order_name) ? compare_by_name : compare_by_file);
+
+	for (size_t i = 0; i < result->len; ++i) {
+		result->rows[i] = keys[i].row;
+	}
+	cf_free(keys);
+}
+
+/*
+ * Drop every row of `result` that sorts at or before row `cursor` in `order`.
+ *
+ * The order of the remaining rows is kept.
+ */
+static void
+skip_to_cursor(const scan_table_t *table, const scan_strs_t *names,
+		const uint32_t *file, const uint32_t *line, db_order_t order,
+		uint32_t cursor, scan_result_t *result)
+{
+	int (*const compare)(const void *, const void *) =
+			(order == db_order_name) ? compare_by_name : compare_by_file;
+	sort_key_t cursor_key;
+	make_sort_key(table, names, file, line, cursor, &cursor_key);
+
+	size_t len = 0;
+	for (size_t i = 0; i < result->len; ++i) {
+		sort_key_t key;
+		make_sort_key(table, names, file, line, result->rows[i], &key);
+		if (compare(&key, &cursor_key) > 0) {
+			result->rows[len++] = result->rows[i];
+		}
+	}
+	result->len = len;
+}
+
+/*
+ * Fill in the sort key of `row`.
+ */
+static void
+make_sort_key(const scan_table_t *table, const scan_strs_t *names,
+		const uint32_t *file, const uint32_t *line, uint32_t row,
+		sort_key_t *out)
+{
+	const scan_strs_t *paths = &table->files.paths;
+	const uint32_t off = names->offs[row];
+
+	*out = (sort_key_t) {
+		.name = names->blob + off,
+		.name_len = names->offs[row + 1] - off - 1,
+		.path = paths->blob + paths->offs[file[row]],
+		.line = line[row],
+		.row = row,
+	};
+}
+
+/*
+ * Byte-wise, the same as sqlite's default BINARY collation.
+ */
+static int
+compare_by_name(const void *lhs_, const void *rhs_)
+{
+	const sort_key_t *const lhs = lhs_;
+	const sort_key_t *const rhs = rhs_;
+
+	const size_t len = (lhs->name_len < rhs->name_len) ?
+			lhs->name_len : rhs->name_len;
+	int ret = memcmp(lhs->name, rhs->name, len);
+	if (ret) {
+		return ret;
+	}
+	if ((ret = (lhs->name_len > rhs->name_len) -
+			(lhs->name_len < rhs->name_len))) {
+		return ret;
+	}
+	return (lhs->row > rhs->row) - (lhs->row < rhs->row);
+}
+
+static int
+compare_by_file(const void *lhs_, const void *rhs_)
+{
+	const sort_key_t *const lhs = lhs_;
+	const sort_key_t *const rhs = rhs_;
+
+	int ret = strcmp(lhs->path, rhs->path);
+	if (ret) {
+		return ret;
+	}
+	if ((ret = (lhs->line > rhs->line) - (lhs->line < rhs->line))) {
+		return ret;
+	}
+	return (lhs->row > rhs->row) - (lhs->row < rhs->row);
+}
@@ -0,0 +1,168 @@
+/*
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ * Copyright (C) 2024 cfind developer
+ *
+ * Columnar in-memory scan engine.
+ *
+ * An alternative to running find queries through sqlite one row at a time.
+ * The typename, member, and file tables are read once into column arrays.
+ * A query then runs as a sequence of filter passes over whole columns, and
+ * only rows that pass every filter are handed back to the caller.
+ *
+ * This only pays off for broad, ad-hoc queries (e.g., wildcard names) run
+ * against a database that fits in memory. Point lookups are faster through
+ * sqlite's indexes.
+ */
+#pragma once
+
+#include "cc_support.h"
+#include "cf_string.h"
+#include "db_types.h"
+#include "sql_db.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+__BEGIN_DECLS
+
+/*
+ * A column of strings.
+ *
+ * Members
+ * - blob
+ *   Every string back to back, each followed by a NUL.
+ * - lower
+ *   Same as `blob` but ASCII lower case. Name matching is case insensitive
+ *   like sql's LIKE, so substring searches run on this copy.
+ *   NULL for columns that are never searched.
+ * - offs
+ *   Byte offset of each string in `blob`. Has one extra trailing entry equal
+ *   to the total length so that the length of string `i` is
+ *   `offs[i + 1] - offs[i] - 1`.
+ * - len
+ *   Bytes used in `blob`.
+ * - capacity
+ *   Bytes allocated for `blob` (and `lower`).
+ * - searchable
+ *   Whether to maintain `lower`.
+ */
+typedef struct {
+	char *blob;
+	char *lower;
+	uint32_t *offs;
+	size_t len;
+	size_t capacity;
+	bool searchable;
+} scan_strs_t;
+
+/*
+ * The file table.
+ *
+ * Row 0 is a placeholder for entries without a file. Other tables refer to
+ * files by row index rather than by database rowid.
+ *
+ * Members
+ * - num_rows
+ *   Rows used, including the placeholder.
+ * - capacity
+ *   Rows allocated in every column.
+ * - ids
+ *   Database rowid of each file, ascending.
+ * - paths
+ */
+typedef struct {
+	size_t num_rows;
+	size_t capacity;
+	int64_t *ids;
+	scan_strs_t paths;
+} scan_files_t;
+
+/*
+ * The typename table, joined with the kind of each named type.
+ *
+ * Members
+ * - names
+ * - name_kind
+ *   `typename_kind_t` of each row.
+ * - type_kind
+ *   `type_kind_t` of the type each row names. 0 if unknown.
+ * - local
+ *   1 if the row is declared inside a function, 0 if at file scope.
+ * - ids
+ *   Database rowid of each row, ascending. Also the row's keyset cursor.
+ * - base_type
+ *   Database rowid of the type each row names.
+ * - file
+ *   Row index into `scan_files_t`.
+ * - line, column
+ */
+typedef struct {
+	size_t num_rows;
+	size_t capacity;
+	int64_t *ids;
+	scan_strs_t names;
+	uint8_t *name_kind;
+	uint8_t *type_kind;
+	uint8_t *local;
+	int64_t *base_type;
+	uint32_t *file;
+	uint32_t *line;
+	uint32_t *column;
+} scan_typenames_t;
+
+/*
+ * The member table.
+ *
+ * Members are similar to `scan_typenames_t`.
+ */
+typedef struct {
+	size_t num_rows;
+	size_t capacity;
+	scan_strs_t names;
+	int64_t *parent;
+	int64_t *base_type;
+	uint32_t *file;
+	uint32_t *line;
+	uint32_t *column;
+} scan_members_t;
+
+/*
+ * All tables loaded by scan_table_load().
+ */
+typedef struct {
+	scan_files_t files;
+	scan_typenames_t typenames;
+	scan_members_t members;
+} scan_table_t;
+
+/*
+ * Rows that passed a scan, in result order.
+ *
+ * Members
+ * - rows
+ *   Row indices into the scanned table.
+ * - len
+ *   Number of entries in `rows`.
+ */
+typedef struct {
+	uint32_t *rows;
+	size_t len;
+} scan_result_t;
+
+int scan_table_load(sqlite_db_t *db, scan_table_t *out);
+void scan_table_free(scan_table_t *table);
+
+int scan_find_typenames(const scan_table_t *table, const cf_str_t *name,
+		const db_filter_t *filter, scan_result_t *out);
+int scan_find_members(const scan_table_t *table, int64_t parent,
+		const cf_str_t *name, const db_filter_t *filter, scan_result_t *out);
+void scan_result_free(scan_result_t *result);
+
+void scan_get_typename(const scan_table_t *table, uint32_t row,
+		db_typename_t *entry_out, loc_ctx_t *loc_out, cf_str_t *file_out);
+int64_t scan_typename_cursor(const scan_table_t *table, uint32_t row);
+void scan_get_member(const scan_table_t *table, uint32_t row,
+		db_member_t *entry_out, loc_ctx_t *loc_out, cf_str_t *file_out);
+
+__END_DECLS
@@ -12,6 +12,8 @@
 #include "db_types.h"
 #include "cf_db.h"
 #include "sql_db.h"
+#include "scan.h"
+#include "query_log.h"
 #include "token.h"
 
 #include <errno.h>
@@ -19,24 +21,65 @@
 #include <stdbool.h>
 #include <string.h>
 
-static int exec_search(cf_db_t *db, search_cmd_t *cmd);
-static int exec_search_type(cf_db_t *db, type_search_t *query);
+CF_VEC_FUNC_DECL(use_count_vec_t, db_type_use_count_t, use_count_vec);
+
+/*
+ * State of the command being executed.
+ *
+ * Members
+ * - opts
+ * - num_results
+ *   Number of results printed so far.
+ */
+typedef struct {
+	const search_opts_t *opts;
+	size_t num_results;
+} exec_ctx_t;
+
+static void log_command(const cf_str_t *cmd, const search_opts_t *opts,
+		const search_result_t *result, int error, uint64_t latency_us);
+
+static int exec_search(cf_db_t *db, const scan_table_t *table,
+		search_cmd_t *cmd, exec_ctx_t *ctx);
+static int exec_search_type(cf_db_t *db, type_search_t *query,
+		const db_filter_t *filter, exec_ctx_t *ctx);
 static int search_type_core(cf_db_t *db, type_search_t *query,
+		const db_filter_t *filter, exec_ctx_t *ctx,
 		type_ref_t *id_out, db_type_entry_t *entry_out, loc_ctx_t *loc_out);
-static int exec_search_typename(cf_db_t *db, typename_search_t *query);
-static int exec_search_member(cf_db_t *db, member_search_t *query);
+static int exec_search_typename(cf_db_t *db, typename_search_t *query,
+		const db_filter_t *filter, exec_ctx_t *ctx);
+static int exec_search_member(cf_db_t *db, member_search_t *query,
+		const db_filter_t *filter, exec_ctx_t *ctx);
+static int exec_search_type_use(cf_db_t *db, type_search_t *query,
+		const db_filter_t *filter, exec_ctx_t *ctx);
 
 static int find_one_type(cf_db_t *db, const name_spec_t *name,
-		type_ref_t *out);
-static int find_elab_type(cf_db_t *db, const name_spec_t *name,
-		type_ref_t *out);
-
-static int print_all_typenames(cf_db_t *db, const name_spec_t *name);
+		const db_filter_t *filter, type_ref_t *out);
+static void make_name_filter(const name_spec_t *name,
+		const db_filter_t *filter, db_filter_t *out);
+
+static int print_all_typenames(cf_db_t *db, const name_spec_t *name,
+		const db_filter_t *filter, exec_ctx_t *ctx);
+
+static int exec_scan_typename(cf_db_t *db, const scan_table_t *table,
+		typename_search_t *query, const db_filter_t *filter,
+		exec_ctx_t *ctx);
+static int exec_scan_member(cf_db_t *db, const scan_table_t *table,
+		member_search_t *query, const db_filter_t *filter,
+		exec_ctx_t *ctx);
+static int scan_find_one_type(const scan_table_t *table,
+		const name_spec_t *name, const db_filter_t *filter, type_ref_t *out);
+static int scan_print_typenames(cf_db_t *db, const scan_table_t *table,
+		const name_spec_t *name, const db_filter_t *filter,
+		exec_ctx_t *ctx);
 
 static void print_type_entry(type_ref_t id, db_type_entry_t *entry,
 		loc_ctx_t *loc, const cf_str_t *file);
 static void print_one_typename(db_typename_t *name, loc_ctx_t *loc,
 		const cf_str_t *file);
+static void print_next_page(int64_t cursor);
+static void finish_result(cf_db_t *db, const loc_ctx_t *loc,
+		exec_ctx_t *ctx);
 static void print_member_entry(type_ref_t parent, const db_member_t *entry,
 		const loc_ctx_t *loc, const cf_str_t *file);
 
@@ -45,45 +88,120 @@ static void print_member_entry(type_ref_t parent, const db_member_t *entry,
  */
 #define user_print(fmt, ...) printf(fmt, ##__VA_ARGS__)
 
+/*
+ * Open the database at `db_path`, then run command `cmd` on it.
+ *
+ * If `opts->scan` is set, the database is loaded into a `scan_table_t` first.
+ * If `opts->log_path` is set, the command is recorded in the query log. Its
+ * latency doesn't include opening or loading the database, so a replay with
+ * the database already open measures the same thing.
+ */
+int
+run_one_command(const char *db_path, const cf_str_t *cmd,
+		const search_opts_t *opts)
+{
+	int error;
+	cf_db_t db;
+	scan_table_t table;
+	search_result_t result;
+
+	// open `db_path`
+	if ((error = cf_db_open_sql(db_path, false, &db))) {
+		goto fail;
+	}
+
+	if (opts->scan && (error = scan_table_load(&db.sql, &table))) {
+		goto fail_scan;
+	}
+
+	const uint64_t start = query_log_clock_us();
+	error = search_exec(&db, opts->scan ? &table : NULL, cmd, opts, &result);
+	if (opts->log_path) {
+		log_command(cmd, opts, &result, error,
+				query_log_clock_us() - start);
+	}
+
+	if (opts->scan) {
+		scan_table_free(&table);
+	}
+fail_scan:
+	cf_db_close(&db);
+fail:
+	return error;
+}
+
 /*
  * parse `cmd` into a `search_cmd_t`, then pass it to another function to
  * "execute" a search query.
  *
+ * `table` must be the scan table of `db` if `opts->scan` is set, else NULL.
+ * If `opts->context` is set, each result is followed by its source line as
+ * stored by the indexer.
+ *
+ * `out` is filled in even on failure.
+ *
  * ideas:
  * - search for type definition, get location back
  *
  * XXX
  */
 int
-run_one_command(const char *db_path, const cf_str_t *cmd)
+search_exec(cf_db_t *db, const scan_table_t *table, const cf_str_t *cmd,
+		const search_opts_t *opts, search_result_t *out)
 {
 	int error;
-	cf_db_t db;
+	exec_ctx_t ctx = {
+		.opts = opts,
+	};
 
-	// open `db_path`
-	if ((error = cf_db_open_sql(db_path, false, &db))) {
-		goto fail;
-	}
+	memset(out, 0, sizeof(*out));
 
 	// parse `cmd` into a query struct
 	search_cmd_t query;
 	if ((error = parse_command(cmd, &query))) {
-		goto fail_cmd;
+		return error;
 	}
+	out->kind = query.kind;
 
 	// execute search query
-	if ((error = exec_search(&db, &query))) {
-		goto fail_search;
-	}
+	error = exec_search(db, table, &query, &ctx);
+	out->num_results = ctx.num_results;
 
-fail_search:
 	free_search_cmd(&query);
-fail_cmd:
-	cf_db_close(&db);
-fail:
 	return error;
 }
 
+/*
+ * Append a record of `cmd` to the query log.
+ *
+ * Commands that didn't parse aren't logged; there's nothing to replay. A log
+ * that can't be written only gets a warning: the query itself worked.
+ */
+static void
+log_command(const cf_str_t *cmd, const search_opts_t *opts,
+		const search_result_t *result, int error, uint64_t latency_us)
+{
+	if (!result->kind) {
+		return;
+	}
+
+	query_record_t rec = {
+		.time_ms = query_log_wall_ms(),
+		.latency_us = latency_us,
+		.num_results = result->num_results,
+		.error = error,
+		.scan = opts->scan,
+		.kind = result->kind,
+	};
+	cf_str_borrow_str(cmd, &rec.cmd);
+
+	int log_error;
+	if ((log_error = query_log_append(opts->log_path, &rec))) {
+		cf_print_warn("cannot append to query log '%s', error %d\n",
+				opts->log_path, log_error);
+	}
+}
+
 #if 0
 /*
  * XXX experimental
@@ -135,19 +253,91 @@ typedef struct {
  * needs to be resolved and then printed
  */
 static int
-exec_search(cf_db_t *db, search_cmd_t *cmd)
+exec_search(cf_db_t *db, const scan_table_t *table, search_cmd_t *cmd,
+		exec_ctx_t *ctx)
 {
+	if (table) {
+		// `typedecl` and `typeuse` always go through `db`; they're single lookups
+		switch (cmd->kind) {
+			case search_typename:
+				return exec_scan_typename(db, table, &cmd->arg.typename,
+						&cmd->filter, ctx);
+			case search_member_decl:
+				return exec_scan_member(db, table, &cmd->arg.member,
+						&cmd->filter, ctx);
+			default:
+				break;
+		}
+	}
+
 	switch (cmd->kind) {
 		case search_type_decl:
-			return exec_search_type(db, &cmd->arg.type);
+			return exec_search_type(db, &cmd->arg.type, &cmd->filter, ctx);
 		case search_typename:
-			return exec_search_typename(db, &cmd->arg.typename);
+			return exec_search_typename(db, &cmd->arg.typename,
+					&cmd->filter, ctx);
 		case search_member_decl:
-			return exec_search_member(db, &cmd->arg.member);
+			return exec_search_member(db, &cmd->arg.member, &cmd->filter,
+					ctx);
+		case search_type_use:
+			return exec_search_type_use(db, &cmd->arg.type_use,
+					&cmd->filter, ctx);
 	}
 	__builtin_unreachable();
 }
 
+/*
+ * Print the aggregated use counts of the type matching `query`, one line per
+ * file and kind of use, then their total.
+ *
+ * This is a single lookup by type however many uses there are. A database
+ * indexed without aggregated type uses has no counts.
+ */
+static int
+exec_search_type_use(cf_db_t *db, type_search_t *query,
+		const db_filter_t *filter, exec_ctx_t *ctx)
+{
+	int error;
+
+	type_ref_t id;
+	db_type_entry_t entry;
+	loc_ctx_t loc;
+	if ((error = search_type_core(db, query, filter, ctx, &id, &entry,
+			&loc))) {
+		return error;
+	}
+
+	use_count_vec_t counts;
+	use_count_vec_make(&counts);
+	if ((error = cf_db_type_use_count_lookup(db, id, &counts))) {
+		cf_print_err("cannot look up use counts of type %lld, error %d\n",
+				p_(id.rowid), error);
+		goto fail;
+	}
+
+	uint64_t total = 0;
+	for (size_t i = 0; i < use_count_vec_len(&counts); ++i) {
+		const db_type_use_count_t *count = use_count_vec_at(&counts, i);
+
+		cf_str_t file_name;
+		if ((error = cf_db_file_lookup(db, count->file, &file_name))) {
+			goto fail;
+		}
+		user_print("%llu %s in %.*s\n", p_(count->count),
+				db_type_use_str(count->kind), (int)cf_str_len(&file_name),
+				file_name.str);
+		cf_str_free(&file_name);
+
+		total += count->count;
+		++ctx->num_results;
+	}
+	user_print("%llu uses of type %lld\n", p_(total), p_(id.rowid));
+
+fail:
+	use_count_vec_free(&counts);
+	return error;
+}
+
 /*
  * Somehow use `query` to call into sqlite. Get back a sql cursor, store it in
  * `out`.
@@ -166,7 +356,8 @@ exec_search(cf_db_t *db, search_cmd_t *cmd)
  * - rowid -> type table -> entry
  */
 static int
-exec_search_type(cf_db_t *db, type_search_t *query)
+exec_search_type(cf_db_t *db, type_search_t *query, const db_filter_t *filter,
+		exec_ctx_t *ctx)
 {
 	int error;
 
@@ -174,7 +365,8 @@ exec_search_type(cf_db_t *db, type_search_t *query)
 	db_type_entry_t entry;
 	loc_ctx_t loc;
 
-	if ((error = search_type_core(db, query, &id, &entry, &loc))) {
+	if ((error = search_type_core(db, query, filter, ctx, &id, &entry,
+			&loc))) {
 		goto fail;
 	}
 
@@ -185,6 +377,7 @@ exec_search_type(cf_db_t *db, type_search_t *query)
 	}
 
 	print_type_entry(id, &entry, &loc, &file_name);
+	finish_result(db, &loc, ctx);
 
 	cf_str_free(&file_name);
 fail:
@@ -192,15 +385,17 @@ fail:
 }
 
 static int
-exec_search_typename(cf_db_t *db, typename_search_t *query)
+exec_search_typename(cf_db_t *db, typename_search_t *query,
+		const db_filter_t *filter, exec_ctx_t *ctx)
 {
-	print_all_typenames(db, &query->name);
+	print_all_typenames(db, &query->name, filter, ctx);
 
 	return 0;
 }
 
 static int
-exec_search_member(cf_db_t *db, member_search_t *query)
+exec_search_member(cf_db_t *db, member_search_t *query,
+		const db_filter_t *filter, exec_ctx_t *ctx)
 {
 	int error;
 
@@ -212,13 +407,13 @@ exec_search_member(cf_db_t *db, member_search_t *query)
 	loc_ctx_t member_loc;
 
 	// look up query->base, get type ID
-	if ((error = search_type_core(db, &query->base, &parent_id,
-			&type_entry, &type_loc_))) {
+	if ((error = search_type_core(db, &query->base, filter, ctx,
+			&parent_id, &type_entry, &type_loc_))) {
 		goto fail;
 	}
 
 	// look up (type-ID, member-name)
-	if ((error = cf_db_member_lookup(db, parent_id, &query->name,
+	if ((error = cf_db_member_lookup(db, parent_id, &query->name, filter,
 			&member_entry, &member_loc))) {
 		cf_print_err("lookup member id %lld '%.*s' error %d\n",
 				p_(parent_id.rowid),
@@ -234,6 +429,7 @@ exec_search_member(cf_db_t *db, member_search_t *query)
 	}
 
 	print_member_entry(parent_id, &member_entry, &member_loc, &file_name);
+	finish_result(db, &member_loc, ctx);
 
 	cf_str_free(&file_name);
 fail_file:
@@ -243,7 +439,8 @@ fail:
 }
 
 static int
-search_type_core(cf_db_t *db, type_search_t *query, type_ref_t *id_out,
+search_type_core(cf_db_t *db, type_search_t *query, const db_filter_t *filter,
+		exec_ctx_t *ctx, type_ref_t *id_out,
 		db_type_entry_t *entry_out, loc_ctx_t *loc_out)
 {
 	int error;
@@ -255,12 +452,12 @@ search_type_core(cf_db_t *db, type_search_t *query, type_ref_t *id_out,
 		id.rowid = query->rowid;
 	} else {
 		// do a typename lookup with `query->name` to get a rowid
-		if ((error = find_one_type(db, &query->name, &id))) {
+		if ((error = find_one_type(db, &query->name, filter, &id))) {
 			if (error == ENOENT) {
 				user_print("no matching type\n");
 			} else if (error == EMLINK) {
 				user_print("ambiguous typename\n");
-				(void)print_all_typenames(db, &query->name);
+				(void)print_all_typenames(db, &query->name, filter, ctx);
 			}
 			goto fail;
 		}
@@ -285,7 +482,7 @@ fail:
 
 /*
  * Do the following:
- * - make an iterator over typenames matching `name`
+ * - make an iterator over typenames matching `name` and `filter`
  * - extract 1 entry
  *   fail if the iterator is empty
  * - save the type ID
@@ -303,29 +500,27 @@ fail:
  *     1: return rowid
  *     2+: check all entries match rowid, EMLINK if not
  *   - !none
- *     do same lookup, get iterator
- *     1: check typename.kind == direct, check type table kind matches
- *     XXX what to do if 'name' matches but not 'struct'?
- *     kjlkjsf hard because 'struct' is also a uniqueifier
- *     might need to check the whole iterator
- *     2+: ignore duplicate rowids, but error on duplicate 'struct name's with
- *       different rowids
+ *     same, but the database only returns direct names of the matching kind
+ *     of type: "struct foo" never matches `union foo` or `typedef ... foo`
  */
 static int
-find_one_type(cf_db_t *db, const name_spec_t *name, type_ref_t *out)
+find_one_type(cf_db_t *db, const name_spec_t *name, const db_filter_t *filter,
+		type_ref_t *out)
 {
-	if (name->kind != name_none) {
-		return find_elab_type(db, name, out);
-	}
 	int error;
 	db_typename_iter_t iter;
+	db_filter_t name_filter;
 
 	type_ref_t id;
 	db_typename_t entry;
 	loc_ctx_t loc;
 
+	make_name_filter(name, filter, &name_filter);
+	// a cursor pages through listings; resolving a name needs every match
+	name_filter.after = 0;
+
 	// search typename table for entries matching `name->name`
-	if ((error = cf_db_typename_find(db, &name->name, &iter))) {
+	if ((error = cf_db_typename_find(db, &name->name, &name_filter, &iter))) {
 		goto fail;
 	}
 
@@ -358,129 +553,230 @@ fail:
 }
 
 /*
- * XXX duplicated because too different
+ * Combine `name` and the user's `filter` into one filter for a typename find.
  *
- *   - !none
- *     do same lookup, get iterator
- *     1: check typename.kind == direct, check type table kind matches
- *     XXX what to do if 'name' matches but not 'struct'?
- *     kjlkjsf hard because 'struct' is also a uniqueifier
- *     might need to check the whole iterator
- *     2+: ignore duplicate rowids, but error on duplicate 'struct name's with
- *       different rowids
+ * An elaborated name, e.g., "struct foo", can only match the direct name of a
+ * struct. That's expressed as a filter so the database does the work.
  */
-static int
-find_elab_type(cf_db_t *db, const name_spec_t *name, type_ref_t *out)
+static void
+make_name_filter(const name_spec_t *name, const db_filter_t *filter,
+		db_filter_t *out)
 {
-	cf_assert(name->kind != name_none);
+	memcpy(out, filter, sizeof(*out));
+
+	if (name->kind != name_none) {
+		out->type_kind = elab2type_kind(name->kind);
+		out->name_kind = name_kind_direct;
+	}
+}
 
+/*
+ * Look up and print all typenames matching `name` and `filter`.
+ *
+ * If `filter->limit` cut the results short, end with the cursor that
+ * continues them.
+ */
+static int
+print_all_typenames(cf_db_t *db, const name_spec_t *name,
+		const db_filter_t *filter, exec_ctx_t *ctx)
+{
 	int error;
 	db_typename_iter_t iter;
+	db_filter_t name_filter;
 
-	db_typename_t name_entry;
-	db_type_entry_t type_entry;
+	db_typename_t entry;
 	loc_ctx_t loc;
-	loc_ctx_t type_loc;
+	uint32_t count = 0;
+	int64_t cursor = 0;
 
-	type_ref_t id = {
-		.rowid = 0,
-	};
+	make_name_filter(name, filter, &name_filter);
 
-	// search typename table for entries matching `name->name`
-	if ((error = cf_db_typename_find(db, &name->name, &iter))) {
+	// search typename table for entries matching `name`
+	if ((error = cf_db_typename_find(db, &name->name, &name_filter, &iter))) {
+		if ((error == ENOENT) && name_filter.after) {
+			user_print("stale cursor %lld\n", p_(name_filter.after));
+		}
 		goto fail;
 	}
 
-	// linear search all matches
+	// print each entry
 	while (db_typename_iter_next(&iter)) {
-		db_typename_iter_peek(&iter, &name_entry, &loc);
-
-		// ignore non-elaborated typenames
-		if (name_entry.kind != name_kind_direct) {
-			continue;
-		}
+		db_typename_iter_peek(&iter, &entry, &loc);
+		cursor = db_typename_iter_cursor(&iter);
+		count++;
 
-		// look up type-entry to check kind (struct, union, enum) matches
-		if ((error = cf_db_type_lookup(db, name_entry.base_type,
-				&type_entry, &type_loc))) {
-			cf_print_corrupt("no type entry for %lld, error %d\n",
-					p_(id.rowid), error);
+		// resolve `loc->file` to its name
+		cf_str_t file_name;
+		if ((error = cf_db_file_lookup(db, loc.file, &file_name))) {
 			goto fail_iter;
 		}
 
-		if (elab2type_kind(name->kind) != type_entry.kind) {
-			// different kind: `struct foo` != `union foo`
-			continue;
-		}
+		print_one_typename(&entry, &loc, &file_name);
+		finish_result(db, &loc, ctx);
 
-		if (!id.rowid) {
-			// first match, save type ID
-			id.rowid = name_entry.base_type.rowid;
-		}
+		cf_str_free(&file_name);
+	}
 
-		if (name_entry.base_type.rowid != id.rowid) {
-			// many names matching `name` referencing different types
-			error = EMLINK;
-			goto fail_iter;
+	if (name_filter.limit && (count == name_filter.limit)) {
+		print_next_page(cursor);
+	}
+
+fail_iter:
+	db_typename_iter_free(&iter);
+fail:
+	return error;
+}
+
+static int
+exec_scan_typename(cf_db_t *db, const scan_table_t *table,
+		typename_search_t *query, const db_filter_t *filter,
+		exec_ctx_t *ctx)
+{
+	return scan_print_typenames(db, table, &query->name, filter, ctx);
+}
+
+/*
+ * Scan version of exec_search_member().
+ */
+static int
+exec_scan_member(cf_db_t *db, const scan_table_t *table,
+		member_search_t *query, const db_filter_t *filter,
+		exec_ctx_t *ctx)
+{
+	int error;
+	type_ref_t parent_id;
+	scan_result_t result;
+
+	db_member_t entry;
+	loc_ctx_t loc;
+	cf_str_t file_name;
+
+	// resolve query->base to a type ID
+	if (query->base.is_id) {
+		parent_id.rowid = query->base.rowid;
+	} else if ((error = scan_find_one_type(table, &query->base.name, filter,
+			&parent_id))) {
+		if (error == ENOENT) {
+			user_print("no matching type\n");
+		} else if (error == EMLINK) {
+			user_print("ambiguous typename\n");
+			(void)scan_print_typenames(db, table, &query->base.name, filter,
+					ctx);
 		}
+		goto fail;
+	}
+
+	if ((error = scan_find_members(table, parent_id.rowid, &query->name,
+			filter, &result))) {
+		goto fail;
 	}
 
-	if (!id.rowid) {
-		// no matches
+	// same as cf_db_member_lookup(): only the first match
+	if (!result.len) {
 		error = ENOENT;
-		goto fail_iter;
+		cf_print_err("lookup member id %lld '%.*s' error %d\n",
+				p_(parent_id.rowid),
+				(int)cf_str_len(&query->name), query->name.str,
+				error);
+		goto fail_result;
 	}
 
-	// on success, return type ID
-	*out = id;
+	scan_get_member(table, result.rows[0], &entry, &loc, &file_name);
+	print_member_entry(parent_id, &entry, &loc, &file_name);
+	finish_result(db, &loc, ctx);
 
-fail_iter:
-	db_typename_iter_free(&iter);
+fail_result:
+	scan_result_free(&result);
 fail:
 	return error;
 }
 
 /*
- * Look up and print all typenames matching `name`.
- *
- * XXX doesn't properly implement 'struct' name searches
+ * Scan version of find_one_type().
  */
 static int
-print_all_typenames(cf_db_t *db, const name_spec_t *name)
+scan_find_one_type(const scan_table_t *table, const name_spec_t *name,
+		const db_filter_t *filter, type_ref_t *out)
 {
 	int error;
-	db_typename_iter_t iter;
+	db_filter_t name_filter;
+	scan_result_t result;
 
 	db_typename_t entry;
 	loc_ctx_t loc;
+	cf_str_t file_name;
 
-	// search typename table for entries matching `name`
-	if ((error = cf_db_typename_find(db, &name->name, &iter))) {
+	make_name_filter(name, filter, &name_filter);
+	name_filter.after = 0;
+
+	if ((error = scan_find_typenames(table, &name->name, &name_filter,
+			&result))) {
 		goto fail;
 	}
+	if (!result.len) {
+		error = ENOENT;
+		goto fail_result;
+	}
 
-	// print each entry
-	while (db_typename_iter_next(&iter)) {
-		// XXX change to check for name->kind
-		// don't print types that 
+	scan_get_typename(table, result.rows[0], &entry, &loc, &file_name);
+	const int64_t rowid = entry.base_type.rowid;
 
-		db_typename_iter_peek(&iter, &entry, &loc);
+	// many names matching `name` referencing different types
+	for (size_t i = 1; i < result.len; ++i) {
+		scan_get_typename(table, result.rows[i], &entry, &loc, &file_name);
+		if (entry.base_type.rowid != rowid) {
+			error = EMLINK;
+			goto fail_result;
+		}
+	}
 
-		// resolve `loc->file` to its name
-		cf_str_t file_name;
-		if ((error = cf_db_file_lookup(db, loc.file, &file_name))) {
-			goto fail_iter;
+	out->rowid = rowid;
+
+fail_result:
+	scan_result_free(&result);
+fail:
+	return error;
+}
+
+/*
+ * Scan version of print_all_typenames().
+ */
+static int
+scan_print_typenames(cf_db_t *db, const scan_table_t *table,
+		const name_spec_t *name, const db_filter_t *filter,
+		exec_ctx_t *ctx)
+{
+	int error;
+	db_filter_t name_filter;
+	scan_result_t result;
+
+	db_typename_t entry;
+	loc_ctx_t loc;
+	cf_str_t file_name;
+
+	make_name_filter(name, filter, &name_filter);
+
+	if ((error = scan_find_typenames(table, &name->name, &name_filter,
+			&result))) {
+		if ((error == ENOENT) && name_filter.after) {
+			user_print("stale cursor %lld\n", p_(name_filter.after));
 		}
+		return error;
+	}
 
+	for (size_t i = 0; i < result.len; ++i) {
+		scan_get_typename(table, result.rows[i], &entry, &loc, &file_name);
 		print_one_typename(&entry, &loc, &file_name);
+		finish_result(db, &loc, ctx);
+	}
 
-		cf_str_free(&file_name);
+	if (name_filter.limit && (result.len == name_filter.limit)) {
+		print_next_page(scan_typename_cursor(table,
+				result.rows[result.len - 1]));
 	}
 
-fail_iter:
-	db_typename_iter_free(&iter);
-fail:
-	return error;
+	scan_result_free(&result);
+	return 0;
 }
 
 static void
@@ -519,6 +815,42 @@ print_one_typename(db_typename_t *name, loc_ctx_t *loc, const cf_str_t *file)
 			);
 }
 
+/*
+ * Tell the user how to get the next page of a listing that ended at
+ * `cursor`.
+ *
+ * There may turn out to be no more results. Finding out would cost a query
+ * for a row that isn't printed.
+ */
+static void
+print_next_page(int64_t cursor)
+{
+	user_print("more: --after %lld\n", p_(cursor));
+}
+
+/*
+ * Count a result just printed. If requested, print the stored source line at
+ * `loc` below it.
+ *
+ * The line comes from the database, so this works without the source. It's
+ * skipped if the database was indexed without snippets.
+ */
+static void
+finish_result(cf_db_t *db, const loc_ctx_t *loc, exec_ctx_t *ctx)
+{
+	++ctx->num_results;
+	if (!ctx->opts->context) {
+		return;
+	}
+
+	cf_str_t line;
+	if (cf_db_snippet_lookup(db, loc->file, loc->line, &line)) {
+		return;
+	}
+	user_print("    %.*s\n", (int)cf_str_len(&line), line.str);
+	cf_str_free(&line);
+}
+
 static void
 print_member_entry(type_ref_t parent, const db_member_t *entry,
 		const loc_ctx_t *loc, const cf_str_t *file)
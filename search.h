@@ -5,10 +5,54 @@
 #pragma once
 
 #include "cc_support.h"
+#include "cf_db.h"
 #include "cf_string.h"
+#include "scan.h"
+#include "search_types.h"
+
+#include <stdbool.h>
+#include <stddef.h>
 
 __BEGIN_DECLS
 
-int run_one_command(const char *db_path, const cf_str_t *cmd);
+/*
+ * Options that change how commands are executed, not what they search for.
+ *
+ * Members
+ * - scan
+ *   Load the database into memory and run typename and member searches on it
+ *   with the columnar scan engine in "scan.h" instead of sqlite.
+ * - context
+ *   Print the source line of each result below it. Lines come from the
+ *   database (see `cfind-index --snippets`), not the filesystem.
+ * - log_path
+ *   Optional query log to append a record of each command to, along with
+ *   its latency and number of results. See "query_log.h".
+ */
+typedef struct {
+	bool scan;
+	bool context;
+	const char *log_path;
+} search_opts_t;
+
+/*
+ * What search_exec() did.
+ *
+ * Members
+ * - kind
+ *   Kind of the parsed command, or 0 if it didn't parse.
+ * - num_results
+ *   Number of entries printed, including those printed to explain an
+ *   ambiguous name.
+ */
+typedef struct {
+	search_kind_t kind;
+	size_t num_results;
+} search_result_t;
+
+int run_one_command(const char *db_path, const cf_str_t *cmd,
+		const search_opts_t *opts);
+int search_exec(cf_db_t *db, const scan_table_t *table, const cf_str_t *cmd,
+		const search_opts_t *opts, search_result_t *out);
 
 __END_DECLS
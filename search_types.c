@@ -32,9 +32,17 @@ free_search_cmd(search_cmd_t *cmd)
 			cf_str_free(&arg->name);
 			break;
 		}
+		case search_type_use: {
+			type_search_t *arg = &cmd->arg.type_use;
+			if (!arg->is_id) {
+				cf_str_free(&arg->name.name);
+			}
+			break;
+		}
 		default:
 			__builtin_unreachable();
 	}
+	cf_str_free(&cmd->filter.file_glob);
 }
 
 /*
@@ -19,6 +19,7 @@ typedef enum {
 	search_type_decl = 1,
 	search_typename = 2,
 	search_member_decl = 3,
+	search_type_use = 4,
 } search_kind_t;
 
 /*
@@ -63,13 +64,29 @@ typedef struct {
 	cf_str_t name;
 } member_search_t;
 
+/*
+ * A parsed command.
+ *
+ * Members
+ * - kind
+ *   Which command. Selects the active member of `arg`.
+ * - test_option
+ *   Unused.
+ * - filter
+ *   Constraints from command options. These are passed to the database so
+ *   that only matching entries are returned.
+ * - arg
+ *   Command arguments.
+ */
 typedef struct {
 	search_kind_t kind;
 	bool test_option;
+	db_filter_t filter;
 	union {
 		type_search_t type;
 		typename_search_t typename;
 		member_search_t member;
+		type_search_t type_use;
 	} arg;
 } search_cmd_t;
 
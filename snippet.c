@@ -0,0 +1,313 @@
+/*
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ * Copyright (C) 2024 cfind developer
+ *
+ * Source line snippet blocks. See "snippet.h".
+ *
+ * Uncompressed block layout, all integers LEB128 varints:
+ *   count
+ *   count times:
+ *     line delta (from the previous line, or from 0 for the first)
+ *     text length
+ *     text bytes
+ *
+ * A stored block is the uncompressed length as a 4 byte little endian integer
+ * followed by the zlib stream of the uncompressed block.
+ */
+#include "snippet.h"
+
+#include "cf_alloc.h"
+#include "cf_assert.h"
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <zlib.h>
+
+static size_t encoded_len(const db_snippet_t *lines, size_t num_lines);
+static size_t varint_len(uint64_t val);
+static uint8_t *put_varint(uint8_t *pos, uint64_t val);
+static bool get_varint(const uint8_t **pos, const uint8_t *end,
+		uint64_t *out);
+
+// bytes in front of the zlib stream
+#define SNIPPET_HEADER_LEN 4
+// refuse to decode blocks larger than this; a corrupt header isn't trusted
+#define SNIPPET_MAX_RAW_LEN (64u << 20)
+
+/*
+ * Encode and compress `lines` into a new block.
+ *
+ * `lines` must be sorted by line number without duplicates. On success, the
+ * caller owns `*blob_out` and frees it with cf_free().
+ */
+int
+snippet_encode(const db_snippet_t *lines, size_t num_lines,
+		uint8_t **blob_out, size_t *len_out)
+{
+	int error;
+	uint8_t *raw = NULL;
+	uint8_t *blob = NULL;
+
+	const size_t raw_len = encoded_len(lines, num_lines);
+	if (raw_len > SNIPPET_MAX_RAW_LEN) {
+		return EFBIG;
+	}
+
+	if (!(raw = cf_malloc(raw_len))) {
+		error = ENOMEM;
+		goto fail;
+	}
+	uint8_t *pos = put_varint(raw, num_lines);
+	uint32_t prev = 0;
+	for (size_t i = 0; i < num_lines; ++i) {
+		cf_assert(!i || (lines[i].line > prev));
+		const size_t len = cf_str_len(&lines[i].text);
+		pos = put_varint(pos, lines[i].line - prev);
+		pos = put_varint(pos, len);
+		if (len) {
+			memcpy(pos, lines[i].text.str, len);
+		}
+		pos += len;
+		prev = lines[i].line;
+	}
+	cf_assert((size_t)(pos - raw) == raw_len);
+
+	uLongf zlen = compressBound(raw_len);
+	if (!(blob = cf_malloc(SNIPPET_HEADER_LEN + zlen))) {
+		error = ENOMEM;
+		goto fail;
+	}
+	for (unsigned i = 0; i < SNIPPET_HEADER_LEN; ++i) {
+		blob[i] = (uint8_t)(raw_len >> (8 * i));
+	}
+	if (compress2(&blob[SNIPPET_HEADER_LEN], &zlen, raw, raw_len,
+			Z_BEST_COMPRESSION) != Z_OK) {
+		error = ENOMEM;
+		goto fail;
+	}
+
+	cf_free(raw);
+	*blob_out = blob;
+	*len_out = SNIPPET_HEADER_LEN + zlen;
+	return 0;
+
+fail:
+	cf_free(blob);
+	cf_free(raw);
+	return error;
+}
+
+/*
+ * Decompress and decode stored block `blob` into `out`.
+ *
+ * Return EILSEQ if `blob` is corrupt. On success, follow with a call to
+ * snippet_block_free().
+ */
+int
+snippet_decode(const void *blob, size_t len, snippet_block_t *out)
+{
+	int error;
+	const uint8_t *bytes = blob;
+
+	memset(out, 0, sizeof(*out));
+
+	if (len < SNIPPET_HEADER_LEN) {
+		return EILSEQ;
+	}
+	size_t raw_len = 0;
+	for (unsigned i = 0; i < SNIPPET_HEADER_LEN; ++i) {
+		raw_len |= (size_t)bytes[i] << (8 * i);
+	}
+	if (!raw_len || (raw_len > SNIPPET_MAX_RAW_LEN)) {
+		return EILSEQ;
+	}
+
+	if (!(out->raw = cf_malloc(raw_len))) {
+		error = ENOMEM;
+		goto fail;
+	}
+	uLongf got = raw_len;
+	if ((uncompress(out->raw, &got, &bytes[SNIPPET_HEADER_LEN],
+			len - SNIPPET_HEADER_LEN) != Z_OK) || (got != raw_len)) {
+		error = EILSEQ;
+		goto fail;
+	}
+
+	const uint8_t *pos = out->raw;
+	const uint8_t *const end = out->raw + raw_len;
+	uint64_t count;
+	// every line takes at least two bytes
+	if (!get_varint(&pos, end, &count) || (count > raw_len / 2)) {
+		error = EILSEQ;
+		goto fail;
+	}
+	if (count && !(out->lines = cf_malloc(sizeof(*out->lines) * count))) {
+		error = ENOMEM;
+		goto fail;
+	}
+
+	uint64_t line = 0;
+	for (size_t i = 0; i < count; ++i) {
+		uint64_t delta;
+		uint64_t text_len;
+		if (!get_varint(&pos, end, &delta) ||
+				!get_varint(&pos, end, &text_len) ||
+				(i && !delta) || ((line += delta) > UINT32_MAX) ||
+				(text_len > (size_t)(end - pos))) {
+			error = EILSEQ;
+			goto fail;
+		}
+		out->lines[i].line = (uint32_t)line;
+		cf_str_borrow((const char *)pos, text_len, &out->lines[i].text);
+		pos += text_len;
+	}
+	if (pos != end) {
+		error = EILSEQ;
+		goto fail;
+	}
+
+	out->num_lines = count;
+	return 0;
+
+fail:
+	snippet_block_free(out);
+	return error;
+}
+
+void
+snippet_block_free(snippet_block_t *block)
+{
+	cf_free(block->lines);
+	cf_free(block->raw);
+	memset(block, 0, sizeof(*block));
+}
+
+/*
+ * Find line number `line` in `block`. Return NULL if it isn't there.
+ */
+const db_snippet_t *
+snippet_block_find(const snippet_block_t *block, uint32_t line)
+{
+	size_t lo = 0;
+	size_t hi = block->num_lines;
+
+	while (lo < hi) {
+		const size_t mid = lo + (hi - lo) / 2;
+		const uint32_t mid_line = block->lines[mid].line;
+		if (mid_line == line) {
+			return &block->lines[mid];
+		}
+		if (mid_line < line) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
+		}
+	}
+	return NULL;
+}
+
+/*
+ * Combine the lines of `block` with new sorted `lines`.
+ *
+ * The result is sorted without duplicates. For a line in both, the one from
+ * `block` is kept; a file's content doesn't change while it's in the
+ * database. Entries of `*out` borrow their text from `block` and `lines`.
+ * Free `*out` with cf_free().
+ */
+int
+snippet_merge(const snippet_block_t *block, const db_snippet_t *lines,
+		size_t num_lines, db_snippet_t **out, size_t *len_out)
+{
+	const size_t max_len = block->num_lines + num_lines;
+	db_snippet_t *merged = NULL;
+
+	if (max_len && !(merged = cf_malloc(sizeof(*merged) * max_len))) {
+		return ENOMEM;
+	}
+
+	size_t i = 0;
+	size_t j = 0;
+	size_t len = 0;
+	while ((i < block->num_lines) || (j < num_lines)) {
+		if ((j == num_lines) || ((i < block->num_lines) &&
+				(block->lines[i].line <= lines[j].line))) {
+			if ((j < num_lines) &&
+					(block->lines[i].line == lines[j].line)) {
+				++j;
+			}
+			merged[len++] = block->lines[i++];
+		} else {
+			merged[len++] = lines[j++];
+		}
+	}
+
+	*out = merged;
+	*len_out = len;
+	return 0;
+}
+
+/*
+ * Uncompressed size of a block holding `lines`.
+ */
+static size_t
+encoded_len(const db_snippet_t *lines, size_t num_lines)
+{
+	size_t len = varint_len(num_lines);
+	uint32_t prev = 0;
+
+	for (size_t i = 0; i < num_lines; ++i) {
+		const size_t text_len = cf_str_len(&lines[i].text);
+		len += varint_len(lines[i].line - prev) + varint_len(text_len) +
+				text_len;
+		prev = lines[i].line;
+	}
+	return len;
+}
+
+static size_t
+varint_len(uint64_t val)
+{
+	size_t len = 1;
+	while (val >= 0x80) {
+		val >>= 7;
+		++len;
+	}
+	return len;
+}
+
+/*
+ * Write `val` to `pos`. Return the position after it.
+ */
+static uint8_t *
+put_varint(uint8_t *pos, uint64_t val)
+{
+	while (val >= 0x80) {
+		*pos++ = (uint8_t)(val | 0x80);
+		val >>= 7;
+	}
+	*pos++ = (uint8_t)val;
+	return pos;
+}
+
+/*
+ * Read a varint at `*pos` and advance `*pos` past it.
+ *
+ * Return false if it runs past `end` or doesn't fit in 64 bits.
+ */
+static bool
+get_varint(const uint8_t **pos, const uint8_t *end, uint64_t *out)
+{
+	uint64_t val = 0;
+
+	for (unsigned shift = 0; (*pos < end) && (shift < 64); shift += 7) {
+		const uint8_t byte = *(*pos)++;
+		val |= (uint64_t)(byte & 0x7f) << shift;
+		if (!(byte & 0x80)) {
+			*out = val;
+			return true;
+		}
+	}
+	return false;
+}
@@ -0,0 +1,49 @@
+/*
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ * Copyright (C) 2024 cfind developer
+ *
+ * Compressed blocks of source line snippets.
+ *
+ * The indexer can store the source line of each entry it indexes so that
+ * `cfind --context` can print it without reading the source. Lines are kept
+ * per file in a block. A line shared by several entries is stored once, and
+ * the block is compressed as a whole because lines of the same file have a
+ * lot in common.
+ */
+#pragma once
+
+#include "cc_support.h"
+#include "db_types.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+__BEGIN_DECLS
+
+/*
+ * A decoded block.
+ *
+ * Members
+ * - raw
+ *   The uncompressed block. Owns the text of every entry of `lines`.
+ * - lines
+ *   Every line of the block, in ascending line order.
+ * - num_lines
+ *   Length of `lines`.
+ */
+typedef struct {
+	uint8_t *raw;
+	db_snippet_t *lines;
+	size_t num_lines;
+} snippet_block_t;
+
+int snippet_encode(const db_snippet_t *lines, size_t num_lines,
+		uint8_t **blob_out, size_t *len_out);
+int snippet_decode(const void *blob, size_t len, snippet_block_t *out);
+void snippet_block_free(snippet_block_t *block);
+const db_snippet_t *snippet_block_find(const snippet_block_t *block,
+		uint32_t line);
+int snippet_merge(const snippet_block_t *block, const db_snippet_t *lines,
+		size_t num_lines, db_snippet_t **out, size_t *len_out);
+
+__END_DECLS
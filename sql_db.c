@@ -17,18 +17,40 @@
 #include "cf_vector.h"
 
 #include <errno.h>
+#include <fcntl.h>
 #include <sys/param.h>
 #include <limits.h>
 #include <unistd.h>
 #include <string.h>
 #include <stdint.h>
 #include <stdlib.h>
+#include <time.h>
 
 // value of `sql_db_t::buf_len`
 #define SQL_DB_BUF_LEN PATH_MAX
 
+// size of the stack buffers used to read files for hashing and comparison
+#define FILE_READ_LEN 4096
+
+// how long a checkpoint forced by `wal_policy_t::size_cap` waits for readers
+#define WAL_CAP_BUSY_MS 1000
+
 static int clean_path(sqlite_db_t *db, const char *path_in, size_t len,
 		const char **out);
+static const cf_str_t *lookup_vcs_id(const sqlite_db_t *db, const char *path,
+		size_t len, cf_str_t *id_out);
+static int mark_vcs_files(sqlite_db_t *db, const vcs_tree_t *tree,
+		bool tracked, bool aliases, size_t *count_out);
+static int find_duplicate_file(sqlite_db_t *db, const char *path,
+		uint64_t hash, int64_t *out);
+static int make_precise(sqlite_db_t *db, int64_t rowid, bool *purged_out);
+static int load_snippets(sqlite_db_t *db, int64_t file);
+static void drop_snippets(sqlite_db_t *db);
+static int timed_checkpoint(sqlite_db_t *db, int mode);
+static uint64_t get_time_ns(void);
+static int hash_file(const char *path, uint64_t *out);
+static int files_equal(const char *lhs, const char *rhs, bool *out);
+static ssize_t read_full(int fd, char *buf, size_t len);
 
 static bool sanitize_typename(const db_typename_t *name);
 static bool sanitize_typename_kind(uint32_t kind);
@@ -40,6 +62,7 @@ static bool sanitize_rowid(int64_t rowid);
  * Steps:
  * - allocate buffers for calls to realpath(3)
  * - open database at `db_path`
+ * - check for approximately indexed files
  */
 int
 sql_db_open(const char *db_path, bool ro, sqlite_db_t *out)
@@ -67,10 +90,22 @@ sql_db_open(const char *db_path, bool ro, sqlite_db_t *out)
 		goto fail_open;
 	}
 
+	size_t num_approx = 0;
+	if (!ro && (error = count_approx_files(out->sql, &num_approx))) {
+		cf_print_err("cannot count approx files, error %d\n", error);
+		goto fail_approx;
+	}
+	out->has_approx = (num_approx != 0);
+
+	cf_map8_make(&out->vcs_restamp);
+	path_batch_make(&out->paths);
+
 	cf_assert(out->sql);
 	cf_assert(out->path_buf[0]);
 	cf_assert(out->path_buf[1]);
 	return 0;
+fail_approx:
+	(void)sqlite3_close(out->sql);
 fail_open:
 	cf_free(out->path_buf[1]);
 fail_alloc:
@@ -84,16 +119,59 @@ fail:
  * Free a `sqlite_db_t` returned from a previous call to sql_db_open().
  *
  * Steps:
+ * - optionally, truncate the WAL
+ * - print WAL statistics
  * - free underlying `sql` handle
  * - free realpath buffers
+ * - free version control state
+ * - free cached snippets
+ * - print path resolution statistics, free prefetched paths
+ * - print typename lookup statistics
  */
 int
 sql_db_close(sqlite_db_t *db)
 {
 	cf_print_debug("flushing sqlite db\n");
+
+	if (!db->readonly) {
+		if (db->wal_policy.close_truncate) {
+			(void)timed_checkpoint(db, SQLITE_CHECKPOINT_TRUNCATE);
+		}
+
+		const wal_stats_t *stats = &db->wal_stats;
+		cf_print_debug("wal: %u checkpoints (%u busy) in %llu us, "
+				"max size %llu bytes\n",
+				stats->num_checkpoints, stats->num_busy,
+				p_(stats->checkpoint_ns / 1000), p_(stats->max_wal_size));
+
+		const path_stats_t *paths = &db->path_stats;
+		cf_print_debug("paths: %llu batched in %llu batches (%llu threads) "
+				"in %llu us, %llu used; %llu one at a time in %llu us\n",
+				p_(paths->batch_paths), p_(paths->num_batches),
+				p_(paths->num_threads), p_(paths->batch_ns / 1000),
+				p_(paths->batch_hits), p_(paths->sync_paths),
+				p_(paths->sync_ns / 1000));
+		// one realpath(3) per path resolved, one lookup per component
+		cf_print_debug("paths: %llu realpath calls for %llu lookups; "
+				"%llu components batched, %llu one at a time\n",
+				p_(paths->batch_paths + paths->sync_paths),
+				p_(paths->batch_hits + paths->sync_paths),
+				p_(paths->batch_components),
+				p_(paths->sync_components));
+
+		const typename_stats_t *names = &db->typename_stats;
+		cf_print_debug("typenames: %llu looked up in %llu batches, "
+				"%llu one at a time\n",
+				p_(names->many_keys), p_(names->num_many),
+				p_(names->num_single));
+	}
+
+	drop_snippets(db);
 	(void)sqlite3_close(db->sql);
 	cf_free(db->path_buf[0]);
 	cf_free(db->path_buf[1]);
+	cf_map8_free(&db->vcs_restamp);
+	path_batch_free(&db->paths);
 	return 0;
 }
 
@@ -112,18 +190,35 @@ sql_db_close(sqlite_db_t *db)
  *   many filesystem paths can map to the same underlying file
  *   this function handles some cases (like excess '/'s) but not all (like
  *   hardlinks)
+ * - files are deduplicated by contents
+ *   If `path` is byte-for-byte identical to a file already in `db`, `path` is
+ *   recorded as an alias of that file, `out` is set to that file, and
+ *   `*alias_out` is set to true. Otherwise it's set to false.
+ * - approximately indexed files are replaced
+ *   In approximate mode (see sql_db_set_approx()), new files are tagged as
+ *   approximate. Otherwise, adding a file tagged as approximate deletes its
+ *   entries so the caller can index it again precisely. An alias of such a
+ *   file is reported as not being an alias, for the same reason.
  *
  * XXX the current implemntation stores absolute paths on disk. Ideally,
  * project root-relative paths should be store but that's harder to implement.
  *
+ * If a version control snapshot was attached with sql_db_vcs_sync(), the
+ * file's version control id is stored along with it.
+ *
  * Steps:
  * - clean `path`
  * - lookup any preexisting file
+ *   If it changed since it was last indexed, update its version control id
+ *   and hash. If it's approximate, purge it.
+ * - lookup any preexisting alias
+ * - hash the contents of `path` and look for a file with identical contents
+ *   If there is one, insert an alias to it.
  * - insert new entry
  */
 int
 sql_db_add_file(sqlite_db_t *db, const char *path_, size_t len_,
-		int64_t *out)
+		int64_t *out, bool *alias_out)
 {
 	cf_assert(len_ < INT_MAX);
 	int error;
@@ -143,16 +238,26 @@ sql_db_add_file(sqlite_db_t *db, const char *path_, size_t len_,
 	len = strnlen(path, db->buf_len);
 	cf_print_info("path cleaned to %zu-byte '%s'\n", len, path);
 
-	// the cleaned path should still exist
-	if (access(path, F_OK) == -1) {
-		error = errno;
-		goto fail;
-	}
+	*alias_out = false;
 
 	// check sql db for preexistence
 	error = lookup_file(db->sql, path, len, out);
 
+	cf_str_t vcs_id;
+	uint64_t hash;
 	if (!error) {
+		// a file purged by sql_db_vcs_sync() needs its new id recorded
+		if (db->vcs && cf_map8_remove(&db->vcs_restamp, (uint64_t)*out)) {
+			if ((error = hash_file(path, &hash))) {
+				goto fail;
+			}
+			if ((error = update_file(db->sql, *out,
+					lookup_vcs_id(db, path, len, &vcs_id), hash))) {
+				goto fail;
+			}
+		}
+		bool purged;
+		error = make_precise(db, *out, &purged);
 		goto fail;
 	}
 
@@ -163,24 +268,370 @@ sql_db_add_file(sqlite_db_t *db, const char *path_, size_t len_,
 		goto fail;
 	}
 
+	// maybe it's a known duplicate
+	error = lookup_file_alias(db->sql, path, len, out);
+	if (!error) {
+		bool purged;
+		error = make_precise(db, *out, &purged);
+		*alias_out = !purged;
+		goto fail;
+	}
+	if (error != ENOENT) {
+		cf_print_debug("cannot look up alias '%s', error %d\n", path, error);
+		goto fail;
+	}
+
+	// or a new duplicate
+	if ((error = hash_file(path, &hash))) {
+		cf_print_debug("cannot hash file '%s', error %d\n", path, error);
+		goto fail;
+	}
+
+	error = find_duplicate_file(db, path, hash, out);
+	if (!error) {
+		cf_print_info("file '%s' duplicates file %lld\n", path, p_(*out));
+		if ((error = insert_file_alias(db->sql, path, len, *out,
+				lookup_vcs_id(db, path, len, &vcs_id)))) {
+			cf_print_debug("cannot insert alias '%s', error %d\n", path,
+					error);
+			goto fail;
+		}
+		bool purged;
+		error = make_precise(db, *out, &purged);
+		*alias_out = !purged;
+		goto fail;
+	}
+	if (error != ENOENT) {
+		goto fail;
+	}
+
 	// it doesn't exist, insert it, save rowid
-	if ((error = insert_file(db->sql, path, len, out))) {
+	if ((error = insert_file(db->sql, path, len,
+			lookup_vcs_id(db, path, len, &vcs_id), hash, out))) {
 		cf_print_debug("cannot insert file '%s', error %d\n", path, error);
 		goto fail;
 	}
 
+	if (db->approx) {
+		if ((error = insert_approx_file(db->sql, *out))) {
+			goto fail;
+		}
+		db->has_approx = true;
+	}
+
+fail:
+	return error;
+}
+
+/*
+ * Queue `path`, `len` bytes and not necessarily NUL terminated, to be resolved
+ * by the next sql_db_resolve_files().
+ *
+ * Once resolved, a later sql_db_add_file() of the same path uses the result
+ * instead of resolving it again. Resolved paths are kept until the first call
+ * to this function after sql_db_resolve_files(). Call it with every file a
+ * TU might add, then resolve them, then add them.
+ */
+int
+sql_db_prefetch_file(sqlite_db_t *db, const char *path, size_t len)
+{
+	if (db->readonly) {
+		return EACCES;
+	}
+	if (len >= db->buf_len) {
+		return ERANGE;
+	}
+
+	// start a new batch
+	if (db->paths.resolved == db->paths.len) {
+		path_batch_reset(&db->paths);
+	}
+	return path_batch_add(&db->paths, path, len);
+}
+
+/*
+ * Resolve every path queued by sql_db_prefetch_file() at once.
+ */
+void
+sql_db_resolve_files(sqlite_db_t *db)
+{
+	path_batch_resolve(&db->paths, &db->path_stats);
+}
+
+/*
+ * Set whether files added to `db` from now on are indexed approximately.
+ *
+ * Approximate files are parsed without their `#include`s so what's indexed
+ * from them can be wrong. They're tagged so that a later precise run
+ * replaces them.
+ */
+int
+sql_db_set_approx(sqlite_db_t *db, bool approx)
+{
+	if (db->readonly) {
+		return EACCES;
+	}
+
+	db->approx = approx;
+	return 0;
+}
+
+/*
+ * Set the WAL checkpoint policy of `db`.
+ */
+int
+sql_db_set_wal_policy(sqlite_db_t *db, const wal_policy_t *policy)
+{
+	if (db->readonly) {
+		return EACCES;
+	}
+
+	memcpy(&db->wal_policy, policy, sizeof(*policy));
+	return 0;
+}
+
+/*
+ * Checkpoint the WAL of `db` according to its policy.
+ *
+ * Call this at points where a checkpoint is cheap, e.g., between TUs. Readers
+ * blocking a checkpoint aren't an error; it's retried on the next call.
+ *
+ * Steps:
+ * - measure the WAL
+ * - if it's over its size cap, truncate it
+ *   else, checkpoint passively
+ */
+int
+sql_db_checkpoint(sqlite_db_t *db)
+{
+	int error;
+	const wal_policy_t *policy = &db->wal_policy;
+
+	if (db->readonly) {
+		return EACCES;
+	}
+
+	if (!policy->size_cap && !policy->tu_checkpoint) {
+		return 0;
+	}
+
+	uint64_t wal_size;
+	if ((error = get_wal_size(db->sql, &wal_size))) {
+		cf_print_err("cannot get wal size, error %d\n", error);
+		return error;
+	}
+
+	if (policy->size_cap && (wal_size > policy->size_cap)) {
+		cf_print_debug("wal size %llu over cap %llu; truncating\n",
+				p_(wal_size), p_(policy->size_cap));
+
+		// wait a little for readers on older snapshots
+		(void)sqlite3_busy_timeout(db->sql, WAL_CAP_BUSY_MS);
+		error = timed_checkpoint(db, SQLITE_CHECKPOINT_TRUNCATE);
+		(void)sqlite3_busy_timeout(db->sql, 0);
+		return error;
+	}
+
+	if (policy->tu_checkpoint) {
+		return timed_checkpoint(db, SQLITE_CHECKPOINT_PASSIVE);
+	}
+	return 0;
+}
+
+/*
+ * Record that the TU whose main file is `tu` depends on `file`.
+ */
+int
+sql_db_tu_dep_insert(sqlite_db_t *db, int64_t tu, int64_t file)
+{
+	if (db->readonly) {
+		return EACCES;
+	}
+
+	return insert_tu_dep(db->sql, tu, file);
+}
+
+/*
+ * Add source lines `lines` of file `file`.
+ *
+ * `lines` must be sorted by line number without duplicates. They're merged
+ * with the lines already stored for `file`, e.g., by another TU that includes
+ * the same header. The file's block is only rewritten if a line is new.
+ *
+ * Steps:
+ * - read the file's current block, if any
+ * - merge in `lines`
+ * - encode and store the result
+ */
+int
+sql_db_snippet_insert(sqlite_db_t *db, int64_t file,
+		const db_snippet_t *lines, size_t num_lines)
+{
+	int error;
+	db_snippet_t *merged = NULL;
+	uint8_t *blob = NULL;
+	size_t num_merged;
+	size_t len;
+
+	if (db->readonly) {
+		return EACCES;
+	}
+
+	error = load_snippets(db, file);
+	if (error && (error != ENOENT)) {
+		return error;
+	}
+	// ENOENT leaves an empty block
+
+	const snippet_block_t *block = &db->snippet_block;
+	if ((error = snippet_merge(block, lines, num_lines, &merged,
+			&num_merged))) {
+		goto fail;
+	}
+	if (num_merged == block->num_lines) {
+		// nothing new
+		goto fail;
+	}
+
+	if ((error = snippet_encode(merged, num_merged, &blob, &len))) {
+		goto fail;
+	}
+	cf_print_debug("snippets of file %lld: %zu lines, %zu bytes\n",
+			p_(file), num_merged, len);
+
+	error = insert_snippets(db->sql, file, blob, len);
+
 fail:
+	// `merged` borrows from the cached block, so drop it last
+	cf_free(blob);
+	cf_free(merged);
+	drop_snippets(db);
 	return error;
 }
 
+/*
+ * Look up line `line` of file `file`.
+ *
+ * On success, `*out` is set to a copy of the line. Free it with
+ * cf_str_free(). Return ENOENT if it wasn't stored.
+ */
+int
+sql_db_snippet_lookup(sqlite_db_t *db, int64_t file, uint32_t line,
+		cf_str_t *out)
+{
+	int error;
+
+	if ((error = load_snippets(db, file))) {
+		return error;
+	}
+
+	const db_snippet_t *snippet = snippet_block_find(&db->snippet_block,
+			line);
+	if (!snippet) {
+		return ENOENT;
+	}
+	return cf_str_dup_str(&snippet->text, out);
+}
+
+/*
+ * Bring `db` up to date with version control snapshot `tree`.
+ *
+ * Every file whose contents differ from when it was indexed is purged from
+ * `db`. The main files of TUs that don't depend on any such file are
+ * inserted into `clean_tus_out`; they needn't be reindexed. All other TUs
+ * must be.
+ *
+ * A file has changed if:
+ * - it was tracked, and its version control id differs or it's now modified
+ *   or untracked
+ * - it was untracked, and now it's tracked
+ * Files that are modified in the working tree are always considered changed
+ * because their contents can't be named by an id. A file also changes if any
+ * of its aliases did; they might not be duplicates anymore.
+ *
+ * `tree` is borrowed until `db` is closed. Files added after this call are
+ * stamped with their id from `tree`.
+ *
+ * Steps:
+ * - enter a transaction
+ * - build a temporary table of changed files
+ * - collect clean TUs
+ * - purge changed files
+ * - commit
+ */
+int
+sql_db_vcs_sync(sqlite_db_t *db, const vcs_tree_t *tree,
+		cf_map8_t *clean_tus_out)
+{
+	int error;
+	size_t num_tracked = 0;
+	size_t num_untracked = 0;
+
+	if (db->readonly) {
+		return EACCES;
+	}
+
+	if ((error = begin_transaction(db->sql))) {
+		return error;
+	}
+
+	if ((error = reset_changed_files(db->sql))) {
+		goto fail;
+	}
+
+	for (int aliases = 0; aliases < 2; ++aliases) {
+		if ((error = mark_vcs_files(db, tree, /*tracked*/true, aliases,
+				&num_tracked))) {
+			goto fail;
+		}
+
+		if ((error = mark_vcs_files(db, tree, /*tracked*/false, aliases,
+				&num_untracked))) {
+			goto fail;
+		}
+	}
+
+	// must happen before purging; that deletes dependencies of dirty TUs
+	if ((error = find_clean_tus(db->sql, clean_tus_out))) {
+		goto fail;
+	}
+
+	drop_snippets(db);
+	if ((error = purge_changed_files(db->sql))) {
+		goto fail;
+	}
+
+	cf_print_debug("vcs sync: %zu changed, %zu newly tracked files; "
+			"%zu clean TUs\n", num_tracked, num_untracked,
+			cf_map8_len(clean_tus_out));
+
+	db->vcs = tree;
+fail:
+	if (error) {
+		(void)end_transaction(db->sql, /*commit*/false);
+		return error;
+	}
+	return end_transaction(db->sql, /*commit*/true);
+}
+
 int
 sql_db_typename_lookup(sqlite_db_t *db, const loc_ctx_t *loc,
 		const db_typename_t *name, int64_t *out)
 {
 	cf_assert(!cf_str_is_null(&name->name));
+	++db->typename_stats.num_single;
 	return lookup_typename(db->sql, loc, name, out);
 }
 
+int
+sql_db_typename_lookup_many(sqlite_db_t *db, const db_typename_key_t *keys,
+		size_t num_keys, type_ref_t *out)
+{
+	++db->typename_stats.num_many;
+	db->typename_stats.many_keys += num_keys;
+	return lookup_typenames(db->sql, keys, num_keys, out);
+}
+
 int
 sql_db_type_insert(sqlite_db_t *db, const loc_ctx_t *loc,
 		const db_type_entry_t *entry, int64_t *out)
@@ -223,6 +674,17 @@ sql_db_type_use_insert(sqlite_db_t *db, const loc_ctx_t *loc,
 	return insert_type_use(db->sql, loc, entry, &dummy);
 }
 
+int
+sql_db_type_use_count_insert(sqlite_db_t *db, const db_type_use_count_t *entry,
+		bool max)
+{
+	if (db->readonly) {
+		return EACCES;
+	}
+
+	return insert_type_use_count(db->sql, entry, max);
+}
+
 int
 sql_db_member_insert(sqlite_db_t *db, const loc_ctx_t *loc,
 		const db_member_t *entry)
@@ -251,24 +713,33 @@ sql_db_type_lookup(sqlite_db_t *db, int64_t rowid, db_type_entry_t *entry_out,
 	return lookup_type_entry(db->sql, rowid, entry_out, loc_out);
 }
 
+int
+sql_db_type_use_count_lookup(sqlite_db_t *db, int64_t type,
+		use_count_vec_t *out)
+{
+	cf_assert(type);
+
+	return lookup_type_use_counts(db->sql, type, out);
+}
+
 int
 sql_db_member_lookup(sqlite_db_t *db, int64_t parent, const cf_str_t *member,
-		db_member_t *entry_out, loc_ctx_t *loc_out)
+		const db_filter_t *filter, db_member_t *entry_out, loc_ctx_t *loc_out)
 {
 	cf_assert(parent);
 
-	return lookup_member(db->sql, parent, member, entry_out, loc_out);
+	return lookup_member(db->sql, parent, member, filter, entry_out, loc_out);
 }
 
 int
 sql_db_typename_find(sqlite_db_t *db, const cf_str_t *name,
-		sqlite_db_typename_iter_t *out)
+		const db_filter_t *filter, sqlite_db_typename_iter_t *out)
 {
 	int error;
 
 	memset(out, 0, sizeof(*out));
 
-	if ((error = find_typenames(db->sql, name, &out->stmt))) {
+	if ((error = find_typenames(db->sql, name, filter, &out->stmt))) {
 		goto fail;
 	}
 
@@ -307,7 +778,8 @@ sql_db_typename_iter_next(sqlite_db_t *db, sqlite_db_typename_iter_t *it)
 	}
 
 	// deserialize
-	if ((error = iter_get_typename(it->stmt, &it->cur_name, &it->cur_loc))) {
+	if ((error = iter_get_typename(it->stmt, &it->cur_name, &it->cur_loc,
+			&it->cur_cursor))) {
 		cf_print_err("can't deserialize typename iter %p, error %d\n",
 				it, error);
 		return false;
@@ -322,11 +794,24 @@ sql_db_typename_iter_next(sqlite_db_t *db, sqlite_db_typename_iter_t *it)
 	return true;
 }
 
+int64_t
+sql_db_typename_iter_cursor(const sqlite_db_typename_iter_t *it)
+{
+	return it->cur_cursor;
+}
+
 /*
  * Clean `path_in` and copy it to NUL-terminated `*out`.
  *
  * `*out` is borrowed from `db`. It need not be explicitly freed; a call to
  * sql_db_close() does that.
+ *
+ * realpath(3) fails if any part of the path doesn't exist, so a cleaned path
+ * needn't be checked for existence again.
+ *
+ * Steps:
+ * - use the result of sql_db_resolve_files(), if `path_in` was prefetched
+ * - else, resolve it now
  */
 static int
 clean_path(sqlite_db_t *db, const char *path_in, size_t len, const char **out)
@@ -335,19 +820,411 @@ clean_path(sqlite_db_t *db, const char *path_in, size_t len, const char **out)
 	if (len >= db->buf_len) {
 		return ERANGE;
 	}
+
+	const path_job_t *job = path_batch_find(&db->paths, path_in, len);
+	if (job) {
+		++db->path_stats.batch_hits;
+		if (job->error) {
+			return job->error;
+		}
+		*out = job->resolved;
+		return 0;
+	}
+
 	memcpy(db->path_buf[0], path_in, len);
 	db->path_buf[0][len] = '\0';
 
 	// XXX returns an absolute path
 	// not exactly suitable but maybe good enough for now
-	if (!realpath(db->path_buf[0], db->path_buf[1])) {
-		return errno;
+	const uint64_t start = get_time_ns();
+	char *const resolved = realpath(db->path_buf[0], db->path_buf[1]);
+	const int error = resolved ? 0 : errno;
+	++db->path_stats.sync_paths;
+	db->path_stats.sync_ns += get_time_ns() - start;
+	db->path_stats.sync_components += path_components(resolved ? resolved :
+			db->path_buf[0]);
+	if (error) {
+		return error;
 	}
 
 	*out = db->path_buf[1];
 	return 0;
 }
 
+/*
+ * Get the version control id to store for the file at cleaned path `path`.
+ *
+ * Return NULL if there's no version control snapshot, or if the file is
+ * untracked or modified. Otherwise, return `id_out`, set to a string borrowed
+ * from `db->vcs`.
+ */
+static const cf_str_t *
+lookup_vcs_id(const sqlite_db_t *db, const char *path, size_t len,
+		cf_str_t *id_out)
+{
+	if (!db->vcs) {
+		return NULL;
+	}
+
+	if (vcs_tree_lookup(db->vcs, path, len, id_out) != vcs_clean) {
+		return NULL;
+	}
+	return id_out;
+}
+
+/*
+ * Compare every file in `db` that was `tracked` by version control to its
+ * current state in `tree`. Add the changed ones to the changed file table and
+ * to `db->vcs_restamp`.
+ *
+ * If `aliases` is true, compare file aliases instead. A changed alias marks
+ * the file it refers to as changed.
+ *
+ * On success, `*count_out` is incremented by the number of changed files.
+ */
+static int
+mark_vcs_files(sqlite_db_t *db, const vcs_tree_t *tree, bool tracked,
+		bool aliases, size_t *count_out)
+{
+	int error;
+	sqlite3_stmt *stmt;
+	size_t count = 0;
+
+	if ((error = find_vcs_files(db->sql, tracked, aliases, &stmt))) {
+		return error;
+	}
+
+	while (!(error = iter_next_vcs_file(stmt))) {
+		int64_t rowid;
+		cf_str_t path;
+		cf_str_t old_id;
+		if ((error = iter_get_vcs_file(stmt, tracked, &rowid, &path,
+				&old_id))) {
+			goto fail;
+		}
+
+		cf_str_t new_id;
+		const vcs_file_state_t state = vcs_tree_lookup(tree, path.str,
+				cf_str_len(&path), &new_id);
+
+		bool changed;
+		if (tracked) {
+			changed = (state != vcs_clean) ||
+					(cf_str_len(&old_id) != cf_str_len(&new_id)) ||
+					memcmp(old_id.str, new_id.str, cf_str_len(&new_id));
+		} else {
+			changed = (state != vcs_untracked);
+		}
+
+		if (!changed) {
+			continue;
+		}
+
+		cf_print_info("vcs: file %lld '%.*s' changed\n", p_(rowid),
+				(int)cf_str_len(&path), path.str);
+
+		if ((error = mark_file_changed(db->sql, rowid))) {
+			goto fail;
+		}
+
+		// several aliases can refer to the same file
+		uint64_t unused;
+		if (cf_map8_lookup(&db->vcs_restamp, (uint64_t)rowid, &unused)) {
+			continue;
+		}
+
+		cf_map_entry_t *entry = cf_map8_reserve(&db->vcs_restamp);
+		if (!entry) {
+			error = ENOMEM;
+			goto fail;
+		}
+		entry->key = (uint64_t)rowid;
+		entry->value = 0;
+		cf_map8_commit(&db->vcs_restamp, entry);
+
+		++count;
+	}
+
+	// ENOENT just means no more rows
+	error = (error == ENOENT) ? 0 : error;
+	*count_out += count;
+fail:
+	free_vcs_files(stmt);
+	return error;
+}
+
+/*
+ * If `db` is precise and preexisting file `rowid` is approximate, delete
+ * everything indexed from it and untag it.
+ *
+ * `*purged_out` is set to whether anything was deleted.
+ */
+static int
+make_precise(sqlite_db_t *db, int64_t rowid, bool *purged_out)
+{
+	int error;
+
+	*purged_out = false;
+	if (db->approx || !db->has_approx) {
+		return 0;
+	}
+
+	error = lookup_approx_file(db->sql, rowid);
+	if (error) {
+		return (error == ENOENT) ? 0 : error;
+	}
+
+	cf_print_info("replace approx file %lld\n", p_(rowid));
+
+	drop_snippets(db);
+	if ((error = begin_transaction(db->sql))) {
+		return error;
+	}
+	if ((error = purge_approx_file(db->sql, rowid))) {
+		(void)end_transaction(db->sql, /*commit*/false);
+		return error;
+	}
+	if ((error = end_transaction(db->sql, /*commit*/true))) {
+		return error;
+	}
+
+	*purged_out = true;
+	return 0;
+}
+
+/*
+ * Make `db->snippet_block` the snippet block of file `file`.
+ *
+ * Return ENOENT if `file` has no snippets. The cache is left empty in that
+ * case.
+ */
+static int
+load_snippets(sqlite_db_t *db, int64_t file)
+{
+	int error;
+
+	if (db->snippet_file == file) {
+		return 0;
+	}
+
+	drop_snippets(db);
+	if ((error = lookup_snippets(db->sql, file, &db->snippet_block))) {
+		return error;
+	}
+	db->snippet_file = file;
+	return 0;
+}
+
+static void
+drop_snippets(sqlite_db_t *db)
+{
+	snippet_block_free(&db->snippet_block);
+	db->snippet_file = 0;
+}
+
+/*
+ * Run a checkpoint and account for it in `db->wal_stats`.
+ *
+ * The WAL is measured before the checkpoint, which is when it's largest.
+ */
+static int
+timed_checkpoint(sqlite_db_t *db, int mode)
+{
+	int error;
+	wal_stats_t *stats = &db->wal_stats;
+
+	uint64_t wal_size;
+	if (!get_wal_size(db->sql, &wal_size) && (wal_size > stats->max_wal_size)) {
+		stats->max_wal_size = wal_size;
+	}
+
+	const uint64_t start = get_time_ns();
+	error = checkpoint_wal(db->sql, mode);
+	stats->checkpoint_ns += get_time_ns() - start;
+	++stats->num_checkpoints;
+
+	switch (error) {
+		case SQLITE_OK:
+			return 0;
+		case SQLITE_BUSY:
+			// readers are in the way; try again next time
+			++stats->num_busy;
+			return 0;
+		default:
+			return EIO;
+	}
+}
+
+static uint64_t
+get_time_ns(void)
+{
+	struct timespec ts;
+	(void)clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ((uint64_t)ts.tv_sec * 1000000000ull) + (uint64_t)ts.tv_nsec;
+}
+
+/*
+ * Find a file in `db` whose contents are identical to those of the file at
+ * NUL-terminated path `path`. `hash` is the hash of `path` from hash_file().
+ *
+ * Files with a matching hash are only candidates. Each one is compared
+ * byte-by-byte so a hash collision can never merge two different files.
+ *
+ * Returns ENOENT if there is no such file.
+ */
+static int
+find_duplicate_file(sqlite_db_t *db, const char *path, uint64_t hash,
+		int64_t *out)
+{
+	int error;
+	sqlite3_stmt *stmt;
+
+	if ((error = find_files_by_hash(db->sql, hash, &stmt))) {
+		return error;
+	}
+
+	while (!(error = iter_next_file_hash(stmt))) {
+		int64_t rowid;
+		cf_str_t other;
+		if ((error = iter_get_file_hash(stmt, &rowid, &other))) {
+			goto fail;
+		}
+
+		// NUL-terminate the candidate's path for open(2)
+		// (`path` is already in `path_buf[1]`)
+		const size_t other_len = cf_str_len(&other);
+		if (other_len >= db->buf_len) {
+			continue;
+		}
+		memcpy(db->path_buf[0], other.str, other_len);
+		db->path_buf[0][other_len] = '\0';
+
+		bool equal;
+		if ((error = files_equal(path, db->path_buf[0], &equal))) {
+			// the candidate might be gone; it can't be a duplicate then
+			cf_print_debug("cannot compare '%s' and '%s', error %d\n", path,
+					db->path_buf[0], error);
+			continue;
+		}
+		if (equal) {
+			*out = rowid;
+			goto fail;
+		}
+	}
+
+fail:
+	free_files_by_hash(stmt);
+	return error;
+}
+
+/*
+ * Hash the contents of the file at NUL-terminated `path`.
+ *
+ * This is 64bit FNV-1a with the top bit cleared so the result fits in a
+ * sqlite integer. It only has to be good enough to make byte comparisons in
+ * find_duplicate_file() rare.
+ */
+static int
+hash_file(const char *path, uint64_t *out)
+{
+	int error = 0;
+	char buf[FILE_READ_LEN];
+	uint64_t hash = 0xcbf29ce484222325ull;
+
+	const int fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (fd == -1) {
+		return errno;
+	}
+
+	for (;;) {
+		const ssize_t ret = read_full(fd, buf, sizeof(buf));
+		if (ret == -1) {
+			error = errno;
+			break;
+		}
+		for (ssize_t i = 0; i < ret; ++i) {
+			hash ^= (unsigned char)buf[i];
+			hash *= 0x100000001b3ull;
+		}
+		if ((size_t)ret < sizeof(buf)) {
+			break;
+		}
+	}
+
+	(void)close(fd);
+	*out = hash & INT64_MAX;
+	return error;
+}
+
+/*
+ * Set `*out` to whether the files at NUL-terminated paths `lhs` and `rhs` have
+ * identical contents.
+ */
+static int
+files_equal(const char *lhs, const char *rhs, bool *out)
+{
+	int error = 0;
+	char lhs_buf[FILE_READ_LEN];
+	char rhs_buf[FILE_READ_LEN];
+
+	const int lhs_fd = open(lhs, O_RDONLY | O_CLOEXEC);
+	if (lhs_fd == -1) {
+		return errno;
+	}
+	const int rhs_fd = open(rhs, O_RDONLY | O_CLOEXEC);
+	if (rhs_fd == -1) {
+		error = errno;
+		goto fail;
+	}
+
+	*out = false;
+	for (;;) {
+		const ssize_t lhs_ret = read_full(lhs_fd, lhs_buf, sizeof(lhs_buf));
+		const ssize_t rhs_ret = read_full(rhs_fd, rhs_buf, sizeof(rhs_buf));
+		if ((lhs_ret == -1) || (rhs_ret == -1)) {
+			error = errno;
+			break;
+		}
+		if ((lhs_ret != rhs_ret) ||
+				memcmp(lhs_buf, rhs_buf, (size_t)lhs_ret)) {
+			break;
+		}
+		if ((size_t)lhs_ret < sizeof(lhs_buf)) {
+			*out = true;
+			break;
+		}
+	}
+
+	(void)close(rhs_fd);
+fail:
+	(void)close(lhs_fd);
+	return error;
+}
+
+/*
+ * read(2) `len` bytes from `fd`, or fewer only at EOF.
+ */
+static ssize_t
+read_full(int fd, char *buf, size_t len)
+{
+	size_t done = 0;
+
+	while (done < len) {
+		const ssize_t ret = read(fd, buf + done, len - done);
+		if (ret == -1) {
+			if (errno == EINTR) {
+				continue;
+			}
+			return -1;
+		}
+		if (!ret) {
+			break;
+		}
+		done += (size_t)ret;
+	}
+	return (ssize_t)done;
+}
+
 static bool
 sanitize_typename(const db_typename_t *name)
 {
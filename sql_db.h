@@ -10,6 +10,9 @@
 #include "cf_map.h"
 #include "cf_vector.h"
 #include "db_types.h"
+#include "path_batch.h"
+#include "snippet.h"
+#include "vcs.h"
 
 #include <sqlite3.h>
 #include <stdint.h>
@@ -18,6 +21,69 @@
 
 __BEGIN_DECLS
 
+/*
+ * When to checkpoint the WAL of a read/write database.
+ *
+ * sqlite's default is to checkpoint passively once the WAL reaches 1000 pages.
+ * Passive checkpoints can't move past readers, so with long-lived readers the
+ * WAL file only grows. A zero-initialized policy keeps the default behavior.
+ *
+ * Members
+ * - size_cap
+ *   If nonzero, the maximum size in bytes of the WAL file. It's checked at
+ *   each sql_db_checkpoint(). Once exceeded, a truncating checkpoint waits
+ *   for readers to move to the newest snapshot then resets the WAL.
+ * - tu_checkpoint
+ *   Do a passive checkpoint at each sql_db_checkpoint(). The indexer calls
+ *   it between TUs.
+ * - close_truncate
+ *   Do a truncating checkpoint when the database is closed. The WAL file
+ *   persists but it's left empty.
+ */
+typedef struct {
+	uint64_t size_cap;
+	bool tu_checkpoint;
+	bool close_truncate;
+} wal_policy_t;
+
+/*
+ * WAL statistics printed when a database is closed.
+ *
+ * Members
+ * - num_checkpoints
+ *   Number of checkpoints started by `wal_policy_t`, including ones that were
+ *   blocked by readers.
+ * - num_busy
+ *   Number of those checkpoints that were blocked by readers.
+ * - checkpoint_ns
+ *   Total wall time spent in checkpoints.
+ * - max_wal_size
+ *   Largest WAL file size seen, in bytes.
+ */
+typedef struct {
+	uint32_t num_checkpoints;
+	uint32_t num_busy;
+	uint64_t checkpoint_ns;
+	uint64_t max_wal_size;
+} wal_stats_t;
+
+/*
+ * Typename lookup statistics printed when a database is closed.
+ *
+ * Members
+ * - num_single
+ *   Number of sql_db_typename_lookup() calls.
+ * - num_many
+ *   Number of sql_db_typename_lookup_many() calls.
+ * - many_keys
+ *   Total keys passed to those calls.
+ */
+typedef struct {
+	uint64_t num_single;
+	uint64_t num_many;
+	uint64_t many_keys;
+} typename_stats_t;
+
 /*
  * Sqlite database backend.
  *
@@ -36,12 +102,52 @@ __BEGIN_DECLS
  *   Length, in bytes, of each buffer in `path_buf`.
  * - path_buf
  *   Two heap-allocated buffers for passing as input and output to realpath(3).
+ * - vcs
+ *   Optional, borrowed version control snapshot set by sql_db_vcs_sync(). If
+ *   non-NULL, new files are inserted along with their version control id.
+ * - vcs_restamp
+ *   Set of rowids of files that changed since they were last indexed. Their
+ *   version control ids are updated the next time they're added.
+ * - approx
+ *   True if new files are being indexed approximately. Set with
+ *   sql_db_set_approx().
+ * - has_approx
+ *   True if the database might contain approximately indexed files. If false,
+ *   adding a preexisting file needn't check whether it must be reindexed
+ *   precisely.
+ * - wal_policy
+ *   Checkpoint policy set with sql_db_set_wal_policy().
+ * - wal_stats
+ *   Checkpoint statistics.
+ * - snippet_file
+ *   File rowid of `snippet_block`, or 0 if nothing is cached.
+ * - snippet_block
+ *   The most recently read snippet block. Printing context for a page of
+ *   results usually reads many lines from few files.
+ * - paths
+ *   Paths queued with sql_db_prefetch_file(), resolved ahead of
+ *   sql_db_add_file() by sql_db_resolve_files().
+ * - path_stats
+ *   Path resolution statistics, printed when the database is closed.
+ * - typename_stats
+ *   Typename lookup statistics, printed when the database is closed.
  */
 typedef struct {
 	sqlite3 *sql;
 	bool readonly;
 	size_t buf_len;
 	char *path_buf[2];
+	const vcs_tree_t *vcs;
+	cf_map8_t vcs_restamp;
+	bool approx;
+	bool has_approx;
+	wal_policy_t wal_policy;
+	wal_stats_t wal_stats;
+	int64_t snippet_file;
+	snippet_block_t snippet_block;
+	path_batch_t paths;
+	path_stats_t path_stats;
+	typename_stats_t typename_stats;
 } sqlite_db_t;
 
 /*
@@ -57,41 +163,64 @@ typedef struct {
  *   `stmt`. Advancing `stmt` invalidates `cur_name`.
  * - cur_loc
  *   Current location.
+ * - cur_cursor
+ *   Keyset cursor of the current entry.
  */
 typedef struct {
 	sqlite3_stmt *stmt;
 	db_typename_t cur_name;
 	loc_ctx_t cur_loc;
+	int64_t cur_cursor;
 } sqlite_db_typename_iter_t;
 
 int sql_db_open(const char *db_path, bool ro, sqlite_db_t *out);
 int sql_db_close(sqlite_db_t *db);
 int sql_db_add_file(sqlite_db_t *db, const char *path, size_t len,
-		int64_t *out);
+		int64_t *out, bool *alias_out);
+int sql_db_prefetch_file(sqlite_db_t *db, const char *path, size_t len);
+void sql_db_resolve_files(sqlite_db_t *db);
+int sql_db_set_approx(sqlite_db_t *db, bool approx);
+int sql_db_set_wal_policy(sqlite_db_t *db, const wal_policy_t *policy);
+int sql_db_checkpoint(sqlite_db_t *db);
+int sql_db_tu_dep_insert(sqlite_db_t *db, int64_t tu, int64_t file);
+int sql_db_snippet_insert(sqlite_db_t *db, int64_t file,
+		const db_snippet_t *lines, size_t num_lines);
+int sql_db_snippet_lookup(sqlite_db_t *db, int64_t file, uint32_t line,
+		cf_str_t *out);
+int sql_db_vcs_sync(sqlite_db_t *db, const vcs_tree_t *tree,
+		cf_map8_t *clean_tus_out);
 
 int sql_db_typename_lookup(sqlite_db_t *db, const loc_ctx_t *loc,
 		const db_typename_t *name, int64_t *out);
+int sql_db_typename_lookup_many(sqlite_db_t *db,
+		const db_typename_key_t *keys, size_t num_keys, type_ref_t *out);
 int sql_db_type_insert(sqlite_db_t *db, const loc_ctx_t *loc,
 		const db_type_entry_t *entry, int64_t *out);
 int sql_db_typename_insert(sqlite_db_t *db, const loc_ctx_t *loc,
 		const db_typename_t *entry);
 int sql_db_type_use_insert(sqlite_db_t *db, const loc_ctx_t *loc,
 		const db_type_use_t *entry);
+int sql_db_type_use_count_insert(sqlite_db_t *db,
+		const db_type_use_count_t *entry, bool max);
 int sql_db_member_insert(sqlite_db_t *db, const loc_ctx_t *loc,
 		const db_member_t *entry);
 
 int sql_db_file_lookup(sqlite_db_t *db, int64_t rowid, cf_str_t *out);
 int sql_db_type_lookup(sqlite_db_t *db, int64_t rowid,
 		db_type_entry_t *entry_out, loc_ctx_t *loc_out);
+int sql_db_type_use_count_lookup(sqlite_db_t *db, int64_t type,
+		use_count_vec_t *out);
 int sql_db_member_lookup(sqlite_db_t *db, int64_t parent,
-		const cf_str_t *member, db_member_t *entry_out, loc_ctx_t *loc_out);
+		const cf_str_t *member, const db_filter_t *filter,
+		db_member_t *entry_out, loc_ctx_t *loc_out);
 int sql_db_typename_find(sqlite_db_t *db, const cf_str_t *name,
-		sqlite_db_typename_iter_t *out);
+		const db_filter_t *filter, sqlite_db_typename_iter_t *out);
 
 void sql_db_typename_iter_free(sqlite_db_typename_iter_t *it);
 void sql_db_typename_iter_peek(const sqlite_db_t *db,
 		const sqlite_db_typename_iter_t *it, db_typename_t *entry_out,
 		loc_ctx_t *loc_out);
 bool sql_db_typename_iter_next(sqlite_db_t *db, sqlite_db_typename_iter_t *it);
+int64_t sql_db_typename_iter_cursor(const sqlite_db_typename_iter_t *it);
 
 __END_DECLS
@@ -16,9 +16,15 @@
 #include <stdint.h>
 #include <errno.h>
 #include <limits.h>
+#include <sys/stat.h>
+
+CF_VEC_FUNC_DECL(use_count_vec_t, db_type_use_count_t, use_count_vec);
 
 static int config_db(sqlite3 *db);
 static int create_tables(sqlite3 *db);
+static int create_indexes(sqlite3 *db);
+static int create_one_index(sqlite3 *db, sqlite3_stmt *stmt,
+		const char *name);
 
 // query compilation functions
 static sqlite3_stmt *compile_file_table_create(sqlite3 *db);
@@ -26,20 +32,45 @@ static sqlite3_stmt *compile_type_table_create(sqlite3 *db);
 static sqlite3_stmt *compile_typename_table_create(sqlite3 *db);
 static sqlite3_stmt *compile_incomplete_type_table_create(sqlite3 *db);
 static sqlite3_stmt *compile_type_use_table_create(sqlite3 *db);
+static sqlite3_stmt *compile_type_use_count_table_create(sqlite3 *db);
 static sqlite3_stmt *compile_member_table_create(sqlite3 *db);
+static sqlite3_stmt *compile_tu_dep_table_create(sqlite3 *db);
+static sqlite3_stmt *compile_file_alias_table_create(sqlite3 *db);
+static sqlite3_stmt *compile_approx_file_table_create(sqlite3 *db);
+static sqlite3_stmt *compile_snippet_table_create(sqlite3 *db);
 
 static sqlite3_stmt *compile_file_table_lookup(sqlite3 *db);
 static sqlite3_stmt *compile_file_table_id_lookup(sqlite3 *db);
 static sqlite3_stmt *compile_file_table_insert(sqlite3 *db);
+static sqlite3_stmt *compile_file_table_update(sqlite3 *db);
+static sqlite3_stmt *compile_file_table_hash_find(sqlite3 *db);
+static sqlite3_stmt *compile_file_table_vcs_find(sqlite3 *db, bool tracked,
+		bool aliases);
+static sqlite3_stmt *compile_file_alias_table_lookup(sqlite3 *db);
+static sqlite3_stmt *compile_file_alias_table_insert(sqlite3 *db);
+static sqlite3_stmt *compile_approx_file_table_insert(sqlite3 *db);
+static sqlite3_stmt *compile_approx_file_table_lookup(sqlite3 *db);
+static sqlite3_stmt *compile_approx_file_table_count(sqlite3 *db);
+static sqlite3_stmt *compile_tu_dep_table_count(sqlite3 *db);
+static sqlite3_stmt *compile_snippet_table_insert(sqlite3 *db);
+static sqlite3_stmt *compile_snippet_table_lookup(sqlite3 *db);
 static sqlite3_stmt *compile_type_table_lookup(sqlite3 *db);
 static sqlite3_stmt *compile_type_table_insert(sqlite3 *db);
 static sqlite3_stmt *compile_typename_table_lookup(sqlite3 *db);
-static sqlite3_stmt *compile_typename_table_find(sqlite3 *db);
+static sqlite3_stmt *compile_typename_table_lookup_many(sqlite3 *db);
+static sqlite3_stmt *compile_typename_table_find(sqlite3 *db,
+		db_order_t order);
+static sqlite3_stmt *compile_typename_table_cursor(sqlite3 *db);
 static sqlite3_stmt *compile_typename_table_insert(sqlite3 *db);
 static sqlite3_stmt *compile_incomplete_type_table_lookup(sqlite3 *db);
 static sqlite3_stmt *compile_type_use_table_insert(sqlite3 *db);
+static sqlite3_stmt *compile_type_use_count_table_insert(sqlite3 *db);
+static sqlite3_stmt *compile_type_use_count_table_lookup(sqlite3 *db);
 static sqlite3_stmt *compile_member_table_insert(sqlite3 *db);
 static sqlite3_stmt *compile_member_table_lookup(sqlite3 *db);
+static sqlite3_stmt *compile_tu_dep_table_insert(sqlite3 *db);
+static sqlite3_stmt *compile_tu_dep_table_clean_find(sqlite3 *db);
+static sqlite3_stmt *compile_vcs_changed_insert(sqlite3 *db);
 
 static sqlite3_stmt *compile_query_desc(
 		sqlite3 *db, const query_desc_t *query);
@@ -51,7 +82,21 @@ static int bind_file_lookup(
 		sqlite3_stmt *stmt, const char *path, size_t len);
 static int bind_file_id_lookup(sqlite3_stmt *stmt, int64_t rowid);
 static int bind_file_insert(
+		sqlite3_stmt *stmt, const char *path, size_t len,
+		const cf_str_t *vcs_id, uint64_t hash);
+static int bind_file_update(
+		sqlite3_stmt *stmt, int64_t rowid, const cf_str_t *vcs_id,
+		uint64_t hash);
+static int bind_file_hash_find(sqlite3_stmt *stmt, uint64_t hash);
+static int bind_approx_file(sqlite3_stmt *stmt, int64_t file);
+static int bind_snippet_insert(sqlite3_stmt *stmt, int64_t file,
+		const void *blob, size_t len);
+static int bind_snippet_lookup(sqlite3_stmt *stmt, int64_t file);
+static int bind_file_alias_lookup(
 		sqlite3_stmt *stmt, const char *path, size_t len);
+static int bind_file_alias_insert(
+		sqlite3_stmt *stmt, const char *path, size_t len, int64_t file,
+		const cf_str_t *vcs_id);
 static int bind_type_lookup(sqlite3_stmt *stmt, int64_t rowid);
 static int bind_type_insert(
 		sqlite3_stmt *stmt, const loc_ctx_t *loc,
@@ -59,30 +104,73 @@ static int bind_type_insert(
 static int bind_typename_lookup(
 		sqlite3_stmt *stmt, const loc_ctx_t *loc,
 		const db_typename_t *name);
-static int bind_typename_find(sqlite3_stmt *stmt, const cf_str_t *name);
+static int bind_typename_lookup_many(sqlite3_stmt *stmt,
+		const db_typename_key_t *keys, size_t num_keys);
+static int bind_typename_find(sqlite3_stmt *stmt, const cf_str_t *name,
+		const db_filter_t *filter);
 static int bind_typename_insert(
 		sqlite3_stmt *stmt, const loc_ctx_t *loc,
 		const db_typename_t *name);
 static int bind_type_use_insert(
 		sqlite3_stmt *stmt, const loc_ctx_t *loc,
 		const db_type_use_t *entry);
+static int bind_type_use_count_insert(sqlite3_stmt *stmt,
+		const db_type_use_count_t *entry, bool max);
+static int bind_type_use_count_lookup(sqlite3_stmt *stmt, int64_t type);
 static int bind_member_insert(
 		sqlite3_stmt *stmt, const loc_ctx_t *loc,
 		const db_member_t *entry);
 static int bind_member_lookup(
-		sqlite3_stmt *stmt, int64_t parent, const cf_str_t *name);
+		sqlite3_stmt *stmt, int64_t parent, const cf_str_t *name,
+		const db_filter_t *filter);
+static void bind_file_glob(const db_filter_t *filter, cf_str_t *out);
+static int bind_tu_dep_insert(sqlite3_stmt *stmt, int64_t tu, int64_t file);
+static int bind_vcs_changed_insert(sqlite3_stmt *stmt, int64_t rowid);
 
 // lookup query execute functions
 static int exec_lookup_file_query(sqlite3_stmt *stmt, int64_t *rowid_out);
+static int exec_lookup_file_alias_query(sqlite3_stmt *stmt,
+		int64_t *rowid_out);
 static int exec_file_id_lookup_query(sqlite3_stmt *stmt, cf_str_t *path_out);
 static int exec_lookup_typename_query(sqlite3_stmt *stmt, int64_t *rowid_out,
 		typename_kind_t *kind_out);
+static int exec_lookup_many_typename_query(sqlite3_stmt *stmt,
+		uint32_t *key_out, int64_t *rowid_out);
+static int check_typename_cursor(sqlite3 *db, int64_t cursor);
 static int exec_find_typename_query(sqlite3_stmt *stmt,
-		db_typename_t *entry_out, loc_ctx_t *loc_out);
+		db_typename_t *entry_out, loc_ctx_t *loc_out, int64_t *cursor_out);
 static int exec_lookup_type(sqlite3_stmt *stmt, int64_t *rowid_out,
 		db_type_entry_t *entry_out, loc_ctx_t *loc_out);
 static int exec_lookup_member(sqlite3_stmt *stmt,
 		db_member_t *entry_out, loc_ctx_t *loc_out);
+static int exec_find_vcs_file(sqlite3_stmt *stmt, bool tracked,
+		int64_t *rowid_out, cf_str_t *path_out, cf_str_t *vcs_id_out);
+static int exec_find_file_hash(sqlite3_stmt *stmt, int64_t *rowid_out,
+		cf_str_t *path_out);
+static int exec_scan_file(sqlite3_stmt *stmt, int64_t *rowid_out,
+		cf_str_t *path_out);
+static int exec_scan_typename(sqlite3_stmt *stmt, int64_t *rowid_out,
+		db_typename_t *entry_out, type_kind_t *type_kind_out,
+		loc_ctx_t *loc_out);
+static int exec_scan_member(sqlite3_stmt *stmt, db_member_t *entry_out,
+		loc_ctx_t *loc_out);
+static int exec_scan_type(sqlite3_stmt *stmt, int64_t *rowid_out,
+		db_type_entry_t *entry_out, loc_ctx_t *loc_out);
+static int exec_scan_type_use(sqlite3_stmt *stmt, db_type_use_t *entry_out,
+		loc_ctx_t *loc_out);
+static int exec_type_use_count(sqlite3_stmt *stmt, db_type_use_count_t *out);
+static int exec_scan_two_ids(sqlite3_stmt *stmt, int64_t *first_out,
+		int64_t *second_out);
+static int exec_scan_file_alias(sqlite3_stmt *stmt, int64_t *file_out,
+		cf_str_t *path_out);
+static int exec_scan_snippet(sqlite3_stmt *stmt, int64_t *file_out,
+		snippet_block_t *out);
+
+static int exec_simple_query(sqlite3 *db, sqlite3_stmt *stmt);
+
+// purging
+static int reset_purged_types(sqlite3 *db);
+static int purge_dependent_types(sqlite3 *db);
 
 static int lookup_one_row(sqlite3_stmt *stmt, const lookup_desc_t *desc,
 		column_val_t *out);
@@ -133,15 +221,15 @@ static int sql_column_kind2type(column_kind_t kind);
  *   - file table
  *   - type table
  *   ...
+ * - create indexes
  * - in read/write mode, enter a transaction for all future inserts
- *
- * XXX `ro=true` is broken; sqlite3_open fails with 21 SQLITE_MISUSE ???
  */
 int
 sql_open(const char *db_path, bool ro, sqlite3 **sql_out)
 {
-	const int flags = SQLITE_OPEN_CREATE | SQLITE_OPEN_PRIVATECACHE |
-			(ro ? SQLITE_OPEN_READONLY : SQLITE_OPEN_READWRITE);
+	// note: sqlite rejects SQLITE_OPEN_CREATE with SQLITE_OPEN_READONLY
+	const int flags = SQLITE_OPEN_PRIVATECACHE | (ro ? SQLITE_OPEN_READONLY :
+			(SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE));
 	int error;
 	sqlite3 *db = NULL;
 
@@ -175,6 +263,11 @@ sql_open(const char *db_path, bool ro, sqlite3 **sql_out)
 		goto fail;
 	}
 
+	// and indexes on those tables
+	if ((error = create_indexes(db))) {
+		goto fail;
+	}
+
 done:
 	*sql_out = db;
 	return 0;
@@ -216,6 +309,62 @@ fail:
 	return error;
 }
 
+/*
+ * Checkpoint the WAL of `db` with checkpoint mode `mode`, one of
+ * `SQLITE_CHECKPOINT_*`.
+ *
+ * Returns the sqlite error code. SQLITE_BUSY means the checkpoint couldn't
+ * finish because of concurrent readers; it can be retried later.
+ */
+int
+checkpoint_wal(sqlite3 *db, int mode)
+{
+	int error;
+	int log_frames;
+	int ckpt_frames;
+
+	error = sqlite3_wal_checkpoint_v2(db, NULL, mode, &log_frames,
+			&ckpt_frames);
+	if (error && (error != SQLITE_BUSY)) {
+		cf_print_err("cannot checkpoint, mode %d, error %d/'%s'\n",
+				mode, error, sqlite3_errmsg(db));
+	}
+
+	cf_print_info("checkpoint mode %d: %d/%d frames, error %d\n",
+			mode, ckpt_frames, log_frames, error);
+	return error;
+}
+
+/*
+ * Get the size, in bytes, of the WAL file of `db`.
+ *
+ * A WAL that doesn't exist yet has size 0.
+ */
+int
+get_wal_size(sqlite3 *db, uint64_t *size_out)
+{
+	struct stat sb;
+
+	const char *const db_path = sqlite3_db_filename(db, "main");
+	if (!db_path || !*db_path) {
+		// temporary or in-memory database
+		*size_out = 0;
+		return 0;
+	}
+
+	const char *const wal_path = sqlite3_filename_wal(db_path);
+	if (stat(wal_path, &sb) == -1) {
+		if (errno == ENOENT) {
+			*size_out = 0;
+			return 0;
+		}
+		return errno;
+	}
+
+	*size_out = (uint64_t)sb.st_size;
+	return 0;
+}
+
 /*
  * For a read/write database, create all cf tables in `db`.
  *
@@ -225,7 +374,7 @@ fail:
 static int
 create_tables(sqlite3 *db)
 {
-#define CF_NUM_TABLES 6
+#define CF_NUM_TABLES 11
 	int error;
 
 	static const char *const table_names[] = {
@@ -235,6 +384,11 @@ create_tables(sqlite3 *db)
 		INCOMPLETE_TYPE_TABLE_NAME,
 		TYPE_USE_TABLE_NAME,
 		MEMBER_TABLE_NAME,
+		TU_DEP_TABLE_NAME,
+		FILE_ALIAS_TABLE_NAME,
+		APPROX_FILE_TABLE_NAME,
+		SNIPPET_TABLE_NAME,
+		TYPE_USE_COUNT_TABLE_NAME,
 	};
 
 	// an array of sql CREATE statements
@@ -245,6 +399,11 @@ create_tables(sqlite3 *db)
 		compile_incomplete_type_table_create(db),
 		compile_type_use_table_create(db),
 		compile_member_table_create(db),
+		compile_tu_dep_table_create(db),
+		compile_file_alias_table_create(db),
+		compile_approx_file_table_create(db),
+		compile_snippet_table_create(db),
+		compile_type_use_count_table_create(db),
 	};
 
 	_Static_assert(ARRAY_LEN(table_names) == CF_NUM_TABLES,
@@ -272,6 +431,66 @@ create_tables(sqlite3 *db)
 	return error;
 }
 
+/*
+ * For a read/write database, create all cf indexes in `db`.
+ *
+ * Like create_tables(), preexisting indexes are left alone. Tables must
+ * already exist.
+ */
+static int
+create_indexes(sqlite3 *db)
+{
+#define FILE_HASH_INDEX_QUERY_CREATE \
+	"CREATE INDEX IF NOT EXISTS " \
+	FILE_HASH_INDEX_NAME " ON " \
+	FILE_TABLE_NAME " " \
+	FILE_HASH_INDEX_COLUMNS ";"
+#define TYPENAME_NAME_INDEX_QUERY_CREATE \
+	"CREATE INDEX IF NOT EXISTS " \
+	TYPENAME_NAME_INDEX_NAME " ON " \
+	TYPENAME_TABLE_NAME " " \
+	TYPENAME_NAME_INDEX_COLUMNS ";"
+#define TYPENAME_SCOPE_INDEX_QUERY_CREATE \
+	"CREATE INDEX IF NOT EXISTS " \
+	TYPENAME_SCOPE_INDEX_NAME " ON " \
+	TYPENAME_TABLE_NAME " " \
+	TYPENAME_SCOPE_INDEX_COLUMNS ";"
+	int error;
+
+	if ((error = create_one_index(db,
+			compile_query(db, FILE_HASH_INDEX_QUERY_CREATE),
+			FILE_HASH_INDEX_NAME))) {
+		return error;
+	}
+	if ((error = create_one_index(db,
+			compile_query(db, TYPENAME_NAME_INDEX_QUERY_CREATE),
+			TYPENAME_NAME_INDEX_NAME))) {
+		return error;
+	}
+	return create_one_index(db,
+			compile_query(db, TYPENAME_SCOPE_INDEX_QUERY_CREATE),
+			TYPENAME_SCOPE_INDEX_NAME);
+}
+
+/*
+ * Run index CREATE statement `stmt` for index `name`, then free `stmt`.
+ */
+static int
+create_one_index(sqlite3 *db, sqlite3_stmt *stmt, const char *name)
+{
+	int error;
+
+	if ((error = sqlite3_step(stmt)) != SQLITE_DONE) {
+		cf_print_err("cannot create index '%s', error %d/'%s'\n",
+				name, error, sqlite3_errmsg(db));
+	} else {
+		error = 0;
+	}
+
+	sqlite3_finalize(stmt);
+	return error;
+}
+
 /*
  * Do a lookup for a file whose name exactly matches `path`.
  *
@@ -334,35 +553,25 @@ fail:
 }
 
 /*
- * Insert a path into the file table.
+ * Do a lookup for an alias whose path exactly matches `path`.
  *
- * The new rowid is assigned to `*rowid_out`.
+ * On success, the rowid of the file the alias refers to is written to
+ * `*rowid_out`.
  */
 int
-insert_file(sqlite3 *db, const char *path, size_t len, int64_t *rowid_out)
+lookup_file_alias(sqlite3 *db, const char *path, size_t len,
+		int64_t *rowid_out)
 {
 	cf_assert(len);
 
 	int error;
-	sqlite3_stmt *stmt = compile_file_table_insert(db);
-
-	// serialize `path` to `stmt`
-	if ((error = bind_file_insert(stmt, path, len))) {
-		goto fail;
-	}
+	sqlite3_stmt *stmt = compile_file_alias_table_lookup(db);
 
-	// execute query
-	error = sqlite3_step(stmt);
-	if (error != SQLITE_DONE) {
-		cf_print_err("insert-file query execute failed, error %d\n", error);
+	if ((error = bind_file_alias_lookup(stmt, path, len))) {
 		goto fail;
 	}
-	error = 0;
 
-	// get back the rowid of the just-inserted row
-	const int64_t rowid = sqlite3_last_insert_rowid(db);
-	cf_assert(rowid > 0);
-	*rowid_out = rowid;
+	error = exec_lookup_file_alias_query(stmt, rowid_out);
 
 fail:
 	sqlite3_finalize(stmt);
@@ -370,30 +579,31 @@ fail:
 }
 
 /*
- * Insert `entry` into the type table.
+ * Insert a path into the file table.
  *
- * On success, the new rowid is returned via `*rowid_out`.
+ * `vcs_id` is the file's version control id. Pass NULL for untracked files.
+ * `hash` is a hash of the file's contents; it must fit in 63 bits.
  *
- * This function only inserts into the type table. It's the caller's job to
- * follow with a separate insertion into the typename table (or wherever) that
- * references `*rowid_out`.
+ * The new rowid is assigned to `*rowid_out`.
  */
 int
-insert_complete_type(sqlite3 *db, const loc_ctx_t *loc,
-		const db_type_entry_t *entry, int64_t *rowid_out)
+insert_file(sqlite3 *db, const char *path, size_t len, const cf_str_t *vcs_id,
+		uint64_t hash, int64_t *rowid_out)
 {
+	cf_assert(len);
+
 	int error;
-	sqlite3_stmt *stmt = compile_type_table_insert(db);
+	sqlite3_stmt *stmt = compile_file_table_insert(db);
 
-	// serialize `entry`
-	if ((error = bind_type_insert(stmt, loc, entry))) {
+	// serialize `path` to `stmt`
+	if ((error = bind_file_insert(stmt, path, len, vcs_id, hash))) {
 		goto fail;
 	}
 
 	// execute query
 	error = sqlite3_step(stmt);
 	if (error != SQLITE_DONE) {
-		cf_print_err("insert-type query execute failed, error %d\n", error);
+		cf_print_err("insert-file query execute failed, error %d\n", error);
 		goto fail;
 	}
 	error = 0;
@@ -409,317 +619,1580 @@ fail:
 }
 
 /*
+ * Set the version control id and content hash of file `rowid`.
+ *
+ * Pass NULL for `vcs_id` to mark the file as untracked.
  */
 int
-insert_typename(sqlite3 *db, const loc_ctx_t *loc, const db_typename_t *name,
-		int64_t *rowid_out)
+update_file(sqlite3 *db, int64_t rowid, const cf_str_t *vcs_id, uint64_t hash)
 {
 	int error;
-	sqlite3_stmt *stmt = compile_typename_table_insert(db);
+	sqlite3_stmt *stmt = compile_file_table_update(db);
 
-	// serialize `name`
-	if ((error = bind_typename_insert(stmt, loc, name))) {
+	if ((error = bind_file_update(stmt, rowid, vcs_id, hash))) {
 		goto fail;
 	}
 
-	// execute query
 	error = sqlite3_step(stmt);
 	if (error != SQLITE_DONE) {
-		cf_print_err("insert-typename query execute failed, error %d\n",
-				error);
+		cf_print_err("update-file query execute failed, error %d\n", error);
 		goto fail;
 	}
 	error = 0;
 
-	// get back the rowid of the just-inserted row
-	const int64_t rowid = sqlite3_last_insert_rowid(db);
-	cf_assert(rowid > 0);
-	*rowid_out = rowid;
 fail:
+	sqlite3_finalize(stmt);
 	return error;
 }
 
 /*
- * Check for existence of a type matching `name` in the file specified by
- * `loc`.
+ * Insert `path` as an alias of file `file`.
  *
- * If it exists, return the entry's rowid via `*rowid_out`, if not this
- * function returns ENOENT.
+ * `vcs_id` is the version control id of `path` (not `file`). Pass NULL if
+ * it's untracked.
  */
 int
-lookup_typename(sqlite3 *db, const loc_ctx_t *loc, const db_typename_t *name,
-		int64_t *rowid_out)
+insert_file_alias(sqlite3 *db, const char *path, size_t len, int64_t file,
+		const cf_str_t *vcs_id)
 {
-	int error;
-	sqlite3_stmt *stmt = compile_typename_table_lookup(db);
-
-	if ((error = bind_typename_lookup(stmt, loc, name))) {
-		goto fail;
-	}
-
-	typename_kind_t found_kind;
-	if ((error = exec_lookup_typename_query(stmt, rowid_out, &found_kind))) {
-		goto fail;
-	}
-
-	// the tag namespace is not shared with the typedef namespace
-	// e.g., `struct foo;` is different from `typedef struct {} foo;`
-	if (found_kind != name->kind) {
-		cf_print_debug("lookup-typename found matching row with wrong kind; "
-				"found %u, expected %u\n", found_kind, name->kind);
-		error = ENOENT;
-	}
-
-fail:
-	sqlite3_finalize(stmt);
-	return error;
-}
+	cf_assert(len);
 
-int
-insert_type_use(sqlite3 *db, const loc_ctx_t *loc, const db_type_use_t *entry,
-		int64_t *rowid_out)
-{
 	int error;
-	sqlite3_stmt *stmt = compile_type_use_table_insert(db);
+	sqlite3_stmt *stmt = compile_file_alias_table_insert(db);
 
-	// serialize `entry`
-	if ((error = bind_type_use_insert(stmt, loc, entry))) {
+	if ((error = bind_file_alias_insert(stmt, path, len, file, vcs_id))) {
 		goto fail;
 	}
 
-	// execute query
 	error = sqlite3_step(stmt);
 	if (error != SQLITE_DONE) {
-		cf_print_err("insert-type-use query execute failed, error %d\n",
+		cf_print_err("insert-file-alias query execute failed, error %d\n",
 				error);
 		goto fail;
 	}
 	error = 0;
 
-	// get back the rowid of the just-inserted row
-	const int64_t rowid = sqlite3_last_insert_rowid(db);
-	cf_assert(rowid > 0);
-	*rowid_out = rowid;
-
 fail:
 	sqlite3_finalize(stmt);
 	return error;
 }
 
+/*
+ * Tag file `file` as approximately indexed.
+ */
 int
-insert_member(sqlite3 *db, const loc_ctx_t *loc, const db_member_t *entry,
-		int64_t *rowid_out)
+insert_approx_file(sqlite3 *db, int64_t file)
 {
 	int error;
-	sqlite3_stmt *stmt = compile_member_table_insert(db);
-
-	// serialize `entry`
-	if ((error = bind_member_insert(stmt, loc, entry))) {
-		goto fail;
-	}
+	sqlite3_stmt *stmt = compile_approx_file_table_insert(db);
 
-	// execute query
-	error = sqlite3_step(stmt);
-	if (error != SQLITE_DONE) {
-		cf_print_err("insert-member query execute failed, error %d\n",
-				error);
-		goto fail;
+	if ((error = bind_approx_file(stmt, file))) {
+		sqlite3_finalize(stmt);
+		return error;
 	}
-	error = 0;
-
-	// get back the rowid of the just-inserted row
-	const int64_t rowid = sqlite3_last_insert_rowid(db);
-	cf_assert(rowid > 0);
-	*rowid_out = rowid;
 
-fail:
-	sqlite3_finalize(stmt);
-	return error;
+	return exec_simple_query(db, stmt);
 }
 
+/*
+ * Check whether file `file` is approximately indexed.
+ *
+ * Returns 0 if it is, ENOENT if it isn't.
+ */
 int
-lookup_type_entry(sqlite3 *db, int64_t rowid, db_type_entry_t *entry_out,
-		loc_ctx_t *loc_out)
+lookup_approx_file(sqlite3 *db, int64_t file)
 {
 	int error;
-	sqlite3_stmt *stmt = compile_type_table_lookup(db);
-
-	if ((error = bind_type_lookup(stmt, rowid))) {
-		goto fail;
-	}
+	sqlite3_stmt *stmt = compile_approx_file_table_lookup(db);
 
-	// execute query
-	int64_t rowid_out;
-	if ((error = exec_lookup_type(stmt, &rowid_out, entry_out, loc_out))) {
+	if ((error = bind_approx_file(stmt, file))) {
 		goto fail;
 	}
 
-	cf_assert(rowid_out == rowid);
+	error = query_step_one(stmt);
 
 fail:
 	sqlite3_finalize(stmt);
 	return error;
 }
 
+/*
+ * Count the approximately indexed files in `db`.
+ */
 int
-lookup_member(sqlite3 *db, int64_t parent, const cf_str_t *member,
-		db_member_t *entry_out, loc_ctx_t *loc_out)
+count_approx_files(sqlite3 *db, size_t *count_out)
 {
 	int error;
-	sqlite3_stmt *stmt = compile_member_table_lookup(db);
+	sqlite3_stmt *stmt = compile_approx_file_table_count(db);
 
-	if ((error = bind_member_lookup(stmt, parent, member))) {
-		goto fail;
-	}
+	const size_t num_outputs = approx_file_count_query.num_outputs;
+	column_val_t column_vals[num_outputs];
 
-	// execute query
-	if ((error = exec_lookup_member(stmt, entry_out, loc_out))) {
+	if ((error = lookup_one_row(stmt, &approx_file_count_query,
+			column_vals))) {
 		goto fail;
 	}
 
+	*count_out = (size_t)column_vals[0].uint64_val;
+
 fail:
 	sqlite3_finalize(stmt);
 	return error;
 }
 
 /*
- * Create a statement that yields all `db_typename_t`s matching `name`.
- *
- * This function does:
- *   compile
- *   bind
- * next():
- *   sql_step
- * get():
- *   deserialize
+ * Count the TUs in `db`.
  */
 int
-find_typenames(sqlite3 *db, const cf_str_t *name, sqlite3_stmt **out)
+count_tus(sqlite3 *db, size_t *count_out)
 {
 	int error;
-	sqlite3_stmt *stmt = compile_typename_table_find(db);
+	sqlite3_stmt *stmt = compile_tu_dep_table_count(db);
+
+	const size_t num_outputs = tu_count_query.num_outputs;
+	column_val_t column_vals[num_outputs];
 
-	if ((error = bind_typename_find(stmt, name))) {
+	if ((error = lookup_one_row(stmt, &tu_count_query, column_vals))) {
 		goto fail;
 	}
 
-	*out = stmt;
+	*count_out = (size_t)column_vals[0].uint64_val;
 
-	return 0;
 fail:
 	sqlite3_finalize(stmt);
 	return error;
 }
 
 /*
- * Note: invalidates any borrowed strings returned from a previous
- * iter_get_typename() call.
+ * Store compressed snippet block `blob` for file `file`, replacing any
+ * previous block.
  */
 int
-iter_next_typename(sqlite3_stmt *stmt)
+insert_snippets(sqlite3 *db, int64_t file, const void *blob, size_t len)
 {
-	return query_step_one(stmt);
-}
+	int error;
+	sqlite3_stmt *stmt = compile_snippet_table_insert(db);
 
-int
-iter_get_typename(sqlite3_stmt *stmt, db_typename_t *entry_out,
-		loc_ctx_t *loc_out)
-{
-	return exec_find_typename_query(stmt, entry_out, loc_out);
-}
+	if ((error = bind_snippet_insert(stmt, file, blob, len))) {
+		sqlite3_finalize(stmt);
+		return error;
+	}
 
-void
-free_typenames(sqlite3_stmt *stmt)
-{
-	sqlite3_finalize(stmt);
+	return exec_simple_query(db, stmt);
 }
 
 /*
- * Execute a file lookup query that has been previously prepared in `stmt`.
+ * Read and decode the snippet block of file `file` into `out`.
  *
- * On success, the rowid of the single matching entry is written to
- * `*rowid_out`.
+ * Return ENOENT if the file has no snippets. On success, follow with a call to
+ * snippet_block_free().
  */
-static int
-exec_lookup_file_query(sqlite3_stmt *stmt, int64_t *rowid_out)
+int
+lookup_snippets(sqlite3 *db, int64_t file, snippet_block_t *out)
 {
 	int error;
+	sqlite3_stmt *stmt = compile_snippet_table_lookup(db);
 
-	const size_t num_outputs = file_lookup_query.num_outputs;
+	const size_t num_outputs = snippet_lookup_query.num_outputs;
 	column_val_t column_vals[num_outputs];
 
-	if ((error = lookup_one_row(stmt, &file_lookup_query, column_vals))) {
+	if ((error = bind_snippet_lookup(stmt, file))) {
+		goto fail;
+	}
+	if ((error = lookup_one_row(stmt, &snippet_lookup_query, column_vals))) {
 		goto fail;
 	}
 
-	*rowid_out = (int64_t)column_vals[0].uint64_val;
+	// decode before `stmt` frees the borrowed blob
+	error = snippet_decode(column_vals[0].blob_val.data,
+			column_vals[0].blob_val.len, out);
+	if (error == EILSEQ) {
+		cf_print_corrupt("snippets of file %lld can't be decoded\n",
+				p_(file));
+	}
 
 fail:
+	sqlite3_finalize(stmt);
 	return error;
 }
 
 /*
- * Do a lookup in the file table according to `stmt`.
+ * Delete every entry located in approximately indexed file `file`, then
+ * untag it.
  *
- * On success, `path_out` is set to an *owned* string of the file path.
+ * The file's rowid stays the same. The caller indexes it precisely right
+ * after, which replaces what was deleted. Types in other files that reference
+ * types in `file` are deleted too (see purge_dependent_types()).
  */
-static int
-exec_file_id_lookup_query(sqlite3_stmt *stmt, cf_str_t *path_out)
+int
+purge_approx_file(sqlite3 *db, int64_t file)
 {
 	int error;
 
-	const size_t num_outputs = file_id_lookup_query.num_outputs;
-	column_val_t column_vals[num_outputs];
-
-	if ((error = lookup_one_row(stmt, &file_id_lookup_query, column_vals))) {
-		goto fail;
+	// purge the types in `file` and everything that references them
+	if ((error = reset_purged_types(db))) {
+		return error;
 	}
-
-	cf_str_dup_str(&column_vals[0].str_val, path_out);
+	sqlite3_stmt *stmt = compile_query(db, "INSERT INTO temp.purged_type"
+			" SELECT typeid FROM " TYPE_TABLE_NAME " WHERE file == ?1;");
+	if ((error = bind_approx_file(stmt, file))) {
+		sqlite3_finalize(stmt);
+		return error;
+	}
+	if ((error = exec_simple_query(db, stmt))) {
+		return error;
+	}
+	if ((error = purge_dependent_types(db))) {
+		return error;
+	}
+
+	// note: every statement binds `file` as ?1
+	sqlite3_stmt *const purge_stmts[] = {
+		compile_query(db, "DELETE FROM " TYPENAME_TABLE_NAME
+				" WHERE file == ?1;"),
+		compile_query(db, "DELETE FROM " TYPE_TABLE_NAME
+				" WHERE file == ?1;"),
+		compile_query(db, "DELETE FROM " INCOMPLETE_TYPE_TABLE_NAME
+				" WHERE file == ?1;"),
+		compile_query(db, "DELETE FROM " TYPE_USE_TABLE_NAME
+				" WHERE file == ?1;"),
+		compile_query(db, "DELETE FROM " TYPE_USE_COUNT_TABLE_NAME
+				" WHERE file == ?1;"),
+		compile_query(db, "DELETE FROM " MEMBER_TABLE_NAME
+				" WHERE file == ?1;"),
+		compile_query(db, "DELETE FROM " SNIPPET_TABLE_NAME
+				" WHERE file == ?1;"),
+		compile_query(db, "DELETE FROM " APPROX_FILE_TABLE_NAME
+				" WHERE file == ?1;"),
+	};
+
+	// execute each statement, stopping at the first error
+	error = 0;
+	for (unsigned i = 0; i < ARRAY_LEN(purge_stmts); ++i) {
+		if (!error) {
+			error = bind_approx_file(purge_stmts[i], file);
+		}
+		if (error) {
+			sqlite3_finalize(purge_stmts[i]);
+			continue;
+		}
+		if ((error = exec_simple_query(db, purge_stmts[i]))) {
+			cf_print_err("cannot purge approx file %lld, statement %u\n",
+					p_(file), i);
+		}
+	}
+
+	return error;
+}
+
+/*
+ * Record that the TU with main file `tu` depends on file `file`.
+ */
+int
+insert_tu_dep(sqlite3 *db, int64_t tu, int64_t file)
+{
+	int error;
+	sqlite3_stmt *stmt = compile_tu_dep_table_insert(db);
+
+	if ((error = bind_tu_dep_insert(stmt, tu, file))) {
+		goto fail;
+	}
+
+	error = sqlite3_step(stmt);
+	if (error != SQLITE_DONE) {
+		cf_print_err("insert-tu-dep query execute failed, error %d\n", error);
+		goto fail;
+	}
+	error = 0;
+
+fail:
+	sqlite3_finalize(stmt);
+	return error;
+}
+
+/*
+ * Insert `entry` into the type table.
+ *
+ * On success, the new rowid is returned via `*rowid_out`.
+ *
+ * This function only inserts into the type table. It's the caller's job to
+ * follow with a separate insertion into the typename table (or wherever) that
+ * references `*rowid_out`.
+ */
+int
+insert_complete_type(sqlite3 *db, const loc_ctx_t *loc,
+		const db_type_entry_t *entry, int64_t *rowid_out)
+{
+	int error;
+	sqlite3_stmt *stmt = compile_type_table_insert(db);
+
+	// serialize `entry`
+	if ((error = bind_type_insert(stmt, loc, entry))) {
+		goto fail;
+	}
+
+	// execute query
+	error = sqlite3_step(stmt);
+	if (error != SQLITE_DONE) {
+		cf_print_err("insert-type query execute failed, error %d\n", error);
+		goto fail;
+	}
+	error = 0;
+
+	// get back the rowid of the just-inserted row
+	const int64_t rowid = sqlite3_last_insert_rowid(db);
+	cf_assert(rowid > 0);
+	*rowid_out = rowid;
+
+fail:
+	sqlite3_finalize(stmt);
+	return error;
+}
+
+/*
+ */
+int
+insert_typename(sqlite3 *db, const loc_ctx_t *loc, const db_typename_t *name,
+		int64_t *rowid_out)
+{
+	int error;
+	sqlite3_stmt *stmt = compile_typename_table_insert(db);
+
+	// serialize `name`
+	if ((error = bind_typename_insert(stmt, loc, name))) {
+		goto fail;
+	}
+
+	// execute query
+	error = sqlite3_step(stmt);
+	if (error != SQLITE_DONE) {
+		cf_print_err("insert-typename query execute failed, error %d\n",
+				error);
+		goto fail;
+	}
+	error = 0;
+
+	// get back the rowid of the just-inserted row
+	const int64_t rowid = sqlite3_last_insert_rowid(db);
+	cf_assert(rowid > 0);
+	*rowid_out = rowid;
+fail:
+	return error;
+}
+
+/*
+ * Check for existence of a type matching `name` in the file specified by
+ * `loc`.
+ *
+ * If it exists, return the entry's rowid via `*rowid_out`, if not this
+ * function returns ENOENT.
+ */
+int
+lookup_typename(sqlite3 *db, const loc_ctx_t *loc, const db_typename_t *name,
+		int64_t *rowid_out)
+{
+	int error;
+	sqlite3_stmt *stmt = compile_typename_table_lookup(db);
+
+	if ((error = bind_typename_lookup(stmt, loc, name))) {
+		goto fail;
+	}
+
+	// the tag namespace is not shared with the typedef namespace
+	// e.g., `struct foo;` is different from `typedef struct {} foo;`
+	// so `kind` is part of the key, like in lookup_typenames()
+	typename_kind_t found_kind;
+	if ((error = exec_lookup_typename_query(stmt, rowid_out, &found_kind))) {
+		goto fail;
+	}
+	cf_assert(found_kind == name->kind);
+
+fail:
+	sqlite3_finalize(stmt);
+	return error;
+}
+
+/*
+ * Batched lookup_typename().
+ *
+ * Keys are resolved `TYPENAME_LOOKUP_BATCH` at a time, with one statement
+ * execution per batch. `out[i]` is set to the rowid of the type `keys[i]`
+ * names, or zero if there's none.
+ */
+int
+lookup_typenames(sqlite3 *db, const db_typename_key_t *keys, size_t num_keys,
+		type_ref_t *out)
+{
+	int error = 0;
+
+	memset(out, 0, num_keys * sizeof(*out));
+	if (!num_keys) {
+		return 0;
+	}
+
+	sqlite3_stmt *stmt = compile_typename_table_lookup_many(db);
+
+	for (size_t base = 0; base < num_keys; base += TYPENAME_LOOKUP_BATCH) {
+		const size_t left = num_keys - base;
+		const size_t n = (left < TYPENAME_LOOKUP_BATCH) ? left :
+				TYPENAME_LOOKUP_BATCH;
+
+		if ((error = bind_typename_lookup_many(stmt, &keys[base], n))) {
+			goto fail;
+		}
+
+		while (!(error = query_step_one(stmt))) {
+			uint32_t i;
+			int64_t rowid;
+			if ((error = exec_lookup_many_typename_query(stmt, &i, &rowid))) {
+				goto fail;
+			}
+			cf_assert(i < n);
+			// first match wins, like lookup_typename()
+			if (!out[base + i].rowid) {
+				out[base + i].rowid = rowid;
+			}
+		}
+		if (error != ENOENT) {
+			goto fail;
+		}
+
+		error = 0;
+		(void)sqlite3_reset(stmt);
+	}
+
+fail:
+	sqlite3_finalize(stmt);
+	return error;
+}
+
+int
+insert_type_use(sqlite3 *db, const loc_ctx_t *loc, const db_type_use_t *entry,
+		int64_t *rowid_out)
+{
+	int error;
+	sqlite3_stmt *stmt = compile_type_use_table_insert(db);
+
+	// serialize `entry`
+	if ((error = bind_type_use_insert(stmt, loc, entry))) {
+		goto fail;
+	}
+
+	// execute query
+	error = sqlite3_step(stmt);
+	if (error != SQLITE_DONE) {
+		cf_print_err("insert-type-use query execute failed, error %d\n",
+				error);
+		goto fail;
+	}
+	error = 0;
+
+	// get back the rowid of the just-inserted row
+	const int64_t rowid = sqlite3_last_insert_rowid(db);
+	cf_assert(rowid > 0);
+	*rowid_out = rowid;
+
+fail:
+	sqlite3_finalize(stmt);
+	return error;
+}
+
+/*
+ * Add `entry->count` to the stored count of `entry`'s type, file, and kind.
+ *
+ * If `max` is set, the stored count becomes the larger of the two instead.
+ * This is for counts that might have been stored already, e.g., those of a
+ * header merged from several fragments.
+ */
+int
+insert_type_use_count(sqlite3 *db, const db_type_use_count_t *entry, bool max)
+{
+	int error;
+	sqlite3_stmt *stmt = compile_type_use_count_table_insert(db);
+
+	if ((error = bind_type_use_count_insert(stmt, entry, max))) {
+		goto fail;
+	}
+
+	error = sqlite3_step(stmt);
+	if (error != SQLITE_DONE) {
+		cf_print_err("insert-type-use-count query execute failed, "
+				"error %d\n", error);
+		goto fail;
+	}
+	error = 0;
+
+fail:
+	sqlite3_finalize(stmt);
+	return error;
+}
+
+int
+insert_member(sqlite3 *db, const loc_ctx_t *loc, const db_member_t *entry,
+		int64_t *rowid_out)
+{
+	int error;
+	sqlite3_stmt *stmt = compile_member_table_insert(db);
+
+	// serialize `entry`
+	if ((error = bind_member_insert(stmt, loc, entry))) {
+		goto fail;
+	}
+
+	// execute query
+	error = sqlite3_step(stmt);
+	if (error != SQLITE_DONE) {
+		cf_print_err("insert-member query execute failed, error %d\n",
+				error);
+		goto fail;
+	}
+	error = 0;
+
+	// get back the rowid of the just-inserted row
+	const int64_t rowid = sqlite3_last_insert_rowid(db);
+	cf_assert(rowid > 0);
+	*rowid_out = rowid;
+
+fail:
+	sqlite3_finalize(stmt);
+	return error;
+}
+
+/*
+ * Append the use counts of type `type` to `out`, ordered by file then kind.
+ */
+int
+lookup_type_use_counts(sqlite3 *db, int64_t type, use_count_vec_t *out)
+{
+	int error;
+	sqlite3_stmt *stmt = compile_type_use_count_table_lookup(db);
+
+	if ((error = bind_type_use_count_lookup(stmt, type))) {
+		goto fail;
+	}
+
+	while (!(error = query_step_one(stmt))) {
+		db_type_use_count_t entry;
+		if ((error = exec_type_use_count(stmt, &entry))) {
+			goto fail;
+		}
+		if (!use_count_vec_push(out, &entry)) {
+			error = ENOMEM;
+			goto fail;
+		}
+	}
+
+	// ENOENT just means no more rows
+	error = (error == ENOENT) ? 0 : error;
+
+fail:
+	sqlite3_finalize(stmt);
+	return error;
+}
+
+int
+lookup_type_entry(sqlite3 *db, int64_t rowid, db_type_entry_t *entry_out,
+		loc_ctx_t *loc_out)
+{
+	int error;
+	sqlite3_stmt *stmt = compile_type_table_lookup(db);
+
+	if ((error = bind_type_lookup(stmt, rowid))) {
+		goto fail;
+	}
+
+	// execute query
+	int64_t rowid_out;
+	if ((error = exec_lookup_type(stmt, &rowid_out, entry_out, loc_out))) {
+		goto fail;
+	}
+
+	cf_assert(rowid_out == rowid);
+
+fail:
+	sqlite3_finalize(stmt);
+	return error;
+}
+
+/*
+ * Look up the first member of `parent` named `member` that also passes
+ * `filter`, which may be NULL.
+ *
+ * Only `db_filter_t::file_glob` applies to members.
+ */
+int
+lookup_member(sqlite3 *db, int64_t parent, const cf_str_t *member,
+		const db_filter_t *filter, db_member_t *entry_out, loc_ctx_t *loc_out)
+{
+	int error;
+	sqlite3_stmt *stmt = compile_member_table_lookup(db);
+
+	if ((error = bind_member_lookup(stmt, parent, member, filter))) {
+		goto fail;
+	}
+
+	// execute query
+	if ((error = exec_lookup_member(stmt, entry_out, loc_out))) {
+		goto fail;
+	}
+
+fail:
+	sqlite3_finalize(stmt);
+	return error;
+}
+
+/*
+ * Create a statement that yields all `db_typename_t`s matching `name` and
+ * `filter`. `filter` may be NULL to match every entry named `name`.
+ *
+ * Filtering, ordering, and the limit are all done by sqlite. Rows that don't
+ * pass are never deserialized.
+ *
+ * A keyset cursor in `filter->after` continues an earlier search. Each order
+ * has its own statement so sqlite can seek straight to the cursor's key
+ * rather than skip over every earlier row. Return ENOENT if the cursor's row
+ * no longer exists.
+ *
+ * This function does:
+ *   check cursor
+ *   compile
+ *   bind
+ * next():
+ *   sql_step
+ * get():
+ *   deserialize
+ */
+int
+find_typenames(sqlite3 *db, const cf_str_t *name, const db_filter_t *filter,
+		sqlite3_stmt **out)
+{
+	int error;
+
+	if (filter && filter->after &&
+			(error = check_typename_cursor(db, filter->after))) {
+		return error;
+	}
+
+	const db_order_t order = filter ? filter->order : db_order_none;
+	sqlite3_stmt *stmt = compile_typename_table_find(db, order);
+
+	if ((error = bind_typename_find(stmt, name, filter))) {
+		goto fail;
+	}
+
+	*out = stmt;
+
+	return 0;
+fail:
+	sqlite3_finalize(stmt);
+	return error;
+}
+
+/*
+ * Note: invalidates any borrowed strings returned from a previous
+ * iter_get_typename() call.
+ */
+int
+iter_next_typename(sqlite3_stmt *stmt)
+{
+	return query_step_one(stmt);
+}
+
+int
+iter_get_typename(sqlite3_stmt *stmt, db_typename_t *entry_out,
+		loc_ctx_t *loc_out, int64_t *cursor_out)
+{
+	return exec_find_typename_query(stmt, entry_out, loc_out, cursor_out);
+}
+
+void
+free_typenames(sqlite3_stmt *stmt)
+{
+	sqlite3_finalize(stmt);
+}
+
+/*
+ * Create a statement that yields every file whose contents hash to `hash`.
+ *
+ * Advance it with iter_next_file_hash(). Each row is a candidate; the caller
+ * has to compare contents to rule out a collision.
+ */
+int
+find_files_by_hash(sqlite3 *db, uint64_t hash, sqlite3_stmt **out)
+{
+	int error;
+	sqlite3_stmt *stmt = compile_file_table_hash_find(db);
+
+	if ((error = bind_file_hash_find(stmt, hash))) {
+		goto fail;
+	}
+
+	*out = stmt;
+	return 0;
+fail:
+	sqlite3_finalize(stmt);
+	return error;
+}
+
+int
+iter_next_file_hash(sqlite3_stmt *stmt)
+{
+	return query_step_one(stmt);
+}
+
+/*
+ * Deserialize the current file of `stmt`. `*path_out` borrows from `stmt`.
+ */
+int
+iter_get_file_hash(sqlite3_stmt *stmt, int64_t *rowid_out, cf_str_t *path_out)
+{
+	return exec_find_file_hash(stmt, rowid_out, path_out);
+}
+
+void
+free_files_by_hash(sqlite3_stmt *stmt)
+{
+	sqlite3_finalize(stmt);
+}
+
+/*
+ * Create a statement that yields every file that was either tracked, or
+ * untracked, by version control when it was indexed.
+ *
+ * If `aliases` is true, file aliases are yielded instead. Their rowid is that
+ * of the file they refer to.
+ *
+ * Advance it with iter_next_vcs_file(). Pass the same `tracked` value to
+ * iter_get_vcs_file().
+ */
+int
+find_vcs_files(sqlite3 *db, bool tracked, bool aliases, sqlite3_stmt **out)
+{
+	*out = compile_file_table_vcs_find(db, tracked, aliases);
+	return 0;
+}
+
+int
+iter_next_vcs_file(sqlite3_stmt *stmt)
+{
+	return query_step_one(stmt);
+}
+
+/*
+ * Deserialize the current file of `stmt`.
+ *
+ * `*path_out` and `*vcs_id_out` borrow from `stmt`. `*vcs_id_out` is a null
+ * string for untracked files.
+ */
+int
+iter_get_vcs_file(sqlite3_stmt *stmt, bool tracked, int64_t *rowid_out,
+		cf_str_t *path_out, cf_str_t *vcs_id_out)
+{
+	return exec_find_vcs_file(stmt, tracked, rowid_out, path_out, vcs_id_out);
+}
+
+void
+free_vcs_files(sqlite3_stmt *stmt)
+{
+	sqlite3_finalize(stmt);
+}
+
+/*
+ * Create statements that read every row of a table for "scan.c".
+ *
+ * Each is advanced with iter_next_scan_row() and freed with
+ * free_scan_rows(). Strings returned by the iter_get_scan_*() functions
+ * borrow from the statement.
+ */
+int
+scan_files(sqlite3 *db, sqlite3_stmt **out)
+{
+	*out = compile_query_desc(db, &scan_file_query.base);
+	return 0;
+}
+
+int
+scan_typenames(sqlite3 *db, sqlite3_stmt **out)
+{
+	*out = compile_query_desc(db, &scan_typename_query.base);
+	return 0;
+}
+
+int
+scan_members(sqlite3 *db, sqlite3_stmt **out)
+{
+	*out = compile_query_desc(db, &scan_member_query.base);
+	return 0;
+}
+
+int
+iter_next_scan_row(sqlite3_stmt *stmt)
+{
+	return query_step_one(stmt);
+}
+
+int
+iter_get_scan_file(sqlite3_stmt *stmt, int64_t *rowid_out, cf_str_t *path_out)
+{
+	return exec_scan_file(stmt, rowid_out, path_out);
+}
+
+/*
+ * Deserialize a typename along with the kind of the type it names.
+ * `*type_kind_out` is 0 if the type entry is missing.
+ */
+int
+iter_get_scan_typename(sqlite3_stmt *stmt, int64_t *rowid_out,
+		db_typename_t *entry_out, type_kind_t *type_kind_out,
+		loc_ctx_t *loc_out)
+{
+	return exec_scan_typename(stmt, rowid_out, entry_out, type_kind_out,
+			loc_out);
+}
+
+int
+iter_get_scan_member(sqlite3_stmt *stmt, db_member_t *entry_out,
+		loc_ctx_t *loc_out)
+{
+	return exec_scan_member(stmt, entry_out, loc_out);
+}
+
+void
+free_scan_rows(sqlite3_stmt *stmt)
+{
+	sqlite3_finalize(stmt);
+}
+
+/*
+ * More whole-table reads, for "merge.c". These share iter_next_scan_row()
+ * and free_scan_rows() with the ones above.
+ */
+int
+scan_types(sqlite3 *db, sqlite3_stmt **out)
+{
+	*out = compile_query_desc(db, &scan_type_query.base);
+	return 0;
+}
+
+int
+scan_type_uses(sqlite3 *db, sqlite3_stmt **out)
+{
+	*out = compile_query_desc(db, &scan_type_use_query.base);
+	return 0;
+}
+
+int
+scan_type_use_counts(sqlite3 *db, sqlite3_stmt **out)
+{
+	*out = compile_query_desc(db, &scan_type_use_count_query.base);
+	return 0;
+}
+
+int
+scan_tu_deps(sqlite3 *db, sqlite3_stmt **out)
+{
+	*out = compile_query_desc(db, &scan_tu_dep_query.base);
+	return 0;
+}
+
+int
+scan_file_aliases(sqlite3 *db, sqlite3_stmt **out)
+{
+	*out = compile_query_desc(db, &scan_file_alias_query.base);
+	return 0;
+}
+
+int
+scan_snippets(sqlite3 *db, sqlite3_stmt **out)
+{
+	*out = compile_query_desc(db, &scan_snippet_query.base);
+	return 0;
+}
+
+int
+iter_get_scan_type(sqlite3_stmt *stmt, int64_t *rowid_out,
+		db_type_entry_t *entry_out, loc_ctx_t *loc_out)
+{
+	return exec_scan_type(stmt, rowid_out, entry_out, loc_out);
+}
+
+int
+iter_get_scan_type_use(sqlite3_stmt *stmt, db_type_use_t *entry_out,
+		loc_ctx_t *loc_out)
+{
+	return exec_scan_type_use(stmt, entry_out, loc_out);
+}
+
+int
+iter_get_scan_type_use_count(sqlite3_stmt *stmt, db_type_use_count_t *out)
+{
+	return exec_type_use_count(stmt, out);
+}
+
+int
+iter_get_scan_tu_dep(sqlite3_stmt *stmt, int64_t *tu_out, int64_t *file_out)
+{
+	return exec_scan_two_ids(stmt, tu_out, file_out);
+}
+
+/*
+ * `*file_out` is the rowid of the file `*path_out` duplicates.
+ */
+int
+iter_get_scan_file_alias(sqlite3_stmt *stmt, int64_t *file_out,
+		cf_str_t *path_out)
+{
+	return exec_scan_file_alias(stmt, file_out, path_out);
+}
+
+/*
+ * `*out` is the decoded block of file `*file_out`. Free it with
+ * snippet_block_free().
+ */
+int
+iter_get_scan_snippets(sqlite3_stmt *stmt, int64_t *file_out,
+		snippet_block_t *out)
+{
+	return exec_scan_snippet(stmt, file_out, out);
+}
+
+/*
+ * Begin a transaction.
+ *
+ * Follow with a call to end_transaction().
+ */
+int
+begin_transaction(sqlite3 *db)
+{
+	return exec_simple_query(db, compile_query(db, "BEGIN;"));
+}
+
+/*
+ * Either commit or roll back the current transaction.
+ */
+int
+end_transaction(sqlite3 *db, bool commit)
+{
+	if (commit) {
+		return exec_simple_query(db, compile_query(db, "COMMIT;"));
+	}
+	return exec_simple_query(db, compile_query(db, "ROLLBACK;"));
+}
+
+/*
+ * Create an empty temporary table of changed files.
+ *
+ * Populate it with mark_file_changed(). It's used as input to
+ * find_clean_tus() and purge_changed_files(). It isn't persisted; sqlite
+ * drops it when `db` is closed.
+ */
+int
+reset_changed_files(sqlite3 *db)
+{
+	int error;
+
+	if ((error = exec_simple_query(db, compile_query(db,
+			"CREATE TEMP TABLE IF NOT EXISTS vcs_changed "
+			"(id INTEGER PRIMARY KEY);")))) {
+		return error;
+	}
+
+	// note: compiled separately; the table must exist first
+	return exec_simple_query(db, compile_query(db,
+			"DELETE FROM temp.vcs_changed;"));
+}
+
+/*
+ * Add file `rowid` to the changed file table.
+ */
+int
+mark_file_changed(sqlite3 *db, int64_t rowid)
+{
+	int error;
+	sqlite3_stmt *stmt = compile_vcs_changed_insert(db);
+
+	if ((error = bind_vcs_changed_insert(stmt, rowid))) {
+		sqlite3_finalize(stmt);
+		return error;
+	}
+
+	return exec_simple_query(db, stmt);
+}
+
+/*
+ * Insert the main file of every TU that doesn't depend on a changed file into
+ * `out`.
+ *
+ * Keys are file rowids. Values are unused.
+ */
+int
+find_clean_tus(sqlite3 *db, cf_map8_t *out)
+{
+	int error;
+	sqlite3_stmt *stmt = compile_tu_dep_table_clean_find(db);
+
+	const size_t num_outputs = tu_dep_clean_find_query.num_outputs;
+	column_val_t column_vals[num_outputs];
+	const serial_row_t srow = {
+		.num_columns = num_outputs,
+		.column_kinds = tu_dep_clean_find_query.output_kinds,
+		.column_values = column_vals,
+	};
+
+	while (!(error = query_step_one(stmt))) {
+		if ((error = select_serial_row(stmt, &srow))) {
+			goto fail;
+		}
+
+		cf_map_entry_t *entry = cf_map8_reserve(out);
+		if (!entry) {
+			error = ENOMEM;
+			goto fail;
+		}
+		entry->key = column_vals[0].uint64_val;
+		entry->value = 0;
+		cf_map8_commit(out, entry);
+	}
+
+	// ENOENT just means no more rows
+	error = (error == ENOENT) ? 0 : error;
+
+fail:
+	sqlite3_finalize(stmt);
+	return error;
+}
+
+/*
+ * Delete every entry that comes from a changed file.
+ *
+ * Steps:
+ * - delete types located in changed files, and every type that references
+ *   one of them (see purge_dependent_types())
+ *   A referencing type is in a TU that depends on the changed file, so it's
+ *   recreated when that TU is reindexed.
+ * - delete rows located in changed files from each table
+ * - delete all dependencies of TUs that depend on a changed file
+ *   They're recreated when the TU is reindexed.
+ * - delete aliases of changed files
+ *   Their contents might not match anymore.
+ * - clear the version control id of each changed file
+ *   It's set again when the file is reindexed.
+ */
+int
+purge_changed_files(sqlite3 *db)
+{
+#define CHANGED_FILES "(SELECT id FROM temp.vcs_changed)"
+	int error;
+
+	if ((error = reset_purged_types(db))) {
+		return error;
+	}
+	if ((error = exec_simple_query(db, compile_query(db,
+			"INSERT INTO temp.purged_type SELECT typeid FROM "
+			TYPE_TABLE_NAME " WHERE file IN " CHANGED_FILES ";")))) {
+		return error;
+	}
+	if ((error = purge_dependent_types(db))) {
+		return error;
+	}
+
+	sqlite3_stmt *const purge_stmts[] = {
+		compile_query(db, "DELETE FROM " TYPENAME_TABLE_NAME
+				" WHERE file IN " CHANGED_FILES ";"),
+		compile_query(db, "DELETE FROM " TYPE_TABLE_NAME
+				" WHERE file IN " CHANGED_FILES ";"),
+		compile_query(db, "DELETE FROM " INCOMPLETE_TYPE_TABLE_NAME
+				" WHERE file IN " CHANGED_FILES ";"),
+		compile_query(db, "DELETE FROM " TYPE_USE_TABLE_NAME
+				" WHERE file IN " CHANGED_FILES ";"),
+		compile_query(db, "DELETE FROM " TYPE_USE_COUNT_TABLE_NAME
+				" WHERE file IN " CHANGED_FILES ";"),
+		compile_query(db, "DELETE FROM " MEMBER_TABLE_NAME
+				" WHERE file IN " CHANGED_FILES ";"),
+		compile_query(db, "DELETE FROM " SNIPPET_TABLE_NAME
+				" WHERE file IN " CHANGED_FILES ";"),
+		compile_query(db, "DELETE FROM " TU_DEP_TABLE_NAME
+				" WHERE tu IN (SELECT tu FROM " TU_DEP_TABLE_NAME
+				" WHERE file IN " CHANGED_FILES ");"),
+		compile_query(db, "DELETE FROM " FILE_ALIAS_TABLE_NAME
+				" WHERE file IN " CHANGED_FILES ";"),
+		compile_query(db, "UPDATE " FILE_TABLE_NAME
+				" SET vcs_id = NULL WHERE id IN " CHANGED_FILES ";"),
+	};
+#undef CHANGED_FILES
+
+	// execute each statement, stopping at the first error
+	error = 0;
+	for (unsigned i = 0; i < ARRAY_LEN(purge_stmts); ++i) {
+		if (error) {
+			sqlite3_finalize(purge_stmts[i]);
+			continue;
+		}
+		if ((error = exec_simple_query(db, purge_stmts[i]))) {
+			cf_print_err("cannot purge changed files, statement %u\n", i);
+		}
+	}
+
+	return error;
+}
+
+/*
+ * Create an empty temporary table of types to purge.
+ *
+ * Fill it with the types located in the files being purged, then call
+ * purge_dependent_types(). Like `temp.vcs_changed`, it isn't persisted.
+ */
+static int
+reset_purged_types(sqlite3 *db)
+{
+	int error;
+
+	if ((error = exec_simple_query(db, compile_query(db,
+			"CREATE TEMP TABLE IF NOT EXISTS purged_type "
+			"(typeid INTEGER PRIMARY KEY);")))) {
+		return error;
+	}
+
+	// note: compiled separately; the table must exist first
+	return exec_simple_query(db, compile_query(db,
+			"DELETE FROM temp.purged_type;"));
+}
+
+/*
+ * Delete every type in `temp.purged_type` along with everything that
+ * references it.
+ *
+ * A type with a member of a purged type is purged too, even if its own file
+ * is unchanged. Otherwise the member would be left referencing a deleted
+ * type, and reindexing wouldn't fix it: the referencing type still exists, so
+ * it's not new, so its members aren't inserted again. Deleting it makes it
+ * new. Deleting a type this way can make more types dangle; repeat until none
+ * are added.
+ *
+ * Steps:
+ * - add the parent of every member whose type is purged, until none are new
+ * - subtract the member type uses of purged types from `type_use_count`
+ *   Each member of an indexable type is counted as one `type_use_decl` at
+ *   the member's location. They're counted again when the type is reinserted.
+ * - delete the type uses at members of purged types, and uses of purged types
+ * - delete members, typenames, and incomplete types of purged types
+ * - delete the purged types
+ * - delete use counts of purged types, and counts left at zero
+ */
+static int
+purge_dependent_types(sqlite3 *db)
+{
+	int error;
+
+	// note: "INSERT OR IGNORE" only counts new rows as changes
+	do {
+		if ((error = exec_simple_query(db, compile_query(db,
+				"INSERT OR IGNORE INTO temp.purged_type"
+				" SELECT parent FROM " MEMBER_TABLE_NAME
+				" WHERE base_type IN temp.purged_type;")))) {
+			return error;
+		}
+	} while (sqlite3_changes(db));
+
+	sqlite3_stmt *const purge_stmts[] = {
+		compile_query(db, "UPDATE " TYPE_USE_COUNT_TABLE_NAME
+				" SET count = count - m.n"
+				" FROM (SELECT base_type, file, COUNT(*) AS n"
+				" FROM " MEMBER_TABLE_NAME
+				" WHERE parent IN temp.purged_type"
+				" GROUP BY base_type, file) AS m"
+				" WHERE " TYPE_USE_COUNT_TABLE_NAME ".kind == ?1"
+				" AND " TYPE_USE_COUNT_TABLE_NAME ".base_type == m.base_type"
+				" AND " TYPE_USE_COUNT_TABLE_NAME ".file == m.file;"),
+		compile_query(db, "DELETE FROM " TYPE_USE_TABLE_NAME
+				" WHERE rowid IN (SELECT u.rowid"
+				" FROM " MEMBER_TABLE_NAME " AS m"
+				" JOIN " TYPE_USE_TABLE_NAME " AS u"
+				" ON (u.file == m.file AND u.line == m.line"
+				" AND u.column == m.column)"
+				" WHERE m.parent IN temp.purged_type)"
+				" OR base_type IN temp.purged_type;"),
+		compile_query(db, "DELETE FROM " MEMBER_TABLE_NAME
+				" WHERE parent IN temp.purged_type"
+				" OR base_type IN temp.purged_type;"),
+		compile_query(db, "DELETE FROM " TYPENAME_TABLE_NAME
+				" WHERE base_type IN temp.purged_type;"),
+		compile_query(db, "DELETE FROM " INCOMPLETE_TYPE_TABLE_NAME
+				" WHERE base_type IN temp.purged_type;"),
+		compile_query(db, "DELETE FROM " TYPE_TABLE_NAME
+				" WHERE typeid IN temp.purged_type;"),
+		compile_query(db, "DELETE FROM " TYPE_USE_COUNT_TABLE_NAME
+				" WHERE base_type IN temp.purged_type OR count <= 0;"),
+	};
+
+	// execute each statement, stopping at the first error
+	error = sqlite3_bind_int(purge_stmts[0], 1, type_use_decl);
+	for (unsigned i = 0; i < ARRAY_LEN(purge_stmts); ++i) {
+		if (error) {
+			sqlite3_finalize(purge_stmts[i]);
+			continue;
+		}
+		if ((error = exec_simple_query(db, purge_stmts[i]))) {
+			cf_print_err("cannot purge dependent types, statement %u\n", i);
+		}
+	}
+
+	return error;
+}
+
+/*
+ * Execute a file lookup query that has been previously prepared in `stmt`.
+ *
+ * On success, the rowid of the single matching entry is written to
+ * `*rowid_out`.
+ */
+static int
+exec_lookup_file_query(sqlite3_stmt *stmt, int64_t *rowid_out)
+{
+	int error;
+
+	const size_t num_outputs = file_lookup_query.num_outputs;
+	column_val_t column_vals[num_outputs];
+
+	if ((error = lookup_one_row(stmt, &file_lookup_query, column_vals))) {
+		goto fail;
+	}
+
+	*rowid_out = (int64_t)column_vals[0].uint64_val;
+
+fail:
+	return error;
+}
+
+/*
+ * Do a lookup in the file alias table according to `stmt`.
+ */
+static int
+exec_lookup_file_alias_query(sqlite3_stmt *stmt, int64_t *rowid_out)
+{
+	int error;
+
+	const size_t num_outputs = file_alias_lookup_query.num_outputs;
+	column_val_t column_vals[num_outputs];
+
+	if ((error = lookup_one_row(stmt, &file_alias_lookup_query,
+			column_vals))) {
+		goto fail;
+	}
+
+	*rowid_out = (int64_t)column_vals[0].uint64_val;
+
+fail:
+	return error;
+}
+
+/*
+ * Do a lookup in the file table according to `stmt`.
+ *
+ * On success, `path_out` is set to an *owned* string of the file path.
+ */
+static int
+exec_file_id_lookup_query(sqlite3_stmt *stmt, cf_str_t *path_out)
+{
+	int error;
+
+	const size_t num_outputs = file_id_lookup_query.num_outputs;
+	column_val_t column_vals[num_outputs];
+
+	if ((error = lookup_one_row(stmt, &file_id_lookup_query, column_vals))) {
+		goto fail;
+	}
+
+	cf_str_dup_str(&column_vals[0].str_val, path_out);
+
+fail:
+	return error;
+
+}
+
+/*
+ * Do a lookup (select one row) in the typename table.
+ */
+static int
+exec_lookup_typename_query(sqlite3_stmt *stmt, int64_t *rowid_out,
+		typename_kind_t *kind_out)
+{
+	int error;
+
+	const size_t num_outputs = typename_lookup_query.num_outputs;
+	column_val_t column_vals[num_outputs];
+
+	if ((error = lookup_one_row(stmt, &typename_lookup_query, column_vals))) {
+		goto fail;
+	}
+
+	*rowid_out = column_vals[0].uint64_val;
+	*kind_out = column_vals[1].uint32_val;
+
+fail:
+	return error;
+}
+
+/*
+ * Read one (key index, base_type) row of a batched typename lookup.
+ */
+static int
+exec_lookup_many_typename_query(sqlite3_stmt *stmt, uint32_t *key_out,
+		int64_t *rowid_out)
+{
+	int error;
+
+	const size_t num_outputs = typename_lookup_many_query.num_outputs;
+	column_val_t column_vals[num_outputs];
+
+	const serial_row_t srow = {
+		.num_columns = num_outputs,
+		.column_kinds = typename_lookup_many_query.output_kinds,
+		.column_values = column_vals,
+	};
+
+	if ((error = select_serial_row(stmt, &srow))) {
+		goto fail;
+	}
+
+	*key_out = column_vals[0].uint32_val;
+	*rowid_out = (int64_t)column_vals[1].uint64_val;
+
+fail:
+	return error;
+}
+
+/*
+ * Check that keyset cursor `cursor` still names a typename row.
+ *
+ * A cursor whose row was removed, e.g., by a reindex, can't be placed in
+ * any order. Rather than silently restart from the first result, fail.
+ */
+static int
+check_typename_cursor(sqlite3 *db, int64_t cursor)
+{
+	int error;
+	sqlite3_stmt *stmt = compile_typename_table_cursor(db);
+
+	const size_t num_outputs = typename_cursor_query.num_outputs;
+	column_val_t column_vals[num_outputs];
+	column_vals[0].uint64_val = (uint64_t)cursor;
+
+	const serial_row_t row = {
+		.num_columns = typename_cursor_query.base.num_columns,
+		.column_kinds = typename_cursor_query.base.column_kinds,
+		.column_values = column_vals,
+	};
+
+	if ((error = bind_serial_row(stmt, &row))) {
+		goto fail;
+	}
+	if ((error = lookup_one_row(stmt, &typename_cursor_query, column_vals))) {
+		goto fail;
+	}
+
+fail:
+	sqlite3_finalize(stmt);
+	return error;
+}
+
+/*
+ * Do a find (select many rows) in the typename table.
+ *
+ * `*cursor_out` is the row's keyset cursor, i.e., its rowid.
+ */
+static int
+exec_find_typename_query(sqlite3_stmt *stmt, db_typename_t *entry_out,
+		loc_ctx_t *loc_out, int64_t *cursor_out)
+{
+	int error;
+
+	const size_t num_outputs = typename_find_query.num_outputs;
+	column_val_t column_vals[num_outputs];
+
+	const serial_row_t srow = {
+		.num_columns = typename_find_query.num_outputs,
+		.column_kinds = typename_find_query.output_kinds,
+		.column_values = column_vals,
+	};
+
+	if ((error = select_serial_row(stmt, &srow))) {
+		goto fail;
+	}
+
+	// note: schema differs from struct member order
+	memset(entry_out, 0, sizeof(*entry_out));
+	cf_str_borrow_str(&column_vals[0].str_val, &entry_out->name);
+	entry_out->kind = column_vals[1].uint32_val;
+	entry_out->base_type.rowid = column_vals[2].uint64_val;
+
+	*loc_out = (loc_ctx_t) {
+		.file = {
+			.rowid = column_vals[3].uint64_val,
+		},
+		.func = {
+			.rowid = column_vals[4].uint64_val,
+		},
+		.scope = column_vals[5].uint32_val,
+		.line = column_vals[6].uint32_val,
+		.column = column_vals[7].uint32_val,
+	};
+	*cursor_out = (int64_t)column_vals[8].uint64_val;
+
+	// strings should be borrowed from `stmt`
+	cf_assert(column_vals[0].str_val.len & CF_STR_BORROWED);
+
+fail:
+	return error;
+}
+
+static int
+exec_lookup_type(sqlite3_stmt *stmt, int64_t *rowid_out,
+		db_type_entry_t *entry_out, loc_ctx_t *loc_out)
+{
+	int error;
+
+	const size_t num_outputs = type_lookup_query.num_outputs;
+	column_val_t column_vals[num_outputs];
+
+	if ((error = lookup_one_row(stmt, &type_lookup_query, column_vals))) {
+		goto fail;
+	}
+
+	// deserialize from `column_vals` into output parameters
+
+	*rowid_out = column_vals[0].uint64_val;
+
+	*entry_out = (db_type_entry_t) {
+		.kind = column_vals[1].uint32_val,
+		.complete = column_vals[2].uint32_val,
+	};
+
+	*loc_out = (loc_ctx_t) {
+		.file = {
+			.rowid = column_vals[3].uint64_val,
+		},
+		.func = {
+			.rowid = column_vals[4].uint64_val,
+		},
+		.scope = column_vals[5].uint32_val,
+		.line = column_vals[6].uint32_val,
+		.column = column_vals[7].uint32_val,
+	};
 
 fail:
 	return error;
-
 }
 
 /*
- * Do a lookup (select one row) in the typename table.
  */
 static int
-exec_lookup_typename_query(sqlite3_stmt *stmt, int64_t *rowid_out,
-		typename_kind_t *kind_out)
+exec_lookup_member(sqlite3_stmt *stmt, db_member_t *entry_out,
+		loc_ctx_t *loc_out)
 {
 	int error;
 
-	const size_t num_outputs = typename_lookup_query.num_outputs;
+	const size_t num_outputs = member_lookup_query.num_outputs;
 	column_val_t column_vals[num_outputs];
 
-	if ((error = lookup_one_row(stmt, &typename_lookup_query, column_vals))) {
+	if ((error = lookup_one_row(stmt, &member_lookup_query, column_vals))) {
 		goto fail;
 	}
 
-	*rowid_out = column_vals[0].uint64_val;
-	*kind_out = column_vals[1].uint32_val;
+	// deserialize from `column_vals` into output parameters
+
+	*entry_out = (db_member_t) {
+		.parent = {
+			.rowid = column_vals[0].uint64_val
+		},
+		.base_type = {
+			.rowid = column_vals[1].uint64_val
+		},
+	};
+	cf_str_dup_str(&column_vals[2].str_val, &entry_out->name);
+
+	*loc_out = (loc_ctx_t) {
+		.file = {
+			.rowid = column_vals[3].uint64_val,
+		},
+		.func = {
+			.rowid = 0,
+		},
+		.scope = 0,
+		.line = column_vals[4].uint32_val,
+		.column = column_vals[5].uint32_val,
+	};
 
 fail:
 	return error;
 }
 
 /*
- * Do a find (select many rows) in the typename table.
+ * Deserialize the current row of a file iterator from find_files_by_hash().
  */
 static int
-exec_find_typename_query(sqlite3_stmt *stmt, db_typename_t *entry_out,
+exec_find_file_hash(sqlite3_stmt *stmt, int64_t *rowid_out, cf_str_t *path_out)
+{
+	int error;
+
+	const size_t num_outputs = file_hash_find_query.num_outputs;
+	column_val_t column_vals[num_outputs];
+
+	const serial_row_t srow = {
+		.num_columns = num_outputs,
+		.column_kinds = file_hash_find_query.output_kinds,
+		.column_values = column_vals,
+	};
+
+	if ((error = select_serial_row(stmt, &srow))) {
+		goto fail;
+	}
+
+	*rowid_out = (int64_t)column_vals[0].uint64_val;
+	cf_str_borrow_str(&column_vals[1].str_val, path_out);
+
+fail:
+	return error;
+}
+
+static int
+exec_scan_file(sqlite3_stmt *stmt, int64_t *rowid_out, cf_str_t *path_out)
+{
+	int error;
+
+	const size_t num_outputs = scan_file_query.num_outputs;
+	column_val_t column_vals[num_outputs];
+
+	const serial_row_t srow = {
+		.num_columns = num_outputs,
+		.column_kinds = scan_file_query.output_kinds,
+		.column_values = column_vals,
+	};
+
+	if ((error = select_serial_row(stmt, &srow))) {
+		goto fail;
+	}
+
+	*rowid_out = (int64_t)column_vals[0].uint64_val;
+	cf_str_borrow_str(&column_vals[1].str_val, path_out);
+
+fail:
+	return error;
+}
+
+static int
+exec_scan_typename(sqlite3_stmt *stmt, int64_t *rowid_out,
+		db_typename_t *entry_out, type_kind_t *type_kind_out,
 		loc_ctx_t *loc_out)
 {
 	int error;
 
-	const size_t num_outputs = typename_find_query.num_outputs;
+	const size_t num_outputs = scan_typename_query.num_outputs;
 	column_val_t column_vals[num_outputs];
 
 	const serial_row_t srow = {
-		.num_columns = typename_find_query.num_outputs,
-		.column_kinds = typename_find_query.output_kinds,
+		.num_columns = num_outputs,
+		.column_kinds = scan_typename_query.output_kinds,
 		.column_values = column_vals,
 	};
 
@@ -727,109 +2200,309 @@ exec_find_typename_query(sqlite3_stmt *stmt, db_typename_t *entry_out,
 		goto fail;
 	}
 
-	// note: schema differs from struct member order
 	memset(entry_out, 0, sizeof(*entry_out));
 	cf_str_borrow_str(&column_vals[0].str_val, &entry_out->name);
 	entry_out->kind = column_vals[1].uint32_val;
-	entry_out->base_type.rowid = column_vals[2].uint64_val;
+	*type_kind_out = column_vals[2].uint32_val;
+	entry_out->base_type.rowid = column_vals[3].uint64_val;
+
+	*loc_out = (loc_ctx_t) {
+		.file = {
+			.rowid = column_vals[4].uint64_val,
+		},
+		.scope = column_vals[8].uint32_val,
+		.line = column_vals[5].uint32_val,
+		.column = column_vals[6].uint32_val,
+	};
+	*rowid_out = (int64_t)column_vals[7].uint64_val;
+
+fail:
+	return error;
+}
+
+static int
+exec_scan_member(sqlite3_stmt *stmt, db_member_t *entry_out,
+		loc_ctx_t *loc_out)
+{
+	int error;
+
+	const size_t num_outputs = scan_member_query.num_outputs;
+	column_val_t column_vals[num_outputs];
+
+	const serial_row_t srow = {
+		.num_columns = num_outputs,
+		.column_kinds = scan_member_query.output_kinds,
+		.column_values = column_vals,
+	};
+
+	if ((error = select_serial_row(stmt, &srow))) {
+		goto fail;
+	}
+
+	*entry_out = (db_member_t) {
+		.parent = {
+			.rowid = column_vals[0].uint64_val
+		},
+		.base_type = {
+			.rowid = column_vals[1].uint64_val
+		},
+	};
+	cf_str_borrow_str(&column_vals[2].str_val, &entry_out->name);
 
 	*loc_out = (loc_ctx_t) {
 		.file = {
 			.rowid = column_vals[3].uint64_val,
 		},
-		.func = {
-			.rowid = column_vals[4].uint64_val,
+		.line = column_vals[4].uint32_val,
+		.column = column_vals[5].uint32_val,
+	};
+
+fail:
+	return error;
+}
+
+static int
+exec_scan_type(sqlite3_stmt *stmt, int64_t *rowid_out,
+		db_type_entry_t *entry_out, loc_ctx_t *loc_out)
+{
+	int error;
+
+	const size_t num_outputs = scan_type_query.num_outputs;
+	column_val_t column_vals[num_outputs];
+
+	const serial_row_t srow = {
+		.num_columns = num_outputs,
+		.column_kinds = scan_type_query.output_kinds,
+		.column_values = column_vals,
+	};
+
+	if ((error = select_serial_row(stmt, &srow))) {
+		goto fail;
+	}
+
+	*rowid_out = (int64_t)column_vals[0].uint64_val;
+	*entry_out = (db_type_entry_t) {
+		.kind = column_vals[1].uint32_val,
+		.complete = column_vals[2].uint32_val,
+	};
+
+	*loc_out = (loc_ctx_t) {
+		.file = {
+			.rowid = column_vals[3].uint64_val,
 		},
-		.scope = column_vals[5].uint32_val,
-		.line = column_vals[6].uint32_val,
-		.column = column_vals[7].uint32_val,
+		.line = column_vals[4].uint32_val,
+		.column = column_vals[5].uint32_val,
+	};
+
+fail:
+	return error;
+}
+
+static int
+exec_scan_type_use(sqlite3_stmt *stmt, db_type_use_t *entry_out,
+		loc_ctx_t *loc_out)
+{
+	int error;
+
+	const size_t num_outputs = scan_type_use_query.num_outputs;
+	column_val_t column_vals[num_outputs];
+
+	const serial_row_t srow = {
+		.num_columns = num_outputs,
+		.column_kinds = scan_type_use_query.output_kinds,
+		.column_values = column_vals,
+	};
+
+	if ((error = select_serial_row(stmt, &srow))) {
+		goto fail;
+	}
+
+	*entry_out = (db_type_use_t) {
+		.base_type = {
+			.rowid = column_vals[0].uint64_val
+		},
+		.kind = column_vals[1].uint32_val,
+	};
+
+	*loc_out = (loc_ctx_t) {
+		.file = {
+			.rowid = column_vals[2].uint64_val,
+		},
+		.line = column_vals[3].uint32_val,
+		.column = column_vals[4].uint32_val,
+	};
+
+fail:
+	return error;
+}
+
+/*
+ * Read the current row of a type use count lookup or scan into `out`. Both
+ * select the same columns.
+ */
+static int
+exec_type_use_count(sqlite3_stmt *stmt, db_type_use_count_t *out)
+{
+	int error;
+
+	_Static_assert(TYPE_USE_COUNT_NUM_COLUMNS == 4, "keep columns synced");
+	const size_t num_outputs = type_use_count_lookup_query.num_outputs;
+	column_val_t column_vals[num_outputs];
+
+	const serial_row_t srow = {
+		.num_columns = num_outputs,
+		.column_kinds = type_use_count_lookup_query.output_kinds,
+		.column_values = column_vals,
+	};
+
+	if ((error = select_serial_row(stmt, &srow))) {
+		goto fail;
+	}
+
+	*out = (db_type_use_count_t) {
+		.base_type = {
+			.rowid = (int64_t)column_vals[0].uint64_val,
+		},
+		.file = {
+			.rowid = (int64_t)column_vals[1].uint64_val,
+		},
+		.kind = (type_use_kind_t)column_vals[2].uint32_val,
+		.count = column_vals[3].uint64_val,
 	};
 
-	// strings should be borrowed from `stmt`
-	cf_assert(column_vals[0].str_val.len & CF_STR_BORROWED);
+fail:
+	return error;
+}
+
+static int
+exec_scan_two_ids(sqlite3_stmt *stmt, int64_t *first_out, int64_t *second_out)
+{
+	int error;
+
+	const size_t num_outputs = scan_tu_dep_query.num_outputs;
+	column_val_t column_vals[num_outputs];
+
+	const serial_row_t srow = {
+		.num_columns = num_outputs,
+		.column_kinds = scan_tu_dep_query.output_kinds,
+		.column_values = column_vals,
+	};
+
+	if ((error = select_serial_row(stmt, &srow))) {
+		goto fail;
+	}
+
+	*first_out = (int64_t)column_vals[0].uint64_val;
+	*second_out = (int64_t)column_vals[1].uint64_val;
 
 fail:
 	return error;
 }
 
 static int
-exec_lookup_type(sqlite3_stmt *stmt, int64_t *rowid_out,
-		db_type_entry_t *entry_out, loc_ctx_t *loc_out)
+exec_scan_snippet(sqlite3_stmt *stmt, int64_t *file_out, snippet_block_t *out)
 {
 	int error;
 
-	const size_t num_outputs = type_lookup_query.num_outputs;
+	const size_t num_outputs = scan_snippet_query.num_outputs;
 	column_val_t column_vals[num_outputs];
 
-	if ((error = lookup_one_row(stmt, &type_lookup_query, column_vals))) {
+	const serial_row_t srow = {
+		.num_columns = num_outputs,
+		.column_kinds = scan_snippet_query.output_kinds,
+		.column_values = column_vals,
+	};
+
+	if ((error = select_serial_row(stmt, &srow))) {
 		goto fail;
 	}
 
-	// deserialize from `column_vals` into output parameters
+	*file_out = (int64_t)column_vals[0].uint64_val;
+	error = snippet_decode(column_vals[1].blob_val.data,
+			column_vals[1].blob_val.len, out);
 
-	*rowid_out = column_vals[0].uint64_val;
+fail:
+	return error;
+}
 
-	*entry_out = (db_type_entry_t) {
-		.kind = column_vals[1].uint32_val,
-		.complete = column_vals[2].uint32_val,
-	};
+static int
+exec_scan_file_alias(sqlite3_stmt *stmt, int64_t *file_out,
+		cf_str_t *path_out)
+{
+	int error;
 
-	*loc_out = (loc_ctx_t) {
-		.file = {
-			.rowid = column_vals[3].uint64_val,
-		},
-		.func = {
-			.rowid = column_vals[4].uint64_val,
-		},
-		.scope = column_vals[5].uint32_val,
-		.line = column_vals[6].uint32_val,
-		.column = column_vals[7].uint32_val,
+	const size_t num_outputs = scan_file_alias_query.num_outputs;
+	column_val_t column_vals[num_outputs];
+
+	const serial_row_t srow = {
+		.num_columns = num_outputs,
+		.column_kinds = scan_file_alias_query.output_kinds,
+		.column_values = column_vals,
 	};
 
+	if ((error = select_serial_row(stmt, &srow))) {
+		goto fail;
+	}
+
+	*file_out = (int64_t)column_vals[0].uint64_val;
+	cf_str_borrow_str(&column_vals[1].str_val, path_out);
+
 fail:
 	return error;
 }
 
 /*
+ * Deserialize the current row of a file iterator from find_vcs_files().
+ *
+ * Note: alias iterators have the same output columns as file iterators.
  */
 static int
-exec_lookup_member(sqlite3_stmt *stmt, db_member_t *entry_out,
-		loc_ctx_t *loc_out)
+exec_find_vcs_file(sqlite3_stmt *stmt, bool tracked, int64_t *rowid_out,
+		cf_str_t *path_out, cf_str_t *vcs_id_out)
 {
 	int error;
 
-	const size_t num_outputs = member_lookup_query.num_outputs;
-	column_val_t column_vals[num_outputs];
+	const lookup_desc_t *const desc = tracked ?
+			&file_tracked_find_query : &file_untracked_find_query;
+	column_val_t column_vals[desc->num_outputs];
 
-	if ((error = lookup_one_row(stmt, &member_lookup_query, column_vals))) {
+	const serial_row_t srow = {
+		.num_columns = desc->num_outputs,
+		.column_kinds = desc->output_kinds,
+		.column_values = column_vals,
+	};
+
+	if ((error = select_serial_row(stmt, &srow))) {
 		goto fail;
 	}
 
-	// deserialize from `column_vals` into output parameters
+	*rowid_out = (int64_t)column_vals[0].uint64_val;
+	cf_str_borrow_str(&column_vals[1].str_val, path_out);
+	if (tracked) {
+		cf_str_borrow_str(&column_vals[2].str_val, vcs_id_out);
+	} else {
+		cf_str_null(vcs_id_out);
+	}
 
-	*entry_out = (db_member_t) {
-		.parent = {
-			.rowid = column_vals[0].uint64_val
-		},
-		.base_type = {
-			.rowid = column_vals[1].uint64_val
-		},
-	};
-	cf_str_dup_str(&column_vals[2].str_val, &entry_out->name);
+fail:
+	return error;
+}
 
-	*loc_out = (loc_ctx_t) {
-		.file = {
-			.rowid = column_vals[3].uint64_val,
-		},
-		.func = {
-			.rowid = 0,
-		},
-		.scope = 0,
-		.line = column_vals[4].uint32_val,
-		.column = column_vals[5].uint32_val,
-	};
+/*
+ * Execute `stmt` that doesn't return any rows, then finalize it.
+ */
+static int
+exec_simple_query(sqlite3 *db, sqlite3_stmt *stmt)
+{
+	int error = sqlite3_step(stmt);
+	if (error != SQLITE_DONE) {
+		cf_print_err("query execute failed, error %d/'%s'\n",
+				error, sqlite3_errmsg(db));
+	} else {
+		error = 0;
+	}
 
-fail:
+	sqlite3_finalize(stmt);
 	return error;
 }
 
@@ -915,19 +2588,235 @@ query_step_one(sqlite3_stmt *stmt)
  *
  * type    |SQL         |arg
  * --------|------------|------
- * string   path         path, len
+ * string   path         path, len
+ */
+static int
+bind_file_lookup(sqlite3_stmt *stmt, const char *path, size_t len)
+{
+	const size_t num_columns = file_lookup_query.base.num_columns;
+
+	column_val_t vals[num_columns];
+	cf_str_borrow(path, len, &vals[0].str_val);
+
+	const serial_row_t row = {
+		.num_columns = num_columns,
+		.column_kinds = file_lookup_query.base.column_kinds,
+		.column_values = vals,
+	};
+
+	return bind_serial_row(stmt, &row);
+}
+
+/*
+ * Serialize `rowid` into a sql query for a lookup by ID the file table.
+ *
+ * A table describing the mapping from sql columns to arguments, as the sql
+ * type:
+ *
+ * type    |SQL         |arg
+ * --------|------------|------
+ * int64    id           rowid
+ */
+static int
+bind_file_id_lookup(sqlite3_stmt *stmt, int64_t rowid)
+{
+	const size_t num_columns = file_id_lookup_query.base.num_columns;
+
+	column_val_t vals[num_columns];
+	vals[0].uint64_val = rowid;
+
+	const serial_row_t row = {
+		.num_columns = num_columns,
+		.column_kinds = file_id_lookup_query.base.column_kinds,
+		.column_values = vals,
+	};
+
+	return bind_serial_row(stmt, &row);
+}
+
+/*
+ * Serialize `path` into a sql query for insertion into the file table.
+ *
+ * A table describing the mapping from sql columns to arguments, as the sql
+ * type:
+ *
+ * type    |SQL         |arg
+ * --------|------------|------
+ * null     id           NULL
+ * string   path         path, len
+ * string   vcs_id       vcs_id (NULL if `vcs_id` is NULL)
+ * int64    hash         hash
+ */
+static int
+bind_file_insert(sqlite3_stmt *stmt, const char *path, size_t len,
+		const cf_str_t *vcs_id, uint64_t hash)
+{
+	const size_t num_columns = file_insert_query.num_columns;
+
+	column_kind_t kinds[num_columns];
+	memcpy(kinds, file_insert_query.column_kinds, sizeof(kinds));
+
+	column_val_t vals[num_columns];
+	vals[0].null_val = true;
+	cf_str_borrow(path, len, &vals[1].str_val);
+	if (vcs_id) {
+		cf_str_borrow_str(vcs_id, &vals[2].str_val);
+	} else {
+		kinds[2] = column_null;
+		vals[2].null_val = true;
+	}
+	vals[3].uint64_val = hash;
+
+	const serial_row_t row = {
+		.num_columns = num_columns,
+		.column_kinds = kinds,
+		.column_values = vals,
+	};
+
+	return bind_serial_row(stmt, &row);
+}
+
+/*
+ * Serialize `vcs_id` and `hash` into a sql query to update a row in the file
+ * table.
+ *
+ * A table describing the mapping from sql columns to arguments, as the sql
+ * type:
+ *
+ * type    |SQL         |arg
+ * --------|------------|------
+ * int64    id           rowid
+ * string   vcs_id       vcs_id (NULL if `vcs_id` is NULL)
+ * int64    hash         hash
+ */
+static int
+bind_file_update(sqlite3_stmt *stmt, int64_t rowid, const cf_str_t *vcs_id,
+		uint64_t hash)
+{
+	const size_t num_columns = file_update_query.num_columns;
+
+	column_kind_t kinds[num_columns];
+	memcpy(kinds, file_update_query.column_kinds, sizeof(kinds));
+
+	column_val_t vals[num_columns];
+	vals[0].uint64_val = (uint64_t)rowid;
+	if (vcs_id) {
+		cf_str_borrow_str(vcs_id, &vals[1].str_val);
+	} else {
+		kinds[1] = column_null;
+		vals[1].null_val = true;
+	}
+	vals[2].uint64_val = hash;
+
+	const serial_row_t row = {
+		.num_columns = num_columns,
+		.column_kinds = kinds,
+		.column_values = vals,
+	};
+
+	return bind_serial_row(stmt, &row);
+}
+
+/*
+ * Serialize `rowid` into a sql query for a type lookup.
+ *
+ * A table describing the mapping from sql columns to arguments, as the sql
+ * type:
+ *
+ * type    |SQL         |arg
+ * --------|------------|------
+ * int64    id           rowid
+ */
+static int
+bind_type_lookup(sqlite3_stmt *stmt, int64_t rowid)
+{
+	const size_t num_columns = type_lookup_query.base.num_columns;
+
+	column_val_t vals[num_columns];
+	vals[0].uint64_val = rowid;
+
+	const serial_row_t row = {
+		.num_columns = num_columns,
+		.column_kinds = type_lookup_query.base.column_kinds,
+		.column_values = vals,
+	};
+
+	return bind_serial_row(stmt, &row);
+}
+
+/*
+ * Serialize `hash` into a sql query for a lookup by content hash in the file
+ * table.
+ *
+ * type    |SQL         |arg
+ * --------|------------|------
+ * int64    hash         hash
+ */
+static int
+bind_file_hash_find(sqlite3_stmt *stmt, uint64_t hash)
+{
+	const size_t num_columns = file_hash_find_query.base.num_columns;
+
+	column_val_t vals[num_columns];
+	vals[0].uint64_val = hash;
+
+	const serial_row_t row = {
+		.num_columns = num_columns,
+		.column_kinds = file_hash_find_query.base.column_kinds,
+		.column_values = vals,
+	};
+
+	return bind_serial_row(stmt, &row);
+}
+
+/*
+ * Serialize `file` into any approx-file table query. They all take the file
+ * rowid as their only input.
+ *
+ * type    |SQL         |arg
+ * --------|------------|------
+ * int64    file         file
+ */
+static int
+bind_approx_file(sqlite3_stmt *stmt, int64_t file)
+{
+	const size_t num_columns = approx_file_insert_query.num_columns;
+
+	column_val_t vals[num_columns];
+	vals[0].uint64_val = (uint64_t)file;
+
+	const serial_row_t row = {
+		.num_columns = num_columns,
+		.column_kinds = approx_file_insert_query.column_kinds,
+		.column_values = vals,
+	};
+
+	return bind_serial_row(stmt, &row);
+}
+
+/*
+ * Serialize a snippet block into a sql query for an insert into the snippet
+ * table. `blob` must outlive the execution of `stmt`.
+ *
+ * type    |SQL         |arg
+ * --------|------------|------
+ * int64    file         file
+ * blob     data         blob, len
  */
 static int
-bind_file_lookup(sqlite3_stmt *stmt, const char *path, size_t len)
+bind_snippet_insert(sqlite3_stmt *stmt, int64_t file, const void *blob,
+		size_t len)
 {
-	const size_t num_columns = file_lookup_query.base.num_columns;
+	const size_t num_columns = snippet_insert_query.num_columns;
 
 	column_val_t vals[num_columns];
-	cf_str_borrow(path, len, &vals[0].str_val);
+	vals[0].uint64_val = (uint64_t)file;
+	vals[1].blob_val.data = blob;
+	vals[1].blob_val.len = len;
 
 	const serial_row_t row = {
 		.num_columns = num_columns,
-		.column_kinds = file_lookup_query.base.column_kinds,
+		.column_kinds = snippet_insert_query.column_kinds,
 		.column_values = vals,
 	};
 
@@ -935,26 +2824,21 @@ bind_file_lookup(sqlite3_stmt *stmt, const char *path, size_t len)
 }
 
 /*
- * Serialize `rowid` into a sql query for a lookup by ID the file table.
- *
- * A table describing the mapping from sql columns to arguments, as the sql
- * type:
- *
  * type    |SQL         |arg
  * --------|------------|------
- * int64    id           rowid
+ * int64    file         file
  */
 static int
-bind_file_id_lookup(sqlite3_stmt *stmt, int64_t rowid)
+bind_snippet_lookup(sqlite3_stmt *stmt, int64_t file)
 {
-	const size_t num_columns = file_id_lookup_query.base.num_columns;
+	const size_t num_columns = snippet_lookup_query.base.num_columns;
 
 	column_val_t vals[num_columns];
-	vals[0].uint64_val = rowid;
+	vals[0].uint64_val = (uint64_t)file;
 
 	const serial_row_t row = {
 		.num_columns = num_columns,
-		.column_kinds = file_id_lookup_query.base.column_kinds,
+		.column_kinds = snippet_lookup_query.base.column_kinds,
 		.column_values = vals,
 	};
 
@@ -962,28 +2846,23 @@ bind_file_id_lookup(sqlite3_stmt *stmt, int64_t rowid)
 }
 
 /*
- * Serialize `path` into a sql query for insertion into the file table.
- *
- * A table describing the mapping from sql columns to arguments, as the sql
- * type:
+ * Serialize `path` into a sql query for a lookup in the file alias table.
  *
  * type    |SQL         |arg
  * --------|------------|------
- * null     id           NULL
  * string   path         path, len
  */
 static int
-bind_file_insert(sqlite3_stmt *stmt, const char *path, size_t len)
+bind_file_alias_lookup(sqlite3_stmt *stmt, const char *path, size_t len)
 {
-	const size_t num_columns = file_insert_query.num_columns;
+	const size_t num_columns = file_alias_lookup_query.base.num_columns;
 
 	column_val_t vals[num_columns];
-	vals[0].null_val = true;
-	cf_str_borrow(path, len, &vals[1].str_val);
+	cf_str_borrow(path, len, &vals[0].str_val);
 
 	const serial_row_t row = {
 		.num_columns = num_columns,
-		.column_kinds = file_insert_query.column_kinds,
+		.column_kinds = file_alias_lookup_query.base.column_kinds,
 		.column_values = vals,
 	};
 
@@ -991,26 +2870,36 @@ bind_file_insert(sqlite3_stmt *stmt, const char *path, size_t len)
 }
 
 /*
- * Serialize `rowid` into a sql query for a type lookup.
- *
- * A table describing the mapping from sql columns to arguments, as the sql
- * type:
+ * Serialize an alias for insertion into the file alias table.
  *
  * type    |SQL         |arg
  * --------|------------|------
- * int64    id           rowid
+ * string   path         path, len
+ * int64    file         file
+ * string   vcs_id       vcs_id (NULL if `vcs_id` is NULL)
  */
 static int
-bind_type_lookup(sqlite3_stmt *stmt, int64_t rowid)
+bind_file_alias_insert(sqlite3_stmt *stmt, const char *path, size_t len,
+		int64_t file, const cf_str_t *vcs_id)
 {
-	const size_t num_columns = type_lookup_query.base.num_columns;
+	const size_t num_columns = file_alias_insert_query.num_columns;
+
+	column_kind_t kinds[num_columns];
+	memcpy(kinds, file_alias_insert_query.column_kinds, sizeof(kinds));
 
 	column_val_t vals[num_columns];
-	vals[0].uint64_val = rowid;
+	cf_str_borrow(path, len, &vals[0].str_val);
+	vals[1].uint64_val = (uint64_t)file;
+	if (vcs_id) {
+		cf_str_borrow_str(vcs_id, &vals[2].str_val);
+	} else {
+		kinds[2] = column_null;
+		vals[2].null_val = true;
+	}
 
 	const serial_row_t row = {
 		.num_columns = num_columns,
-		.column_kinds = type_lookup_query.base.column_kinds,
+		.column_kinds = kinds,
 		.column_values = vals,
 	};
 
@@ -1069,6 +2958,9 @@ bind_type_insert(sqlite3_stmt *stmt, const loc_ctx_t *loc,
  * --------|------------|------
  * int64    file         loc->file
  * string   name         name->name.{str,len}
+ * int      scope        loc->scope
+ * int64    func         loc->func
+ * int      kind         name->kind
  */
 static int
 bind_typename_lookup(sqlite3_stmt *stmt, const loc_ctx_t *loc,
@@ -1079,6 +2971,9 @@ bind_typename_lookup(sqlite3_stmt *stmt, const loc_ctx_t *loc,
 	column_val_t vals[num_columns];
 	vals[0].uint64_val = (uint64_t)loc->file.rowid;
 	cf_str_borrow_str(&name->name, &vals[1].str_val);
+	vals[2].uint32_val = loc->scope;
+	vals[3].uint64_val = (uint64_t)loc->func.rowid;
+	vals[4].uint32_val = name->kind;
 
 	const serial_row_t row = {
 		.num_columns = num_columns,
@@ -1090,7 +2985,61 @@ bind_typename_lookup(sqlite3_stmt *stmt, const loc_ctx_t *loc,
 }
 
 /*
- * Format `stmt` to do a search for typenames matching `name`.
+ * Serialize `num_keys` keys into a batched typename lookup.
+ *
+ * Each key `i` binds `TYPENAME_KEY_COLUMNS` columns starting at
+ * `TYPENAME_KEY_COLUMNS * i`:
+ *
+ * type    |SQL         |arg
+ * --------|------------|------
+ * int64    file         keys[i].loc->file
+ * string   name         keys[i].name->name.{str,len}
+ * int      kind         keys[i].name->kind
+ * int      scope        keys[i].loc->scope
+ * int64    func         keys[i].loc->func
+ *
+ * Keys past `num_keys` are bound to NULL so they match nothing.
+ */
+static int
+bind_typename_lookup_many(sqlite3_stmt *stmt, const db_typename_key_t *keys,
+		size_t num_keys)
+{
+	const size_t num_columns = typename_lookup_many_query.base.num_columns;
+	cf_assert(num_keys <= TYPENAME_LOOKUP_BATCH);
+
+	column_kind_t kinds[num_columns];
+	memcpy(kinds, typename_lookup_many_query.base.column_kinds,
+			sizeof(kinds));
+
+	column_val_t vals[num_columns];
+	for (size_t i = 0; i < TYPENAME_LOOKUP_BATCH; ++i) {
+		const size_t base = TYPENAME_KEY_COLUMNS * i;
+		column_val_t *key_vals = &vals[base];
+		if (i >= num_keys) {
+			for (size_t j = 0; j < TYPENAME_KEY_COLUMNS; ++j) {
+				kinds[base + j] = column_null;
+				key_vals[j].null_val = true;
+			}
+			continue;
+		}
+		key_vals[0].uint64_val = (uint64_t)keys[i].loc->file.rowid;
+		cf_str_borrow_str(&keys[i].name->name, &key_vals[1].str_val);
+		key_vals[2].uint32_val = keys[i].name->kind;
+		key_vals[3].uint32_val = keys[i].loc->scope;
+		key_vals[4].uint64_val = (uint64_t)keys[i].loc->func.rowid;
+	}
+
+	const serial_row_t row = {
+		.num_columns = num_columns,
+		.column_kinds = kinds,
+		.column_values = vals,
+	};
+
+	return bind_serial_row(stmt, &row);
+}
+
+/*
+ * Format `stmt` to do a search for typenames matching `name` and `filter`.
  *
  * A table describing the mapping from sql columns to struct members, as well
  * as the sql type:
@@ -1098,14 +3047,34 @@ bind_typename_lookup(sqlite3_stmt *stmt, const loc_ctx_t *loc,
  * type    |SQL         |arg
  * --------|------------|------
  * string   name         name->{str,len}
+ * int      kind         filter->type_kind
+ * int      kind         filter->name_kind
+ * string   path         filter->file_glob
+ * int64    (cursor)     filter->after
+ * int64    (limit)      filter->limit, or INT64_MAX for no limit
+ * int      (scope)      filter->scope
+ *
+ * Every `typename_find*_query` takes the same parameters.
  */
 static int
-bind_typename_find(sqlite3_stmt *stmt, const cf_str_t *name)
+bind_typename_find(sqlite3_stmt *stmt, const cf_str_t *name,
+		const db_filter_t *filter)
 {
+	static const db_filter_t no_filter;
+	if (!filter) {
+		filter = &no_filter;
+	}
+
 	const size_t num_columns = typename_find_query.base.num_columns;
 
 	column_val_t vals[num_columns];
 	cf_str_borrow_str(name, &vals[0].str_val);
+	vals[1].uint32_val = filter->type_kind;
+	vals[2].uint32_val = filter->name_kind;
+	bind_file_glob(filter, &vals[3].str_val);
+	vals[4].uint64_val = (uint64_t)filter->after;
+	vals[5].uint64_val = filter->limit ? filter->limit : INT64_MAX;
+	vals[6].uint32_val = filter->scope;
 
 	const serial_row_t row = {
 		.num_columns = num_columns,
@@ -1194,6 +3163,62 @@ bind_type_use_insert(sqlite3_stmt *stmt, const loc_ctx_t *loc,
 	return bind_serial_row(stmt, &row);
 }
 
+/*
+ * Serialize `entry` into a sql query that adds to the type use count table.
+ *
+ * type    |SQL         |arg
+ * --------|------------|------
+ * int64    base_type    entry->base_type
+ * int64    file         entry->file
+ * int      kind         entry->kind
+ * int64    count        entry->count
+ * int      -            max
+ */
+static int
+bind_type_use_count_insert(sqlite3_stmt *stmt,
+		const db_type_use_count_t *entry, bool max)
+{
+	const size_t num_columns = type_use_count_insert_query.num_columns;
+
+	column_val_t vals[num_columns];
+	vals[0].uint64_val = (uint64_t)entry->base_type.rowid;
+	vals[1].uint64_val = (uint64_t)entry->file.rowid;
+	vals[2].uint32_val = entry->kind;
+	vals[3].uint64_val = entry->count;
+	vals[4].uint32_val = max;
+
+	const serial_row_t row = {
+		.num_columns = num_columns,
+		.column_kinds = type_use_count_insert_query.column_kinds,
+		.column_values = vals,
+	};
+
+	return bind_serial_row(stmt, &row);
+}
+
+/*
+ * type    |SQL         |arg
+ * --------|------------|------
+ * int64    base_type    type
+ */
+static int
+bind_type_use_count_lookup(sqlite3_stmt *stmt, int64_t type)
+{
+	const size_t num_columns =
+			type_use_count_lookup_query.base.num_columns;
+
+	column_val_t vals[num_columns];
+	vals[0].uint64_val = (uint64_t)type;
+
+	const serial_row_t row = {
+		.num_columns = num_columns,
+		.column_kinds = type_use_count_lookup_query.base.column_kinds,
+		.column_values = vals,
+	};
+
+	return bind_serial_row(stmt, &row);
+}
+
 /*
  * Serialize `entry` into a sql query for insertion into the member table.
  *
@@ -1242,15 +3267,18 @@ bind_member_insert(sqlite3_stmt *stmt, const loc_ctx_t *loc,
  * --------|------------|------
  * int64    parent       parent
  * string   name         name->{str,len}
+ * string   path         filter->file_glob
  */
 static int
-bind_member_lookup(sqlite3_stmt *stmt, int64_t parent, const cf_str_t *name)
+bind_member_lookup(sqlite3_stmt *stmt, int64_t parent, const cf_str_t *name,
+		const db_filter_t *filter)
 {
 	const size_t num_columns = member_lookup_query.base.num_columns;
 
 	column_val_t vals[num_columns];
 	vals[0].uint64_val = (uint64_t)parent;
 	cf_str_borrow_str(name, &vals[1].str_val);
+	bind_file_glob(filter, &vals[2].str_val);
 
 	const serial_row_t row = {
 		.num_columns = num_columns,
@@ -1261,6 +3289,75 @@ bind_member_lookup(sqlite3_stmt *stmt, int64_t parent, const cf_str_t *name)
 	return bind_serial_row(stmt, &row);
 }
 
+/*
+ * Set `out` to the string to bind for `filter->file_glob`.
+ *
+ * The queries treat an empty pattern as "any file". A null string can't be
+ * used because sqlite binds it as NULL, which matches nothing.
+ */
+static void
+bind_file_glob(const db_filter_t *filter, cf_str_t *out)
+{
+	if (!filter || cf_str_is_null(&filter->file_glob)) {
+		cf_str_borrow("", 0, out);
+		return;
+	}
+	cf_str_borrow_str(&filter->file_glob, out);
+}
+
+/*
+ * Serialize a TU dependency for insertion into the tu-dep table.
+ *
+ * A table describing the mapping from sql columns to arguments, as the sql
+ * type:
+ *
+ * type    |SQL         |arg
+ * --------|------------|------
+ * int64    tu           tu
+ * int64    file         file
+ */
+static int
+bind_tu_dep_insert(sqlite3_stmt *stmt, int64_t tu, int64_t file)
+{
+	const size_t num_columns = tu_dep_insert_query.num_columns;
+
+	column_val_t vals[num_columns];
+	vals[0].uint64_val = (uint64_t)tu;
+	vals[1].uint64_val = (uint64_t)file;
+
+	const serial_row_t row = {
+		.num_columns = num_columns,
+		.column_kinds = tu_dep_insert_query.column_kinds,
+		.column_values = vals,
+	};
+
+	return bind_serial_row(stmt, &row);
+}
+
+/*
+ * Serialize `rowid` for insertion into the temporary changed file table.
+ *
+ * type    |SQL         |arg
+ * --------|------------|------
+ * int64    id           rowid
+ */
+static int
+bind_vcs_changed_insert(sqlite3_stmt *stmt, int64_t rowid)
+{
+	const size_t num_columns = vcs_changed_insert_query.num_columns;
+
+	column_val_t vals[num_columns];
+	vals[0].uint64_val = (uint64_t)rowid;
+
+	const serial_row_t row = {
+		.num_columns = num_columns,
+		.column_kinds = vcs_changed_insert_query.column_kinds,
+		.column_values = vals,
+	};
+
+	return bind_serial_row(stmt, &row);
+}
+
 /*
  * Bind `stmt` according to `row`.
  *
@@ -1318,6 +3415,13 @@ bind_one_column(sqlite3_stmt *stmt, int bind_index, column_kind_t column_kind,
 			return sqlite3_bind_text(stmt, bind_index,
 					val->str_val.str, cf_str_len(&val->str_val),
 					SQLITE_STATIC);
+		case column_blob:
+			if (val->blob_val.len > INT_MAX) {
+				return ERANGE;
+			}
+			return sqlite3_bind_blob(stmt, bind_index,
+					val->blob_val.data, (int)val->blob_val.len,
+					SQLITE_STATIC);
 	}
 	cf_panic("unknown column kind %d\n", column_kind);
 }
@@ -1436,6 +3540,11 @@ select_one_column(sqlite3_stmt *stmt, int index, column_kind_t expected_kind,
 			}
 			break;
 		}
+		case column_blob:
+			// note: borrowed, same as strings
+			out->blob_val.data = sqlite3_column_blob(stmt, index);
+			out->blob_val.len = (size_t)sqlite3_column_bytes(stmt, index);
+			break;
 	}
 
 	return 0;
@@ -1456,6 +3565,8 @@ sql_column_kind2type(column_kind_t kind)
 			return SQLITE_INTEGER;
 		case column_str:
 			return SQLITE_TEXT;
+		case column_blob:
+			return SQLITE_BLOB;
 	}
 	cf_panic("unknown column kind %d\n", kind);
 }
@@ -1516,6 +3627,16 @@ compile_type_use_table_create(sqlite3 *db)
 	return compile_query(db, TYPE_USE_TABLE_QUERY_CREATE);
 }
 
+static sqlite3_stmt *
+compile_type_use_count_table_create(sqlite3 *db)
+{
+#define TYPE_USE_COUNT_TABLE_QUERY_CREATE \
+	CREATE_TABLE_BASE \
+	TYPE_USE_COUNT_TABLE_NAME " " \
+	TYPE_USE_COUNT_COLUMNS ";"
+	return compile_query(db, TYPE_USE_COUNT_TABLE_QUERY_CREATE);
+}
+
 static sqlite3_stmt *
 compile_member_table_create(sqlite3 *db)
 {
@@ -1526,6 +3647,46 @@ compile_member_table_create(sqlite3 *db)
 	return compile_query(db, MEMBER_TABLE_QUERY_CREATE);
 }
 
+static sqlite3_stmt *
+compile_tu_dep_table_create(sqlite3 *db)
+{
+#define TU_DEP_TABLE_QUERY_CREATE \
+	CREATE_TABLE_BASE \
+	TU_DEP_TABLE_NAME " " \
+	TU_DEP_COLUMNS ";"
+	return compile_query(db, TU_DEP_TABLE_QUERY_CREATE);
+}
+
+static sqlite3_stmt *
+compile_file_alias_table_create(sqlite3 *db)
+{
+#define FILE_ALIAS_TABLE_QUERY_CREATE \
+	CREATE_TABLE_BASE \
+	FILE_ALIAS_TABLE_NAME " " \
+	FILE_ALIAS_COLUMNS ";"
+	return compile_query(db, FILE_ALIAS_TABLE_QUERY_CREATE);
+}
+
+static sqlite3_stmt *
+compile_approx_file_table_create(sqlite3 *db)
+{
+#define APPROX_FILE_TABLE_QUERY_CREATE \
+	CREATE_TABLE_BASE \
+	APPROX_FILE_TABLE_NAME " " \
+	APPROX_FILE_COLUMNS ";"
+	return compile_query(db, APPROX_FILE_TABLE_QUERY_CREATE);
+}
+
+static sqlite3_stmt *
+compile_snippet_table_create(sqlite3 *db)
+{
+#define SNIPPET_TABLE_QUERY_CREATE \
+	CREATE_TABLE_BASE \
+	SNIPPET_TABLE_NAME " " \
+	SNIPPET_COLUMNS ";"
+	return compile_query(db, SNIPPET_TABLE_QUERY_CREATE);
+}
+
 static sqlite3_stmt *
 compile_file_table_lookup(sqlite3 *db)
 {
@@ -1544,6 +3705,79 @@ compile_file_table_insert(sqlite3 *db)
 	return compile_query_desc(db, &file_insert_query);
 }
 
+static sqlite3_stmt *
+compile_file_table_update(sqlite3 *db)
+{
+	return compile_query_desc(db, &file_update_query);
+}
+
+static sqlite3_stmt *
+compile_file_table_hash_find(sqlite3 *db)
+{
+	return compile_query_desc(db, &file_hash_find_query.base);
+}
+
+static sqlite3_stmt *
+compile_file_table_vcs_find(sqlite3 *db, bool tracked, bool aliases)
+{
+	if (aliases) {
+		return compile_query_desc(db, tracked ?
+				&file_alias_tracked_find_query.base :
+				&file_alias_untracked_find_query.base);
+	}
+	return compile_query_desc(db, tracked ?
+			&file_tracked_find_query.base :
+			&file_untracked_find_query.base);
+}
+
+static sqlite3_stmt *
+compile_file_alias_table_lookup(sqlite3 *db)
+{
+	return compile_query_desc(db, &file_alias_lookup_query.base);
+}
+
+static sqlite3_stmt *
+compile_file_alias_table_insert(sqlite3 *db)
+{
+	return compile_query_desc(db, &file_alias_insert_query);
+}
+
+static sqlite3_stmt *
+compile_snippet_table_insert(sqlite3 *db)
+{
+	return compile_query_desc(db, &snippet_insert_query);
+}
+
+static sqlite3_stmt *
+compile_snippet_table_lookup(sqlite3 *db)
+{
+	return compile_query_desc(db, &snippet_lookup_query.base);
+}
+
+static sqlite3_stmt *
+compile_approx_file_table_insert(sqlite3 *db)
+{
+	return compile_query_desc(db, &approx_file_insert_query);
+}
+
+static sqlite3_stmt *
+compile_approx_file_table_lookup(sqlite3 *db)
+{
+	return compile_query_desc(db, &approx_file_lookup_query.base);
+}
+
+static sqlite3_stmt *
+compile_approx_file_table_count(sqlite3 *db)
+{
+	return compile_query_desc(db, &approx_file_count_query.base);
+}
+
+static sqlite3_stmt *
+compile_tu_dep_table_count(sqlite3 *db)
+{
+	return compile_query_desc(db, &tu_count_query.base);
+}
+
 static sqlite3_stmt *
 compile_type_table_lookup(sqlite3 *db)
 {
@@ -1563,9 +3797,29 @@ compile_typename_table_lookup(sqlite3 *db)
 }
 
 static sqlite3_stmt *
-compile_typename_table_find(sqlite3 *db)
+compile_typename_table_lookup_many(sqlite3 *db)
+{
+	return compile_query_desc(db, &typename_lookup_many_query.base);
+}
+
+static sqlite3_stmt *
+compile_typename_table_find(sqlite3 *db, db_order_t order)
+{
+	switch (order) {
+		case db_order_none:
+			return compile_query_desc(db, &typename_find_query.base);
+		case db_order_name:
+			return compile_query_desc(db, &typename_find_by_name_query.base);
+		case db_order_file:
+			return compile_query_desc(db, &typename_find_by_file_query.base);
+	}
+	cf_panic("unknown order %d\n", order);
+}
+
+static sqlite3_stmt *
+compile_typename_table_cursor(sqlite3 *db)
 {
-	return compile_query_desc(db, &typename_find_query.base);
+	return compile_query_desc(db, &typename_cursor_query.base);
 }
 
 static sqlite3_stmt *
@@ -1586,6 +3840,18 @@ compile_type_use_table_insert(sqlite3 *db)
 	return compile_query_desc(db, &type_use_insert_query);
 }
 
+static sqlite3_stmt *
+compile_type_use_count_table_insert(sqlite3 *db)
+{
+	return compile_query_desc(db, &type_use_count_insert_query);
+}
+
+static sqlite3_stmt *
+compile_type_use_count_table_lookup(sqlite3 *db)
+{
+	return compile_query_desc(db, &type_use_count_lookup_query.base);
+}
+
 static sqlite3_stmt *
 compile_member_table_insert(sqlite3 *db)
 {
@@ -1598,6 +3864,24 @@ compile_member_table_lookup(sqlite3 *db)
 	return compile_query_desc(db, &member_lookup_query.base);
 }
 
+static sqlite3_stmt *
+compile_tu_dep_table_insert(sqlite3 *db)
+{
+	return compile_query_desc(db, &tu_dep_insert_query);
+}
+
+static sqlite3_stmt *
+compile_tu_dep_table_clean_find(sqlite3 *db)
+{
+	return compile_query_desc(db, &tu_dep_clean_find_query.base);
+}
+
+static sqlite3_stmt *
+compile_vcs_changed_insert(sqlite3 *db)
+{
+	return compile_query_desc(db, &vcs_changed_insert_query);
+}
+
 /*
  * Compile a query from a query description.
  *
@@ -7,7 +7,9 @@
 #pragma once
 
 #include "cc_support.h"
+#include "cf_map.h"
 #include "db_types.h"
+#include "snippet.h"
 
 #include <stdbool.h>
 #include <stdint.h>
@@ -20,7 +22,22 @@ int sql_open(const char *db_path, bool ro, sqlite3 **sql_out);
 
 int lookup_file(sqlite3 *db, const char *path, size_t len, int64_t *rowid_out);
 int lookup_file_id(sqlite3 *db, int64_t rowid, cf_str_t *out);
-int insert_file(sqlite3 *db, const char *path, size_t len, int64_t *rowid_out);
+int insert_file(sqlite3 *db, const char *path, size_t len,
+		const cf_str_t *vcs_id, uint64_t hash, int64_t *rowid_out);
+int update_file(sqlite3 *db, int64_t rowid, const cf_str_t *vcs_id,
+		uint64_t hash);
+int lookup_file_alias(sqlite3 *db, const char *path, size_t len,
+		int64_t *rowid_out);
+int insert_file_alias(sqlite3 *db, const char *path, size_t len, int64_t file,
+		const cf_str_t *vcs_id);
+int insert_approx_file(sqlite3 *db, int64_t file);
+int lookup_approx_file(sqlite3 *db, int64_t file);
+int count_approx_files(sqlite3 *db, size_t *count_out);
+int count_tus(sqlite3 *db, size_t *count_out);
+int purge_approx_file(sqlite3 *db, int64_t file);
+int insert_tu_dep(sqlite3 *db, int64_t tu, int64_t file);
+int insert_snippets(sqlite3 *db, int64_t file, const void *blob, size_t len);
+int lookup_snippets(sqlite3 *db, int64_t file, snippet_block_t *out);
 
 int insert_complete_type(sqlite3 *db, const loc_ctx_t *loc,
 		const db_type_entry_t *entry, int64_t *rowid_out);
@@ -28,6 +45,8 @@ int insert_typename(sqlite3 *db, const loc_ctx_t *loc,
 		const db_typename_t *name, int64_t *rowid_out);
 int insert_type_use(sqlite3 *db, const loc_ctx_t *loc,
 		const db_type_use_t *entry, int64_t *rowid_out);
+int insert_type_use_count(sqlite3 *db, const db_type_use_count_t *entry,
+		bool max);
 int insert_member(sqlite3 *db, const loc_ctx_t *loc, const db_member_t *entry,
 		int64_t *rowid_out);
 
@@ -35,14 +54,77 @@ int lookup_type_entry(sqlite3 *db, int64_t rowid, db_type_entry_t *entry_out,
 		loc_ctx_t *loc_out);
 int lookup_typename(sqlite3 *db, const loc_ctx_t *loc,
 		const db_typename_t *name, int64_t *rowid_out);
+int lookup_typenames(sqlite3 *db, const db_typename_key_t *keys,
+		size_t num_keys, type_ref_t *out);
+int lookup_type_use_counts(sqlite3 *db, int64_t type, use_count_vec_t *out);
 int lookup_member(sqlite3 *db, int64_t parent, const cf_str_t *member,
-		db_member_t *entry_out, loc_ctx_t *loc_out);
+		const db_filter_t *filter, db_member_t *entry_out, loc_ctx_t *loc_out);
 
 // typename iterator
-int find_typenames(sqlite3 *db, const cf_str_t *name, sqlite3_stmt **out);
+int find_typenames(sqlite3 *db, const cf_str_t *name,
+		const db_filter_t *filter, sqlite3_stmt **out);
 int iter_next_typename(sqlite3_stmt *stmt);
 int iter_get_typename(sqlite3_stmt *stmt, db_typename_t *entry_out,
-		loc_ctx_t *loc_out);
+		loc_ctx_t *loc_out, int64_t *cursor_out);
 void free_typenames(sqlite3_stmt *stmt);
 
+// content hash iterator
+int find_files_by_hash(sqlite3 *db, uint64_t hash, sqlite3_stmt **out);
+int iter_next_file_hash(sqlite3_stmt *stmt);
+int iter_get_file_hash(sqlite3_stmt *stmt, int64_t *rowid_out,
+		cf_str_t *path_out);
+void free_files_by_hash(sqlite3_stmt *stmt);
+
+// version control file iterator
+int find_vcs_files(sqlite3 *db, bool tracked, bool aliases,
+		sqlite3_stmt **out);
+int iter_next_vcs_file(sqlite3_stmt *stmt);
+int iter_get_vcs_file(sqlite3_stmt *stmt, bool tracked, int64_t *rowid_out,
+		cf_str_t *path_out, cf_str_t *vcs_id_out);
+void free_vcs_files(sqlite3_stmt *stmt);
+
+// whole-table iterators for columnar scans
+int scan_files(sqlite3 *db, sqlite3_stmt **out);
+int scan_typenames(sqlite3 *db, sqlite3_stmt **out);
+int scan_members(sqlite3 *db, sqlite3_stmt **out);
+int iter_next_scan_row(sqlite3_stmt *stmt);
+int iter_get_scan_file(sqlite3_stmt *stmt, int64_t *rowid_out,
+		cf_str_t *path_out);
+int iter_get_scan_typename(sqlite3_stmt *stmt, int64_t *rowid_out,
+		db_typename_t *entry_out, type_kind_t *type_kind_out,
+		loc_ctx_t *loc_out);
+int iter_get_scan_member(sqlite3_stmt *stmt, db_member_t *entry_out,
+		loc_ctx_t *loc_out);
+void free_scan_rows(sqlite3_stmt *stmt);
+
+// whole-table iterators for merging index fragments
+int scan_types(sqlite3 *db, sqlite3_stmt **out);
+int scan_type_uses(sqlite3 *db, sqlite3_stmt **out);
+int scan_type_use_counts(sqlite3 *db, sqlite3_stmt **out);
+int scan_tu_deps(sqlite3 *db, sqlite3_stmt **out);
+int scan_file_aliases(sqlite3 *db, sqlite3_stmt **out);
+int scan_snippets(sqlite3 *db, sqlite3_stmt **out);
+int iter_get_scan_type(sqlite3_stmt *stmt, int64_t *rowid_out,
+		db_type_entry_t *entry_out, loc_ctx_t *loc_out);
+int iter_get_scan_type_use(sqlite3_stmt *stmt, db_type_use_t *entry_out,
+		loc_ctx_t *loc_out);
+int iter_get_scan_type_use_count(sqlite3_stmt *stmt,
+		db_type_use_count_t *out);
+int iter_get_scan_tu_dep(sqlite3_stmt *stmt, int64_t *tu_out,
+		int64_t *file_out);
+int iter_get_scan_file_alias(sqlite3_stmt *stmt, int64_t *file_out,
+		cf_str_t *path_out);
+int iter_get_scan_snippets(sqlite3_stmt *stmt, int64_t *file_out,
+		snippet_block_t *out);
+
+// incremental reindexing
+int checkpoint_wal(sqlite3 *db, int mode);
+int get_wal_size(sqlite3 *db, uint64_t *size_out);
+int begin_transaction(sqlite3 *db);
+int end_transaction(sqlite3 *db, bool commit);
+int reset_changed_files(sqlite3 *db);
+int mark_file_changed(sqlite3 *db, int64_t rowid);
+int find_clean_tus(sqlite3 *db, cf_map8_t *out);
+int purge_changed_files(sqlite3 *db);
+
 __END_DECLS
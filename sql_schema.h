@@ -12,7 +12,14 @@
  * - file
  *   Central table for all C source-containing files indexed by cfind. All
  *   other tables that contain a source code location reference a row in the
- *   file table by rowid.
+ *   file table by rowid. When indexing with version control, the file's git
+ *   blob id is also recorded; it's NULL for untracked files. Each file also
+ *   has a hash of its contents; a file is only stored once no matter how many
+ *   paths it's copied to.
+ * - file-alias
+ *   Extra paths to files whose contents are byte-identical to a file in the
+ *   file table. Each row references the file table row that stores the
+ *   contents. Like the file table, it also stores a git blob id.
  * - type
  *   Central table for all user-defined types (structs, unions, enums).
  *   All other tables that record something about the use of a type reference
@@ -26,15 +33,42 @@
  * - incomplete-type
  *   An internal-only table used to deal with incomplete types/forward
  *   declarations that are encountered before the definition of a type.
+ * - tu-dep
+ *   Which files each translation unit depends on. Each row references two rows
+ *   in the file table: the main ".c" file of a TU, and a file it includes
+ *   (directly or transitively), or itself. This is used to find the TUs that
+ *   need to be reindexed when a file changes.
+ * - approx-file
+ *   Files indexed approximately, i.e., parsed on their own without following
+ *   `#include`s. Everything located in such a file is approximate. A precise
+ *   run deletes and replaces it, then removes the file from this table.
+ * - snippet
+ *   Optional source lines of indexed entries, for printing context without
+ *   the source. One row per file; `data` is a compressed block of every
+ *   stored line of the file (see "snippet.h").
  */
 
 #define FILE_TABLE_NAME "file_table"
-#define FILE_COLUMN_NAMES "id, path"
+#define FILE_COLUMN_NAMES "id, path, vcs_id, hash"
 #define FILE_COLUMNS "(" \
 	"id INTEGER PRIMARY KEY ASC," \
-	"path STRING" \
+	"path STRING," \
+	"vcs_id STRING," /*NOTE: nullable*/ \
+	"hash INT" \
 	")"
-#define FILE_NUM_COLUMNS 2
+#define FILE_NUM_COLUMNS 4
+
+#define FILE_HASH_INDEX_NAME "file_hash_index"
+#define FILE_HASH_INDEX_COLUMNS "(hash)"
+
+#define FILE_ALIAS_TABLE_NAME "file_alias"
+#define FILE_ALIAS_COLUMN_NAMES "path, file, vcs_id"
+#define FILE_ALIAS_COLUMNS "(" \
+	"path STRING," \
+	"file INT," \
+	"vcs_id STRING" /*NOTE: nullable*/ \
+	")"
+#define FILE_ALIAS_NUM_COLUMNS 3
 
 #define TYPE_TABLE_NAME "type_table"
 #define TYPE_COLUMN_NAMES \
@@ -66,6 +100,20 @@
 	")"
 #define TYPENAME_NUM_COLUMNS 8
 
+// backs name-ordered typename searches and their keyset cursors
+#define TYPENAME_NAME_INDEX_NAME "typename_name_index"
+#define TYPENAME_NAME_INDEX_COLUMNS "(name)"
+
+/*
+ * Backs typename lookups by the indexer.
+ *
+ * Scope leads so that global names (scope 0, func 0) and the names local to
+ * each function are separate ranges of the index. A global lookup seeks
+ * straight into the global range however many local types there are.
+ */
+#define TYPENAME_SCOPE_INDEX_NAME "typename_scope_index"
+#define TYPENAME_SCOPE_INDEX_COLUMNS "(scope, func, file, name)"
+
 #define INCOMPLETE_TYPE_TABLE_NAME "incomplete_type"
 #define INCOMPLETE_TYPE_COLUMN_NAMES \
 	"(name, kind, base_type, file, line, column)"
@@ -94,6 +142,24 @@
 	")"
 #define TYPE_USE_NUM_COLUMNS 5
 
+/*
+ * Number of uses of a type, per file and kind of use.
+ *
+ * Only written when indexing with aggregated type uses (see
+ * `index_config_t::use_counts`). `type_use` then only holds a sample of the
+ * locations counted here.
+ */
+#define TYPE_USE_COUNT_TABLE_NAME "type_use_count"
+#define TYPE_USE_COUNT_COLUMN_NAMES "base_type, file, kind, count"
+#define TYPE_USE_COUNT_COLUMNS "(" \
+	"base_type INT," \
+	"file INT," \
+	"kind INT," \
+	"count INT," \
+	"PRIMARY KEY (base_type, file, kind)" \
+	")"
+#define TYPE_USE_COUNT_NUM_COLUMNS 4
+
 #define MEMBER_TABLE_NAME "members"
 #define MEMBER_COLUMN_NAMES "parent, base_type, name, file, line, column"
 #define MEMBER_COLUMNS "(" \
@@ -105,3 +171,27 @@
 	"column INT" \
 	")"
 #define MEMBER_NUM_COLUMNS 6
+
+#define TU_DEP_TABLE_NAME "tu_dep"
+#define TU_DEP_COLUMN_NAMES "tu, file"
+#define TU_DEP_COLUMNS "(" \
+	"tu INT," \
+	"file INT," \
+	"PRIMARY KEY (tu, file)" \
+	")"
+#define TU_DEP_NUM_COLUMNS 2
+
+#define APPROX_FILE_TABLE_NAME "approx_file"
+#define APPROX_FILE_COLUMN_NAMES "file"
+#define APPROX_FILE_COLUMNS "(" \
+	"file INTEGER PRIMARY KEY" \
+	")"
+#define APPROX_FILE_NUM_COLUMNS 1
+
+#define SNIPPET_TABLE_NAME "snippet"
+#define SNIPPET_COLUMN_NAMES "file, data"
+#define SNIPPET_COLUMNS "(" \
+	"file INTEGER PRIMARY KEY," \
+	"data BLOB" \
+	")"
+#define SNIPPET_NUM_COLUMNS 2
@@ -9,6 +9,7 @@
 #pragma once
 
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 #include <string.h>
 
@@ -29,13 +30,15 @@
 /*
  * cfind only supports a subset of sqlite data types.
  *
- * In other words, float and non-utf8 strings aren't useful.
+ * In other words, float isn't useful. Non-utf8 data is only stored as an
+ * opaque blob.
  */
 typedef enum {
 	column_null,
 	column_uint32,
 	column_uint64,
 	column_str,
+	column_blob,
 } column_kind_t;
 
 /*
@@ -53,6 +56,10 @@ typedef union {
 	uint32_t uint32_val;
 	uint64_t uint64_val;
 	cf_str_t str_val;
+	struct {
+		const void *data;
+		size_t len;
+	} blob_val;
 } column_val_t;
 
 /*
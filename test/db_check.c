@@ -0,0 +1,178 @@
+/*
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ * Copyright (C) 2024 cfind developer
+ *
+ * Whole-database checks on a sqlite database written by the indexer.
+ *
+ * These read the tables directly rather than going through `cf_db_t`, which
+ * only exposes lookups.
+ */
+#define _POSIX_C_SOURCE 200809L // for open_memstream(3)
+#include "db_check.h"
+
+#include "../sql_schema.h"
+
+#include <errno.h>
+#include <sqlite3.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+/*
+ * Nonzero type reference `col` that has no row in the type table.
+ */
+#define DANGLING(col) \
+	"(IFNULL(" col ", 0) != 0 AND " col " NOT IN " \
+	"(SELECT typeid FROM " TYPE_TABLE_NAME "))"
+
+/*
+ * The location of type `col` as "path:line:column", so that the same type
+ * has the same label in any database. "-" for no type and "?" for a missing
+ * one.
+ */
+#define TYPE_LABEL(col) \
+	"(CASE WHEN IFNULL(" col ", 0) == 0 THEN '-' ELSE COALESCE(" \
+	"(SELECT f.path || ':' || t.line || ':' || t.column" \
+	" FROM " TYPE_TABLE_NAME " AS t" \
+	" JOIN " FILE_TABLE_NAME " AS f ON (f.id == t.file)" \
+	" WHERE t.typeid == " col "), '?') END)"
+
+#define FILE_LABEL(col) \
+	"COALESCE((SELECT path FROM " FILE_TABLE_NAME " WHERE id == " col \
+	"), '?')"
+
+/*
+ * Format the location of an entry of the table aliased `t`.
+ */
+#define LOC_LABEL(t) \
+	FILE_LABEL(t ".file") " || ':' || " t ".line || ':' || " t ".column"
+
+static int open_ro(const char *db_path, sqlite3 **out);
+
+/*
+ * Count the entries in database `db_path` that reference a type that isn't
+ * in it.
+ *
+ * Every member parent and every nonzero base type of a typename, member,
+ * type use, and use count must be a row of the type table.
+ */
+int
+count_dangling_refs(const char *db_path, size_t *out)
+{
+	int error;
+	sqlite3 *db;
+	sqlite3_stmt *stmt;
+
+	static const char query[] = "SELECT "
+		"(SELECT COUNT(*) FROM " MEMBER_TABLE_NAME " WHERE "
+			DANGLING("parent") " OR " DANGLING("base_type") ") + "
+		"(SELECT COUNT(*) FROM " TYPENAME_TABLE_NAME " WHERE "
+			DANGLING("base_type") ") + "
+		"(SELECT COUNT(*) FROM " INCOMPLETE_TYPE_TABLE_NAME " WHERE "
+			DANGLING("base_type") ") + "
+		"(SELECT COUNT(*) FROM " TYPE_USE_TABLE_NAME " WHERE "
+			DANGLING("base_type") ") + "
+		"(SELECT COUNT(*) FROM " TYPE_USE_COUNT_TABLE_NAME " WHERE "
+			DANGLING("base_type") ");";
+
+	if ((error = open_ro(db_path, &db))) {
+		return error;
+	}
+	if (sqlite3_prepare_v2(db, query, -1, &stmt, NULL) != SQLITE_OK) {
+		printf("cannot count dangling refs: %s\n", sqlite3_errmsg(db));
+		error = EINVAL;
+		goto fail;
+	}
+	if (sqlite3_step(stmt) == SQLITE_ROW) {
+		*out = (size_t)sqlite3_column_int64(stmt, 0);
+	} else {
+		error = EIO;
+	}
+	sqlite3_finalize(stmt);
+fail:
+	sqlite3_close(db);
+	return error;
+}
+
+/*
+ * Print every type, typename, member, type use, and use count in database
+ * `db_path` as one sorted line each, to a heap string `*out`.
+ *
+ * Rowids aren't printed. Types are referred to by location and files by path
+ * instead, so two databases of the same source dump the same even if rows
+ * were inserted in another order. On success, free `*out` with free(3).
+ */
+int
+dump_db_entries(const char *db_path, char **out)
+{
+	int error;
+	sqlite3 *db;
+	sqlite3_stmt *stmt;
+
+	static const char query[] =
+		"SELECT 'type ' || o.kind || ' ' || o.complete || ' ' ||"
+			" " TYPE_LABEL("o.typeid") " FROM " TYPE_TABLE_NAME " AS o"
+		" UNION ALL SELECT 'typename ' || n.name || ' ' || n.kind || ' ' ||"
+			" n.scope || ' ' || " LOC_LABEL("n") " || ' ' ||"
+			" " TYPE_LABEL("n.base_type")
+			" FROM " TYPENAME_TABLE_NAME " AS n"
+		" UNION ALL SELECT 'member ' || " TYPE_LABEL("m.parent") " || ' ' ||"
+			" m.name || ' ' || " LOC_LABEL("m") " || ' ' ||"
+			" " TYPE_LABEL("m.base_type")
+			" FROM " MEMBER_TABLE_NAME " AS m"
+		" UNION ALL SELECT 'use ' || u.kind || ' ' ||"
+			" " LOC_LABEL("u") " || ' ' || " TYPE_LABEL("u.base_type")
+			" FROM " TYPE_USE_TABLE_NAME " AS u"
+		" UNION ALL SELECT 'count ' || c.kind || ' ' || c.count || ' ' ||"
+			" " FILE_LABEL("c.file") " || ' ' || " TYPE_LABEL("c.base_type")
+			" FROM " TYPE_USE_COUNT_TABLE_NAME " AS c"
+		" ORDER BY 1;";
+
+	if ((error = open_ro(db_path, &db))) {
+		return error;
+	}
+	if (sqlite3_prepare_v2(db, query, -1, &stmt, NULL) != SQLITE_OK) {
+		printf("cannot dump db: %s\n", sqlite3_errmsg(db));
+		error = EINVAL;
+		goto fail;
+	}
+
+	size_t len;
+	FILE *f = open_memstream(out, &len);
+	if (!f) {
+		error = errno;
+		goto fail_stmt;
+	}
+
+	int ret;
+	while ((ret = sqlite3_step(stmt)) == SQLITE_ROW) {
+		// NULL if any column of the line is
+		const char *line = (const char *)sqlite3_column_text(stmt, 0);
+		fprintf(f, "%s\n", line ? line : "(null)");
+	}
+	error = (ret == SQLITE_DONE) ? 0 : EIO;
+
+	if (fclose(f) && !error) {
+		error = errno;
+	}
+	if (error) {
+		free(*out);
+		*out = NULL;
+	}
+fail_stmt:
+	sqlite3_finalize(stmt);
+fail:
+	sqlite3_close(db);
+	return error;
+}
+
+static int
+open_ro(const char *db_path, sqlite3 **out)
+{
+	if (sqlite3_open_v2(db_path, out, SQLITE_OPEN_READONLY, NULL)
+			!= SQLITE_OK) {
+		printf("cannot open '%s': %s\n", db_path, sqlite3_errmsg(*out));
+		sqlite3_close(*out);
+		return EIO;
+	}
+	return 0;
+}
@@ -0,0 +1,16 @@
+/*
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ * Copyright (C) 2024 cfind developer
+ */
+#pragma once
+
+#include "../cc_support.h"
+
+#include <stddef.h>
+
+__BEGIN_DECLS
+
+int count_dangling_refs(const char *db_path, size_t *out);
+int dump_db_entries(const char *db_path, char **out);
+
+__END_DECLS
@@ -0,0 +1,374 @@
+/*
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ * Copyright (C) 2024 cfind developer
+ */
+#define _XOPEN_SOURCE 700 // for mkdtemp(3), nftw(3)
+#include "src_tree.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <ftw.h>
+#include <limits.h>
+#include <paths.h>
+#include <spawn.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+extern char **environ;
+
+/*
+ * Name of trees created under `_PATH_TMP`, as a mkdtemp(3) template.
+ */
+#define SRC_TREE_TEMPLATE "cfind_test_XXXXXX"
+
+/*
+ * Most directory levels a file written with src_tree_write() is nested in.
+ */
+#define SRC_TREE_MAX_DEPTH 8
+
+/*
+ * Most files src_tree_index() takes as inputs.
+ */
+#define SRC_TREE_MAX_INPUTS 8
+
+static int remove_entry(const char *path, const struct stat *st, int flag,
+		struct FTW *ftw);
+static int make_parent_dirs(const src_tree_t *tree, const char *name);
+static int run_git(const src_tree_t *tree, const char *const *args);
+
+/*
+ * Create an empty temporary directory.
+ *
+ * On success, follow with a call to free_src_tree().
+ */
+int
+make_src_tree(src_tree_t *out)
+{
+	const int n = snprintf(out->root, sizeof(out->root), "%s%s", _PATH_TMP,
+			SRC_TREE_TEMPLATE);
+	if (n >= (int)sizeof(out->root)) {
+		return ENAMETOOLONG;
+	}
+	if (!mkdtemp(out->root)) {
+		return errno;
+	}
+	return 0;
+}
+
+/*
+ * Recursively delete `tree` and everything in it.
+ */
+void
+free_src_tree(src_tree_t *tree)
+{
+	(void)nftw(tree->root, remove_entry, 16, FTW_DEPTH | FTW_PHYS);
+}
+
+static int
+remove_entry(const char *path, CF_UNUSED const struct stat *st,
+		CF_UNUSED int flag, CF_UNUSED struct FTW *ftw)
+{
+	// keep going; nothing useful can be done with an error
+	(void)remove(path);
+	return 0;
+}
+
+/*
+ * Format the absolute path to file `name`, relative to the root of `tree`,
+ * into the `len`-byte buffer `buf`.
+ */
+int
+src_tree_path(const src_tree_t *tree, const char *name, char *buf,
+		size_t len)
+{
+	const int n = snprintf(buf, len, "%s/%s", tree->root, name);
+	if ((n < 0) || ((size_t)n >= len)) {
+		return ENAMETOOLONG;
+	}
+	return 0;
+}
+
+/*
+ * Create or replace file `name` in `tree` with the contents of `src`.
+ *
+ * `name` is relative to the root of `tree`. Directories in it are created as
+ * needed.
+ */
+int
+src_tree_write(const src_tree_t *tree, const char *name, const char *src)
+{
+	int error;
+	char path[PATH_MAX];
+
+	if ((error = src_tree_path(tree, name, path, sizeof(path)))) {
+		return error;
+	}
+	if ((error = make_parent_dirs(tree, name))) {
+		return error;
+	}
+
+	FILE *f = fopen(path, "w");
+	if (!f) {
+		return errno;
+	}
+	error = (fputs(src, f) == EOF) ? EIO : 0;
+	if (fclose(f) && !error) {
+		error = errno;
+	}
+	return error;
+}
+
+/*
+ * Create each directory leading up to file `name` in `tree`.
+ */
+static int
+make_parent_dirs(const src_tree_t *tree, const char *name)
+{
+	int error;
+	char path[PATH_MAX];
+
+	if ((error = src_tree_path(tree, name, path, sizeof(path)))) {
+		return error;
+	}
+
+	// cut `path` at each '/' of `name`, from the left
+	char *slash = &path[strlen(tree->root) + 1];
+	for (unsigned depth = 0; (slash = strchr(slash, '/')); ++depth) {
+		if (depth == SRC_TREE_MAX_DEPTH) {
+			return ELOOP;
+		}
+		*slash = '\0';
+		if (mkdir(path, 0700) && (errno != EEXIST)) {
+			return errno;
+		}
+		*slash++ = '/';
+	}
+	return 0;
+}
+
+/*
+ * Write a compilation database to "compile_commands.json" in the root of
+ * `tree`, with one command for each of the `n` source files `names`.
+ *
+ * Each file is compiled with default arguments. Pass the root of `tree` as an
+ * `input_comp_db` input to index it.
+ */
+int
+src_tree_write_comp_db(const src_tree_t *tree, const char *const *names,
+		size_t n)
+{
+	int error;
+	char path[PATH_MAX];
+
+	if ((error = src_tree_path(tree, "compile_commands.json", path,
+			sizeof(path)))) {
+		return error;
+	}
+
+	FILE *f = fopen(path, "w");
+	if (!f) {
+		return errno;
+	}
+	fprintf(f, "[\n");
+	for (size_t i = 0; i < n; ++i) {
+		fprintf(f, "\t{\"directory\": \"%s\", \"command\": \"clang\", "
+				"\"file\": \"%s/%s\"}%s\n", tree->root, tree->root, names[i],
+				(i + 1 < n) ? "," : "");
+	}
+	fprintf(f, "]\n");
+
+	error = ferror(f) ? EIO : 0;
+	if (fclose(f) && !error) {
+		error = errno;
+	}
+	return error;
+}
+
+/*
+ * Commit every file in `tree` to a git repository rooted at `tree`.
+ *
+ * The repository is created by the first call.
+ */
+int
+src_tree_commit(const src_tree_t *tree)
+{
+	int error;
+
+	const char *const init[] = {"init", "-q", NULL};
+	const char *const add[] = {"add", "-A", NULL};
+	const char *const commit[] = {
+		"-c", "user.name=cfind", "-c", "user.email=cfind@localhost",
+		"commit", "-q", "--allow-empty", "-m", "test", NULL,
+	};
+
+	if ((error = run_git(tree, init))) {
+		return error;
+	}
+	if ((error = run_git(tree, add))) {
+		return error;
+	}
+	return run_git(tree, commit);
+}
+
+/*
+ * Index the `n` files `names` of `tree` into database `db_name` in the tree.
+ *
+ * The rest of the configuration is copied from `config`. Its database and
+ * input kinds default to `index_db_sql` and `input_source_file`. If `names`
+ * is NULL, the root of `tree` is the one input, e.g., for `input_comp_db`.
+ * `db_name` is a sqlite database or a log directory, depending on the
+ * database kind.
+ */
+int
+src_tree_index(const src_tree_t *tree, const char *db_name,
+		const char *const *names, size_t n, const index_config_t *config)
+{
+	int error;
+	char db_path[PATH_MAX];
+	char paths[SRC_TREE_MAX_INPUTS][PATH_MAX];
+	const char *inputs[SRC_TREE_MAX_INPUTS];
+
+	if (!names) {
+		inputs[0] = tree->root;
+		n = 1;
+	} else if (n > ARRAY_LEN(inputs)) {
+		return E2BIG;
+	}
+	for (size_t i = 0; names && (i < n); ++i) {
+		if ((error = src_tree_path(tree, names[i], paths[i],
+				sizeof(paths[i])))) {
+			return error;
+		}
+		inputs[i] = paths[i];
+	}
+	if ((error = src_tree_path(tree, db_name, db_path, sizeof(db_path)))) {
+		return error;
+	}
+
+	index_config_t copy = *config;
+	if (!copy.db_kind) {
+		copy.db_kind = index_db_sql;
+	}
+	if (!copy.input_kind) {
+		copy.input_kind = input_source_file;
+	}
+	copy.db_args.sql_path = db_path;
+	copy.input_paths = inputs;
+	copy.num_inputs = n;
+	return cf_index_project(&copy);
+}
+
+/*
+ * Open an empty, writable database of kind `db_kind`: `db_kind_mem`, or
+ * `db_kind_sql` or `db_kind_log` at "x.db" or "x.log" in `tree`.
+ *
+ * On success, follow with a call to cf_db_close().
+ */
+int
+src_tree_open_db(const src_tree_t *tree, int db_kind, cf_db_t *out)
+{
+	int error;
+	char path[PATH_MAX];
+
+	switch (db_kind) {
+		case db_kind_mem:
+			return cf_db_open_mem(out);
+		case db_kind_sql:
+			if ((error = src_tree_path(tree, "x.db", path, sizeof(path)))) {
+				return error;
+			}
+			return cf_db_open_sql(path, /*ro*/false, out);
+		case db_kind_log:
+			if ((error = src_tree_path(tree, "x.log", path,
+					sizeof(path)))) {
+				return error;
+			}
+			return cf_db_open_log(path, out);
+	}
+	return EINVAL;
+}
+
+/*
+ * Make a tree, open an empty database of kind `db_kind` in it with
+ * src_tree_open_db(), and run `fn` on both with `arg`.
+ *
+ * The database is closed and the tree removed afterwards, whether or not
+ * `fn` failed. Return the first error.
+ */
+int
+src_tree_with_db(int db_kind, src_tree_db_fn_t fn, void *arg)
+{
+	int error;
+	src_tree_t tree;
+	cf_db_t db;
+
+	if ((error = make_src_tree(&tree))) {
+		return error;
+	}
+	if ((error = src_tree_open_db(&tree, db_kind, &db))) {
+		goto fail;
+	}
+	error = fn(&db, &tree, arg);
+	const int close_error = cf_db_close(&db);
+	error = error ? error : close_error;
+
+fail:
+	free_src_tree(&tree);
+	return error;
+}
+
+/*
+ * Run git(1) in `tree` with NULL-terminated arguments `args`.
+ *
+ * Its stdout is discarded. A nonzero exit status is reported as EIO.
+ */
+static int
+run_git(const src_tree_t *tree, const char *const *args)
+{
+	int error;
+	char *argv[16] = {"git", "-C", (char *)tree->root};
+	size_t argc = 3;
+
+	for (; *args; ++args) {
+		if (argc + 1 == ARRAY_LEN(argv)) {
+			return E2BIG;
+		}
+		argv[argc++] = (char *)*args;
+	}
+	argv[argc] = NULL;
+
+	posix_spawn_file_actions_t actions;
+	if ((error = posix_spawn_file_actions_init(&actions))) {
+		return error;
+	}
+	if ((error = posix_spawn_file_actions_addopen(&actions, STDOUT_FILENO,
+			_PATH_DEVNULL, O_WRONLY, 0))) {
+		goto fail;
+	}
+
+	pid_t pid;
+	if ((error = posix_spawnp(&pid, argv[0], &actions, NULL, argv,
+			environ))) {
+		goto fail;
+	}
+
+	int status;
+	while (waitpid(pid, &status, 0) == -1) {
+		if (errno != EINTR) {
+			error = errno;
+			goto fail;
+		}
+	}
+	if (!WIFEXITED(status) || WEXITSTATUS(status)) {
+		error = EIO;
+	}
+
+fail:
+	(void)posix_spawn_file_actions_destroy(&actions);
+	return error;
+}
@@ -0,0 +1,52 @@
+/*
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ * Copyright (C) 2024 cfind developer
+ */
+#pragma once
+
+#include "../cc_support.h"
+#include "../cf_db.h"
+#include "../cf_index.h"
+
+#include <stddef.h>
+
+__BEGIN_DECLS
+
+/*
+ * A temporary directory of source files, returned from make_src_tree().
+ *
+ * Unlike `src_adaptor_t`, files in a tree can `#include` each other, be
+ * listed in a compilation database, and be committed to a git repository.
+ *
+ * Members:
+ * - root
+ *   Absolute path to the directory. Large enough for "/tmp/" plus the
+ *   mkdtemp(3) template.
+ */
+typedef struct {
+	char root[64];
+} src_tree_t;
+
+/*
+ * Test body run by src_tree_with_db() on a new database in a new tree.
+ *
+ * Return nonzero on failure, like a test function.
+ */
+typedef int (*src_tree_db_fn_t)(cf_db_t *db, const src_tree_t *tree,
+		void *arg);
+
+int make_src_tree(src_tree_t *out);
+void free_src_tree(src_tree_t *tree);
+int src_tree_path(const src_tree_t *tree, const char *name, char *buf,
+		size_t len);
+int src_tree_write(const src_tree_t *tree, const char *name,
+		const char *src);
+int src_tree_write_comp_db(const src_tree_t *tree,
+		const char *const *names, size_t n);
+int src_tree_commit(const src_tree_t *tree);
+int src_tree_index(const src_tree_t *tree, const char *db_name,
+		const char *const *names, size_t n, const index_config_t *config);
+int src_tree_open_db(const src_tree_t *tree, int db_kind, cf_db_t *out);
+int src_tree_with_db(int db_kind, src_tree_db_fn_t fn, void *arg);
+
+__END_DECLS
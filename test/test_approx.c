@@ -0,0 +1,99 @@
+/*
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ * Copyright (C) 2024 cfind developer
+ *
+ * Approximate indexing with `index_config_t::approx`, then replacing it with a
+ * precise run.
+ */
+#define _POSIX_C_SOURCE 200809L // for PATH_MAX
+#include "test_utils.h"
+#include "src_tree.h"
+#include "db_check.h"
+#include "../cf_index.h"
+
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static int test_approx_then_precise(void);
+TEST_DECL(test_approx_then_precise);
+
+/*
+ * Index every file approximately, then the TUs precisely.
+ *
+ * Approximately, "a.c" and "u.c" don't see the headers they include, so they
+ * get their own incomplete `pt` and `inner`. Precisely, these resolve to the
+ * types in "h.h" and "part.c" instead, and every approximate file is purged
+ * when the precise run first adds it.
+ *
+ * The result must have no references to purged types and dump the same as a
+ * precise index from scratch.
+ */
+static int
+test_approx_then_precise(void)
+{
+	int error;
+	src_tree_t tree;
+	char db_path[PATH_MAX];
+	char *replaced = NULL;
+	char *scratch = NULL;
+	size_t dangling;
+
+	const char *const all_files[] = {
+		"h.h",
+		"a.c",
+		"part.c",
+		"u.c",
+	};
+	const char *const tus[] = {
+		"a.c",
+		"u.c",
+	};
+	const index_config_t approx = {
+		.approx = true,
+	};
+	const index_config_t precise = {0};
+
+	ASSERT_EQ(make_src_tree(&tree), 0);
+	ASSERT_EQ(src_tree_write(&tree, "h.h",
+			"struct pt { int x; int y; };\n"
+			"typedef struct pt pt_t;\n"), 0);
+	ASSERT_EQ(src_tree_write(&tree, "a.c",
+			"#include \"h.h\"\n"
+			"struct rect { struct pt a; pt_t b; };\n"), 0);
+	ASSERT_EQ(src_tree_write(&tree, "part.c",
+			"struct inner { int v; };\n"), 0);
+	// a unity build: "part.c" is its own TU and included by "u.c"
+	ASSERT_EQ(src_tree_write(&tree, "u.c",
+			"#include \"part.c\"\n"
+			"struct outer { struct inner i; struct rect *r; };\n"), 0);
+
+	ASSERT_EQ(src_tree_index(&tree, "replaced.db", all_files,
+			ARRAY_LEN(all_files), &approx), 0);
+	ASSERT_EQ(src_tree_index(&tree, "replaced.db", tus, ARRAY_LEN(tus),
+			&precise), 0);
+	ASSERT_EQ(src_tree_index(&tree, "scratch.db", tus, ARRAY_LEN(tus),
+			&precise), 0);
+
+	ASSERT_EQ(src_tree_path(&tree, "replaced.db", db_path, sizeof(db_path)),
+			0);
+	ASSERT_EQ(count_dangling_refs(db_path, &dangling), 0);
+	ASSERT_EQ(dangling, 0);
+	ASSERT_EQ(dump_db_entries(db_path, &replaced), 0);
+
+	ASSERT_EQ(src_tree_path(&tree, "scratch.db", db_path, sizeof(db_path)),
+			0);
+	ASSERT_EQ(dump_db_entries(db_path, &scratch), 0);
+
+	error = strcmp(replaced, scratch);
+	if (error) {
+		printf("replaced:\n%s\nscratch:\n%s\n", replaced, scratch);
+	}
+	free(replaced);
+	free(scratch);
+	free_src_tree(&tree);
+
+	ASSERT_EQ(error, 0);
+	return 0;
+}
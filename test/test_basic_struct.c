@@ -19,11 +19,15 @@ TEST_DECL(test_basic_struct);
 static int
 index_wrapper(src_adaptor_t *adp, cf_db_t *db)
 {
+	const char *const inputs[] = {
+		adp->path,
+	};
 	const index_config_t config = {
 		.db_kind = index_db_borrowed,
 		.input_kind = input_source_file,
 		.db_args.db = db,
-		.input_path = adp->path,
+		.input_paths = inputs,
+		.num_inputs = ARRAY_LEN(inputs),
 	};
 
 	return cf_index_project(&config);
@@ -52,7 +56,7 @@ lookup_one_type(cf_db_t *db, const cf_str_t *name, full_type_t *out)
 
 	// look up, make iterator
 	db_typename_iter_t iter;
-	if ((error = cf_db_typename_find(db, name, &iter))) {
+	if ((error = cf_db_typename_find(db, name, NULL, &iter))) {
 		goto fail;
 	}
 
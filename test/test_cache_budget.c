@@ -0,0 +1,210 @@
+/*
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ * Copyright (C) 2024 cfind developer
+ *
+ * Bounding the indexer's caches with `index_config_t::cache_budget`.
+ */
+#define _POSIX_C_SOURCE 200809L // for open_memstream(3)
+#include "test_utils.h"
+#include "src_tree.h"
+#include "db_check.h"
+#include "../cf_index.h"
+#include "../cf_map.h"
+
+#include <limits.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static int test_cache_budget_evict(void);
+static int test_cache_budget_index(void);
+TEST_DECL(test_cache_budget_evict);
+TEST_DECL(test_cache_budget_index);
+
+/*
+ * Budget of the cache in test_cache_budget_evict(), and the number of keys
+ * inserted into it: many times what fits.
+ */
+#define EVICT_BUDGET 4096
+#define EVICT_KEYS 5000
+
+/*
+ * Number of structs in the header of test_cache_budget_index(), and of TUs
+ * including it. There are more structs than the smallest cache holds.
+ */
+#define HEADER_STRUCTS 200
+#define HEADER_TUS 4
+
+/*
+ * Number of values passed to count_release().
+ */
+static size_t num_released;
+
+static void count_release(uint64_t value);
+static char *make_header_src(void);
+
+/*
+ * Insert far more keys into an owning cache than its budget holds.
+ *
+ * The cache must stay within its budget, hand every value it drops to its
+ * release function exactly once, and map each key it still has to the value
+ * last inserted for it.
+ */
+static int
+test_cache_budget_evict(void)
+{
+	cf_cache8_t cache;
+	uint64_t value;
+	size_t found = 0;
+
+	num_released = 0;
+	cf_cache8_make_owner(EVICT_BUDGET, 16, count_release, &cache);
+	ASSERT_EQ(cf_cache8_budget(&cache) <= EVICT_BUDGET, 1);
+
+	for (uint64_t key = 1; key <= EVICT_KEYS; ++key) {
+		ASSERT_EQ(cf_cache8_insert(&cache, key, key * 3), 0);
+		ASSERT(cf_cache8_bytes(&cache) <= cf_cache8_budget(&cache));
+
+		// replace the new key's value, and keep key 1 referenced
+		ASSERT_EQ(cf_cache8_insert(&cache, key, key * 3 + 1), 0);
+		if (cf_cache8_lookup(&cache, 1, &value)) {
+			ASSERT_EQ(value, 4);
+		}
+	}
+
+	const cf_cache_stats_t *stats = &cache.stats;
+	ASSERT_EQ(stats->inserts, EVICT_KEYS);
+	ASSERT_EQ(stats->evictions, EVICT_KEYS - cf_cache8_len(&cache));
+	// one release per replaced value and one per eviction
+	ASSERT_EQ(num_released, EVICT_KEYS + stats->evictions);
+
+	for (uint64_t key = 1; key <= EVICT_KEYS; ++key) {
+		if (cf_cache8_contains(&cache, key)) {
+			ASSERT(cf_cache8_lookup(&cache, key, &value));
+			ASSERT_EQ(value, key * 3 + 1);
+			found++;
+		}
+	}
+	ASSERT_EQ(found, cf_cache8_len(&cache));
+	ASSERT(found < EVICT_KEYS);
+
+	// the most recently inserted key has yet to be passed by the hand
+	ASSERT(cf_cache8_contains(&cache, EVICT_KEYS));
+
+	cf_cache8_free(&cache);
+	ASSERT_EQ(num_released, (2 * EVICT_KEYS));
+	return 0;
+}
+
+static void
+count_release(CF_UNUSED uint64_t value)
+{
+	num_released++;
+}
+
+/*
+ * Index TUs sharing a header with more structs than the caches hold, once
+ * with unbounded caches and once with the smallest budget.
+ *
+ * A budget of 1 byte must still bound both caches it's split between.
+ *
+ * Entries evicted from the caches must be found again in the database rather
+ * than inserted twice, so both runs dump the same.
+ */
+static int
+test_cache_budget_index(void)
+{
+	int error;
+	src_tree_t tree;
+	char db_path[PATH_MAX];
+	char name[16];
+	char src[128];
+	char *unbounded = NULL;
+	char *bounded = NULL;
+	size_t dangling;
+	const char *tus[HEADER_TUS];
+	char tu_names[HEADER_TUS][16];
+
+	const index_config_t unbounded_config = {0};
+	const index_config_t bounded_config = {
+		.cache_budget = 1,
+	};
+
+	ASSERT_EQ(make_src_tree(&tree), 0);
+	char *header = make_header_src();
+	ASSERT(header);
+	ASSERT_EQ(src_tree_write(&tree, "h.h", header), 0);
+	free(header);
+
+	for (unsigned i = 0; i < HEADER_TUS; ++i) {
+		snprintf(tu_names[i], sizeof(tu_names[i]), "t%u.c", i);
+		snprintf(name, sizeof(name), "u%u", i);
+		// each TU uses structs from all over the header
+		snprintf(src, sizeof(src),
+				"#include \"h.h\"\n"
+				"struct %s {\n"
+				"	struct s%u a; struct s%u b; s%u_t c;\n"
+				"};\n",
+				name, i, (HEADER_STRUCTS - 1) - i,
+				(HEADER_STRUCTS / 2) + i);
+		ASSERT_EQ(src_tree_write(&tree, tu_names[i], src), 0);
+		tus[i] = tu_names[i];
+	}
+
+	ASSERT_EQ(src_tree_index(&tree, "unbounded.db", tus, HEADER_TUS,
+			&unbounded_config), 0);
+	ASSERT_EQ(src_tree_index(&tree, "bounded.db", tus, HEADER_TUS,
+			&bounded_config), 0);
+
+	ASSERT_EQ(src_tree_path(&tree, "bounded.db", db_path, sizeof(db_path)),
+			0);
+	ASSERT_EQ(count_dangling_refs(db_path, &dangling), 0);
+	ASSERT_EQ(dangling, 0);
+	ASSERT_EQ(dump_db_entries(db_path, &bounded), 0);
+
+	ASSERT_EQ(src_tree_path(&tree, "unbounded.db", db_path,
+			sizeof(db_path)), 0);
+	ASSERT_EQ(dump_db_entries(db_path, &unbounded), 0);
+
+	error = strcmp(bounded, unbounded);
+	if (error) {
+		printf("bounded:\n%s\nunbounded:\n%s\n", bounded, unbounded);
+	}
+	free(bounded);
+	free(unbounded);
+	free_src_tree(&tree);
+
+	ASSERT_EQ(error, 0);
+	return 0;
+}
+
+/*
+ * Generate a header of `HEADER_STRUCTS` structs, each with a typedef and a
+ * pointer to the one before it.
+ *
+ * On success, return a heap string to free with free(3).
+ */
+static char *
+make_header_src(void)
+{
+	char *src;
+	size_t len;
+	FILE *f = open_memstream(&src, &len);
+
+	if (!f) {
+		return NULL;
+	}
+	fprintf(f, "struct s0 { int x; };\n");
+	fprintf(f, "typedef struct s0 s0_t;\n");
+	for (unsigned i = 1; i < HEADER_STRUCTS; ++i) {
+		fprintf(f, "struct s%u { int x; struct s%u *prev; };\n", i,
+				i - 1);
+		fprintf(f, "typedef struct s%u s%u_t;\n", i, i);
+	}
+	if (fclose(f)) {
+		free(src);
+		return NULL;
+	}
+	return src;
+}
@@ -0,0 +1,83 @@
+/*
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ * Copyright (C) 2024 cfind developer
+ *
+ * Files that duplicate another file byte for byte.
+ */
+#define _POSIX_C_SOURCE 200809L // for PATH_MAX
+#include "test_utils.h"
+#include "src_tree.h"
+#include "db_check.h"
+#include "../cf_index.h"
+
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static int test_dedup_nested_type(void);
+TEST_DECL(test_dedup_nested_type);
+
+/*
+ * Use a type nested in a struct of a duplicate header.
+ *
+ * "b.c" includes a copy of "a.c"'s header, so nothing in the copy is stored
+ * again. `inner` is declared inside `outer` and must still resolve to the
+ * original's `inner` when `user` refers to it later in "b.c".
+ */
+static int
+test_dedup_nested_type(void)
+{
+	src_tree_t tree;
+	char db_path[PATH_MAX];
+	char orig[PATH_MAX];
+	char copy[PATH_MAX];
+	char user[PATH_MAX];
+	char line[4 * PATH_MAX];
+	char *dump;
+	size_t dangling;
+
+	static const char header[] =
+		"struct outer {\n"
+		"	struct inner { int v; } i;\n"
+		"	struct { int w; } anon;\n"
+		"};\n";
+
+	const char *const tus[] = {
+		"a.c",
+		"b.c",
+	};
+	const index_config_t config = {0};
+
+	ASSERT_EQ(make_src_tree(&tree), 0);
+	ASSERT_EQ(src_tree_write(&tree, "inc/h.h", header), 0);
+	ASSERT_EQ(src_tree_write(&tree, "copy/h.h", header), 0);
+	ASSERT_EQ(src_tree_write(&tree, "a.c", "#include \"inc/h.h\"\n"), 0);
+	ASSERT_EQ(src_tree_write(&tree, "b.c",
+			"#include \"copy/h.h\"\n"
+			"struct user { struct inner n; struct outer o; };\n"), 0);
+	ASSERT_EQ(src_tree_index(&tree, "x.db", tus, ARRAY_LEN(tus), &config), 0);
+
+	ASSERT_EQ(src_tree_path(&tree, "x.db", db_path, sizeof(db_path)), 0);
+	ASSERT_EQ(count_dangling_refs(db_path, &dangling), 0);
+	ASSERT_EQ(dangling, 0);
+	ASSERT_EQ(dump_db_entries(db_path, &dump), 0);
+
+	ASSERT_EQ(src_tree_path(&tree, "inc/h.h", orig, sizeof(orig)), 0);
+	ASSERT_EQ(src_tree_path(&tree, "copy/h.h", copy, sizeof(copy)), 0);
+	ASSERT_EQ(src_tree_path(&tree, "b.c", user, sizeof(user)), 0);
+
+	// types are only stored once, in the original header
+	snprintf(line, sizeof(line), "member %s:2:2 v", orig);
+	ASSERT(strstr(dump, line));
+	ASSERT(!strstr(dump, copy));
+
+	// `user::n` is of the original `inner`
+	snprintf(line, sizeof(line), "member %s:2:1 n %s:2:15 %s:2:2\n", user,
+			user, orig);
+	ASSERT(strstr(dump, line));
+
+	free(dump);
+	free_src_tree(&tree);
+	return 0;
+}
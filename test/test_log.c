@@ -0,0 +1,114 @@
+/*
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ * Copyright (C) 2024 cfind developer
+ *
+ * Indexing to a log with `index_db_log`, then compacting it with `input_log`.
+ */
+#define _POSIX_C_SOURCE 200809L // for PATH_MAX
+#include "test_utils.h"
+#include "src_tree.h"
+#include "db_check.h"
+#include "../cf_index.h"
+
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static int test_log_compact_round_trip(void);
+TEST_DECL(test_log_compact_round_trip);
+
+/*
+ * Index TUs to two logs, compact both logs into one database, and compare it
+ * with the same TUs indexed into a database directly.
+ *
+ * "a.c" and "b.c" include "h.h", so compaction has to merge the header's file
+ * and types from the two logs. "c.c" includes a byte-identical copy of it,
+ * which the log doesn't know is a duplicate; its types must resolve to the
+ * original's. Rowids differ between the databases; the entries they join to
+ * must not.
+ */
+static int
+test_log_compact_round_trip(void)
+{
+	int error;
+	src_tree_t tree;
+	char db_path[PATH_MAX];
+	char *compacted = NULL;
+	char *direct = NULL;
+	size_t dangling;
+
+	const char *const tus[] = {
+		"a.c",
+		"b.c",
+		"c.c",
+	};
+	const char *const a_tus[] = {
+		"a.c",
+	};
+	const char *const b_tus[] = {
+		"b.c",
+		"c.c",
+	};
+	const char *const logs[] = {
+		"a.log",
+		"b.log",
+	};
+	const index_config_t log_config = {
+		.db_kind = index_db_log,
+	};
+	const index_config_t compact_config = {
+		.input_kind = input_log,
+	};
+	const index_config_t direct_config = {0};
+
+	static const char header[] =
+		"struct pt { int x; int y; };\n"
+		"typedef struct { struct pt min; struct pt max; } box_t;\n";
+
+	ASSERT_EQ(make_src_tree(&tree), 0);
+	ASSERT_EQ(src_tree_write(&tree, "h.h", header), 0);
+	ASSERT_EQ(src_tree_write(&tree, "copy/h.h", header), 0);
+	ASSERT_EQ(src_tree_write(&tree, "a.c",
+			"#include \"h.h\"\n"
+			"struct shape {\n"
+			"	box_t bounds;\n"
+			"	union { struct pt center; int radius; } u;\n"
+			"};\n"), 0);
+	ASSERT_EQ(src_tree_write(&tree, "b.c",
+			"#include \"h.h\"\n"
+			"struct path { struct pt *points; box_t bounds; };\n"), 0);
+	ASSERT_EQ(src_tree_write(&tree, "c.c",
+			"#include \"copy/h.h\"\n"
+			"struct label { box_t bounds; struct pt anchor; };\n"), 0);
+
+	ASSERT_EQ(src_tree_index(&tree, "a.log", a_tus, ARRAY_LEN(a_tus),
+			&log_config), 0);
+	ASSERT_EQ(src_tree_index(&tree, "b.log", b_tus, ARRAY_LEN(b_tus),
+			&log_config), 0);
+	ASSERT_EQ(src_tree_index(&tree, "compacted.db", logs, ARRAY_LEN(logs),
+			&compact_config), 0);
+	ASSERT_EQ(src_tree_index(&tree, "direct.db", tus, ARRAY_LEN(tus),
+			&direct_config), 0);
+
+	ASSERT_EQ(src_tree_path(&tree, "compacted.db", db_path, sizeof(db_path)),
+			0);
+	ASSERT_EQ(count_dangling_refs(db_path, &dangling), 0);
+	ASSERT_EQ(dangling, 0);
+	ASSERT_EQ(dump_db_entries(db_path, &compacted), 0);
+
+	ASSERT_EQ(src_tree_path(&tree, "direct.db", db_path, sizeof(db_path)), 0);
+	ASSERT_EQ(dump_db_entries(db_path, &direct), 0);
+	ASSERT(strstr(direct, "typename box_t "));
+
+	error = strcmp(compacted, direct);
+	if (error) {
+		printf("compacted:\n%s\ndirect:\n%s\n", compacted, direct);
+	}
+	free(compacted);
+	free(direct);
+	free_src_tree(&tree);
+
+	ASSERT_EQ(error, 0);
+	return 0;
+}
@@ -0,0 +1,317 @@
+/*
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ * Copyright (C) 2024 cfind developer
+ *
+ * Batched typename lookups with cf_db_typename_lookup_many().
+ */
+#define _POSIX_C_SOURCE 200809L // for PATH_MAX
+#include "test_utils.h"
+#include "src_tree.h"
+#include "../cf_db.h"
+#include "../cf_index.h"
+#include "../cf_string.h"
+#include "../db_types.h"
+
+#include <errno.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static int test_lookup_many_mem(void);
+static int test_lookup_many_sql(void);
+static int test_lookup_many_log(void);
+static int test_lookup_many_index(void);
+TEST_DECL(test_lookup_many_mem);
+TEST_DECL(test_lookup_many_sql);
+TEST_DECL(test_lookup_many_log);
+TEST_DECL(test_lookup_many_index);
+
+/*
+ * Number of names inserted by fill_db(). Each is looked up under
+ * `LOOKUP_VARIANTS` keys, for several batches of sqlite's lookup.
+ */
+#define LOOKUP_NAMES 40
+#define LOOKUP_VARIANTS 5
+
+/*
+ * Number of structs, each with a typedef, in the header indexed by
+ * test_lookup_many_index().
+ */
+#define INDEX_STRUCTS 2000
+
+/*
+ * Typenames inserted for one name, and the ones looked up.
+ *
+ * Members
+ * - name, miss
+ *   "n<i>", and "m<i>", which is never inserted.
+ * - locs
+ *   Location of each variant of the name: in file "a.c" at scope 0 (struct
+ *   and typedef), in "a.c" at scope 1, in "b.c", and in "a.c" for `miss`.
+ * - types
+ *   Type each variant names, or zero if it wasn't inserted.
+ */
+typedef struct {
+	char name[16];
+	char miss[16];
+	loc_ctx_t locs[LOOKUP_VARIANTS];
+	db_typename_t names[LOOKUP_VARIANTS];
+	type_ref_t types[LOOKUP_VARIANTS];
+} lookup_name_t;
+
+static int run_lookup_many(cf_db_t *db, const src_tree_t *tree,
+		void *arg);
+static int write_structs(const src_tree_t *tree, const char *name);
+static int fill_db(cf_db_t *db, const src_tree_t *tree,
+		lookup_name_t *names);
+static int insert_typename(cf_db_t *db, const loc_ctx_t *loc,
+		db_typename_t *name, type_ref_t *type_out);
+
+static int
+test_lookup_many_mem(void)
+{
+	return src_tree_with_db(db_kind_mem, run_lookup_many, NULL);
+}
+
+static int
+test_lookup_many_sql(void)
+{
+	return src_tree_with_db(db_kind_sql, run_lookup_many, NULL);
+}
+
+static int
+test_lookup_many_log(void)
+{
+	return src_tree_with_db(db_kind_log, run_lookup_many, NULL);
+}
+
+/*
+ * Index a header of `INDEX_STRUCTS` structs and typedefs into a sqlite
+ * database.
+ *
+ * The typenames of a TU's structs and typedefs are resolved in batches, not
+ * one statement per struct.
+ */
+static int
+test_lookup_many_index(void)
+{
+	src_tree_t tree;
+	cf_db_t db;
+	char db_path[PATH_MAX];
+	char path[PATH_MAX];
+
+	ASSERT_EQ(make_src_tree(&tree), 0);
+	ASSERT_EQ(write_structs(&tree, "a.c"), 0);
+	ASSERT_EQ(src_tree_path(&tree, "a.c", path, sizeof(path)), 0);
+	ASSERT_EQ(src_tree_path(&tree, "x.db", db_path, sizeof(db_path)), 0);
+	ASSERT_EQ(cf_db_open_sql(db_path, /*ro*/false, &db), 0);
+
+	const char *const inputs[] = {
+		path,
+	};
+	const index_config_t config = {
+		.db_kind = index_db_borrowed,
+		.input_kind = input_source_file,
+		.db_args.db = &db,
+		.input_paths = inputs,
+		.num_inputs = ARRAY_LEN(inputs),
+	};
+	ASSERT_EQ(cf_index_project(&config), 0);
+
+	// one batch for the structs, one for the typedefs naming them
+	const typename_stats_t *stats = &db.sql.typename_stats;
+	ASSERT_EQ(stats->num_single, 0);
+	ASSERT(stats->num_many <= 2);
+	ASSERT(stats->many_keys >= 2 * INDEX_STRUCTS);
+
+	ASSERT_EQ(cf_db_close(&db), 0);
+
+	// the last struct and its typedef were both stored
+	ASSERT_EQ(cf_db_open_sql(db_path, /*ro*/true, &db), 0);
+	const char *const names[] = {
+		"s1999",
+		"t1999",
+	};
+	for (size_t i = 0; i < ARRAY_LEN(names); ++i) {
+		cf_str_t name;
+		db_typename_iter_t iter;
+		size_t num_found = 0;
+
+		cf_str_borrow(names[i], strlen(names[i]), &name);
+		ASSERT_EQ(cf_db_typename_find(&db, &name, NULL, &iter), 0);
+		while (db_typename_iter_next(&iter)) {
+			++num_found;
+		}
+		db_typename_iter_free(&iter);
+		ASSERT_EQ(num_found, 1);
+	}
+	ASSERT_EQ(cf_db_close(&db), 0);
+	free_src_tree(&tree);
+	return 0;
+}
+
+/*
+ * Write file `name` of `tree`: `INDEX_STRUCTS` structs "s<i>", each followed
+ * by typedef "t<i>" of it.
+ */
+static int
+write_structs(const src_tree_t *tree, const char *name)
+{
+	char *src = NULL;
+	size_t src_len = 0;
+	FILE *stream = open_memstream(&src, &src_len);
+	if (!stream) {
+		return errno;
+	}
+	for (unsigned i = 0; i < INDEX_STRUCTS; ++i) {
+		fprintf(stream, "struct s%u { int a; struct s%u *b; };\n"
+				"typedef struct s%u t%u;\n", i, i, i, i);
+	}
+	if (fclose(stream)) {
+		free(src);
+		return errno;
+	}
+	const int error = src_tree_write(tree, name, src);
+	free(src);
+	return error;
+}
+
+/*
+ * Fill `db`, then look up every variant of every name in one batch.
+ *
+ * Each result must be the type inserted for that variant, or zero for one
+ * that wasn't, and agree with cf_db_typename_lookup() on the same key.
+ */
+static int
+run_lookup_many(cf_db_t *db, const src_tree_t *tree, CF_UNUSED void *arg)
+{
+	static lookup_name_t names[LOOKUP_NAMES];
+	db_typename_key_t keys[LOOKUP_NAMES * LOOKUP_VARIANTS];
+	type_ref_t found[LOOKUP_NAMES * LOOKUP_VARIANTS];
+
+	ASSERT_EQ(fill_db(db, tree, names), 0);
+
+	for (size_t i = 0; i < LOOKUP_NAMES; ++i) {
+		for (size_t v = 0; v < LOOKUP_VARIANTS; ++v) {
+			keys[i * LOOKUP_VARIANTS + v] = (db_typename_key_t) {
+				.loc = &names[i].locs[v],
+				.name = &names[i].names[v],
+			};
+		}
+	}
+	memset(found, 0xff, sizeof(found));
+	ASSERT_EQ(cf_db_typename_lookup_many(db, keys, ARRAY_LEN(keys), found),
+			0);
+
+	for (size_t i = 0; i < LOOKUP_NAMES; ++i) {
+		for (size_t v = 0; v < LOOKUP_VARIANTS; ++v) {
+			const type_ref_t *result = &found[i * LOOKUP_VARIANTS + v];
+			ASSERT_EQ(result->rowid, names[i].types[v].rowid);
+
+			type_ref_t one;
+			const int error = cf_db_typename_lookup(db, &names[i].locs[v],
+					&names[i].names[v], &one);
+			if (names[i].types[v].rowid) {
+				ASSERT_EQ(error, 0);
+				ASSERT_EQ(one.rowid, result->rowid);
+			} else {
+				ASSERT_EQ(error, ENOENT);
+			}
+		}
+	}
+
+	// the tag and typedef namespaces are separate
+	ASSERT_NEQ(names[0].types[0].rowid, names[0].types[1].rowid);
+	return 0;
+}
+
+/*
+ * Insert typenames for `LOOKUP_NAMES` names into `db`, each naming a type of
+ * its own, and describe them in `names`.
+ *
+ * Every name is a struct in "a.c". Some names are also a typedef in "a.c", a
+ * struct at scope 1 in "a.c", or a struct in "b.c".
+ */
+static int
+fill_db(cf_db_t *db, const src_tree_t *tree, lookup_name_t *names)
+{
+	int error;
+	char path[PATH_MAX];
+	file_ref_t files[2];
+	bool alias;
+
+	const char *const file_names[] = {
+		"a.c",
+		"b.c",
+	};
+	for (size_t i = 0; i < ARRAY_LEN(files); ++i) {
+		// distinct contents, so neither is a duplicate of the other
+		if ((error = src_tree_write(tree, file_names[i], file_names[i]))) {
+			return error;
+		}
+		if ((error = src_tree_path(tree, file_names[i], path,
+				sizeof(path)))) {
+			return error;
+		}
+		if ((error = cf_db_add_file(db, path, strlen(path), &files[i],
+				&alias))) {
+			return error;
+		}
+	}
+
+	for (unsigned i = 0; i < LOOKUP_NAMES; ++i) {
+		lookup_name_t *entry = &names[i];
+		memset(entry, 0, sizeof(*entry));
+		snprintf(entry->name, sizeof(entry->name), "n%u", i);
+		snprintf(entry->miss, sizeof(entry->miss), "m%u", i);
+
+		const bool inserted[LOOKUP_VARIANTS] = {
+			true,
+			(i % 2) == 0,
+			(i % 3) == 0,
+			(i % 5) == 0,
+			false,
+		};
+		for (size_t v = 0; v < LOOKUP_VARIANTS; ++v) {
+			const char *name = (v == 4) ? entry->miss : entry->name;
+			entry->locs[v] = (loc_ctx_t) {
+				.file = files[(v == 3) ? 1 : 0],
+				.scope = (v == 2) ? 1 : 0,
+				.line = i + 1,
+				.column = (uint32_t)v + 1,
+			};
+			entry->names[v].kind = (v == 1) ? name_kind_typedef :
+					name_kind_direct;
+			cf_str_borrow(name, strlen(name), &entry->names[v].name);
+			if (!inserted[v]) {
+				continue;
+			}
+			if ((error = insert_typename(db, &entry->locs[v],
+					&entry->names[v], &entry->types[v]))) {
+				return error;
+			}
+		}
+	}
+	return 0;
+}
+
+/*
+ * Insert a struct type at `loc` and typename `name` for it.
+ */
+static int
+insert_typename(cf_db_t *db, const loc_ctx_t *loc, db_typename_t *name,
+		type_ref_t *type_out)
+{
+	int error;
+	const db_type_entry_t type = {
+		.kind = type_kind_struct,
+		.complete = true,
+	};
+
+	if ((error = cf_db_type_insert(db, loc, &type, type_out))) {
+		return error;
+	}
+	name->base_type = *type_out;
+	return cf_db_typename_insert(db, loc, name);
+}
@@ -0,0 +1,194 @@
+/*
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ * Copyright (C) 2024 cfind developer
+ *
+ * Merging index fragments, one sqlite database per TU, with `input_fragment`.
+ */
+#define _POSIX_C_SOURCE 200809L // for PATH_MAX
+#include "test_utils.h"
+#include "src_tree.h"
+#include "db_check.h"
+#include "../cf_index.h"
+
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static int test_merge_fragments(void);
+static int test_merge_commands(void);
+TEST_DECL(test_merge_fragments);
+TEST_DECL(test_merge_commands);
+
+/*
+ * Index each TU to a fragment, as `cfind-cc` does, merge the fragments into
+ * one database, and compare it with the same TUs indexed into a database
+ * directly.
+ *
+ * "a.c" and "b.c" include "h.h", so merging has to deduplicate the header's
+ * file and types across fragments. "c.c" includes a byte-identical copy of
+ * it; in its own fragment, the copy is just another file, and its types must
+ * resolve to the original's. Rowids differ between the databases; the
+ * entries they join to must not.
+ */
+static int
+test_merge_fragments(void)
+{
+	int error;
+	src_tree_t tree;
+	char db_path[PATH_MAX];
+	char *merged = NULL;
+	char *direct = NULL;
+	size_t dangling;
+
+	const char *const tus[] = {
+		"a.c",
+		"b.c",
+		"c.c",
+	};
+	const char *const frags[] = {
+		"a.frag",
+		"b.frag",
+		"c.frag",
+	};
+	const index_config_t frag_config = {0};
+	const index_config_t merge_config = {
+		.input_kind = input_fragment,
+	};
+	const index_config_t direct_config = {0};
+
+	static const char header[] =
+		"struct pt { int x; int y; };\n"
+		"typedef struct { struct pt min; struct pt max; } box_t;\n";
+
+	ASSERT_EQ(make_src_tree(&tree), 0);
+	ASSERT_EQ(src_tree_write(&tree, "h.h", header), 0);
+	ASSERT_EQ(src_tree_write(&tree, "copy/h.h", header), 0);
+	ASSERT_EQ(src_tree_write(&tree, "a.c",
+			"#include \"h.h\"\n"
+			"struct shape {\n"
+			"	box_t bounds;\n"
+			"	union { struct pt center; int radius; } u;\n"
+			"};\n"), 0);
+	ASSERT_EQ(src_tree_write(&tree, "b.c",
+			"#include \"h.h\"\n"
+			"struct path { struct pt *points; box_t bounds; };\n"), 0);
+	ASSERT_EQ(src_tree_write(&tree, "c.c",
+			"#include \"copy/h.h\"\n"
+			"struct label { box_t bounds; struct pt anchor; };\n"), 0);
+
+	for (size_t i = 0; i < ARRAY_LEN(tus); ++i) {
+		ASSERT_EQ(src_tree_index(&tree, frags[i], &tus[i], 1, &frag_config),
+				0);
+	}
+	ASSERT_EQ(src_tree_index(&tree, "merged.db", frags, ARRAY_LEN(frags),
+			&merge_config), 0);
+	ASSERT_EQ(src_tree_index(&tree, "direct.db", tus, ARRAY_LEN(tus),
+			&direct_config), 0);
+
+	ASSERT_EQ(src_tree_path(&tree, "merged.db", db_path, sizeof(db_path)),
+			0);
+	ASSERT_EQ(count_dangling_refs(db_path, &dangling), 0);
+	ASSERT_EQ(dangling, 0);
+	ASSERT_EQ(dump_db_entries(db_path, &merged), 0);
+
+	ASSERT_EQ(src_tree_path(&tree, "direct.db", db_path, sizeof(db_path)), 0);
+	ASSERT_EQ(dump_db_entries(db_path, &direct), 0);
+	ASSERT(strstr(direct, "typename box_t "));
+
+	error = strcmp(merged, direct);
+	if (error) {
+		printf("merged:\n%s\ndirect:\n%s\n", merged, direct);
+	}
+	free(merged);
+	free(direct);
+	free_src_tree(&tree);
+
+	ASSERT_EQ(error, 0);
+	return 0;
+}
+
+/*
+ * Index each TU to a fragment with the compiler command line that builds it,
+ * as `cfind-cc` does, then merge the fragments.
+ *
+ * The command already names the source, and writes an object file with `-o`.
+ * The merged fragments must match the TUs indexed with default arguments.
+ */
+static int
+test_merge_commands(void)
+{
+	int error;
+	src_tree_t tree;
+	char db_path[PATH_MAX];
+	char src_path[PATH_MAX];
+	char obj_path[PATH_MAX];
+	char *merged = NULL;
+	char *direct = NULL;
+
+	const char *const tus[] = {
+		"a.c",
+		"b.c",
+	};
+	const char *const objs[] = {
+		"a.o",
+		"b.o",
+	};
+	const char *const frags[] = {
+		"a.frag",
+		"b.frag",
+	};
+	const index_config_t merge_config = {
+		.input_kind = input_fragment,
+	};
+	const index_config_t direct_config = {0};
+
+	ASSERT_EQ(make_src_tree(&tree), 0);
+	ASSERT_EQ(src_tree_write(&tree, "h.h",
+			"struct vec { int dx; int dy; };\n"), 0);
+	ASSERT_EQ(src_tree_write(&tree, "a.c",
+			"#include \"h.h\"\n"
+			"struct body { struct vec p; struct vec v; };\n"), 0);
+	ASSERT_EQ(src_tree_write(&tree, "b.c",
+			"#include \"h.h\"\n"
+			"typedef struct vec vec_t;\n"), 0);
+
+	for (size_t i = 0; i < ARRAY_LEN(tus); ++i) {
+		ASSERT_EQ(src_tree_path(&tree, tus[i], src_path,
+				sizeof(src_path)), 0);
+		ASSERT_EQ(src_tree_path(&tree, objs[i], obj_path,
+				sizeof(obj_path)), 0);
+		const char *const argv[] = {
+			"clang", "-std=c17", "-c", src_path, "-o", obj_path,
+		};
+		const index_config_t frag_config = {
+			.input_kind = input_command,
+			.command_argv = argv,
+			.command_argc = ARRAY_LEN(argv),
+		};
+		ASSERT_EQ(src_tree_index(&tree, frags[i], &tus[i], 1, &frag_config),
+				0);
+	}
+	ASSERT_EQ(src_tree_index(&tree, "merged.db", frags, ARRAY_LEN(frags),
+			&merge_config), 0);
+	ASSERT_EQ(src_tree_index(&tree, "direct.db", tus, ARRAY_LEN(tus),
+			&direct_config), 0);
+
+	ASSERT_EQ(src_tree_path(&tree, "merged.db", db_path, sizeof(db_path)),
+			0);
+	ASSERT_EQ(dump_db_entries(db_path, &merged), 0);
+	ASSERT_EQ(src_tree_path(&tree, "direct.db", db_path, sizeof(db_path)), 0);
+	ASSERT_EQ(dump_db_entries(db_path, &direct), 0);
+	ASSERT(strstr(direct, "typename vec_t "));
+
+	error = strcmp(merged, direct);
+	if (error) {
+		printf("merged:\n%s\ndirect:\n%s\n", merged, direct);
+	}
+	free(merged);
+	free(direct);
+	free_src_tree(&tree);
+
+	ASSERT_EQ(error, 0);
+	return 0;
+}
@@ -0,0 +1,194 @@
+/*
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ * Copyright (C) 2024 cfind developer
+ *
+ * Recording commands to a query log and replaying them, as `cfind -L` and
+ * `cfind-bench replay` do.
+ */
+#define _POSIX_C_SOURCE 200809L // for PATH_MAX
+#include "test_utils.h"
+#include "src_tree.h"
+#include "../cf_db.h"
+#include "../cf_index.h"
+#include "../cf_string.h"
+#include "../query_log.h"
+#include "../scan.h"
+#include "../search.h"
+
+#include <errno.h>
+#include <limits.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+
+static int test_query_log_records(void);
+static int test_query_log_replay(void);
+TEST_DECL(test_query_log_records);
+TEST_DECL(test_query_log_replay);
+
+/*
+ * Append records, and a line cut short in between, then read them back.
+ *
+ * Every field must survive, including a command with spaces and a newline in
+ * it. The cut line is reported as malformed without losing the record after
+ * it.
+ */
+static int
+test_query_log_records(void)
+{
+	src_tree_t tree;
+	char path[PATH_MAX];
+	query_log_t log;
+	query_record_t rec;
+
+	const char *const cmds[] = {
+		"typename pt",
+		"memberdecl struct rect\nb",
+		"tn -l 3 %",
+	};
+	query_record_t records[] = {
+		{
+			.time_ms = 1700000000123,
+			.latency_us = 42,
+			.num_results = 1,
+			.kind = search_typename,
+		},
+		{
+			.time_ms = 1700000000456,
+			.latency_us = 0,
+			.num_results = 0,
+			.error = -2,
+			.kind = search_member_decl,
+		},
+		{
+			.time_ms = 1700000000789,
+			.latency_us = 1234567,
+			.num_results = 3,
+			.scan = true,
+			.kind = search_typename,
+		},
+	};
+
+	ASSERT_EQ(make_src_tree(&tree), 0);
+	ASSERT_EQ(src_tree_path(&tree, "q.log", path, sizeof(path)), 0);
+
+	for (size_t i = 0; i < ARRAY_LEN(records); ++i) {
+		cf_str_borrow(cmds[i], strlen(cmds[i]), &records[i].cmd);
+		ASSERT_EQ(query_log_append(path, &records[i]), 0);
+		if (i == 0) {
+			// a record whose write was cut short
+			FILE *f = fopen(path, "a");
+			ASSERT(f);
+			fputs("q1 1700000000200 17 1 0 0 2 11:typen\n", f);
+			ASSERT_EQ(fclose(f), 0);
+		}
+	}
+
+	ASSERT_EQ(query_log_load(path, &log), 0);
+	for (size_t i = 0; i < ARRAY_LEN(records); ++i) {
+		if (i == 1) {
+			ASSERT_EQ(query_log_next(&log, &rec), EILSEQ);
+		}
+		ASSERT_EQ(query_log_next(&log, &rec), 0);
+		ASSERT_EQ(rec.time_ms, records[i].time_ms);
+		ASSERT_EQ(rec.latency_us, records[i].latency_us);
+		ASSERT_EQ(rec.num_results, records[i].num_results);
+		ASSERT_EQ(rec.error, records[i].error);
+		ASSERT_EQ(rec.scan, records[i].scan);
+		ASSERT_EQ(rec.kind, records[i].kind);
+		ASSERT(str_is(&rec.cmd, cmds[i]));
+	}
+	ASSERT_EQ(query_log_next(&log, &rec), ENOENT);
+	query_log_free(&log);
+
+	free_src_tree(&tree);
+	return 0;
+}
+
+/*
+ * Run commands on an indexed database with a query log, then replay the log
+ * against the same database.
+ *
+ * Only commands that parse are logged. Each replayed command must find as
+ * many results as were logged and fail only if it failed when logged, with
+ * and without the scan engine.
+ */
+static int
+test_query_log_replay(void)
+{
+	src_tree_t tree;
+	char db_path[PATH_MAX];
+	char log_path[PATH_MAX];
+	cf_db_t db;
+	scan_table_t table;
+	query_log_t log;
+	query_record_t rec;
+	size_t num_records = 0;
+	size_t num_found = 0;
+
+	const char *const tus[] = {
+		"a.c",
+	};
+	const index_config_t config = {0};
+	const char *const cmds[] = {
+		"typename pt",
+		"typename missing",
+		"tn -l 1 %",
+		"memberdecl struct rect b",
+		"memberdecl struct rect nope",
+		"not a command",
+	};
+
+	ASSERT_EQ(make_src_tree(&tree), 0);
+	ASSERT_EQ(src_tree_write(&tree, "a.c",
+			"struct pt { int x; int y; };\n"
+			"struct rect { struct pt a; struct pt b; };\n"
+			"typedef struct rect rect_t;\n"), 0);
+	ASSERT_EQ(src_tree_index(&tree, "x.db", tus, ARRAY_LEN(tus), &config),
+			0);
+	ASSERT_EQ(src_tree_path(&tree, "x.db", db_path, sizeof(db_path)), 0);
+	ASSERT_EQ(src_tree_path(&tree, "q.log", log_path, sizeof(log_path)), 0);
+
+	for (size_t i = 0; i < ARRAY_LEN(cmds); ++i) {
+		for (int scan = 0; scan < 2; ++scan) {
+			const search_opts_t opts = {
+				.scan = scan,
+				.log_path = log_path,
+			};
+			cf_str_t cmd;
+			cf_str_borrow(cmds[i], strlen(cmds[i]), &cmd);
+			(void)run_one_command(db_path, &cmd, &opts);
+		}
+	}
+
+	ASSERT_EQ(cf_db_open_sql(db_path, /*ro*/false, &db), 0);
+	ASSERT_EQ(scan_table_load(&db.sql, &table), 0);
+	ASSERT_EQ(query_log_load(log_path, &log), 0);
+
+	int error;
+	while ((error = query_log_next(&log, &rec)) != ENOENT) {
+		ASSERT_EQ(error, 0);
+		num_records++;
+		num_found += rec.num_results;
+
+		const search_opts_t opts = {
+			.scan = rec.scan,
+		};
+		search_result_t result;
+		error = search_exec(&db, rec.scan ? &table : NULL, &rec.cmd,
+				&opts, &result);
+		ASSERT_EQ(result.kind, rec.kind);
+		ASSERT_EQ(result.num_results, rec.num_results);
+		ASSERT_EQ(!error, !rec.error);
+	}
+	query_log_free(&log);
+	scan_table_free(&table);
+	ASSERT_EQ(cf_db_close(&db), 0);
+
+	// every command but the last parsed, once per engine
+	ASSERT_EQ(num_records, 2 * (ARRAY_LEN(cmds) - 1));
+	ASSERT(num_found);
+
+	free_src_tree(&tree);
+	return 0;
+}
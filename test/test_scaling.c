@@ -0,0 +1,448 @@
+/*
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ * Copyright (C) 2024 cfind developer
+ *
+ * Algorithmic complexity tests.
+ *
+ * Each test generates a pathological C input at doubling sizes, indexes each
+ * one, and fits the scaling exponent `k` of index time and peak memory
+ * (t ~ n^k). An n*log(n) algorithm fits k a little above 1 over these
+ * ranges; a quadratic one fits k near 2. A test fails if any dimension fits
+ * above SCALING_MAX_EXPONENT, or above a documented, looser bound for index
+ * time where the growth is in libclang rather than in cfind.
+ *
+ * These take minutes, so they only run when environment variable
+ * `CFIND_TEST_SCALING` is set. Otherwise they pass immediately.
+ */
+#define _POSIX_C_SOURCE 200809L // for open_memstream(3)
+#include "test_utils.h"
+#include "src_tree.h"
+#include "../cf_db.h"
+#include "../cf_index.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <math.h>
+#include <paths.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+
+static int test_scaling_wide_struct(void);
+static int test_scaling_nested_records(void);
+static int test_scaling_typedef_chain(void);
+static int test_scaling_many_structs(void);
+TEST_DECL(test_scaling_wide_struct);
+TEST_DECL(test_scaling_nested_records);
+TEST_DECL(test_scaling_typedef_chain);
+TEST_DECL(test_scaling_many_structs);
+
+/*
+ * Largest allowed fitted exponent.
+ *
+ * n*log(n) over a 8x range starting at n=1000 fits about 1.1. Leave room for
+ * timing noise.
+ */
+#define SCALING_MAX_EXPONENT 1.3
+
+/*
+ * Largest allowed fitted exponent of index time for a typedef chain.
+ *
+ * libclang walks the whole sugar chain of a typedef each time it makes a
+ * CXType for it, so getting the type a typedef names is O(depth) and indexing
+ * a chain of n is O(n^2) however few such calls cfind makes (one per
+ * typedef). Quadratic growth here is expected; leave room for timing noise.
+ */
+#define TYPEDEF_CHAIN_MAX_EXPONENT 2.2
+
+/*
+ * Number of input sizes. Each is double the previous one.
+ */
+#define SCALING_STEPS 4
+
+/*
+ * Memory growth, in KiB, below which the memory fit is skipped. Smaller
+ * differences in peak RSS are mostly allocator noise.
+ */
+#define SCALING_MIN_RSS_KB (8 * 1024)
+
+/*
+ * Depth of each run of nested anonymous records. clang rejects nesting deeper
+ * than 256.
+ */
+#define NEST_DEPTH 64
+
+/*
+ * Write C source of size `n` to `f`.
+ */
+typedef void (*scaling_gen_t)(FILE *f, size_t n);
+
+/*
+ * Measurements of one index run.
+ *
+ * Members
+ * - secs
+ *   Wall time of cf_index_project().
+ * - rss_kb
+ *   Growth in peak RSS during cf_index_project().
+ */
+typedef struct {
+	double secs;
+	long rss_kb;
+} scaling_sample_t;
+
+static int run_scaling(const char *name, scaling_gen_t gen, size_t max_n,
+		double max_time_k);
+static int measure_backend(int kind, scaling_gen_t gen, size_t n,
+		scaling_sample_t *out);
+static int measure_child(int kind, const src_tree_t *tree,
+		scaling_sample_t *out);
+static int write_input(scaling_gen_t gen, size_t n, const src_tree_t *tree);
+static double fit_exponent(const size_t *n, const double *y, size_t len);
+static double now_secs(void);
+
+static void gen_wide_struct(FILE *f, size_t n);
+static void gen_nested_records(FILE *f, size_t n);
+static void gen_typedef_chain(FILE *f, size_t n);
+static void gen_many_structs(FILE *f, size_t n);
+
+/*
+ * One struct with up to 100k members.
+ */
+static int
+test_scaling_wide_struct(void)
+{
+	return run_scaling("wide struct", gen_wide_struct, 100000,
+			SCALING_MAX_EXPONENT);
+}
+
+/*
+ * Up to 16k anonymous records, nested `NEST_DEPTH` deep.
+ */
+static int
+test_scaling_nested_records(void)
+{
+	return run_scaling("nested records", gen_nested_records, 16384,
+			SCALING_MAX_EXPONENT);
+}
+
+/*
+ * A chain of up to 10k typedefs, each naming the previous one.
+ *
+ * Index time is bound by libclang; see TYPEDEF_CHAIN_MAX_EXPONENT.
+ */
+static int
+test_scaling_typedef_chain(void)
+{
+	return run_scaling("typedef chain", gen_typedef_chain, 10000,
+			TYPEDEF_CHAIN_MAX_EXPONENT);
+}
+
+/*
+ * A single file with up to 50k struct definitions.
+ */
+static int
+test_scaling_many_structs(void)
+{
+	return run_scaling("many structs", gen_many_structs, 50000,
+			SCALING_MAX_EXPONENT);
+}
+
+/*
+ * Index input `gen` at `SCALING_STEPS` doubling sizes up to `max_n`, into
+ * both the memory and sql backends. Fit and check exponents: at most
+ * `max_time_k` for index time and SCALING_MAX_EXPONENT for memory.
+ */
+static int
+run_scaling(const char *name, scaling_gen_t gen, size_t max_n,
+		double max_time_k)
+{
+	static const struct {
+		int kind;
+		const char *name;
+	} backends[] = {
+		{db_kind_mem, "mem"},
+		{db_kind_sql, "sql"},
+	};
+
+	if (!getenv("CFIND_TEST_SCALING")) {
+		printf("skipped; set CFIND_TEST_SCALING to run\n");
+		return 0;
+	}
+
+	size_t sizes[SCALING_STEPS];
+	for (size_t i = 0; i < SCALING_STEPS; ++i) {
+		sizes[i] = max_n >> (SCALING_STEPS - 1 - i);
+	}
+
+	int failed = 0;
+	for (size_t b = 0; b < ARRAY_LEN(backends); ++b) {
+		double secs[SCALING_STEPS];
+		double rss[SCALING_STEPS];
+
+		for (size_t i = 0; i < SCALING_STEPS; ++i) {
+			scaling_sample_t sample;
+			ASSERT_EQ(measure_backend(backends[b].kind, gen, sizes[i],
+					&sample), 0);
+			printf("%s/%s n=%zu: %.3fs, +%ldKiB\n", name, backends[b].name,
+					sizes[i], sample.secs, sample.rss_kb);
+			secs[i] = sample.secs;
+			// a fit needs logs of positive numbers
+			rss[i] = (sample.rss_kb > 0) ? (double)sample.rss_kb : 1;
+		}
+
+		const double time_k = fit_exponent(sizes, secs, SCALING_STEPS);
+		printf("%s/%s: time ~ n^%.2f\n", name, backends[b].name, time_k);
+		if (time_k > max_time_k) {
+			printf("%s/%s: index time grows faster than n^%.1f\n", name,
+					backends[b].name, max_time_k);
+			failed = 1;
+		}
+
+		if (rss[SCALING_STEPS - 1] < SCALING_MIN_RSS_KB) {
+			printf("%s/%s: memory too small to fit\n", name,
+					backends[b].name);
+			continue;
+		}
+		const double rss_k = fit_exponent(sizes, rss, SCALING_STEPS);
+		printf("%s/%s: memory ~ n^%.2f\n", name, backends[b].name, rss_k);
+		if (rss_k > SCALING_MAX_EXPONENT) {
+			printf("%s/%s: memory grows faster than n*log(n)\n", name,
+					backends[b].name);
+			failed = 1;
+		}
+	}
+
+	return failed;
+}
+
+/*
+ * Generate an input of size `n` in a new source tree and index it in a child
+ * process.
+ *
+ * A child is used so each run's peak RSS is its own, rather than the highest
+ * of every test so far.
+ */
+static int
+measure_backend(int kind, scaling_gen_t gen, size_t n,
+		scaling_sample_t *out)
+{
+	int error;
+	src_tree_t tree;
+	int fds[2];
+
+	if ((error = make_src_tree(&tree))) {
+		return error;
+	}
+	if ((error = write_input(gen, n, &tree))) {
+		goto fail;
+	}
+
+	if (pipe(fds)) {
+		error = errno;
+		goto fail;
+	}
+
+	fflush(stdout);
+	const pid_t pid = fork();
+	if (pid == -1) {
+		error = errno;
+		close(fds[0]);
+		close(fds[1]);
+		goto fail;
+	}
+
+	if (!pid) {
+		// the indexer logs every entry; that isn't what's being measured
+		const int null_fd = open(_PATH_DEVNULL, O_WRONLY);
+		if (null_fd != -1) {
+			(void)dup2(null_fd, STDOUT_FILENO);
+			close(null_fd);
+		}
+
+		close(fds[0]);
+		scaling_sample_t sample;
+		const int child_error = measure_child(kind, &tree, &sample);
+		if (!child_error) {
+			(void)!write(fds[1], &sample, sizeof(sample));
+		}
+		_exit(child_error ? 1 : 0);
+	}
+
+	close(fds[1]);
+	const ssize_t len = read(fds[0], out, sizeof(*out));
+	close(fds[0]);
+
+	int wstatus;
+	while (waitpid(pid, &wstatus, 0) == -1) {
+		if (errno != EINTR) {
+			error = errno;
+			goto fail;
+		}
+	}
+	if (!WIFEXITED(wstatus) || WEXITSTATUS(wstatus) ||
+			(len != (ssize_t)sizeof(*out))) {
+		printf("index of n=%zu failed\n", n);
+		error = ECHILD;
+		goto fail;
+	}
+
+fail:
+	free_src_tree(&tree);
+	return error;
+}
+
+/*
+ * Index "in.c" of `tree` into a new database of kind `kind`.
+ *
+ * Only runs in the child process.
+ */
+static int
+measure_child(int kind, const src_tree_t *tree, scaling_sample_t *out)
+{
+	int error;
+	cf_db_t db;
+	char path[PATH_MAX];
+	struct rusage before;
+	struct rusage after;
+
+	if ((error = src_tree_path(tree, "in.c", path, sizeof(path)))) {
+		return error;
+	}
+	if ((error = src_tree_open_db(tree, kind, &db))) {
+		return error;
+	}
+
+	const char *const inputs[] = {
+		path,
+	};
+	const index_config_t config = {
+		.db_kind = index_db_borrowed,
+		.input_kind = input_source_file,
+		.db_args.db = &db,
+		.input_paths = inputs,
+		.num_inputs = ARRAY_LEN(inputs),
+	};
+
+	getrusage(RUSAGE_SELF, &before);
+	const double start = now_secs();
+	error = cf_index_project(&config);
+	out->secs = now_secs() - start;
+	getrusage(RUSAGE_SELF, &after);
+	out->rss_kb = after.ru_maxrss - before.ru_maxrss;
+
+	cf_db_close(&db);
+	return error;
+}
+
+/*
+ * Write the output of `gen` for size `n` to file "in.c" of `tree`.
+ *
+ * The indexer registers its input by path, so this is a real file rather than
+ * a `src_adaptor_t`.
+ */
+static int
+write_input(scaling_gen_t gen, size_t n, const src_tree_t *tree)
+{
+	int error;
+	char *src = NULL;
+	size_t len = 0;
+
+	FILE *f = open_memstream(&src, &len);
+	if (!f) {
+		return errno;
+	}
+	gen(f, n);
+	if (fclose(f)) {
+		error = errno;
+		free(src);
+		return error;
+	}
+
+	error = src_tree_write(tree, "in.c", src);
+	free(src);
+	return error;
+}
+
+/*
+ * Least-squares slope of log(y) against log(n).
+ */
+static double
+fit_exponent(const size_t *n, const double *y, size_t len)
+{
+	double sum_x = 0;
+	double sum_y = 0;
+	double sum_xx = 0;
+	double sum_xy = 0;
+
+	for (size_t i = 0; i < len; ++i) {
+		const double x = log((double)n[i]);
+		const double ly = log(y[i]);
+		sum_x += x;
+		sum_y += ly;
+		sum_xx += x * x;
+		sum_xy += x * ly;
+	}
+
+	return ((len * sum_xy) - (sum_x * sum_y)) /
+			((len * sum_xx) - (sum_x * sum_x));
+}
+
+static double
+now_secs(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + (ts.tv_nsec / 1e9);
+}
+
+static void
+gen_wide_struct(FILE *f, size_t n)
+{
+	fprintf(f, "struct wide {\n");
+	for (size_t i = 0; i < n; ++i) {
+		fprintf(f, "\tint m%zu;\n", i);
+	}
+	fprintf(f, "};\n");
+}
+
+static void
+gen_nested_records(FILE *f, size_t n)
+{
+	fprintf(f, "struct nest {\n");
+	for (size_t i = 0; i < n; i += NEST_DEPTH) {
+		for (size_t d = 0; d < NEST_DEPTH; ++d) {
+			fprintf(f, "struct {\n");
+		}
+		fprintf(f, "int x;\n");
+		for (size_t d = 0; d < NEST_DEPTH; ++d) {
+			fprintf(f, "} f%zu_%zu;\n", i, d);
+		}
+	}
+	fprintf(f, "};\n");
+}
+
+static void
+gen_typedef_chain(FILE *f, size_t n)
+{
+	fprintf(f, "struct base { int a; };\n");
+	fprintf(f, "typedef struct base t0;\n");
+	for (size_t i = 1; i < n; ++i) {
+		fprintf(f, "typedef t%zu t%zu;\n", i - 1, i);
+	}
+	fprintf(f, "t%zu last;\n", n - 1);
+}
+
+static void
+gen_many_structs(FILE *f, size_t n)
+{
+	for (size_t i = 0; i < n; ++i) {
+		fprintf(f, "struct s%zu { int a; long b; };\n", i);
+	}
+}
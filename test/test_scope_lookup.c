@@ -0,0 +1,184 @@
+/*
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ * Copyright (C) 2024 cfind developer
+ *
+ * Typename lookups and searches keyed by scope and function.
+ */
+#define _POSIX_C_SOURCE 200809L // for PATH_MAX
+#include "test_utils.h"
+#include "src_tree.h"
+#include "../cf_db.h"
+#include "../cf_string.h"
+#include "../db_types.h"
+
+#include <errno.h>
+#include <limits.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+
+static int test_scope_lookup_mem(void);
+static int test_scope_lookup_sql(void);
+static int test_scope_lookup_log(void);
+TEST_DECL(test_scope_lookup_mem);
+TEST_DECL(test_scope_lookup_sql);
+TEST_DECL(test_scope_lookup_log);
+
+/*
+ * Typenames named "s" in file "a.c", all at the same line, told apart only by
+ * kind, scope, and function. The last is looked up but never inserted.
+ */
+typedef struct {
+	typename_kind_t kind;
+	uint32_t scope;
+	size_t func;
+	bool inserted;
+} scope_case_t;
+
+static const scope_case_t cases[] = {
+	{name_kind_direct, scope_global, 0, true},
+	{name_kind_direct, scope_nested, 1, true},
+	{name_kind_direct, scope_nested, 2, true},
+	{name_kind_direct, scope_nested + 1, 1, true},
+	{name_kind_typedef, scope_nested, 1, true},
+	{name_kind_direct, scope_nested, 3, false},
+};
+
+// number of `cases` inserted at file scope and in a function
+#define NUM_GLOBAL 1
+#define NUM_LOCAL 4
+
+static int run_scope_lookup(cf_db_t *db, const src_tree_t *tree,
+		void *find_arg);
+static int count_found(cf_db_t *db, db_scope_filter_t scope, size_t *out);
+
+static int
+test_scope_lookup_mem(void)
+{
+	return src_tree_with_db(db_kind_mem, run_scope_lookup, &(bool){true});
+}
+
+static int
+test_scope_lookup_sql(void)
+{
+	return src_tree_with_db(db_kind_sql, run_scope_lookup, &(bool){true});
+}
+
+/*
+ * A log can't be searched, only looked up in.
+ */
+static int
+test_scope_lookup_log(void)
+{
+	return src_tree_with_db(db_kind_log, run_scope_lookup, &(bool){false});
+}
+
+/*
+ * Insert each of `cases` that's marked inserted, naming a type of its own,
+ * then look each one up, singly and in one batch.
+ *
+ * Each lookup must find the type inserted with exactly its kind, scope, and
+ * function, or nothing. If `find_arg` points to true, also search by scope
+ * filter.
+ */
+static int
+run_scope_lookup(cf_db_t *db, const src_tree_t *tree, void *find_arg)
+{
+	const bool find = *(const bool *)find_arg;
+	char path[PATH_MAX];
+	file_ref_t file;
+	bool alias;
+	loc_ctx_t locs[ARRAY_LEN(cases)];
+	db_typename_t names[ARRAY_LEN(cases)];
+	type_ref_t types[ARRAY_LEN(cases)];
+	db_typename_key_t keys[ARRAY_LEN(cases)];
+	type_ref_t found[ARRAY_LEN(cases)];
+
+	ASSERT_EQ(src_tree_write(tree, "a.c", "a.c"), 0);
+	ASSERT_EQ(src_tree_path(tree, "a.c", path, sizeof(path)), 0);
+	ASSERT_EQ(cf_db_add_file(db, path, strlen(path), &file, &alias), 0);
+
+	const db_type_entry_t type = {
+		.kind = type_kind_struct,
+		.complete = true,
+	};
+	for (size_t i = 0; i < ARRAY_LEN(cases); ++i) {
+		locs[i] = (loc_ctx_t) {
+			.file = file,
+			.scope = cases[i].scope,
+			.line = 1,
+			.column = 1,
+		};
+		// `index` and `rowid` overlap, so this suits every backend
+		locs[i].func.index = cases[i].func;
+		names[i] = (db_typename_t) {
+			.kind = cases[i].kind,
+		};
+		cf_str_borrow("s", 1, &names[i].name);
+		types[i].rowid = 0;
+		keys[i] = (db_typename_key_t) {
+			.loc = &locs[i],
+			.name = &names[i],
+		};
+		if (!cases[i].inserted) {
+			continue;
+		}
+		ASSERT_EQ(cf_db_type_insert(db, &locs[i], &type, &types[i]), 0);
+		names[i].base_type = types[i];
+		ASSERT_EQ(cf_db_typename_insert(db, &locs[i], &names[i]), 0);
+	}
+
+	memset(found, 0xff, sizeof(found));
+	ASSERT_EQ(cf_db_typename_lookup_many(db, keys, ARRAY_LEN(keys), found),
+			0);
+	for (size_t i = 0; i < ARRAY_LEN(cases); ++i) {
+		type_ref_t one;
+		const int error = cf_db_typename_lookup(db, &locs[i], &names[i],
+				&one);
+
+		ASSERT_EQ(found[i].rowid, types[i].rowid);
+		if (cases[i].inserted) {
+			ASSERT_EQ(error, 0);
+			ASSERT_EQ(one.rowid, types[i].rowid);
+		} else {
+			ASSERT_EQ(error, ENOENT);
+		}
+	}
+
+	if (!find) {
+		return 0;
+	}
+	size_t num;
+	ASSERT_EQ(count_found(db, db_scope_any, &num), 0);
+	ASSERT_EQ(num, NUM_GLOBAL + NUM_LOCAL);
+	ASSERT_EQ(count_found(db, db_scope_global, &num), 0);
+	ASSERT_EQ(num, NUM_GLOBAL);
+	ASSERT_EQ(count_found(db, db_scope_local, &num), 0);
+	ASSERT_EQ(num, NUM_LOCAL);
+	return 0;
+}
+
+/*
+ * Count the typenames named "s" in `db` declared at `scope`.
+ */
+static int
+count_found(cf_db_t *db, db_scope_filter_t scope, size_t *out)
+{
+	int error;
+	db_typename_iter_t iter;
+	cf_str_t name;
+	const db_filter_t filter = {
+		.scope = scope,
+	};
+
+	cf_str_borrow("s", 1, &name);
+	if ((error = cf_db_typename_find(db, &name, &filter, &iter))) {
+		return error;
+	}
+	*out = 0;
+	while (db_typename_iter_next(&iter)) {
+		++*out;
+	}
+	db_typename_iter_free(&iter);
+	return 0;
+}
@@ -0,0 +1,267 @@
+/*
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ * Copyright (C) 2024 cfind developer
+ *
+ * Keyset pagination of typename searches with `db_filter_t::after`.
+ */
+#define _POSIX_C_SOURCE 200809L // for PATH_MAX
+#include "test_utils.h"
+#include "src_tree.h"
+#include "../cf_db.h"
+#include "../cf_string.h"
+#include "../db_types.h"
+
+#include <errno.h>
+#include <limits.h>
+#include <stdio.h>
+#include <string.h>
+
+static int test_search_page_mem(void);
+static int test_search_page_sql(void);
+TEST_DECL(test_search_page_mem);
+TEST_DECL(test_search_page_sql);
+
+/*
+ * Number of typenames inserted by fill_db(), and the size of each page. The
+ * page size doesn't divide the number of matches, so the last page is short.
+ */
+#define PAGE_NAMES 23
+#define PAGE_LIMIT 4
+
+/*
+ * One search result: enough to tell results apart and compare listings.
+ */
+typedef struct {
+	int64_t cursor;
+	type_ref_t type;
+	loc_ctx_t loc;
+} page_row_t;
+
+static int check_paging(cf_db_t *db, const char *pattern, db_order_t order,
+		size_t expect);
+static int find_rows(cf_db_t *db, const char *pattern,
+		const db_filter_t *filter, page_row_t *rows, size_t cap,
+		size_t *len_out);
+static int fill_db(cf_db_t *db, const src_tree_t *tree);
+static int run_search_page_mem(cf_db_t *db, const src_tree_t *tree,
+		void *arg);
+static int run_search_page_sql(cf_db_t *db, const src_tree_t *tree,
+		void *arg);
+
+static int
+test_search_page_mem(void)
+{
+	return src_tree_with_db(db_kind_mem, run_search_page_mem, NULL);
+}
+
+static int
+test_search_page_sql(void)
+{
+	return src_tree_with_db(db_kind_sql, run_search_page_sql, NULL);
+}
+
+/*
+ * Page through a mem database. It only matches exact names, in insertion
+ * order.
+ */
+static int
+run_search_page_mem(cf_db_t *db, const src_tree_t *tree, CF_UNUSED void *arg)
+{
+	ASSERT_EQ(fill_db(db, tree), 0);
+	ASSERT_EQ(check_paging(db, "dup", db_order_none, PAGE_NAMES - 2), 0);
+	return 0;
+}
+
+/*
+ * Page through a sqlite database in every order, with patterns.
+ */
+static int
+run_search_page_sql(cf_db_t *db, const src_tree_t *tree, CF_UNUSED void *arg)
+{
+	ASSERT_EQ(fill_db(db, tree), 0);
+
+	// the orders differ: "aa" sorts first by name, and the last "a.c" entry
+	// by file
+	page_row_t first;
+	size_t len;
+	const db_filter_t by_name = {
+		.order = db_order_name,
+		.limit = 1,
+	};
+	const db_filter_t by_file = {
+		.order = db_order_file,
+		.limit = 1,
+	};
+	ASSERT_EQ(find_rows(db, "%", &by_name, &first, 1, &len), 0);
+	ASSERT_EQ(len, 1);
+	ASSERT_EQ(first.loc.line, PAGE_NAMES - 11);
+	ASSERT_EQ(find_rows(db, "%", &by_file, &first, 1, &len), 0);
+	ASSERT_EQ(len, 1);
+	ASSERT_EQ(first.loc.line, 2);
+
+	ASSERT_EQ(check_paging(db, "dup", db_order_none, PAGE_NAMES - 2), 0);
+	ASSERT_EQ(check_paging(db, "dup", db_order_name, PAGE_NAMES - 2), 0);
+	ASSERT_EQ(check_paging(db, "dup", db_order_file, PAGE_NAMES - 2), 0);
+	ASSERT_EQ(check_paging(db, "%", db_order_none, PAGE_NAMES), 0);
+	ASSERT_EQ(check_paging(db, "%", db_order_name, PAGE_NAMES), 0);
+	ASSERT_EQ(check_paging(db, "%", db_order_file, PAGE_NAMES), 0);
+
+	// a cursor of a row that isn't there fails rather than restarting
+	db_typename_iter_t iter;
+	cf_str_t name;
+	const db_filter_t stale = {
+		.after = 1000,
+	};
+	cf_str_borrow("dup", strlen("dup"), &name);
+	ASSERT_EQ(cf_db_typename_find(db, &name, &stale, &iter), ENOENT);
+	return 0;
+}
+
+/*
+ * Search `db` for `pattern` in `order` once in full and once a page at a
+ * time, each page starting after the cursor of the last row of the one before.
+ *
+ * The full search must return `expect` rows, and the pages strung together
+ * must be the same rows in the same order.
+ */
+static int
+check_paging(cf_db_t *db, const char *pattern, db_order_t order,
+		size_t expect)
+{
+	page_row_t all[PAGE_NAMES];
+	page_row_t paged[PAGE_NAMES + PAGE_LIMIT];
+	size_t num_all;
+	size_t num_paged = 0;
+	size_t num_pages = 0;
+
+	const db_filter_t full = {
+		.order = order,
+	};
+	ASSERT_EQ(find_rows(db, pattern, &full, all, ARRAY_LEN(all), &num_all),
+			0);
+	ASSERT_EQ(num_all, expect);
+
+	db_filter_t filter = {
+		.order = order,
+		.limit = PAGE_LIMIT,
+	};
+	while (true) {
+		size_t len;
+		ASSERT_EQ(find_rows(db, pattern, &filter, &paged[num_paged],
+				ARRAY_LEN(paged) - num_paged, &len), 0);
+		ASSERT(len <= PAGE_LIMIT);
+		num_pages++;
+		ASSERT(num_pages <= ((expect / PAGE_LIMIT) + 1));
+		num_paged += len;
+		if (len < PAGE_LIMIT) {
+			break;
+		}
+		filter.after = paged[num_paged - 1].cursor;
+	}
+
+	ASSERT_EQ(num_paged, num_all);
+	for (size_t i = 0; i < num_all; ++i) {
+		ASSERT_EQ(paged[i].cursor, all[i].cursor);
+		ASSERT_EQ(paged[i].type.rowid, all[i].type.rowid);
+		ASSERT_EQ(paged[i].loc.file.rowid, all[i].loc.file.rowid);
+		ASSERT_EQ(paged[i].loc.line, all[i].loc.line);
+	}
+	return 0;
+}
+
+/*
+ * Copy the results of searching `db` for `pattern` with `filter` to `rows`,
+ * up to `cap` of them.
+ */
+static int
+find_rows(cf_db_t *db, const char *pattern, const db_filter_t *filter,
+		page_row_t *rows, size_t cap, size_t *len_out)
+{
+	int error;
+	db_typename_iter_t iter;
+	cf_str_t name;
+	size_t len = 0;
+
+	cf_str_borrow(pattern, strlen(pattern), &name);
+	if ((error = cf_db_typename_find(db, &name, filter, &iter))) {
+		return error;
+	}
+	while (db_typename_iter_next(&iter)) {
+		if (len == cap) {
+			error = E2BIG;
+			break;
+		}
+		db_typename_t entry;
+		db_typename_iter_peek(&iter, &entry, &rows[len].loc);
+		rows[len].type = entry.base_type;
+		rows[len].cursor = db_typename_iter_cursor(&iter);
+		len++;
+	}
+	db_typename_iter_free(&iter);
+
+	*len_out = len;
+	return error;
+}
+
+/*
+ * Insert `PAGE_NAMES` typenames into `db`, each naming a struct of its own.
+ *
+ * All but two are named "dup", so the name order falls back to rowid. They
+ * alternate between files "b.c" and "a.c", at lines that run backwards, so
+ * insertion, name, and file order all differ.
+ */
+static int
+fill_db(cf_db_t *db, const src_tree_t *tree)
+{
+	int error;
+	char path[PATH_MAX];
+	file_ref_t files[2];
+	bool alias;
+
+	const char *const file_names[] = {
+		"b.c",
+		"a.c",
+	};
+	for (size_t i = 0; i < ARRAY_LEN(files); ++i) {
+		// distinct contents, so neither is a duplicate of the other
+		if ((error = src_tree_write(tree, file_names[i],
+				file_names[i]))) {
+			return error;
+		}
+		if ((error = src_tree_path(tree, file_names[i], path,
+				sizeof(path)))) {
+			return error;
+		}
+		if ((error = cf_db_add_file(db, path, strlen(path), &files[i],
+				&alias))) {
+			return error;
+		}
+	}
+
+	const db_type_entry_t type = {
+		.kind = type_kind_struct,
+		.complete = true,
+	};
+	for (unsigned i = 0; i < PAGE_NAMES; ++i) {
+		const char *name = (i == 5) ? "zz" :
+				(i == 11) ? "aa" : "dup";
+		const loc_ctx_t loc = {
+			.file = files[i % 2],
+			.line = PAGE_NAMES - i,
+			.column = 1,
+		};
+		db_typename_t entry = {
+			.kind = name_kind_direct,
+		};
+
+		if ((error = cf_db_type_insert(db, &loc, &type,
+				&entry.base_type))) {
+			return error;
+		}
+		cf_str_borrow(name, strlen(name), &entry.name);
+		if ((error = cf_db_typename_insert(db, &loc, &entry))) {
+			return error;
+		}
+	}
+	return 0;
+}
@@ -0,0 +1,259 @@
+/*
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ * Copyright (C) 2024 cfind developer
+ *
+ * Source line snippets stored with `index_config_t::snippets`, which back
+ * `cfind --context`.
+ */
+#define _POSIX_C_SOURCE 200809L // for PATH_MAX
+#include "test_utils.h"
+#include "src_tree.h"
+#include "../cf_db.h"
+#include "../cf_index.h"
+#include "../cf_string.h"
+#include "../db_types.h"
+
+#include <errno.h>
+#include <limits.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+
+static int test_snippet_lines(void);
+static int test_snippet_log_compact(void);
+static int test_snippet_off(void);
+TEST_DECL(test_snippet_lines);
+TEST_DECL(test_snippet_log_compact);
+TEST_DECL(test_snippet_off);
+
+/*
+ * Longest line in "b.c". It's cut at `DB_SNIPPET_MAX_LEN` bytes when stored.
+ */
+#define WIDE_LEN (DB_SNIPPET_MAX_LEN + 60)
+
+/*
+ * A typename, and the line it's declared on as stored: trimmed and cut.
+ */
+typedef struct {
+	const char *name;
+	const char *line;
+} snippet_case_t;
+
+static const char *const tus[] = {
+	"a.c",
+	"b.c",
+};
+
+static int write_tree(const src_tree_t *tree, char *wide);
+static int check_snippets(const src_tree_t *tree, const char *db_name,
+		const char *wide);
+
+/*
+ * Index both TUs in one run with snippets, then check the line of every
+ * typename.
+ *
+ * Each TU indexes part of "h.h" that the other doesn't, so the header's lines
+ * from both TUs must have been merged.
+ */
+static int
+test_snippet_lines(void)
+{
+	src_tree_t tree;
+	char wide[WIDE_LEN + 1];
+	const index_config_t config = {
+		.snippets = true,
+	};
+
+	ASSERT_EQ(make_src_tree(&tree), 0);
+	ASSERT_EQ(write_tree(&tree, wide), 0);
+	ASSERT_EQ(src_tree_index(&tree, "x.db", tus, ARRAY_LEN(tus), &config),
+			0);
+	ASSERT_EQ(check_snippets(&tree, "x.db", wide), 0);
+	free_src_tree(&tree);
+	return 0;
+}
+
+/*
+ * Index each TU to its own log with snippets, then compact the logs. The
+ * compacted database must have the same lines as one indexed directly.
+ */
+static int
+test_snippet_log_compact(void)
+{
+	src_tree_t tree;
+	char wide[WIDE_LEN + 1];
+
+	const char *const logs[] = {
+		"a.log",
+		"b.log",
+	};
+	const index_config_t log_config = {
+		.db_kind = index_db_log,
+		.snippets = true,
+	};
+	const index_config_t compact_config = {
+		.input_kind = input_log,
+	};
+
+	ASSERT_EQ(make_src_tree(&tree), 0);
+	ASSERT_EQ(write_tree(&tree, wide), 0);
+	for (size_t i = 0; i < ARRAY_LEN(tus); ++i) {
+		ASSERT_EQ(src_tree_index(&tree, logs[i], &tus[i], 1,
+				&log_config), 0);
+	}
+	ASSERT_EQ(src_tree_index(&tree, "x.db", logs, ARRAY_LEN(logs),
+			&compact_config), 0);
+	ASSERT_EQ(check_snippets(&tree, "x.db", wide), 0);
+	free_src_tree(&tree);
+	return 0;
+}
+
+/*
+ * Without snippets, no line is stored.
+ */
+static int
+test_snippet_off(void)
+{
+	src_tree_t tree;
+	cf_db_t db;
+	char wide[WIDE_LEN + 1];
+	char path[PATH_MAX];
+	db_typename_iter_t iter;
+	db_typename_t entry;
+	loc_ctx_t loc;
+	cf_str_t name;
+	cf_str_t line;
+	const index_config_t config = {0};
+
+	ASSERT_EQ(make_src_tree(&tree), 0);
+	ASSERT_EQ(write_tree(&tree, wide), 0);
+	ASSERT_EQ(src_tree_index(&tree, "x.db", tus, ARRAY_LEN(tus), &config),
+			0);
+
+	ASSERT_EQ(src_tree_path(&tree, "x.db", path, sizeof(path)), 0);
+	ASSERT_EQ(cf_db_open_sql(path, /*ro*/true, &db), 0);
+	cf_str_borrow("pt", strlen("pt"), &name);
+	ASSERT_EQ(cf_db_typename_find(&db, &name, NULL, &iter), 0);
+	ASSERT(db_typename_iter_next(&iter));
+	db_typename_iter_peek(&iter, &entry, &loc);
+	ASSERT_EQ(cf_db_snippet_lookup(&db, loc.file, loc.line, &line),
+			ENOENT);
+	db_typename_iter_free(&iter);
+
+	ASSERT_EQ(cf_db_close(&db), 0);
+	free_src_tree(&tree);
+	return 0;
+}
+
+/*
+ * Write the sources of the tests to `tree`. Format the line of `wide` as it's
+ * stored to `wide`.
+ *
+ * "h.h" declares `only_b` only when included by "b.c". "a.c" has a line with
+ * whitespace around it and "b.c" one longer than `DB_SNIPPET_MAX_LEN`.
+ */
+static int
+write_tree(const src_tree_t *tree, char *wide)
+{
+	int error;
+	char b_src[WIDE_LEN + 128];
+
+	// "struct wide { int a; }; // xxx..."
+	static const char wide_decl[] = "struct wide { int a; }; // ";
+	memcpy(wide, wide_decl, strlen(wide_decl));
+	memset(&wide[strlen(wide_decl)], 'x', WIDE_LEN - strlen(wide_decl));
+	wide[WIDE_LEN] = '\0';
+	snprintf(b_src, sizeof(b_src),
+			"#define B\n"
+			"#include \"h.h\"\n"
+			"typedef struct pt b_pt;\n"
+			"%s\n", wide);
+	wide[DB_SNIPPET_MAX_LEN] = '\0';
+
+	if ((error = src_tree_write(tree, "h.h",
+			"struct pt {\n"
+			"	int x;\n"
+			"};\n"
+			"#ifdef B\n"
+			"struct only_b { int y; };\n"
+			"#endif\n"))) {
+		return error;
+	}
+	if ((error = src_tree_write(tree, "a.c",
+			"#include \"h.h\"\n"
+			"   struct a_only { struct pt p; };   \n"))) {
+		return error;
+	}
+	return src_tree_write(tree, "b.c", b_src);
+}
+
+/*
+ * Check that each typename of the sources in database `db_name` of `tree`
+ * has the stored line it's declared on.
+ */
+static int
+check_snippets(const src_tree_t *tree, const char *db_name, const char *wide)
+{
+	cf_db_t db;
+	char path[PATH_MAX];
+	db_typename_iter_t iter;
+	cf_str_t pattern;
+	loc_ctx_t pt = {0};
+	size_t found = 0;
+
+	const snippet_case_t cases[] = {
+		{"pt", "struct pt {"},
+		{"only_b", "struct only_b { int y; };"},
+		{"a_only", "struct a_only { struct pt p; };"},
+		{"b_pt", "typedef struct pt b_pt;"},
+		{"wide", wide},
+	};
+
+	ASSERT_EQ(src_tree_path(tree, db_name, path, sizeof(path)), 0);
+	ASSERT_EQ(cf_db_open_sql(path, /*ro*/true, &db), 0);
+
+	cf_str_borrow("%", strlen("%"), &pattern);
+	ASSERT_EQ(cf_db_typename_find(&db, &pattern, NULL, &iter), 0);
+	while (db_typename_iter_next(&iter)) {
+		db_typename_t entry;
+		loc_ctx_t loc;
+		cf_str_t line;
+
+		db_typename_iter_peek(&iter, &entry, &loc);
+		const snippet_case_t *c = NULL;
+		for (size_t i = 0; i < ARRAY_LEN(cases); ++i) {
+			if (str_is(&entry.name, cases[i].name)) {
+				c = &cases[i];
+			}
+		}
+		ASSERT(c);
+		found++;
+
+		ASSERT_EQ(cf_db_snippet_lookup(&db, loc.file, loc.line, &line),
+				0);
+		const bool match = str_is(&line, c->line);
+		if (!match) {
+			printf("%s: got '%.*s', want '%s'\n", c->name,
+					(int)cf_str_len(&line), line.str,
+					c->line);
+		}
+		cf_str_free(&line);
+		ASSERT(match);
+
+		if (c == &cases[0]) {
+			pt = loc;
+		}
+	}
+	db_typename_iter_free(&iter);
+	ASSERT_EQ(found, ARRAY_LEN(cases));
+
+	// the line after `pt` is a member's; the one after that nothing's
+	cf_str_t line;
+	ASSERT_EQ(cf_db_snippet_lookup(&db, pt.file, pt.line + 1, &line), 0);
+	cf_str_free(&line);
+	ASSERT_EQ(cf_db_snippet_lookup(&db, pt.file, pt.line + 2, &line),
+			ENOENT);
+
+	ASSERT_EQ(cf_db_close(&db), 0);
+	return 0;
+}
@@ -0,0 +1,127 @@
+/*
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ * Copyright (C) 2024 cfind developer
+ *
+ * Splitting a TU's top-level structs across threads with
+ * `index_config_t::tu_threads`.
+ */
+#define _POSIX_C_SOURCE 200809L // for open_memstream(3)
+#include "test_utils.h"
+#include "src_tree.h"
+#include "db_check.h"
+#include "../cf_index.h"
+
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static int test_split_same_tables(void);
+TEST_DECL(test_split_same_tables);
+
+/*
+ * Number of groups of structs generated by make_split_src(). Each group has
+ * 5 top-level decls; enough for more than one window of a split TU.
+ */
+#define SPLIT_GROUPS 300
+
+static char *make_split_src(void);
+
+/*
+ * Index a TU with many top-level structs on one thread, then split across
+ * several, and compare the tables.
+ *
+ * The generated structs have every kind of name, nest records, and refer to
+ * structs before them, so a struct built out of order would show up as a
+ * different or missing row.
+ */
+static int
+test_split_same_tables(void)
+{
+	int error;
+	src_tree_t tree;
+	char db_path[PATH_MAX];
+	char *unsplit = NULL;
+	char *split = NULL;
+
+	const char *const tus[] = {
+		"many.c",
+	};
+	const index_config_t one_thread = {
+		.tu_threads = 1,
+	};
+	const index_config_t threads = {
+		.tu_threads = 8,
+	};
+
+	char *src = make_split_src();
+	ASSERT(src);
+	ASSERT_EQ(make_src_tree(&tree), 0);
+	error = src_tree_write(&tree, "many.c", src);
+	free(src);
+	ASSERT_EQ(error, 0);
+
+	ASSERT_EQ(src_tree_index(&tree, "unsplit.db", tus, ARRAY_LEN(tus),
+			&one_thread), 0);
+	ASSERT_EQ(src_tree_index(&tree, "split.db", tus, ARRAY_LEN(tus),
+			&threads), 0);
+
+	ASSERT_EQ(src_tree_path(&tree, "unsplit.db", db_path, sizeof(db_path)),
+			0);
+	ASSERT_EQ(dump_db_entries(db_path, &unsplit), 0);
+	ASSERT_EQ(src_tree_path(&tree, "split.db", db_path, sizeof(db_path)), 0);
+	ASSERT_EQ(dump_db_entries(db_path, &split), 0);
+
+	error = strcmp(unsplit, split);
+	if (error) {
+		printf("unsplit:\n%s\nsplit:\n%s\n", unsplit, split);
+	}
+	ASSERT(strstr(unsplit, "typename s299 "));
+	free(unsplit);
+	free(split);
+	free_src_tree(&tree);
+
+	ASSERT_EQ(error, 0);
+	return 0;
+}
+
+/*
+ * Generate `SPLIT_GROUPS` groups of a direct-name struct, an unnamed struct
+ * with a typedef name, a union, an enum, and a struct with nested records.
+ *
+ * Return a heap string to free(3), or NULL on failure.
+ */
+static char *
+make_split_src(void)
+{
+	char *src;
+	size_t len;
+
+	FILE *f = open_memstream(&src, &len);
+	if (!f) {
+		return NULL;
+	}
+
+	fprintf(f, "struct s0 { int v; };\n");
+	for (unsigned i = 1; i < SPLIT_GROUPS; ++i) {
+		fprintf(f, "struct s%u { struct s%u prev; int v%u; };\n", i, i - 1,
+				i);
+		fprintf(f, "typedef struct { struct s%u *p; long l; } t%u;\n", i, i);
+		fprintf(f, "union u%u { t%u t; struct s%u s; };\n", i, i, i);
+		fprintf(f, "enum e%u { e%u_a, e%u_b };\n", i, i, i);
+		fprintf(f, "struct n%u { struct { int a; } anon; "
+				"struct n%u_in { union u%u u; } in; enum e%u e; };\n",
+				i, i, i, i);
+	}
+
+	if (ferror(f)) {
+		fclose(f);
+		free(src);
+		return NULL;
+	}
+	if (fclose(f)) {
+		free(src);
+		return NULL;
+	}
+	return src;
+}
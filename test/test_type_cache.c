@@ -0,0 +1,195 @@
+/*
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ * Copyright (C) 2024 cfind developer
+ *
+ * The file and type caches the indexer keeps between TUs.
+ */
+#define _POSIX_C_SOURCE 200809L // for PATH_MAX
+#include "test_utils.h"
+#include "src_tree.h"
+#include "db_check.h"
+#include "../cf_index.h"
+
+#include <errno.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static int test_type_cache_tag_vs_typedef(void);
+static int test_type_cache_shared_header(void);
+TEST_DECL(test_type_cache_tag_vs_typedef);
+TEST_DECL(test_type_cache_shared_header);
+
+/*
+ * A struct tag and a typedef of another struct, with the same name in the
+ * same file. The tag and typedef namespaces are separate, so these are two
+ * typenames of two types.
+ */
+static const char tag_vs_typedef_src[] =
+	"struct foo { int a; };\n"
+	"typedef struct { int b; } foo;\n"
+	"struct bar { foo f; struct foo g; };\n";
+
+/*
+ * Index the `n` source files `names` of `tree` into a new sqlite database
+ * `db_name` in the tree, all in one run.
+ */
+static int
+index_sources(const src_tree_t *tree, const char *db_name,
+		const char *const *names, size_t n)
+{
+	int error;
+	char db_path[PATH_MAX];
+	char paths[4][PATH_MAX];
+	const char *inputs[4];
+
+	if (n > ARRAY_LEN(inputs)) {
+		return E2BIG;
+	}
+	for (size_t i = 0; i < n; ++i) {
+		if ((error = src_tree_path(tree, names[i], paths[i],
+				sizeof(paths[i])))) {
+			return error;
+		}
+		inputs[i] = paths[i];
+	}
+	if ((error = src_tree_path(tree, db_name, db_path, sizeof(db_path)))) {
+		return error;
+	}
+
+	const index_config_t config = {
+		.db_kind = index_db_sql,
+		.input_kind = input_source_file,
+		.db_args.sql_path = db_path,
+		.input_paths = inputs,
+		.num_inputs = n,
+	};
+	return cf_index_project(&config);
+}
+
+/*
+ * Count the lines of `dump` that start with `prefix`.
+ */
+static size_t
+count_lines(const char *dump, const char *prefix)
+{
+	size_t count = 0;
+	const size_t len = strlen(prefix);
+
+	for (const char *line = dump; *line; ) {
+		count += !strncmp(line, prefix, len);
+		const char *end = strchr(line, '\n');
+		line = end ? (end + 1) : (line + strlen(line));
+	}
+	return count;
+}
+
+/*
+ * Index `tag_vs_typedef_src` and check both `foo`s are kept apart.
+ *
+ * Steps:
+ * - index the file
+ * - check there are two `foo` typenames, one of each kind, each naming the
+ *   struct it's declared with
+ * - check member `bar::f` is of the typedef'd struct and `bar::g` of
+ *   `struct foo`
+ */
+static int
+test_type_cache_tag_vs_typedef(void)
+{
+	src_tree_t tree;
+	char db_path[PATH_MAX];
+	char path[PATH_MAX];
+	char line[4 * PATH_MAX];
+	char *dump;
+	size_t dangling;
+
+	const char *const names[] = {
+		"x.c",
+	};
+
+	ASSERT_EQ(make_src_tree(&tree), 0);
+	ASSERT_EQ(src_tree_write(&tree, "x.c", tag_vs_typedef_src), 0);
+	ASSERT_EQ(index_sources(&tree, "x.db", names, ARRAY_LEN(names)), 0);
+
+	ASSERT_EQ(src_tree_path(&tree, "x.db", db_path, sizeof(db_path)), 0);
+	ASSERT_EQ(count_dangling_refs(db_path, &dangling), 0);
+	ASSERT_EQ(dangling, 0);
+	ASSERT_EQ(dump_db_entries(db_path, &dump), 0);
+	ASSERT_EQ(src_tree_path(&tree, "x.c", path, sizeof(path)), 0);
+
+	ASSERT_EQ(count_lines(dump, "type "), 3);
+	ASSERT_EQ(count_lines(dump, "typename foo "), 2);
+
+	// kind 1 is `struct`, 2 is `typedef`
+	snprintf(line, sizeof(line), "typename foo 1 0 %s:1:1 %s:1:1\n", path,
+			path);
+	ASSERT(strstr(dump, line));
+	snprintf(line, sizeof(line), "typename foo 2 0 %s:2:1 %s:2:9\n", path,
+			path);
+	ASSERT(strstr(dump, line));
+
+	snprintf(line, sizeof(line), "member %s:3:1 f %s:3:14 %s:2:9\n", path,
+			path, path);
+	ASSERT(strstr(dump, line));
+	snprintf(line, sizeof(line), "member %s:3:1 g %s:3:21 %s:1:1\n", path,
+			path, path);
+	ASSERT(strstr(dump, line));
+
+	free(dump);
+	free_src_tree(&tree);
+	return 0;
+}
+
+/*
+ * Index two TUs that include the same header in one run, so the second TU
+ * finds the header's file and types in the caches.
+ *
+ * The header is only stored once, and types with the same name don't resolve
+ * to each other from the cache. The result must dump the same as the
+ * header's types indexed from one TU.
+ */
+static int
+test_type_cache_shared_header(void)
+{
+	int error;
+	src_tree_t tree;
+	char db_path[PATH_MAX];
+	char *one = NULL;
+	char *two = NULL;
+
+	const char *const one_tu[] = {
+		"a.c",
+	};
+	const char *const two_tus[] = {
+		"a.c",
+		"b.c",
+	};
+
+	ASSERT_EQ(make_src_tree(&tree), 0);
+	ASSERT_EQ(src_tree_write(&tree, "h.h", tag_vs_typedef_src), 0);
+	ASSERT_EQ(src_tree_write(&tree, "a.c", "#include \"h.h\"\n"), 0);
+	ASSERT_EQ(src_tree_write(&tree, "b.c", "#include \"h.h\"\n"), 0);
+
+	ASSERT_EQ(index_sources(&tree, "one.db", one_tu, ARRAY_LEN(one_tu)), 0);
+	ASSERT_EQ(index_sources(&tree, "two.db", two_tus, ARRAY_LEN(two_tus)),
+			0);
+
+	ASSERT_EQ(src_tree_path(&tree, "one.db", db_path, sizeof(db_path)), 0);
+	ASSERT_EQ(dump_db_entries(db_path, &one), 0);
+	ASSERT_EQ(src_tree_path(&tree, "two.db", db_path, sizeof(db_path)), 0);
+	ASSERT_EQ(dump_db_entries(db_path, &two), 0);
+
+	error = strcmp(one, two);
+	if (error) {
+		printf("one TU:\n%s\ntwo TUs:\n%s\n", one, two);
+	}
+	ASSERT_EQ(count_lines(two, "typename foo "), 2);
+	free(one);
+	free(two);
+	free_src_tree(&tree);
+
+	ASSERT_EQ(error, 0);
+	return 0;
+}
@@ -0,0 +1,422 @@
+/*
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ * Copyright (C) 2024 cfind developer
+ *
+ * Aggregated type use counts with `index_config_t::count_uses`.
+ */
+#define _POSIX_C_SOURCE 200809L // for PATH_MAX
+#include "test_utils.h"
+#include "src_tree.h"
+#include "db_check.h"
+#include "../cf_db.h"
+#include "../cf_index.h"
+#include "../cf_string.h"
+#include "../cf_vector.h"
+#include "../db_types.h"
+
+#include <errno.h>
+#include <limits.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static int test_use_count_totals(void);
+static int test_use_count_merge(void);
+static int test_use_count_rows(void);
+TEST_DECL(test_use_count_totals);
+TEST_DECL(test_use_count_merge);
+TEST_DECL(test_use_count_rows);
+
+CF_VEC_FUNC_DECL(use_count_vec_t, db_type_use_count_t, use_count_vec);
+
+/*
+ * Most distinct (kind, file, type) keys a tally holds.
+ */
+#define TALLY_MAX_KEYS 32
+
+/*
+ * Number of uses of one (kind, file, type) key in a database dump.
+ *
+ * Members
+ * - key
+ *   "KIND FILE TYPE", with the type as its location label.
+ * - count
+ *   Uses of `key`.
+ */
+typedef struct {
+	char key[256];
+	uint64_t count;
+} use_tally_entry_t;
+
+/*
+ * Every key of a dump, sorted by key.
+ */
+typedef struct {
+	use_tally_entry_t entries[TALLY_MAX_KEYS];
+	size_t len;
+} use_tally_t;
+
+static const char *const tus[] = {
+	"a.c",
+	"b.c",
+};
+
+static int write_tree(const src_tree_t *tree);
+static int dump_tree_db(const src_tree_t *tree, const char *db_name,
+		char **out);
+static int tally_uses(const char *dump, const char *prefix,
+		use_tally_t *out);
+static int tally_add(use_tally_t *tally, const char *key, uint64_t count);
+static int compare_entries(const void *a, const void *b);
+static int check_pt_counts(const src_tree_t *tree, const char *db_name);
+static int check_db_pt_counts(cf_db_t *db);
+
+/*
+ * Index the same TUs once with a row per use and once with counts.
+ *
+ * The count of each (kind, file, type) must be the number of use rows of the
+ * first database with that key. The second database keeps at most one sample
+ * row per key and TU, and at least one per key.
+ */
+static int
+test_use_count_totals(void)
+{
+	src_tree_t tree;
+	char *rows = NULL;
+	char *counted = NULL;
+	static use_tally_t row_tally;
+	static use_tally_t count_tally;
+	static use_tally_t sample_tally;
+
+	const index_config_t rows_config = {0};
+	const index_config_t count_config = {
+		.count_uses = true,
+		.use_samples = 1,
+	};
+
+	ASSERT_EQ(make_src_tree(&tree), 0);
+	ASSERT_EQ(write_tree(&tree), 0);
+	ASSERT_EQ(src_tree_index(&tree, "rows.db", tus, ARRAY_LEN(tus),
+			&rows_config), 0);
+	ASSERT_EQ(src_tree_index(&tree, "count.db", tus, ARRAY_LEN(tus),
+			&count_config), 0);
+	ASSERT_EQ(dump_tree_db(&tree, "rows.db", &rows), 0);
+	ASSERT_EQ(dump_tree_db(&tree, "count.db", &counted), 0);
+
+	ASSERT_EQ(tally_uses(rows, "use ", &row_tally), 0);
+	ASSERT_EQ(tally_uses(counted, "count ", &count_tally), 0);
+	ASSERT_EQ(tally_uses(counted, "use ", &sample_tally), 0);
+	ASSERT(!strstr(rows, "\ncount "));
+	free(rows);
+	free(counted);
+
+	ASSERT(row_tally.len);
+	ASSERT_EQ(count_tally.len, row_tally.len);
+	ASSERT_EQ(sample_tally.len, row_tally.len);
+	for (size_t i = 0; i < row_tally.len; ++i) {
+		const use_tally_entry_t *row = &row_tally.entries[i];
+		const use_tally_entry_t *count = &count_tally.entries[i];
+		const use_tally_entry_t *sample = &sample_tally.entries[i];
+
+		ASSERT_EQ(strcmp(count->key, row->key), 0);
+		ASSERT_EQ(count->count, row->count);
+		ASSERT_EQ(strcmp(sample->key, row->key), 0);
+		ASSERT(sample->count <= ARRAY_LEN(tus));
+		ASSERT(sample->count <= row->count);
+	}
+
+	ASSERT_EQ(check_pt_counts(&tree, "count.db"), 0);
+	free_src_tree(&tree);
+	return 0;
+}
+
+/*
+ * Index each TU to a fragment with counts, merge them, and compare with the
+ * TUs indexed with counts directly.
+ *
+ * Both fragments include "h.h", so they both count its uses. Merging must
+ * keep one count for them rather than their sum.
+ */
+static int
+test_use_count_merge(void)
+{
+	int error;
+	src_tree_t tree;
+	char *merged = NULL;
+	char *direct = NULL;
+
+	const char *const frags[] = {
+		"a.frag",
+		"b.frag",
+	};
+	const index_config_t count_config = {
+		.count_uses = true,
+		.use_samples = 1,
+	};
+	const index_config_t merge_config = {
+		.input_kind = input_fragment,
+	};
+
+	ASSERT_EQ(make_src_tree(&tree), 0);
+	ASSERT_EQ(write_tree(&tree), 0);
+	for (size_t i = 0; i < ARRAY_LEN(tus); ++i) {
+		ASSERT_EQ(src_tree_index(&tree, frags[i], &tus[i], 1,
+				&count_config), 0);
+	}
+	ASSERT_EQ(src_tree_index(&tree, "merged.db", frags, ARRAY_LEN(frags),
+			&merge_config), 0);
+	ASSERT_EQ(src_tree_index(&tree, "direct.db", tus, ARRAY_LEN(tus),
+			&count_config), 0);
+
+	ASSERT_EQ(dump_tree_db(&tree, "merged.db", &merged), 0);
+	ASSERT_EQ(dump_tree_db(&tree, "direct.db", &direct), 0);
+
+	error = strcmp(merged, direct);
+	if (error) {
+		printf("merged:\n%s\ndirect:\n%s\n", merged, direct);
+	}
+	free(merged);
+	free(direct);
+
+	ASSERT_EQ(error, 0);
+	ASSERT_EQ(check_pt_counts(&tree, "merged.db"), 0);
+	free_src_tree(&tree);
+	return 0;
+}
+
+/*
+ * Look up use counts in databases indexed with a row per use, in sqlite and
+ * in memory.
+ *
+ * With no aggregated counts, the use rows are counted instead, so `pt` still
+ * has its 8 uses rather than none.
+ */
+static int
+test_use_count_rows(void)
+{
+	src_tree_t tree;
+	cf_db_t db;
+	char paths[ARRAY_LEN(tus)][PATH_MAX];
+	const char *inputs[ARRAY_LEN(tus)];
+
+	const index_config_t rows_config = {0};
+
+	ASSERT_EQ(make_src_tree(&tree), 0);
+	ASSERT_EQ(write_tree(&tree), 0);
+	ASSERT_EQ(src_tree_index(&tree, "rows.db", tus, ARRAY_LEN(tus),
+			&rows_config), 0);
+	ASSERT_EQ(check_pt_counts(&tree, "rows.db"), 0);
+
+	for (size_t i = 0; i < ARRAY_LEN(tus); ++i) {
+		ASSERT_EQ(src_tree_path(&tree, tus[i], paths[i], sizeof(paths[i])),
+				0);
+		inputs[i] = paths[i];
+	}
+	const index_config_t mem_config = {
+		.db_kind = index_db_borrowed,
+		.input_kind = input_source_file,
+		.db_args.db = &db,
+		.input_paths = inputs,
+		.num_inputs = ARRAY_LEN(inputs),
+	};
+	ASSERT_EQ(cf_db_open_mem(&db), 0);
+	ASSERT_EQ(cf_index_project(&mem_config), 0);
+	ASSERT_EQ(check_db_pt_counts(&db), 0);
+	ASSERT_EQ(cf_db_close(&db), 0);
+
+	free_src_tree(&tree);
+	return 0;
+}
+
+/*
+ * Write the sources of the tests to `tree`.
+ *
+ * `pt` is used 3 times in "h.h", which both TUs include, 3 times in "a.c", and
+ * twice in "b.c".
+ */
+static int
+write_tree(const src_tree_t *tree)
+{
+	int error;
+
+	if ((error = src_tree_write(tree, "h.h",
+			"struct pt { int x; int y; };\n"
+			"struct seg {\n"
+			"	struct pt a; struct pt b; struct pt c;\n"
+			"};\n"))) {
+		return error;
+	}
+	if ((error = src_tree_write(tree, "a.c",
+			"#include \"h.h\"\n"
+			"struct tri {\n"
+			"	struct pt p;\n"
+			"	struct pt q;\n"
+			"	struct pt r;\n"
+			"	struct seg s;\n"
+			"};\n"))) {
+		return error;
+	}
+	return src_tree_write(tree, "b.c",
+			"#include \"h.h\"\n"
+			"struct box { struct pt lo; struct pt hi; };\n");
+}
+
+/*
+ * Dump database `db_name` of `tree` with dump_db_entries(), after checking
+ * it has no dangling references.
+ */
+static int
+dump_tree_db(const src_tree_t *tree, const char *db_name, char **out)
+{
+	int error;
+	char path[PATH_MAX];
+	size_t dangling;
+
+	if ((error = src_tree_path(tree, db_name, path, sizeof(path)))) {
+		return error;
+	}
+	if ((error = count_dangling_refs(path, &dangling))) {
+		return error;
+	}
+	if (dangling) {
+		printf("%s: %zu dangling refs\n", db_name, dangling);
+		return EINVAL;
+	}
+	return dump_db_entries(path, out);
+}
+
+/*
+ * Tally the lines of `dump` that start with `prefix`: "use " lines count one
+ * use each, and "count " lines their count.
+ */
+static int
+tally_uses(const char *dump, const char *prefix, use_tally_t *out)
+{
+	int error;
+	const bool counts = !strcmp(prefix, "count ");
+	char loc[PATH_MAX];
+	char base[PATH_MAX];
+	char key[sizeof(out->entries[0].key)];
+
+	memset(out, 0, sizeof(*out));
+	for (const char *line = dump; *line; ) {
+		const char *end = strchr(line, '\n');
+		const char *next = end ? (end + 1) : (line + strlen(line));
+		unsigned kind;
+		unsigned long long count = 1;
+
+		if (strncmp(line, prefix, strlen(prefix))) {
+			line = next;
+			continue;
+		}
+		if (counts) {
+			if (sscanf(line, "count %u %llu %4095s %4095s", &kind,
+					&count, loc, base) != 4) {
+				return EINVAL;
+			}
+		} else {
+			if (sscanf(line, "use %u %4095s %4095s", &kind, loc,
+					base) != 3) {
+				return EINVAL;
+			}
+			// "path:line:column" to "path"
+			for (int i = 0; i < 2; ++i) {
+				char *colon = strrchr(loc, ':');
+				if (!colon) {
+					return EINVAL;
+				}
+				*colon = '\0';
+			}
+		}
+		const int n = snprintf(key, sizeof(key), "%u %s %s", kind, loc,
+				base);
+		if ((n < 0) || ((size_t)n >= sizeof(key))) {
+			return ENAMETOOLONG;
+		}
+		if ((error = tally_add(out, key, count))) {
+			return error;
+		}
+		line = next;
+	}
+
+	qsort(out->entries, out->len, sizeof(out->entries[0]), compare_entries);
+	return 0;
+}
+
+static int
+tally_add(use_tally_t *tally, const char *key, uint64_t count)
+{
+	for (size_t i = 0; i < tally->len; ++i) {
+		if (!strcmp(tally->entries[i].key, key)) {
+			tally->entries[i].count += count;
+			return 0;
+		}
+	}
+	if (tally->len == TALLY_MAX_KEYS) {
+		return E2BIG;
+	}
+	use_tally_entry_t *entry = &tally->entries[tally->len++];
+	strcpy(entry->key, key);
+	entry->count = count;
+	return 0;
+}
+
+static int
+compare_entries(const void *a, const void *b)
+{
+	const use_tally_entry_t *x = a;
+	const use_tally_entry_t *y = b;
+	return strcmp(x->key, y->key);
+}
+
+/*
+ * Run check_db_pt_counts() on database `db_name` of `tree`.
+ */
+static int
+check_pt_counts(const src_tree_t *tree, const char *db_name)
+{
+	cf_db_t db;
+	char path[PATH_MAX];
+
+	ASSERT_EQ(src_tree_path(tree, db_name, path, sizeof(path)), 0);
+	ASSERT_EQ(cf_db_open_sql(path, /*ro*/true, &db), 0);
+	ASSERT_EQ(check_db_pt_counts(&db), 0);
+	ASSERT_EQ(cf_db_close(&db), 0);
+	return 0;
+}
+
+/*
+ * Look up the use counts of `pt` in `db`, as `cfind typeuse` does. They must
+ * add up to its 8 uses across 3 files.
+ */
+static int
+check_db_pt_counts(cf_db_t *db)
+{
+	db_typename_iter_t iter;
+	db_typename_t entry;
+	loc_ctx_t loc;
+	cf_str_t name;
+	use_count_vec_t counts;
+	uint64_t total = 0;
+
+	cf_str_borrow("pt", strlen("pt"), &name);
+	ASSERT_EQ(cf_db_typename_find(db, &name, NULL, &iter), 0);
+	ASSERT(db_typename_iter_next(&iter));
+	db_typename_iter_peek(&iter, &entry, &loc);
+	const type_ref_t pt = entry.base_type;
+	db_typename_iter_free(&iter);
+
+	use_count_vec_make(&counts);
+	ASSERT_EQ(cf_db_type_use_count_lookup(db, pt, &counts), 0);
+	ASSERT_EQ(use_count_vec_len(&counts), 3);
+	for (size_t i = 0; i < use_count_vec_len(&counts); ++i) {
+		const db_type_use_count_t *count = use_count_vec_at(&counts, i);
+		ASSERT_EQ(count->kind, type_use_decl);
+		total += count->count;
+	}
+	ASSERT_EQ(total, 8);
+	use_count_vec_free(&counts);
+	return 0;
+}
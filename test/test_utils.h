@@ -7,9 +7,12 @@
 #pragma once
 
 #include "../cc_support.h"
+#include "../cf_string.h"
 #include "test_runner.h"
 
+#include <stdbool.h>
 #include <stdio.h>
+#include <string.h>
 
 __BEGIN_DECLS
 
@@ -56,4 +59,14 @@ __BEGIN_DECLS
 	} \
 } while(0)
 
+/*
+ * Whether `str` is exactly `cstr`.
+ */
+__attribute__((unused)) static inline bool
+str_is(const cf_str_t *str, const char *cstr)
+{
+	const size_t len = strlen(cstr);
+	return (cf_str_len(str) == len) && !strncmp(str->str, cstr, len);
+}
+
 __END_DECLS
@@ -0,0 +1,119 @@
+/*
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ * Copyright (C) 2024 cfind developer
+ *
+ * Incremental indexing with `index_config_t::vcs_path`.
+ */
+#define _POSIX_C_SOURCE 200809L // for PATH_MAX
+#include "test_utils.h"
+#include "src_tree.h"
+#include "db_check.h"
+#include "../cf_index.h"
+
+#include <limits.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static int test_vcs_changed_header(void);
+TEST_DECL(test_vcs_changed_header);
+
+static const char *const tu_names[] = {
+	"a.c",
+	"b.c",
+};
+
+/*
+ * Index every TU of `tree` into sqlite database `db_name` in the tree.
+ *
+ * With `vcs`, update the database from the previous run in place.
+ */
+static int
+index_tree(const src_tree_t *tree, const char *db_name, bool vcs)
+{
+	int error;
+	char db_path[PATH_MAX];
+
+	if ((error = src_tree_path(tree, db_name, db_path, sizeof(db_path)))) {
+		return error;
+	}
+
+	const char *const inputs[] = {
+		tree->root,
+	};
+	const index_config_t config = {
+		.db_kind = index_db_sql,
+		.input_kind = input_comp_db,
+		.db_args.sql_path = db_path,
+		.input_paths = inputs,
+		.num_inputs = ARRAY_LEN(inputs),
+		.vcs_path = vcs ? tree->root : NULL,
+	};
+
+	return cf_index_project(&config);
+}
+
+/*
+ * Change a header that types in an unchanged file depend on, then reindex.
+ *
+ * Struct `rect` is in unchanged "a.c" but its members are of type `pt`, which
+ * moves within changed "inc/common.h". `rect` must be reinserted along with
+ * `pt` rather than left referencing the purged `pt`. TU "b.c" doesn't include
+ * the header and isn't reindexed; its types must be kept.
+ *
+ * The updated database must dump the same as one indexed from scratch.
+ */
+static int
+test_vcs_changed_header(void)
+{
+	int error;
+	src_tree_t tree;
+	char db_path[PATH_MAX];
+	char *updated = NULL;
+	char *scratch = NULL;
+	size_t dangling;
+
+	ASSERT_EQ(make_src_tree(&tree), 0);
+	ASSERT_EQ(src_tree_write(&tree, "inc/common.h",
+			"struct pt { int x; int y; };\n"), 0);
+	ASSERT_EQ(src_tree_write(&tree, "a.c",
+			"#include \"inc/common.h\"\n"
+			"struct rect { struct pt a; struct pt b; };\n"
+			"struct frame { struct rect r; };\n"), 0);
+	ASSERT_EQ(src_tree_write(&tree, "b.c",
+			"struct other { int z; };\n"), 0);
+	ASSERT_EQ(src_tree_write_comp_db(&tree, tu_names, ARRAY_LEN(tu_names)),
+			0);
+	ASSERT_EQ(src_tree_commit(&tree), 0);
+
+	ASSERT_EQ(index_tree(&tree, "updated.db", true), 0);
+
+	// move `pt` so its old rowid and location are both stale
+	ASSERT_EQ(src_tree_write(&tree, "inc/common.h",
+			"struct pad { char c; };\n"
+			"struct pt { long x; long y; };\n"), 0);
+	ASSERT_EQ(index_tree(&tree, "updated.db", true), 0);
+	ASSERT_EQ(index_tree(&tree, "scratch.db", false), 0);
+
+	ASSERT_EQ(src_tree_path(&tree, "updated.db", db_path, sizeof(db_path)),
+			0);
+	ASSERT_EQ(count_dangling_refs(db_path, &dangling), 0);
+	ASSERT_EQ(dangling, 0);
+	ASSERT_EQ(dump_db_entries(db_path, &updated), 0);
+
+	ASSERT_EQ(src_tree_path(&tree, "scratch.db", db_path, sizeof(db_path)),
+			0);
+	ASSERT_EQ(dump_db_entries(db_path, &scratch), 0);
+
+	error = strcmp(updated, scratch);
+	if (error) {
+		printf("updated:\n%s\nscratch:\n%s\n", updated, scratch);
+	}
+	free(updated);
+	free(scratch);
+	free_src_tree(&tree);
+
+	ASSERT_EQ(error, 0);
+	return 0;
+}
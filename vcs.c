@@ -0,0 +1,442 @@
+/*
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ * Copyright (C) 2024 cfind developer
+ *
+ * git(1) backed implementation of vcs.h.
+ *
+ * `git` is run as a child process with posix_spawnp(3). No shell is involved
+ * so paths with metacharacters are passed through as-is. Output is read
+ * through a pipe into a single heap buffer.
+ */
+#define _POSIX_C_SOURCE 200809L // for realpath(3)
+#define _XOPEN_SOURCE 700
+#include "vcs.h"
+
+#include "cf_alloc.h"
+#include "cf_assert.h"
+#include "cf_print.h"
+#include "cf_vector.h"
+
+#include <errno.h>
+#include <spawn.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+extern char **environ;
+
+CF_VEC_FUNC_DECL(vcs_file_vec_t, vcs_file_t, vcs_file_vec);
+
+static int run_git(char *const argv[], char **out, size_t *len_out);
+static int read_all(int fd, char **out, size_t *len_out);
+static int load_root(const char *repo_path, vcs_tree_t *tree);
+static int load_files(vcs_tree_t *tree);
+static int load_modified(vcs_tree_t *tree);
+static int parse_ls_entry(char *entry, size_t len, vcs_file_t *out);
+static int compare_file(const void *lhs, const void *rhs);
+static vcs_file_t *find_file(const vcs_tree_t *tree, const char *path,
+		size_t len);
+
+/*
+ * Snapshot the git repository containing `repo_path`.
+ *
+ * `repo_path` can be any directory inside the working tree. On success, `out`
+ * must later be freed with vcs_tree_free().
+ *
+ * Steps:
+ * - find the top-level directory of the working tree
+ * - list every file in the index along with its blob id
+ * - mark files that differ between the index and the working tree
+ */
+int
+vcs_tree_load(const char *repo_path, vcs_tree_t *out)
+{
+	int error;
+
+	memset(out, 0, sizeof(*out));
+	vcs_file_vec_make(&out->files);
+
+	if ((error = load_root(repo_path, out))) {
+		cf_print_err("'%s' is not in a git repository, error %d\n",
+				repo_path, error);
+		goto fail;
+	}
+
+	if ((error = load_files(out))) {
+		cf_print_err("cannot list files in '%s', error %d\n",
+				out->root, error);
+		goto fail;
+	}
+
+	if ((error = load_modified(out))) {
+		cf_print_err("cannot list modified files in '%s', error %d\n",
+				out->root, error);
+		goto fail;
+	}
+
+	cf_print_debug("loaded %zu files from git repo '%s'\n",
+			vcs_file_vec_len(&out->files), out->root);
+	return 0;
+
+fail:
+	vcs_tree_free(out);
+	return error;
+}
+
+void
+vcs_tree_free(vcs_tree_t *tree)
+{
+	vcs_file_vec_free(&tree->files);
+	free(tree->root); // from realpath(3)
+	cf_free(tree->ls_buf);
+	tree->root = NULL;
+	tree->ls_buf = NULL;
+}
+
+/*
+ * Get the state of the file at absolute path `path`, `len` bytes long.
+ *
+ * `path` must already be cleaned the same way `vcs_tree_t::root` is. It's
+ * untracked if it's outside of the repository or git doesn't know about it.
+ *
+ * For tracked files, `*id_out` is set to a string borrowing the file's blob
+ * id. It lives as long as `tree`.
+ */
+vcs_file_state_t
+vcs_tree_lookup(const vcs_tree_t *tree, const char *path, size_t len,
+		cf_str_t *id_out)
+{
+	const size_t root_len = tree->root_len;
+
+	// strip the "<root>/" prefix
+	// (a root of "/" already ends in a separator)
+	const size_t prefix_len = root_len + (tree->root[root_len - 1] != '/');
+	if (len <= prefix_len || memcmp(path, tree->root, root_len) ||
+			path[prefix_len - 1] != '/') {
+		return vcs_untracked;
+	}
+
+	const vcs_file_t *file = find_file(tree, path + prefix_len,
+			len - prefix_len);
+	if (!file) {
+		return vcs_untracked;
+	}
+
+	cf_str_borrow_str(&file->id, id_out);
+	return file->modified ? vcs_modified : vcs_clean;
+}
+
+/*
+ * Run git(1) with arguments `argv` and capture its stdout.
+ *
+ * `argv[0]` must be "git" and `argv` must be NULL-terminated. On success,
+ * `*out` is set to a NUL-terminated heap buffer of `*len_out` bytes, not
+ * counting the terminator. stderr is inherited so git's own diagnostics are
+ * visible.
+ *
+ * A nonzero exit status is reported as EIO.
+ */
+static int
+run_git(char *const argv[], char **out, size_t *len_out)
+{
+	int error;
+	int fds[2];
+	posix_spawn_file_actions_t actions;
+	pid_t pid;
+
+	if (pipe(fds) == -1) {
+		return errno;
+	}
+
+	// child: stdout becomes the write end of the pipe
+	if ((error = posix_spawn_file_actions_init(&actions))) {
+		goto fail_pipe;
+	}
+	if ((error = posix_spawn_file_actions_adddup2(&actions, fds[1],
+			STDOUT_FILENO))) {
+		goto fail_actions;
+	}
+	if ((error = posix_spawn_file_actions_addclose(&actions, fds[0])) ||
+			(error = posix_spawn_file_actions_addclose(&actions, fds[1]))) {
+		goto fail_actions;
+	}
+
+	if ((error = posix_spawnp(&pid, argv[0], &actions, NULL, argv,
+			environ))) {
+		cf_print_err("cannot run '%s', error %d\n", argv[0], error);
+		goto fail_actions;
+	}
+
+	// parent: only reads
+	(void)close(fds[1]);
+	fds[1] = -1;
+
+	error = read_all(fds[0], out, len_out);
+
+	// always reap the child, even if reading failed
+	int status;
+	while (waitpid(pid, &status, 0) == -1) {
+		if (errno != EINTR) {
+			if (!error) {
+				error = errno;
+			}
+			break;
+		}
+	}
+	if (!error && (!WIFEXITED(status) || WEXITSTATUS(status))) {
+		error = EIO;
+	}
+	if (error) {
+		cf_free(*out);
+		*out = NULL;
+	}
+
+fail_actions:
+	(void)posix_spawn_file_actions_destroy(&actions);
+fail_pipe:
+	(void)close(fds[0]);
+	if (fds[1] != -1) {
+		(void)close(fds[1]);
+	}
+	return error;
+}
+
+/*
+ * Read from `fd` until EOF into a NUL-terminated heap buffer.
+ */
+static int
+read_all(int fd, char **out, size_t *len_out)
+{
+	int error = 0;
+	char *buf = NULL;
+	size_t len = 0;
+	size_t capacity = 0;
+
+	for (;;) {
+		// always keep one byte for the NUL terminator
+		if (len + 1 >= capacity) {
+			const size_t new_capacity = capacity ? (capacity * 2) : 4096;
+			char *const new_buf = cf_realloc(buf, new_capacity);
+			if (!new_buf) {
+				error = ENOMEM;
+				break;
+			}
+			buf = new_buf;
+			capacity = new_capacity;
+		}
+
+		const ssize_t ret = read(fd, buf + len, capacity - len - 1);
+		if (ret == -1) {
+			if (errno == EINTR) {
+				continue;
+			}
+			error = errno;
+			break;
+		}
+		if (!ret) {
+			break;
+		}
+		len += (size_t)ret;
+	}
+
+	if (error) {
+		cf_free(buf);
+		return error;
+	}
+
+	buf[len] = '\0';
+	*out = buf;
+	*len_out = len;
+	return 0;
+}
+
+/*
+ * Set `tree->root` to the cleaned top-level directory of the working tree
+ * that contains `repo_path`.
+ */
+static int
+load_root(const char *repo_path, vcs_tree_t *tree)
+{
+	int error;
+	char *buf;
+	size_t len;
+
+	char *const argv[] = {
+		"git", "-C", (char *)repo_path, "rev-parse", "--show-toplevel", NULL,
+	};
+	if ((error = run_git(argv, &buf, &len))) {
+		return error;
+	}
+
+	// strip trailing newline
+	while (len && (buf[len - 1] == '\n')) {
+		buf[--len] = '\0';
+	}
+	if (!len) {
+		error = ENOENT;
+		goto fail;
+	}
+
+	// match the cleaning done to paths stored in the database
+	if (!(tree->root = realpath(buf, NULL))) {
+		error = errno;
+		goto fail;
+	}
+	tree->root_len = strlen(tree->root);
+	error = 0;
+
+fail:
+	cf_free(buf);
+	return error;
+}
+
+/*
+ * Fill `tree->files` with every file in the git index.
+ *
+ * Steps:
+ * - run git-ls-files(1) with NUL-separated output
+ * - parse each entry into a `vcs_file_t` that borrows from the output buffer
+ * - sort by path for vcs_tree_lookup()
+ */
+static int
+load_files(vcs_tree_t *tree)
+{
+	int error;
+	size_t len;
+
+	char *const argv[] = {
+		"git", "-C", tree->root, "ls-files", "--stage", "-z", NULL,
+	};
+	if ((error = run_git(argv, &tree->ls_buf, &len))) {
+		return error;
+	}
+
+	char *entry = tree->ls_buf;
+	const char *const end = entry + len;
+	while (entry < end) {
+		const size_t entry_len = strnlen(entry, (size_t)(end - entry));
+
+		vcs_file_t file;
+		if ((error = parse_ls_entry(entry, entry_len, &file))) {
+			cf_print_err("bad ls-files entry '%.*s'\n", (int)entry_len, entry);
+			return error;
+		}
+		if (!vcs_file_vec_push(&tree->files, &file)) {
+			return ENOMEM;
+		}
+
+		entry += entry_len + 1;
+	}
+
+	const size_t count = vcs_file_vec_len(&tree->files);
+	if (count) {
+		qsort(vcs_file_vec_at(&tree->files, 0), count, sizeof(vcs_file_t),
+				compare_file);
+	}
+	return 0;
+}
+
+/*
+ * Parse a single git-ls-files(1) `--stage` entry.
+ *
+ * The format is "<mode> SP <object> SP <stage> TAB <path>". A nonzero stage
+ * means the file has merge conflicts. Treat it as modified because there is
+ * no single blob describing it.
+ */
+static int
+parse_ls_entry(char *entry, size_t len, vcs_file_t *out)
+{
+	char *const end = entry + len;
+
+	char *const id = memchr(entry, ' ', len);
+	if (!id) {
+		return EINVAL;
+	}
+	char *const stage = memchr(id + 1, ' ', (size_t)(end - (id + 1)));
+	if (!stage) {
+		return EINVAL;
+	}
+	char *const path = memchr(stage + 1, '\t', (size_t)(end - (stage + 1)));
+	if (!path || (path + 1 == end)) {
+		return EINVAL;
+	}
+
+	cf_str_borrow(id + 1, (size_t)(stage - (id + 1)), &out->id);
+	cf_str_borrow(path + 1, (size_t)(end - (path + 1)), &out->path);
+	out->modified = (stage[1] != '0');
+	return 0;
+}
+
+/*
+ * Mark every file with unstaged changes in `tree` as modified.
+ *
+ * Staged-but-uncommitted changes are already reflected in the blob ids from
+ * git-ls-files(1), so only the diff between the index and the working tree
+ * matters.
+ */
+static int
+load_modified(vcs_tree_t *tree)
+{
+	int error;
+	char *buf;
+	size_t len;
+
+	char *const argv[] = {
+		"git", "-C", tree->root, "diff", "--name-only", "-z", NULL,
+	};
+	if ((error = run_git(argv, &buf, &len))) {
+		return error;
+	}
+
+	const char *path = buf;
+	const char *const end = buf + len;
+	while (path < end) {
+		const size_t path_len = strnlen(path, (size_t)(end - path));
+
+		vcs_file_t *const file = find_file(tree, path, path_len);
+		if (file) {
+			file->modified = true;
+		}
+
+		path += path_len + 1;
+	}
+
+	cf_free(buf);
+	return 0;
+}
+
+static int
+compare_file(const void *lhs_, const void *rhs_)
+{
+	const vcs_file_t *const lhs = lhs_;
+	const vcs_file_t *const rhs = rhs_;
+	const size_t lhs_len = cf_str_len(&lhs->path);
+	const size_t rhs_len = cf_str_len(&rhs->path);
+
+	const int ret = memcmp(lhs->path.str, rhs->path.str,
+			(lhs_len < rhs_len) ? lhs_len : rhs_len);
+	if (ret) {
+		return ret;
+	}
+	return (lhs_len > rhs_len) - (lhs_len < rhs_len);
+}
+
+/*
+ * Binary search `tree->files` for repo-relative path `path`.
+ */
+static vcs_file_t *
+find_file(const vcs_tree_t *tree, const char *path, size_t len)
+{
+	const size_t count = vcs_file_vec_len(&tree->files);
+	if (!count) {
+		return NULL;
+	}
+
+	vcs_file_t key;
+	cf_str_borrow(path, len, &key.path);
+	return bsearch(&key, vcs_file_vec_at(&tree->files, 0), count,
+			sizeof(vcs_file_t), compare_file);
+}
@@ -0,0 +1,87 @@
+/*
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ * Copyright (C) 2024 cfind developer
+ *
+ * Version control queries.
+ *
+ * This is used to detect which source files changed since a database was
+ * built. Only git is supported. It's queried by running the `git` command line
+ * tool against a local repository. No network access is needed.
+ */
+#pragma once
+
+#include "cc_support.h"
+#include "cf_string.h"
+#include "cf_vector.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+
+__BEGIN_DECLS
+
+/*
+ * State of a file in a `vcs_tree_t`.
+ *
+ * Enumerators
+ * - vcs_untracked
+ *   The file isn't under version control. E.g., a system header.
+ * - vcs_clean
+ *   The file is tracked and its contents in the working tree match its object
+ *   id.
+ * - vcs_modified
+ *   The file is tracked but it has been modified in the working tree. Its
+ *   object id doesn't describe what's on disk.
+ */
+typedef enum {
+	vcs_untracked = 1,
+	vcs_clean = 2,
+	vcs_modified = 3,
+} vcs_file_state_t;
+
+/*
+ * A single tracked file.
+ *
+ * Members
+ * - path
+ *   Path relative to the root of the repository. Borrowed from
+ *   `vcs_tree_t::ls_buf`.
+ * - id
+ *   git blob id as a hex string. Also borrowed from `vcs_tree_t::ls_buf`.
+ * - modified
+ *   Whether the working tree copy differs from `id`.
+ */
+typedef struct {
+	cf_str_t path;
+	cf_str_t id;
+	bool modified;
+} vcs_file_t;
+
+CF_VEC_TYPE_DECL(vcs_file_vec_t, vcs_file_t);
+
+/*
+ * Snapshot of the files tracked in a repository.
+ *
+ * Members
+ * - root
+ *   Owned, NUL-terminated, realpath(3)-cleaned path of the top-level
+ *   directory of the repository.
+ * - root_len
+ *   strlen(3) of `root`.
+ * - files
+ *   Every tracked file sorted by `vcs_file_t::path`.
+ * - ls_buf
+ *   Raw output of git-ls-files(1). Backing storage for the strings in `files`.
+ */
+typedef struct {
+	char *root;
+	size_t root_len;
+	vcs_file_vec_t files;
+	char *ls_buf;
+} vcs_tree_t;
+
+int vcs_tree_load(const char *repo_path, vcs_tree_t *out);
+void vcs_tree_free(vcs_tree_t *tree);
+vcs_file_state_t vcs_tree_lookup(const vcs_tree_t *tree, const char *path,
+		size_t len, cf_str_t *id_out);
+
+__END_DECLS